@@ -9,8 +9,10 @@
   *        changing state as well as other peripherals changing state.
   *
   * Notes:
-  *        - The "CAN_BUS_Shield-master" library must be added to your Arduino IDE for this
-  *          program to compile successfully.
+  *        - The "CAN_BUS_Shield-master" and "Mcp2515Reader" libraries must be added to your
+  *          Arduino IDE for this program to compile successfully.
+  *        - The INT pin of the MCP2515 must be wired to CAN_INT_PIN. Packets are read from its
+  *          interrupt, so none are lost while the serial port is busy.
   *        - This program is written for the SEEED CAN Bus Shield.
   *        - This code has been written to protect a 2014 Nissan Altima.
   *        - Packet Composition:  {Byte[0], Byte[1], Byte[2], Byte[3], Byte[4], ... , Byte[n]} 
@@ -20,6 +22,7 @@
 /* INCLUDES */
 #include <mcp_can.h>
 #include <SPI.h>
+#include <Mcp2515Reader.h>
 
 /* CONSTANTS */
 const unsigned int MAX_PAYLOAD_SIZE = 0x08;               // Maximum data size of a packet's payload
@@ -57,7 +60,9 @@ const unsigned char UDS_PID = 0x7E0;                      // Process ID for Univ
 
 /* SHIELD SETUP */
 const int SPI_CS_PIN = 9; // SPI chip select pin set to 9
+const int CAN_INT_PIN = 2; // MCP2515 INT pin set to 2
 MCP_CAN CAN(SPI_CS_PIN);  // Set ship select pin
+mcp2515_reader_t canReader; // Packets read from the MCP2515 interrupt
 
 void setup()
 {
@@ -66,6 +71,7 @@ void setup()
   if (CAN_OK == CAN.begin(CAN_500KBPS)) // Initialize CAN reading at 500 Kbps
   {
     //Serial.println("CAN BUS Shield init ok!");
+    Mcp2515ReaderBegin(&canReader, SPI_CS_PIN, CAN_INT_PIN); // Read packets from the INT pin from now on
   }
 
   else
@@ -79,15 +85,11 @@ void setup()
 
 void loop()
 {
-  unsigned char len = 0;  // length of data
-  unsigned char newPacket[MAX_PAYLOAD_SIZE];   // 8 byte packet data buffer
+  mcp2515_frame_t frame;  // packet read by the interrupt
 
-  if (CAN_MSGAVAIL == CAN.checkReceive())   // check if data is coming in
+  while (Mcp2515ReaderRead(&canReader, &frame)) // take every packet waiting
   {
-    CAN.readMsgBuf(&len, newPacket);  // read data,  len: data length, buf: data buffer
-    unsigned long timestamp = millis();   // get time since program started in milliseconds
-    unsigned long canId = CAN.getCanId(); // get the ID of the CAN message
-    CheckPacket(canId, len, newPacket);
+    CheckPacket(frame.id, frame.len, frame.data);
   }
 }
 
@@ -10,8 +10,10 @@
  *        file. This code can be expanded to send test commands to the vehicle.
  *        
  * Notes: 
- *        - The "CAN_BUS_Shield-master" library must be added to your Arduino IDE for this
- *          program to compile successfully.
+ *        - The "CAN_BUS_Shield-master" and "TimerWheel" libraries must be added to your Arduino IDE
+ *          for this program to compile successfully.
+ *        - The diagnostic mode requests and the blinker pattern are sent from a timer wheel moved
+ *          on by millis() in the loop, so reading is never held up by a delay().
  *        - This program is written for the SEEED CAN Bus Shield.
  *        - This code has only been tested on a 2014 Nissan Altima. It may work on other
  *          vehicles, but this is not certain.
@@ -20,13 +22,14 @@
 /* INCLUDES */
 #include <mcp_can.h>
 #include <SPI.h>
+#include <TimerWheel.h>
 
 /* CONSTANTS */
 const int SPI_CS_PIN = 9; // SPI chip select pin set to 9
 
 unsigned char DIAG_MODE_PAYLOAD[3]  = {0x02, 0x10, 0xC0}; // payload of tester present packet
-const unsigned char DIAG_MODE_PID = 0x745;
-const unsigned char DIAG_MODE_RESPONSE_PID = 0x765;
+const unsigned long DIAG_MODE_PID = 0x745;
+const unsigned long DIAG_MODE_RESPONSE_PID = 0x765;
 const unsigned int DIAG_MODE_PAYLOAD_SIZE = 3; // tester present packet payload size
 
 unsigned char DIAG_BLINKER_OFF_PAYLOAD[5] = {0x04, 0x30, 0x2F, 0x20, 0x00};
@@ -35,10 +38,51 @@ unsigned char DIAG_LEFT_BLINKER_PAYLOAD[5] = {0x04, 0x30, 0x2F, 0x20, 0x02};
 const unsigned int DIAG_BLINKER_PAYLOAD_SIZE = 5;
 const unsigned int STANDARD_FRAME = 0; // Standard frame parameter
 
+const unsigned int DIAG_SEND_FREQ = 50; // send diagnostic mode request every 50 ms
+const unsigned int BLINKER_SEND_FREQ = 100; // delay 100ms between blinker messages
+const unsigned int BLINKER_MESSAGES = 4; // number of on (then off) messages per blink
+const unsigned int NUM_BLINKS = 100; // number of blinks before the pattern stops
+
 
 /* SHIELD SETUP */
 MCP_CAN CAN(SPI_CS_PIN);  // Set ship select pin
 
+/* TIMERS */
+timer_wheel_t wheel;            // 1 ms ticks, moved on by millis()
+wheel_timer_t diagModeTimer;    // periodic diagnostic mode request
+wheel_timer_t blinkerTimer;     // blinker pattern, one message per expiry
+unsigned int blinkerStep = 0;   // message of the current blink, on for the first BLINKER_MESSAGES then off
+unsigned int numBlinks = 0;
+
+void diag_mode_callback(void *arg)
+{
+    Serial.println("Sent diagnostic mode request");
+    CAN.sendMsgBuf(DIAG_MODE_PID, STANDARD_FRAME, DIAG_MODE_PAYLOAD_SIZE, DIAG_MODE_PAYLOAD);
+}
+
+void blinker_callback(void *arg)
+{
+    if (blinkerStep < BLINKER_MESSAGES)
+    {
+        CAN.sendMsgBuf(DIAG_MODE_PID, STANDARD_FRAME, DIAG_BLINKER_PAYLOAD_SIZE, DIAG_RIGHT_BLINKER_PAYLOAD);
+    }
+    else
+    {
+        CAN.sendMsgBuf(DIAG_MODE_PID, STANDARD_FRAME, DIAG_BLINKER_PAYLOAD_SIZE, DIAG_BLINKER_OFF_PAYLOAD);
+    }
+
+    blinkerStep++;
+    if (blinkerStep == (2 * BLINKER_MESSAGES))
+    {
+        blinkerStep = 0;
+        numBlinks++;
+        if (numBlinks >= NUM_BLINKS)
+        {
+            TimerWheelCancel(&wheel, &blinkerTimer);
+        }
+    }
+}
+
 void setup()
 {
     Serial.begin(115200);
@@ -54,6 +98,12 @@ void setup()
         Serial.println("Init CAN BUS Shield again");
         delay(100);
     }
+
+    TimerWheelInit(&wheel, millis());
+    TimerWheelSetup(&diagModeTimer, diag_mode_callback, NULL);
+    TimerWheelSetup(&blinkerTimer, blinker_callback, NULL);
+    TimerWheelStart(&wheel, &diagModeTimer, 1, DIAG_SEND_FREQ); // periodically send the diagnostic mode request
+    TimerWheelStart(&wheel, &blinkerTimer, BLINKER_SEND_FREQ, BLINKER_SEND_FREQ);
 }
 
 
@@ -62,25 +112,11 @@ void loop()
     unsigned char len = 0;  // length of data
     unsigned char buf[8];   // 8 byte data buffer
     unsigned long timestamp = millis();   // get time since program started in milliseconds
-/*
-    if (timestamp % DIAG_SEND_FREQ) // periodically send the tester present message
-    {
-      Serial.print(timestamp);
-      Serial.print(": Sent tester present");
-      Serial.println();
-      CAN.sendMsgBuf(TESTER_PRESENT_PID, STANDARD_FRAME, TESTER_PRESENT_PAYLOAD_SIZE, TESTER_PRESENT_PAYLOAD);
-    }
-*/
 
-while(true)
-{
-    Serial.println("Sent diagnostic mode request");
-    CAN.sendMsgBuf(DIAG_MODE_PID, STANDARD_FRAME, DIAG_MODE_PAYLOAD_SIZE, DIAG_MODE_PAYLOAD);
-   // delay(100);
+    TimerWheelAdvance(&wheel, timestamp); // send the requests and blinker messages that are due
 
     if(CAN_MSGAVAIL == CAN.checkReceive())    // check if data is coming in
     {
-        timestamp = millis();
         CAN.readMsgBuf(&len, buf);            // read data,  len: data length, buf: data buffer
         
         unsigned long canId = CAN.getCanId(); // get the ID of the CAN message
@@ -102,25 +138,6 @@ while(true)
         }
         Serial.println();
     }
-    delay(50);
-}
-  int numBlinks = 0;
-  while(numBlinks < 100)
-  {
-    int blinkCounter = 0;
-    for (blinkCounter = 0; blinkCounter < 4; blinkCounter++)
-    {
-        CAN.sendMsgBuf(DIAG_MODE_PID, STANDARD_FRAME, DIAG_BLINKER_PAYLOAD_SIZE, DIAG_RIGHT_BLINKER_PAYLOAD);
-        delay(100); // delay 100ms between blinker messages
-    }
-
-    for (blinkCounter = 0; blinkCounter < 4; blinkCounter++)
-    {
-        CAN.sendMsgBuf(DIAG_MODE_PID, STANDARD_FRAME, DIAG_BLINKER_PAYLOAD_SIZE, DIAG_BLINKER_OFF_PAYLOAD);
-        delay(100); // delay 100ms between blinker messages
-    }
-    numBlinks++;
-  }
 }
 
 /*********************************************************************************************************
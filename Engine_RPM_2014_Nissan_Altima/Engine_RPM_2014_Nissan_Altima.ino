@@ -9,8 +9,10 @@
  *        sent to the serial port.
  *        
  * Notes: 
- *        - The "CAN_BUS_Shield-master" library must be added to your Arduino IDE for this
- *          program to compile successfully.
+ *        - The "CAN_BUS_Shield-master" and "Mcp2515Reader" libraries must be added to your
+ *          Arduino IDE for this program to compile successfully.
+ *        - The INT pin of the MCP2515 must be wired to CAN_INT_PIN. Packets are read from its
+ *          interrupt, so none are lost while the serial port is busy.
  *        - This program is written for the SEEED CAN Bus Shield.
  *        - This code has only been tested on a 2014 Nissan Altima. It may work on other
  *          vehicles, but this is not certain.
@@ -19,12 +21,15 @@
 /* INCLUDES */
 #include <mcp_can.h>
 #include <SPI.h>
+#include <Mcp2515Reader.h>
 
 /* CONSTANTS */
 const int SPI_CS_PIN = 9; // SPI chip select pin set to 9
+const int CAN_INT_PIN = 2; // MCP2515 INT pin set to 2
 
 /* SHIELD SETUP */
 MCP_CAN CAN(SPI_CS_PIN);  // Set ship select pin
+mcp2515_reader_t canReader; // Packets read from the MCP2515 interrupt
 
 void setup()
 {
@@ -33,6 +38,7 @@ void setup()
     if (CAN_OK == CAN.begin(CAN_500KBPS)) // Initialize CAN reading at 500 Kbps
     {
         Serial.print("CAN BUS Shield init ok!");
+        Mcp2515ReaderBegin(&canReader, SPI_CS_PIN, CAN_INT_PIN); // Read packets from the INT pin from now on
     }
   
     else
@@ -46,14 +52,13 @@ void setup()
 
 void loop()
 {
-    unsigned char len = 0;  // length of data
-    unsigned char buf[8];   // 8 byte data buffer
+    mcp2515_frame_t frame;  // packet read by the interrupt
   
-    if(CAN_MSGAVAIL == CAN.checkReceive())    // check if data is coming in
+    while (Mcp2515ReaderRead(&canReader, &frame)) // take every packet waiting
     {
-        CAN.readMsgBuf(&len, buf);            // read data,  len: data length, buf: data buffer
-        unsigned long timestamp = millis();   // get time since program started in milliseconds
-        unsigned long canId = CAN.getCanId(); // get the ID of the CAN message
+        unsigned char len = frame.len;            // length of data
+        unsigned char *buf = frame.data;          // 8 byte data buffer
+        unsigned long canId = frame.id;           // get the ID of the CAN message
         unsigned long engineRPM = 0;
         
         if ((canId == 0x180) && (len == 8)) // engine RPM packet found
@@ -0,0 +1,238 @@
+/*
+  * @file Mcp2515Reader.cpp
+  *
+  * Interrupt driven receive for the MCP2515 of the CAN-BUS Shield
+*/
+
+/* INCLUDES */
+#include "Mcp2515Reader.h"
+
+/* GLOBAL VARIABLES */
+static mcp2515_reader_t *s_Reader = NULL;   // Reader run by the INT pin
+
+/** Reads CANINTF and EFLG, which are next to each other, in one transaction
+ *  @param *reader Reader struct
+ *  @param *flags CANINTF and EFLG to be set
+ */
+static void Mcp2515ReaderFlags(mcp2515_reader_t *reader, uint8_t flags[2])
+{
+  digitalWrite(reader->csPin, LOW);
+  SPI.transfer(MCP_READ);
+  SPI.transfer(MCP_CANINTF);
+  flags[0] = SPI.transfer(0x00);
+  flags[1] = SPI.transfer(0x00);
+  digitalWrite(reader->csPin, HIGH);
+}
+
+/** Clears bits of a register with BIT MODIFY
+ *  @param *reader Reader struct
+ *  @param address Register address
+ *  @param bits Bits to be cleared
+ */
+static void Mcp2515ReaderClear(mcp2515_reader_t *reader, uint8_t address, uint8_t bits)
+{
+  digitalWrite(reader->csPin, LOW);
+  SPI.transfer(MCP_BITMOD);
+  SPI.transfer(address);
+  SPI.transfer(bits);
+  SPI.transfer(0x00);
+  digitalWrite(reader->csPin, HIGH);
+}
+
+/** Reads a receive buffer into the ring in one burst, the chip select going high clears its RXnIF
+ *  A frame read with the ring full is counted and thrown away
+ *  @param *reader Reader struct
+ *  @param instruction MCP_READ_RX0 or MCP_READ_RX1
+ */
+static void Mcp2515ReaderBuffer(mcp2515_reader_t *reader, uint8_t instruction)
+{
+  mcp2515_frame_t spare;
+  mcp2515_frame_t *frame = &spare;
+  uint8_t header[MCP2515_READER_HEADER_BYTES];
+  uint8_t queued = (uint8_t)(reader->head - reader->tail);
+  uint8_t index = 0;
+
+  if (queued < MCP2515_READER_RING_SIZE)
+  {
+    frame = &reader->ring[reader->head & MCP2515_READER_RING_MASK];
+  }
+
+  digitalWrite(reader->csPin, LOW);
+  SPI.transfer(instruction);
+  for (index = 0; index < MCP2515_READER_HEADER_BYTES; index++)
+  {
+    header[index] = SPI.transfer(0x00);
+  }
+  frame->len = header[4] & MCP_DLC_MASK;
+  if (frame->len > 8)
+  {
+    frame->len = 8;
+  }
+  for (index = 0; index < frame->len; index++)
+  {
+    frame->data[index] = SPI.transfer(0x00);
+  }
+  digitalWrite(reader->csPin, HIGH);
+
+  frame->id = ((uint32_t) header[MCP_SIDH] << 3) | (header[MCP_SIDL] >> 5);
+  frame->ext = (header[MCP_SIDL] & MCP_RXB_IDE_M) ? 1 : 0;
+  if (frame->ext)
+  {
+    frame->id = (frame->id << 18) | ((uint32_t)(header[MCP_SIDL] & 0x03) << 16) |
+                ((uint32_t) header[MCP_EID8] << 8) | header[MCP_EID0];
+    frame->rtr = (header[4] & MCP_RXB_RTR_M) ? 1 : 0;
+  }
+  else
+  {
+    frame->rtr = (header[MCP_SIDL] & MCP2515_READER_SIDL_SRR) ? 1 : 0;
+  }
+  frame->timestamp = millis();
+  reader->frames++;
+
+  if (frame == &spare)
+  {
+    reader->dropped++;
+    return;
+  }
+  MCP2515_READER_BARRIER();
+  reader->head++;
+  if ((uint8_t)(queued + 1) > reader->maxQueued)
+  {
+    reader->maxQueued = queued + 1;
+  }
+}
+
+/** Empties both receive buffers until neither RXnIF is set, counting and clearing the overflow flags
+ *  RXB1 only takes a frame while RXB0 is full, so RXB0 holds the older frame, unless the last
+ *  pass found RXB0 alone full and a frame rolled into RXB1 while it was read
+ *  @param *reader Reader struct
+ */
+static void Mcp2515ReaderDrain(mcp2515_reader_t *reader)
+{
+  uint8_t flags[2];
+  uint8_t rx = 0;
+
+  SPI.beginTransaction(SPISettings(MCP2515_READER_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+  do
+  {
+    Mcp2515ReaderFlags(reader, flags);
+    if (flags[1] & MCP2515_READER_OVERFLOWS)
+    {
+      if (flags[1] & MCP_EFLG_RX0OVR)
+      {
+        reader->rx0Overflows++;
+      }
+      if (flags[1] & MCP_EFLG_RX1OVR)
+      {
+        reader->rx1Overflows++;
+      }
+      Mcp2515ReaderClear(reader, MCP_EFLG, flags[1] & MCP2515_READER_OVERFLOWS);
+      Mcp2515ReaderClear(reader, MCP_CANINTF, MCP_ERRIF);
+    }
+
+    rx = flags[0] & MCP2515_READER_RX_FLAGS;
+    if ((rx == MCP2515_READER_RX_FLAGS) && reader->rxb1Older)
+    {
+      Mcp2515ReaderBuffer(reader, MCP_READ_RX1);
+      Mcp2515ReaderBuffer(reader, MCP_READ_RX0);
+    }
+    else
+    {
+      if (rx & MCP_RX0IF)
+      {
+        Mcp2515ReaderBuffer(reader, MCP_READ_RX0);
+      }
+      if (rx & MCP_RX1IF)
+      {
+        Mcp2515ReaderBuffer(reader, MCP_READ_RX1);
+      }
+    }
+    reader->rxb1Older = (rx == MCP_RX0IF);
+  } while (rx != 0);
+  SPI.endTransaction();
+}
+
+/** Interrupt service routine of the INT pin
+ */
+static void mcp2515_reader_isr(void)
+{
+  if (s_Reader != NULL)
+  {
+    s_Reader->interrupts++;
+    Mcp2515ReaderDrain(s_Reader);
+  }
+}
+
+/** Starts reading the MCP2515 from its INT pin, called after CAN.begin
+ *  Frames that came in before are read right away, the INT pin would otherwise stay low
+ *  @param *reader Reader struct to be initialized
+ *  @param csPin SPI chip select of the MCP2515
+ *  @param intPin Pin the INT output is wired to, one that can take an interrupt (2 on the Uno)
+ */
+void Mcp2515ReaderBegin(mcp2515_reader_t *reader, uint8_t csPin, uint8_t intPin)
+{
+  memset(reader, 0, sizeof(mcp2515_reader_t));
+  reader->csPin = csPin;
+  reader->intPin = intPin;
+
+  noInterrupts();
+  s_Reader = reader;
+  pinMode(intPin, INPUT);
+  SPI.usingInterrupt(digitalPinToInterrupt(intPin));
+  attachInterrupt(digitalPinToInterrupt(intPin), mcp2515_reader_isr, FALLING);
+  Mcp2515ReaderDrain(reader);
+  interrupts();
+}
+
+/** Takes the oldest frame out of the ring, called from the main loop
+ *  @param *reader Reader struct
+ *  @param *frame Frame to be filled in
+ *  @return Whether or not there was a frame
+ */
+bool Mcp2515ReaderRead(mcp2515_reader_t *reader, mcp2515_frame_t *frame)
+{
+  uint8_t tail = reader->tail;
+
+  if (tail == reader->head)
+  {
+    return false;
+  }
+  memcpy(frame, &reader->ring[tail & MCP2515_READER_RING_MASK], sizeof(mcp2515_frame_t));
+  MCP2515_READER_BARRIER(); // the slot is free for the interrupt only once copied
+  reader->tail = tail + 1;
+  return true;
+}
+
+/** Gets the number of frames waiting in the ring
+ *  @param *reader Reader struct
+ *  @return Number of frames
+ */
+uint8_t Mcp2515ReaderAvailable(const mcp2515_reader_t *reader)
+{
+  return (uint8_t)(reader->head - reader->tail);
+}
+
+/** Prints the reader statistics
+ *  @param *reader Reader struct
+ *  @param *out Serial port to print to
+ */
+void Mcp2515ReaderPrint(const mcp2515_reader_t *reader, Print *out)
+{
+  char line[160];
+  uint32_t counts[5];
+  uint8_t maxQueued = 0;
+
+  noInterrupts(); // 32 bit counters are not read in one go on the AVR
+  counts[0] = reader->frames;
+  counts[1] = reader->interrupts;
+  counts[2] = reader->rx0Overflows;
+  counts[3] = reader->rx1Overflows;
+  counts[4] = reader->dropped;
+  maxQueued = reader->maxQueued;
+  interrupts();
+
+  snprintf(line, sizeof(line), "MCP2515: %lu frames in %lu interrupts, RX0OVR %lu, RX1OVR %lu, %lu dropped, %u of %u queued at most",
+           (unsigned long) counts[0], (unsigned long) counts[1], (unsigned long) counts[2], (unsigned long) counts[3],
+           (unsigned long) counts[4], (unsigned) maxQueued, (unsigned) MCP2515_READER_RING_SIZE);
+  out->println(line);
+}
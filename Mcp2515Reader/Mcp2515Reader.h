@@ -0,0 +1,77 @@
+/*
+  * @file Mcp2515Reader.h
+  *
+  * Interrupt driven receive for the MCP2515 of the CAN-BUS Shield. The mcp_can library still
+  * sets the controller up (CAN.begin), then the INT pin runs the reader: it reads CANINTF and
+  * EFLG in one burst, reads every full receive buffer with a single READ RX BUFFER burst (ID,
+  * DLC and payload, the chip select going high clears its RXnIF) and puts the frames into a RAM
+  * ring the main loop takes them from. Polling with checkReceive / readMsgBuf takes seven SPI
+  * transactions per frame and only empties one buffer per loop, so a loop busy printing lets
+  * both buffers fill and the MCP2515 drops frames; here both buffers are emptied as soon as a
+  * frame comes in, and the ring holds MCP2515_READER_RING_SIZE frames for the loop to catch up.
+  *
+  * The interrupt keeps reading until neither RXnIF is set, so the INT pin goes high and the
+  * next frame gives a falling edge again. RX0OVR / RX1OVR in EFLG (a frame the MCP2515 had no
+  * room for) are counted and cleared, as are frames the ring had no room for. Only the
+  * interrupt writes the head of the ring and only the main loop the tail, both 8 bits, so
+  * neither side has to turn interrupts off.
+  *
+  * Once begun, nothing else may read the receive buffers (CAN.checkReceive, CAN.readMsgBuf),
+  * and anything else on the SPI bus has to use SPI transactions, which hold the reader off.
+  * Install this folder as an Arduino library to use it in a sketch.
+*/
+
+#ifndef MCP2515READER_H
+#define MCP2515READER_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <stdint.h>
+#include <SPI.h>
+#include <mcp_can_dfs.h>
+
+/* DEFINES */
+#ifndef MCP2515_READER_RING_SIZE
+#define MCP2515_READER_RING_SIZE      16        // Frames the ring holds, a power of two up to 128
+#endif
+#define MCP2515_READER_RING_MASK      (MCP2515_READER_RING_SIZE - 1)
+#define MCP2515_READER_SPI_CLOCK      4000000   // SPI clock (Hz), the one the mcp_can library runs at after SPI.begin()
+#define MCP2515_READER_HEADER_BYTES   5         // SIDH, SIDL, EID8, EID0 and DLC of a receive buffer
+#define MCP2515_READER_RX_FLAGS       (MCP_RX0IF | MCP_RX1IF)
+#define MCP2515_READER_OVERFLOWS      (MCP_EFLG_RX1OVR | MCP_EFLG_RX0OVR)
+#define MCP2515_READER_SIDL_SRR       0x10      // RXBnSIDL: standard frame remote request
+#define MCP2515_READER_BARRIER()      __asm__ __volatile__("" ::: "memory")  // Keeps the compiler from moving a slot copy across its index update
+
+/* STRUCTS */
+typedef struct {
+  uint32_t id;                          // Standard (11 bit) or extended (29 bit) ID
+  uint8_t ext;                          // Whether or not the ID is extended
+  uint8_t rtr;                          // Whether or not the frame is a remote request
+  uint8_t len;                          // Data length, 0 - 8
+  uint8_t data[8];                      // Payload
+  uint32_t timestamp;                   // Time (millis) the frame was read from the MCP2515
+} mcp2515_frame_t;
+
+typedef struct {
+  uint8_t csPin;                        // SPI chip select of the MCP2515
+  uint8_t intPin;                       // Pin the INT output of the MCP2515 is wired to
+  mcp2515_frame_t ring[MCP2515_READER_RING_SIZE];  // Frames read, oldest at the tail
+  volatile uint8_t head;                // Next slot the interrupt fills
+  volatile uint8_t tail;                // Next slot the main loop reads
+  bool rxb1Older;                       // Whether or not a frame rolled into RXB1 while RXB0 was being read
+
+  volatile uint32_t interrupts;         // Number of times the INT pin went low
+  volatile uint32_t frames;             // Number of frames read
+  volatile uint32_t rx0Overflows;       // Number of times RX0OVR was found set
+  volatile uint32_t rx1Overflows;       // Number of times RX1OVR was found set
+  volatile uint32_t dropped;            // Number of frames read with the ring full
+  volatile uint8_t maxQueued;           // Most frames the ring held
+} mcp2515_reader_t;
+
+/* FUNCTION PROTOTYPES */
+void Mcp2515ReaderBegin(mcp2515_reader_t *reader, uint8_t csPin, uint8_t intPin);
+bool Mcp2515ReaderRead(mcp2515_reader_t *reader, mcp2515_frame_t *frame);
+uint8_t Mcp2515ReaderAvailable(const mcp2515_reader_t *reader);
+void Mcp2515ReaderPrint(const mcp2515_reader_t *reader, Print *out);
+
+#endif // MCP2515READER_H
@@ -8,6 +8,32 @@
 #define FIFO_START_INT_BIT 5
 
 FLEXCAN_callback_t isr_table[32];
+FLEXCAN_status_callback_t status_callback_g = NULL;
+
+/* TX queue */
+#define FLEXCAN_TXQ_MB_FREE         0  /* TX mailbox idle. */
+#define FLEXCAN_TXQ_MB_BUSY         1  /* TX mailbox waiting for the bus. */
+#define FLEXCAN_TXQ_MB_CANCEL       2  /* TX mailbox aborted for a higher priority frame, requeued unless sent. */
+#define FLEXCAN_TXQ_MB_ABORT        3  /* TX mailbox aborted by FLEXCAN_txq_flush. */
+
+typedef struct {
+   FLEXCAN_frame_t frame;  /*!< Frame to send. */
+   uint32_t tag;           /*!< Passed back with the result. */
+   uint32_t key;           /*!< Arbitration key, lower wins. */
+   uint32_t seq;           /*!< Queueing order, first among equal keys. */
+} FLEXCAN_tx_entry_t;
+
+FLEXCAN_tx_entry_t txq_entries_g[FLEXCAN_TXQ_SIZE];         /* Queued frames. */
+uint8_t txq_order_g[FLEXCAN_TXQ_SIZE];                      /* Queued entries by priority. */
+uint8_t txq_free_g[FLEXCAN_TXQ_SIZE];                       /* Unused entries. */
+uint8_t txq_count_g = 0;
+uint8_t txq_cancels_g = 0;                                  /* Mailboxes being cancelled, their frames come back into the queue. */
+FLEXCAN_tx_entry_t txq_mb_g[FLEXCAN_TX_MB_WIDTH];           /* Frames in the TX mailboxes. */
+volatile uint8_t txq_mb_state_g[FLEXCAN_TX_MB_WIDTH];
+uint32_t txq_seq_g = 0;
+FLEXCAN_txq_callback_t txq_callback_g = NULL;
+
+void FLEXCAN_txq_isr(uint8_t mb);
 
 /* Store configuration settings in case of reset */
 FLEXCAN_config_t config_g;
@@ -32,10 +58,14 @@ void can0_message_isr( void )
    {
       if(flags & 0x00000001)
       {
+         /* IFLAG1 is write 1 to clear: write only this flag, before the callback so
+          * a TX mailbox it loads again cannot complete into a flag cleared afterwards.
+          * The FIFO flag is cleared by FLEXCAN_fifo_read, clearing it again drops the next frame. */
+         if(i != FLEXCAN_INT_FIFO_AVALIBLE)
+            FLEXCAN0_IFLAG1 = (1 << i);
+
          if(isr_table[i] != NULL)
             (isr_table[i])(i);
-
-         FLEXCAN0_IFLAG1 |= (1 << i);
          return;
       }
       else
@@ -47,23 +77,44 @@ void can0_message_isr( void )
    return;
 }
 
-/*
+/* Shared by the error, warning and bus off interrupts. ESR1 is read once (which clears
+ * the error bits), only the interrupt flags found set are cleared (write 1 to clear) so
+ * none raised in the meantime is lost, then the status goes to the callback. */
+static void can0_status_isr(void)
+{
+   FLEXCAN_status_t status;
+
+   FLEXCAN_status(&status);
+   FLEXCAN0_ESR1 = status.errors & (FLEXCAN_ESR_ERR_INT | FLEXCAN_ESR_BOFF_INT |
+                                    FLEXCAN_ESR_TWRN_INT | FLEXCAN_ESR_RWRN_INT);
+   if(status_callback_g != NULL)
+      status_callback_g(&status);
+}
+
+void can0_bus_off_isr(void)
+{
+   NVIC_CLEAR_PENDING(IRQ_CAN_BUS_OFF);
+   can0_status_isr();
+}
+
 void can0_error_isr(void)
 {
-   NVIC_CLEAR_PENDING(IRQ_CAN_MESSAGE);
-   FLEXCAN0_ESR1 |= FLEXCAN_ESR_BIT1_ERR | FLEXCAN_ESR_BIT0_ERR;
-   for (uint8_t i = FLEXCAN_TX_BASE_MB; i < (FLEXCAN_TX_BASE_MB + FLEXCAN_TX_MB_WIDTH); i++) 
-   {  
-      FLEXCAN_abort_mb(i);
-   }
+   NVIC_CLEAR_PENDING(IRQ_CAN_ERROR);
+   can0_status_isr();
+}
 
+void can0_tx_warn_isr(void)
+{
+   NVIC_CLEAR_PENDING(IRQ_CAN_TX_WARN);
+   can0_status_isr();
+}
+
+void can0_rx_warn_isr(void)
+{
+   NVIC_CLEAR_PENDING(IRQ_CAN_RX_WARN);
+   can0_status_isr();
 }
-*/
 
-//void can0_error_isr(void);
-//extern void can0_bus_off_isr(void);
-//extern void can0_tx_warn_isr(void);
-//extern void can0_rx_warn_isr(void);
 //extern void can0_wakeup_isr(void);
 
 /* =========================================================================  */
@@ -146,17 +197,23 @@ int FLEXCAN_init(FLEXCAN_config_t config)
    FLEXCAN0_CTRL1 |= FLEXCAN_CTRL_TWRN_MSK;  // Enable TX Warning INT. Mask
    NVIC_ENABLE_IRQ(IRQ_CAN_TX_WARN);
 
-   //NVIC_ENABLE_IRQ(IRQ_CAN_RX_WARN);
+   FLEXCAN0_CTRL1 |= FLEXCAN_CTRL_RWRN_MSK;  // Enable RX Warning INT. Mask
+   NVIC_ENABLE_IRQ(IRQ_CAN_RX_WARN);
+
    //NVIC_ENABLE_IRQ(IRQ_CAN_WAKEUP);
    //NVIC_ENABLE_IRQ(IRQ_CAN_MESSAGE);
 
-   //FLEXCAN0_CTRL1 |= FLEXCAN_CTRL_RWRN_MSK;  // Enable RX Warning INT. Mask
    FLEXCAN0_CTRL1 |= FLEXCAN_CTRL_BOFF_REC;  // DISABLE (1) automatic bus off recovery.
-   FLEXCAN0_CTRL1 |= FLEXCAN_CTRL_LBUF;      // Send the lowest number buffer is transmitted first.
+   FLEXCAN0_CTRL1 &= ~FLEXCAN_CTRL_LBUF;     // Lowest ID is transmitted first (lowest number buffer on a tie).
    FLEXCAN0_CTRL1 |= FLEXCAN_CTRL_SMP;       // Enable tripple bit sampling.
 
-   /* DEFAULT: Set to accept all messages */
+   /* DEFAULT: Set to accept all messages. With IRMQ each filter slot has its own mask. */
    FLEXCAN0_RXFGMASK = 0;
+   for(uint8_t n = 0; n < FLEXCAN_NUM_FIFO_FILTERS; n++)
+   {
+      FLEXCAN0_IDFLT_TAB(n) = 0;
+      FLEXCAN0_RXIMRn(n) = 0;
+   }
 
 
    FLEXCAN0_CTRL2 |= FLEXCAN_CTRL2_MRP;   // Start Matching through MB first.
@@ -171,7 +228,7 @@ int FLEXCAN_init(FLEXCAN_config_t config)
    
    /* set tx buffers to inactive */
    uint8_t i;
-   for (i = FLEXCAN_RX_BASE_MB; i < FLEXCAN_MAX_MB; i++) 
+   for (i = FLEXCAN_RX_BASE_MB; i <= FLEXCAN_MAX_MB; i++) 
    {
       /* Clear IFLAGS */
       FLEXCAN0_IFLAG1 |= (1<<i);
@@ -202,6 +259,8 @@ int FLEXCAN_read_frame(uint8_t mb, FLEXCAN_frame_t *frame)
    // get identifier and dlc
    frame->dlc = FLEXCAN_get_length(FLEXCAN0_MBn_CS(mb ));
    frame->ide = (FLEXCAN0_MBn_CS(mb ) & FLEXCAN_MB_CS_IDE)? 1:0;
+   frame->srr = (FLEXCAN0_MBn_CS(mb ) & FLEXCAN_MB_CS_SRR)? 1:0;
+   frame->rtr = (FLEXCAN0_MBn_CS(mb ) & FLEXCAN_MB_CS_RTR)? 1:0;
 
    frame->id  = (FLEXCAN0_MBn_ID(mb) & FLEXCAN_MB_ID_EXT_MASK);
 
@@ -221,7 +280,7 @@ int FLEXCAN_read_frame(uint8_t mb, FLEXCAN_frame_t *frame)
 
    if(frame->dlc > 4)
    {
-      data_in = FLEXCAN0_MBn_WORD0(mb);
+      data_in = FLEXCAN0_MBn_WORD1(mb);
       frame->data[7] = data_in & 0xFF;
       data_in >>= 8;
       frame->data[6] = data_in & 0xFF;
@@ -244,19 +303,28 @@ int FLEXCAN_read_frame(uint8_t mb, FLEXCAN_frame_t *frame)
 int FLEXCAN_mb_write(uint8_t mb, uint8_t code, FLEXCAN_frame_t frame)
 {
    
+   uint32_t cs = FLEXCAN_MB_CS_CODE(code) | FLEXCAN_MB_CS_LENGTH(frame.dlc);
+
    FLEXCAN_abort_mb(mb);
 
-   /* Assume there are no extended ID message */
-   FLEXCAN0_MBn_ID(mb) = FLEXCAN_MB_ID_IDSTD(frame.id);
+   /* Extended IDs fill the whole ID field, standard IDs its upper 11 bits */
+   if(frame.ide)
+   {
+      FLEXCAN0_MBn_ID(mb) = frame.id & FLEXCAN_MB_ID_EXT_MASK;
+      cs |= FLEXCAN_MB_CS_IDE | FLEXCAN_MB_CS_SRR;
+   }
+   else
+   {
+      FLEXCAN0_MBn_ID(mb) = FLEXCAN_MB_ID_IDSTD(frame.id);
+   }
+
+   if(frame.rtr)
+      cs |= FLEXCAN_MB_CS_RTR;
 
    FLEXCAN0_MBn_WORD0(mb) = (frame.data[0]<<24)|(frame.data[1]<<16)|(frame.data[2]<<8)|frame.data[3];
    FLEXCAN0_MBn_WORD1(mb) = (frame.data[4]<<24)|(frame.data[5]<<16)|(frame.data[6]<<8)|frame.data[7];
 
-   /* Assume there are never any Extended ID mEsagesg */
-   /* TODO: */
-
-    FLEXCAN0_MBn_CS(mb) = FLEXCAN_MB_CS_CODE(code)
-                              | FLEXCAN_MB_CS_LENGTH(frame.dlc);
+   FLEXCAN0_MBn_CS(mb) = cs;
    
    return FLEXCAN_SUCCESS;
 }
@@ -340,39 +408,18 @@ int FLEXCAN_fifo_read(FLEXCAN_frame_t * frame)
 
    FLEXCAN_read_frame(FLEXCAN_FIFO_MB, frame);
    
-   /* Clear the flag */
-   FLEXCAN0_IFLAG1 |= FLEXCAN_IMASK1_BUF5M;
+   /* Clear the flag (write 1 to clear, |= would also clear the warning and overflow flags) */
+   FLEXCAN0_IFLAG1 = FLEXCAN_IMASK1_BUF5M;
    return FLEXCAN_SUCCESS;
 
 }
 
 int FLEXCAN_write(FLEXCAN_frame_t frame, FLEXCAN_tx_option_t option)
 {
-   int mb = FLEXCAN_TX_BASE_MB + 1;
-
-   /* Assume MB 10 For now */ 
-   FLEXCAN_mb_write(mb, FLEXCAN_MB_CODE_TX_ONCE, frame);
-
-   switch(option)
-   {
-      case TX_ONCE:                 /* TX Once */
-         if(FLEXCAN_abort_mb(mb) != FLEXCAN_TX_ABORTED)
-            return FLEXCAN_TX_SUCCESS;
-
-         else
-            return FLEXCAN_TX_ABORTED;
-         
-         break;
+   if(FLEXCAN_txq_send(&frame, 0) != FLEXCAN_SUCCESS)
+      return FLEXCAN_ERROR;
 
-      case TX_BEST_EFFORT:          /* TX Until DEAD */
-         /* Just Let it go and return */
-         break;
-
-      default:
-         break;
-
-   }
-   return FLEXCAN_SUCCESS;
+   return FLEXCAN_TX_SUCCESS;
 }
 
 int FLEXCAN_reset(void)
@@ -434,22 +481,36 @@ int FLEXCAN_abort_mb(uint8_t mb)
 
 }
 
+int FLEXCAN_set_fifo_filter(uint8_t n, uint32_t filter, uint32_t mask)
+{
+   if(n >= FLEXCAN_NUM_FIFO_FILTERS)
+      return FLEXCAN_ERROR;
+
+   /* The filter table and the individual masks can only be written in freeze mode */
+   FLEXCAN_freeze();
+   FLEXCAN0_IDFLT_TAB(n) = filter;
+   FLEXCAN0_RXIMRn(n) = mask;
+   FLEXCAN_unfreeze();
+
+   return FLEXCAN_SUCCESS;
+}
+
 uint32_t FLEXCAN_filter_a(uint8_t rtr, uint8_t ide, uint32_t ext_id)
 {
    uint32_t filt_a = 0;
    if(rtr)
    {
-      filt_a |= (1<<31);
+      filt_a |= FLEXCAN_FILTER_A_MSK_RTR;
    }
 
    if(ide)
    {
-      filt_a |= (1<<30);
-      filt_a |= ((ext_id & 0x3fffffff) << 1);
+      filt_a |= FLEXCAN_FILTER_A_MSK_IDE;
+      filt_a |= ((ext_id & FLEXCAN_MB_ID_EXT_MASK) << 1);
    }
    else
    {
-      filt_a |= ((ext_id & 0x0007FFF)  << 19);
+      filt_a |= ((ext_id & 0x7FF) << 19);
    }
    return filt_a;
 }
@@ -470,8 +531,8 @@ uint32_t FLEXCAN_filter_b(uint8_t rtr_a,
                            uint16_t id_a, 
                            uint16_t id_b)
 {
-   uint16_t filt_1 = 0;
-   uint16_t filt_2 = 0;
+   uint32_t filt_1 = 0;
+   uint32_t filt_2 = 0;
 
    /* Form first part of filter */
    if(rtr_a)
@@ -482,11 +543,11 @@ uint32_t FLEXCAN_filter_b(uint8_t rtr_a,
    if(ide_a)
    {
       filt_1 |= (1<<14);
-      filt_1 |= (id_a & 0x1fff);
+      filt_1 |= (id_a & 0x3FFF);
    }
    else 
    {
-      filt_1 |= ((id_a & 0x7FFF) << 3);
+      filt_1 |= ((id_a & 0x7FF) << 3);
    }
 
    /* Form second part of filter */
@@ -498,18 +559,18 @@ uint32_t FLEXCAN_filter_b(uint8_t rtr_a,
    if(ide_b)
    {
       filt_2 |= (1<<14);
-      filt_2 |= (id_a & 0x1fff);
+      filt_2 |= (id_b & 0x3FFF);
    }
 
    else
    {
-      filt_2 |= ((id_a & 0x7FFF) << 3);
+      filt_2 |= ((id_b & 0x7FF) << 3);
    }
 
    return (filt_1 << 16) | filt_2;
 }
 
-/** Forms a filter mask in format B. Filters on 4 (upper) 8-bit ID segments. 
+/** Forms a filter mask in format C. Filters on 4 (upper) 8-bit ID segments. 
  * @param id Array of 8-Bit ID slices. 
  * @param len Length of the ID array (MAX - 4).
  * @return Properly formatted acceptance filter. 
@@ -518,25 +579,305 @@ uint32_t FLEXCAN_filter_c(uint8_t * id, uint8_t len)
 {
    uint32_t filt_c = 0;   
    uint8_t i;
-   for(i = 0; i < len; i++)
+   for(i = 0; (i < len) && (i < 4); i++)
    {
-      filt_c |= id[i] << ((8 * i) - 1);
+      /* Slice 0 is the most significant byte of the element */
+      filt_c |= (uint32_t)id[i] << (24 - (8 * i));
    }
    return filt_c;
 }
 
 int FLEXCAN_status(FLEXCAN_status_t *status)
 {
-   status->tx_err_cnt = FLEXCAN_ECR_TX_ERR_COUNTER(FLEXCAN0_ECR);
-   status->rx_err_cnt = FLEXCAN_ECR_RX_ERR_COUNTER(FLEXCAN0_ECR);
+   uint32_t ecr = FLEXCAN0_ECR;
+
+   /* TX counter in bits 7:0, RX counter in bits 15:8 */
+   status->tx_err_cnt = ecr & 0xFF;
+   status->rx_err_cnt = (ecr >> 8) & 0xFF;
 
    /* First read gets all of the errors */
    status->errors    = FLEXCAN0_ESR1;
 
-   status->tx_wrn    = status->errors & FLEXCAN_ESR_TX_WRN;
-   status->rx_wrn    = status->errors & FLEXCAN_ESR_RX_WRN;
+   status->tx_wrn    = (status->errors & FLEXCAN_ESR_TX_WRN)? 1:0;
+   status->rx_wrn    = (status->errors & FLEXCAN_ESR_RX_WRN)? 1:0;
    status->flt_conf  = FLEXCAN_ESR_get_fault_code(status->errors);
    
    return FLEXCAN_SUCCESS;
 }
 
+int FLEXCAN_status_reg_callback(FLEXCAN_status_callback_t cb)
+{
+   status_callback_g = cb;
+   return FLEXCAN_SUCCESS;
+}
+
+int FLEXCAN_set_bus_off_recovery(uint8_t automatic)
+{
+   /* BOFF_REC can be written in any mode, clearing it while bus off starts the recovery */
+   if(automatic)
+      FLEXCAN0_CTRL1 &= ~FLEXCAN_CTRL_BOFF_REC;
+   else
+      FLEXCAN0_CTRL1 |= FLEXCAN_CTRL_BOFF_REC;
+   return FLEXCAN_SUCCESS;
+}
+
+int FLEXCAN_set_timing(FLEXCAN_config_t config)
+{
+   config_g = config;
+
+   /* The timing fields can only be written in freeze mode */
+   FLEXCAN_freeze();
+   FLEXCAN0_CTRL1 = (FLEXCAN0_CTRL1 & ~(FLEXCAN_CTRL_PROPSEG(0x7) | FLEXCAN_CTRL_RJW(0x3) |
+                     FLEXCAN_CTRL_PSEG1(0x7) | FLEXCAN_CTRL_PSEG2(0x7) | FLEXCAN_CTRL_PRESDIV(0xFF))) |
+                    FLEXCAN_CTRL_PROPSEG(config.propseg) | FLEXCAN_CTRL_RJW(config.rjw) |
+                    FLEXCAN_CTRL_PSEG1(config.pseg_1) | FLEXCAN_CTRL_PSEG2(config.pseg_2) |
+                    FLEXCAN_CTRL_PRESDIV(config.presdiv);
+   FLEXCAN_unfreeze();
+
+   return FLEXCAN_SUCCESS;
+}
+
+int FLEXCAN_set_listen_only(uint8_t enable)
+{
+   /* LOM can only be written in freeze mode */
+   FLEXCAN_freeze();
+   if(enable)
+      FLEXCAN0_CTRL1 |= FLEXCAN_CTRL_LOM;
+   else
+      FLEXCAN0_CTRL1 &= ~FLEXCAN_CTRL_LOM;
+   FLEXCAN_unfreeze();
+
+   return FLEXCAN_SUCCESS;
+}
+
+/* =========================================================================  */
+/* TX Queue                                                                   */
+/* =========================================================================  */
+
+/* Arbitration key: base ID, then IDE (a standard frame wins over an extended
+ * one with the same base ID), then the extended ID bits. Lower wins. */
+static uint32_t FLEXCAN_txq_key(const FLEXCAN_frame_t *frame)
+{
+   if(frame->ide)
+      return ((frame->id >> 18) & 0x7FF) << 19 | (1 << 18) | (frame->id & 0x3FFFF);
+
+   return (frame->id & 0x7FF) << 19;
+}
+
+/* Local function ONLY: loads a frame into a TX mailbox and starts it. */
+static void FLEXCAN_txq_load(uint8_t mb, FLEXCAN_tx_entry_t *entry)
+{
+   uint32_t cs = FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_ONCE) | FLEXCAN_MB_CS_LENGTH(entry->frame.dlc);
+
+   txq_mb_g[mb - FLEXCAN_TX_BASE_MB] = *entry;
+   txq_mb_state_g[mb - FLEXCAN_TX_BASE_MB] = FLEXCAN_TXQ_MB_BUSY;
+
+   FLEXCAN0_MBn_CS(mb) = FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_INACTIVE);
+   if(entry->frame.ide)
+   {
+      FLEXCAN0_MBn_ID(mb) = entry->frame.id & FLEXCAN_MB_ID_EXT_MASK;
+      cs |= FLEXCAN_MB_CS_IDE | FLEXCAN_MB_CS_SRR;
+   }
+   else
+   {
+      FLEXCAN0_MBn_ID(mb) = FLEXCAN_MB_ID_IDSTD(entry->frame.id);
+   }
+   if(entry->frame.rtr)
+      cs |= FLEXCAN_MB_CS_RTR;
+
+   FLEXCAN0_MBn_WORD0(mb) = (entry->frame.data[0]<<24)|(entry->frame.data[1]<<16)|(entry->frame.data[2]<<8)|entry->frame.data[3];
+   FLEXCAN0_MBn_WORD1(mb) = (entry->frame.data[4]<<24)|(entry->frame.data[5]<<16)|(entry->frame.data[6]<<8)|entry->frame.data[7];
+   FLEXCAN0_MBn_CS(mb) = cs;
+}
+
+/* Local function ONLY: puts an entry into the queue by priority. The queue must have room. */
+static void FLEXCAN_txq_insert(const FLEXCAN_tx_entry_t *entry)
+{
+   uint8_t slot = txq_free_g[FLEXCAN_TXQ_SIZE - 1 - txq_count_g];
+   uint8_t i = txq_count_g;
+
+   txq_entries_g[slot] = *entry;
+   while(i > 0)
+   {
+      FLEXCAN_tx_entry_t *prev = &txq_entries_g[txq_order_g[i - 1]];
+      if((prev->key < entry->key) || ((prev->key == entry->key) && (prev->seq < entry->seq)))
+         break;
+      txq_order_g[i] = txq_order_g[i - 1];
+      i--;
+   }
+   txq_order_g[i] = slot;
+   txq_count_g++;
+}
+
+/* Local function ONLY: checks whether a frame with this key is in a TX mailbox,
+ * the controller could send a second one with the same ID first. */
+static uint8_t FLEXCAN_txq_in_flight(uint32_t key)
+{
+   uint8_t i;
+   for(i = 0; i < FLEXCAN_TX_MB_WIDTH; i++)
+   {
+      if((txq_mb_state_g[i] != FLEXCAN_TXQ_MB_FREE) && (txq_mb_g[i].key == key))
+         return 1;
+   }
+   return 0;
+}
+
+/* Local function ONLY: loads the highest priority queued frame that can go into
+ * a free TX mailbox. Called with interrupts disabled or from the TX interrupt. */
+static void FLEXCAN_txq_fill(uint8_t mb)
+{
+   uint8_t i;
+   uint8_t slot;
+
+   for(i = 0; i < txq_count_g; i++)
+   {
+      slot = txq_order_g[i];
+      if(FLEXCAN_txq_in_flight(txq_entries_g[slot].key))
+         continue;
+
+      memmove(&txq_order_g[i], &txq_order_g[i + 1], txq_count_g - i - 1);
+      txq_count_g--;
+      txq_free_g[FLEXCAN_TXQ_SIZE - 1 - txq_count_g] = slot;
+      FLEXCAN_txq_load(mb, &txq_entries_g[slot]);
+      return;
+   }
+}
+
+/* TX mailbox interrupt (flag already cleared): the frame was sent or aborted. */
+void FLEXCAN_txq_isr(uint8_t mb)
+{
+   uint8_t n = mb - FLEXCAN_TX_BASE_MB;
+   uint8_t state = txq_mb_state_g[n];
+   uint8_t aborted = (FLEXCAN_get_code(FLEXCAN0_MBn_CS(mb)) == FLEXCAN_MB_CODE_TX_ABORT);
+
+   if(state == FLEXCAN_TXQ_MB_FREE)
+      return;
+
+   txq_mb_state_g[n] = FLEXCAN_TXQ_MB_FREE;
+   if(state == FLEXCAN_TXQ_MB_CANCEL)
+      txq_cancels_g--;
+
+   if(aborted && (state == FLEXCAN_TXQ_MB_CANCEL))
+   {
+      /* Made room for a higher priority frame, goes back in its old place
+       * (FLEXCAN_txq_send kept a queue entry for it). */
+      FLEXCAN_txq_insert(&txq_mb_g[n]);
+   }
+   else if(txq_callback_g != NULL)
+   {
+      txq_callback_g(&txq_mb_g[n].frame, txq_mb_g[n].tag, aborted ? FLEXCAN_TX_ABORTED : FLEXCAN_TX_SUCCESS);
+   }
+   FLEXCAN_txq_fill(mb);
+}
+
+int FLEXCAN_txq_init(FLEXCAN_txq_callback_t cb)
+{
+   uint8_t i;
+
+   __disable_irq();
+   txq_callback_g = cb;
+   txq_count_g = 0;
+   txq_cancels_g = 0;
+   for(i = 0; i < FLEXCAN_TXQ_SIZE; i++)
+      txq_free_g[i] = i;
+
+   for(i = 0; i < FLEXCAN_TX_MB_WIDTH; i++)
+   {
+      txq_mb_state_g[i] = FLEXCAN_TXQ_MB_FREE;
+      FLEXCAN0_MBn_CS(FLEXCAN_TX_BASE_MB + i) = FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_INACTIVE);
+      FLEXCAN0_IFLAG1 = (1 << (FLEXCAN_TX_BASE_MB + i));
+      FLEXCAN_mb_reg_callback(FLEXCAN_TX_BASE_MB + i, FLEXCAN_txq_isr);
+   }
+   __enable_irq();
+   return FLEXCAN_SUCCESS;
+}
+
+int FLEXCAN_txq_send(const FLEXCAN_frame_t *frame, uint32_t tag)
+{
+   FLEXCAN_tx_entry_t entry;
+   uint8_t i;
+   uint8_t victim = FLEXCAN_TX_MB_WIDTH;
+
+   entry.frame = *frame;
+   entry.tag = tag;
+   entry.key = FLEXCAN_txq_key(frame);
+
+   __disable_irq();
+   if((txq_count_g + txq_cancels_g) >= FLEXCAN_TXQ_SIZE)
+   {
+      __enable_irq();
+      return FLEXCAN_ERROR;
+   }
+   entry.seq = txq_seq_g++;
+   FLEXCAN_txq_insert(&entry);
+
+   for(i = 0; i < FLEXCAN_TX_MB_WIDTH; i++)
+   {
+      if(txq_mb_state_g[i] == FLEXCAN_TXQ_MB_FREE)
+      {
+         FLEXCAN_txq_fill(FLEXCAN_TX_BASE_MB + i);
+         __enable_irq();
+         return FLEXCAN_SUCCESS;
+      }
+      /* Lowest priority frame still waiting for the bus (not sent with its interrupt pending) */
+      if((txq_mb_state_g[i] == FLEXCAN_TXQ_MB_BUSY) && !(FLEXCAN0_IFLAG1 & (1 << (FLEXCAN_TX_BASE_MB + i))) &&
+         ((victim == FLEXCAN_TX_MB_WIDTH) || (txq_mb_g[i].key > txq_mb_g[victim].key)))
+         victim = i;
+   }
+
+   /* Every mailbox busy: cancel the lowest priority one if this frame would win against it.
+    * The abort completes in the TX interrupt, unless the frame was sent in the meantime. */
+   if((victim != FLEXCAN_TX_MB_WIDTH) && (entry.key < txq_mb_g[victim].key) && !FLEXCAN_txq_in_flight(entry.key))
+   {
+      txq_mb_state_g[victim] = FLEXCAN_TXQ_MB_CANCEL;
+      txq_cancels_g++;
+      FLEXCAN0_MBn_CS(FLEXCAN_TX_BASE_MB + victim) = FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_ABORT);
+   }
+   __enable_irq();
+   return FLEXCAN_SUCCESS;
+}
+
+int FLEXCAN_txq_pending(void)
+{
+   int pending;
+   uint8_t i;
+
+   __disable_irq();
+   pending = txq_count_g;
+   for(i = 0; i < FLEXCAN_TX_MB_WIDTH; i++)
+   {
+      if(txq_mb_state_g[i] != FLEXCAN_TXQ_MB_FREE)
+         pending++;
+   }
+   __enable_irq();
+   return pending;
+}
+
+int FLEXCAN_txq_flush(void)
+{
+   FLEXCAN_tx_entry_t entry;
+   uint8_t i;
+
+   __disable_irq();
+   for(i = 0; i < FLEXCAN_TX_MB_WIDTH; i++)
+   {
+      if(txq_mb_state_g[i] != FLEXCAN_TXQ_MB_FREE)
+      {
+         if(txq_mb_state_g[i] == FLEXCAN_TXQ_MB_CANCEL)
+            txq_cancels_g--;
+         txq_mb_state_g[i] = FLEXCAN_TXQ_MB_ABORT;
+         FLEXCAN0_MBn_CS(FLEXCAN_TX_BASE_MB + i) = FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_ABORT);
+      }
+   }
+   while(txq_count_g > 0)
+   {
+      txq_count_g--;
+      entry = txq_entries_g[txq_order_g[0]];
+      txq_free_g[FLEXCAN_TXQ_SIZE - 1 - txq_count_g] = txq_order_g[0];
+      memmove(&txq_order_g[0], &txq_order_g[1], txq_count_g);
+      if(txq_callback_g != NULL)
+         txq_callback_g(&entry.frame, entry.tag, FLEXCAN_TX_ABORTED);
+   }
+   __enable_irq();
+   return FLEXCAN_SUCCESS;
+}
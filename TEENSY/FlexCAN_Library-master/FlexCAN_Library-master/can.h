@@ -19,31 +19,39 @@
 
 #define FLEXCAN_FIFO_MB             0        /*!< Mailbox used for the FIFO.         */
 #define FLEXCAN_RX_BASE_MB          8        /*!< Lowest MB used for RX callbacks.   */ 
-#define FLEXCAN_RX_MB_WIDTH         5        /*!< Number of Mailboxes allocated for reception Callbacks. */
+#define FLEXCAN_RX_MB_WIDTH         2        /*!< Number of Mailboxes allocated for reception Callbacks. */
 #define FLEXCAN_TX_BASE_MB          (FLEXCAN_RX_BASE_MB + FLEXCAN_RX_MB_WIDTH + 1)     /*!< Base mailbox for tx. */
-#define FLEXCAN_TX_MB_WIDTH         (FLEXCAN_MAX_MB - FLEXCAN_TX_BASE_MB) /*!< Number of mailboxes allocated for transmission. */
-#define FLEXCAN_MAX_MB              15
+#define FLEXCAN_TX_MB_WIDTH         (FLEXCAN_MAX_MB + 1 - FLEXCAN_TX_BASE_MB) /*!< Number of mailboxes allocated for transmission. */
+#define FLEXCAN_MAX_MB              15       /*!< Last mailbox (16 on the Teensy 3.1). */
+#define FLEXCAN_TXQ_SIZE            32       /*!< Frames the TX queue holds besides the ones in the TX mailboxes. */
 
 /* Interrupts */
 #define FLEXCAN_INT_FIFO_OVERFLOW   7  /*!< Interrupt Number in IFLAGS1 that represents FIFO Overflow. */
 #define FLEXCAN_INT_FIFO_WARNING    6  /*!< Interrupt Number in IFLAGS1 that represents FIFO Warning (Half Full). */
 #define FLEXCAN_INT_FIFO_AVALIBLE   5  /*!< Interrupt Number in IFLAGS1 for data in the FIFO. */
 
+/* Fault confinement (ISO 11898-1) */
+#define FLEXCAN_FLT_ERROR_ACTIVE    0  /*!< flt_conf: Error Active. */
+#define FLEXCAN_FLT_ERROR_PASSIVE   1  /*!< flt_conf: Error Passive (TX or RX error counter > 127). */
+#define FLEXCAN_FLT_BUS_OFF         2  /*!< flt_conf: Bus Off (TX error counter > 255), 3 reads as bus off too. */
+#define FLEXCAN_BUS_OFF_RECOVERY_BITS (128 * 11)  /*!< Recessive bits a bus off node has to see before it is Error Active again. */
+
 #define FLEXCAN_ID_FILT_TYPE 0      // A - (00) ONE FULL (Extended) ID per table element 
                                     // B - (01) Two full standard IDS per filter table element.
                                     // C - (10) Four partial (8-Bit) Standard IDS per table element.
                                     // D - (11) All Frames Rejected
 
-#define FLEXCAN_FILTER_A_MSK_RTR (1<<31)
-#define FLEXCAN_FILTER_A_MSK_IDE (1<<30)
-#define FLEXCAN_FILTER_A_MSK_ID  (0x3FFFE)
+#define FLEXCAN_FILTER_A_MSK_RTR (1UL<<31)
+#define FLEXCAN_FILTER_A_MSK_IDE (1UL<<30)
+#define FLEXCAN_FILTER_A_MSK_ID  (0x3FFFFFFEUL)  /*!< All 29 bits of an extended ID. */
+#define FLEXCAN_FILTER_A_MSK_STD (0x3FF80000UL)  /*!< All 11 bits of a standard ID. */
 
-#define FLEXCAN_FILTER_B_MSK_RTR_A (1<<31)
-#define FLEXCAN_FILTER_B_MSK_IDE_A (1<<30)
-#define FLEXCAN_FILTER_B_MSK_ID_A  (0x3F00)
-#define FLEXCAN_FILTER_B_MSK_RTR_B (1<<15)
-#define FLEXCAN_FILTER_B_MSK_IDE_B (1<<14)
-#define FLEXCAN_FILTER_B_MSK_ID_B  (0x003F)
+#define FLEXCAN_FILTER_B_MSK_RTR_A (1UL<<31)
+#define FLEXCAN_FILTER_B_MSK_IDE_A (1UL<<30)
+#define FLEXCAN_FILTER_B_MSK_ID_A  (0x3FFF0000UL)
+#define FLEXCAN_FILTER_B_MSK_RTR_B (1UL<<15)
+#define FLEXCAN_FILTER_B_MSK_IDE_B (1UL<<14)
+#define FLEXCAN_FILTER_B_MSK_ID_B  (0x00003FFFUL)
 
 /** Struct to hold a full FLEXCAN message.
  *
@@ -75,7 +83,7 @@ typedef struct {
 typedef struct {
    uint8_t tx_err_cnt;  /*!< Transmit Error Counter. */
    uint8_t rx_err_cnt;  /*!< Recieve Error Counter. */
-   uint8_t errors;      /*!< Various error bits See FLEXCAN docs. */
+   uint32_t errors;     /*!< ESR1 as read, error bits See FLEXCAN docs (reading clears them). */
    uint8_t tx_wrn;      /*!< Transmit Warning Error (TX_CNT > 96). */
    uint8_t rx_wrn;      /*!< Recieve Warning Error (RX_CNT > 96). */
    uint8_t flt_conf;    /*!< 00 - Error Active 01 - Error Passive  1X- Bus Off. */
@@ -98,17 +106,20 @@ typedef void (*FLEXCAN_rx_callback)(FLEXCAN_frame_t *);
 typedef void (*FLEXCAN_tx_callback)(FLEXCAN_frame_t *);
 typedef void (*FLEXCAN_fifo_callback)(FLEXCAN_frame_t *);
 typedef void (*FLEXCAN_callback_t)(uint8_t mb );
+typedef void (*FLEXCAN_status_callback_t)(FLEXCAN_status_t *status);
+typedef void (*FLEXCAN_txq_callback_t)(const FLEXCAN_frame_t *frame, uint32_t tag, int result);
 
 
-
-// TODO: Warning Interrupts
-// TODO: Status struct.
-// TODO: Bus off interrupt
-
 /** Sets a Filter for the FIFO.
+ * A frame is received when it matches any slot: the bits set in the mask are compared, the
+ * others are don't care. Every slot accepts all frames after FLEXCAN_init, so all 
+ * FLEXCAN_NUM_FIFO_FILTERS slots have to be set (repeating a filter is fine) to reject frames.
+ * e.g. only extended IDs 0x18DAF1xx: filter FLEXCAN_filter_a(0, 1, 0x18DAF100),
+ * mask FLEXCAN_FILTER_A_MSK_RTR | FLEXCAN_FILTER_A_MSK_IDE | (0x1FFFFF00 << 1).
  * @param n The number of the filter slot to use. (Default 0-7).
  * @param filter see FLEXCAN_filter_a, FLEXCAN_filter_b, FLEXCAN_filter_c.
- * @param mask
+ * @param mask Bits of the filter to compare, in the same format.
+ * @return FLEXCAN_SUCCESS or FLEXCAN_ERROR (no such slot).
  */
 int FLEXCAN_set_fifo_filter(uint8_t n, uint32_t filter, uint32_t mask);
 
@@ -136,7 +147,7 @@ uint32_t FLEXCAN_filter_b(uint8_t rtr_a,
                            uint16_t id_a, 
                            uint16_t id_b);
 
-/** Forms a filter mask in format B. Filters on 4 (upper) 8-bit ID segments. 
+/** Forms a filter mask in format C. Filters on 4 (upper) 8-bit ID segments. 
  * @param id Array of 8-Bit ID slices. 
  * @param len Length of the ID array (MAX - 4).
  * @return Properly formatted acceptance filter. 
@@ -220,18 +231,82 @@ int FLEXCAN_fifo_read(FLEXCAN_frame_t * frame);
 int FLEXCAN_abort_mb(uint8_t mb);
 
 /** Writes a message over FLEXCAN Hardware.
+ * Goes through the TX queue without waiting, FLEXCAN_txq_init has to be called first.
  * @param frame 
- * @param option
- * @return FLEXCAN_TX_SUCCESS or FLEXCAN_TX_ABORTED.
+ * @param option Ignored, the controller always retries until the frame is sent or aborted.
+ * @return FLEXCAN_TX_SUCCESS if queued, FLEXCAN_ERROR if the queue is full.
  */
 int FLEXCAN_write(FLEXCAN_frame_t frame, FLEXCAN_tx_option_t option);
 
+/** Sets up the TX queue on the FLEXCAN_TX_MB_WIDTH TX mailboxes, call after FLEXCAN_init and FLEXCAN_reset.
+ * Queued frames go out by priority (lowest arbitration ID first, in queueing order for the same ID):
+ * the controller arbitrates between the TX mailboxes, and a frame queued while every mailbox is
+ * busy takes the mailbox of the lowest priority frame, which goes back into the queue.
+ * @param cb Called from the TX interrupt when a frame was sent or aborted, NULL for none.
+ * @return FLEXCAN_SUCCESS or FLEXCAN_ERROR.
+ */
+int FLEXCAN_txq_init(FLEXCAN_txq_callback_t cb);
+
+/** Queues a frame for transmission, never waits.
+ * @param frame Frame to send (standard or extended ID).
+ * @param tag Passed back to the callback with the result.
+ * @return FLEXCAN_SUCCESS or FLEXCAN_ERROR if the queue is full.
+ */
+int FLEXCAN_txq_send(const FLEXCAN_frame_t *frame, uint32_t tag);
+
+/** Gets the number of frames not completed yet.
+ * @return Frames queued or in a TX mailbox.
+ */
+int FLEXCAN_txq_pending(void);
+
+/** Aborts every frame not sent yet, never waits.
+ * Queued frames complete with FLEXCAN_TX_ABORTED right away, the ones in a TX mailbox once
+ * the controller has either sent (FLEXCAN_TX_SUCCESS) or aborted them.
+ * @return FLEXCAN_SUCCESS or FLEXCAN_ERROR.
+ */
+int FLEXCAN_txq_flush(void);
+
 /** Gets detailed FLEXCAN and writes back to pointer to status struct.
  * @param The pointer to store the status information.
  * @return FLEXCAN_SUCCESS or FLEXCAN_ERROR.
  */
 int FLEXCAN_status(FLEXCAN_status_t * status);
 
+/** Register callback function for the error, TX/RX warning and bus off interrupts.
+ * Runs in the interrupt with the status read there, the interrupt flags are already cleared.
+ * The hardware has no interrupt for the way back to Error Active, poll FLEXCAN_status for it.
+ * @param cb Callback Function, NULL for none.
+ * @return FLEXCAN_SUCCESS or FLEXCAN_ERROR.
+ */
+int FLEXCAN_status_reg_callback(FLEXCAN_status_callback_t cb);
+
+/** Selects how the controller leaves bus off.
+ * Automatic recovery starts as soon as the controller is bus off and takes FLEXCAN_BUS_OFF_RECOVERY_BITS
+ * recessive bits, the least the spec allows. Otherwise the controller stays bus off until this is
+ * called with automatic set, which starts the recovery right away. FLEXCAN_init selects manual.
+ * @param automatic 1 - recover on its own, 0 - stay bus off.
+ * @return FLEXCAN_SUCCESS or FLEXCAN_ERROR.
+ */
+int FLEXCAN_set_bus_off_recovery(uint8_t automatic);
+
+/** Sets the bit timing without initializing the controller again.
+ * Only the PRESDIV, RJW, PSEG1, PSEG2 and PROPSEG fields of CTRL1 change, the interrupt masks, filters
+ * and mailboxes are kept. The controller is frozen while they are written, a frame on the bus is lost.
+ * @param config
+ * @see FLEXCAN_config_t
+ * @return FLEXCAN_SUCCESS or FLEXCAN_ERROR.
+ */
+int FLEXCAN_set_timing(FLEXCAN_config_t config);
+
+/** Selects listen only mode.
+ * In listen only mode the controller receives without acknowledging frames or signalling errors and
+ * transmits nothing, error counters are frozen; errors are still flagged in ESR1. A node that does not
+ * know the bit rate of the bus can try one without disturbing it.
+ * @param enable 1 - listen only, 0 - normal.
+ * @return FLEXCAN_SUCCESS or FLEXCAN_ERROR.
+ */
+int FLEXCAN_set_listen_only(uint8_t enable);
+
 /** Resets FLEXCAN Hardware.
  * @return FLEXCAN_SUCCESS or FLEXCAN_ERROR.
  */
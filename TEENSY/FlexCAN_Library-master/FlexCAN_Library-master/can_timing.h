@@ -0,0 +1,179 @@
+/* @description Bit timing solver for the FLEXCAN module, FLEXCAN_config_t from a bit rate, sample point and clock.
+ * @file can_timing.h
+ *
+ * Everything here is constexpr (C++11, one return statement each) so the timing is worked out
+ * by the compiler. A bit rate is exact when clock / (prescaler * time quanta) rounds to it, so
+ * 83333 bit/s is the 83 1/3 kbit/s of 16 MHz / 192. Of the exact prescaler / time quanta pairs
+ * the one whose sample point comes closest to the one asked for is taken, the most time quanta
+ * on a tie. Phase 2 is what is left after the sample point, phase 1 is made as long as it can
+ * be and the propagation segment gets the rest.
+ *
+ * FLEXCAN_TIMING(clock, bitrate, sample_point) fails to compile when there is no exact solution.
+ * FLEXCAN_timing() called at run time gives an all zero config instead (see FLEXCAN_timing_exists).
+ */
+#ifndef _CAN_TIMING_H_
+#define _CAN_TIMING_H_
+
+#include "can.h"
+
+#define FLEXCAN_CLOCK_HZ            16000000 /*!< Protocol engine clock, the oscillator (CTRL1 CLK_SRC 0). */
+#define FLEXCAN_TIMING_TQ_MIN       8        /*!< Fewest time quanta per bit. */
+#define FLEXCAN_TIMING_TQ_MAX       25       /*!< Most time quanta per bit. */
+#define FLEXCAN_TIMING_PRESC_MAX    256      /*!< Largest prescaler (PRESDIV + 1). */
+#define FLEXCAN_TIMING_SEG_MAX      8        /*!< Longest PROPSEG, PSEG1 and PSEG2 (time quanta). */
+#define FLEXCAN_TIMING_PSEG2_MIN    2        /*!< Shortest phase 2 (time quanta), the information processing time. */
+#define FLEXCAN_TIMING_SJW_MAX      4        /*!< Longest resynchronization jump width (time quanta). */
+#define FLEXCAN_TIMING_SJW          2        /*!< Default resynchronization jump width (time quanta), what FLEXCAN_init always had. */
+#define FLEXCAN_TIMING_NONE         0xFFFFFFFF /*!< Sample point error of a pair that gives no exact bit rate. */
+
+/* ========================================================================= */
+/* Helpers, in the order they are used                                       */
+/* ========================================================================= */
+
+constexpr uint32_t FLEXCAN_timing_min(uint32_t a, uint32_t b) { return (a < b) ? a : b; }
+constexpr uint32_t FLEXCAN_timing_max(uint32_t a, uint32_t b) { return (a > b) ? a : b; }
+constexpr uint32_t FLEXCAN_timing_diff(uint32_t a, uint32_t b) { return (a > b) ? (a - b) : (b - a); }
+
+/** Prescaler closest to a bit rate with a number of time quanta. */
+constexpr uint32_t FLEXCAN_timing_presc(uint32_t clock, uint32_t bitrate, uint32_t tq)
+{
+   return (clock + (bitrate * tq) / 2) / (bitrate * tq);
+}
+
+/** Bit rate (bit/s, rounded) of a prescaler and number of time quanta. */
+constexpr uint32_t FLEXCAN_timing_rate(uint32_t clock, uint32_t presc, uint32_t tq)
+{
+   return (clock + (presc * tq) / 2) / (presc * tq);
+}
+
+/** Whether or not a number of time quanta gives the bit rate exactly with a prescaler in range. */
+constexpr bool FLEXCAN_timing_exact(uint32_t clock, uint32_t bitrate, uint32_t tq)
+{
+   return (FLEXCAN_timing_presc(clock, bitrate, tq) >= 1) &&
+          (FLEXCAN_timing_presc(clock, bitrate, tq) <= FLEXCAN_TIMING_PRESC_MAX) &&
+          (FLEXCAN_timing_rate(clock, FLEXCAN_timing_presc(clock, bitrate, tq), tq) == bitrate);
+}
+
+/** Phase 2 (time quanta) putting the sample point closest to the one asked for (per mille),
+ *  leaving 2 - 16 time quanta for the propagation segment and phase 1. */
+constexpr uint32_t FLEXCAN_timing_pseg2(uint32_t tq, uint32_t sample_point)
+{
+   return FLEXCAN_timing_min(FLEXCAN_timing_min(FLEXCAN_TIMING_SEG_MAX, tq - 3),
+                             FLEXCAN_timing_max(FLEXCAN_timing_max(FLEXCAN_TIMING_PSEG2_MIN, (tq > 17) ? (tq - 17) : 0),
+                                                tq - (tq * sample_point + 500) / 1000));
+}
+
+/** Distance (per million) of the sample point from the one asked for, FLEXCAN_TIMING_NONE if
+ *  the number of time quanta gives no exact bit rate. */
+constexpr uint32_t FLEXCAN_timing_error(uint32_t clock, uint32_t bitrate, uint32_t sample_point, uint32_t tq)
+{
+   return ((tq >= FLEXCAN_TIMING_TQ_MIN) && FLEXCAN_timing_exact(clock, bitrate, tq)) ?
+          FLEXCAN_timing_diff(((tq - FLEXCAN_timing_pseg2(tq, sample_point)) * 1000000) / tq, sample_point * 1000) :
+          FLEXCAN_TIMING_NONE;
+}
+
+/** Number of time quanta with the smallest sample point error, from tq down, 0 if none is exact. */
+constexpr uint32_t FLEXCAN_timing_best(uint32_t clock, uint32_t bitrate, uint32_t sample_point, uint32_t tq, uint32_t best)
+{
+   return (tq < FLEXCAN_TIMING_TQ_MIN) ? best :
+          FLEXCAN_timing_best(clock, bitrate, sample_point, tq - 1,
+                              (FLEXCAN_timing_error(clock, bitrate, sample_point, tq) <
+                               FLEXCAN_timing_error(clock, bitrate, sample_point, best)) ? tq : best);
+}
+
+/** Number of time quanta of the solution, 0 if there is none. */
+constexpr uint32_t FLEXCAN_timing_tq(uint32_t clock, uint32_t bitrate, uint32_t sample_point)
+{
+   return ((bitrate == 0) || (sample_point == 0) || (sample_point >= 1000)) ? 0 :
+          FLEXCAN_timing_best(clock, bitrate, sample_point, FLEXCAN_TIMING_TQ_MAX, 0);
+}
+
+/** Register fields of a solution: phase 1 as long as it can be, the propagation segment the rest. */
+constexpr FLEXCAN_config_t FLEXCAN_timing_fields(uint32_t presc, uint32_t tseg1, uint32_t pseg2, uint32_t sjw)
+{
+   return {(uint8_t)(presc - 1),
+           (uint8_t)(tseg1 - FLEXCAN_timing_min(FLEXCAN_TIMING_SEG_MAX, tseg1 - 1) - 1),
+           (uint8_t)(FLEXCAN_timing_min(FLEXCAN_timing_min(sjw, FLEXCAN_TIMING_SJW_MAX),
+                                        FLEXCAN_timing_min(pseg2, FLEXCAN_timing_min(FLEXCAN_TIMING_SEG_MAX, tseg1 - 1))) - 1),
+           (uint8_t)(FLEXCAN_timing_min(FLEXCAN_TIMING_SEG_MAX, tseg1 - 1) - 1),
+           (uint8_t)(pseg2 - 1)};
+}
+
+/** Stands in for the config when there is no exact solution. Not constexpr, so reaching it
+ *  while the compiler works out a timing is an error. */
+inline FLEXCAN_config_t FLEXCAN_timing_no_solution(void)
+{
+   FLEXCAN_config_t none = {0, 0, 0, 0, 0};
+   return none;
+}
+
+constexpr FLEXCAN_config_t FLEXCAN_timing_solve(uint32_t clock, uint32_t bitrate, uint32_t sample_point, uint32_t sjw, uint32_t tq)
+{
+   return (tq == 0) ? FLEXCAN_timing_no_solution() :
+          FLEXCAN_timing_fields(FLEXCAN_timing_presc(clock, bitrate, tq), tq - 1 - FLEXCAN_timing_pseg2(tq, sample_point),
+                                FLEXCAN_timing_pseg2(tq, sample_point), (sjw == 0) ? 1 : sjw);
+}
+
+/* ========================================================================= */
+/* Solver                                                                    */
+/* ========================================================================= */
+
+/** Checks whether or not a bit rate can be had exactly from a clock.
+ * @param clock Protocol engine clock (Hz).
+ * @param bitrate Bit rate (bit/s).
+ * @param sample_point Sample point (per mille of the bit, e.g. 875), must be below 1000.
+ * @return Whether or not FLEXCAN_timing finds a solution.
+ */
+constexpr bool FLEXCAN_timing_exists(uint32_t clock, uint32_t bitrate, uint32_t sample_point)
+{
+   return FLEXCAN_timing_tq(clock, bitrate, sample_point) != 0;
+}
+
+/** Works out the bit timing for a bit rate.
+ * @param clock Protocol engine clock (Hz), FLEXCAN_CLOCK_HZ.
+ * @param bitrate Bit rate (bit/s).
+ * @param sample_point Sample point (per mille of the bit), the closest one possible is taken.
+ * @param sjw Resynchronization jump width (time quanta), shortened to fit the phase segments.
+ * @return Config for FLEXCAN_init or FLEXCAN_set_timing, all zero if there is no exact solution.
+ */
+constexpr FLEXCAN_config_t FLEXCAN_timing(uint32_t clock, uint32_t bitrate, uint32_t sample_point, uint32_t sjw = FLEXCAN_TIMING_SJW)
+{
+   return FLEXCAN_timing_solve(clock, bitrate, sample_point, sjw, FLEXCAN_timing_tq(clock, bitrate, sample_point));
+}
+
+/** Number of time quanta per bit of a config. */
+constexpr uint32_t FLEXCAN_timing_quanta(FLEXCAN_config_t config)
+{
+   return 1 + (config.propseg + 1) + (config.pseg_1 + 1) + (config.pseg_2 + 1);
+}
+
+/** Bit rate (bit/s, rounded) of a config. */
+constexpr uint32_t FLEXCAN_timing_bitrate(uint32_t clock, FLEXCAN_config_t config)
+{
+   return FLEXCAN_timing_rate(clock, config.presdiv + 1, FLEXCAN_timing_quanta(config));
+}
+
+/** Sample point (per mille, rounded) of a config. */
+constexpr uint32_t FLEXCAN_timing_sample_point(FLEXCAN_config_t config)
+{
+   return ((FLEXCAN_timing_quanta(config) - (config.pseg_2 + 1)) * 1000 + FLEXCAN_timing_quanta(config) / 2) / FLEXCAN_timing_quanta(config);
+}
+
+/** The timing of a bit rate, always worked out by the compiler. */
+template <uint32_t CLOCK, uint32_t BITRATE, uint32_t SAMPLE_POINT>
+struct FLEXCAN_timing_t
+{
+   static_assert(FLEXCAN_timing_exists(CLOCK, BITRATE, SAMPLE_POINT),
+                 "No prescaler and number of time quanta give this bit rate exactly from this clock");
+   static constexpr FLEXCAN_config_t config = FLEXCAN_timing(CLOCK, BITRATE, SAMPLE_POINT);
+};
+
+template <uint32_t CLOCK, uint32_t BITRATE, uint32_t SAMPLE_POINT>
+constexpr FLEXCAN_config_t FLEXCAN_timing_t<CLOCK, BITRATE, SAMPLE_POINT>::config;
+
+/** Config for a bit rate, a compile error when there is no exact solution.
+ * e.g. FLEXCAN_init(FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 500000, 750));
+ */
+#define FLEXCAN_TIMING(clock, bitrate, sample_point)  (FLEXCAN_timing_t<(clock), (bitrate), (sample_point)>::config)
+
+#endif
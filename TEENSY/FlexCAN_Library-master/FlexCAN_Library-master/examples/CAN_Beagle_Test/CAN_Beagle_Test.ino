@@ -21,42 +21,15 @@ void echo(int argc, char ** argv);
 #define LED_PIN 13
 
 
-/* SHOULD BE MOVED INTO THE CAN LIBRARY */
-void can0_bus_off_isr( void )
+/* Error, warning and bus off interrupts, the ISRs are in the library. */
+void can_status_callback(FLEXCAN_status_t *status)
 {
-   NVIC_CLEAR_PENDING(IRQ_CAN_BUS_OFF);
-   Serial.println("CLEARING BOF");
-   FLEXCAN0_ESR1 |= FLEXCAN_ESR_BOFF_INT; /* NOW CLEAR ALL OF THE MAILBOXES */
-}
-
-/* SHOULD BE MOVED INTO THE CAN LIBRARY */
-void can0_tx_warn_isr(void)
-{
-   
-   /* Clear NVIC */
-   NVIC_CLEAR_PENDING(IRQ_CAN_TX_WARN);
-
-   /* Clear Flexcan interrupt flag */
-   FLEXCAN0_ESR1 |= FLEXCAN_ESR_TWRN_INT;
-   Serial.print(FLEXCAN0_IFLAG1);
-   Serial.println("Transmit WARNING!!!!!");
-}
-
-void can0_error_isr(void)
-{
-   NVIC_CLEAR_PENDING(IRQ_CAN_MESSAGE);
-   FLEXCAN0_ESR1 |= FLEXCAN_ESR_BIT1_ERR | FLEXCAN_ESR_BIT0_ERR;
-   /*
-   if(FLEXCAN_abort_mb(10) == FLEXCAN_SUCCESS)
-   {
-      Serial.println("Message Aborted");
-   }
-   else
-   {
-      Serial.println("Message Abort Failed");
-
-   }
-   */
+   if(status->errors & FLEXCAN_ESR_BOFF_INT)
+      Serial.println("BUS OFF");
+   if(status->errors & FLEXCAN_ESR_TWRN_INT)
+      Serial.println("Transmit WARNING!!!!!");
+   if(status->errors & FLEXCAN_ESR_RWRN_INT)
+      Serial.println("Receive WARNING!!!!!");
 }
 
 void can_fifo_callback(uint8_t x){
@@ -95,7 +68,9 @@ void setup(){
    can_config.pseg_2    = 2;  /*!< Phase 2 length */
 
    FLEXCAN_init(can_config);
+   FLEXCAN_txq_init(NULL);
    FLEXCAN_fifo_reg_callback(can_fifo_callback);
+   FLEXCAN_status_reg_callback(can_status_callback);
    
    FLEXCAN_frame_t cb_frame_a; 
    cb_frame_a.id = 0x0030;
@@ -137,6 +112,7 @@ void FLEXCAN_cmd_status(int argc, char ** argv)
 void FLEXCAN_cmd_reset(int argc, char ** argv)
 {
    FLEXCAN_reset();
+   FLEXCAN_txq_init(NULL);
    Serial.println("FLEXCAN reset.");
 }
 
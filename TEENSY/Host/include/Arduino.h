@@ -0,0 +1,183 @@
+/*
+  * @file Arduino.h
+  *
+  * Host stand-in for the Teensy 3.x Arduino core. Provides the subset of the core used by the
+  * logger (Print, Serial, millis(), NVIC and port macros) so the capture pipeline can be built
+  * and run on a Linux workstation.
+*/
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <stddef.h>
+
+/* DEFINES */
+#define DEC                           10
+#define HEX                           16
+#define OCT                           8
+#define BIN                           2
+
+#define HIGH                          1
+#define LOW                           0
+#define INPUT                         0
+#define OUTPUT                        1
+#define INPUT_PULLUP                  2
+#define RISING                        3
+#define FALLING                       2
+#define CHANGE                        4
+
+/* Interrupt numbers of the CAN0 peripheral, matching the Teensy 3.1 vector table */
+#define IRQ_CAN_MESSAGE               29
+#define IRQ_CAN_BUS_OFF               30
+#define IRQ_CAN_ERROR                 31
+#define IRQ_CAN_TX_WARN               32
+#define IRQ_CAN_RX_WARN               33
+#define IRQ_CAN_WAKEUP                34
+#define IRQ_PORT_PINS                 40        // Host only: the pin interrupts of attachInterrupt, one vector for every pin
+#define HOST_NUM_IRQ                  64
+#define HOST_NUM_PINS                 64        // Number of digital pins
+
+#define NVIC_ENABLE_IRQ(n)            HostNvicEnable((n), true)
+#define NVIC_DISABLE_IRQ(n)           HostNvicEnable((n), false)
+#define NVIC_CLEAR_PENDING(n)         ((void)(n))
+#define NVIC_IS_ENABLED(n)            HostNvicIsEnabled(n)
+#define __disable_irq()               HostGlobalIrqEnable(false)
+#define __enable_irq()                HostGlobalIrqEnable(true)
+#define noInterrupts()                __disable_irq()
+#define interrupts()                  __enable_irq()
+
+/* Pin mux, clock gating and oscillator registers touched by FLEXCAN_init */
+extern uint32_t g_HostPortRegisters[8];
+#define CORE_PIN3_CONFIG              (g_HostPortRegisters[0])
+#define CORE_PIN4_CONFIG              (g_HostPortRegisters[1])
+#define OSC0_CR                       (g_HostPortRegisters[2])
+#define SIM_SCGC6                     (g_HostPortRegisters[3])
+#define PORT_PCR_MUX(n)               (((n) & 7) << 8)
+#define OSC_ERCLKEN                   0x80
+#define SIM_SCGC6_FLEXCAN0            0x00000010
+
+/* STRUCTS */
+typedef uint8_t byte;
+typedef void (*HostPinHandler)(uint8_t pin, uint8_t value);
+
+/* FUNCTION PROTOTYPES */
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield(void);
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+uint8_t digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*function)(void), int mode);
+void detachInterrupt(uint8_t pin);
+uint8_t digitalPinToInterrupt(uint8_t pin);
+
+/* Host interrupt controller: handlers run synchronously, one at a time, when raised and unmasked */
+void HostNvicEnable(uint32_t irq, bool enable);
+bool HostNvicIsEnabled(uint32_t irq);
+void HostGlobalIrqEnable(bool enable);
+bool HostIrqAllowed(uint32_t irq);
+void HostIrqAttach(uint32_t irq, void (*handler)(void));
+void HostIrqRaise(uint32_t irq);
+void HostIrqDispatch(void);
+bool HostInInterrupt(void);
+
+/* Host pins: what the sketch writes goes to the device attached to the pin, what a device drives
+   is read back and its edges run the attached interrupt */
+void HostPinAttachOutput(uint8_t pin, HostPinHandler handler);
+void HostPinDrive(uint8_t pin, uint8_t value);
+void HostPinReset(void);
+
+/* Host clock control: real time by default, virtual time for replay and simulation */
+void HostClockUseVirtualTime(bool useVirtual);
+void HostClockSetMicros(uint64_t us);
+void HostClockAdvanceMicros(uint64_t us);
+uint64_t HostClockMicros(void);
+
+void setup(void);
+void loop(void);
+
+/* CLASSES */
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) { return write((const uint8_t *) str, strlen(str)); }
+
+  size_t print(const char *str) { return write(str); }
+  size_t print(char c) { return write((uint8_t) c); }
+  size_t print(unsigned char n, int base = DEC) { return printNumber(n, base); }
+  size_t print(int n, int base = DEC) { return printSigned(n, base); }
+  size_t print(unsigned int n, int base = DEC) { return printNumber(n, base); }
+  size_t print(long n, int base = DEC) { return printSigned(n, base); }
+  size_t print(unsigned long n, int base = DEC) { return printNumber(n, base); }
+  size_t print(long long n, int base = DEC) { return printSigned(n, base); }
+  size_t print(unsigned long long n, int base = DEC) { return printNumber(n, base); }
+  size_t print(double n, int digits = 2);
+
+  size_t println(void) { return write((const uint8_t *) "\r\n", 2); }
+  template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+  template <typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+
+private:
+  size_t printNumber(unsigned long long n, int base);
+  size_t printSigned(long long n, int base);
+};
+
+class usb_serial_class : public Print
+{
+public:
+  void begin(uint32_t baud) { (void) baud; }
+  void end(void) {}
+  int available(void);
+  int read(void);
+  int peek(void);
+  int availableForWrite(void);
+  void flush(void);
+  operator bool() { return true; }
+  using Print::write;
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buffer, size_t size);
+};
+
+class IntervalTimer
+{
+public:
+  IntervalTimer() : m_function(NULL), m_periodUs(0), m_nextUs(0) {}
+  ~IntervalTimer() { end(); }
+  bool begin(void (*function)(void), uint32_t periodUs);
+  bool HostBeginAt(void (*function)(void), uint64_t deadlineUs);
+  void end(void);
+  void priority(uint8_t level) { (void) level; }
+  static void HostRunExpired(void);
+  static bool HostNextDeadline(uint64_t *deadlineUs);
+
+private:
+  bool HostArm(void (*function)(void), uint32_t periodUs, uint64_t deadlineUs);
+
+  void (*m_function)(void);
+  uint32_t m_periodUs;
+  uint64_t m_nextUs;
+};
+
+/* GLOBAL VARIABLES */
+extern usb_serial_class Serial;
+
+/* Host serial plumbing: input injected by tests, output optionally captured */
+void HostSerialInject(const char *data, size_t len);
+void HostSerialSetOutput(FILE *stream);
+void HostSerialSetTxRate(uint32_t bytesPerSecond);
+
+#endif // HOST_ARDUINO_H
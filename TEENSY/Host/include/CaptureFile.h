@@ -0,0 +1,40 @@
+/*
+  * @file CaptureFile.h
+  *
+  * Reads captures written by FileWriteMessage (attack files and serial logs) back into
+  * CAN messages
+*/
+
+#ifndef CAPTUREFILE_H
+#define CAPTUREFILE_H
+
+/* INCLUDES */
+#include "CANMessage.h"
+
+/* DEFINES */
+#define CAPTURE_LINE_SIZE             256       // Longest line read from a capture
+#define CAPTURE_INITIAL_CAPACITY      4096      // Number of messages allocated on the first append
+
+/* ENUMS */
+enum CaptureLine_e {
+  eCAPTURE_LINE_FRAME = 0,              // Timestamp, ID and payload of a frame
+  eCAPTURE_LINE_OTHER,                  // Header, PDU, footer or blank line
+  eCAPTURE_LINE_MALFORMED               // Starts like a frame but cannot be parsed
+};
+
+/* STRUCTS */
+typedef struct {
+  can_message_t *messages;              // Messages in file order
+  uint32_t count;                       // Number of messages
+  uint32_t capacity;                    // Number of messages allocated
+  uint32_t malformedLines;              // Frame lines that could not be parsed
+} capture_t;
+
+/* FUNCTION PROTOTYPES */
+void CaptureInit(capture_t *capture);
+void CaptureFree(capture_t *capture);
+bool CaptureAppend(capture_t *capture, const can_message_t *message);
+CaptureLine_e CaptureParseLine(const char *line, can_message_t *message);
+bool CaptureLoadFile(capture_t *capture, const char *path);
+
+#endif // CAPTUREFILE_H
@@ -0,0 +1,45 @@
+/*
+  * @file CaptureScan.h
+  *
+  * Fast scanning of captures written by FileWriteMessage: memory-mapped files, line-aligned
+  * chunks, a SWAR (8 characters per word) line parser and an ID index for per-ID tables
+*/
+
+#ifndef CAPTURESCAN_H
+#define CAPTURESCAN_H
+
+/* INCLUDES */
+#include <stddef.h>
+#include <CaptureFile.h>
+
+/* DEFINES */
+#define CAPTURE_SCAN_LINE_SIZE        64        // Longest line the word parser takes, longer frame lines go to CaptureParseLine
+#define CAPTURE_ID_INDEX_CAPACITY     256       // Number of slots allocated on the first insert
+#define CAPTURE_ID_EXTENDED           0x80000000UL // Key bit of an extended ID, so 7E8 and 000007E8 are different IDs
+#define CAPTURE_ID_TEXT_SIZE          (CAN_EXT_ID_DIGITS + 1) // Size of the text CaptureFormatId writes
+
+/* STRUCTS */
+typedef struct {
+  const char *data;                     // File contents, NULL for an empty file
+  size_t size;                          // Number of bytes
+} capture_map_t;
+
+typedef struct {
+  uint32_t *ids;                        // Arbitration ID of each slot, CAPTURE_ID_EXTENDED set for an extended ID
+  uint32_t *values;                     // Dense index of each slot, UINT32_MAX when the slot is free
+  uint32_t capacity;                    // Number of slots, a power of two
+  uint32_t count;                       // Number of IDs, the dense indexes are [0 - count)
+} capture_id_index_t;
+
+/* FUNCTION PROTOTYPES */
+bool CaptureMapFile(capture_map_t *map, const char *path);
+void CaptureUnmapFile(capture_map_t *map);
+uint32_t CaptureSplitChunks(const char *data, size_t size, size_t chunkSize, size_t *bounds, uint32_t maxChunks);
+CaptureLine_e CaptureScanLine(const char *line, size_t length, can_message_t *message);
+void CaptureIdIndexInit(capture_id_index_t *index);
+void CaptureIdIndexFree(capture_id_index_t *index);
+uint32_t CaptureIdIndexFind(capture_id_index_t *index, uint32_t id, uint8_t ide, bool *added);
+uint32_t CaptureIdIndexGet(const capture_id_index_t *index, uint32_t id, uint8_t ide);
+const char *CaptureFormatId(char *text, uint32_t id, uint8_t ide);
+
+#endif // CAPTURESCAN_H
@@ -0,0 +1,25 @@
+/*
+  * @file DS1307RTC.h
+  *
+  * Host stand-in for the DS1307 real time clock, backed by the workstation clock
+*/
+
+#ifndef HOST_DS1307RTC_H
+#define HOST_DS1307RTC_H
+
+/* INCLUDES */
+#include <Time.h>
+
+/* CLASSES */
+class DS1307RTC
+{
+public:
+  static time_t get(void);
+  static bool set(time_t t);
+  static bool chipPresent(void) { return true; }
+};
+
+/* GLOBAL VARIABLES */
+extern DS1307RTC RTC;
+
+#endif // HOST_DS1307RTC_H
@@ -0,0 +1,56 @@
+/*
+  * @file FlexcanHostBus.h
+  *
+  * Bus side of the simulated FlexCAN0 controller: frames put on the bus are loaded into the
+  * RX FIFO (raising the message interrupt), frames transmitted from a mailbox are handed to
+  * a host callback. Bus errors move the error counters through the fault confinement states,
+  * and a bus off controller only comes back after the recovery the spec asks for. Frames sent
+  * at another bit rate than the one the controller is set to are bus errors, not frames.
+*/
+
+#ifndef HOST_FLEXCAN_BUS_H
+#define HOST_FLEXCAN_BUS_H
+
+/* INCLUDES */
+#include <can.h>
+
+/* DEFINES */
+#define FLEXCAN_HOST_FIFO_DEPTH       6         // Number of frames the RX FIFO holds
+#define FLEXCAN_HOST_FIFO_WARNING     5         // Number of frames that raises the FIFO warning flag
+#define FLEXCAN_HOST_CLOCK_HZ         16000000  // Protocol engine clock (oscillator)
+#define FLEXCAN_HOST_WARNING_LIMIT    96        // Error counter that raises a warning
+#define FLEXCAN_HOST_PASSIVE_LIMIT    127       // Error counter above which the controller is error passive
+#define FLEXCAN_HOST_BUS_OFF_LIMIT    255       // TX error counter above which the controller is bus off
+#define FLEXCAN_HOST_RESYNC_BITS      11        // Recessive bits needed to join the bus again
+#define FLEXCAN_HOST_RATE_TOLERANCE   15        // Bit rate mismatch (per mille) still received, about the oscillator tolerance CAN allows
+
+/* STRUCTS */
+typedef struct {
+  uint32_t framesOffered;               // Frames put on the bus for reception
+  uint32_t framesReceived;              // Frames loaded into the RX FIFO
+  uint32_t framesIgnored;               // Frames missed because the controller was disabled or frozen
+  uint32_t framesFiltered;              // Frames no RX FIFO filter table element accepted
+  uint32_t framesMisread;               // Frames sent at another bit rate than the controller's, each one a bus error
+  uint32_t fifoOverflows;               // Frames lost because the RX FIFO was full
+  uint32_t framesTransmitted;           // Frames sent from a TX mailbox
+  uint32_t busErrors;                   // Errors injected while the controller was on the bus
+  uint32_t busOffs;                     // Number of times the controller went bus off
+  uint32_t recoveries;                  // Number of times the controller came back from bus off
+  uint64_t busOffAt;                    // Time (us) the controller last went bus off
+  uint64_t recoveredAt;                 // Time (us) the controller last came back from bus off
+} flexcan_host_stats_t;
+
+typedef void (*FlexcanHostTxHandler)(const FLEXCAN_frame_t *frame);
+
+/* FUNCTION PROTOTYPES */
+void FlexcanHostReset(void);
+bool FlexcanHostReceive(const FLEXCAN_frame_t *frame);
+uint8_t FlexcanHostFifoCount(void);
+void FlexcanHostSetTxHandler(FlexcanHostTxHandler handler);
+void FlexcanHostGetStats(flexcan_host_stats_t *stats);
+void FlexcanHostBusError(bool transmitting, uint16_t count);
+void FlexcanHostSetTxPaused(bool paused);
+uint32_t FlexcanHostBitTimeNs(void);
+void FlexcanHostSetBusBitRate(uint32_t bitRate);
+
+#endif // HOST_FLEXCAN_BUS_H
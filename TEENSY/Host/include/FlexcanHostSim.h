@@ -0,0 +1,54 @@
+/*
+  * @file FlexcanHostSim.h
+  *
+  * Host stand-in for the FlexCAN0 register block. Included by kinetis_flexcan.h when
+  * FLEXCAN_HOST_SIM is defined: every register macro then refers to a FlexcanHostRegister,
+  * whose reads and writes are routed through the simulation so freeze/reset handshakes,
+  * write-1-to-clear flags, the RX FIFO and TX mailboxes behave like the hardware.
+*/
+
+#ifndef HOST_FLEXCAN_SIM_H
+#define HOST_FLEXCAN_SIM_H
+
+/* INCLUDES */
+#include <stdint.h>
+
+/* DEFINES */
+#define FLEXCAN_HOST_REGISTER_SPACE   0x4000    // Size (bytes) of the simulated register block
+
+/* FUNCTION PROTOTYPES */
+uint32_t FlexcanHostRead(uint32_t offset);
+void FlexcanHostWrite(uint32_t offset, uint32_t value);
+
+/* CLASSES */
+class FlexcanHostRegister
+{
+public:
+  operator uint32_t() const { return FlexcanHostRead(offset()); }
+  FlexcanHostRegister &operator=(uint32_t value) { FlexcanHostWrite(offset(), value); return *this; }
+  FlexcanHostRegister &operator=(const FlexcanHostRegister &other) { return *this = (uint32_t) other; }
+  FlexcanHostRegister &operator|=(uint32_t value) { return *this = ((uint32_t) *this | value); }
+  FlexcanHostRegister &operator&=(uint32_t value) { return *this = ((uint32_t) *this & value); }
+  FlexcanHostRegister &operator^=(uint32_t value) { return *this = ((uint32_t) *this ^ value); }
+
+  uint32_t value;                       // Register contents, only touched by the simulation
+
+private:
+  uint32_t offset() const;
+};
+
+/* GLOBAL VARIABLES */
+extern FlexcanHostRegister g_FlexcanHostRegisters[FLEXCAN_HOST_REGISTER_SPACE / 4];
+
+/* Register block base addresses, only CAN0 exists on the Teensy 3.1 */
+#define FLEXCAN0_BASE                 ((uintptr_t) g_FlexcanHostRegisters)
+#define FLEXCAN1_BASE                 FLEXCAN0_BASE
+
+typedef FlexcanHostRegister vuint32_t;
+
+inline uint32_t FlexcanHostRegister::offset() const
+{
+  return (uint32_t)((this - g_FlexcanHostRegisters) * 4);
+}
+
+#endif // HOST_FLEXCAN_SIM_H
@@ -0,0 +1,44 @@
+/*
+  * @file HostTest.h
+  *
+  * What the host test programs share: the command line (every test takes -v, the options of a
+  * test are listed in a table), the error count the checks add to and the PASS/FAIL line with
+  * the exit code ctest reads.
+*/
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+/* INCLUDES */
+#include <stdint.h>
+#include <stdio.h>
+
+/* DEFINES */
+// Counts an error and prints the message when the condition does not hold
+#define HOST_TEST_CHECK(condition, ...)   do { if (!(condition)) { HostTestFail(__VA_ARGS__); } } while (0)
+
+/* ENUMS */
+typedef enum {
+  eHOST_TEST_FLAG,                      // bool set when the option is given
+  eHOST_TEST_UINT,                      // uint32_t read with strtoul (decimal, 0x hex)
+  eHOST_TEST_STRING,                    // const char * to the argument
+} HostTestOption_e;
+
+/* STRUCTS */
+typedef struct {
+  char option;                          // Option letter
+  HostTestOption_e type;                // Type of the value
+  void *value;                          // Value set from the command line
+} host_test_option_t;
+
+/* GLOBAL VARIABLES */
+extern bool g_HostTestVerbose;          // -v given
+extern uint32_t g_HostTestErrors;       // Number of checks that failed
+
+/* FUNCTION PROTOTYPES */
+bool HostTestOptions(int argc, char **argv, const char *usage, const host_test_option_t *options, uint8_t numOptions);
+void HostTestUsage(void);
+void HostTestFail(const char *format, ...) __attribute__((format(printf, 1, 2)));
+int HostTestSummary(void);
+
+#endif // HOST_TEST_H
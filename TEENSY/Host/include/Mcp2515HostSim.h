@@ -0,0 +1,46 @@
+/*
+  * @file Mcp2515HostSim.h
+  *
+  * Simulated MCP2515 CAN controller on the host SPI bus, as on the Seeed CAN-BUS Shield. The
+  * SPI instructions the mcp_can library and the interrupt driven reader use are decoded against
+  * a register file: RESET, READ, WRITE, BIT MODIFY, READ STATUS, RX STATUS and READ RX BUFFER
+  * (whose chip select going high clears the RXnIF flag of the buffer read). Frames put on the bus
+  * are loaded into RXB0, rolled over into RXB1 when BUKT is set, or lost with RX0OVR / RX1OVR set
+  * in EFLG when the buffers are full. The INT pin is low while a flag enabled in CANINTE is set.
+  * Every mask and filter accepts every frame, and transmission is not simulated.
+*/
+
+#ifndef HOST_MCP2515_SIM_H
+#define HOST_MCP2515_SIM_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <SPI.h>
+#include <can.h>
+
+/* DEFINES */
+#define MCP2515_HOST_REGISTER_SPACE   128       // Number of registers (addresses 0x00 - 0x7F)
+#define MCP2515_HOST_CANCTRL_RESET    0x87      // CANCTRL after a reset: configuration mode, CLKOUT on at F / 8
+#define MCP2515_HOST_CANSTAT_RESET    0x80      // CANSTAT after a reset: configuration mode
+
+/* STRUCTS */
+typedef struct {
+  uint32_t framesOffered;               // Frames put on the bus
+  uint32_t framesReceived;              // Frames loaded into RXB0 or RXB1
+  uint32_t framesRolledOver;            // Frames of those loaded into RXB1 because RXB0 was full
+  uint32_t framesIgnored;               // Frames missed because the controller was not in normal or listen only mode
+  uint32_t framesLost;                  // Frames lost because the receive buffers were full
+  uint32_t rx0Overflows;                // Number of times RX0OVR was set
+  uint32_t rx1Overflows;                // Number of times RX1OVR was set
+  uint32_t interrupts;                  // Number of times the INT pin went low
+  uint32_t transactions;                // Number of times the chip select went low
+  uint32_t spiBytes;                    // Bytes transferred with the chip select low
+} mcp2515_host_stats_t;
+
+/* FUNCTION PROTOTYPES */
+void Mcp2515HostReset(uint8_t csPin, uint8_t intPin);
+bool Mcp2515HostReceive(const FLEXCAN_frame_t *frame);
+void Mcp2515HostGetStats(mcp2515_host_stats_t *stats);
+uint8_t Mcp2515HostRegister(uint8_t address);
+
+#endif // HOST_MCP2515_SIM_H
@@ -0,0 +1,58 @@
+/*
+  * @file SPI.h
+  *
+  * Host stand-in for the SPI library. Each byte transferred goes to the simulated device whose
+  * chip select is low and takes its 8 bit times of the SPI clock off the host clock, so time
+  * spent on the SPI bus shows in virtual time. The SD card stand-in does not use it.
+*/
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+/* INCLUDES */
+#include <Arduino.h>
+
+/* DEFINES */
+#define MSBFIRST                      1
+#define LSBFIRST                      0
+#define SPI_MODE0                     0x00
+#define SPI_MODE1                     0x04
+#define SPI_MODE2                     0x08
+#define SPI_MODE3                     0x0C
+#define SPI_HOST_CLOCK                4000000   // SPI clock (Hz) after SPI.begin(), F_CPU / 4 on a 16 MHz AVR
+#define SPI_HOST_MAX_DEVICES          4         // Number of devices that can be attached
+
+/* STRUCTS */
+typedef uint8_t (*HostSpiDevice)(uint8_t data);
+
+/* CLASSES */
+class SPISettings
+{
+public:
+  SPISettings() : clock(SPI_HOST_CLOCK) {}
+  SPISettings(uint32_t clockHz, uint8_t bitOrder, uint8_t dataMode) : clock(clockHz) { (void) bitOrder; (void) dataMode; }
+
+  uint32_t clock;                       // SPI clock (Hz)
+};
+
+class SPIClass
+{
+public:
+  void begin(void);
+  void end(void) {}
+  void beginTransaction(SPISettings settings);
+  void endTransaction(void);
+  void usingInterrupt(uint8_t interruptNumber);
+  uint8_t transfer(uint8_t data);
+  void transfer(void *buf, size_t count);
+};
+
+/* GLOBAL VARIABLES */
+extern SPIClass SPI;
+
+/* Host SPI bus: devices attached by their chip select pin */
+void HostSpiAttach(uint8_t csPin, HostSpiDevice device);
+void HostSpiReset(void);
+uint32_t HostSpiBytes(void);
+
+#endif // HOST_SPI_H
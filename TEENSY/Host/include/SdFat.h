@@ -0,0 +1,101 @@
+/*
+  * @file SdFat.h
+  *
+  * Host stand-in for the SdFat library. Files and directories are created under a local
+  * directory (./sdcard by default, JEDI_SD_ROOT in the environment or SdFatHostSetRoot()).
+  * SdFatHostSetCloseTime() makes every close hold the caller for as long as a card takes to
+  * write out its buffers, with virtual time (and the bus) going on meanwhile.
+  * SdFatHostSetDiscardWrites() makes files opened for writing drop their bytes, for timing the
+  * code that writes them without the host disk.
+*/
+
+#ifndef HOST_SDFAT_H
+#define HOST_SDFAT_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <fcntl.h>
+
+/* DEFINES */
+#ifndef O_READ
+#define O_READ                        O_RDONLY
+#endif
+#ifndef O_WRITE
+#define O_WRITE                       O_WRONLY
+#endif
+#define O_AT_END                      0x40000000  // Position the file at its end when opened
+
+#define SPI_FULL_SPEED                0
+#define SPI_HALF_SPEED                1
+#define SPI_QUARTER_SPEED             2
+
+#define FAT_DATE(year, month, day)    (uint16_t)((((year) - 1980) << 9) | ((month) << 5) | (day))
+#define FAT_TIME(hour, minute, second) (uint16_t)(((hour) << 11) | ((minute) << 5) | ((second) >> 1))
+
+#define T_ACCESS                      1
+#define T_CREATE                      2
+#define T_WRITE                       4
+
+#define SD_HOST_ROOT_SIZE             256       // Longest local directory standing in for the card, with its terminator
+#define SD_HOST_NAME_SIZE             256       // Longest path on the card, with its terminator
+#define SD_HOST_PATH_SIZE             (SD_HOST_ROOT_SIZE + SD_HOST_NAME_SIZE)  // Longest host path: root, separator and path on the card
+
+/* CLASSES */
+class SdFile : public Print
+{
+public:
+  SdFile() : m_file(NULL), m_writeError(false) { m_path[0] = '\0'; }
+  ~SdFile() { close(); }
+  bool open(const char *path, int oflag = O_READ);
+  bool close(void);
+  bool isOpen(void) const { return m_file != NULL; }
+  bool sync(void);
+  int read(void);
+  int available(void);
+  uint32_t fileSize(void);
+  bool truncate(uint32_t length);
+  bool rmRfStar(void);
+  bool timestamp(uint8_t flags, uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second);
+  bool getWriteError(void) const { return m_writeError; }
+  void clearWriteError(void) { m_writeError = false; }
+  using Print::write;
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buffer, size_t size);
+  static void dateTimeCallback(void (*callback)(uint16_t *date, uint16_t *time));
+
+private:
+  FILE *m_file;
+  bool m_writeError;
+  char m_path[SD_HOST_NAME_SIZE];       // Path relative to the card root, empty for the root directory
+};
+
+class Sd2Card
+{
+public:
+  bool readOCR(uint32_t *ocr);
+};
+
+class SdFat
+{
+public:
+  bool begin(uint8_t chipSelect, uint8_t spiSpeed = SPI_FULL_SPEED);
+  bool exists(const char *path);
+  bool mkdir(const char *path);
+  bool remove(const char *path);
+  Sd2Card *card(void) { return &m_card; }
+  SdFile *vwd(void) { return &m_root; }
+
+private:
+  Sd2Card m_card;
+  SdFile m_root;
+};
+
+/* FUNCTION PROTOTYPES */
+void SdFatHostSetRoot(const char *directory);
+const char *SdFatHostRoot(void);
+void SdFatHostPath(char *hostPath, size_t size, const char *path);
+void SdFatHostSetCardPresent(bool present);
+void SdFatHostSetCloseTime(uint32_t us);
+void SdFatHostSetDiscardWrites(bool discard);
+
+#endif // HOST_SDFAT_H
@@ -0,0 +1,54 @@
+/*
+  * @file SocketCan.h
+  *
+  * Linux SocketCAN input: raw CAN sockets read in batches (recvmmsg) with kernel receive
+  * timestamps, and a load sender that puts the vehicle traffic model on an interface
+*/
+
+#ifndef SOCKETCAN_H
+#define SOCKETCAN_H
+
+/* INCLUDES */
+#include <pthread.h>
+#include "CANMessage.h"
+
+/* DEFINES */
+#define SOCKETCAN_DEFAULT_BATCH       64        // Number of frames read or sent per system call
+#define SOCKETCAN_MAX_BATCH           256       // Largest batch
+#define SOCKETCAN_RCVBUF_SIZE         (8 * 1024 * 1024) // Socket receive buffer, frames wait here while files are written
+#define SOCKETCAN_LOAD_BITRATE        TRAFFIC_BITRATE_1M // Bit rate of the traffic model the load sender uses
+
+/* STRUCTS */
+typedef struct {
+  uint32_t framesReceived;              // Data frames handed to the handler
+  uint32_t framesSkipped;               // Error, remote and CAN FD frames
+  uint32_t kernelDrops;                 // Frames the socket dropped, buffer full (SO_RXQ_OVFL)
+  uint32_t batches;                     // Number of recvmmsg calls that returned frames
+  uint32_t hardwareStamps;              // Frames stamped by the interface
+  uint32_t softwareStamps;              // Frames stamped by the kernel
+  uint64_t firstFrameNs;                // Host time of the first frame
+  uint64_t lastFrameNs;                 // Host time of the last frame
+} socketcan_stats_t;
+
+typedef struct {
+  const char *interface;                // Interface the load is sent on
+  uint32_t numFrames;                   // Number of frames to send
+  volatile uint32_t framesSent;         // Number of frames sent
+  volatile bool done;                   // Whether or not the sender has finished
+  volatile bool stop;                   // Set to make the sender finish early
+  pthread_t thread;                     // Sender thread
+} socketcan_load_t;
+
+typedef void (*SocketCanHandler)(can_message_t *message);
+
+/* FUNCTION PROTOTYPES */
+int SocketCanOpen(const char *interface, bool receive);
+void SocketCanClose(int fd);
+bool SocketCanWaitReadable(int fd, int timeoutMs);
+uint32_t SocketCanReceive(int fd, uint16_t batch, SocketCanHandler handler, socketcan_stats_t *stats);
+bool SocketCanStartLoad(socketcan_load_t *load);
+void SocketCanStopLoad(socketcan_load_t *load);
+const char *SocketCanLastError(void);
+uint64_t SocketCanNanos(void);
+
+#endif // SOCKETCAN_H
@@ -0,0 +1,37 @@
+/*
+  * @file Time.h
+  *
+  * Host stand-in for the Arduino Time library, backed by the workstation clock
+*/
+
+#ifndef HOST_TIMELIB_H
+#define HOST_TIMELIB_H
+
+/* INCLUDES */
+#include <time.h>
+#include <Arduino.h>
+
+/* ENUMS */
+typedef enum
+{
+  timeNotSet = 0,
+  timeNeedsSync,
+  timeSet
+} timeStatus_t;
+
+/* STRUCTS */
+typedef time_t (*getExternalTime)(void);
+
+/* FUNCTION PROTOTYPES */
+time_t now(void);
+int year(time_t t);
+int month(time_t t);
+int day(time_t t);
+int hour(time_t t);
+int minute(time_t t);
+int second(time_t t);
+void setSyncProvider(getExternalTime provider);
+timeStatus_t timeStatus(void);
+void setTime(time_t t);
+
+#endif // HOST_TIMELIB_H
@@ -0,0 +1,28 @@
+/*
+  * @file UDSLoggerHost.h
+  *
+  * State of the logger sketch (UDS_Data_Logger_Final_Interrupts.ino) made visible to the host
+  * programs that drive it
+*/
+
+#ifndef UDSLOGGERHOST_H
+#define UDSLOGGERHOST_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <FlexcanHostBus.h>
+#include "UDSDataLogger.h"
+
+/* GLOBAL VARIABLES */
+extern circular_buffer_t g_CB;
+extern isotp_reassembler_t g_IsoTp;
+extern session_manager_t g_Sessions;
+extern SdFat g_SD;
+extern sd_recovery_t g_SdRecovery;
+extern sd_monitor_t g_SdMonitor;
+extern bus_monitor_t g_BusMonitor;
+extern model_t g_Model;
+extern telemetry_t g_Telemetry;
+extern char g_Timestamp[TIMESTAMP_SIZE];
+
+#endif // UDSLOGGERHOST_H
@@ -0,0 +1,13 @@
+/*
+  * @file Wire.h
+  *
+  * Host stand-in for the Wire (I2C) library, only the RTC uses it on the device
+*/
+
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+/* INCLUDES */
+#include <Arduino.h>
+
+#endif // HOST_WIRE_H
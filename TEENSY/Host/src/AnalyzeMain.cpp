@@ -0,0 +1,867 @@
+/*
+  * @file AnalyzeMain.cpp
+  *
+  * Analyzes archives of captures written by FileWriteMessage (Before_UDS_Attack_N.txt and
+  * After_UDS_Attack_N.txt) on every core: files are memory-mapped and cut into line-aligned
+  * chunks, chunks are parsed by CaptureScanLine into per-ID tables in parallel, the tables of
+  * a file are merged in order and its diagnostic frames go through the ISO-TP reassembler and
+  * the UDS decoder. Prints per-ID statistics (extended IDs padded to 8 digits as in the logs)
+  * and a summary of every attack session.
+  *
+  * uds_logger_analyze [-j threads] [-c chunk_kb] [-I] [-S] [-V] capture...
+  *
+  *   -I  no per-ID table
+  *   -S  no attack session table
+  *   -V  also reads every file with CaptureLoadFile and checks the frames match
+  *
+  * A capture is a file or a directory of .txt files.
+*/
+
+/* INCLUDES */
+#include <CaptureScan.h>
+#include "IsoTp.h"
+#include "UDSDecoder.h"
+#include <ftw.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* DEFINES */
+#define ANALYZE_DEFAULT_CHUNK_KB      1024      // Chunk size when -c is not given
+#define ANALYZE_MAX_CHUNKS            256       // Largest number of chunks per file
+#define ANALYZE_MAX_THREADS           256       // Largest number of worker threads
+#define ANALYZE_NO_SESSION            0xFFFFFFFF // Session number of a file not named like an attack file
+#define ANALYZE_NO_PERIOD             0xFFFFFFFF // Minimum period of an ID seen once
+#define ANALYZE_FNV_OFFSET            0xCBF29CE484222325ULL
+#define ANALYZE_FNV_PRIME             0x100000001B3ULL
+
+/* STRUCTS */
+typedef struct {
+  uint32_t id;                          // Arbitration ID
+  uint8_t ide;                          // ID Extended bit: 1 - extended (29 bit) ID, 0 - standard (11 bit) ID
+  uint32_t count;                       // Number of frames
+  uint32_t files;                       // Number of files the ID is in
+  uint32_t firstTimestamp;              // Timestamp of the first frame
+  uint32_t lastTimestamp;               // Timestamp of the last frame
+  uint32_t minPeriod;                   // Shortest time between two frames
+  uint32_t maxPeriod;                   // Longest time between two frames
+  uint64_t periodSum;                   // Sum of the times between frames
+  uint32_t periods;                     // Number of times between frames
+  uint16_t dlcMask;                     // Bit n set when a frame had n data bytes
+  uint8_t changeMask;                   // Bit n set when data byte n changed between two frames
+  uint8_t firstLen;                     // Length of the first frame
+  uint8_t lastLen;                      // Length of the last frame
+  uint8_t firstData[8];                 // Payload of the first frame
+  uint8_t lastData[8];                  // Payload of the last frame
+} analyze_id_t;
+
+typedef struct {
+  capture_id_index_t index;             // ID -> entry
+  analyze_id_t *entries;                // Entries in the order IDs were first seen
+  uint32_t capacity;                    // Number of entries allocated
+} analyze_table_t;
+
+typedef struct {
+  size_t begin;                         // Offset of the first line
+  size_t end;                           // Offset past the last line
+  analyze_table_t table;                // Per-ID statistics of the chunk
+  can_message_t *diag;                  // Frames on diagnostic IDs, in file order
+  uint32_t numDiag;                     // Number of diagnostic frames
+  uint32_t diagCapacity;                // Number of diagnostic frames allocated
+  uint32_t frames;                      // Number of frames
+  uint32_t malformed;                   // Number of frame lines that could not be parsed
+  uint64_t checksum;                    // Sum of the frame hashes
+  bool outOfMemory;                     // Whether or not parsing stopped for lack of memory
+} analyze_chunk_t;
+
+typedef struct {
+  char *path;                           // Path of the capture file
+  uint32_t dirLength;                   // Length of the directory part of the path
+  uint32_t session;                     // N of Before/After_UDS_Attack_N.txt
+  bool after;                           // Whether or not the file is an After file
+  bool readable;                        // Whether or not the file could be mapped
+  capture_map_t map;                    // File contents
+  analyze_chunk_t *chunks;              // Chunks in file order
+  uint32_t numChunks;                   // Number of chunks
+  volatile uint32_t chunksLeft;         // Number of chunks not yet parsed, the last one merges the file
+  analyze_table_t table;                // Per-ID statistics of the file
+  uds_summary_t summary;                // Diagnostic traffic of the file
+  uint32_t pdus;                        // Number of diagnostic PDUs reassembled
+  uint32_t frames;                      // Number of frames
+  uint32_t malformed;                   // Number of frame lines that could not be parsed
+  uint64_t checksum;                    // Sum of the frame hashes
+  bool outOfMemory;                     // Whether or not the statistics are incomplete for lack of memory
+} analyze_file_t;
+
+typedef struct {
+  uint32_t fileIndex;                   // File of the chunk
+  uint32_t chunkIndex;                  // Chunk within the file
+} analyze_work_t;
+
+/* GLOBAL VARIABLES */
+static analyze_file_t *s_Files = NULL;
+static uint32_t s_NumFiles = 0;
+static uint32_t s_FilesCapacity = 0;
+static analyze_work_t *s_Work = NULL;
+static uint32_t s_NumWork = 0;
+static volatile uint32_t s_NextWork = 0;
+static size_t s_ChunkSize = ANALYZE_DEFAULT_CHUNK_KB * 1024;
+
+static uint64_t AnalyzeNanos(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t) now.tv_sec * 1000000000ULL) + (uint64_t) now.tv_nsec;
+}
+
+/** Hash of a frame, summed over a file so the sum does not depend on how the file was cut
+ */
+static uint64_t AnalyzeHash(const can_message_t *message)
+{
+  uint64_t hash = ANALYZE_FNV_OFFSET;
+  uint8_t fields[10 + sizeof(message->data)];
+  uint8_t index = 0;
+
+  memcpy(&fields[0], &message->timestamp, 4);
+  memcpy(&fields[4], &message->id, 4);
+  fields[8] = message->ide;
+  fields[9] = message->len;
+  memcpy(&fields[10], message->data, message->len);
+  for (index = 0; index < (10 + message->len); index++)
+  {
+    hash = (hash ^ fields[index]) * ANALYZE_FNV_PRIME;
+  }
+  return hash;
+}
+
+static void AnalyzeTableInit(analyze_table_t *table)
+{
+  CaptureIdIndexInit(&table->index);
+  table->entries = NULL;
+  table->capacity = 0;
+}
+
+static void AnalyzeTableFree(analyze_table_t *table)
+{
+  CaptureIdIndexFree(&table->index);
+  free(table->entries);
+  AnalyzeTableInit(table);
+}
+
+/** Entry of an ID, a new zeroed entry when the ID is not in the table yet
+ *  @return Entry, NULL when out of memory
+ */
+static analyze_id_t *AnalyzeTableEntry(analyze_table_t *table, uint32_t id, uint8_t ide, bool *added)
+{
+  analyze_id_t *entries = NULL;
+  uint32_t capacity = 0;
+  uint32_t index = 0;
+
+  if (table->index.count == table->capacity)
+  {
+    // grown before the index takes a new ID, so every ID in the index has an entry
+    capacity = (table->capacity == 0) ? CAPTURE_ID_INDEX_CAPACITY : (table->capacity * 2);
+    entries = (analyze_id_t *) realloc(table->entries, capacity * sizeof(analyze_id_t));
+    if (entries == NULL)
+    {
+      return NULL;
+    }
+    table->entries = entries;
+    table->capacity = capacity;
+  }
+  index = CaptureIdIndexFind(&table->index, id, ide, added);
+  if (index == UINT32_MAX)
+  {
+    return NULL;
+  }
+  if (*added)
+  {
+    memset(&table->entries[index], 0, sizeof(analyze_id_t));
+    table->entries[index].id = id;
+    table->entries[index].ide = ide;
+    table->entries[index].minPeriod = ANALYZE_NO_PERIOD;
+  }
+  return &table->entries[index];
+}
+
+/** Adds the time between two frames of an ID
+ */
+static void AnalyzeAddPeriod(analyze_id_t *entry, uint32_t from, uint32_t to)
+{
+  uint32_t period = to - from;
+  if (to < from)
+  {
+    return; // timestamps went back (clock set), not a period
+  }
+  entry->minPeriod = (period < entry->minPeriod) ? period : entry->minPeriod;
+  entry->maxPeriod = (period > entry->maxPeriod) ? period : entry->maxPeriod;
+  entry->periodSum += period;
+  entry->periods++;
+}
+
+/** Bytes that differ between two payloads, a byte only one of them has counts as changed
+ */
+static uint8_t AnalyzeChangedBytes(const uint8_t *first, uint8_t firstLen, const uint8_t *second, uint8_t secondLen)
+{
+  uint8_t mask = 0;
+  uint8_t index = 0;
+  for (index = 0; index < 8; index++)
+  {
+    if ((index < firstLen) != (index < secondLen))
+    {
+      mask |= (uint8_t)(1 << index);
+    }
+    else if ((index < firstLen) && (first[index] != second[index]))
+    {
+      mask |= (uint8_t)(1 << index);
+    }
+  }
+  return mask;
+}
+
+static bool AnalyzeTableAdd(analyze_table_t *table, const can_message_t *message)
+{
+  bool added = false;
+  analyze_id_t *entry = AnalyzeTableEntry(table, message->id, message->ide, &added);
+
+  if (entry == NULL)
+  {
+    return false;
+  }
+  if (added)
+  {
+    entry->firstTimestamp = message->timestamp;
+    entry->firstLen = message->len;
+    memcpy(entry->firstData, message->data, message->len);
+  }
+  else
+  {
+    AnalyzeAddPeriod(entry, entry->lastTimestamp, message->timestamp);
+    entry->changeMask |= AnalyzeChangedBytes(entry->lastData, entry->lastLen, message->data, message->len);
+  }
+  entry->count++;
+  entry->dlcMask |= (uint16_t)(1 << message->len);
+  entry->lastTimestamp = message->timestamp;
+  entry->lastLen = message->len;
+  memcpy(entry->lastData, message->data, message->len);
+  return true;
+}
+
+/** Merges the statistics of one table into another
+ *  @param *table Table to be merged into
+ *  @param *source Table to be merged
+ *  @param contiguous Whether or not the source follows the table in the same file, the gap
+ *         between them is then a period
+ */
+static bool AnalyzeTableMerge(analyze_table_t *table, const analyze_table_t *source, bool contiguous)
+{
+  const analyze_id_t *from = NULL;
+  analyze_id_t *entry = NULL;
+  uint32_t index = 0;
+  bool added = false;
+
+  for (index = 0; index < source->index.count; index++)
+  {
+    from = &source->entries[index];
+    entry = AnalyzeTableEntry(table, from->id, from->ide, &added);
+    if (entry == NULL)
+    {
+      return false;
+    }
+    if (added)
+    {
+      *entry = *from;
+      continue;
+    }
+    if (contiguous)
+    {
+      AnalyzeAddPeriod(entry, entry->lastTimestamp, from->firstTimestamp);
+      entry->changeMask |= AnalyzeChangedBytes(entry->lastData, entry->lastLen, from->firstData, from->firstLen);
+      entry->lastTimestamp = from->lastTimestamp;
+      entry->lastLen = from->lastLen;
+      memcpy(entry->lastData, from->lastData, sizeof(entry->lastData));
+    }
+    entry->count += from->count;
+    entry->files += from->files;
+    entry->minPeriod = (from->minPeriod < entry->minPeriod) ? from->minPeriod : entry->minPeriod;
+    entry->maxPeriod = (from->maxPeriod > entry->maxPeriod) ? from->maxPeriod : entry->maxPeriod;
+    entry->periodSum += from->periodSum;
+    entry->periods += from->periods;
+    entry->dlcMask |= from->dlcMask;
+    entry->changeMask |= from->changeMask;
+  }
+  return true;
+}
+
+/** Parses the lines of one chunk
+ */
+static void AnalyzeChunk(analyze_file_t *file, analyze_chunk_t *chunk)
+{
+  const char *position = file->map.data + chunk->begin;
+  const char *end = file->map.data + chunk->end;
+  const char *newline = NULL;
+  can_message_t message;
+  can_message_t *diag = NULL;
+  uint32_t diagCapacity = 0;
+  IsoTpDirection_e direction;
+
+  while ((position < end) && !chunk->outOfMemory)
+  {
+    newline = (const char *) memchr(position, '\n', end - position);
+    if (newline == NULL)
+    {
+      newline = end;
+    }
+    switch (CaptureScanLine(position, newline - position, &message))
+    {
+      case eCAPTURE_LINE_FRAME:
+      {
+        chunk->frames++;
+        chunk->checksum += AnalyzeHash(&message);
+        if (!AnalyzeTableAdd(&chunk->table, &message))
+        {
+          chunk->outOfMemory = true;
+          break;
+        }
+        if (!message.ide && (IsoTpFindPair(message.id, &direction) != ISOTP_NO_PAIR)) // the pairs are standard IDs
+        {
+          if (chunk->numDiag == chunk->diagCapacity)
+          {
+            diagCapacity = (chunk->diagCapacity == 0) ? 64 : (chunk->diagCapacity * 2);
+            diag = (can_message_t *) realloc(chunk->diag, diagCapacity * sizeof(can_message_t));
+            if (diag == NULL)
+            {
+              chunk->outOfMemory = true;
+              break;
+            }
+            chunk->diag = diag;
+            chunk->diagCapacity = diagCapacity;
+          }
+          chunk->diag[chunk->numDiag++] = message;
+        }
+        break;
+      }
+      case eCAPTURE_LINE_MALFORMED: { chunk->malformed++; break; }
+      default: { break; }
+    }
+    position = newline + 1;
+  }
+}
+
+/** Merges the chunks of a file in order and summarizes its diagnostic traffic
+ *  Runs on the thread that parsed the last chunk of the file
+ */
+static void AnalyzeFinishFile(analyze_file_t *file)
+{
+  static __thread isotp_reassembler_t s_IsoTp;
+  uds_decoded_t decoded;
+  isotp_pdu_t pdu;
+  isotp_pdu_t *last = NULL;
+  analyze_chunk_t *chunk = NULL;
+  uint32_t index = 0;
+  uint32_t frame = 0;
+
+  IsoTpInit(&s_IsoTp);
+  UDSSummaryReset(&file->summary);
+  for (index = 0; index < file->numChunks; index++)
+  {
+    chunk = &file->chunks[index];
+    if (chunk->outOfMemory || !AnalyzeTableMerge(&file->table, &chunk->table, true))
+    {
+      file->outOfMemory = true;
+    }
+    file->frames += chunk->frames;
+    file->malformed += chunk->malformed;
+    file->checksum += chunk->checksum;
+    for (frame = 0; frame < chunk->numDiag; frame++)
+    {
+      if (IsoTpProcessMessage(&s_IsoTp, &chunk->diag[frame]))
+      {
+        last = IsoTpLastPdu(&s_IsoTp);
+        if (UDSDecode(last->data, (last->length > ISOTP_MAX_PDU_SIZE) ? ISOTP_MAX_PDU_SIZE : last->length,
+                      (last->direction == eISOTP_DIR_RESPONSE), &decoded))
+        {
+          UDSSummaryUpdate(&file->summary, &decoded, last->timestamp);
+        }
+        file->pdus++;
+        IsoTpPopPdu(&s_IsoTp, &pdu);
+      }
+    }
+    AnalyzeTableFree(&chunk->table);
+    free(chunk->diag);
+  }
+  for (index = 0; index < file->table.index.count; index++)
+  {
+    file->table.entries[index].files = 1;
+  }
+  free(file->chunks);
+  file->chunks = NULL;
+  CaptureUnmapFile(&file->map);
+}
+
+/** Maps the files and cuts them into chunks, files are taken in turn by the threads
+ *  A file without chunks (empty) is finished here, no chunk thread would get to it
+ */
+static void *AnalyzeMapThread(void *argument)
+{
+  static size_t bounds[ANALYZE_MAX_THREADS][ANALYZE_MAX_CHUNKS + 1];
+  size_t *fileBounds = bounds[(uintptr_t) argument];
+  analyze_file_t *file = NULL;
+  uint32_t fileIndex = 0;
+  uint32_t index = 0;
+
+  while ((fileIndex = __sync_fetch_and_add(&s_NextWork, 1)) < s_NumFiles)
+  {
+    file = &s_Files[fileIndex];
+    file->readable = CaptureMapFile(&file->map, file->path);
+    if (!file->readable)
+    {
+      continue;
+    }
+    file->numChunks = CaptureSplitChunks(file->map.data, file->map.size, s_ChunkSize, fileBounds, ANALYZE_MAX_CHUNKS);
+    file->chunks = (analyze_chunk_t *) calloc((file->numChunks > 0) ? file->numChunks : 1, sizeof(analyze_chunk_t));
+    if (file->chunks == NULL)
+    {
+      file->numChunks = 0;
+      file->outOfMemory = true;
+    }
+    for (index = 0; index < file->numChunks; index++)
+    {
+      file->chunks[index].begin = fileBounds[index];
+      file->chunks[index].end = fileBounds[index + 1];
+      AnalyzeTableInit(&file->chunks[index].table);
+    }
+    file->chunksLeft = file->numChunks;
+    if (file->numChunks == 0)
+    {
+      AnalyzeFinishFile(file);
+    }
+  }
+  return NULL;
+}
+
+/** Parses chunks, taken in turn by the threads, the thread finishing the last chunk of a file
+ *  merges the file
+ */
+static void *AnalyzeChunkThread(void *argument)
+{
+  analyze_work_t *work = NULL;
+  analyze_file_t *file = NULL;
+  uint32_t workIndex = 0;
+  (void) argument;
+
+  while ((workIndex = __sync_fetch_and_add(&s_NextWork, 1)) < s_NumWork)
+  {
+    work = &s_Work[workIndex];
+    file = &s_Files[work->fileIndex];
+    AnalyzeChunk(file, &file->chunks[work->chunkIndex]);
+    if (__sync_sub_and_fetch(&file->chunksLeft, 1) == 0)
+    {
+      AnalyzeFinishFile(file);
+    }
+  }
+  return NULL;
+}
+
+/** Runs a pass on a number of threads, the calling thread is one of them
+ */
+static void AnalyzeRun(void *(*pass)(void *), uint32_t numThreads)
+{
+  static pthread_t threads[ANALYZE_MAX_THREADS];
+  uint32_t index = 0;
+  uint32_t started = 0;
+
+  s_NextWork = 0;
+  for (index = 1; index < numThreads; index++)
+  {
+    if (pthread_create(&threads[started], NULL, pass, (void *)(uintptr_t) index) == 0)
+    {
+      started++;
+    }
+  }
+  pass((void *) 0);
+  for (index = 0; index < started; index++)
+  {
+    pthread_join(threads[index], NULL);
+  }
+}
+
+static bool AnalyzeAddFile(const char *path)
+{
+  analyze_file_t *files = NULL;
+  analyze_file_t *file = NULL;
+  const char *name = strrchr(path, '/');
+  unsigned int session = 0;
+  int length = 0;
+
+  if (s_NumFiles == s_FilesCapacity)
+  {
+    s_FilesCapacity = (s_FilesCapacity == 0) ? 1024 : (s_FilesCapacity * 2);
+    files = (analyze_file_t *) realloc(s_Files, s_FilesCapacity * sizeof(analyze_file_t));
+    if (files == NULL)
+    {
+      return false;
+    }
+    s_Files = files;
+  }
+  file = &s_Files[s_NumFiles++];
+  memset(file, 0, sizeof(analyze_file_t));
+  file->path = strdup(path);
+  name = (name == NULL) ? path : (name + 1);
+  file->dirLength = (uint32_t)(name - path);
+  file->session = ANALYZE_NO_SESSION;
+  AnalyzeTableInit(&file->table);
+  if ((sscanf(name, "Before_UDS_Attack_%u.txt%n", &session, &length) == 1) && (name[length] == '\0') && (length > 0))
+  {
+    file->session = session;
+  }
+  else if ((sscanf(name, "After_UDS_Attack_%u.txt%n", &session, &length) == 1) && (name[length] == '\0') && (length > 0))
+  {
+    file->session = session;
+    file->after = true;
+  }
+  return true;
+}
+
+static int AnalyzeAddEntry(const char *path, const struct stat *info, int flag, struct FTW *ftw)
+{
+  size_t length = strlen(path);
+  (void) info;
+  (void) ftw;
+  if ((flag == FTW_F) && (length > 4) && (strcmp(&path[length - 4], ".txt") == 0))
+  {
+    return AnalyzeAddFile(path) ? 0 : 1;
+  }
+  return 0;
+}
+
+static bool AnalyzeAddCapture(const char *path)
+{
+  struct stat info;
+
+  if (stat(path, &info) != 0)
+  {
+    return false;
+  }
+  if (!S_ISDIR(info.st_mode))
+  {
+    return AnalyzeAddFile(path);
+  }
+  return nftw(path, AnalyzeAddEntry, 16, FTW_PHYS) == 0;
+}
+
+/** Orders files by directory, session number, Before ahead of After, then path
+ */
+static int AnalyzeCompareFiles(const void *a, const void *b)
+{
+  const analyze_file_t *first = (const analyze_file_t *) a;
+  const analyze_file_t *second = (const analyze_file_t *) b;
+  int order = 0;
+
+  if ((first->session != ANALYZE_NO_SESSION) && (second->session != ANALYZE_NO_SESSION))
+  {
+    order = strncmp(first->path, second->path, (first->dirLength < second->dirLength) ? first->dirLength : second->dirLength);
+    if ((order == 0) && (first->dirLength != second->dirLength))
+    {
+      order = (first->dirLength < second->dirLength) ? -1 : 1;
+    }
+    if (order != 0)
+    {
+      return order;
+    }
+    if (first->session != second->session)
+    {
+      return (first->session < second->session) ? -1 : 1;
+    }
+    if (first->after != second->after)
+    {
+      return first->after ? 1 : -1;
+    }
+  }
+  return strcmp(first->path, second->path);
+}
+
+/** Standard IDs first, then extended IDs, each in ID order
+ */
+static int AnalyzeCompareIds(const void *a, const void *b)
+{
+  const analyze_id_t *first = (const analyze_id_t *) a;
+  const analyze_id_t *second = (const analyze_id_t *) b;
+  if (first->ide != second->ide)
+  {
+    return (first->ide < second->ide) ? -1 : 1;
+  }
+  return (first->id < second->id) ? -1 : (first->id > second->id);
+}
+
+/** Reads every file again with CaptureLoadFile and compares frames, malformed lines and hashes
+ *  @return Number of files that do not match
+ */
+static uint32_t AnalyzeVerify(void)
+{
+  capture_t capture;
+  uint64_t checksum = 0;
+  uint32_t mismatches = 0;
+  uint32_t fileIndex = 0;
+  uint32_t index = 0;
+
+  for (fileIndex = 0; fileIndex < s_NumFiles; fileIndex++)
+  {
+    CaptureInit(&capture);
+    CaptureLoadFile(&capture, s_Files[fileIndex].path);
+    for (checksum = 0, index = 0; index < capture.count; index++)
+    {
+      checksum += AnalyzeHash(&capture.messages[index]);
+    }
+    if ((capture.count != s_Files[fileIndex].frames) || (capture.malformedLines != s_Files[fileIndex].malformed) ||
+        (checksum != s_Files[fileIndex].checksum))
+    {
+      fprintf(stderr, "%s: %lu frames %lu malformed, CaptureLoadFile %lu frames %lu malformed\n", s_Files[fileIndex].path,
+              (unsigned long) s_Files[fileIndex].frames, (unsigned long) s_Files[fileIndex].malformed,
+              (unsigned long) capture.count, (unsigned long) capture.malformedLines);
+      mismatches++;
+    }
+    CaptureFree(&capture);
+  }
+  return mismatches;
+}
+
+static void AnalyzePrintIds(analyze_table_t *table)
+{
+  analyze_id_t *entry = NULL;
+  uint32_t index = 0;
+  uint8_t dlc = 0;
+  char dlcs[3 * 9 + 1];
+  char changed[8 + 1];
+  char id[CAPTURE_ID_TEXT_SIZE];
+
+  qsort(table->entries, table->index.count, sizeof(analyze_id_t), AnalyzeCompareIds);
+  printf("\n%-10s %10s %7s %10s %10s %10s  %-18s %s\n", "ID", "Frames", "Files", "Min (ms)", "Mean (ms)", "Max (ms)", "DLC", "Bytes changing");
+  for (index = 0; index < table->index.count; index++)
+  {
+    entry = &table->entries[index];
+    dlcs[0] = '\0';
+    for (dlc = 0; dlc <= 8; dlc++)
+    {
+      if (entry->dlcMask & (1 << dlc))
+      {
+        snprintf(&dlcs[strlen(dlcs)], sizeof(dlcs) - strlen(dlcs), "%s%u", (dlcs[0] == '\0') ? "" : ",", dlc);
+      }
+    }
+    for (dlc = 0; dlc < 8; dlc++)
+    {
+      changed[dlc] = (entry->changeMask & (1 << dlc)) ? ('0' + dlc) : '.';
+    }
+    changed[8] = '\0';
+    if (entry->periods > 0)
+    {
+      printf("%-10s %10lu %7lu %10lu %10.1f %10lu  %-18s %s\n", CaptureFormatId(id, entry->id, entry->ide),
+             (unsigned long) entry->count, (unsigned long) entry->files, (unsigned long) entry->minPeriod, (double) entry->periodSum / entry->periods,
+             (unsigned long) entry->maxPeriod, dlcs, changed);
+    }
+    else
+    {
+      printf("%-10s %10lu %7lu %10s %10s %10s  %-18s %s\n", CaptureFormatId(id, entry->id, entry->ide),
+             (unsigned long) entry->count, (unsigned long) entry->files, "-", "-", "-", dlcs, changed);
+    }
+  }
+}
+
+/** Prints one line per attack session, its Before and After files combined
+ */
+static void AnalyzePrintSessions(void)
+{
+  uds_summary_t summary;
+  analyze_file_t *first = NULL;
+  analyze_file_t *file = NULL;
+  uint32_t beforeFrames = 0;
+  uint32_t afterFrames = 0;
+  uint32_t pdus = 0;
+  uint32_t index = 0;
+  uint8_t serviceClass = 0;
+
+  printf("\n%-40s %8s %8s %6s %6s %6s %6s %5s  %s\n", "Session", "Before", "After", "PDUs", "Req", "Pos", "Neg", "Keys", "Attack");
+  index = 0;
+  while (index < s_NumFiles)
+  {
+    first = &s_Files[index];
+    if (first->session == ANALYZE_NO_SESSION)
+    {
+      index++;
+      continue;
+    }
+    UDSSummaryReset(&summary);
+    beforeFrames = 0;
+    afterFrames = 0;
+    pdus = 0;
+    for (; index < s_NumFiles; index++)
+    {
+      file = &s_Files[index];
+      if ((file->session != first->session) || (file->dirLength != first->dirLength) ||
+          (strncmp(file->path, first->path, first->dirLength) != 0))
+      {
+        break;
+      }
+      if (file->after)
+      {
+        afterFrames += file->frames;
+      }
+      else
+      {
+        beforeFrames += file->frames;
+      }
+      pdus += file->pdus;
+      for (serviceClass = 0; serviceClass < eUDS_NUM_CLASSES; serviceClass++)
+      {
+        summary.classCount[serviceClass] += file->summary.classCount[serviceClass];
+      }
+      summary.requests += file->summary.requests;
+      summary.positiveResponses += file->summary.positiveResponses;
+      summary.negativeResponses += file->summary.negativeResponses;
+      summary.rejectedKeys += file->summary.rejectedKeys;
+    }
+    printf("%.*s%-*lu %8lu %8lu %6lu %6lu %6lu %6lu %5lu  %s\n", (int) first->dirLength, first->path,
+           (int)((first->dirLength < 40) ? (40 - first->dirLength) : 1), (unsigned long) first->session,
+           (unsigned long) beforeFrames, (unsigned long) afterFrames, (unsigned long) pdus,
+           (unsigned long) summary.requests, (unsigned long) summary.positiveResponses,
+           (unsigned long) summary.negativeResponses, (unsigned long) summary.rejectedKeys,
+           UDSGetAttackName(UDSClassifyAttack(&summary)));
+  }
+}
+
+static void AnalyzeUsage(const char *program)
+{
+  fprintf(stderr, "usage: %s [-j threads] [-c chunk_kb] [-I] [-S] [-V] capture...\n", program);
+}
+
+int main(int argc, char **argv)
+{
+  analyze_table_t total;
+  uint32_t numThreads = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t fileIndex = 0;
+  uint32_t index = 0;
+  uint32_t unreadable = 0;
+  uint32_t incomplete = 0;
+  uint32_t mismatches = 0;
+  uint64_t frames = 0;
+  uint64_t malformed = 0;
+  uint64_t bytes = 0;
+  uint64_t checksum = 0;
+  uint64_t startNs = 0;
+  double seconds = 0;
+  bool printIds = true;
+  bool printSessions = true;
+  bool verify = false;
+  int option = 0;
+
+  while ((option = getopt(argc, argv, "j:c:ISV")) != -1)
+  {
+    switch (option)
+    {
+      case 'j': { numThreads = strtoul(optarg, NULL, 0); break; }
+      case 'c': { s_ChunkSize = strtoul(optarg, NULL, 0) * 1024; break; }
+      case 'I': { printIds = false; break; }
+      case 'S': { printSessions = false; break; }
+      case 'V': { verify = true; break; }
+      default:
+      {
+        AnalyzeUsage(argv[0]);
+        return 1;
+      }
+    }
+  }
+  if ((optind == argc) || (numThreads == 0) || (s_ChunkSize == 0))
+  {
+    AnalyzeUsage(argv[0]);
+    return 1;
+  }
+  numThreads = (numThreads > ANALYZE_MAX_THREADS) ? ANALYZE_MAX_THREADS : numThreads;
+  for (; optind < argc; optind++)
+  {
+    if (!AnalyzeAddCapture(argv[optind]))
+    {
+      fprintf(stderr, "cannot read capture %s\n", argv[optind]);
+      return 1;
+    }
+  }
+  if (s_NumFiles == 0)
+  {
+    fprintf(stderr, "no capture files\n");
+    return 1;
+  }
+  qsort(s_Files, s_NumFiles, sizeof(analyze_file_t), AnalyzeCompareFiles);
+  UDSDecoderInit(); // the decoder builds its lookup table on first use, not from several threads
+
+  startNs = AnalyzeNanos();
+  AnalyzeRun(AnalyzeMapThread, numThreads);
+  for (fileIndex = 0; fileIndex < s_NumFiles; fileIndex++)
+  {
+    s_NumWork += s_Files[fileIndex].numChunks;
+  }
+  s_Work = (analyze_work_t *) malloc(((s_NumWork > 0) ? s_NumWork : 1) * sizeof(analyze_work_t));
+  for (s_NumWork = 0, fileIndex = 0; fileIndex < s_NumFiles; fileIndex++)
+  {
+    for (index = 0; index < s_Files[fileIndex].numChunks; index++)
+    {
+      s_Work[s_NumWork].fileIndex = fileIndex;
+      s_Work[s_NumWork].chunkIndex = index;
+      s_NumWork++;
+    }
+  }
+  AnalyzeRun(AnalyzeChunkThread, numThreads);
+
+  AnalyzeTableInit(&total);
+  for (fileIndex = 0; fileIndex < s_NumFiles; fileIndex++)
+  {
+    if (!s_Files[fileIndex].readable)
+    {
+      fprintf(stderr, "cannot read capture %s\n", s_Files[fileIndex].path);
+      unreadable++;
+      continue;
+    }
+    if (s_Files[fileIndex].outOfMemory || !AnalyzeTableMerge(&total, &s_Files[fileIndex].table, false))
+    {
+      fprintf(stderr, "out of memory analyzing capture %s\n", s_Files[fileIndex].path);
+      incomplete++;
+    }
+    frames += s_Files[fileIndex].frames;
+    malformed += s_Files[fileIndex].malformed;
+    checksum += s_Files[fileIndex].checksum;
+  }
+  seconds = (AnalyzeNanos() - startNs) / 1e9;
+  for (fileIndex = 0; fileIndex < s_NumFiles; fileIndex++)
+  {
+    struct stat info;
+    if (stat(s_Files[fileIndex].path, &info) == 0)
+    {
+      bytes += (uint64_t) info.st_size;
+    }
+  }
+
+  printf("Files:                  %lu (%.1f MB)\n", (unsigned long) s_NumFiles, bytes / 1e6);
+  printf("Frames:                 %llu\n", (unsigned long long) frames);
+  printf("Malformed lines:        %llu\n", (unsigned long long) malformed);
+  printf("IDs:                    %lu\n", (unsigned long) total.index.count);
+  printf("Threads:                %lu, %lu chunks\n", (unsigned long) numThreads, (unsigned long) s_NumWork);
+  printf("Time:                   %.3f ms, %.0f MB/s, %.0f frames/s\n", seconds * 1e3,
+         (seconds > 0) ? (bytes / 1e6 / seconds) : 0.0, (seconds > 0) ? (frames / seconds) : 0.0);
+  printf("Checksum:               %016llX\n", (unsigned long long) checksum);
+  if (printIds)
+  {
+    AnalyzePrintIds(&total);
+  }
+  if (printSessions)
+  {
+    AnalyzePrintSessions();
+  }
+  if (verify)
+  {
+    mismatches = AnalyzeVerify();
+    printf("\nVerified against CaptureLoadFile: %lu of %lu files differ\n", (unsigned long) mismatches, (unsigned long) s_NumFiles);
+  }
+  return ((unreadable > 0) || (incomplete > 0) || (mismatches > 0)) ? 1 : 0;
+}
@@ -0,0 +1,685 @@
+/*
+  * @file Arduino.cpp
+  *
+  * Host stand-in for the Teensy 3.x Arduino core: clock, interrupt controller, Print, Serial
+  * and IntervalTimer
+*/
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <time.h>
+#include <unistd.h>
+
+/* DEFINES */
+#define HOST_MAX_TIMERS               4         // Number of periodic interrupt timers (PIT) on the Teensy 3.x
+#define HOST_SERIAL_RX_SIZE           1024      // Size of the injected serial input buffer
+#define HOST_SERIAL_TX_BUFFER         4096      // Bytes the USB serial port buffers when its throughput is limited
+
+/* GLOBAL VARIABLES */
+uint32_t g_HostPortRegisters[8];
+usb_serial_class Serial;
+
+static bool s_VirtualTime = false;
+static uint64_t s_VirtualUs = 0;
+static struct timespec s_StartTime;
+static bool s_StartTimeSet = false;
+
+static void (*s_IrqHandlers[HOST_NUM_IRQ])(void);
+static bool s_IrqEnabled[HOST_NUM_IRQ];
+static bool s_IrqPending[HOST_NUM_IRQ];
+static bool s_GlobalIrqEnabled = true;
+static bool s_InInterrupt = false;
+
+static IntervalTimer *s_Timers[HOST_MAX_TIMERS];
+
+static FILE *s_SerialOut = stdout;
+static char s_SerialRx[HOST_SERIAL_RX_SIZE];
+static size_t s_SerialRxHead = 0;
+static size_t s_SerialRxCount = 0;
+static uint32_t s_SerialTxRate = 0;       // Throughput (bytes per second) of the USB serial port, 0 for unlimited
+static uint64_t s_SerialTxStartUs = 0;    // Time the throughput limit was set
+static uint64_t s_SerialTxSent = 0;       // Bytes written since the throughput limit was set
+
+static uint32_t s_RandomState = 0x2545F491;
+
+static bool s_PinLow[HOST_NUM_PINS];                    // Level of each pin, they float high
+static uint8_t s_PinModes[HOST_NUM_PINS];               // Edge of the attached interrupt, FALLING, RISING or CHANGE
+static bool s_PinPending[HOST_NUM_PINS];                // Edge seen, the interrupt has not run yet
+static HostPinHandler s_PinOutputs[HOST_NUM_PINS];      // Devices attached to the pins the sketch drives
+static void (*s_PinInterrupts[HOST_NUM_PINS])(void);    // Interrupts attached to the pins devices drive
+
+/* ========================================================================= */
+/* Clock                                                                     */
+/* ========================================================================= */
+
+/** Selects the clock behind millis() and micros()
+ *  @param useVirtual Virtual time only moves when advanced, real time follows the monotonic clock
+ */
+void HostClockUseVirtualTime(bool useVirtual)
+{
+  s_VirtualTime = useVirtual;
+}
+
+/** Sets the virtual clock
+ *  @param us New time (us)
+ */
+void HostClockSetMicros(uint64_t us)
+{
+  s_VirtualUs = us;
+}
+
+/** Advances the virtual clock, running every timer that expires on the way
+ *  @param us Time (us) to advance by
+ */
+void HostClockAdvanceMicros(uint64_t us)
+{
+  uint64_t target = s_VirtualUs + us;
+  uint64_t deadline = 0;
+
+  if (s_InInterrupt || !s_GlobalIrqEnabled) // timers cannot run, they catch up once unmasked
+  {
+    s_VirtualUs = target;
+    return;
+  }
+  while (IntervalTimer::HostNextDeadline(&deadline) && (deadline <= target))
+  {
+    if (deadline > s_VirtualUs)
+    {
+      s_VirtualUs = deadline;
+    }
+    IntervalTimer::HostRunExpired();
+  }
+  s_VirtualUs = target;
+}
+
+/** Gets the current time
+ *  @return Microseconds since the program started (real time) or the virtual time
+ */
+uint64_t HostClockMicros(void)
+{
+  struct timespec current;
+
+  if (s_VirtualTime)
+  {
+    return s_VirtualUs;
+  }
+  if (!s_StartTimeSet)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &s_StartTime);
+    s_StartTimeSet = true;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &current);
+  return ((uint64_t)(current.tv_sec - s_StartTime.tv_sec) * 1000000ULL) + ((current.tv_nsec - s_StartTime.tv_nsec) / 1000);
+}
+
+uint32_t millis(void)
+{
+  return (uint32_t)(HostClockMicros() / 1000);
+}
+
+uint32_t micros(void)
+{
+  return (uint32_t) HostClockMicros();
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  uint64_t end = 0;
+  uint64_t current = 0;
+
+  if (s_VirtualTime)
+  {
+    HostClockAdvanceMicros(us);
+    return;
+  }
+  end = HostClockMicros() + us;
+  while ((current = HostClockMicros()) < end)
+  {
+    IntervalTimer::HostRunExpired();
+    usleep(((end - current) > 1000) ? 1000 : (useconds_t)(end - current));
+  }
+  IntervalTimer::HostRunExpired();
+}
+
+void delay(uint32_t ms)
+{
+  delayMicroseconds(ms * 1000);
+}
+
+void yield(void)
+{
+  IntervalTimer::HostRunExpired();
+}
+
+/* ========================================================================= */
+/* Interrupt controller                                                      */
+/* ========================================================================= */
+
+void HostNvicEnable(uint32_t irq, bool enable)
+{
+  if (irq >= HOST_NUM_IRQ)
+  {
+    return;
+  }
+  s_IrqEnabled[irq] = enable;
+  if (enable)
+  {
+    HostIrqDispatch();
+  }
+}
+
+bool HostNvicIsEnabled(uint32_t irq)
+{
+  return (irq < HOST_NUM_IRQ) && s_IrqEnabled[irq];
+}
+
+void HostGlobalIrqEnable(bool enable)
+{
+  s_GlobalIrqEnabled = enable;
+  if (enable)
+  {
+    HostIrqDispatch();
+  }
+}
+
+/** Checks whether or not a handler could run right now
+ *  @param irq Interrupt number
+ *  @return Whether or not the interrupt is unmasked and no other handler is running
+ */
+bool HostIrqAllowed(uint32_t irq)
+{
+  return HostNvicIsEnabled(irq) && s_GlobalIrqEnabled && !s_InInterrupt;
+}
+
+/** Attaches the handler of an interrupt (the vector table entry on the device)
+ *  @param irq Interrupt number
+ *  @param handler Handler to be run when the interrupt is raised
+ */
+void HostIrqAttach(uint32_t irq, void (*handler)(void))
+{
+  if (irq < HOST_NUM_IRQ)
+  {
+    s_IrqHandlers[irq] = handler;
+  }
+}
+
+/** Marks an interrupt pending and runs it if it is not masked
+ *  @param irq Interrupt number
+ */
+void HostIrqRaise(uint32_t irq)
+{
+  if (irq < HOST_NUM_IRQ)
+  {
+    s_IrqPending[irq] = true;
+    HostIrqDispatch();
+  }
+}
+
+/** Runs every pending, unmasked interrupt, lowest number first
+ *  Handlers never nest, an interrupt raised by a handler runs after it returns
+ */
+void HostIrqDispatch(void)
+{
+  uint32_t irq = 0;
+  bool ran = true;
+
+  if (s_InInterrupt)
+  {
+    return;
+  }
+  while (ran && s_GlobalIrqEnabled)
+  {
+    ran = false;
+    for (irq = 0; irq < HOST_NUM_IRQ; irq++)
+    {
+      if (s_IrqPending[irq] && s_IrqEnabled[irq] && (s_IrqHandlers[irq] != NULL))
+      {
+        s_IrqPending[irq] = false;
+        s_InInterrupt = true;
+        s_IrqHandlers[irq]();
+        s_InInterrupt = false;
+        ran = true;
+        break;
+      }
+    }
+  }
+}
+
+bool HostInInterrupt(void)
+{
+  return s_InInterrupt;
+}
+
+/* ========================================================================= */
+/* IntervalTimer                                                             */
+/* ========================================================================= */
+
+bool IntervalTimer::begin(void (*function)(void), uint32_t periodUs)
+{
+  if (periodUs == 0)
+  {
+    return false;
+  }
+  return HostArm(function, periodUs, HostClockMicros() + periodUs);
+}
+
+/** Arms the timer to fire once, at an absolute time on the host clock
+ *  Host only: lets a replay put each frame on the bus at its own time, the callback re-arms it
+ *  @param *function Callback function
+ *  @param deadlineUs Time (us) the callback runs, right away when already passed
+ *  @return Whether or not a timer was available
+ */
+bool IntervalTimer::HostBeginAt(void (*function)(void), uint64_t deadlineUs)
+{
+  return HostArm(function, 0, deadlineUs);
+}
+
+bool IntervalTimer::HostArm(void (*function)(void), uint32_t periodUs, uint64_t deadlineUs)
+{
+  uint8_t index = 0;
+  uint8_t freeIndex = HOST_MAX_TIMERS;
+
+  for (index = 0; index < HOST_MAX_TIMERS; index++)
+  {
+    if (s_Timers[index] == this)
+    {
+      freeIndex = index;
+      break;
+    }
+    if ((s_Timers[index] == NULL) && (freeIndex == HOST_MAX_TIMERS))
+    {
+      freeIndex = index;
+    }
+  }
+  if (freeIndex == HOST_MAX_TIMERS)
+  {
+    return false;
+  }
+  m_function = function;
+  m_periodUs = periodUs;
+  m_nextUs = deadlineUs;
+  s_Timers[freeIndex] = this;
+  return true;
+}
+
+void IntervalTimer::end(void)
+{
+  uint8_t index = 0;
+  for (index = 0; index < HOST_MAX_TIMERS; index++)
+  {
+    if (s_Timers[index] == this)
+    {
+      s_Timers[index] = NULL;
+    }
+  }
+  m_function = NULL;
+}
+
+/** Runs the callback of every timer that has expired, as an interrupt
+ *  Timers that expire while interrupts are masked catch up once they are unmasked
+ */
+void IntervalTimer::HostRunExpired(void)
+{
+  uint64_t current = HostClockMicros();
+  uint8_t index = 0;
+  IntervalTimer *timer = NULL;
+  bool ran = true;
+
+  if (s_InInterrupt || !s_GlobalIrqEnabled)
+  {
+    return;
+  }
+  while (ran) // a one-shot timer re-armed by its callback may land in an earlier slot
+  {
+    ran = false;
+    for (index = 0; index < HOST_MAX_TIMERS; index++)
+    {
+      timer = s_Timers[index];
+      while ((timer != NULL) && (timer == s_Timers[index]) && (timer->m_nextUs <= current))
+      {
+        if (timer->m_periodUs == 0)
+        {
+          s_Timers[index] = NULL;
+        }
+        else
+        {
+          timer->m_nextUs += timer->m_periodUs;
+        }
+        s_InInterrupt = true;
+        timer->m_function();
+        s_InInterrupt = false;
+        HostIrqDispatch();
+        ran = true;
+      }
+    }
+  }
+}
+
+/** Gets the earliest deadline of all running timers
+ *  @param *deadlineUs Deadline (us) to be set
+ *  @return Whether or not a timer is running
+ */
+bool IntervalTimer::HostNextDeadline(uint64_t *deadlineUs)
+{
+  uint8_t index = 0;
+  bool found = false;
+
+  for (index = 0; index < HOST_MAX_TIMERS; index++)
+  {
+    if ((s_Timers[index] != NULL) && (!found || (s_Timers[index]->m_nextUs < *deadlineUs)))
+    {
+      *deadlineUs = s_Timers[index]->m_nextUs;
+      found = true;
+    }
+  }
+  return found;
+}
+
+/* ========================================================================= */
+/* Print and Serial                                                          */
+/* ========================================================================= */
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t count = 0;
+  while (count < size)
+  {
+    if (write(buffer[count]) == 0)
+    {
+      break;
+    }
+    count++;
+  }
+  return count;
+}
+
+size_t Print::printNumber(unsigned long long n, int base)
+{
+  char buffer[66];
+  char *digit = &buffer[sizeof(buffer) - 1];
+
+  if (base < 2)
+  {
+    base = 10;
+  }
+  *digit = '\0';
+  do
+  {
+    uint8_t value = n % base;
+    *--digit = (value < 10) ? ('0' + value) : ('A' + value - 10);
+    n /= base;
+  } while (n > 0);
+  return write(digit);
+}
+
+size_t Print::printSigned(long long n, int base)
+{
+  size_t count = 0;
+  if ((n < 0) && (base == DEC))
+  {
+    count = print('-');
+    return count + printNumber((unsigned long long)(-n), base);
+  }
+  return printNumber((unsigned long long) n, base);
+}
+
+size_t Print::print(double n, int digits)
+{
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+  return write(buffer);
+}
+
+size_t usb_serial_class::write(uint8_t c)
+{
+  s_SerialTxSent++;
+  if (s_SerialOut != NULL)
+  {
+    fputc(c, s_SerialOut);
+  }
+  return 1;
+}
+
+size_t usb_serial_class::write(const uint8_t *buffer, size_t size)
+{
+  s_SerialTxSent += size;
+  if (s_SerialOut != NULL)
+  {
+    fwrite(buffer, 1, size, s_SerialOut);
+  }
+  return size;
+}
+
+int usb_serial_class::available(void)
+{
+  return (int) s_SerialRxCount;
+}
+
+int usb_serial_class::read(void)
+{
+  int c = peek();
+  if (c >= 0)
+  {
+    s_SerialRxHead = (s_SerialRxHead + 1) % HOST_SERIAL_RX_SIZE;
+    s_SerialRxCount--;
+  }
+  return c;
+}
+
+int usb_serial_class::peek(void)
+{
+  if (s_SerialRxCount == 0)
+  {
+    return -1;
+  }
+  return (uint8_t) s_SerialRx[s_SerialRxHead];
+}
+
+int usb_serial_class::availableForWrite(void)
+{
+  uint64_t allowed = 0;
+  if (s_SerialTxRate == 0)
+  {
+    return 64;
+  }
+  // the link drains the buffer at the set rate, an idle link does not save up more than the buffer
+  allowed = ((HostClockMicros() - s_SerialTxStartUs) * s_SerialTxRate) / 1000000;
+  if (allowed > (s_SerialTxSent + HOST_SERIAL_TX_BUFFER))
+  {
+    s_SerialTxSent = allowed - HOST_SERIAL_TX_BUFFER;
+  }
+  return (allowed > s_SerialTxSent) ? (int)(allowed - s_SerialTxSent) : 0;
+}
+
+void usb_serial_class::flush(void)
+{
+  if (s_SerialOut != NULL)
+  {
+    fflush(s_SerialOut);
+  }
+}
+
+/** Queues bytes to be read from Serial
+ *  @param *data Bytes to be queued
+ *  @param len Number of bytes
+ */
+void HostSerialInject(const char *data, size_t len)
+{
+  size_t index = 0;
+  for (index = 0; (index < len) && (s_SerialRxCount < HOST_SERIAL_RX_SIZE); index++)
+  {
+    s_SerialRx[(s_SerialRxHead + s_SerialRxCount) % HOST_SERIAL_RX_SIZE] = data[index];
+    s_SerialRxCount++;
+  }
+}
+
+/** Redirects Serial output
+ *  @param *stream Stream to be written to, NULL discards the output
+ */
+void HostSerialSetOutput(FILE *stream)
+{
+  s_SerialOut = stream;
+}
+
+/** Limits the throughput of Serial output, availableForWrite reports what the link has drained
+ *  @param bytesPerSecond Throughput, 0 for unlimited
+ */
+void HostSerialSetTxRate(uint32_t bytesPerSecond)
+{
+  s_SerialTxRate = bytesPerSecond;
+  s_SerialTxStartUs = HostClockMicros();
+  s_SerialTxSent = 0;
+}
+
+/* ========================================================================= */
+/* Miscellaneous                                                             */
+/* ========================================================================= */
+
+long random(long howBig)
+{
+  if (howBig <= 0)
+  {
+    return 0;
+  }
+  // xorshift32, deterministic so host runs can be repeated
+  s_RandomState ^= s_RandomState << 13;
+  s_RandomState ^= s_RandomState >> 17;
+  s_RandomState ^= s_RandomState << 5;
+  return (long)(s_RandomState % (uint32_t) howBig);
+}
+
+long random(long howSmall, long howBig)
+{
+  if (howSmall >= howBig)
+  {
+    return howSmall;
+  }
+  return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed)
+{
+  if (seed != 0)
+  {
+    s_RandomState = (uint32_t) seed;
+  }
+}
+
+/* ========================================================================= */
+/* Pins                                                                      */
+/* ========================================================================= */
+
+/** Runs the interrupt of every pin that saw its edge, the port interrupt on the device
+ */
+static void host_port_isr(void)
+{
+  uint8_t pin = 0;
+
+  for (pin = 0; pin < HOST_NUM_PINS; pin++)
+  {
+    if (s_PinPending[pin])
+    {
+      s_PinPending[pin] = false;
+      if (s_PinInterrupts[pin] != NULL)
+      {
+        s_PinInterrupts[pin]();
+      }
+    }
+  }
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  (void) pin;
+  (void) mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (pin >= HOST_NUM_PINS)
+  {
+    return;
+  }
+  s_PinLow[pin] = (value == LOW);
+  if (s_PinOutputs[pin] != NULL)
+  {
+    s_PinOutputs[pin](pin, value);
+  }
+}
+
+uint8_t digitalRead(uint8_t pin)
+{
+  return ((pin < HOST_NUM_PINS) && s_PinLow[pin]) ? LOW : HIGH;
+}
+
+void attachInterrupt(uint8_t pin, void (*function)(void), int mode)
+{
+  if (pin >= HOST_NUM_PINS)
+  {
+    return;
+  }
+  s_PinInterrupts[pin] = function;
+  s_PinModes[pin] = (uint8_t) mode;
+  s_PinPending[pin] = false;
+  HostIrqAttach(IRQ_PORT_PINS, host_port_isr);
+  HostNvicEnable(IRQ_PORT_PINS, true);
+}
+
+void detachInterrupt(uint8_t pin)
+{
+  if (pin < HOST_NUM_PINS)
+  {
+    s_PinInterrupts[pin] = NULL;
+    s_PinPending[pin] = false;
+  }
+}
+
+uint8_t digitalPinToInterrupt(uint8_t pin)
+{
+  return pin;
+}
+
+/** Attaches a simulated device to an output pin of the sketch
+ *  @param pin Pin, a chip select for example
+ *  @param handler Called with every value written to the pin, NULL to detach
+ */
+void HostPinAttachOutput(uint8_t pin, HostPinHandler handler)
+{
+  if (pin < HOST_NUM_PINS)
+  {
+    s_PinOutputs[pin] = handler;
+  }
+}
+
+/** Drives an input pin from a simulated device, an edge matching the attached interrupt raises it
+ *  @param pin Pin, an interrupt line for example
+ *  @param value HIGH or LOW
+ */
+void HostPinDrive(uint8_t pin, uint8_t value)
+{
+  bool low = (value == LOW);
+  bool edge = false;
+
+  if ((pin >= HOST_NUM_PINS) || (s_PinLow[pin] == low))
+  {
+    return;
+  }
+  s_PinLow[pin] = low;
+  edge = (s_PinModes[pin] == CHANGE) || ((s_PinModes[pin] == FALLING) && low) || ((s_PinModes[pin] == RISING) && !low);
+  if (edge && (s_PinInterrupts[pin] != NULL))
+  {
+    s_PinPending[pin] = true;
+    HostIrqRaise(IRQ_PORT_PINS);
+  }
+}
+
+/** Detaches every device and interrupt from the pins and lets them float high
+ */
+void HostPinReset(void)
+{
+  memset(s_PinLow, 0, sizeof(s_PinLow));
+  memset(s_PinModes, 0, sizeof(s_PinModes));
+  memset(s_PinPending, 0, sizeof(s_PinPending));
+  memset(s_PinOutputs, 0, sizeof(s_PinOutputs));
+  memset(s_PinInterrupts, 0, sizeof(s_PinInterrupts));
+}
@@ -0,0 +1,504 @@
+/*
+  * @file BenchMain.cpp
+  *
+  * Benchmarks every stage a frame goes through in the logger: FIFO decode, transpose, ring
+  * push, trigger check, formatting and file write. Frames come from the vehicle traffic model
+  * at 100% load. Reports ns/frame and the longest single call of each stage, writes the
+  * results as JSON and fails when a stage is slower than a stored baseline by more than the
+  * threshold.
+  *
+  * uds_logger_bench [-n frames] [-r repeats] [-o results.json] [-b baseline.json]
+  *                  [-t threshold_percent] [-d card_dir]
+  *
+  * ns/frame is the best of the repeats, timed over batches of calls with one pair of clock reads
+  * per batch; the longest call is the worst of every repeat and is reported only, it depends on
+  * the host scheduler. The baseline gate has a small absolute allowance so stages of a few ns do
+  * not fail on noise. The RX FIFO holds only a few frames, so fifo_decode loads each frame into
+  * it and reads it back in the same call, which keeps its batches as long as the others.
+  *
+  * formatting and file_write write to files that drop their bytes (SdFatHostSetDiscardWrites):
+  * the host disk is not the SD card, and timing it would measure whatever else the machine is
+  * writing. Both stages then time the logger's own work, which the reference below scales.
+  *
+  * A baseline comes from another machine, so every repeat of a stage is preceded by a run of a
+  * reference workload (a hash over the same frames) that does not change with the logger. The
+  * baseline ns/frame of the stage is scaled by how much faster or slower the reference ran next
+  * to it than in the baseline before the threshold is applied, which also takes out most of the
+  * load other processes put on the machine while the stage ran.
+*/
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <FlexcanHostBus.h>
+#include "UDSDataLogger.h"
+#include <getopt.h>
+#include <time.h>
+
+/* DEFINES */
+#define BENCH_DEFAULT_FRAMES          50000     // Number of frames run through each stage
+#define BENCH_DEFAULT_REPEATS         5         // Number of times each stage is run
+#define BENCH_DEFAULT_THRESHOLD       20        // Slowdown (%) over the scaled baseline that fails the run
+#define BENCH_NOISE_ALLOWANCE         5.0       // Slowdown (ns/frame) over the baseline always allowed
+#define BENCH_BATCH_FRAMES            256       // Number of frames timed together
+#define BENCH_RING_CAPACITY           (SESSION_BLOCK_SIZE * 8)  // Capacity of the benchmarked ring, as in the sketch
+#define BENCH_SEED                    0x5EED    // Seed of the traffic model, every run sees the same frames
+#define BENCH_LINE_SIZE               256       // Longest line read from a baseline
+#define BENCH_REFERENCE_ROUNDS        4         // Times the reference workload hashes every frame
+
+/* STRUCTS */
+typedef struct {
+  const char *name;                     // Stage name in the report and the JSON results
+  uint16_t framesPerCall;               // Number of frames one timed call covers
+  uint16_t callsPerBatch;               // Number of calls timed together
+  void (*prepare)(uint32_t frame, uint32_t numFrames); // Untimed set up before a batch, may be NULL
+  void (*run)(uint32_t frame);          // Timed call
+} bench_stage_t;
+
+typedef struct {
+  double nsPerFrame;                    // Best time per frame over the repeats
+  double maxNs;                         // Longest single call over the repeats
+  double baselineNsPerFrame;            // Time per frame in the baseline, 0 when not in it
+  double referenceNsPerFrame;           // Best time per frame of the reference, timed between the repeats of the stage
+  double scaledNsPerFrame;              // Baseline time per frame scaled by the reference
+  bool regressed;                       // Whether or not the stage is slower than the baseline allows
+} bench_result_t;
+
+/* FUNCTION PROTOTYPES */
+static void BenchRunFifo(uint32_t frame);
+static void BenchRunTranspose(uint32_t frame);
+static void BenchRunRingPush(uint32_t frame);
+static void BenchRunTriggerCheck(uint32_t frame);
+static void BenchRunFormatting(uint32_t frame);
+static void BenchPrepareFileWrite(uint32_t frame, uint32_t numFrames);
+static void BenchRunFileWrite(uint32_t frame);
+static void BenchRunReference(uint32_t frame);
+
+/* CONSTANTS */
+const bench_stage_t BenchStages[] =
+{
+  {"fifo_decode",   1, BENCH_BATCH_FRAMES, NULL, BenchRunFifo},
+  {"transpose",     1, BENCH_BATCH_FRAMES, NULL, BenchRunTranspose},
+  {"ring_push",     1, BENCH_BATCH_FRAMES, NULL, BenchRunRingPush},
+  {"trigger_check", 1, BENCH_BATCH_FRAMES, NULL, BenchRunTriggerCheck},
+  {"formatting",    1, BENCH_BATCH_FRAMES, NULL, BenchRunFormatting},
+  {"file_write",    SESSION_BLOCK_SIZE, 1, BenchPrepareFileWrite, BenchRunFileWrite}
+};
+
+const uint8_t BENCH_NUM_STAGES = sizeof(BenchStages) / sizeof(BenchStages[0]);
+
+/* Work that does not change with the logger, timed the same way to tell how fast this machine is */
+const bench_stage_t BenchReference = {"reference", 1, BENCH_BATCH_FRAMES, NULL, BenchRunReference};
+
+/* GLOBAL VARIABLES */
+static FLEXCAN_frame_t *s_Frames = NULL;    // Frames from the traffic model
+static can_message_t *s_Messages = NULL;    // The same frames transposed
+static FLEXCAN_frame_t s_Decoded;
+static can_message_t s_Transposed;
+static circular_buffer_t s_Ring;
+static circular_buffer_t s_FileRing;
+static uint32_t s_FileRingFirstFrame = 0;
+static uint32_t s_FileRingFirstSeq = 0;
+static SdFat s_SD;
+static SdFile s_FormatFile;
+static SdFile s_WriteFile;
+static volatile uint32_t s_Sink = 0;        // Keeps the trigger check from being optimized away
+static double s_TimerOverheadNs = 0;
+
+static uint64_t BenchNanos(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t) now.tv_sec * 1000000000ULL) + (uint64_t) now.tv_nsec;
+}
+
+/* ========================================================================= */
+/* Stages                                                                    */
+/* ========================================================================= */
+
+/** Loads a frame into the RX FIFO and reads it, the message interrupt is masked */
+static void BenchRunFifo(uint32_t frame)
+{
+  FlexcanHostReceive(&s_Frames[frame]);
+  FLEXCAN_fifo_read(&s_Decoded);
+}
+
+static void BenchRunTranspose(uint32_t frame)
+{
+  TransposeCanMessage(&s_Transposed, &s_Frames[frame]);
+}
+
+static void BenchRunRingPush(uint32_t frame)
+{
+  CircularBufferPush(&s_Ring, &s_Messages[frame]);
+}
+
+static void BenchRunTriggerCheck(uint32_t frame)
+{
+  s_Sink += SessionMatchRule(&s_Messages[frame]);
+}
+
+static void BenchRunFormatting(uint32_t frame)
+{
+  FileWriteMessage(&s_Messages[frame], &s_FormatFile);
+}
+
+/** Fills the ring with the frames of a batch, as the FIFO interrupt does before a block is written */
+static void BenchPrepareFileWrite(uint32_t frame, uint32_t numFrames)
+{
+  uint32_t index = 0;
+  s_FileRingFirstFrame = frame;
+  s_FileRingFirstSeq = s_FileRing.pushCount;
+  for (index = 0; index < numFrames; index++)
+  {
+    CircularBufferPush(&s_FileRing, &s_Messages[frame + index]);
+  }
+}
+
+/** Writes one block of the ring to the file and syncs it, as a session does */
+static void BenchRunFileWrite(uint32_t frame)
+{
+  uint32_t start = s_FileRingFirstSeq + (frame - s_FileRingFirstFrame);
+  CircularBufferDumpRangeToFile(&s_FileRing, start, start + SESSION_BLOCK_SIZE, &s_WriteFile);
+  s_WriteFile.sync();
+}
+
+/** FNV-1a hash over the bytes of a frame, a fixed amount of integer and memory work */
+static void BenchRunReference(uint32_t frame)
+{
+  const uint8_t *bytes = (const uint8_t *) &s_Messages[frame];
+  uint32_t hash = 2166136261UL;
+  uint8_t round = 0;
+  size_t index = 0;
+
+  for (round = 0; round < BENCH_REFERENCE_ROUNDS; round++)
+  {
+    for (index = 0; index < sizeof(can_message_t); index++)
+    {
+      hash = (hash ^ bytes[index]) * 16777619UL;
+    }
+  }
+  s_Sink += hash;
+}
+
+/* ========================================================================= */
+/* Benchmark                                                                 */
+/* ========================================================================= */
+
+/** Generates the benchmark frames from the traffic model at 100% load
+ *  @param numFrames Number of frames
+ */
+static void BenchGenerateFrames(uint32_t numFrames)
+{
+  traffic_model_t model;
+  uint64_t endNs = 0;
+  uint32_t index = 0;
+
+  s_Frames = (FLEXCAN_frame_t *) malloc(numFrames * sizeof(FLEXCAN_frame_t));
+  s_Messages = (can_message_t *) malloc(numFrames * sizeof(can_message_t));
+  TrafficInit(&model, &TrafficVehicleProfile, TRAFFIC_BITRATE_500K, true, BENCH_SEED);
+  for (index = 0; index < numFrames; index++)
+  {
+    TrafficNextFrame(&model, &s_Frames[index], &endNs);
+    TransposeCanMessage(&s_Messages[index], &s_Frames[index]);
+  }
+}
+
+/** Measures the cost of reading the clock, taken off every timed batch (or call) */
+static void BenchCalibrate(void)
+{
+  uint64_t start = 0;
+  uint32_t index = 0;
+  const uint32_t samples = 100000;
+
+  start = BenchNanos();
+  for (index = 0; index < samples; index++)
+  {
+    (void) BenchNanos();
+  }
+  s_TimerOverheadNs = (double)(BenchNanos() - start) / samples;
+}
+
+/** Runs a stage once over every frame
+ *  @param *stage Stage to be run
+ *  @param numFrames Number of frames
+ *  @param perCall Whether every call is timed on its own (longest call) or batches are timed (ns/frame)
+ *  @return ns/frame when batches are timed, the longest call otherwise
+ */
+static double BenchRunStage(const bench_stage_t *stage, uint32_t numFrames, bool perCall)
+{
+  uint32_t batchFrames = stage->framesPerCall * stage->callsPerBatch;
+  uint32_t frame = 0;
+  uint32_t framesTimed = 0;
+  uint16_t call = 0;
+  uint64_t start = 0;
+  double elapsed = 0;
+  double total = 0;
+  double longest = 0;
+
+  for (frame = 0; (frame + batchFrames) <= numFrames; frame += batchFrames)
+  {
+    if (stage->prepare != NULL)
+    {
+      stage->prepare(frame, batchFrames);
+    }
+    if (perCall)
+    {
+      for (call = 0; call < stage->callsPerBatch; call++)
+      {
+        start = BenchNanos();
+        stage->run(frame + (call * stage->framesPerCall));
+        elapsed = (double)(BenchNanos() - start) - s_TimerOverheadNs;
+        longest = (elapsed > longest) ? elapsed : longest;
+      }
+    }
+    else
+    {
+      start = BenchNanos();
+      for (call = 0; call < stage->callsPerBatch; call++)
+      {
+        stage->run(frame + (call * stage->framesPerCall));
+      }
+      elapsed = (double)(BenchNanos() - start) - s_TimerOverheadNs;
+      total += (elapsed > 0) ? elapsed : 0;
+      framesTimed += batchFrames;
+    }
+  }
+  if (perCall)
+  {
+    return longest;
+  }
+  return (framesTimed > 0) ? (total / framesTimed) : 0;
+}
+
+/** Sets up the state every stage works on: the controller, the rings and the files
+ *  @param *directory Directory the card stand-in is set up in, the files drop what is written to them
+ *  @return Whether or not the files could be opened
+ */
+static bool BenchSetUp(const char *directory)
+{
+  FLEXCAN_config_t canConfig;
+
+  HostClockUseVirtualTime(true);
+  FlexcanHostReset();
+  CanConfigInit(&canConfig);
+  FLEXCAN_init(canConfig);
+  NVIC_DISABLE_IRQ(IRQ_CAN_MESSAGE); // frames stay in the FIFO until the benchmark reads them
+
+  CircularBufferInit(&s_Ring, BENCH_RING_CAPACITY, sizeof(can_message_t));
+  CircularBufferInit(&s_FileRing, BENCH_RING_CAPACITY, sizeof(can_message_t));
+
+  SdFatHostSetRoot(directory);
+  SdFatHostSetDiscardWrites(true);
+  if (!s_SD.begin(SD_CHIP_SELECT, SPI_FULL_SPEED))
+  {
+    return false;
+  }
+  return s_FormatFile.open("bench_format.txt", O_CREAT | O_WRITE | O_TRUNC) &&
+         s_WriteFile.open("bench_write.txt", O_CREAT | O_WRITE | O_TRUNC);
+}
+
+static void BenchTearDown(void)
+{
+  s_FormatFile.close();
+  s_WriteFile.close();
+  SdFatHostSetDiscardWrites(false);
+  CircularBufferFree(&s_Ring);
+  CircularBufferFree(&s_FileRing);
+}
+
+/** Reads the ns/frame of every stage and of the reference from a baseline written by this program
+ *  @param *path Path of the baseline
+ *  @param *results Results to be given their baseline
+ *  @param *referenceNsPerFrame ns/frame of the reference in the baseline, 0 when not in it
+ *  @return Whether or not the baseline could be read
+ */
+static bool BenchReadBaseline(const char *path, bench_result_t *results, double *referenceNsPerFrame)
+{
+  char line[BENCH_LINE_SIZE];
+  char name[BENCH_LINE_SIZE];
+  double nsPerFrame = 0;
+  uint8_t index = 0;
+  FILE *file = fopen(path, "r");
+
+  if (file == NULL)
+  {
+    return false;
+  }
+  *referenceNsPerFrame = 0;
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    if (sscanf(line, " \"reference_ns_per_frame\": %lf", &nsPerFrame) == 1)
+    {
+      *referenceNsPerFrame = nsPerFrame;
+      continue;
+    }
+    if (sscanf(line, " \"%[^\"]\": {\"ns_per_frame\": %lf", name, &nsPerFrame) != 2)
+    {
+      continue;
+    }
+    for (index = 0; index < BENCH_NUM_STAGES; index++)
+    {
+      if (strcmp(name, BenchStages[index].name) == 0)
+      {
+        results[index].baselineNsPerFrame = nsPerFrame;
+      }
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+/** Writes the results as JSON, one stage per line
+ *  @param *path Path of the results
+ *  @param *results Results of every stage
+ *  @param referenceNsPerFrame ns/frame of the reference workload
+ *  @param numFrames Number of frames
+ *  @param repeats Number of repeats
+ *  @return Whether or not the results were written
+ */
+static bool BenchWriteResults(const char *path, const bench_result_t *results, double referenceNsPerFrame, uint32_t numFrames, uint32_t repeats)
+{
+  uint8_t index = 0;
+  FILE *file = fopen(path, "w");
+
+  if (file == NULL)
+  {
+    return false;
+  }
+  fprintf(file, "{\n  \"frames\": %lu,\n  \"repeats\": %lu,\n  \"reference_ns_per_frame\": %.2f,\n  \"stages\": {\n",
+          (unsigned long) numFrames, (unsigned long) repeats, referenceNsPerFrame);
+  for (index = 0; index < BENCH_NUM_STAGES; index++)
+  {
+    fprintf(file, "    \"%s\": {\"ns_per_frame\": %.2f, \"max_ns\": %.0f, \"frames_per_call\": %u}%s\n",
+            BenchStages[index].name, results[index].nsPerFrame, results[index].maxNs,
+            BenchStages[index].framesPerCall, (index + 1 < BENCH_NUM_STAGES) ? "," : "");
+  }
+  fprintf(file, "  }\n}\n");
+  return fclose(file) == 0;
+}
+
+static void BenchUsage(const char *program)
+{
+  fprintf(stderr, "usage: %s [-n frames] [-r repeats] [-o results.json] [-b baseline.json] [-t threshold_percent] [-d card_dir]\n", program);
+}
+
+int main(int argc, char **argv)
+{
+  bench_result_t results[sizeof(BenchStages) / sizeof(BenchStages[0])];
+  uint32_t numFrames = BENCH_DEFAULT_FRAMES;
+  uint32_t repeats = BENCH_DEFAULT_REPEATS;
+  uint32_t threshold = BENCH_DEFAULT_THRESHOLD;
+  uint32_t repeat = 0;
+  const char *resultsPath = NULL;
+  const char *baselinePath = NULL;
+  const char *directory = "bench_card";
+  bool regressed = false;
+  double value = 0;
+  double referenceNsPerFrame = 0;
+  double baselineReference = 0;
+  uint8_t index = 0;
+  int option = 0;
+
+  while ((option = getopt(argc, argv, "n:r:o:b:t:d:")) != -1)
+  {
+    switch (option)
+    {
+      case 'n': { numFrames = strtoul(optarg, NULL, 0); break; }
+      case 'r': { repeats = strtoul(optarg, NULL, 0); break; }
+      case 'o': { resultsPath = optarg; break; }
+      case 'b': { baselinePath = optarg; break; }
+      case 't': { threshold = strtoul(optarg, NULL, 0); break; }
+      case 'd': { directory = optarg; break; }
+      default:
+      {
+        BenchUsage(argv[0]);
+        return 1;
+      }
+    }
+  }
+  if ((numFrames < BENCH_RING_CAPACITY) || (repeats == 0))
+  {
+    BenchUsage(argv[0]);
+    return 1;
+  }
+
+  memset(results, 0, sizeof(results));
+  if ((baselinePath != NULL) && !BenchReadBaseline(baselinePath, results, &baselineReference))
+  {
+    fprintf(stderr, "cannot read baseline %s\n", baselinePath);
+    return 1;
+  }
+  if (!BenchSetUp(directory))
+  {
+    fprintf(stderr, "cannot open the benchmark files in %s\n", directory);
+    return 1;
+  }
+  BenchGenerateFrames(numFrames);
+  BenchCalibrate();
+
+  (void) BenchRunStage(&BenchReference, numFrames, false);
+  for (index = 0; index < BENCH_NUM_STAGES; index++)
+  {
+    (void) BenchRunStage(&BenchStages[index], numFrames, false); // warm up caches and clocks
+    for (repeat = 0; repeat < repeats; repeat++)
+    {
+      value = BenchRunStage(&BenchReference, numFrames, false);
+      if ((repeat == 0) || (value < results[index].referenceNsPerFrame))
+      {
+        results[index].referenceNsPerFrame = value;
+      }
+      value = BenchRunStage(&BenchStages[index], numFrames, false);
+      if ((repeat == 0) || (value < results[index].nsPerFrame))
+      {
+        results[index].nsPerFrame = value;
+      }
+      value = BenchRunStage(&BenchStages[index], numFrames, true);
+      results[index].maxNs = (value > results[index].maxNs) ? value : results[index].maxNs;
+    }
+    if ((index == 0) || (results[index].referenceNsPerFrame < referenceNsPerFrame))
+    {
+      referenceNsPerFrame = results[index].referenceNsPerFrame;
+    }
+    results[index].scaledNsPerFrame = results[index].baselineNsPerFrame;
+    if ((baselineReference > 0) && (results[index].referenceNsPerFrame > 0))
+    {
+      results[index].scaledNsPerFrame *= results[index].referenceNsPerFrame / baselineReference;
+    }
+    results[index].regressed = (results[index].baselineNsPerFrame > 0) &&
+                               (results[index].nsPerFrame > ((results[index].scaledNsPerFrame * (100 + threshold) / 100) + BENCH_NOISE_ALLOWANCE));
+    regressed = regressed || results[index].regressed;
+  }
+  BenchTearDown();
+
+  printf("%-16s %12s %12s %12s\n", "Stage", "ns/frame", "max ns/call", "baseline");
+  printf("%-16s %12.2f %12s ", BenchReference.name, referenceNsPerFrame, "-");
+  if (baselineReference > 0)
+  {
+    printf("%12.2f  (machine speed x%.2f)\n", baselineReference, baselineReference / referenceNsPerFrame);
+  }
+  else
+  {
+    printf("%12s\n", "-");
+  }
+  for (index = 0; index < BENCH_NUM_STAGES; index++)
+  {
+    printf("%-16s %12.2f %12.0f ", BenchStages[index].name, results[index].nsPerFrame, results[index].maxNs);
+    if (results[index].baselineNsPerFrame > 0)
+    {
+      printf("%12.2f%s\n", results[index].scaledNsPerFrame, results[index].regressed ? "  REGRESSED" : "");
+    }
+    else
+    {
+      printf("%12s\n", "-");
+    }
+  }
+  printf("Frames: %lu, repeats: %lu, clock overhead %.1f ns, file_write calls are %u-frame blocks, baselines scaled by the reference, %lu %% allowed\n",
+         (unsigned long) numFrames, (unsigned long) repeats, s_TimerOverheadNs, SESSION_BLOCK_SIZE, (unsigned long) threshold);
+
+  if ((resultsPath != NULL) && !BenchWriteResults(resultsPath, results, referenceNsPerFrame, numFrames, repeats))
+  {
+    fprintf(stderr, "cannot write results %s\n", resultsPath);
+    return 1;
+  }
+  return regressed ? 1 : 0;
+}
@@ -0,0 +1,256 @@
+/*
+  * @file CanAutobaudMain.cpp
+  *
+  * Checks the bit rate detection against buses at every bit rate of the table, and at random
+  * ones of them up to 1% off their nominal bit rate. Every frame at a wrong bit rate has to
+  * reject it, so the bit rate is found with at most one frame per bit rate tried before it
+  * plus the confirming frames; the controller has to end up at the right timing, with its other
+  * CTRL1 bits kept, without having sent anything or moved its error counters on the way. A
+  * silent bus and a bus at a bit rate not in the table have to time out. The detection time is
+  * printed next to the time the old scan (16 bit rates, 10 x 10 ms of polling each) takes.
+  *
+  * can_autobaud_host [-s seed] [-n runs] [-v]
+*/
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <FlexcanHostBus.h>
+#include <CanAutobaud.h>
+#include <HostTest.h>
+#include <TrafficModel.h>
+
+/* DEFINES */
+#define AUTOBAUD_TEST_RUNS            200       // Default number of runs at random bit rates
+#define AUTOBAUD_TEST_POLL_US         100       // Time (us) between two main loop services
+#define AUTOBAUD_TEST_MAX_FRAMES      500       // Frames offered before a run is given up
+#define AUTOBAUD_TEST_OFFSET          10        // Most a random bus is off its nominal bit rate (per mille)
+#define AUTOBAUD_TEST_TIMEOUT         5000      // Time (ms) the detection runs for on a bus with traffic
+#define AUTOBAUD_TEST_SILENT_TIMEOUT  2000      // Time (ms) the detection runs for on a silent bus
+#define AUTOBAUD_TEST_ODD_RATE        300000    // Bit rate (bit/s) of a bus not in the table
+#define AUTOBAUD_TEST_ODD_TIMEOUT     100       // Time (ms) the detection runs for on it, a few hundred frames
+#define AUTOBAUD_TEST_MB              (FLEXCAN_TX_BASE_MB - 1)  // Mailbox loaded while listening, it must wait
+#define AUTOBAUD_TEST_SCAN_DWELL      100       // Time (ms) the old scan polls each bit rate
+
+/* STRUCTS */
+typedef struct {
+  uint32_t frames;                      // Frames offered on the bus until the end of the detection
+  uint32_t transmitted;                 // Frames transmitted while listening
+  uint32_t ecr;                         // Error counters at the end of the detection
+  uint32_t ctrl;                        // CTRL1 at the end of the detection
+} autobaud_test_bus_t;
+
+/* GLOBAL VARIABLES */
+static uint64_t s_DetectTotal = 0;      // Sum of the detection times (us)
+static uint64_t s_ScanTotal = 0;        // Sum of the times (us) the old scan would take
+static uint32_t s_FramesTotal = 0;      // Sum of the frames until detection
+static uint32_t s_Runs = 0;
+
+/** Picks a frame as found on a vehicle bus, mostly standard IDs
+ *  @param *frame Frame to be set
+ */
+static void AutobaudTestFrame(FLEXCAN_frame_t *frame)
+{
+  uint8_t i = 0;
+
+  memset(frame, 0, sizeof(FLEXCAN_frame_t));
+  frame->ide = (random(4) == 0) ? 1 : 0;
+  frame->id = frame->ide ? (uint32_t) random(0x20000000) : (uint32_t) random(0x800);
+  frame->dlc = random(9);
+  for (i = 0; i < frame->dlc; i++)
+  {
+    frame->data[i] = random(256);
+  }
+}
+
+/** Runs a detection on a bus with frames of random length and spacing, or on a silent one
+ *  @param *ab Autobaud struct
+ *  @param busRate Bit rate (bit/s) of the other nodes
+ *  @param traffic Whether or not there are frames on the bus
+ *  @param timeout Time (ms) the detection is given
+ *  @param *bus What the bus saw, to be set
+ */
+static void AutobaudTestRun(can_autobaud_t *ab, uint32_t busRate, bool traffic, uint32_t timeout, autobaud_test_bus_t *bus)
+{
+  FLEXCAN_config_t canConfig;
+  FLEXCAN_frame_t frame;
+  flexcan_host_stats_t stats;
+  uint64_t nextFrameAt = 0;
+  uint64_t frameUs = 0;
+
+  FlexcanHostReset();
+  canConfig.presdiv = 1;                // 500 kbit/s from the 16 MHz oscillator, what the sketch starts at
+  canConfig.propseg = 2;
+  canConfig.rjw = 1;
+  canConfig.pseg_1 = 7;
+  canConfig.pseg_2 = 3;
+  FLEXCAN_init(canConfig);
+  FlexcanHostSetBusBitRate(busRate);
+
+  CanAutobaudStart(ab, CanBitRateTable, CAN_NUM_BIT_RATES, timeout);
+  AutobaudTestFrame(&frame);
+  FLEXCAN_mb_write(AUTOBAUD_TEST_MB, FLEXCAN_MB_CODE_TX_ONCE, frame);
+
+  nextFrameAt = HostClockMicros() + random(AUTOBAUD_TEST_POLL_US * 10);
+  memset(bus, 0, sizeof(autobaud_test_bus_t));
+  while (CanAutobaudService(ab) == eAUTOBAUD_LISTENING)
+  {
+    if (traffic && (HostClockMicros() >= nextFrameAt))
+    {
+      // the frame is received at its end, the next one follows after a random idle time
+      AutobaudTestFrame(&frame);
+      frameUs = TrafficFrameTimeNs(&frame, busRate) / 1000;
+      HostClockAdvanceMicros(frameUs);
+      FlexcanHostReceive(&frame);
+      bus->frames++;
+      nextFrameAt = HostClockMicros() + random(frameUs + 1);
+      if (bus->frames > AUTOBAUD_TEST_MAX_FRAMES)
+      {
+        break;
+      }
+    }
+    else
+    {
+      HostClockAdvanceMicros(AUTOBAUD_TEST_POLL_US);
+    }
+  }
+
+  FlexcanHostGetStats(&stats);
+  bus->transmitted = stats.framesTransmitted;
+  bus->ecr = FLEXCAN0_ECR;
+  bus->ctrl = FLEXCAN0_CTRL1;
+}
+
+/** Gets the time the old scan spends before it gets to a bit rate: 100 ms at each slower bit rate, from 5 kbit/s up
+ *  @param bitRate Bit rate (bit/s) of the bus
+ *  @return Time (us), not counting the wait for the first frame
+ */
+static uint64_t AutobaudTestScanTime(uint32_t bitRate)
+{
+  uint64_t time = 0;
+  uint8_t i = 0;
+
+  for (i = 0; i < CAN_NUM_BIT_RATES; i++)
+  {
+    if (CanBitRateTable[i].bitRate < bitRate)
+    {
+      time += AUTOBAUD_TEST_SCAN_DWELL * 1000ULL;
+    }
+  }
+  return time;
+}
+
+/** Checks a detection on a bus at one of the bit rates of the table
+ *  @param index Bit rate of the table the bus is at
+ *  @param offset Per mille the bus is off the nominal bit rate
+ */
+static void AutobaudTestDetect(uint8_t index, int32_t offset)
+{
+  const can_bit_rate_t *expected = &CanBitRateTable[index];
+  const can_bit_rate_t *found = NULL;
+  uint32_t busRate = expected->bitRate + (int32_t)(((int64_t) expected->bitRate * offset) / 1000);
+  can_autobaud_t ab;
+  autobaud_test_bus_t bus;
+  flexcan_host_stats_t stats;
+  uint32_t timing = 0;
+  uint32_t errors = g_HostTestErrors;
+
+  AutobaudTestRun(&ab, busRate, true, AUTOBAUD_TEST_TIMEOUT, &bus);
+  found = CanAutobaudResult(&ab);
+  timing = FLEXCAN_CTRL_PRESDIV(expected->config.presdiv) | FLEXCAN_CTRL_RJW(expected->config.rjw) |
+           FLEXCAN_CTRL_PSEG1(expected->config.pseg_1) | FLEXCAN_CTRL_PSEG2(expected->config.pseg_2) |
+           FLEXCAN_CTRL_PROPSEG(expected->config.propseg);
+
+  if ((found == NULL) || (found->bitRate != expected->bitRate))
+  {
+    HostTestFail("bus at %lu bit/s: found %s", (unsigned long) busRate, (found != NULL) ? found->name : "nothing");
+  }
+  else
+  {
+    HOST_TEST_CHECK((bus.frames <= (uint32_t)(index + CAN_AUTOBAUD_CONFIRM_FRAMES)) && (ab.rejected == index) && (ab.silent == 0),
+                    "bus at %lu bit/s: %lu frames, %lu rejected, %lu silent, at most %u frames expected", (unsigned long) busRate,
+                    (unsigned long) bus.frames, (unsigned long) ab.rejected, (unsigned long) ab.silent, index + CAN_AUTOBAUD_CONFIRM_FRAMES);
+  }
+  HOST_TEST_CHECK((bus.ctrl & 0xFFFF0007) == timing, "bus at %lu bit/s: CTRL1 timing %08lX, %08lX expected", (unsigned long) busRate,
+                  (unsigned long)(bus.ctrl & 0xFFFF0007), (unsigned long) timing);
+  HOST_TEST_CHECK((bus.ctrl & FLEXCAN_CTRL_LOM) && (bus.ctrl & FLEXCAN_CTRL_ERR_MSK) && (bus.ctrl & FLEXCAN_CTRL_BOFF_REC) && (bus.ctrl & FLEXCAN_CTRL_SMP),
+                  "bus at %lu bit/s: CTRL1 %08lX lost bits set by FLEXCAN_init or listen only", (unsigned long) busRate, (unsigned long) bus.ctrl);
+  HOST_TEST_CHECK((bus.transmitted == 0) && (bus.ecr == 0), "bus at %lu bit/s: %lu frames sent, ECR %04lX while listening",
+                  (unsigned long) busRate, (unsigned long) bus.transmitted, (unsigned long) bus.ecr);
+
+  // joining the bus sends the mailbox loaded while listening
+  FLEXCAN_set_listen_only(0);
+  FlexcanHostGetStats(&stats);
+  HOST_TEST_CHECK(stats.framesTransmitted == 1, "bus at %lu bit/s: %lu frames sent after leaving listen only mode", (unsigned long) busRate,
+                  (unsigned long) stats.framesTransmitted);
+
+  s_Runs++;
+  s_FramesTotal += bus.frames;
+  s_DetectTotal += ab.detectTime;
+  s_ScanTotal += AutobaudTestScanTime(expected->bitRate);
+  if (g_HostTestVerbose || (g_HostTestErrors != errors))
+  {
+    printf("%-13s bus %7lu bit/s: %2lu frames, %2lu bit rates tried, %8lu us (old scan %4lu ms)\n", expected->name,
+           (unsigned long) busRate, (unsigned long) bus.frames, (unsigned long) ab.ratesTried, (unsigned long) ab.detectTime,
+           (unsigned long)(AutobaudTestScanTime(expected->bitRate) / 1000));
+  }
+}
+
+/** Checks that the detection gives up on a silent bus, and on a bus at a bit rate not in the table
+ */
+static void AutobaudTestTimeouts(void)
+{
+  can_autobaud_t ab;
+  autobaud_test_bus_t bus;
+
+  AutobaudTestRun(&ab, CanBitRateTable[0].bitRate, false, AUTOBAUD_TEST_SILENT_TIMEOUT, &bus);
+  HOST_TEST_CHECK((ab.state == eAUTOBAUD_FAILED) && (ab.detectTime >= AUTOBAUD_TEST_SILENT_TIMEOUT * 1000UL) &&
+                  (ab.silent >= (AUTOBAUD_TEST_SILENT_TIMEOUT / CAN_AUTOBAUD_DWELL) - 1) && (ab.rejected == 0),
+                  "silent bus: state %u after %lu us, %lu silent, %lu rejected", ab.state, (unsigned long) ab.detectTime,
+                  (unsigned long) ab.silent, (unsigned long) ab.rejected);
+  if (g_HostTestVerbose)
+  {
+    CanAutobaudPrint(&ab, &Serial);
+  }
+
+  AutobaudTestRun(&ab, AUTOBAUD_TEST_ODD_RATE, true, AUTOBAUD_TEST_ODD_TIMEOUT, &bus);
+  HOST_TEST_CHECK((ab.state == eAUTOBAUD_FAILED) && (ab.frames == 0) && (ab.rejected != 0) && (bus.ecr == 0) && (bus.transmitted == 0),
+                  "bus at %lu bit/s: state %u, %lu frames, %lu rejected, ECR %04lX, %lu sent", (unsigned long) AUTOBAUD_TEST_ODD_RATE,
+                  ab.state, (unsigned long) ab.frames, (unsigned long) ab.rejected, (unsigned long) bus.ecr, (unsigned long) bus.transmitted);
+  if (g_HostTestVerbose)
+  {
+    CanAutobaudPrint(&ab, &Serial);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t runs = AUTOBAUD_TEST_RUNS;
+  uint32_t seed = 1;
+  uint32_t i = 0;
+  const host_test_option_t options[] =
+  {
+    {'s', eHOST_TEST_UINT, &seed},
+    {'n', eHOST_TEST_UINT, &runs}
+  };
+
+  if (!HostTestOptions(argc, argv, "[-s seed] [-n runs] [-v]", options, sizeof(options) / sizeof(options[0])))
+  {
+    return 1;
+  }
+
+  randomSeed(seed);
+  HostClockUseVirtualTime(true);
+  for (i = 0; i < CAN_NUM_BIT_RATES; i++)
+  {
+    AutobaudTestDetect(i, 0);
+  }
+  for (i = 0; i < runs; i++)
+  {
+    AutobaudTestDetect(random(CAN_NUM_BIT_RATES), random(-AUTOBAUD_TEST_OFFSET, AUTOBAUD_TEST_OFFSET + 1));
+  }
+  AutobaudTestTimeouts();
+
+  printf("%lu detections: %lu frames and %lu us each on average (old scan %lu us)\n", (unsigned long) s_Runs,
+         (unsigned long)(s_FramesTotal / s_Runs), (unsigned long)(s_DetectTotal / s_Runs), (unsigned long)(s_ScanTotal / s_Runs));
+  return HostTestSummary();
+}
@@ -0,0 +1,614 @@
+/*
+  * @file CanIdMain.cpp
+  *
+  * Checks that standard (11 bit) and extended (29 bit) IDs keep both their value and their IDE
+  * bit end to end: sent through a TX mailbox and through the TX queue, received through the RX
+  * FIFO into can_message_t, written by FileWriteMessage and read back by CaptureParseLine and
+  * CaptureScanLine, queued as telemetry records, matched against the session trigger rules and
+  * accepted or rejected by the RX FIFO filters (formats A, B and C). Extended IDs that fit in 11 bits are the frames that used to come back
+  * as standard ones, so every run has plenty of them.
+  *
+  * can_id_host [-s seed] [-n frames] [-d sd_root] [-v]
+*/
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <FlexcanHostBus.h>
+#include <CaptureFile.h>
+#include <CaptureScan.h>
+#include <SDCard.h>
+#include <HostTest.h>
+#include <SessionManager.h>
+#include <Telemetry.h>
+
+/* DEFINES */
+#define ID_TEST_MAX_FRAMES            4096      // Most frames run through the checks
+#define ID_TEST_FRAMES                1000      // Default number of random frames
+#define ID_TEST_MB                    (FLEXCAN_TX_BASE_MB - 1)  // Spare mailbox between the RX callback and TX queue mailboxes
+#define ID_TEST_FILE                  "IDTEST.TXT"  // Capture written to the card
+#define ID_TEST_FRAME_US              250       // Time (us) the bus moves on by per frame
+
+/* STRUCTS */
+typedef struct {
+  const char *line;                     // Capture line
+  int kind;                             // CaptureLine_e expected
+  uint32_t id;                          // ID and IDE bit expected of a frame line
+  uint8_t ide;
+} id_test_line_t;
+
+/* CONSTANTS */
+// Frames every run starts with: the ends of both ID ranges and extended IDs that look standard
+const FLEXCAN_frame_t IdTestEdges[] = {
+  // srr ide rtr dlc id           data
+  {0, 0, 0, 8, 0x000,       {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07}},
+  {0, 0, 0, 1, 0x7FF,       {0xFF}},
+  {1, 1, 0, 2, 0x00000000,  {0x10, 0x20}},
+  {1, 1, 0, 3, 0x000007FF,  {0x7F, 0xF0, 0x0F}},
+  {1, 1, 0, 0, 0x00000123,  {0}},
+  {1, 1, 0, 8, 0x1FFFFFFF,  {0xFF, 0xFE, 0xFD, 0xFC, 0xFB, 0xFA, 0xF9, 0xF8}},
+  {1, 1, 0, 8, 0x18DAF110,  {0x02, 0x10, 0x03, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA}},
+  {1, 1, 0, 8, 0x0CFEF100,  {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88}},
+  {0, 0, 1, 0, 0x7E8,       {0}},
+  {1, 1, 1, 0, 0x000007E8,  {0}}
+};
+const uint16_t ID_TEST_NUM_EDGES = sizeof(IdTestEdges) / sizeof(IdTestEdges[0]);
+
+// Lines of older captures (extended IDs unpadded) and lines that must not parse
+const id_test_line_t IdTestLines[] = {
+  {"100\t\t1A2B\t01 02 ",         eCAPTURE_LINE_FRAME,     0x1A2B,     1},
+  {"100\t\t18DAF110\t02 10 03 ",  eCAPTURE_LINE_FRAME,     0x18DAF110, 1},
+  {"100\t\t7FF\t",                eCAPTURE_LINE_FRAME,     0x7FF,      0},
+  {"100\t\t0000007FF\t",          eCAPTURE_LINE_MALFORMED, 0,          0},
+  {"100\t\t000007FF\t",           eCAPTURE_LINE_FRAME,     0x7FF,      1},
+  {"100\t\t00000000\t",           eCAPTURE_LINE_FRAME,     0x0,        1},
+  {"100\t\t20000000\t01 ",        eCAPTURE_LINE_MALFORMED, 0,          0}
+};
+const uint8_t ID_TEST_NUM_LINES = sizeof(IdTestLines) / sizeof(IdTestLines[0]);
+
+/* GLOBAL VARIABLES */
+static FLEXCAN_frame_t s_Frames[ID_TEST_MAX_FRAMES];     // Frames put through the checks
+static uint16_t s_NumFrames = 0;
+static FLEXCAN_frame_t s_Sent[ID_TEST_MAX_FRAMES];       // Frames that went out on the bus
+static uint16_t s_NumSent = 0;
+static FLEXCAN_frame_t s_Received[ID_TEST_MAX_FRAMES];   // Frames read from the RX FIFO
+static can_message_t s_Messages[ID_TEST_MAX_FRAMES];     // The same, as the logger stores them
+static uint16_t s_NumReceived = 0;
+static telemetry_t s_Telemetry;
+
+/** TX handler of the simulated bus: keeps every frame sent
+ */
+static void id_test_tx_handler(const FLEXCAN_frame_t *frame)
+{
+  if (s_NumSent < ID_TEST_MAX_FRAMES)
+  {
+    memcpy(&s_Sent[s_NumSent++], frame, sizeof(FLEXCAN_frame_t));
+  }
+}
+
+/** RX FIFO interrupt: keeps every frame and the message the logger makes of it
+ *  @param mb Unused
+ */
+static void id_test_fifo_callback(uint8_t mb)
+{
+  FLEXCAN_frame_t frame;
+  while (FLEXCAN_fifo_avalible())
+  {
+    FLEXCAN_fifo_read(&frame);
+    if (s_NumReceived < ID_TEST_MAX_FRAMES)
+    {
+      memcpy(&s_Received[s_NumReceived], &frame, sizeof(FLEXCAN_frame_t));
+      TransposeCanMessage(&s_Messages[s_NumReceived], &frame);
+      s_NumReceived++;
+    }
+  }
+}
+
+/** Prints a frame
+ *  @param *label What the frame is
+ *  @param *frame Frame
+ */
+static void IdTestPrintFrame(const char *label, const FLEXCAN_frame_t *frame)
+{
+  uint8_t i = 0;
+  printf("  %s: %s %0*lX%s [%u]", label, frame->ide ? "ext" : "std", frame->ide ? 8 : 3, (unsigned long) frame->id,
+         frame->rtr ? " rtr" : "", frame->dlc);
+  for (i = 0; (i < frame->dlc) && (i < 8) && !frame->rtr; i++)
+  {
+    printf(" %02X", frame->data[i]);
+  }
+  printf("\n");
+}
+
+/** Checks two frames for the same ID, IDE bit, RTR bit, length and data
+ *  @return Whether or not the frames are the same
+ */
+static bool IdTestSameFrame(const FLEXCAN_frame_t *expected, const FLEXCAN_frame_t *actual)
+{
+  if ((expected->id != actual->id) || (expected->ide != actual->ide) || (expected->rtr != actual->rtr) || (expected->dlc != actual->dlc))
+  {
+    return false;
+  }
+  return expected->rtr || (memcmp(expected->data, actual->data, expected->dlc) == 0);
+}
+
+/** Checks a message against the frame it was made of
+ *  @return Whether or not the message has the ID, IDE bit, length and data of the frame
+ */
+static bool IdTestSameMessage(const FLEXCAN_frame_t *expected, const can_message_t *actual)
+{
+  return (expected->id == actual->id) && (expected->ide == actual->ide) && (expected->dlc == actual->len) &&
+         (expected->rtr || (memcmp(expected->data, actual->data, expected->dlc) == 0));
+}
+
+/** Builds the frames: the edge cases, then random standard and extended frames
+ *  @param count Number of random frames
+ */
+static void IdTestBuildFrames(uint16_t count)
+{
+  FLEXCAN_frame_t *frame = NULL;
+  uint16_t i = 0;
+  uint8_t b = 0;
+
+  memcpy(s_Frames, IdTestEdges, sizeof(IdTestEdges));
+  s_NumFrames = ID_TEST_NUM_EDGES;
+  for (i = 0; (i < count) && (s_NumFrames < ID_TEST_MAX_FRAMES); i++)
+  {
+    frame = &s_Frames[s_NumFrames++];
+    memset(frame, 0, sizeof(FLEXCAN_frame_t));
+    frame->ide = random(2);
+    frame->srr = frame->ide;
+    if (!frame->ide)
+    {
+      frame->id = random(CAN_MAX_STD_ID + 1);
+    }
+    else if (random(4) == 0)
+    {
+      frame->id = random(CAN_MAX_STD_ID + 1); // extended, but fits in 11 bits
+    }
+    else
+    {
+      frame->id = (((uint32_t) random(0x10000) << 13) | random(0x2000)) & FLEXCAN_MB_ID_EXT_MASK;
+    }
+    frame->rtr = (random(16) == 0) ? 1 : 0;
+    frame->dlc = random(9);
+    for (b = 0; (b < frame->dlc) && !frame->rtr; b++)
+    {
+      frame->data[b] = random(256);
+    }
+  }
+}
+
+/** Sends every frame, through the spare mailbox (FLEXCAN_mb_write) and the TX queue in turn
+ *  Every frame has to go out as it was written
+ */
+static void IdTestTransmit(void)
+{
+  uint16_t i = 0;
+  uint32_t errors = 0;
+
+  s_NumSent = 0;
+  for (i = 0; i < s_NumFrames; i++)
+  {
+    if (i & 1)
+    {
+      FLEXCAN_txq_send(&s_Frames[i], i);
+    }
+    else
+    {
+      FLEXCAN_mb_write(ID_TEST_MB, FLEXCAN_MB_CODE_TX_ONCE, s_Frames[i]);
+    }
+    HostClockAdvanceMicros(ID_TEST_FRAME_US);
+    if ((s_NumSent != (i + 1)) || !IdTestSameFrame(&s_Frames[i], &s_Sent[i]))
+    {
+      if (errors++ < 5)
+      {
+        printf("TX %s frame %u:\n", (i & 1) ? "queue" : "mailbox", i);
+        IdTestPrintFrame("written", &s_Frames[i]);
+        if (s_NumSent == (i + 1))
+        {
+          IdTestPrintFrame("sent", &s_Sent[i]);
+        }
+      }
+      s_NumSent = i + 1;
+    }
+  }
+  printf("TX:        %u frames\n", s_NumFrames);
+  HOST_TEST_CHECK(errors == 0, "TX:        %lu frames wrong", (unsigned long) errors);
+}
+
+/** Receives every frame through the RX FIFO into the logger's messages
+ *  Every frame has to come back as it was on the bus
+ */
+static void IdTestReceive(void)
+{
+  uint16_t i = 0;
+  uint32_t errors = 0;
+
+  s_NumReceived = 0;
+  for (i = 0; i < s_NumFrames; i++)
+  {
+    HostClockAdvanceMicros(ID_TEST_FRAME_US);
+    FlexcanHostReceive(&s_Frames[i]);
+    if ((s_NumReceived != (i + 1)) || !IdTestSameFrame(&s_Frames[i], &s_Received[i]) || !IdTestSameMessage(&s_Frames[i], &s_Messages[i]))
+    {
+      if (errors++ < 5)
+      {
+        printf("RX frame %u:\n", i);
+        IdTestPrintFrame("on the bus", &s_Frames[i]);
+        if (s_NumReceived == (i + 1))
+        {
+          IdTestPrintFrame("received", &s_Received[i]);
+        }
+      }
+      s_NumReceived = i + 1;
+    }
+  }
+  printf("RX:        %u frames\n", s_NumFrames);
+  HOST_TEST_CHECK(errors == 0, "RX:        %lu frames wrong", (unsigned long) errors);
+}
+
+/** Checks a message read back from a capture against the message written
+ *  @return Whether or not they are the same
+ */
+static bool IdTestSameStored(const can_message_t *written, const can_message_t *read)
+{
+  return (written->timestamp == read->timestamp) && (written->id == read->id) && (written->ide == read->ide) &&
+         (written->len == read->len) && (memcmp(written->data, read->data, written->len) == 0);
+}
+
+/** Writes the received messages to a capture with FileWriteMessage and reads it back with both parsers
+ *  Every message has to come back the same
+ */
+static void IdTestStore(void)
+{
+  char path[SD_HOST_PATH_SIZE];
+  capture_t capture;
+  capture_map_t map;
+  can_message_t message;
+  SdFat sd;
+  SdFile file;
+  const char *position = NULL;
+  const char *newline = NULL;
+  uint32_t scanned = 0;
+  uint32_t errors = 0;
+  uint16_t i = 0;
+
+  if (!sd.begin(0) || !file.open(ID_TEST_FILE, O_WRITE | O_CREAT | O_TRUNC))
+  {
+    HostTestFail("Storage:   cannot write %s", ID_TEST_FILE);
+    return;
+  }
+  for (i = 0; i < s_NumReceived; i++)
+  {
+    FileWriteMessage(&s_Messages[i], &file);
+  }
+  file.close();
+  SdFatHostPath(path, sizeof(path), ID_TEST_FILE);
+
+  CaptureInit(&capture);
+  if (!CaptureLoadFile(&capture, path) || (capture.count != s_NumReceived) || (capture.malformedLines != 0))
+  {
+    HostTestFail("Storage:   %s read back %lu of %u frames, %lu malformed", path, (unsigned long) capture.count, s_NumReceived,
+                 (unsigned long) capture.malformedLines);
+    CaptureFree(&capture);
+    return;
+  }
+  for (i = 0; i < s_NumReceived; i++)
+  {
+    if (!IdTestSameStored(&s_Messages[i], &capture.messages[i]) && (errors++ < 5))
+    {
+      printf("Storage: frame %u written %s %lX, parsed %s %lX\n", i, s_Messages[i].ide ? "ext" : "std", (unsigned long) s_Messages[i].id,
+             capture.messages[i].ide ? "ext" : "std", (unsigned long) capture.messages[i].id);
+    }
+  }
+  CaptureFree(&capture);
+
+  if (!CaptureMapFile(&map, path))
+  {
+    HostTestFail("Storage:   cannot map %s", path);
+    return;
+  }
+  for (position = map.data; position < (map.data + map.size); position = newline + 1)
+  {
+    newline = (const char *) memchr(position, '\n', (map.data + map.size) - position);
+    newline = (newline == NULL) ? (map.data + map.size) : newline;
+    if (CaptureScanLine(position, newline - position, &message) != eCAPTURE_LINE_FRAME)
+    {
+      continue;
+    }
+    if ((scanned >= s_NumReceived) || !IdTestSameStored(&s_Messages[scanned], &message))
+    {
+      if (errors++ < 5)
+      {
+        printf("Storage: frame %lu scanned %s %lX\n", (unsigned long) scanned, message.ide ? "ext" : "std", (unsigned long) message.id);
+      }
+    }
+    scanned++;
+  }
+  CaptureUnmapFile(&map);
+  errors += (scanned != s_NumReceived) ? 1 : 0;
+
+  for (i = 0; i < ID_TEST_NUM_LINES; i++)
+  {
+    bool good = true;
+    CaptureLine_e parsed = CaptureParseLine(IdTestLines[i].line, &message);
+    good = (parsed == IdTestLines[i].kind) && ((parsed != eCAPTURE_LINE_FRAME) || ((message.id == IdTestLines[i].id) && (message.ide == IdTestLines[i].ide)));
+    parsed = CaptureScanLine(IdTestLines[i].line, strlen(IdTestLines[i].line), &message);
+    good = good && (parsed == IdTestLines[i].kind) && ((parsed != eCAPTURE_LINE_FRAME) || ((message.id == IdTestLines[i].id) && (message.ide == IdTestLines[i].ide)));
+    if (!good)
+    {
+      printf("Storage: line \"%s\" not parsed as expected\n", IdTestLines[i].line);
+      errors++;
+    }
+  }
+  printf("Storage:   %u frames written and parsed back twice, %u capture lines\n", s_NumReceived, ID_TEST_NUM_LINES);
+  HOST_TEST_CHECK(errors == 0, "Storage:   %lu wrong", (unsigned long) errors);
+}
+
+/** Queues every message as a telemetry frame record and checks the ID of the record
+ *  Every record has to have the ID and the extended flag of its message
+ */
+static void IdTestTelemetry(void)
+{
+  const telemetry_record_t *record = NULL;
+  uint32_t expected = 0;
+  uint32_t id = 0;
+  uint32_t errors = 0;
+  uint16_t i = 0;
+
+  TelemetryInit(&s_Telemetry);
+  TelemetryEnable(&s_Telemetry, true);
+  for (i = 0; i < s_NumReceived; i++)
+  {
+    TelemetryPushFrame(&s_Telemetry, &s_Messages[i]);
+    record = &s_Telemetry.records[(s_Telemetry.head - 1) & (TELEMETRY_RING_SIZE - 1)];
+    id = (uint32_t) record->payload[4] | ((uint32_t) record->payload[5] << 8) | ((uint32_t) record->payload[6] << 16) |
+         ((uint32_t) record->payload[7] << 24);
+    expected = s_Messages[i].ide ? (s_Messages[i].id | TELEMETRY_ID_EXTENDED) : s_Messages[i].id;
+    if ((record->type != eTELEMETRY_FRAME) || (id != expected))
+    {
+      if (errors++ < 5)
+      {
+        printf("Telemetry: frame %u record ID %08lX, expected %08lX\n", i, (unsigned long) id, (unsigned long) expected);
+      }
+    }
+    s_Telemetry.tail = s_Telemetry.head; // taken
+  }
+  printf("Telemetry: %u records\n", s_NumReceived);
+  HOST_TEST_CHECK(errors == 0, "Telemetry: %lu records wrong", (unsigned long) errors);
+}
+
+/** Matches the received messages against the trigger rules, an extended ID must never match an 11 bit
+ *  rule with the same low bits
+ */
+static void IdTestTriggers(void)
+{
+  const trigger_rule_t *rule = NULL;
+  uint8_t expected = SESSION_NO_RULE;
+  uint8_t ruleIndex = SESSION_NO_RULE;
+  uint8_t r = 0;
+  uint32_t errors = 0;
+  uint32_t matched = 0;
+  uint16_t i = 0;
+
+  for (i = 0; i < s_NumReceived; i++)
+  {
+    expected = SESSION_NO_RULE;
+    for (r = 0; (rule = SessionGetRule(r)) != NULL; r++)
+    {
+      if ((s_Messages[i].ide == rule->ide) && ((s_Messages[i].id & rule->mask) == rule->id))
+      {
+        expected = r;
+        break;
+      }
+    }
+    ruleIndex = SessionMatchRule(&s_Messages[i]);
+    matched += (ruleIndex != SESSION_NO_RULE) ? 1 : 0;
+    if (ruleIndex != expected)
+    {
+      if (errors++ < 5)
+      {
+        printf("Triggers:  frame %u ID %lX IDE %u matched rule %u, expected %u\n", i, (unsigned long) s_Messages[i].id,
+               s_Messages[i].ide, ruleIndex, expected);
+      }
+    }
+  }
+  printf("Triggers:  %u messages, %lu match a rule\n", s_NumReceived, (unsigned long) matched);
+  HOST_TEST_CHECK(errors == 0, "Triggers:  %lu wrong", (unsigned long) errors);
+}
+
+/** Sets the filter table format (MCR IDAM), in freeze mode
+ *  @param idam FLEXCAN_ID_FILT_TYPE value
+ */
+static void IdTestSetFilterFormat(uint8_t idam)
+{
+  FLEXCAN0_MCR |= FLEXCAN_MCR_FRZ | FLEXCAN_MCR_HALT;
+  FLEXCAN0_MCR = (FLEXCAN0_MCR & ~FLEXCAN_MCR_IDAM_MASK) | FLEXCAN_MCR_IDAM(idam);
+  FLEXCAN0_MCR &= ~(FLEXCAN_MCR_FRZ | FLEXCAN_MCR_HALT);
+}
+
+/** Whether or not the filters of one run accept a frame, worked out without the filter encoding
+ *  @param run Filter run (0 - 2)
+ *  @param *frame Frame on the bus
+ */
+static bool IdTestFilterExpects(uint8_t run, const FLEXCAN_frame_t *frame)
+{
+  switch (run)
+  {
+    case 0: // format A: J1939 PGN 0xFEF1 from any source, standard 0x7E8, extended diagnostics to F1 from any ECU
+    {
+      return !frame->rtr && ((frame->ide && ((frame->id & 0x00FFFF00) == 0x00FEF100)) || (!frame->ide && (frame->id == 0x7E8)) ||
+                             (frame->ide && ((frame->id & 0x1FFF00FF) == 0x18DA00F1)));
+    }
+    case 1: // format B: standard 0x7E0 and 0x7E8, extended IDs starting 0x18DA8 (upper 14 bits)
+    {
+      return !frame->rtr && ((!frame->ide && ((frame->id == 0x7E0) || (frame->id == 0x7E8))) ||
+                             (frame->ide && ((frame->id >> 15) == (0x18DA8000 >> 15))));
+    }
+    default: // format C: upper 8 bits 0xC6 (standard 0x630 - 0x637, extended 0x18Cxxxxx - 0x18Dxxxxx)
+    {
+      return frame->ide ? ((frame->id >> 21) == 0xC6) : ((frame->id >> 3) == 0xC6);
+    }
+  }
+}
+
+/** Runs the frames and frames made to match past the RX FIFO filters in formats A, B and C
+ *  The filters have to take exactly the frames they should
+ */
+static void IdTestFilters(void)
+{
+  static FLEXCAN_frame_t offered[ID_TEST_MAX_FRAMES + 32];
+  const uint32_t targets[][2] = {
+    {1, 0x0CFEF100}, {1, 0x18FEF1FE}, {0, 0x7E8}, {1, 0x7E8}, {0, 0x7E0}, {1, 0x18DA10F1}, {1, 0x18DA10F2},
+    {1, 0x00FEF200}, {0, 0x100}, {1, 0x18DA8123}, {1, 0x18DAC123}, {0, 0x633}, {1, 0x18C00000}, {1, 0x00000633}
+  };
+  uint8_t sliceC[4] = {0xC6, 0xC6, 0xC6, 0xC6};
+  uint32_t filter = 0;
+  uint32_t mask = 0;
+  uint32_t errors = 0;
+  uint16_t before = 0;
+  uint16_t numOffered = 0;
+  uint16_t expected = 0;
+  uint16_t i = 0;
+  uint8_t run = 0;
+  uint8_t n = 0;
+
+  // the encoding, bit for bit (reference manual, Rx FIFO structure)
+  if ((FLEXCAN_filter_a(0, 1, 0x18DAF110) != 0x71B5E220) || (FLEXCAN_filter_a(1, 0, 0x7E8) != 0xBF400000) ||
+      (FLEXCAN_filter_b(0, 1, 0, 1, 0x7E8, 0x3123) != 0x3F40F123) || (FLEXCAN_filter_c(sliceC, 4) != 0xC6C6C6C6) ||
+      (FLEXCAN_set_fifo_filter(FLEXCAN_NUM_FIFO_FILTERS, 0, 0) != FLEXCAN_ERROR))
+  {
+    printf("Filters:   encoding wrong\n");
+    errors++;
+  }
+
+  memcpy(offered, s_Frames, s_NumFrames * sizeof(FLEXCAN_frame_t));
+  numOffered = s_NumFrames;
+  for (i = 0; i < (sizeof(targets) / sizeof(targets[0])); i++)
+  {
+    memset(&offered[numOffered], 0, sizeof(FLEXCAN_frame_t));
+    offered[numOffered].ide = targets[i][0];
+    offered[numOffered].srr = targets[i][0];
+    offered[numOffered].id = targets[i][1];
+    offered[numOffered].dlc = 1;
+    offered[numOffered].data[0] = i;
+    numOffered++;
+  }
+
+  for (run = 0; run < 3; run++)
+  {
+    IdTestSetFilterFormat(run);
+    for (n = 0; n < FLEXCAN_NUM_FIFO_FILTERS; n++)
+    {
+      switch (run)
+      {
+        case 0:
+        {
+          const uint32_t common = FLEXCAN_FILTER_A_MSK_RTR | FLEXCAN_FILTER_A_MSK_IDE;
+          filter = (n == 0) ? FLEXCAN_filter_a(0, 1, 0x00FEF100) : ((n == 1) ? FLEXCAN_filter_a(0, 1, 0x18DA00F1) : FLEXCAN_filter_a(0, 0, 0x7E8));
+          mask = (n == 0) ? (common | (0x00FFFF00 << 1)) : ((n == 1) ? (common | (0x1FFF00FF << 1)) : (common | FLEXCAN_FILTER_A_MSK_STD));
+          break;
+        }
+        case 1:
+        {
+          filter = (n == 0) ? FLEXCAN_filter_b(0, 0, 1, 1, (0x18DA8000 >> 15), (0x18DA8000 >> 15)) : FLEXCAN_filter_b(0, 0, 0, 0, 0x7E0, 0x7E8);
+          mask = FLEXCAN_FILTER_B_MSK_RTR_A | FLEXCAN_FILTER_B_MSK_IDE_A | FLEXCAN_FILTER_B_MSK_ID_A |
+                 FLEXCAN_FILTER_B_MSK_RTR_B | FLEXCAN_FILTER_B_MSK_IDE_B | FLEXCAN_FILTER_B_MSK_ID_B;
+          break;
+        }
+        default:
+        {
+          filter = FLEXCAN_filter_c(sliceC, 4);
+          mask = 0xFFFFFFFF;
+          break;
+        }
+      }
+      FLEXCAN_set_fifo_filter(n, filter, mask);
+    }
+
+    s_NumReceived = 0;
+    expected = 0;
+    for (i = 0; i < numOffered; i++)
+    {
+      HostClockAdvanceMicros(ID_TEST_FRAME_US);
+      before = s_NumReceived;
+      FlexcanHostReceive(&offered[i]);
+      if (IdTestFilterExpects(run, &offered[i]) != (s_NumReceived != before))
+      {
+        if (errors++ < 5)
+        {
+          printf("Filters: format %c %s\n", 'A' + run, (s_NumReceived != before) ? "accepted" : "rejected");
+          IdTestPrintFrame("frame", &offered[i]);
+        }
+      }
+      expected += IdTestFilterExpects(run, &offered[i]) ? 1 : 0;
+    }
+    printf("Filters:   format %c took %u of %u frames\n", 'A' + run, s_NumReceived, numOffered);
+    errors += (expected == 0) ? 1 : 0; // a run that accepts nothing checks nothing
+  }
+
+  // back to accepting everything
+  IdTestSetFilterFormat(FLEXCAN_ID_FILT_TYPE);
+  for (n = 0; n < FLEXCAN_NUM_FIFO_FILTERS; n++)
+  {
+    FLEXCAN_set_fifo_filter(n, 0, 0);
+  }
+  HOST_TEST_CHECK(errors == 0, "Filters:   %lu wrong", (unsigned long) errors);
+}
+
+int main(int argc, char **argv)
+{
+  FLEXCAN_config_t canConfig;
+  const char *root = NULL;
+  uint32_t seed = 1;
+  uint32_t count = ID_TEST_FRAMES;
+  uint16_t i = 0;
+  const host_test_option_t options[] =
+  {
+    {'s', eHOST_TEST_UINT, &seed},
+    {'n', eHOST_TEST_UINT, &count},
+    {'d', eHOST_TEST_STRING, &root}
+  };
+
+  if (!HostTestOptions(argc, argv, "[-s seed] [-n frames] [-d sd_root] [-v]", options, sizeof(options) / sizeof(options[0])))
+  {
+    return 1;
+  }
+  if (root != NULL)
+  {
+    SdFatHostSetRoot(root);
+  }
+  if (count > (ID_TEST_MAX_FRAMES - ID_TEST_NUM_EDGES))
+  {
+    count = ID_TEST_MAX_FRAMES - ID_TEST_NUM_EDGES;
+  }
+
+  randomSeed(seed);
+  HostClockUseVirtualTime(true);
+  FlexcanHostReset();
+  canConfig.presdiv = 1;                // 500 kbit/s from the 16 MHz oscillator
+  canConfig.propseg = 2;
+  canConfig.rjw = 1;
+  canConfig.pseg_1 = 7;
+  canConfig.pseg_2 = 3;
+  FLEXCAN_init(canConfig);
+  FLEXCAN_fifo_reg_callback(id_test_fifo_callback);
+  FLEXCAN_txq_init(NULL);
+  FlexcanHostSetTxHandler(id_test_tx_handler);
+
+  IdTestBuildFrames((uint16_t) count);
+  if (g_HostTestVerbose)
+  {
+    for (i = 0; i < ID_TEST_NUM_EDGES; i++)
+    {
+      IdTestPrintFrame("edge", &s_Frames[i]);
+    }
+  }
+  IdTestTransmit();
+  IdTestReceive();
+  IdTestStore();
+  IdTestTelemetry();
+  IdTestTriggers();
+  IdTestFilters();
+  return HostTestSummary();
+}
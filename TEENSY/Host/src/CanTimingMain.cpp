@@ -0,0 +1,235 @@
+/*
+  * @file CanTimingMain.cpp
+  *
+  * Checks the bit timing solver. The standard automotive bit rates are worked out by the
+  * compiler (a missing solution would stop this file from building) and each is set in the
+  * simulated controller, which has to receive frames at that bit rate and reject the ones 3%
+  * off it. Then every bit rate of the table, at sample points from 50% to 90% and at the clocks
+  * FlexCAN may run from, is solved at run time and compared with a search of every prescaler,
+  * time quanta and segment split: a solution has to exist exactly when the search finds one,
+  * give the bit rate, keep every field in range and have the smallest sample point error found.
+  *
+  * can_timing_host [-v]
+*/
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <FlexcanHostBus.h>
+#include <HostTest.h>
+#include <can_timing.h>
+#include <math.h>
+
+/* DEFINES */
+#define TIMING_TEST_NUM_RATES         14        // Number of bit rates checked
+#define TIMING_TEST_NUM_CLOCKS        8         // Number of clocks checked
+#define TIMING_TEST_SP_MIN            500       // Lowest sample point checked (per mille)
+#define TIMING_TEST_SP_MAX            900       // Highest sample point checked (per mille)
+#define TIMING_TEST_SP_STEP           25        // Sample point step (per mille)
+#define TIMING_TEST_OFF_RATE          30        // Bus bit rate offset (per mille) that has to be rejected
+
+/* STRUCTS */
+typedef struct {
+  uint32_t bitRate;                     // Bit rate (bit/s)
+  FLEXCAN_config_t config;              // Solved by the compiler at 16 MHz, 87.5% (CiA 301)
+} timing_test_rate_t;
+
+/* CONSTANTS */
+// 500 kbit/s at 75% has to be the timing CanConfigInit always had
+static_assert(FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 500000, 750).presdiv == 1, "500 kbit/s PRESDIV");
+static_assert(FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 500000, 750).propseg == 2, "500 kbit/s PROPSEG");
+static_assert(FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 500000, 750).rjw == 1, "500 kbit/s RJW");
+static_assert(FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 500000, 750).pseg_1 == 7, "500 kbit/s PSEG1");
+static_assert(FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 500000, 750).pseg_2 == 3, "500 kbit/s PSEG2");
+static_assert(!FLEXCAN_timing_exists(FLEXCAN_CLOCK_HZ, 33000, 750), "33 kbit/s is not exact from 16 MHz");
+static_assert(!FLEXCAN_timing_exists(FLEXCAN_CLOCK_HZ, 4000000, 750), "4 Mbit/s needs fewer than 8 time quanta");
+
+static const timing_test_rate_t TimingTestRates[TIMING_TEST_NUM_RATES] =
+{
+  {1000000, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 1000000, 875)},
+  { 800000, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 800000, 875)},
+  { 500000, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 500000, 875)},
+  { 250000, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 250000, 875)},
+  { 200000, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 200000, 875)},
+  { 125000, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 125000, 875)},
+  { 100000, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 100000, 875)},
+  {  83333, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 83333, 875)},
+  {  50000, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 50000, 875)},
+  {  33333, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 33333, 875)},
+  {  20000, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 20000, 875)},
+  {  10000, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 10000, 875)},
+  {   5000, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 5000, 875)},
+  {  95238, FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 95238, 875)}
+};
+
+// oscillators and bus clocks of the Kinetis parts, and what other CAN controllers run from
+static const uint32_t TimingTestClocks[TIMING_TEST_NUM_CLOCKS] =
+{
+  16000000, 8000000, 20000000, 24000000, 36000000, 40000000, 48000000, 60000000
+};
+
+/** Searches every prescaler, number of time quanta and phase 2 length for the smallest sample
+ *  point error that gives a bit rate exactly
+ *  @param clock Clock (Hz)
+ *  @param bitRate Bit rate (bit/s)
+ *  @param samplePoint Sample point (per mille)
+ *  @return Smallest error (per million), FLEXCAN_TIMING_NONE if no timing gives the bit rate
+ */
+static uint32_t TimingTestSearch(uint32_t clock, uint32_t bitRate, uint32_t samplePoint)
+{
+  uint32_t best = FLEXCAN_TIMING_NONE;
+  uint32_t error = 0;
+  uint32_t presc = 0;
+  uint32_t tq = 0;
+  uint32_t pseg2 = 0;
+  uint32_t tseg1 = 0;
+  int64_t sp = 0;
+
+  for (presc = 1; presc <= FLEXCAN_TIMING_PRESC_MAX; presc++)
+  {
+    for (tq = FLEXCAN_TIMING_TQ_MIN; tq <= FLEXCAN_TIMING_TQ_MAX; tq++)
+    {
+      if ((uint32_t) llround((double) clock / (presc * tq)) != bitRate)
+      {
+        continue;
+      }
+      for (pseg2 = FLEXCAN_TIMING_PSEG2_MIN; pseg2 <= FLEXCAN_TIMING_SEG_MAX; pseg2++)
+      {
+        tseg1 = tq - 1 - pseg2;
+        if ((tseg1 < 2) || (tseg1 > 2 * FLEXCAN_TIMING_SEG_MAX))
+        {
+          continue;
+        }
+        sp = ((int64_t)(tq - pseg2) * 1000000) / tq;
+        error = (uint32_t) llabs(sp - (int64_t) samplePoint * 1000);
+        best = (error < best) ? error : best;
+      }
+    }
+  }
+  return best;
+}
+
+/** Checks a config: every field in range, the bit rate given exactly
+ *  @param clock Clock (Hz)
+ *  @param bitRate Bit rate (bit/s)
+ *  @param *config Config to be checked
+ *  @return Whether or not the config is right
+ */
+static bool TimingTestValid(uint32_t clock, uint32_t bitRate, const FLEXCAN_config_t *config)
+{
+  uint32_t tq = FLEXCAN_timing_quanta(*config);
+
+  return (config->propseg < FLEXCAN_TIMING_SEG_MAX) && (config->pseg_1 < FLEXCAN_TIMING_SEG_MAX) &&
+         (config->pseg_2 < FLEXCAN_TIMING_SEG_MAX) && ((config->pseg_2 + 1) >= FLEXCAN_TIMING_PSEG2_MIN) &&
+         (config->rjw < FLEXCAN_TIMING_SJW_MAX) && (config->rjw <= config->pseg_1) && (config->rjw <= config->pseg_2) &&
+         (tq >= FLEXCAN_TIMING_TQ_MIN) && (tq <= FLEXCAN_TIMING_TQ_MAX) &&
+         (FLEXCAN_timing_bitrate(clock, *config) == bitRate);
+}
+
+/** Solves every bit rate at every clock and sample point at run time and compares with the search
+ */
+static void TimingTestSolver(void)
+{
+  FLEXCAN_config_t config;
+  uint32_t solved = 0;
+  uint32_t unsolved = 0;
+  uint32_t clock = 0;
+  uint32_t rate = 0;
+  uint32_t sp = 0;
+  uint32_t best = 0;
+  uint32_t error = 0;
+  uint8_t c = 0;
+  uint8_t r = 0;
+
+  for (c = 0; c < TIMING_TEST_NUM_CLOCKS; c++)
+  {
+    clock = TimingTestClocks[c];
+    for (r = 0; r < TIMING_TEST_NUM_RATES; r++)
+    {
+      rate = TimingTestRates[r].bitRate;
+      for (sp = TIMING_TEST_SP_MIN; sp <= TIMING_TEST_SP_MAX; sp += TIMING_TEST_SP_STEP)
+      {
+        best = TimingTestSearch(clock, rate, sp);
+        if (FLEXCAN_timing_exists(clock, rate, sp) != (best != FLEXCAN_TIMING_NONE))
+        {
+          HostTestFail("%lu Hz, %lu bit/s, %lu: solver %s a solution, the search %s", (unsigned long) clock, (unsigned long) rate,
+                       (unsigned long) sp, FLEXCAN_timing_exists(clock, rate, sp) ? "finds" : "does not find",
+                       (best != FLEXCAN_TIMING_NONE) ? "does" : "does not");
+          continue;
+        }
+        if (best == FLEXCAN_TIMING_NONE)
+        {
+          unsolved++;
+          continue;
+        }
+
+        config = FLEXCAN_timing(clock, rate, sp);
+        error = FLEXCAN_timing_error(clock, rate, sp, FLEXCAN_timing_quanta(config));
+        HOST_TEST_CHECK(TimingTestValid(clock, rate, &config) && (error == best),
+                        "%lu Hz, %lu bit/s, %lu: PRESDIV %u PROPSEG %u RJW %u PSEG1 %u PSEG2 %u gives %lu bit/s, sample point error %lu (best %lu)",
+                        (unsigned long) clock, (unsigned long) rate, (unsigned long) sp, config.presdiv, config.propseg, config.rjw,
+                        config.pseg_1, config.pseg_2, (unsigned long) FLEXCAN_timing_bitrate(clock, config), (unsigned long) error,
+                        (unsigned long) best);
+        solved++;
+      }
+    }
+  }
+  printf("Solver: %lu timings solved, %lu with no exact solution, all matching the search\n", (unsigned long) solved,
+         (unsigned long) unsolved);
+}
+
+/** Sets the compiler's timing of each standard bit rate in the controller and puts frames on the
+ *  bus at that bit rate and 3% off it
+ */
+static void TimingTestController(void)
+{
+  const timing_test_rate_t *rate = NULL;
+  FLEXCAN_frame_t frame;
+  flexcan_host_stats_t stats;
+  uint32_t bitTimeNs = 0;
+  uint8_t r = 0;
+
+  memset(&frame, 0, sizeof(frame));
+  frame.id = 0x7E8;
+  frame.dlc = 8;
+  for (r = 0; r < TIMING_TEST_NUM_RATES; r++)
+  {
+    rate = &TimingTestRates[r];
+    FlexcanHostReset();
+    FLEXCAN_init(rate->config);
+    bitTimeNs = FlexcanHostBitTimeNs();
+
+    FlexcanHostSetBusBitRate(rate->bitRate);
+    FlexcanHostReceive(&frame);
+    FlexcanHostSetBusBitRate(rate->bitRate + (rate->bitRate * TIMING_TEST_OFF_RATE) / 1000);
+    FlexcanHostReceive(&frame);
+    FlexcanHostSetBusBitRate(rate->bitRate - (rate->bitRate * TIMING_TEST_OFF_RATE) / 1000);
+    FlexcanHostReceive(&frame);
+    FlexcanHostGetStats(&stats);
+
+    HOST_TEST_CHECK(TimingTestValid(FLEXCAN_CLOCK_HZ, rate->bitRate, &rate->config) &&
+                    (llabs(llround(1e9 / rate->bitRate) - (int64_t) bitTimeNs) <= 1) &&
+                    (stats.framesReceived == 1) && (stats.framesMisread == 2),
+                    "%lu bit/s: bit time %lu ns, %lu received, %lu misread", (unsigned long) rate->bitRate, (unsigned long) bitTimeNs,
+                    (unsigned long) stats.framesReceived, (unsigned long) stats.framesMisread);
+    if (g_HostTestVerbose)
+    {
+      printf("%7lu bit/s: PRESDIV %3u PROPSEG %u RJW %u PSEG1 %u PSEG2 %u, %2lu time quanta, sample point %lu\n",
+             (unsigned long) rate->bitRate, rate->config.presdiv, rate->config.propseg, rate->config.rjw, rate->config.pseg_1,
+             rate->config.pseg_2, (unsigned long) FLEXCAN_timing_quanta(rate->config),
+             (unsigned long) FLEXCAN_timing_sample_point(rate->config));
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (!HostTestOptions(argc, argv, "[-v]", NULL, 0))
+  {
+    return 1;
+  }
+
+  HostClockUseVirtualTime(true);
+  TimingTestController();
+  TimingTestSolver();
+  return HostTestSummary();
+}
@@ -0,0 +1,12 @@
+/*
+  * @file CanTimingNoSolution.cpp
+  *
+  * Must not build: no prescaler and number of time quanta give 33 kbit/s exactly from 16 MHz
+  * (it takes 484.8 time quanta per bit), so FLEXCAN_TIMING has to stop the compiler.
+*/
+
+/* INCLUDES */
+#include <can_timing.h>
+
+/* CONSTANTS */
+const FLEXCAN_config_t CanTimingNoSolution = FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, 33000, 750);
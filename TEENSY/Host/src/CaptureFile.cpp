@@ -0,0 +1,156 @@
+/*
+  * @file CaptureFile.cpp
+  *
+  * Reads captures written by FileWriteMessage (attack files and serial logs) back into
+  * CAN messages
+*/
+
+/* INCLUDES */
+#include <CaptureFile.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* DEFINES */
+#define CAPTURE_MAX_ID                0x1FFFFFFF // Largest extended arbitration ID
+
+/** Initializes an empty capture
+ *  @param *capture Capture to be initialized
+ */
+void CaptureInit(capture_t *capture)
+{
+  capture->messages = NULL;
+  capture->count = 0;
+  capture->capacity = 0;
+  capture->malformedLines = 0;
+}
+
+/** Frees the messages of a capture, leaving it empty
+ *  @param *capture Capture to be freed
+ */
+void CaptureFree(capture_t *capture)
+{
+  free(capture->messages);
+  CaptureInit(capture);
+}
+
+/** Appends a message to a capture, growing it as needed
+ *  @param *capture Capture to be appended to
+ *  @param *message Message to be copied
+ *  @return Whether or not the message was appended
+ */
+bool CaptureAppend(capture_t *capture, const can_message_t *message)
+{
+  can_message_t *messages = NULL;
+  uint32_t capacity = 0;
+
+  if (capture->count == capture->capacity)
+  {
+    capacity = (capture->capacity == 0) ? CAPTURE_INITIAL_CAPACITY : (capture->capacity * 2);
+    messages = (can_message_t *) realloc(capture->messages, capacity * sizeof(can_message_t));
+    if (messages == NULL)
+    {
+      return false;
+    }
+    capture->messages = messages;
+    capture->capacity = capacity;
+  }
+  memcpy(&capture->messages[capture->count++], message, sizeof(can_message_t));
+  return true;
+}
+
+/** Parses one line of a capture
+ *  A frame line is "timestamp\t\tID\tB0 B1 ... ", all but the timestamp in unpadded hex except
+ *  extended IDs, which have CAN_EXT_ID_DIGITS digits (older captures: any ID above CAN_MAX_STD_ID)
+ *  @param *line Line, with or without its line ending
+ *  @param *message Message to be set when the line is a frame
+ *  @return Kind of line
+ */
+CaptureLine_e CaptureParseLine(const char *line, can_message_t *message)
+{
+  const char *position = line;
+  char *end = NULL;
+  unsigned long value = 0;
+
+  if (!isdigit((unsigned char) *position))
+  {
+    return eCAPTURE_LINE_OTHER;
+  }
+  memset(message, 0, sizeof(can_message_t));
+
+  value = strtoul(position, &end, 10);
+  if ((end == position) || ((*end != '\t') && (*end != ' ')))
+  {
+    return eCAPTURE_LINE_MALFORMED;
+  }
+  message->timestamp = (uint32_t) value;
+  position = end;
+  while ((*position == ' ') || (*position == '\t'))
+  {
+    position++;
+  }
+
+  value = strtoul(position, &end, 16);
+  if ((end == position) || ((end - position) > CAN_EXT_ID_DIGITS) || (value > CAPTURE_MAX_ID))
+  {
+    return eCAPTURE_LINE_MALFORMED;
+  }
+  message->id = (uint32_t) value;
+  message->ide = ((end - position) == CAN_EXT_ID_DIGITS) || (value > CAN_MAX_STD_ID);
+  position = end;
+
+  while (true)
+  {
+    while ((*position == ' ') || (*position == '\t'))
+    {
+      position++;
+    }
+    if ((*position == '\0') || (*position == '\r') || (*position == '\n'))
+    {
+      break;
+    }
+    if (!isxdigit((unsigned char) *position) || (message->len == sizeof(message->data)))
+    {
+      return eCAPTURE_LINE_MALFORMED;
+    }
+    value = strtoul(position, &end, 16);
+    if ((value > 0xFF) || ((*end != ' ') && (*end != '\t') && (*end != '\r') && (*end != '\n') && (*end != '\0')))
+    {
+      return eCAPTURE_LINE_MALFORMED;
+    }
+    message->data[message->len++] = (uint8_t) value;
+    position = end;
+  }
+  return eCAPTURE_LINE_FRAME;
+}
+
+/** Appends every frame of a capture file to a capture
+ *  Header, PDU and footer lines are skipped, malformed frame lines are counted
+ *  @param *capture Capture to be appended to
+ *  @param *path Path of the capture file
+ *  @return Whether or not the file was read completely
+ */
+bool CaptureLoadFile(capture_t *capture, const char *path)
+{
+  char line[CAPTURE_LINE_SIZE];
+  can_message_t message;
+  FILE *file = fopen(path, "r");
+  bool status = true;
+
+  if (file == NULL)
+  {
+    return false;
+  }
+  while (status && (fgets(line, sizeof(line), file) != NULL))
+  {
+    switch (CaptureParseLine(line, &message))
+    {
+      case eCAPTURE_LINE_FRAME: { status = CaptureAppend(capture, &message); break; }
+      case eCAPTURE_LINE_MALFORMED: { capture->malformedLines++; break; }
+      default: { break; }
+    }
+  }
+  status = status && !ferror(file);
+  fclose(file);
+  return status;
+}
@@ -0,0 +1,426 @@
+/*
+  * @file CaptureScan.cpp
+  *
+  * Fast scanning of captures written by FileWriteMessage: memory-mapped files, line-aligned
+  * chunks, a SWAR (8 characters per word) line parser and an ID index for per-ID tables
+*/
+
+/* INCLUDES */
+#include <CaptureScan.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* DEFINES */
+#define CAPTURE_MAX_ID                0x1FFFFFFF // Largest extended arbitration ID
+#define CAPTURE_MAX_DIGITS            8         // Longest hex field (ID, payload byte)
+#define CAPTURE_ID_FREE               0xFFFFFFFF // Value of a free ID index slot
+
+#define SWAR_ONES                     0x0101010101010101ULL
+#define SWAR_HIGH                     0x8080808080808080ULL
+#define SWAR_LOW7                     0x7F7F7F7F7F7F7F7FULL
+#define SWAR_LOW4                     0x0F0F0F0F0F0F0F0FULL
+#define SWAR_MOVEMASK                 0x0102040810204080ULL // Gathers the high bit of each byte into the top byte
+
+// the word parser takes the first character of a word as its low byte
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#error "CaptureScanLine needs a little-endian host"
+#endif
+
+/** Repeats a character in every byte of a word
+ */
+static inline uint64_t SwarBroadcast(uint8_t c)
+{
+  return SWAR_ONES * c;
+}
+
+/** Flags (0x80) the bytes of a word of ASCII characters that are at least k (1 - 0x80)
+ */
+static inline uint64_t SwarAtLeast(uint64_t word, uint8_t k)
+{
+  return (word + SwarBroadcast(0x80 - k)) & SWAR_HIGH;
+}
+
+/** Flags (0x80) the bytes of a word equal to c
+ */
+static inline uint64_t SwarEqual(uint64_t word, uint8_t c)
+{
+  uint64_t x = word ^ SwarBroadcast(c);
+  return ~(((x & SWAR_LOW7) + SWAR_LOW7) | x | SWAR_LOW7);
+}
+
+/** Packs the flags of a word into 8 bits, bit n for byte n (first character)
+ */
+static inline uint64_t SwarMoveMask(uint64_t flags)
+{
+  return ((flags >> 7) * SWAR_MOVEMASK) >> 56;
+}
+
+/** Index of the first set bit at or above a position
+ *  @return Bit index, 64 when there is none
+ */
+static inline uint32_t CaptureNextBit(uint64_t mask, uint32_t from)
+{
+  if (from >= 64)
+  {
+    return 64;
+  }
+  mask &= ~0ULL << from;
+  return (mask == 0) ? 64 : (uint32_t) __builtin_ctzll(mask);
+}
+
+/** Maps a capture file into memory, read only
+ *  @param *map Mapping to be set
+ *  @param *path Path of the capture file
+ *  @return Whether or not the file was mapped
+ */
+bool CaptureMapFile(capture_map_t *map, const char *path)
+{
+  struct stat info;
+  void *data = NULL;
+  int fd = open(path, O_RDONLY);
+
+  map->data = NULL;
+  map->size = 0;
+  if (fd < 0)
+  {
+    return false;
+  }
+  if (fstat(fd, &info) != 0)
+  {
+    close(fd);
+    return false;
+  }
+  if (info.st_size > 0)
+  {
+    data = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      close(fd);
+      return false;
+    }
+    madvise(data, (size_t) info.st_size, MADV_SEQUENTIAL);
+    map->data = (const char *) data;
+    map->size = (size_t) info.st_size;
+  }
+  close(fd); // the mapping keeps the file
+  return true;
+}
+
+/** Unmaps a capture file
+ *  @param *map Mapping set by CaptureMapFile
+ */
+void CaptureUnmapFile(capture_map_t *map)
+{
+  if (map->data != NULL)
+  {
+    munmap((void *) map->data, map->size);
+  }
+  map->data = NULL;
+  map->size = 0;
+}
+
+/** Splits a capture into chunks of about chunkSize bytes that start and end on line boundaries
+ *  @param *data Capture contents
+ *  @param size Number of bytes
+ *  @param chunkSize Target chunk size
+ *  @param *bounds Chunk n is [bounds[n], bounds[n + 1]), maxChunks + 1 entries
+ *  @param maxChunks Largest number of chunks, the last chunk takes the rest
+ *  @return Number of chunks
+ */
+uint32_t CaptureSplitChunks(const char *data, size_t size, size_t chunkSize, size_t *bounds, uint32_t maxChunks)
+{
+  const char *newline = NULL;
+  uint32_t numChunks = 0;
+  size_t position = 0;
+
+  bounds[0] = 0;
+  while ((position < size) && (numChunks < maxChunks))
+  {
+    position += chunkSize;
+    if ((position >= size) || (numChunks == (maxChunks - 1)))
+    {
+      position = size;
+    }
+    else
+    {
+      newline = (const char *) memchr(&data[position], '\n', size - position);
+      position = (newline == NULL) ? size : (size_t)(newline - data) + 1;
+    }
+    bounds[++numChunks] = position;
+  }
+  return numChunks;
+}
+
+/** Parses a line the word parser does not take with CaptureParseLine
+ */
+static CaptureLine_e CaptureScanLineScalar(const char *line, size_t length, can_message_t *message)
+{
+  char text[CAPTURE_LINE_SIZE];
+
+  if (length >= sizeof(text))
+  {
+    length = sizeof(text) - 1;
+  }
+  memcpy(text, line, length);
+  text[length] = '\0';
+  return CaptureParseLine(text, message);
+}
+
+/** Parses one line of a capture, same result as CaptureParseLine
+ *  The line is classified 8 characters at a time (hex digit, decimal digit, separator, end of
+ *  line) and every character is turned into its nibble value in the same pass, the fields are
+ *  then cut out with the masks instead of testing one character at a time
+ *  @param *line Start of the line, need not be terminated
+ *  @param length Number of characters, without the '\n'
+ *  @param *message Message to be set when the line is a frame
+ *  @return Kind of line
+ */
+CaptureLine_e CaptureScanLine(const char *line, size_t length, can_message_t *message)
+{
+  uint8_t text[CAPTURE_SCAN_LINE_SIZE];
+  uint8_t nibbles[CAPTURE_SCAN_LINE_SIZE];
+  uint64_t word = 0;
+  uint64_t lower = 0;
+  uint64_t value = 0;
+  uint64_t hexMask = 0;
+  uint64_t decMask = 0;
+  uint64_t sepMask = 0;
+  uint64_t endMask = 0;
+  uint64_t nonAscii = 0;
+  uint64_t lineMask = 0;
+  uint32_t words = 0;
+  uint32_t index = 0;
+  uint32_t lineEnd = 0;
+  uint32_t start = 0;
+  uint32_t end = 0;
+
+  if ((length == 0) || !isdigit((unsigned char) line[0]))
+  {
+    return eCAPTURE_LINE_OTHER;
+  }
+  if (length > CAPTURE_SCAN_LINE_SIZE)
+  {
+    return CaptureScanLineScalar(line, length, message);
+  }
+  words = (uint32_t)((length + 7) / 8);
+  memset(&text[(words - 1) * 8], 0, 8); // only the last word has padding
+  memcpy(text, line, length);
+
+  for (index = 0; index < words; index++)
+  {
+    memcpy(&word, &text[index * 8], sizeof(word));
+    nonAscii |= word & SWAR_HIGH;
+    lower = word | SwarBroadcast(0x20);
+    decMask |= SwarMoveMask(SwarAtLeast(word, '0') & ~SwarAtLeast(word, '9' + 1)) << (index * 8);
+    hexMask |= SwarMoveMask((SwarAtLeast(word, '0') & ~SwarAtLeast(word, '9' + 1)) |
+                            (SwarAtLeast(lower, 'a') & ~SwarAtLeast(lower, 'f' + 1))) << (index * 8);
+    sepMask |= SwarMoveMask(SwarEqual(word, ' ') | SwarEqual(word, '\t')) << (index * 8);
+    endMask |= SwarMoveMask(SwarEqual(word, '\r') | SwarEqual(word, '\n') | SwarEqual(word, '\0')) << (index * 8);
+    // '0' - '9' -> 0 - 9, 'A' - 'F' and 'a' - 'f' -> 10 - 15 (bit 6 set for letters)
+    word = (word & SWAR_LOW4) + (((word >> 6) & SWAR_ONES) * 9);
+    memcpy(&nibbles[index * 8], &word, sizeof(word));
+  }
+  if (nonAscii != 0)
+  {
+    return CaptureScanLineScalar(line, length, message);
+  }
+  lineEnd = CaptureNextBit(endMask, 0);
+  lineEnd = (lineEnd < length) ? lineEnd : (uint32_t) length;
+  lineMask = (lineEnd == 64) ? ~0ULL : ((1ULL << lineEnd) - 1);
+  if (((hexMask | sepMask) & lineMask) != lineMask)
+  {
+    return eCAPTURE_LINE_MALFORMED;
+  }
+  memset(message, 0, sizeof(can_message_t));
+
+  // timestamp: decimal digits followed by a separator
+  end = CaptureNextBit(~decMask, 0);
+  if ((end >= lineEnd) || !(sepMask & (1ULL << end)))
+  {
+    return eCAPTURE_LINE_MALFORMED;
+  }
+  for (index = 0; index < end; index++)
+  {
+    value = (value * 10) + nibbles[index];
+  }
+  message->timestamp = (uint32_t) value;
+
+  // ID
+  start = CaptureNextBit(hexMask, end);
+  if (start >= lineEnd)
+  {
+    return eCAPTURE_LINE_MALFORMED;
+  }
+  end = CaptureNextBit(~hexMask, start);
+  if ((end - start) > CAPTURE_MAX_DIGITS)
+  {
+    return eCAPTURE_LINE_MALFORMED;
+  }
+  for (value = 0, index = start; index < end; index++)
+  {
+    value = (value << 4) | nibbles[index];
+  }
+  if (value > CAPTURE_MAX_ID)
+  {
+    return eCAPTURE_LINE_MALFORMED;
+  }
+  message->id = (uint32_t) value;
+  message->ide = ((end - start) == CAN_EXT_ID_DIGITS) || (value > CAN_MAX_STD_ID);
+
+  // payload bytes
+  while ((start = CaptureNextBit(hexMask & lineMask, end)) < lineEnd)
+  {
+    end = CaptureNextBit(~hexMask, start);
+    if (((end - start) > CAPTURE_MAX_DIGITS) || (message->len == sizeof(message->data)))
+    {
+      return eCAPTURE_LINE_MALFORMED;
+    }
+    for (value = 0, index = start; index < end; index++)
+    {
+      value = (value << 4) | nibbles[index];
+    }
+    if (value > 0xFF)
+    {
+      return eCAPTURE_LINE_MALFORMED;
+    }
+    message->data[message->len++] = (uint8_t) value;
+  }
+  return eCAPTURE_LINE_FRAME;
+}
+
+/** Initializes an empty ID index
+ *  @param *index Index to be initialized
+ */
+void CaptureIdIndexInit(capture_id_index_t *index)
+{
+  index->ids = NULL;
+  index->values = NULL;
+  index->capacity = 0;
+  index->count = 0;
+}
+
+/** Frees an ID index, leaving it empty
+ *  @param *index Index to be freed
+ */
+void CaptureIdIndexFree(capture_id_index_t *index)
+{
+  free(index->ids);
+  free(index->values);
+  CaptureIdIndexInit(index);
+}
+
+/** Slot of an ID in an index with room for it
+ */
+static uint32_t CaptureIdIndexSlot(const capture_id_index_t *index, uint32_t id)
+{
+  uint32_t slot = (id * 0x9E3779B1U) & (index->capacity - 1);
+  while ((index->values[slot] != CAPTURE_ID_FREE) && (index->ids[slot] != id))
+  {
+    slot = (slot + 1) & (index->capacity - 1);
+  }
+  return slot;
+}
+
+/** Doubles the number of slots of an ID index
+ */
+static bool CaptureIdIndexGrow(capture_id_index_t *index)
+{
+  capture_id_index_t grown;
+  uint32_t slot = 0;
+  uint32_t target = 0;
+
+  grown.capacity = (index->capacity == 0) ? CAPTURE_ID_INDEX_CAPACITY : (index->capacity * 2);
+  grown.count = index->count;
+  grown.ids = (uint32_t *) malloc(grown.capacity * sizeof(uint32_t));
+  grown.values = (uint32_t *) malloc(grown.capacity * sizeof(uint32_t));
+  if ((grown.ids == NULL) || (grown.values == NULL))
+  {
+    free(grown.ids);
+    free(grown.values);
+    return false;
+  }
+  memset(grown.values, 0xFF, grown.capacity * sizeof(uint32_t));
+  for (slot = 0; slot < index->capacity; slot++)
+  {
+    if (index->values[slot] != CAPTURE_ID_FREE)
+    {
+      target = CaptureIdIndexSlot(&grown, index->ids[slot]);
+      grown.ids[target] = index->ids[slot];
+      grown.values[target] = index->values[slot];
+    }
+  }
+  CaptureIdIndexFree(index);
+  *index = grown;
+  return true;
+}
+
+/** Finds the dense index of an ID, adding the ID when it is new
+ *  IDs get dense indexes in the order they are added, so a per-ID table is a plain array. A
+ *  standard and an extended ID with the same value are different IDs.
+ *  @param *index ID index
+ *  @param id Arbitration ID
+ *  @param ide Whether or not the ID is extended
+ *  @param *added Set to whether or not the ID was added
+ *  @return Dense index of the ID, UINT32_MAX when it could not be added
+ */
+uint32_t CaptureIdIndexFind(capture_id_index_t *index, uint32_t id, uint8_t ide, bool *added)
+{
+  uint32_t slot = 0;
+
+  id = ide ? (id | CAPTURE_ID_EXTENDED) : id;
+  *added = false;
+  if (index->capacity != 0)
+  {
+    slot = CaptureIdIndexSlot(index, id);
+    if (index->values[slot] != CAPTURE_ID_FREE)
+    {
+      return index->values[slot];
+    }
+  }
+  // keep the load under one half
+  if (((index->count + 1) * 2) > index->capacity)
+  {
+    if (!CaptureIdIndexGrow(index))
+    {
+      return CAPTURE_ID_FREE;
+    }
+    slot = CaptureIdIndexSlot(index, id);
+  }
+  index->ids[slot] = id;
+  index->values[slot] = index->count++;
+  *added = true;
+  return index->values[slot];
+}
+
+/** Dense index of an ID, without adding it
+ *  @param *index ID index
+ *  @param id Arbitration ID
+ *  @param ide Whether or not the ID is extended
+ *  @return Dense index of the ID, UINT32_MAX when it is not in the index
+ */
+uint32_t CaptureIdIndexGet(const capture_id_index_t *index, uint32_t id, uint8_t ide)
+{
+  if (index->capacity == 0)
+  {
+    return CAPTURE_ID_FREE;
+  }
+  return index->values[CaptureIdIndexSlot(index, ide ? (id | CAPTURE_ID_EXTENDED) : id)];
+}
+
+/** Writes an arbitration ID in hex the way the logs hold it (PrintCanId), extended IDs padded to
+ *  CAN_EXT_ID_DIGITS digits so they can be told from standard IDs
+ *  @param *text Text of at least CAPTURE_ID_TEXT_SIZE characters
+ *  @param id Arbitration ID
+ *  @param ide Whether or not the ID is extended
+ *  @return The text
+ */
+const char *CaptureFormatId(char *text, uint32_t id, uint8_t ide)
+{
+  snprintf(text, CAPTURE_ID_TEXT_SIZE, ide ? "%08lX" : "%lX", (unsigned long) id);
+  return text;
+}
@@ -0,0 +1,560 @@
+/*
+  * @file DiffMain.cpp
+  *
+  * Compares the traffic before and after a UDS attack: each file of a Before/After pair is
+  * read once (memory-mapped, CaptureScanLine) into per-ID statistics, then the report lists the
+  * IDs that appeared or vanished, IDs whose period changed and data bytes whose value
+  * distribution changed. A standard and an extended ID with the same value are different IDs,
+  * extended IDs are printed padded to 8 digits as in the logs.
+  *
+  * uds_logger_diff [-p period_pct] [-t distance_pct] [-q] before.txt after.txt
+  * uds_logger_diff [-p period_pct] [-t distance_pct] [-q] capture_dir
+  *
+  *   -p  smallest change of the mean period reported (percent, default 20)
+  *   -t  smallest distance between the byte value distributions reported (percent, default 25),
+  *       the distance is the total variation distance of the byte value histograms
+  *   -q  counts only, no ID lists
+  *
+  * Given a directory, every Before_UDS_Attack_N.txt below it is compared with the
+  * After_UDS_Attack_N.txt next to it.
+*/
+
+/* INCLUDES */
+#include <CaptureScan.h>
+#include <ftw.h>
+#include <limits.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* DEFINES */
+#define DIFF_DEFAULT_PERIOD_PCT       20        // Period change reported when -p is not given
+#define DIFF_DEFAULT_DISTANCE_PCT     25        // Distribution distance reported when -t is not given
+#define DIFF_MIN_FRAMES               4         // Frames an ID needs in both files before its period and bytes are compared
+#define DIFF_NUM_BINS                 256       // Histogram bins per data byte, one per value
+#define DIFF_MAX_NEW_VALUES           4         // New byte values listed per byte
+#define DIFF_BEFORE_PREFIX            "Before_UDS_Attack_"
+#define DIFF_AFTER_PREFIX             "After_UDS_Attack_"
+
+/* STRUCTS */
+typedef struct {
+  uint32_t id;                          // Arbitration ID
+  uint8_t ide;                          // ID Extended bit: 1 - extended (29 bit) ID, 0 - standard (11 bit) ID
+  uint32_t count;                       // Number of frames
+  uint32_t firstTimestamp;              // Timestamp of the first frame
+  uint32_t lastTimestamp;               // Timestamp of the last frame
+  uint32_t byteCount[8];                // Number of frames long enough to carry byte n
+  uint32_t histogram[8][DIFF_NUM_BINS]; // Number of frames with each value of byte n
+} diff_id_t;
+
+typedef struct {
+  const char *path;                     // Capture file
+  capture_id_index_t index;             // ID -> entry
+  diff_id_t *entries;                   // Entries in the order IDs were first seen
+  uint32_t capacity;                    // Number of entries allocated
+  uint32_t frames;                      // Number of frames
+  uint32_t malformed;                   // Number of frame lines that could not be parsed
+  uint32_t firstTimestamp;              // Timestamp of the first frame
+  uint32_t lastTimestamp;               // Timestamp of the last frame
+} diff_capture_t;
+
+typedef struct {
+  uint32_t id;                          // Arbitration ID
+  uint8_t ide;                          // ID Extended bit
+  uint32_t index;                       // Entry of the ID
+} diff_order_t;
+
+/* GLOBAL VARIABLES */
+static uint32_t s_PeriodPct = DIFF_DEFAULT_PERIOD_PCT;
+static uint32_t s_DistancePct = DIFF_DEFAULT_DISTANCE_PCT;
+static bool s_Quiet = false;
+static char **s_Pairs = NULL;           // Before file, After file, Before file, ...
+static uint32_t s_NumPaths = 0;
+static uint32_t s_PathsCapacity = 0;
+
+static uint64_t DiffNanos(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t) now.tv_sec * 1000000000ULL) + (uint64_t) now.tv_nsec;
+}
+
+static void DiffCaptureFree(diff_capture_t *capture)
+{
+  CaptureIdIndexFree(&capture->index);
+  free(capture->entries);
+  capture->entries = NULL;
+  capture->capacity = 0;
+}
+
+/** Adds one frame to the statistics of its ID
+ */
+static bool DiffAddFrame(diff_capture_t *capture, const can_message_t *message)
+{
+  diff_id_t *entries = NULL;
+  diff_id_t *entry = NULL;
+  bool added = false;
+  uint32_t capacity = 0;
+  uint32_t index = 0;
+  uint8_t byte = 0;
+
+  if (capture->index.count == capture->capacity)
+  {
+    // grown before the index takes a new ID, so every ID in the index has an entry
+    capacity = (capture->capacity == 0) ? CAPTURE_ID_INDEX_CAPACITY : (capture->capacity * 2);
+    entries = (diff_id_t *) realloc(capture->entries, capacity * sizeof(diff_id_t));
+    if (entries == NULL)
+    {
+      return false;
+    }
+    capture->entries = entries;
+    capture->capacity = capacity;
+  }
+  index = CaptureIdIndexFind(&capture->index, message->id, message->ide, &added);
+  if (index == UINT32_MAX)
+  {
+    return false;
+  }
+  entry = &capture->entries[index];
+  if (added)
+  {
+    memset(entry, 0, sizeof(diff_id_t));
+    entry->id = message->id;
+    entry->ide = message->ide;
+    entry->firstTimestamp = message->timestamp;
+  }
+  entry->count++;
+  entry->lastTimestamp = message->timestamp;
+  for (byte = 0; byte < message->len; byte++)
+  {
+    entry->byteCount[byte]++;
+    entry->histogram[byte][message->data[byte]]++;
+  }
+  return true;
+}
+
+/** Reads a capture file in one pass into per-ID statistics
+ */
+static bool DiffLoad(diff_capture_t *capture, const char *path)
+{
+  capture_map_t map;
+  can_message_t message;
+  const char *position = NULL;
+  const char *end = NULL;
+  const char *newline = NULL;
+
+  memset(capture, 0, sizeof(diff_capture_t));
+  capture->path = path;
+  CaptureIdIndexInit(&capture->index);
+  if (!CaptureMapFile(&map, path))
+  {
+    return false;
+  }
+  position = map.data;
+  end = map.data + map.size;
+  while (position < end)
+  {
+    newline = (const char *) memchr(position, '\n', end - position);
+    if (newline == NULL)
+    {
+      newline = end;
+    }
+    switch (CaptureScanLine(position, newline - position, &message))
+    {
+      case eCAPTURE_LINE_FRAME:
+      {
+        if (capture->frames == 0)
+        {
+          capture->firstTimestamp = message.timestamp;
+        }
+        capture->lastTimestamp = message.timestamp;
+        capture->frames++;
+        DiffAddFrame(capture, &message);
+        break;
+      }
+      case eCAPTURE_LINE_MALFORMED: { capture->malformed++; break; }
+      default: { break; }
+    }
+    position = newline + 1;
+  }
+  CaptureUnmapFile(&map);
+  return true;
+}
+
+/** Statistics of an ID in a capture
+ *  @return Entry, NULL when the ID is not in the capture
+ */
+static const diff_id_t *DiffFind(const diff_capture_t *capture, uint32_t id, uint8_t ide)
+{
+  uint32_t index = CaptureIdIndexGet(&capture->index, id, ide);
+  return (index == UINT32_MAX) ? NULL : &capture->entries[index];
+}
+
+/** Standard IDs first, then extended IDs, each in ID order
+ */
+static int DiffCompareOrder(const void *a, const void *b)
+{
+  const diff_order_t *first = (const diff_order_t *) a;
+  const diff_order_t *second = (const diff_order_t *) b;
+  if (first->ide != second->ide)
+  {
+    return (first->ide < second->ide) ? -1 : 1;
+  }
+  return (first->id < second->id) ? -1 : (first->id > second->id);
+}
+
+/** Entries of a capture in ID order
+ *  @return Array of capture->index.count entries, to be freed
+ */
+static diff_order_t *DiffSortIds(const diff_capture_t *capture)
+{
+  diff_order_t *order = (diff_order_t *) malloc((capture->index.count + 1) * sizeof(diff_order_t));
+  uint32_t index = 0;
+
+  if (order == NULL)
+  {
+    return NULL;
+  }
+  for (index = 0; index < capture->index.count; index++)
+  {
+    order[index].id = capture->entries[index].id;
+    order[index].ide = capture->entries[index].ide;
+    order[index].index = index;
+  }
+  qsort(order, capture->index.count, sizeof(diff_order_t), DiffCompareOrder);
+  return order;
+}
+
+/** Mean period of an ID (ms), 0 for an ID seen fewer than DIFF_MIN_FRAMES times
+ */
+static double DiffPeriod(const diff_id_t *entry)
+{
+  if ((entry->count < DIFF_MIN_FRAMES) || (entry->lastTimestamp <= entry->firstTimestamp))
+  {
+    return 0;
+  }
+  return (double)(entry->lastTimestamp - entry->firstTimestamp) / (entry->count - 1);
+}
+
+/** Total variation distance between the value histograms of one byte
+ *  @return Distance in percent, 0 the same distribution, 100 no value in common
+ */
+static uint32_t DiffDistance(const diff_id_t *before, const diff_id_t *after, uint8_t byte)
+{
+  double distance = 0;
+  double difference = 0;
+  uint32_t bin = 0;
+
+  for (bin = 0; bin < DIFF_NUM_BINS; bin++)
+  {
+    difference = ((double) before->histogram[byte][bin] / before->byteCount[byte]) -
+                 ((double) after->histogram[byte][bin] / after->byteCount[byte]);
+    distance += (difference < 0) ? -difference : difference;
+  }
+  return (uint32_t)((distance * 50.0) + 0.5);
+}
+
+/** Prints the IDs of one capture that are not in the other
+ *  @return Number of IDs
+ */
+static uint32_t DiffPrintMissing(const char *title, const diff_capture_t *from, const diff_order_t *order, const diff_capture_t *other)
+{
+  const diff_id_t *entry = NULL;
+  char id[CAPTURE_ID_TEXT_SIZE];
+  uint32_t index = 0;
+  uint32_t count = 0;
+  uint32_t column = 0;
+
+  for (index = 0; index < from->index.count; index++)
+  {
+    count += (DiffFind(other, order[index].id, order[index].ide) == NULL) ? 1 : 0;
+  }
+  printf("%-24s%lu\n", title, (unsigned long) count);
+  if (s_Quiet || (count == 0))
+  {
+    return count;
+  }
+  for (index = 0; index < from->index.count; index++)
+  {
+    entry = &from->entries[order[index].index];
+    if (DiffFind(other, entry->id, entry->ide) == NULL)
+    {
+      printf("%s%s (%lu)", "  ", CaptureFormatId(id, entry->id, entry->ide), (unsigned long) entry->count);
+      if (++column == 8)
+      {
+        printf("\n");
+        column = 0;
+      }
+    }
+  }
+  if (column != 0)
+  {
+    printf("\n");
+  }
+  return count;
+}
+
+/** Prints the IDs whose mean period changed by at least s_PeriodPct
+ *  @return Number of IDs
+ */
+static uint32_t DiffPrintPeriods(const diff_capture_t *before, const diff_order_t *order, const diff_capture_t *after)
+{
+  const diff_id_t *first = NULL;
+  const diff_id_t *second = NULL;
+  char id[CAPTURE_ID_TEXT_SIZE];
+  double periods[2] = {0, 0};
+  double change = 0;
+  uint32_t index = 0;
+  uint32_t count = 0;
+  uint8_t pass = 0;
+
+  // first pass counts, second pass prints
+  for (pass = 0; pass < (s_Quiet ? 1 : 2); pass++)
+  {
+    for (index = 0; index < before->index.count; index++)
+    {
+      first = &before->entries[order[index].index];
+      second = DiffFind(after, first->id, first->ide);
+      periods[0] = DiffPeriod(first);
+      periods[1] = (second == NULL) ? 0 : DiffPeriod(second);
+      if ((periods[0] == 0) || (periods[1] == 0))
+      {
+        continue;
+      }
+      change = ((periods[1] - periods[0]) * 100.0) / periods[0];
+      if (((change < 0) ? -change : change) < s_PeriodPct)
+      {
+        continue;
+      }
+      if (pass == 0)
+      {
+        count++;
+      }
+      else
+      {
+        printf("  %-10s %10.1f ms %10.1f ms %+8.0f%%\n", CaptureFormatId(id, first->id, first->ide), periods[0], periods[1],
+               change);
+      }
+    }
+    if (pass == 0)
+    {
+      printf("%-24s%lu\n", "Period changes:", (unsigned long) count);
+    }
+  }
+  return count;
+}
+
+/** Prints the data bytes whose value distribution moved by at least s_DistancePct
+ *  @return Number of bytes
+ */
+static uint32_t DiffPrintBytes(const diff_capture_t *before, const diff_order_t *order, const diff_capture_t *after)
+{
+  const diff_id_t *first = NULL;
+  const diff_id_t *second = NULL;
+  char values[(DIFF_MAX_NEW_VALUES * 3) + 4];
+  char id[CAPTURE_ID_TEXT_SIZE];
+  uint32_t distance = 0;
+  uint32_t newValues = 0;
+  uint32_t index = 0;
+  uint32_t count = 0;
+  uint32_t value = 0;
+  uint8_t byte = 0;
+  uint8_t pass = 0;
+
+  for (pass = 0; pass < (s_Quiet ? 1 : 2); pass++)
+  {
+    for (index = 0; index < before->index.count; index++)
+    {
+      first = &before->entries[order[index].index];
+      second = DiffFind(after, first->id, first->ide);
+      if (second == NULL)
+      {
+        continue;
+      }
+      for (byte = 0; byte < 8; byte++)
+      {
+        if ((first->byteCount[byte] < DIFF_MIN_FRAMES) || (second->byteCount[byte] < DIFF_MIN_FRAMES))
+        {
+          continue;
+        }
+        distance = DiffDistance(first, second, byte);
+        if (distance < s_DistancePct)
+        {
+          continue;
+        }
+        if (pass == 0)
+        {
+          count++;
+          continue;
+        }
+        values[0] = '\0';
+        newValues = 0;
+        for (value = 0; value < DIFF_NUM_BINS; value++)
+        {
+          if ((second->histogram[byte][value] != 0) && (first->histogram[byte][value] == 0))
+          {
+            if (newValues < DIFF_MAX_NEW_VALUES)
+            {
+              snprintf(&values[strlen(values)], sizeof(values) - strlen(values), " %02lX", (unsigned long) value);
+            }
+            newValues++;
+          }
+        }
+        printf("  %-10s byte %u %5lu%%   %3lu new values%s%s\n", CaptureFormatId(id, first->id, first->ide), byte,
+               (unsigned long) distance, (unsigned long) newValues, values, (newValues > DIFF_MAX_NEW_VALUES) ? " ..." : "");
+      }
+    }
+    if (pass == 0)
+    {
+      printf("%-24s%lu\n", "Byte changes:", (unsigned long) count);
+    }
+  }
+  return count;
+}
+
+/** Compares a Before and an After capture and prints the report
+ *  @return Whether or not both files were read
+ */
+static bool DiffPair(const char *beforePath, const char *afterPath)
+{
+  diff_capture_t before;
+  diff_capture_t after;
+  diff_order_t *beforeOrder = NULL;
+  diff_order_t *afterOrder = NULL;
+  uint64_t startNs = DiffNanos();
+  uint64_t loadNs = 0;
+  bool status = DiffLoad(&before, beforePath) && DiffLoad(&after, afterPath);
+
+  loadNs = DiffNanos() - startNs;
+  if (status)
+  {
+    printf("Before:                 %s, %lu frames, %lu IDs, %lu ms\n", before.path, (unsigned long) before.frames,
+           (unsigned long) before.index.count, (unsigned long)(before.lastTimestamp - before.firstTimestamp));
+    printf("After:                  %s, %lu frames, %lu IDs, %lu ms\n", after.path, (unsigned long) after.frames,
+           (unsigned long) after.index.count, (unsigned long)(after.lastTimestamp - after.firstTimestamp));
+    beforeOrder = DiffSortIds(&before);
+    afterOrder = DiffSortIds(&after);
+    status = (beforeOrder != NULL) && (afterOrder != NULL);
+  }
+  if (status)
+  {
+    DiffPrintMissing("Appeared:", &after, afterOrder, &before);
+    DiffPrintMissing("Vanished:", &before, beforeOrder, &after);
+    DiffPrintPeriods(&before, beforeOrder, &after);
+    DiffPrintBytes(&before, beforeOrder, &after);
+    printf("Time:                   %.3f ms read, %.3f ms total\n\n", loadNs / 1e6, (DiffNanos() - startNs) / 1e6);
+  }
+  else
+  {
+    fprintf(stderr, "cannot compare %s and %s\n", beforePath, afterPath);
+  }
+  free(beforeOrder);
+  free(afterOrder);
+  DiffCaptureFree(&before);
+  DiffCaptureFree(&after);
+  return status;
+}
+
+static bool DiffAddPath(const char *path)
+{
+  char **pairs = NULL;
+
+  if (s_NumPaths == s_PathsCapacity)
+  {
+    s_PathsCapacity = (s_PathsCapacity == 0) ? 64 : (s_PathsCapacity * 2);
+    pairs = (char **) realloc(s_Pairs, s_PathsCapacity * sizeof(char *));
+    if (pairs == NULL)
+    {
+      return false;
+    }
+    s_Pairs = pairs;
+  }
+  s_Pairs[s_NumPaths++] = strdup(path);
+  return true;
+}
+
+/** Adds a Before file and the After file next to it
+ */
+static int DiffAddEntry(const char *path, const struct stat *info, int flag, struct FTW *ftw)
+{
+  const char *name = path + ftw->base;
+  char after[PATH_MAX];
+  struct stat afterInfo;
+  (void) info;
+
+  if ((flag != FTW_F) || (strncmp(name, DIFF_BEFORE_PREFIX, strlen(DIFF_BEFORE_PREFIX)) != 0))
+  {
+    return 0;
+  }
+  snprintf(after, sizeof(after), "%.*s%s%s", ftw->base, path, DIFF_AFTER_PREFIX, name + strlen(DIFF_BEFORE_PREFIX));
+  if (stat(after, &afterInfo) != 0)
+  {
+    fprintf(stderr, "%s has no After file\n", path);
+    return 0;
+  }
+  return (DiffAddPath(path) && DiffAddPath(after)) ? 0 : 1;
+}
+
+static int DiffComparePaths(const void *a, const void *b)
+{
+  return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static void DiffUsage(const char *program)
+{
+  fprintf(stderr, "usage: %s [-p period_pct] [-t distance_pct] [-q] before.txt after.txt\n"
+                  "       %s [-p period_pct] [-t distance_pct] [-q] capture_dir\n", program, program);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t index = 0;
+  uint32_t failures = 0;
+  int option = 0;
+
+  while ((option = getopt(argc, argv, "p:t:q")) != -1)
+  {
+    switch (option)
+    {
+      case 'p': { s_PeriodPct = strtoul(optarg, NULL, 0); break; }
+      case 't': { s_DistancePct = strtoul(optarg, NULL, 0); break; }
+      case 'q': { s_Quiet = true; break; }
+      default:
+      {
+        DiffUsage(argv[0]);
+        return 1;
+      }
+    }
+  }
+  if ((argc - optind) == 2)
+  {
+    return DiffPair(argv[optind], argv[optind + 1]) ? 0 : 1;
+  }
+  if ((argc - optind) != 1)
+  {
+    DiffUsage(argv[0]);
+    return 1;
+  }
+  if (nftw(argv[optind], DiffAddEntry, 16, FTW_PHYS) != 0)
+  {
+    fprintf(stderr, "cannot read captures below %s\n", argv[optind]);
+    return 1;
+  }
+  if (s_NumPaths == 0)
+  {
+    fprintf(stderr, "no Before/After pairs below %s\n", argv[optind]);
+    return 1;
+  }
+  // a pair is sorted as one element, by its Before path
+  qsort(s_Pairs, s_NumPaths / 2, 2 * sizeof(char *), DiffComparePaths);
+  for (index = 0; index < s_NumPaths; index += 2)
+  {
+    if (!DiffPair(s_Pairs[index], s_Pairs[index + 1]))
+    {
+      failures++;
+    }
+  }
+  return (failures > 0) ? 1 : 0;
+}
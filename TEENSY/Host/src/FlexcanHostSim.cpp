@@ -0,0 +1,745 @@
+/*
+  * @file FlexcanHostSim.cpp
+  *
+  * Simulated FlexCAN0 register block and bus
+*/
+
+/* INCLUDES */
+#include <FlexcanHostBus.h>
+
+/* DEFINES */
+#define FLEXCAN_HOST_MB_BASE          0x80      // Offset of the first message buffer
+#define FLEXCAN_HOST_MB_END           0x480     // Offset past the last of the 64 message buffers
+#define FLEXCAN_HOST_MCR_RESET        0xD890000F  // MCR after a reset: disabled, frozen, halted
+#define FLEXCAN_HOST_FIFO_MB_END      0x100     // Offset past MB7, MB0 - 7 are the RX FIFO and its filter table (RFFN 0)
+
+#define REG(offset)                   (g_FlexcanHostRegisters[(offset) / 4].value)
+
+/* GLOBAL VARIABLES */
+FlexcanHostRegister g_FlexcanHostRegisters[FLEXCAN_HOST_REGISTER_SPACE / 4];
+
+static FLEXCAN_frame_t s_Fifo[FLEXCAN_HOST_FIFO_DEPTH];
+static uint8_t s_FifoHead = 0;
+static uint8_t s_FifoCount = 0;
+static FlexcanHostTxHandler s_TxHandler = NULL;
+static flexcan_host_stats_t s_Stats;
+static uint16_t s_TxErrors = 0;         // TX error counter, past 255 while bus off
+static uint16_t s_RxErrors = 0;         // RX error counter
+static bool s_BusOff = false;           // Whether or not the controller is bus off
+static uint64_t s_RecoveryDue = 0;      // Time (us) the controller has seen 128 x 11 recessive bits since going bus off
+static bool s_TxPaused = false;         // Whether or not TX mailboxes wait, as on a bus kept busy by other nodes
+static bool s_Transmitting = false;     // Whether or not the TX mailboxes are being sent, a mailbox loaded meanwhile joins the next arbitration
+static uint32_t s_BusBitRate = 0;       // Bit rate (bit/s) the other nodes send at, 0 for the one set in CTRL1
+
+/* Interrupt handlers implemented by the driver (vector table entries on the device) */
+void can0_message_isr(void);
+void can0_bus_off_isr(void);
+void can0_error_isr(void);
+void can0_tx_warn_isr(void);
+void can0_rx_warn_isr(void);
+
+static void FlexcanHostTransmitPending(void);
+
+/* Offsets of the registers the simulation acts on */
+static const uint32_t MCR_OFFSET = (uint32_t)((uintptr_t) &FLEXCAN0_MCR - FLEXCAN0_BASE);
+static const uint32_t IMASK1_OFFSET = (uint32_t)((uintptr_t) &FLEXCAN0_IMASK1 - FLEXCAN0_BASE);
+static const uint32_t IFLAG1_OFFSET = (uint32_t)((uintptr_t) &FLEXCAN0_IFLAG1 - FLEXCAN0_BASE);
+static const uint32_t IMASK2_OFFSET = (uint32_t)((uintptr_t) &FLEXCAN0_IMASK2 - FLEXCAN0_BASE);
+static const uint32_t IFLAG2_OFFSET = (uint32_t)((uintptr_t) &FLEXCAN0_IFLAG2 - FLEXCAN0_BASE);
+static const uint32_t CTRL1_OFFSET = (uint32_t)((uintptr_t) &FLEXCAN0_CTRL1 - FLEXCAN0_BASE);
+static const uint32_t ECR_OFFSET = (uint32_t)((uintptr_t) &FLEXCAN0_ECR - FLEXCAN0_BASE);
+static const uint32_t ESR1_OFFSET = (uint32_t)((uintptr_t) &FLEXCAN0_ESR1 - FLEXCAN0_BASE);
+static const uint32_t TIMER_OFFSET = (uint32_t)((uintptr_t) &FLEXCAN0_TIMER - FLEXCAN0_BASE);
+static const uint32_t RXFGMASK_OFFSET = (uint32_t)((uintptr_t) &FLEXCAN0_RXFGMASK - FLEXCAN0_BASE);
+static const uint32_t IDFLT_TAB_OFFSET = (uint32_t)((uintptr_t) &FLEXCAN0_IDFLT_TAB0 - FLEXCAN0_BASE);
+static const uint32_t RXIMR_OFFSET = (uint32_t)((uintptr_t) &FLEXCAN0_RXIMR0 - FLEXCAN0_BASE);
+
+/** Raises the message interrupt while a flag is set whose interrupt is enabled
+ */
+static void FlexcanHostUpdateIrq(void)
+{
+  if ((REG(IFLAG1_OFFSET) & REG(IMASK1_OFFSET)) || (REG(IFLAG2_OFFSET) & REG(IMASK2_OFFSET)))
+  {
+    HostIrqRaise(IRQ_CAN_MESSAGE);
+  }
+}
+
+/** Raises the error, warning and bus off interrupts whose ESR1 flag and CTRL1 mask are set
+ */
+static void FlexcanHostUpdateStatusIrq(void)
+{
+  uint32_t esr = REG(ESR1_OFFSET);
+  uint32_t ctrl = REG(CTRL1_OFFSET);
+
+  if ((esr & FLEXCAN_ESR_ERR_INT) && (ctrl & FLEXCAN_CTRL_ERR_MSK))
+  {
+    HostIrqRaise(IRQ_CAN_ERROR);
+  }
+  if ((esr & FLEXCAN_ESR_BOFF_INT) && (ctrl & FLEXCAN_CTRL_BOFF_MSK))
+  {
+    HostIrqRaise(IRQ_CAN_BUS_OFF);
+  }
+  if ((esr & FLEXCAN_ESR_TWRN_INT) && (ctrl & FLEXCAN_CTRL_TWRN_MSK))
+  {
+    HostIrqRaise(IRQ_CAN_TX_WARN);
+  }
+  if ((esr & FLEXCAN_ESR_RWRN_INT) && (ctrl & FLEXCAN_CTRL_RWRN_MSK))
+  {
+    HostIrqRaise(IRQ_CAN_RX_WARN);
+  }
+}
+
+/** Sets the fault confinement state and warning status bits of ESR1 from the error counters
+ */
+static void FlexcanHostUpdateFaultState(void)
+{
+  uint32_t esr = REG(ESR1_OFFSET) & ~(FLEXCAN_ESR_FLT_CONF_MASK | FLEXCAN_ESR_TX_WRN | FLEXCAN_ESR_RX_WRN);
+
+  if (s_BusOff)
+  {
+    esr |= FLEXCAN_ESR_FLT_CONF(FLEXCAN_FLT_BUS_OFF);
+  }
+  else if ((s_TxErrors > FLEXCAN_HOST_PASSIVE_LIMIT) || (s_RxErrors > FLEXCAN_HOST_PASSIVE_LIMIT))
+  {
+    esr |= FLEXCAN_ESR_FLT_CONF(FLEXCAN_FLT_ERROR_PASSIVE);
+  }
+  if (s_TxErrors >= FLEXCAN_HOST_WARNING_LIMIT)
+  {
+    esr |= FLEXCAN_ESR_TX_WRN;
+  }
+  if (s_RxErrors >= FLEXCAN_HOST_WARNING_LIMIT)
+  {
+    esr |= FLEXCAN_ESR_RX_WRN;
+  }
+  REG(ESR1_OFFSET) = esr;
+  REG(ECR_OFFSET) = ((uint32_t)(s_RxErrors & 0xFF) << 8) | (s_TxErrors > 0xFF ? 0xFF : s_TxErrors);
+}
+
+/** Gets the time (us, rounded up) of a number of bits at the bit rate set in CTRL1
+ *  @param bits Number of bits
+ *  @return Time (us)
+ */
+static uint64_t FlexcanHostBitsToMicros(uint32_t bits)
+{
+  return (((uint64_t) bits * FlexcanHostBitTimeNs()) + 999) / 1000;
+}
+
+/** Brings a bus off controller back once the recovery is due and allowed
+ *  Without BOFF_REC the recovery is due 128 x 11 recessive bits after going bus off. With it the
+ *  controller waits for BOFF_REC to be negated, and if that happens after the recovery bits went
+ *  by it still has to see 11 recessive bits to join the bus.
+ */
+static void FlexcanHostUpdateBusOff(void)
+{
+  uint64_t now = HostClockMicros();
+
+  if (!s_BusOff)
+  {
+    return;
+  }
+  if (REG(CTRL1_OFFSET) & FLEXCAN_CTRL_BOFF_REC)
+  {
+    return;
+  }
+  if (now < s_RecoveryDue)
+  {
+    return;
+  }
+
+  s_BusOff = false;
+  s_TxErrors = 0;
+  s_RxErrors = 0;
+  s_Stats.recoveries++;
+  s_Stats.recoveredAt = s_RecoveryDue;
+  FlexcanHostUpdateFaultState();
+
+  // mailboxes queued while bus off go out now
+  FlexcanHostTransmitPending();
+}
+
+/** Checks whether or not the controller takes part in bus traffic
+ *  @return False while the module is disabled, frozen or bus off
+ */
+static bool FlexcanHostOnBus(void)
+{
+  FlexcanHostUpdateBusOff();
+  return !s_BusOff && !(REG(MCR_OFFSET) & (FLEXCAN_MCR_MDIS | FLEXCAN_MCR_FRZ_ACK));
+}
+
+/** Checks a frame against one RX FIFO filter table element
+ *  @param *frame Frame on the bus
+ *  @param idam Format of the element (MCR IDAM): A one full ID, B two 14 bit IDs, C four 8 bit IDs
+ *  @param filter Filter table element
+ *  @param mask Bits of the element compared
+ *  @return Whether or not the frame matches the element
+ */
+static bool FlexcanHostFilterMatches(const FLEXCAN_frame_t *frame, uint32_t idam, uint32_t filter, uint32_t mask)
+{
+  uint32_t rtr = frame->rtr ? 1 : 0;
+  uint32_t ide = frame->ide ? 1 : 0;
+  uint32_t key = 0;
+  uint8_t shift = 0;
+
+  switch (idam)
+  {
+    case 0:
+    {
+      key = (rtr << 31) | (ide << 30) | (ide ? ((frame->id & FLEXCAN_MB_ID_EXT_MASK) << 1) : ((frame->id & 0x7FF) << 19));
+      return ((key ^ filter) & mask) == 0;
+    }
+    case 1:
+    {
+      key = (rtr << 15) | (ide << 14) | (ide ? ((frame->id >> 15) & 0x3FFF) : ((frame->id & 0x7FF) << 3));
+      for (shift = 0; shift <= 16; shift += 16)
+      {
+        if ((((key << shift) ^ filter) & (mask & (0xFFFFUL << shift))) == 0)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+    case 2:
+    {
+      key = ide ? ((frame->id >> 21) & 0xFF) : ((frame->id >> 3) & 0xFF);
+      for (shift = 0; shift <= 24; shift += 8)
+      {
+        if ((((key << shift) ^ filter) & (mask & (0xFFUL << shift))) == 0)
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+    default:
+    {
+      return false; // format D rejects every frame
+    }
+  }
+}
+
+/** Checks a frame against the RX FIFO filter table (MB6 - 7 with RFFN 0)
+ *  Every element has its own mask (RXIMRn) with MCR IRMQ, RXFGMASK is shared otherwise
+ *  @param *frame Frame on the bus
+ *  @return Whether or not any element accepts the frame
+ */
+static bool FlexcanHostFifoAccepts(const FLEXCAN_frame_t *frame)
+{
+  uint32_t mcr = REG(MCR_OFFSET);
+  uint32_t idam = (mcr & FLEXCAN_MCR_IDAM_MASK) >> FLEXCAN_MCR_IDAM_BIT_NO;
+  uint32_t mask = 0;
+  uint8_t n = 0;
+
+  for (n = 0; n < FLEXCAN_NUM_FIFO_FILTERS; n++)
+  {
+    mask = (mcr & FLEXCAN_MCR_IRMQ) ? REG(RXIMR_OFFSET + (n * 4)) : REG(RXFGMASK_OFFSET);
+    if (FlexcanHostFilterMatches(frame, idam, REG(IDFLT_TAB_OFFSET + (n * 4)), mask))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Copies the oldest frame of the RX FIFO into the FIFO output mailbox (MB0)
+ */
+static void FlexcanHostLoadFifoOutput(void)
+{
+  FLEXCAN_frame_t *frame = &s_Fifo[s_FifoHead];
+  uint32_t cs = FLEXCAN_MB_CS_LENGTH(frame->dlc) | (REG(TIMER_OFFSET) & 0xFFFF);
+
+  if (frame->ide)
+  {
+    cs |= FLEXCAN_MB_CS_IDE | FLEXCAN_MB_CS_SRR;
+    REG(FLEXCAN_HOST_MB_BASE + 4) = frame->id & FLEXCAN_MB_ID_EXT_MASK;
+  }
+  else
+  {
+    REG(FLEXCAN_HOST_MB_BASE + 4) = FLEXCAN_MB_ID_IDSTD(frame->id);
+  }
+  if (frame->rtr)
+  {
+    cs |= FLEXCAN_MB_CS_RTR;
+  }
+  REG(FLEXCAN_HOST_MB_BASE) = cs;
+  REG(FLEXCAN_HOST_MB_BASE + 8) = ((uint32_t) frame->data[0] << 24) | ((uint32_t) frame->data[1] << 16) | ((uint32_t) frame->data[2] << 8) | frame->data[3];
+  REG(FLEXCAN_HOST_MB_BASE + 12) = ((uint32_t) frame->data[4] << 24) | ((uint32_t) frame->data[5] << 16) | ((uint32_t) frame->data[6] << 8) | frame->data[7];
+  REG(IFLAG1_OFFSET) |= FLEXCAN_IMASK1_BUF5M;
+}
+
+/** Removes the frame in the FIFO output mailbox, the CPU has acknowledged it
+ */
+static void FlexcanHostPopFifo(void)
+{
+  if (s_FifoCount == 0)
+  {
+    return;
+  }
+  s_FifoHead = (s_FifoHead + 1) % FLEXCAN_HOST_FIFO_DEPTH;
+  s_FifoCount--;
+  if (s_FifoCount > 0)
+  {
+    FlexcanHostLoadFifoOutput();
+  }
+}
+
+/** Sends the frame written to a TX mailbox
+ *  Transmission completes immediately: the mailbox goes back to inactive and its flag is set
+ *  @param mb Mailbox number
+ */
+static void FlexcanHostTransmit(uint8_t mb)
+{
+  uint32_t offset = FLEXCAN_HOST_MB_BASE + (mb * 0x10);
+  uint32_t cs = REG(offset);
+  uint32_t id = REG(offset + 4);
+  uint32_t word0 = REG(offset + 8);
+  uint32_t word1 = REG(offset + 12);
+  FLEXCAN_frame_t frame;
+
+  memset(&frame, 0, sizeof(frame));
+  frame.ide = (cs & FLEXCAN_MB_CS_IDE) ? 1 : 0;
+  frame.srr = (cs & FLEXCAN_MB_CS_SRR) ? 1 : 0;
+  frame.rtr = (cs & FLEXCAN_MB_CS_RTR) ? 1 : 0;
+  frame.dlc = FLEXCAN_get_length(cs);
+  frame.id = frame.ide ? (id & FLEXCAN_MB_ID_EXT_MASK) : ((id >> FLEXCAN_MB_ID_STD_BIT_NO) & 0x7FF);
+  frame.data[0] = word0 >> 24;
+  frame.data[1] = word0 >> 16;
+  frame.data[2] = word0 >> 8;
+  frame.data[3] = word0;
+  frame.data[4] = word1 >> 24;
+  frame.data[5] = word1 >> 16;
+  frame.data[6] = word1 >> 8;
+  frame.data[7] = word1;
+
+  s_Stats.framesTransmitted++;
+  if (s_TxErrors > 0)
+  {
+    s_TxErrors--;
+    FlexcanHostUpdateFaultState();
+  }
+  if (s_TxHandler != NULL)
+  {
+    s_TxHandler(&frame);
+  }
+  REG(offset) = (cs & ~FLEXCAN_MB_CS_CODE_MASK) | FLEXCAN_MB_CS_CODE(FLEXCAN_MB_CODE_TX_INACTIVE);
+  if (mb < 32)
+  {
+    REG(IFLAG1_OFFSET) |= (1UL << mb);
+  }
+  else
+  {
+    REG(IFLAG2_OFFSET) |= (1UL << (mb - 32));
+  }
+  FlexcanHostUpdateIrq();
+}
+
+/** Sends the TX mailboxes waiting for the bus, one at a time by arbitration: lowest ID first
+ *  (lowest mailbox number on a tie), or lowest mailbox number first with CTRL1 LBUF. Each
+ *  completion interrupt runs before the next arbitration unless this runs in an interrupt;
+ *  a mailbox it loads again is sent by the arbitration already running, not from inside it.
+ */
+static void FlexcanHostTransmitPending(void)
+{
+  uint32_t cs = 0;
+  uint32_t id = 0;
+  uint32_t key = 0;
+  uint32_t bestKey = 0;
+  int best = 0;
+  int mb = 0;
+
+  if (s_Transmitting)
+  {
+    return;
+  }
+  s_Transmitting = true;
+  while (FlexcanHostOnBus() && !s_TxPaused && !(REG(CTRL1_OFFSET) & FLEXCAN_CTRL_LOM)) // nothing is sent in listen only mode
+  {
+    best = -1;
+    for (mb = 0; mb < 64; mb++)
+    {
+      cs = REG(FLEXCAN_HOST_MB_BASE + (mb * 0x10));
+      if (((cs & FLEXCAN_MB_CS_CODE_MASK) >> 24) != FLEXCAN_MB_CODE_TX_ONCE)
+      {
+        continue;
+      }
+      // base ID, then IDE so a standard frame wins over an extended one with the same base ID, then the extended bits
+      id = REG(FLEXCAN_HOST_MB_BASE + (mb * 0x10) + 4);
+      key = (((id >> 18) & 0x7FF) << 19) | ((cs & FLEXCAN_MB_CS_IDE) ? ((1UL << 18) | (id & 0x3FFFF)) : 0);
+      key = (REG(CTRL1_OFFSET) & FLEXCAN_CTRL_LBUF) ? (uint32_t) mb : key;
+      if ((best < 0) || (key < bestKey))
+      {
+        best = mb;
+        bestKey = key;
+      }
+    }
+    if (best < 0)
+    {
+      break;
+    }
+    FlexcanHostTransmit(best);
+  }
+  s_Transmitting = false;
+}
+
+/** Handles a write to the control/status word of a message buffer
+ *  @param mb Mailbox number
+ *  @param value Value written
+ */
+static void FlexcanHostWriteMailboxCs(uint8_t mb, uint32_t value)
+{
+  uint32_t offset = FLEXCAN_HOST_MB_BASE + (mb * 0x10);
+  uint32_t code = (value & FLEXCAN_MB_CS_CODE_MASK) >> 24;
+  uint32_t current = (REG(offset) & FLEXCAN_MB_CS_CODE_MASK) >> 24;
+
+  if (code == FLEXCAN_MB_CODE_TX_ABORT)
+  {
+    // a mailbox already sent keeps its code, one still waiting for the bus takes the abort code; either way the flag is set
+    if (current != FLEXCAN_MB_CODE_TX_ONCE)
+    {
+      value = (value & ~FLEXCAN_MB_CS_CODE_MASK) | (REG(offset) & FLEXCAN_MB_CS_CODE_MASK);
+    }
+    REG(offset) = value;
+    if (mb < 32)
+    {
+      REG(IFLAG1_OFFSET) |= (1UL << mb);
+    }
+    else
+    {
+      REG(IFLAG2_OFFSET) |= (1UL << (mb - 32));
+    }
+    FlexcanHostUpdateIrq();
+    return;
+  }
+  REG(offset) = value;
+  if (code == FLEXCAN_MB_CODE_TX_ONCE)
+  {
+    FlexcanHostTransmitPending(); // arbitrates against the other loaded mailboxes
+  }
+}
+
+/** Resets the register block to its reset values, the RX FIFO is emptied
+ */
+static void FlexcanHostResetRegisters(void)
+{
+  uint32_t index = 0;
+  for (index = 0; index < (FLEXCAN_HOST_REGISTER_SPACE / 4); index++)
+  {
+    g_FlexcanHostRegisters[index].value = 0;
+  }
+  REG(MCR_OFFSET) = FLEXCAN_HOST_MCR_RESET;
+  s_FifoHead = 0;
+  s_FifoCount = 0;
+  s_TxErrors = 0;
+  s_RxErrors = 0;
+  s_BusOff = false;
+}
+
+/** Reads a simulated register
+ *  @param offset Offset of the register in the register block
+ *  @return Register value
+ */
+uint32_t FlexcanHostRead(uint32_t offset)
+{
+  uint32_t value = 0;
+
+  if (offset == TIMER_OFFSET)
+  {
+    REG(TIMER_OFFSET) = micros() & 0xFFFF; // free running timer, one tick per bit at 1 Mbit/s
+  }
+  else if ((offset == ESR1_OFFSET) || (offset == ECR_OFFSET))
+  {
+    FlexcanHostUpdateBusOff();
+  }
+  value = REG(offset);
+  if (offset == ESR1_OFFSET)
+  {
+    // reading ESR1 clears the error bits
+    REG(offset) &= ~(FLEXCAN_ESR_STF_ERR | FLEXCAN_ESR_FRM_ERR | FLEXCAN_ESR_CRC_ERR | FLEXCAN_ESR_ACK_ERR | FLEXCAN_ESR_BIT0_ERR | FLEXCAN_ESR_BIT1_ERR);
+  }
+  return value;
+}
+
+/** Writes a simulated register
+ *  @param offset Offset of the register in the register block
+ *  @param value Value written
+ */
+void FlexcanHostWrite(uint32_t offset, uint32_t value)
+{
+  uint32_t cleared = 0;
+
+  if (offset == MCR_OFFSET)
+  {
+    if (value & FLEXCAN_MCR_SOFT_RST)
+    {
+      FlexcanHostResetRegisters();
+      return;
+    }
+    // freeze mode is acknowledged once the module is enabled, halted and frozen
+    value &= ~(FLEXCAN_MCR_FRZ_ACK | FLEXCAN_MCR_NOT_RDY | FLEXCAN_MCR_LPM_ACK);
+    if (value & FLEXCAN_MCR_MDIS)
+    {
+      value |= FLEXCAN_MCR_NOT_RDY | FLEXCAN_MCR_LPM_ACK;
+    }
+    else if ((value & FLEXCAN_MCR_FRZ) && (value & FLEXCAN_MCR_HALT))
+    {
+      value |= FLEXCAN_MCR_FRZ_ACK | FLEXCAN_MCR_NOT_RDY;
+    }
+    REG(offset) = value;
+    FlexcanHostTransmitPending(); // mailboxes loaded while frozen or listening only go out once the controller is back on the bus
+  }
+  else if (offset == IFLAG1_OFFSET)
+  {
+    // write 1 to clear, acknowledging the FIFO available flag releases the FIFO output
+    cleared = REG(offset) & value;
+    REG(offset) &= ~value;
+    if ((cleared & FLEXCAN_IMASK1_BUF5M) && (REG(MCR_OFFSET) & FLEXCAN_MCR_FEN))
+    {
+      FlexcanHostPopFifo();
+    }
+    FlexcanHostUpdateIrq();
+  }
+  else if (offset == IFLAG2_OFFSET)
+  {
+    REG(offset) &= ~value;
+    FlexcanHostUpdateIrq();
+  }
+  else if ((offset == IMASK1_OFFSET) || (offset == IMASK2_OFFSET))
+  {
+    REG(offset) = value;
+    FlexcanHostUpdateIrq();
+  }
+  else if (offset == ESR1_OFFSET)
+  {
+    REG(offset) &= ~(value & (FLEXCAN_ESR_ERR_INT | FLEXCAN_ESR_BOFF_INT | FLEXCAN_ESR_TWRN_INT | FLEXCAN_ESR_RWRN_INT)); // interrupt bits are write 1 to clear
+  }
+  else if (offset == CTRL1_OFFSET)
+  {
+    // negating BOFF_REC after the recovery bits went by still takes 11 recessive bits to join the bus
+    if (s_BusOff && (REG(offset) & FLEXCAN_CTRL_BOFF_REC) && !(value & FLEXCAN_CTRL_BOFF_REC) && (HostClockMicros() >= s_RecoveryDue))
+    {
+      s_RecoveryDue = HostClockMicros() + FlexcanHostBitsToMicros(FLEXCAN_HOST_RESYNC_BITS);
+    }
+    REG(offset) = value;
+    FlexcanHostUpdateBusOff();
+  }
+  else if ((offset >= FLEXCAN_HOST_MB_BASE) && (offset < FLEXCAN_HOST_MB_END) && (((offset - FLEXCAN_HOST_MB_BASE) % 0x10) == 0) &&
+           !((REG(MCR_OFFSET) & FLEXCAN_MCR_FEN) && (offset < FLEXCAN_HOST_FIFO_MB_END))) // the filter table is not a mailbox
+  {
+    FlexcanHostWriteMailboxCs((offset - FLEXCAN_HOST_MB_BASE) / 0x10, value);
+  }
+  else if (offset < FLEXCAN_HOST_REGISTER_SPACE)
+  {
+    REG(offset) = value;
+  }
+}
+
+/* ========================================================================= */
+/* Bus                                                                       */
+/* ========================================================================= */
+
+/** Checks whether or not the bit rate set in CTRL1 is close enough to the one of the bus to receive
+ *  @return Whether or not the bit rates are within FLEXCAN_HOST_RATE_TOLERANCE of each other
+ */
+static bool FlexcanHostBitRateMatches(void)
+{
+  uint32_t ctrl = REG(CTRL1_OFFSET);
+  uint64_t divider = (uint64_t)(((ctrl >> 24) & 0xFF) + 1) *
+                     (1 + ((ctrl & 0x7) + 1) + (((ctrl >> 19) & 0x7) + 1) + (((ctrl >> 16) & 0x7) + 1));
+  uint64_t rate = (uint64_t) s_BusBitRate * divider; // bus bit rate, scaled by the divider like the clock
+  uint64_t clock = FLEXCAN_HOST_CLOCK_HZ;
+
+  if (s_BusBitRate == 0)
+  {
+    return true;
+  }
+  return ((clock > rate) ? (clock - rate) : (rate - clock)) * 1000 <= rate * FLEXCAN_HOST_RATE_TOLERANCE;
+}
+
+/** Resets the controller and the bus statistics, and attaches the driver's message interrupt
+ */
+void FlexcanHostReset(void)
+{
+  FlexcanHostResetRegisters();
+  memset(&s_Stats, 0, sizeof(s_Stats));
+  s_TxPaused = false;
+  s_Transmitting = false;
+  s_BusBitRate = 0;
+  HostIrqAttach(IRQ_CAN_MESSAGE, can0_message_isr);
+  HostIrqAttach(IRQ_CAN_BUS_OFF, can0_bus_off_isr);
+  HostIrqAttach(IRQ_CAN_ERROR, can0_error_isr);
+  HostIrqAttach(IRQ_CAN_TX_WARN, can0_tx_warn_isr);
+  HostIrqAttach(IRQ_CAN_RX_WARN, can0_rx_warn_isr);
+}
+
+/** Puts a frame on the bus for the controller to receive
+ *  The frame goes into the RX FIFO and the message interrupt runs right away unless it is masked
+ *  @param *frame Frame on the bus
+ *  A frame sent at another bit rate than the one set in CTRL1 (FlexcanHostSetBusBitRate) is not
+ *  received, it is a receive error
+ *  @param *frame Frame on the bus
+ *  @return Whether or not the frame was received (false if the FIFO was full, no filter accepted it, it was sent at another bit rate or the controller was off the bus)
+ */
+bool FlexcanHostReceive(const FLEXCAN_frame_t *frame)
+{
+  s_Stats.framesOffered++;
+  if (!FlexcanHostOnBus() || !(REG(MCR_OFFSET) & FLEXCAN_MCR_FEN))
+  {
+    s_Stats.framesIgnored++;
+    return false;
+  }
+  if (!FlexcanHostBitRateMatches())
+  {
+    s_Stats.framesMisread++;
+    FlexcanHostBusError(false, 1);
+    return false;
+  }
+  if (!FlexcanHostFifoAccepts(frame))
+  {
+    s_Stats.framesFiltered++;
+    return false;
+  }
+  if (s_FifoCount == FLEXCAN_HOST_FIFO_DEPTH)
+  {
+    s_Stats.fifoOverflows++;
+    REG(IFLAG1_OFFSET) |= (1UL << FLEXCAN_INT_FIFO_OVERFLOW);
+    FlexcanHostUpdateIrq();
+    return false;
+  }
+
+  memcpy(&s_Fifo[(s_FifoHead + s_FifoCount) % FLEXCAN_HOST_FIFO_DEPTH], frame, sizeof(FLEXCAN_frame_t));
+  s_FifoCount++;
+  s_Stats.framesReceived++;
+  if (s_RxErrors > FLEXCAN_HOST_PASSIVE_LIMIT)
+  {
+    s_RxErrors = FLEXCAN_HOST_PASSIVE_LIMIT - 8; // back to error active somewhere between 119 and 127
+    FlexcanHostUpdateFaultState();
+  }
+  else if (s_RxErrors > 0)
+  {
+    s_RxErrors--;
+    FlexcanHostUpdateFaultState();
+  }
+  if (s_FifoCount == 1)
+  {
+    FlexcanHostLoadFifoOutput();
+  }
+  if (s_FifoCount == FLEXCAN_HOST_FIFO_WARNING)
+  {
+    REG(IFLAG1_OFFSET) |= (1UL << FLEXCAN_INT_FIFO_WARNING);
+  }
+  FlexcanHostUpdateIrq();
+  return true;
+}
+
+/** Gets the number of frames waiting in the RX FIFO
+ *  @return Number of frames, including the one in the FIFO output mailbox
+ */
+uint8_t FlexcanHostFifoCount(void)
+{
+  return s_FifoCount;
+}
+
+/** Sets the callback that receives every transmitted frame
+ *  @param handler Callback, NULL to discard transmitted frames
+ */
+void FlexcanHostSetTxHandler(FlexcanHostTxHandler handler)
+{
+  s_TxHandler = handler;
+}
+
+/** Gets the bus statistics
+ *  @param *stats Statistics to be set
+ */
+void FlexcanHostGetStats(flexcan_host_stats_t *stats)
+{
+  memcpy(stats, &s_Stats, sizeof(flexcan_host_stats_t));
+}
+
+/** Injects bus errors seen by the controller
+ *  A transmit error adds 8 to the TX error counter, a receive error 1 to the RX error counter, neither
+ *  changes in listen only mode.
+ *  The error, warning and bus off flags are set as the counters cross their limits. Errors while
+ *  the controller is off the bus are not seen.
+ *  @param transmitting Whether the errors hit frames the controller was transmitting (bit errors) or receiving (stuff errors)
+ *  @param count Number of errors
+ */
+void FlexcanHostBusError(bool transmitting, uint16_t count)
+{
+  uint32_t esr = 0;
+  bool txWarning = s_TxErrors >= FLEXCAN_HOST_WARNING_LIMIT;
+  bool rxWarning = s_RxErrors >= FLEXCAN_HOST_WARNING_LIMIT;
+
+  while ((count > 0) && FlexcanHostOnBus())
+  {
+    s_Stats.busErrors++;
+    if (REG(CTRL1_OFFSET) & FLEXCAN_CTRL_LOM)
+    {
+      esr |= FLEXCAN_ESR_STF_ERR | FLEXCAN_ESR_ERR_INT; // counters are frozen in listen only mode, which never transmits
+    }
+    else if (transmitting)
+    {
+      s_TxErrors += 8;
+      esr |= FLEXCAN_ESR_BIT0_ERR | FLEXCAN_ESR_ERR_INT;
+    }
+    else
+    {
+      if (s_RxErrors <= FLEXCAN_HOST_PASSIVE_LIMIT)
+      {
+        s_RxErrors++;
+      }
+      esr |= FLEXCAN_ESR_STF_ERR | FLEXCAN_ESR_ERR_INT;
+    }
+    if (s_TxErrors > FLEXCAN_HOST_BUS_OFF_LIMIT)
+    {
+      s_BusOff = true;
+          s_Stats.busOffs++;
+      s_Stats.busOffAt = HostClockMicros();
+      s_RecoveryDue = s_Stats.busOffAt + FlexcanHostBitsToMicros(FLEXCAN_BUS_OFF_RECOVERY_BITS);
+      esr |= FLEXCAN_ESR_BOFF_INT;
+    }
+    count--;
+  }
+  if (REG(MCR_OFFSET) & FLEXCAN_MCR_WRN_EN)
+  {
+    if (!txWarning && (s_TxErrors >= FLEXCAN_HOST_WARNING_LIMIT))
+    {
+      esr |= FLEXCAN_ESR_TWRN_INT;
+    }
+    if (!rxWarning && (s_RxErrors >= FLEXCAN_HOST_WARNING_LIMIT))
+    {
+      esr |= FLEXCAN_ESR_RWRN_INT;
+    }
+  }
+  REG(ESR1_OFFSET) |= esr;
+  FlexcanHostUpdateFaultState();
+  FlexcanHostUpdateStatusIrq();
+}
+
+/** Gets the bit time set in CTRL1
+ *  @return Bit time (ns) of the protocol engine clock
+ */
+uint32_t FlexcanHostBitTimeNs(void)
+{
+  uint32_t ctrl = REG(CTRL1_OFFSET);
+  uint32_t presdiv = ((ctrl >> 24) & 0xFF) + 1;
+  uint32_t quanta = 1 + ((ctrl & 0x7) + 1) + (((ctrl >> 19) & 0x7) + 1) + (((ctrl >> 16) & 0x7) + 1);
+
+  return (uint32_t)(((uint64_t) presdiv * quanta * 1000000000ULL) / FLEXCAN_HOST_CLOCK_HZ);
+}
+
+/** Holds the TX mailboxes, as on a bus kept busy by other nodes, or lets them go out again
+ *  @param paused Whether or not loaded TX mailboxes wait; when released they go out in arbitration order
+ */
+void FlexcanHostSetTxPaused(bool paused)
+{
+  s_TxPaused = paused;
+  FlexcanHostTransmitPending();
+}
+
+/** Sets the bit rate the other nodes on the bus send at
+ *  @param bitRate Bit rate (bit/s), 0 for the one set in CTRL1 (frames are always received)
+ */
+void FlexcanHostSetBusBitRate(uint32_t bitRate)
+{
+  s_BusBitRate = bitRate;
+}
@@ -0,0 +1,419 @@
+/*
+  * @file HostMain.cpp
+  *
+  * Runs the logger sketch on the host in virtual time: background traffic and a diagnostic
+  * attack are put on the simulated bus, attack files are written below the SD root directory.
+  *
+  * uds_logger_host [-d sd_root] [-n frames] [-r frames_per_second] [-b bit_rate] [-F]
+  *                 [-a attack_start_ms] [-l attack_length_ms] [-s seed] [-q]
+  *                 [-E card_out_ms:card_out_length_ms] [-B bus_off_ms] [-R holdoff_ms] [-W close_us]
+  *
+  * Background traffic is random frames at a fixed rate (-r), or with -b the vehicle traffic
+  * model at that bit rate, timed by the bit-time of every frame. -F fills the bus to 100% load.
+  * -E pulls the SD card for a while, the logger has to recover it without losing a session.
+  * -B makes every frame a failed transmission from then on until the controller is bus off, it
+  * has to come back no sooner than the spec allows and no later than the recovery policy says;
+  * -R holds it off the bus for that long first. -W makes every SD file close take that long, as
+  * a card writing out its buffers does; the CAN interrupt has to keep up meanwhile, so the RX
+  * FIFO must not overflow.
+*/
+
+/* INCLUDES */
+#include <UDSLoggerHost.h>
+#include <getopt.h>
+#include <time.h>
+
+/* DEFINES */
+#define HOST_DEFAULT_FRAMES           20000     // Number of frames put on the bus
+#define HOST_DEFAULT_RATE             2000      // Bus load (frames/s)
+#define HOST_DEFAULT_ATTACK_START     2000      // Time (ms) of the first diagnostic request
+#define HOST_DEFAULT_ATTACK_LENGTH    1000      // Time (ms) the attack lasts
+#define HOST_ATTACK_PERIOD            100       // Time (ms) between diagnostic requests
+#define HOST_MIN_BACKGROUND_ID        0x100     // Lowest ID of generated background traffic
+#define HOST_MAX_BACKGROUND_ID        0x6FF     // Highest ID of generated background traffic
+#define HOST_PENDING_CAPACITY         8         // Number of diagnostic frames waiting for the bus
+#define HOST_DRAIN_LIMIT              60000     // Time (ms) after the traffic ends before giving up on open sessions
+#define HOST_DEFAULT_SEED             1         // Seed of the traffic model when -s is not given
+#define HOST_LOOP_PERIOD              10000     // Time (us) of a main loop pass, the longest the logger may take to notice a recovery or end a hold-off
+
+/* STRUCTS */
+typedef struct {
+  uint32_t id;                          // Arbitration ID
+  uint8_t dlc;                          // Data length code
+  uint8_t data[8];                      // Payload
+} host_script_frame_t;
+
+/* CONSTANTS */
+/* One diagnostic exchange per period on two ID pairs, so two attack sessions overlap */
+const host_script_frame_t HostAttackScript[] =
+{
+  {0x745, 8, {0x02, 0x10, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00}},   // DiagnosticSessionControl
+  {0x765, 8, {0x02, 0x50, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00}},
+  {0x7E0, 8, {0x02, 0x3E, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00}},   // TesterPresent
+  {0x7E8, 8, {0x02, 0x7E, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00}}
+};
+
+const uint8_t HOST_SCRIPT_LENGTH = sizeof(HostAttackScript) / sizeof(HostAttackScript[0]);
+
+/* GLOBAL VARIABLES */
+static IntervalTimer s_BusTimer;
+static uint32_t s_FramesToSend = HOST_DEFAULT_FRAMES;
+static uint32_t s_FramesSent = 0;
+static uint32_t s_AttackStart = HOST_DEFAULT_ATTACK_START;
+static uint32_t s_AttackLength = HOST_DEFAULT_ATTACK_LENGTH;
+static uint32_t s_NextAttack = 0;
+static FLEXCAN_frame_t s_Pending[HOST_PENDING_CAPACITY];
+static uint8_t s_PendingCount = 0;
+static bool s_UseTrafficModel = false;
+static traffic_model_t s_Traffic;
+static FLEXCAN_frame_t s_TrafficFrame;  // Frame on the bus, received when it ends
+static uint64_t s_TrafficStartUs = 0;   // Host time of the start of the traffic model
+static uint32_t s_CardOutStart = 0;     // Time (ms) the SD card is pulled
+static uint32_t s_CardOutLength = 0;    // Time (ms) the SD card stays out, 0 for never
+static uint32_t s_BusOffAt = 0;         // Time (ms) the transmissions start failing, 0 for never
+
+/** Queues the diagnostic exchange of the attack script, in the traffic model it arbitrates
+ *  for the bus with the other due frames
+ */
+static void HostQueueAttack(void)
+{
+  FLEXCAN_frame_t frame;
+  uint8_t index = 0;
+
+  for (index = 0; index < HOST_SCRIPT_LENGTH; index++)
+  {
+    memset(&frame, 0, sizeof(FLEXCAN_frame_t));
+    frame.id = HostAttackScript[index].id;
+    frame.dlc = HostAttackScript[index].dlc;
+    memcpy(frame.data, HostAttackScript[index].data, sizeof(frame.data));
+    if (s_UseTrafficModel)
+    {
+      TrafficQueueFrame(&s_Traffic, &frame, (HostClockMicros() - s_TrafficStartUs) * 1000);
+    }
+    else if (s_PendingCount < HOST_PENDING_CAPACITY)
+    {
+      memcpy(&s_Pending[s_PendingCount++], &frame, sizeof(FLEXCAN_frame_t));
+    }
+  }
+}
+
+/** Queues the attack script while the attack lasts
+ */
+static void HostRunAttack(void)
+{
+  uint32_t current = millis();
+  if ((current >= s_NextAttack) && (current < (s_AttackStart + s_AttackLength)))
+  {
+    HostQueueAttack();
+    s_NextAttack += HOST_ATTACK_PERIOD;
+  }
+}
+
+/** Pulls the SD card and puts it back at the times given with -E
+ */
+static void HostUpdateCard(void)
+{
+  uint32_t current = millis();
+  if (s_CardOutLength > 0)
+  {
+    SdFatHostSetCardPresent((current < s_CardOutStart) || (current >= (s_CardOutStart + s_CardOutLength)));
+  }
+}
+
+/** Turns the frame slot into a failed transmission from the time given with -B until the
+ *  controller is bus off
+ *  @return Whether or not the slot carried a bus error instead of a frame
+ */
+static bool HostInjectBusError(void)
+{
+  flexcan_host_stats_t stats;
+
+  if ((s_BusOffAt == 0) || (millis() < s_BusOffAt))
+  {
+    return false;
+  }
+  FlexcanHostGetStats(&stats);
+  if (stats.busOffs > 0)
+  {
+    return false;
+  }
+  FlexcanHostBusError(true, 1);
+  return true;
+}
+
+/** Callback function for the bus timer with the traffic model: the frame on the bus has
+ *  ended and is received, the timer is armed for the end of the next one
+ */
+static void traffic_timer_callback(void)
+{
+  uint64_t endNs = 0;
+
+  if (!HostInjectBusError())
+  {
+    FlexcanHostReceive(&s_TrafficFrame);
+  }
+  s_FramesSent++;
+  HostRunAttack();
+  if ((s_FramesSent < s_FramesToSend) && TrafficNextFrame(&s_Traffic, &s_TrafficFrame, &endNs))
+  {
+    s_BusTimer.HostBeginAt(traffic_timer_callback, s_TrafficStartUs + (endNs / 1000));
+  }
+}
+
+/** Callback function for the bus timer, puts the next frame on the bus
+ */
+static void bus_timer_callback(void)
+{
+  FLEXCAN_frame_t frame;
+
+  if (s_FramesSent >= s_FramesToSend)
+  {
+    s_BusTimer.end();
+    return;
+  }
+  if (HostInjectBusError())
+  {
+    return;
+  }
+  HostRunAttack();
+
+  if (s_PendingCount > 0)
+  {
+    memcpy(&frame, &s_Pending[0], sizeof(frame));
+    s_PendingCount--;
+    memmove(&s_Pending[0], &s_Pending[1], s_PendingCount * sizeof(FLEXCAN_frame_t));
+  }
+  else
+  {
+    memset(&frame, 0, sizeof(frame));
+    while (!GenerateFrame(&frame, HOST_MIN_BACKGROUND_ID, HOST_MAX_BACKGROUND_ID))
+      ;
+  }
+  FlexcanHostReceive(&frame);
+  s_FramesSent++;
+}
+
+static void HostUsage(const char *program)
+{
+  fprintf(stderr, "usage: %s [-d sd_root] [-n frames] [-r frames_per_second] [-b bit_rate] [-F] [-a attack_start_ms] [-l attack_length_ms] [-s seed] [-q] [-P] [-H] [-T telemetry_file] [-U usb_bytes_per_second] [-E card_out_ms:card_out_length_ms] [-B bus_off_ms] [-R holdoff_ms] [-W close_us]\n", program);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t rate = HOST_DEFAULT_RATE;
+  uint32_t bitrate = 0;
+  uint32_t seed = HOST_DEFAULT_SEED;
+  bool fullLoad = false;
+  bool printProbes = false;
+  bool printHealth = false;
+  bool healthMatches = true;
+  bool cardRecovered = true;
+  bool busRecovered = true;
+  bool keptUp = true;
+  uint32_t closeTime = 0;
+  bool holdoff = false;
+  uint32_t holdoffTime = 0;
+  uint32_t recoveryMin = 0;
+  uint32_t recoveryMax = 0;
+  uint32_t recovery = 0;
+  char *separator = NULL;
+  const char *telemetryPath = NULL;
+  FILE *telemetryFile = NULL;
+  uint32_t usbRate = 0;
+  uint64_t endNs = 0;
+  uint32_t drainStart = 0;
+  struct timespec wallStart;
+  struct timespec wallEnd;
+  double wallSeconds = 0;
+  flexcan_host_stats_t stats;
+  int option = 0;
+
+  while ((option = getopt(argc, argv, "d:n:r:b:Fa:l:s:qPHT:U:E:B:R:W:")) != -1)
+  {
+    switch (option)
+    {
+      case 'd': { SdFatHostSetRoot(optarg); break; }
+      case 'n': { s_FramesToSend = strtoul(optarg, NULL, 0); break; }
+      case 'r': { rate = strtoul(optarg, NULL, 0); break; }
+      case 'b': { bitrate = strtoul(optarg, NULL, 0); break; }
+      case 'F': { fullLoad = true; break; }
+      case 'a': { s_AttackStart = strtoul(optarg, NULL, 0); break; }
+      case 'l': { s_AttackLength = strtoul(optarg, NULL, 0); break; }
+      case 's': { seed = strtoul(optarg, NULL, 0); randomSeed(seed); break; }
+      case 'q': { HostSerialSetOutput(NULL); break; }
+      case 'P': { printProbes = true; break; }
+      case 'H': { printHealth = true; break; }
+      case 'T': { telemetryPath = optarg; break; }
+      case 'U': { usbRate = strtoul(optarg, NULL, 0); break; }
+      case 'E':
+      {
+        s_CardOutStart = strtoul(optarg, &separator, 0);
+        s_CardOutLength = (*separator == ':') ? strtoul(separator + 1, NULL, 0) : 0;
+        break;
+      }
+      case 'B': { s_BusOffAt = strtoul(optarg, NULL, 0); break; }
+      case 'R': { holdoff = true; holdoffTime = strtoul(optarg, NULL, 0); break; }
+      case 'W': { closeTime = strtoul(optarg, NULL, 0); break; }
+      default:
+      {
+        HostUsage(argv[0]);
+        return 1;
+      }
+    }
+  }
+  if (fullLoad && (bitrate == 0))
+  {
+    bitrate = TRAFFIC_BITRATE_500K;
+  }
+  if ((rate == 0) || (rate > 1000000) || (bitrate > TRAFFIC_BITRATE_1M))
+  {
+    HostUsage(argv[0]);
+    return 1;
+  }
+  s_UseTrafficModel = (bitrate > 0);
+  if (telemetryPath != NULL) // Serial carries the binary stream, started the way the receiver starts it
+  {
+    telemetryFile = fopen(telemetryPath, "wb");
+    if (telemetryFile == NULL)
+    {
+      perror(telemetryPath);
+      return 1;
+    }
+    HostSerialSetOutput(telemetryFile);
+    HostSerialInject("t", 1);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &wallStart);
+  HostClockUseVirtualTime(true);
+  FlexcanHostReset();
+  HostSerialSetTxRate(usbRate);
+  setup();
+  SdFatHostSetCloseTime(closeTime);
+  if (holdoff)
+  {
+    BusMonitorSetPolicy(&g_BusMonitor, eBUS_RECOVERY_HOLDOFF, holdoffTime);
+  }
+
+  s_NextAttack = s_AttackStart;
+  if (s_UseTrafficModel)
+  {
+    TrafficInit(&s_Traffic, &TrafficVehicleProfile, bitrate, fullLoad, seed);
+    s_TrafficStartUs = HostClockMicros();
+    TrafficNextFrame(&s_Traffic, &s_TrafficFrame, &endNs);
+    s_BusTimer.HostBeginAt(traffic_timer_callback, s_TrafficStartUs + (endNs / 1000));
+  }
+  else
+  {
+    s_BusTimer.begin(bus_timer_callback, 1000000 / rate);
+  }
+  while (s_FramesSent < s_FramesToSend)
+  {
+    HostUpdateCard();
+    loop();
+  }
+
+  // let every open session reach the end of its window on an idle bus
+  drainStart = millis();
+  while ((SessionActiveCount(&g_Sessions) > 0) && ((millis() - drainStart) < HOST_DRAIN_LIMIT))
+  {
+    HostUpdateCard();
+    loop();
+  }
+  if (telemetryFile != NULL) // a last health record behind every frame, then everything sent
+  {
+    while (!TelemetrySendHealth(&g_Telemetry, &g_Model.health, &g_Sessions, g_Model.totalMsgCount))
+    {
+      LoggerService();
+    }
+    while (TelemetryPending(&g_Telemetry))
+    {
+      LoggerService();
+    }
+    HostSerialSetOutput(NULL);
+    fclose(telemetryFile);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+  wallSeconds = (wallEnd.tv_sec - wallStart.tv_sec) + ((wallEnd.tv_nsec - wallStart.tv_nsec) / 1e9);
+
+  FlexcanHostGetStats(&stats);
+  printf("Frames on bus:          %lu\n", (unsigned long) stats.framesOffered);
+  printf("Frames received:        %lu\n", (unsigned long) stats.framesReceived);
+  printf("FIFO overflows:         %lu\n", (unsigned long) stats.fifoOverflows);
+  printf("Frames stored:          %lu\n", (unsigned long) g_Model.totalMsgCount);
+  printf("Frames dropped (ring):  %lu\n", (unsigned long) g_Sessions.droppedFrames);
+  printf("Attack sessions:        %lu\n", (unsigned long) g_Sessions.sessionCount);
+  printf("Missed triggers:        %lu\n", (unsigned long) g_Sessions.missedTriggers);
+  printf("Sessions still open:    %u\n", SessionActiveCount(&g_Sessions));
+  printf("SD card probes:         %lu (%lu failed), %lu free results from file access\n", (unsigned long) g_SdMonitor.probes,
+         (unsigned long) g_SdMonitor.failedProbes, (unsigned long) g_SdMonitor.results);
+  if (s_CardOutLength > 0)
+  {
+    printf("SD card recoveries:     %lu of %lu failures, last %lu ms\n", (unsigned long) g_Model.health.sdRecoveries,
+           (unsigned long) g_Model.health.sdFailures, (unsigned long) g_Model.health.sdRecoveryLast);
+    printf("Frames kept in RAM:     %lu, %lu dropped\n", (unsigned long) g_Model.health.sdOutageFramesKept,
+           (unsigned long) g_Model.health.sdOutageFramesDropped);
+    cardRecovered = (g_Model.health.sdFailures > 0) && (g_Model.health.sdRecoveries == g_Model.health.sdFailures) && !SdRecoveryActive(&g_SdRecovery);
+    if (!cardRecovered)
+    {
+      fprintf(stderr, "The SD card was not recovered\n");
+    }
+  }
+  if (s_BusOffAt > 0)
+  {
+    // the controller has to see 128 x 11 recessive bits; a hold-off ends on a main loop pass, and
+    // when that is after the recovery bits went by the controller waits for 11 more
+    recoveryMin = ((uint64_t) FLEXCAN_BUS_OFF_RECOVERY_BITS * FlexcanHostBitTimeNs()) / 1000;
+    if (holdoff && ((holdoffTime * 1000) > recoveryMin))
+    {
+      recoveryMin = holdoffTime * 1000;
+    }
+    recoveryMax = recoveryMin + (((uint64_t) FLEXCAN_HOST_RESYNC_BITS * FlexcanHostBitTimeNs()) / 1000) + 1 + (holdoff ? HOST_LOOP_PERIOD : 0);
+    recovery = (uint32_t)(stats.recoveredAt - stats.busOffAt);
+    printf("Bus off recoveries:     %lu of %lu, %lu us off the bus (%lu to %lu us allowed), %lu us seen by the logger\n",
+           (unsigned long) g_BusMonitor.recoveries, (unsigned long) g_BusMonitor.busOffs, (unsigned long) recovery,
+           (unsigned long) recoveryMin, (unsigned long) recoveryMax, (unsigned long) g_BusMonitor.recoveryLast);
+    busRecovered = (stats.busOffs == 1) && (stats.recoveries == 1) && (g_BusMonitor.busOffs == 1) && (g_BusMonitor.recoveries == 1) &&
+                   (recovery >= recoveryMin) && (recovery <= recoveryMax) &&
+                   (g_BusMonitor.recoveryLast >= recovery) && (g_BusMonitor.recoveryLast <= (recovery + HOST_LOOP_PERIOD));
+    if (!busRecovered)
+    {
+      fprintf(stderr, "The CAN controller did not recover from bus off in time\n");
+    }
+  }
+  if (closeTime > 0)
+  {
+    keptUp = (stats.fifoOverflows == 0);
+    if (!keptUp)
+    {
+      fprintf(stderr, "The RX FIFO overflowed while the SD card wrote\n");
+    }
+  }
+  if (s_UseTrafficModel)
+  {
+    printf("Bus load:               %.2f %% at %lu bit/s\n", TrafficBusLoad(&s_Traffic) / 100.0, (unsigned long) bitrate);
+  }
+  printf("Virtual time:           %lu ms\n", (unsigned long) millis());
+  printf("Host time:              %.3f s (%.0f frames/s)\n", wallSeconds, (wallSeconds > 0) ? (stats.framesOffered / wallSeconds) : 0.0);
+  printf("Files written to:       %s/%s\n", SdFatHostRoot(), g_Timestamp);
+
+  if (printProbes || printHealth) // the way a user asks for them, over Serial, handled by the main loop
+  {
+    HostSerialSetOutput(stdout);
+    HostSerialInject(printProbes ? "p" : "", printProbes ? 1 : 0);
+    HostSerialInject(printHealth ? "h" : "", printHealth ? 1 : 0);
+    LoggerService();
+  }
+  if (printHealth)
+  {
+    // the interrupt sees at most one overflow flag per lost frame, and at least one if any frame was lost
+    healthMatches = (g_Model.health.fifoOverflows <= stats.fifoOverflows) && ((g_Model.health.fifoOverflows > 0) == (stats.fifoOverflows > 0)) &&
+                    (g_Model.health.isrCalls >= stats.framesReceived) && (g_Model.health.droppedWhileFlushing <= g_Sessions.droppedFrames) &&
+                    (g_Model.health.fileOpens == g_Model.health.fileCloses);
+    if (!healthMatches)
+    {
+      fprintf(stderr, "Health counters do not match the bus statistics\n");
+    }
+  }
+
+  return ((SessionActiveCount(&g_Sessions) == 0) && healthMatches && cardRecovered && busRecovered && keptUp) ? 0 : 1;
+}
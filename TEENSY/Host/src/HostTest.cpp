@@ -0,0 +1,108 @@
+/*
+  * @file HostTest.cpp
+  *
+  * Command line, error count and result line of the host test programs
+*/
+
+/* INCLUDES */
+#include <HostTest.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+/* DEFINES */
+#define HOST_TEST_MAX_OPTIONS         16        // Most options a test takes besides -v
+
+/* GLOBAL VARIABLES */
+bool g_HostTestVerbose = false;
+uint32_t g_HostTestErrors = 0;
+static const char *s_Program = "";
+static const char *s_Usage = "";
+
+/** Reads the command line, -v sets g_HostTestVerbose and the other options their table entry
+ *  @param argc Number of arguments
+ *  @param **argv Arguments
+ *  @param *usage Options as shown in the usage line, e.g. "[-s seed] [-n frames] [-v]"
+ *  @param *options Options of the test
+ *  @param numOptions Number of options
+ *  @return Whether or not the command line was right, the usage line is printed when it was not
+ */
+bool HostTestOptions(int argc, char **argv, const char *usage, const host_test_option_t *options, uint8_t numOptions)
+{
+  char optionString[(HOST_TEST_MAX_OPTIONS * 2) + 2];
+  uint8_t length = 0;
+  uint8_t index = 0;
+  int option = 0;
+
+  s_Program = argv[0];
+  s_Usage = usage;
+  numOptions = (numOptions > HOST_TEST_MAX_OPTIONS) ? HOST_TEST_MAX_OPTIONS : numOptions;
+  for (index = 0; index < numOptions; index++)
+  {
+    optionString[length++] = options[index].option;
+    if (options[index].type != eHOST_TEST_FLAG)
+    {
+      optionString[length++] = ':';
+    }
+  }
+  optionString[length++] = 'v';
+  optionString[length] = '\0';
+
+  while ((option = getopt(argc, argv, optionString)) != -1)
+  {
+    if (option == 'v')
+    {
+      g_HostTestVerbose = true;
+      continue;
+    }
+    for (index = 0; index < numOptions; index++)
+    {
+      if (options[index].option == option)
+      {
+        break;
+      }
+    }
+    if (index == numOptions)
+    {
+      HostTestUsage();
+      return false;
+    }
+    switch (options[index].type)
+    {
+      case eHOST_TEST_FLAG: { *(bool *) options[index].value = true; break; }
+      case eHOST_TEST_UINT: { *(uint32_t *) options[index].value = strtoul(optarg, NULL, 0); break; }
+      case eHOST_TEST_STRING: { *(const char **) options[index].value = optarg; break; }
+    }
+  }
+  return true;
+}
+
+/** Prints the usage line, for option values the test does not take
+ */
+void HostTestUsage(void)
+{
+  fprintf(stderr, "usage: %s %s\n", s_Program, s_Usage);
+}
+
+/** Counts an error and prints what went wrong, one line
+ *  @param *format printf format of the message
+ */
+void HostTestFail(const char *format, ...)
+{
+  va_list args;
+
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+  printf("\n");
+  g_HostTestErrors++;
+}
+
+/** Prints the result line
+ *  @return Exit code of the test, 0 when no check failed
+ */
+int HostTestSummary(void)
+{
+  printf("%lu errors: %s\n", (unsigned long) g_HostTestErrors, (g_HostTestErrors == 0) ? "PASS" : "FAIL");
+  return (g_HostTestErrors == 0) ? 0 : 1;
+}
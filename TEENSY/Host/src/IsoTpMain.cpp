@@ -0,0 +1,600 @@
+/*
+  * @file IsoTpMain.cpp
+  *
+  * Checks the ISO-TP stack against a simulated ECU. The tester side runs on the simulated
+  * FlexCAN controller (TX queue out, RX FIFO interrupt in) and the ECU side is a second stack
+  * sending straight onto the simulated bus, one frame at a time at 500 kbit/s; the ECU answers
+  * every request with a response of the length the request asks for. Each scenario checks the
+  * PDUs both ways byte for byte, that every sender kept to the block size and STmin of the flow
+  * control it got, and that the errors (timeouts, overflow, WAIT overrun, wrong sequence number)
+  * are reported where they should be. Scripted ECUs send the frames a stack never would.
+  *
+  * isotp_host [-v]
+*/
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <FlexcanHostBus.h>
+#include <HostTest.h>
+#include <IsoTpLink.h>
+
+/* DEFINES */
+#define TP_TEST_FRAME_US              250       // Time (us) an 8 byte frame takes on the bus at 500 kbit/s
+#define TP_TEST_STEP_US               10        // Time (us) the simulation moves on by per step
+#define TP_TEST_RUN_LIMIT_US          5000000   // Longest a scenario may run (us)
+#define TP_TEST_START_US              (0x100000000ULL - 700000)  // micros() wraps a few scenarios in
+#define TP_TEST_BUS_QUEUE_SIZE        64        // Frames waiting for the bus per direction, a power of two
+#define TP_TEST_TRACE_SIZE            4096      // Frames recorded per scenario
+#define TP_TEST_MAX_CHANNELS          ISOTP_NUM_PAIRS  // Links run at the same time, one per diagnostic ID pair
+#define TP_TEST_WAIT_PERIOD_US        100000    // Time (us) between the flow control WAIT frames of the scripted ECU
+#define TP_TEST_NONE                  -1        // No callback (yet) / none expected
+
+/* ENUMS */
+enum TpTestEcu_e
+{
+  eTP_ECU_STACK = 0,                    // ISO-TP stack answering every request
+  eTP_ECU_SILENT,                       // Never answers
+  eTP_ECU_WAIT,                         // Answers a first frame with flow control WAIT frames, then clear to send
+  eTP_ECU_WRONG_SN,                     // Answers with a first frame and a consecutive frame out of sequence
+  eTP_ECU_STALL                         // Answers with a first frame and no consecutive frame
+};
+
+/* STRUCTS */
+typedef struct {
+  const char *name;                     // Name printed with the result
+  uint8_t numChannels;                  // Links talking at the same time
+  uint16_t requestLength;               // Request sent by the tester
+  uint16_t responseLength;              // Response asked of the ECU
+  uint8_t testerBs;                     // Block size and STmin the tester asks for
+  uint8_t testerSt;
+  uint8_t ecuBs;                        // Block size and STmin the ECU asks for
+  uint8_t ecuSt;
+  uint16_t ecuBufferSize;               // Receive buffer of the ECU
+  uint8_t ecu;                          // TpTestEcu_e
+  uint8_t waits;                        // Flow control WAIT frames of the scripted ECU
+  int expectSent;                       // Result of sending the request
+  int expectReceived;                   // Result of receiving the response, TP_TEST_NONE for no response
+} tp_test_scenario_t;
+
+typedef struct {
+  isotp_link_t tester;                  // Tester side of the channel
+  isotp_link_t ecu;                     // ECU side of the channel
+  uint8_t testerBuffer[ISOTP_LINK_MAX_LENGTH];
+  uint8_t ecuBuffer[ISOTP_LINK_MAX_LENGTH];
+  uint8_t request[ISOTP_LINK_MAX_LENGTH];
+  uint8_t response[ISOTP_LINK_MAX_LENGTH];
+  uint16_t requestLength;
+  uint16_t responseLength;
+  int sent;                             // Result of sending the request
+  int received;                         // Result of receiving the response
+  int ecuReceived;                      // Result of the ECU receiving the request
+  uint32_t errors;                      // PDUs with the wrong length or content
+  uint64_t doneAt;                      // Time (us) of the last tester callback
+} tp_test_channel_t;
+
+typedef struct {
+  FLEXCAN_frame_t frames[TP_TEST_BUS_QUEUE_SIZE];
+  uint32_t head;
+  uint32_t tail;
+} tp_test_bus_queue_t;
+
+typedef struct {
+  uint64_t time;                        // Time (us) the sender queued the frame
+  FLEXCAN_frame_t frame;
+} tp_test_trace_t;
+
+/* CONSTANTS */
+const tp_test_scenario_t TpTestScenarios[] = {
+  //name            ch  req   resp  tBS tST   eBS eST   eBuf  ECU               WFT                 sent                   received
+  {"single frames",  1, 5,    7,    0,  0,    0,  0,    4095, eTP_ECU_STACK,    0,                  eISOTP_N_OK,           eISOTP_N_OK},
+  {"multi frame",    1, 100,  300,  4,  1,    0,  0,    4095, eTP_ECU_STACK,    0,                  eISOTP_N_OK,           eISOTP_N_OK},
+  {"blocks, STmin",  1, 200,  62,   1,  0xF5, 3,  5,    4095, eTP_ECU_STACK,    0,                  eISOTP_N_OK,           eISOTP_N_OK},
+  {"longest PDU",    1, 4095, 4095, 0,  0,    8,  0,    4095, eTP_ECU_STACK,    0,                  eISOTP_N_OK,           eISOTP_N_OK},
+  {"concurrent",     3, 150,  500,  2,  0xF9, 5,  2,    4095, eTP_ECU_STACK,    0,                  eISOTP_N_OK,           eISOTP_N_OK},
+  {"overflow",       1, 100,  8,    0,  0,    0,  0,    64,   eTP_ECU_STACK,    0,                  eISOTP_N_BUFFER_OVFLW, TP_TEST_NONE},
+  {"N_Bs timeout",   1, 20,   8,    0,  0,    0,  0,    4095, eTP_ECU_SILENT,   0,                  eISOTP_N_TIMEOUT_BS,   TP_TEST_NONE},
+  {"WAIT frames",    1, 20,   8,    0,  0,    0,  0,    4095, eTP_ECU_WAIT,     ISOTP_LINK_MAX_WFT, eISOTP_N_OK,           TP_TEST_NONE},
+  {"WAIT overrun",   1, 20,   8,    0,  0,    0,  0,    4095, eTP_ECU_WAIT,     ISOTP_LINK_MAX_WFT + 1, eISOTP_N_WFT_OVRN, TP_TEST_NONE},
+  {"wrong SN",       1, 3,    20,   0,  0,    0,  0,    4095, eTP_ECU_WRONG_SN, 0,                  eISOTP_N_OK,           eISOTP_N_WRONG_SN},
+  {"N_Cr timeout",   1, 3,    20,   0,  0,    0,  0,    4095, eTP_ECU_STALL,    0,                  eISOTP_N_OK,           eISOTP_N_TIMEOUT_CR}
+};
+const uint8_t TP_TEST_NUM_SCENARIOS = sizeof(TpTestScenarios) / sizeof(TpTestScenarios[0]);
+
+/* GLOBAL VARIABLES */
+static isotp_stack_t s_Tester;
+static isotp_stack_t s_Ecu;
+static tp_test_channel_t s_Channels[TP_TEST_MAX_CHANNELS];
+static const tp_test_scenario_t *s_Scenario = NULL;
+static tp_test_bus_queue_t s_ToEcu;     // Frames sent by the tester
+static tp_test_bus_queue_t s_ToTester;  // Frames sent by the ECU
+static uint64_t s_BusFreeAt = 0;
+static tp_test_trace_t s_Trace[TP_TEST_TRACE_SIZE];
+static uint32_t s_TraceCount = 0;
+static uint64_t s_TesterLastTx = 0;     // Time (us) the tester last queued a frame
+static bool s_TesterHeld = false;       // Whether or not the controller is held off the bus, the tester frames wait in the TX queue
+static uint8_t s_ScriptWaits = 0;       // WAIT frames the scripted ECU has sent
+static uint64_t s_ScriptNext = 0;       // Time (us) of the next scripted flow control, 0 for none
+
+/** Gets a byte of the test pattern a PDU is filled with
+ *  @param seed First byte of the PDU
+ *  @param i Byte offset
+ *  @return Pattern byte
+ */
+static uint8_t TpTestPattern(uint8_t seed, uint16_t i)
+{
+  return (uint8_t)((i * 13) + (i >> 8) + seed);
+}
+
+/** Records a frame as it is queued for the bus
+ *  @param *frame Frame
+ */
+static void TpTestTrace(const FLEXCAN_frame_t *frame)
+{
+  if (s_TraceCount < TP_TEST_TRACE_SIZE)
+  {
+    s_Trace[s_TraceCount].time = HostClockMicros();
+    memcpy(&s_Trace[s_TraceCount].frame, frame, sizeof(FLEXCAN_frame_t));
+  }
+  s_TraceCount++;
+  if (g_HostTestVerbose)
+  {
+    printf("%10llu 0x%03lX %02X %02X %02X %02X %02X %02X %02X %02X\n", (unsigned long long) HostClockMicros(),
+           (unsigned long) frame->id, frame->data[0], frame->data[1], frame->data[2], frame->data[3],
+           frame->data[4], frame->data[5], frame->data[6], frame->data[7]);
+  }
+}
+
+/** Queues a frame for the bus
+ *  @param *queue Direction
+ *  @param *frame Frame
+ *  @return FLEXCAN_SUCCESS, FLEXCAN_ERROR if the direction is full
+ */
+static int TpTestBusQueue(tp_test_bus_queue_t *queue, const FLEXCAN_frame_t *frame)
+{
+  if ((queue->head - queue->tail) >= TP_TEST_BUS_QUEUE_SIZE)
+  {
+    return FLEXCAN_ERROR;
+  }
+  TpTestTrace(frame);
+  memcpy(&queue->frames[queue->head & (TP_TEST_BUS_QUEUE_SIZE - 1)], frame, sizeof(FLEXCAN_frame_t));
+  queue->head++;
+  return FLEXCAN_SUCCESS;
+}
+
+/** Sender of the ECU stack, straight onto the bus
+ *  @param *frame Frame
+ *  @return FLEXCAN_SUCCESS, FLEXCAN_ERROR if too many frames wait for the bus
+ */
+static int tp_test_ecu_send(const FLEXCAN_frame_t *frame)
+{
+  return TpTestBusQueue(&s_ToTester, frame);
+}
+
+/** Frames transmitted by the simulated controller, i.e. sent by the tester
+ *  @param *frame Frame transmitted
+ */
+static void tp_test_tx_handler(const FLEXCAN_frame_t *frame)
+{
+  s_TesterLastTx = HostClockMicros();
+  if (TpTestBusQueue(&s_ToEcu, frame) != FLEXCAN_SUCCESS)
+  {
+    printf("bus queue to the ECU full\n");
+  }
+  if ((s_ToEcu.head - s_ToEcu.tail) >= TP_TEST_BUS_QUEUE_SIZE)
+  {
+    s_TesterHeld = true;
+    FlexcanHostSetTxPaused(true);
+  }
+}
+
+/** RX FIFO interrupt of the tester
+ *  @param mb Unused
+ */
+static void tp_test_fifo_callback(uint8_t mb)
+{
+  FLEXCAN_frame_t frame;
+  while (FLEXCAN_fifo_avalible())
+  {
+    FLEXCAN_fifo_read(&frame);
+    IsoTpStackReceive(&s_Tester, &frame);
+  }
+}
+
+/** Sends a scripted frame as the ECU of the first channel
+ *  @param b0..b3 First data bytes, the rest is padding
+ */
+static void TpTestScriptSend(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3)
+{
+  FLEXCAN_frame_t frame;
+
+  memset(&frame, 0, sizeof(FLEXCAN_frame_t));
+  frame.id = s_Channels[0].ecu.txId;
+  frame.dlc = 8;
+  memset(frame.data, ISOTP_LINK_PADDING, sizeof(frame.data));
+  frame.data[0] = b0;
+  frame.data[1] = b1;
+  frame.data[2] = b2;
+  frame.data[3] = b3;
+  tp_test_ecu_send(&frame);
+}
+
+/** Scripted ECU: sees the frames sent to it, and is polled with NULL every step
+ *  @param *frame Frame for the ECU, NULL when polled
+ */
+static void TpTestScript(const FLEXCAN_frame_t *frame)
+{
+  uint8_t type = (frame != NULL) ? (frame->data[0] & ISOTP_PCI_TYPE_MASK) : 0xFF;
+
+  switch (s_Scenario->ecu)
+  {
+    case eTP_ECU_WAIT:
+    {
+      if (type == eISOTP_FIRST_FRAME)
+      {
+        s_ScriptWaits = 0;
+        s_ScriptNext = HostClockMicros();
+      }
+      if ((frame == NULL) && (s_ScriptNext != 0) && (HostClockMicros() >= s_ScriptNext))
+      {
+        if (s_ScriptWaits < s_Scenario->waits)
+        {
+          TpTestScriptSend(eISOTP_FLOW_CONTROL | ISOTP_FC_WAIT, 0, 0, 0);
+          s_ScriptWaits++;
+          s_ScriptNext = HostClockMicros() + TP_TEST_WAIT_PERIOD_US;
+        }
+        else
+        {
+          TpTestScriptSend(eISOTP_FLOW_CONTROL | ISOTP_FC_CLEAR_TO_SEND, 0, 0, 0);
+          s_ScriptNext = 0;
+        }
+      }
+      break;
+    }
+    case eTP_ECU_WRONG_SN:
+    case eTP_ECU_STALL:
+    {
+      if (type == eISOTP_SINGLE_FRAME)
+      {
+        TpTestScriptSend(eISOTP_FIRST_FRAME, s_Scenario->responseLength, 0, 0);
+      }
+      else if ((type == eISOTP_FLOW_CONTROL) && (s_Scenario->ecu == eTP_ECU_WRONG_SN))
+      {
+        TpTestScriptSend(eISOTP_CONSECUTIVE_FRAME | 2, 0, 0, 0);
+      }
+      break;
+    }
+    default: { break; }
+  }
+}
+
+/** Tester: request sent, or why not
+ */
+static void tp_test_tester_sent(isotp_link_t *link, IsoTpLinkResult_e result, const uint8_t *data, uint16_t length)
+{
+  tp_test_channel_t *channel = (tp_test_channel_t *) link->arg;
+
+  channel->sent = result;
+  channel->doneAt = HostClockMicros();
+  if ((data != channel->request) || (length != channel->requestLength))
+  {
+    channel->errors++;
+  }
+}
+
+/** Tester: response received, it has to be the one the request asked for
+ */
+static void tp_test_tester_received(isotp_link_t *link, IsoTpLinkResult_e result, const uint8_t *data, uint16_t length)
+{
+  tp_test_channel_t *channel = (tp_test_channel_t *) link->arg;
+  uint16_t i = 0;
+
+  channel->received = result;
+  channel->doneAt = HostClockMicros();
+  if (result != eISOTP_N_OK)
+  {
+    return;
+  }
+  if ((length != channel->responseLength) || (data[0] != (uint8_t)(channel->request[0] + 0x40)))
+  {
+    channel->errors++;
+    return;
+  }
+  for (i = 1; i < length; i++)
+  {
+    if (data[i] != TpTestPattern(data[0], i))
+    {
+      printf("response byte %u is 0x%02X, expected 0x%02X\n", i, data[i], TpTestPattern(data[0], i));
+      channel->errors++;
+      return;
+    }
+  }
+}
+
+/** ECU: request received, checked and answered with as many bytes as it asks for
+ */
+static void tp_test_ecu_received(isotp_link_t *link, IsoTpLinkResult_e result, const uint8_t *data, uint16_t length)
+{
+  tp_test_channel_t *channel = (tp_test_channel_t *) link->arg;
+  uint16_t responseLength = 0;
+  uint16_t i = 0;
+
+  channel->ecuReceived = result;
+  if (result != eISOTP_N_OK)
+  {
+    return;
+  }
+  if (length != channel->requestLength)
+  {
+    channel->errors++;
+    return;
+  }
+  for (i = 3; i < length; i++)
+  {
+    if (data[i] != TpTestPattern(data[0], i))
+    {
+      printf("request byte %u is 0x%02X, expected 0x%02X\n", i, data[i], TpTestPattern(data[0], i));
+      channel->errors++;
+      return;
+    }
+  }
+
+  responseLength = (length >= 3) ? (((uint16_t) data[1] << 8) | data[2]) : 1;
+  channel->response[0] = data[0] + 0x40;
+  for (i = 1; i < responseLength; i++)
+  {
+    channel->response[i] = TpTestPattern(channel->response[0], i);
+  }
+  if (!IsoTpLinkSend(link, channel->response, responseLength))
+  {
+    channel->errors++;
+  }
+}
+
+/** Sets up the links of a scenario on both sides and resets the bus
+ *  @param *scenario Scenario
+ */
+static void TpTestSetup(const tp_test_scenario_t *scenario)
+{
+  tp_test_channel_t *channel = NULL;
+  const isotp_id_pair_t *pair = NULL;
+  uint16_t i = 0;
+  uint8_t c = 0;
+
+  s_Scenario = scenario;
+  memset(&s_ToEcu, 0, sizeof(s_ToEcu));
+  memset(&s_ToTester, 0, sizeof(s_ToTester));
+  s_BusFreeAt = HostClockMicros();
+  s_TraceCount = 0;
+  s_ScriptNext = 0;
+  s_TesterHeld = false;
+  FLEXCAN_txq_flush();
+  FlexcanHostSetTxPaused(false);
+  IsoTpStackInit(&s_Tester, NULL);
+  IsoTpStackInit(&s_Ecu, tp_test_ecu_send);
+
+  for (c = 0; c < scenario->numChannels; c++)
+  {
+    channel = &s_Channels[c];
+    pair = IsoTpGetPair(c);
+    memset(channel, 0, sizeof(tp_test_channel_t));
+    channel->sent = TP_TEST_NONE;
+    channel->received = TP_TEST_NONE;
+    channel->ecuReceived = TP_TEST_NONE;
+
+    IsoTpLinkInit(&channel->tester, pair->requestId, pair->responseId, channel->testerBuffer, ISOTP_LINK_MAX_LENGTH,
+                  tp_test_tester_received, tp_test_tester_sent, channel);
+    channel->tester.blockSize = scenario->testerBs;
+    channel->tester.stMin = scenario->testerSt;
+    IsoTpStackAdd(&s_Tester, &channel->tester);
+
+    IsoTpLinkInit(&channel->ecu, pair->responseId, pair->requestId, channel->ecuBuffer, scenario->ecuBufferSize,
+                  tp_test_ecu_received, NULL, channel);
+    channel->ecu.blockSize = scenario->ecuBs + c;
+    channel->ecu.stMin = scenario->ecuSt;
+    IsoTpStackAdd(&s_Ecu, &channel->ecu);
+
+    // request: service ID, response length asked for, pattern
+    channel->requestLength = scenario->requestLength + ((scenario->requestLength < ISOTP_LINK_MAX_LENGTH) ? (c * 50) : 0);
+    channel->responseLength = scenario->responseLength + ((scenario->responseLength < ISOTP_LINK_MAX_LENGTH) ? (c * 100) : 0);
+    channel->request[0] = 0x10 + c;
+    for (i = 1; i < channel->requestLength; i++)
+    {
+      channel->request[i] = TpTestPattern(channel->request[0], i);
+    }
+    if (channel->requestLength >= 3)
+    {
+      channel->request[1] = channel->responseLength >> 8;
+      channel->request[2] = channel->responseLength & 0xFF;
+    }
+  }
+}
+
+/** Puts the next frame on the bus once it is free, the lower ID wins when both sides have one waiting
+ */
+static void TpTestBusStep(void)
+{
+  tp_test_bus_queue_t *queue = NULL;
+  FLEXCAN_frame_t *frame = NULL;
+  bool ecuWaiting = (s_ToEcu.head != s_ToEcu.tail);
+  bool testerWaiting = (s_ToTester.head != s_ToTester.tail);
+
+  if ((HostClockMicros() < s_BusFreeAt) || (!ecuWaiting && !testerWaiting))
+  {
+    return;
+  }
+  if (ecuWaiting && testerWaiting)
+  {
+    queue = (s_ToEcu.frames[s_ToEcu.tail & (TP_TEST_BUS_QUEUE_SIZE - 1)].id <
+             s_ToTester.frames[s_ToTester.tail & (TP_TEST_BUS_QUEUE_SIZE - 1)].id) ? &s_ToEcu : &s_ToTester;
+  }
+  else
+  {
+    queue = ecuWaiting ? &s_ToEcu : &s_ToTester;
+  }
+  frame = &queue->frames[queue->tail & (TP_TEST_BUS_QUEUE_SIZE - 1)];
+  queue->tail++;
+  s_BusFreeAt = HostClockMicros() + TP_TEST_FRAME_US;
+
+  if (queue == &s_ToTester)
+  {
+    FlexcanHostReceive(frame);
+  }
+  else if (s_Scenario->ecu == eTP_ECU_STACK)
+  {
+    IsoTpStackReceive(&s_Ecu, frame);
+  }
+  else
+  {
+    TpTestScript(frame);
+  }
+  if ((queue == &s_ToEcu) && s_TesterHeld) // room again, the controller sends what waited in its mailboxes
+  {
+    s_TesterHeld = false;
+    FlexcanHostSetTxPaused(false);
+  }
+}
+
+/** Checks that a sender kept to the flow control of the receiver: no consecutive frame before a
+ *  clear to send, no more than the block size per clear to send, and at least STmin between them
+ *  @param senderId ID of the sender
+ *  @param receiverId ID of the receiver
+ */
+static void TpTestCheckPacing(uint32_t senderId, uint32_t receiverId)
+{
+  uint32_t i = 0;
+  uint32_t stMin = 0;
+  uint32_t inBlock = 0;
+  uint8_t blockSize = 0;
+  bool waiting = false;
+  bool first = true;
+  uint64_t last = 0;
+
+  for (i = 0; (i < s_TraceCount) && (i < TP_TEST_TRACE_SIZE); i++)
+  {
+    const FLEXCAN_frame_t *frame = &s_Trace[i].frame;
+    uint8_t type = frame->data[0] & ISOTP_PCI_TYPE_MASK;
+
+    if ((frame->id == senderId) && (type == eISOTP_FIRST_FRAME))
+    {
+      waiting = true;
+    }
+    else if ((frame->id == receiverId) && (type == eISOTP_FLOW_CONTROL) && ((frame->data[0] & ISOTP_PCI_LOW_MASK) == ISOTP_FC_CLEAR_TO_SEND))
+    {
+      waiting = false;
+      blockSize = frame->data[1];
+      stMin = IsoTpStMinMicros(frame->data[2]);
+      inBlock = 0;
+      first = true;
+    }
+    else if ((frame->id == senderId) && (type == eISOTP_CONSECUTIVE_FRAME))
+    {
+      HOST_TEST_CHECK(!waiting && (first || ((s_Trace[i].time - last) >= stMin)), "0x%03lX: consecutive frame at %llu us %s",
+                      (unsigned long) senderId, (unsigned long long) s_Trace[i].time, waiting ? "without a clear to send" : "inside STmin");
+      first = false;
+      last = s_Trace[i].time;
+      if ((blockSize > 0) && (++inBlock >= blockSize))
+      {
+        waiting = true;
+      }
+    }
+  }
+}
+
+/** Runs a scenario until every expected callback came, or the time limit
+ *  @param *scenario Scenario
+ */
+static void TpTestRun(const tp_test_scenario_t *scenario)
+{
+  tp_test_channel_t *channel = NULL;
+  uint64_t start = 0;
+  uint64_t elapsed = 0;
+  uint64_t timeout = 0;
+  uint32_t errors = g_HostTestErrors;
+  uint8_t c = 0;
+  bool done = false;
+
+  TpTestSetup(scenario);
+  start = HostClockMicros();
+  for (c = 0; c < scenario->numChannels; c++)
+  {
+    HOST_TEST_CHECK(IsoTpLinkSend(&s_Channels[c].tester, s_Channels[c].request, s_Channels[c].requestLength),
+                    "%s: request %u not started", scenario->name, c);
+  }
+
+  while (!done && ((HostClockMicros() - start) < TP_TEST_RUN_LIMIT_US))
+  {
+    HostClockAdvanceMicros(TP_TEST_STEP_US);
+    TpTestBusStep();
+    if (scenario->ecu != eTP_ECU_STACK)
+    {
+      TpTestScript(NULL);
+    }
+    IsoTpStackService(&s_Tester);
+    IsoTpStackService(&s_Ecu);
+
+    done = true;
+    for (c = 0; c < scenario->numChannels; c++)
+    {
+      channel = &s_Channels[c];
+      done = done && (channel->sent != TP_TEST_NONE) && ((scenario->expectReceived == TP_TEST_NONE) || (channel->received != TP_TEST_NONE));
+    }
+  }
+  elapsed = HostClockMicros() - start;
+
+  for (c = 0; c < scenario->numChannels; c++)
+  {
+    channel = &s_Channels[c];
+    HOST_TEST_CHECK((channel->sent == scenario->expectSent) && (channel->received == scenario->expectReceived) && (channel->errors == 0),
+                    "%s: channel %u sent %d (expected %d), received %d (expected %d), %lu bad PDUs", scenario->name, c,
+                    channel->sent, scenario->expectSent, channel->received, scenario->expectReceived, (unsigned long) channel->errors);
+    HOST_TEST_CHECK((scenario->ecu != eTP_ECU_STACK) || (scenario->expectSent != eISOTP_N_OK) || (channel->ecuReceived == eISOTP_N_OK),
+                    "%s: channel %u request received by the ECU with %d", scenario->name, c, channel->ecuReceived);
+    TpTestCheckPacing(channel->tester.txId, channel->tester.rxId);
+    TpTestCheckPacing(channel->ecu.txId, channel->ecu.rxId);
+  }
+
+  // timeouts count from the last frame the tester queued (first frame / flow control)
+  channel = &s_Channels[0];
+  timeout = (channel->sent == eISOTP_N_TIMEOUT_BS) ? (ISOTP_LINK_TIMEOUT_BS * 1000ULL) :
+            ((channel->received == eISOTP_N_TIMEOUT_CR) ? (ISOTP_LINK_TIMEOUT_CR * 1000ULL) : 0);
+  HOST_TEST_CHECK((timeout == 0) || (((channel->doneAt - s_TesterLastTx) >= timeout) && ((channel->doneAt - s_TesterLastTx) <= (timeout + TP_TEST_STEP_US))),
+                  "%s: timeout after %llu us, expected %llu us", scenario->name, (unsigned long long)(channel->doneAt - s_TesterLastTx),
+                  (unsigned long long) timeout);
+  HOST_TEST_CHECK((s_TraceCount <= TP_TEST_TRACE_SIZE) && (s_Tester.framesDropped == 0) && (s_Ecu.framesDropped == 0),
+                  "%s: %lu frames traced, %lu / %lu dropped by the stacks", scenario->name, (unsigned long) s_TraceCount,
+                  (unsigned long) s_Tester.framesDropped, (unsigned long) s_Ecu.framesDropped);
+
+  printf("%-14s %u x %4u / %4u bytes, %5lu frames in %8.3f ms: %s\n", scenario->name, scenario->numChannels,
+         scenario->requestLength, scenario->responseLength, (unsigned long) s_TraceCount, elapsed / 1000.0,
+         (g_HostTestErrors == errors) ? "PASS" : "FAIL");
+}
+
+int main(int argc, char **argv)
+{
+  FLEXCAN_config_t canConfig;
+  uint8_t i = 0;
+
+  if (!HostTestOptions(argc, argv, "[-v]", NULL, 0))
+  {
+    return 1;
+  }
+
+  HostClockUseVirtualTime(true);
+  HostClockSetMicros(TP_TEST_START_US);
+  FlexcanHostReset();
+  canConfig.presdiv = 1;                // 500 kbit/s from the 16 MHz oscillator
+  canConfig.propseg = 2;
+  canConfig.rjw = 1;
+  canConfig.pseg_1 = 7;
+  canConfig.pseg_2 = 3;
+  FLEXCAN_init(canConfig);
+  FLEXCAN_fifo_reg_callback(tp_test_fifo_callback);
+  FLEXCAN_txq_init(NULL);
+  FlexcanHostSetTxHandler(tp_test_tx_handler);
+
+  for (i = 0; i < TP_TEST_NUM_SCENARIOS; i++)
+  {
+    TpTestRun(&TpTestScenarios[i]);
+  }
+  return HostTestSummary();
+}
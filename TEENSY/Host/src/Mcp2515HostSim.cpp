@@ -0,0 +1,380 @@
+/*
+  * @file Mcp2515HostSim.cpp
+  *
+  * Simulated MCP2515 CAN controller on the host SPI bus
+*/
+
+/* INCLUDES */
+#include <Mcp2515HostSim.h>
+#include <mcp_can_dfs.h>
+
+/* DEFINES */
+#define MCP2515_HOST_ADDRESS_MASK     0x7F      // Registers wrap around past 0x7F
+#define MCP2515_HOST_RXB_RXRTR        0x08      // RXBnCTRL: remote request received (standard frame)
+#define MCP2515_HOST_RXB_BUKT1        0x02      // RXB0CTRL: read only copy of BUKT
+#define MCP2515_HOST_SIDL_SRR         0x10      // RXBnSIDL: standard frame remote request
+#define MCP2515_HOST_EFLG_WRITABLE    (MCP_EFLG_RX1OVR | MCP_EFLG_RX0OVR)  // EFLG bits the MCU can clear
+#define MCP2515_HOST_READ_RX_MASK     0xF9      // READ RX BUFFER instruction without its n and m bits
+#define MCP2515_HOST_LOAD_TX_MASK     0xF8      // LOAD TX BUFFER instruction without its buffer bits
+#define MCP2515_HOST_RTS_MASK         0xF8      // RTS instruction without its buffer bits
+
+/* ENUMS */
+enum Mcp2515HostSpiState_e
+{
+  eMCP_SPI_INSTRUCTION = 0,             // Waiting for the instruction byte
+  eMCP_SPI_ADDRESS,                     // Waiting for the address of a READ, WRITE or BIT MODIFY
+  eMCP_SPI_READ,                        // Sending registers from the address pointer
+  eMCP_SPI_WRITE,                       // Writing registers from the address pointer
+  eMCP_SPI_MASK,                        // Waiting for the mask of a BIT MODIFY
+  eMCP_SPI_DATA,                        // Waiting for the data of a BIT MODIFY
+  eMCP_SPI_STATUS,                      // Sending the READ STATUS byte, repeated
+  eMCP_SPI_RX_STATUS,                   // Sending the RX STATUS byte, repeated
+  eMCP_SPI_IGNORE                       // Instruction done or not simulated, the rest is ignored
+};
+
+/* GLOBAL VARIABLES */
+static uint8_t s_Registers[MCP2515_HOST_REGISTER_SPACE];
+static mcp2515_host_stats_t s_Stats;
+static uint8_t s_IntPin = 0;            // INT pin, driven by the controller
+static bool s_IntLow = false;           // Level of the INT pin
+static uint8_t s_SpiState = eMCP_SPI_INSTRUCTION;
+static uint8_t s_Instruction = 0;       // Instruction of the current transaction
+static uint8_t s_Address = 0;           // Address pointer of the current transaction
+static uint8_t s_Mask = 0;              // Mask of a BIT MODIFY
+static uint8_t s_ClearOnDeselect = 0;   // RXnIF flag a READ RX BUFFER clears when the chip select goes high
+
+/** Maps an address onto the register it reads, CANSTAT and CANCTRL are at the end of every row
+ *  @param address Register address
+ *  @return Address in s_Registers
+ */
+static uint8_t Mcp2515HostMap(uint8_t address)
+{
+  address &= MCP2515_HOST_ADDRESS_MASK;
+  if ((address & 0x0F) == MCP_CANSTAT)
+  {
+    return MCP_CANSTAT;
+  }
+  if ((address & 0x0F) == MCP_CANCTRL)
+  {
+    return MCP_CANCTRL;
+  }
+  return address;
+}
+
+/** Drives the INT pin low while a flag enabled in CANINTE is set
+ */
+static void Mcp2515HostUpdateInt(void)
+{
+  bool low = (s_Registers[MCP_CANINTF] & s_Registers[MCP_CANINTE]) != 0;
+
+  if (low != s_IntLow)
+  {
+    s_IntLow = low;
+    if (low)
+    {
+      s_Stats.interrupts++;
+    }
+    HostPinDrive(s_IntPin, low ? LOW : HIGH);
+  }
+}
+
+/** Puts the registers in their state after a reset: configuration mode, no flags
+ */
+static void Mcp2515HostResetRegisters(void)
+{
+  memset(s_Registers, 0, sizeof(s_Registers));
+  s_Registers[MCP_CANCTRL] = MCP2515_HOST_CANCTRL_RESET;
+  s_Registers[MCP_CANSTAT] = MCP2515_HOST_CANSTAT_RESET;
+  Mcp2515HostUpdateInt();
+}
+
+/** Writes a register the way the MCU can
+ *  @param address Register address
+ *  @param value New contents
+ */
+static void Mcp2515HostWrite(uint8_t address, uint8_t value)
+{
+  address = Mcp2515HostMap(address);
+  switch (address)
+  {
+    case MCP_CANSTAT: // read only
+      break;
+    case MCP_CANCTRL: // the requested mode is taken right away
+      s_Registers[MCP_CANCTRL] = value;
+      s_Registers[MCP_CANSTAT] = (s_Registers[MCP_CANSTAT] & ~MODE_MASK) | (value & MODE_MASK);
+      break;
+    case MCP_EFLG:
+      s_Registers[MCP_EFLG] = (s_Registers[MCP_EFLG] & ~MCP2515_HOST_EFLG_WRITABLE) | (value & MCP2515_HOST_EFLG_WRITABLE);
+      break;
+    case MCP_RXB0CTRL:
+      s_Registers[MCP_RXB0CTRL] = (value & (MCP_RXB_RX_MASK | MCP_RXB_BUKT_MASK)) |
+                                  ((value & MCP_RXB_BUKT_MASK) ? MCP2515_HOST_RXB_BUKT1 : 0) |
+                                  (s_Registers[MCP_RXB0CTRL] & MCP2515_HOST_RXB_RXRTR);
+      break;
+    case MCP_RXB1CTRL:
+      s_Registers[MCP_RXB1CTRL] = (value & MCP_RXB_RX_MASK) | (s_Registers[MCP_RXB1CTRL] & MCP2515_HOST_RXB_RXRTR);
+      break;
+    default:
+      s_Registers[address] = value;
+      break;
+  }
+  Mcp2515HostUpdateInt();
+}
+
+/** Gets the READ STATUS byte
+ *  @return RX0IF, RX1IF, TXREQ and TXnIF of the three transmit buffers
+ */
+static uint8_t Mcp2515HostStatus(void)
+{
+  uint8_t intf = s_Registers[MCP_CANINTF];
+
+  return (intf & (MCP_RX0IF | MCP_RX1IF)) |
+         ((s_Registers[MCP_TXB0CTRL] & MCP_TXB_TXREQ_M) ? 0x04 : 0) | ((intf & MCP_TX0IF) ? 0x08 : 0) |
+         ((s_Registers[MCP_TXB1CTRL] & MCP_TXB_TXREQ_M) ? 0x10 : 0) | ((intf & MCP_TX1IF) ? 0x20 : 0) |
+         ((s_Registers[MCP_TXB2CTRL] & MCP_TXB_TXREQ_M) ? 0x40 : 0) | ((intf & MCP_TX2IF) ? 0x80 : 0);
+}
+
+/** Gets the RX STATUS byte
+ *  @return Buffers holding a message, frame type and the filter that took it (always RXF0 / RXF1 here)
+ */
+static uint8_t Mcp2515HostRxStatus(void)
+{
+  uint8_t intf = s_Registers[MCP_CANINTF] & (MCP_RX0IF | MCP_RX1IF);
+  uint8_t base = (intf & MCP_RX0IF) ? MCP_RXB0CTRL : MCP_RXB1CTRL;
+  uint8_t type = 0;
+
+  if (intf == 0)
+  {
+    return 0;
+  }
+  type = ((s_Registers[base + 2] & MCP_RXB_IDE_M) ? 0x10 : 0) |
+         ((s_Registers[base] & MCP2515_HOST_RXB_RXRTR) || (s_Registers[base + 5] & MCP_RXB_RTR_M) ? 0x08 : 0);
+  return (uint8_t)(intf << 6) | type | ((base == MCP_RXB1CTRL) ? 0x01 : 0);
+}
+
+/** Chip select of the controller, a transaction starts when it goes low and ends when it goes high
+ *  @param pin Chip select pin
+ *  @param value Level written by the sketch
+ */
+static void mcp2515_host_cs(uint8_t pin, uint8_t value)
+{
+  (void) pin;
+  if (value == LOW)
+  {
+    s_Stats.transactions++;
+    s_SpiState = eMCP_SPI_INSTRUCTION;
+    s_ClearOnDeselect = 0;
+    return;
+  }
+  if (s_ClearOnDeselect != 0)
+  {
+    s_Registers[MCP_CANINTF] &= ~s_ClearOnDeselect;
+    s_ClearOnDeselect = 0;
+    Mcp2515HostUpdateInt();
+  }
+  s_SpiState = eMCP_SPI_IGNORE;
+}
+
+/** Takes the instruction byte of a transaction
+ *  @param instruction Instruction
+ */
+static void Mcp2515HostInstruction(uint8_t instruction)
+{
+  s_Instruction = instruction;
+  if ((instruction == MCP_READ) || (instruction == MCP_WRITE) || (instruction == MCP_BITMOD))
+  {
+    s_SpiState = eMCP_SPI_ADDRESS;
+  }
+  else if (instruction == MCP_READ_STATUS)
+  {
+    s_SpiState = eMCP_SPI_STATUS;
+  }
+  else if (instruction == MCP_RX_STATUS)
+  {
+    s_SpiState = eMCP_SPI_RX_STATUS;
+  }
+  else if ((instruction & MCP2515_HOST_READ_RX_MASK) == MCP_READ_RX0)
+  {
+    // n selects the buffer, m starts at D0 rather than SIDH
+    s_Address = ((instruction & 0x04) ? MCP_RXB1SIDH : MCP_RXB0SIDH) + ((instruction & 0x02) ? 5 : 0);
+    s_ClearOnDeselect = (instruction & 0x04) ? MCP_RX1IF : MCP_RX0IF;
+    s_SpiState = eMCP_SPI_READ;
+  }
+  else if (instruction == MCP_RESET)
+  {
+    Mcp2515HostResetRegisters();
+    s_SpiState = eMCP_SPI_IGNORE;
+  }
+  else // LOAD TX BUFFER, RTS and anything undefined
+  {
+    s_SpiState = eMCP_SPI_IGNORE;
+  }
+}
+
+/** SPI side of the controller, answers each byte sent while its chip select is low
+ *  @param data Byte sent by the MCU
+ *  @return Byte sent back
+ */
+static uint8_t mcp2515_host_spi(uint8_t data)
+{
+  uint8_t out = 0xFF;
+  uint8_t address = 0;
+
+  s_Stats.spiBytes++;
+  switch (s_SpiState)
+  {
+    case eMCP_SPI_INSTRUCTION:
+      Mcp2515HostInstruction(data);
+      break;
+    case eMCP_SPI_ADDRESS:
+      s_Address = data & MCP2515_HOST_ADDRESS_MASK;
+      s_SpiState = (s_Instruction == MCP_READ) ? eMCP_SPI_READ : (s_Instruction == MCP_WRITE) ? eMCP_SPI_WRITE : eMCP_SPI_MASK;
+      break;
+    case eMCP_SPI_READ:
+      out = s_Registers[Mcp2515HostMap(s_Address)];
+      s_Address = (s_Address + 1) & MCP2515_HOST_ADDRESS_MASK;
+      break;
+    case eMCP_SPI_WRITE:
+      Mcp2515HostWrite(s_Address, data);
+      s_Address = (s_Address + 1) & MCP2515_HOST_ADDRESS_MASK;
+      break;
+    case eMCP_SPI_MASK:
+      s_Mask = data;
+      s_SpiState = eMCP_SPI_DATA;
+      break;
+    case eMCP_SPI_DATA:
+      address = Mcp2515HostMap(s_Address);
+      Mcp2515HostWrite(address, (s_Registers[address] & ~s_Mask) | (data & s_Mask));
+      s_SpiState = eMCP_SPI_IGNORE;
+      break;
+    case eMCP_SPI_STATUS:
+      out = Mcp2515HostStatus();
+      break;
+    case eMCP_SPI_RX_STATUS:
+      out = Mcp2515HostRxStatus();
+      break;
+    default:
+      break;
+  }
+  return out;
+}
+
+/** Loads a frame into a receive buffer
+ *  @param base RXBnCTRL of the buffer
+ *  @param *frame Frame received
+ */
+static void Mcp2515HostLoad(uint8_t base, const FLEXCAN_frame_t *frame)
+{
+  uint8_t *buffer = &s_Registers[base];
+  uint8_t dlc = (frame->dlc > 8) ? 8 : frame->dlc;
+
+  buffer[0] &= ~MCP2515_HOST_RXB_RXRTR;
+  if (frame->ide)
+  {
+    buffer[1] = (uint8_t)(frame->id >> 21);
+    buffer[2] = (uint8_t)(((frame->id >> 13) & 0xE0) | MCP_RXB_IDE_M | ((frame->id >> 16) & 0x03));
+    buffer[3] = (uint8_t)(frame->id >> 8);
+    buffer[4] = (uint8_t) frame->id;
+    buffer[5] = dlc | (frame->rtr ? MCP_RXB_RTR_M : 0);
+  }
+  else
+  {
+    buffer[0] |= frame->rtr ? MCP2515_HOST_RXB_RXRTR : 0;
+    buffer[1] = (uint8_t)(frame->id >> 3);
+    buffer[2] = (uint8_t)(((frame->id & 0x07) << 5) | (frame->rtr ? MCP2515_HOST_SIDL_SRR : 0));
+    buffer[3] = 0;
+    buffer[4] = 0;
+    buffer[5] = dlc;
+  }
+  memcpy(&buffer[6], frame->data, 8);
+}
+
+/* ========================================================================= */
+/* Bus side                                                                  */
+/* ========================================================================= */
+
+/** Resets the controller and attaches it to the SPI bus and its pins
+ *  @param csPin Chip select, driven by the sketch
+ *  @param intPin INT pin, driven by the controller
+ */
+void Mcp2515HostReset(uint8_t csPin, uint8_t intPin)
+{
+  memset(&s_Stats, 0, sizeof(s_Stats));
+  s_IntPin = intPin;
+  s_IntLow = false;
+  s_SpiState = eMCP_SPI_IGNORE;
+  s_ClearOnDeselect = 0;
+  HostPinDrive(intPin, HIGH);
+  Mcp2515HostResetRegisters();
+  HostPinAttachOutput(csPin, mcp2515_host_cs);
+  HostSpiAttach(csPin, mcp2515_host_spi);
+}
+
+/** Puts a frame on the bus: it goes into RXB0, into RXB1 when RXB0 is full and BUKT is set, or is
+ *  lost, setting RX0OVR or RX1OVR (and ERRIF) for the buffer it was meant for
+ *  @param *frame Frame that has just ended on the bus
+ *  @return Whether or not the frame was loaded into a receive buffer
+ */
+bool Mcp2515HostReceive(const FLEXCAN_frame_t *frame)
+{
+  uint8_t mode = s_Registers[MCP_CANSTAT] & MODE_MASK;
+  uint8_t overflow = 0;
+
+  s_Stats.framesOffered++;
+  if ((mode != MODE_NORMAL) && (mode != MODE_LISTENONLY) && (mode != MODE_LOOPBACK))
+  {
+    s_Stats.framesIgnored++;
+    return false;
+  }
+  if (!(s_Registers[MCP_CANINTF] & MCP_RX0IF))
+  {
+    Mcp2515HostLoad(MCP_RXB0CTRL, frame);
+    s_Registers[MCP_CANINTF] |= MCP_RX0IF;
+  }
+  else if ((s_Registers[MCP_RXB0CTRL] & MCP_RXB_BUKT_MASK) && !(s_Registers[MCP_CANINTF] & MCP_RX1IF))
+  {
+    Mcp2515HostLoad(MCP_RXB1CTRL, frame);
+    s_Registers[MCP_CANINTF] |= MCP_RX1IF;
+    s_Stats.framesRolledOver++;
+  }
+  else
+  {
+    s_Stats.framesLost++;
+    overflow = (s_Registers[MCP_RXB0CTRL] & MCP_RXB_BUKT_MASK) ? MCP_EFLG_RX1OVR : MCP_EFLG_RX0OVR;
+    if (!(s_Registers[MCP_EFLG] & overflow))
+    {
+      s_Registers[MCP_EFLG] |= overflow;
+      s_Registers[MCP_CANINTF] |= MCP_ERRIF;
+      if (overflow == MCP_EFLG_RX0OVR)
+      {
+        s_Stats.rx0Overflows++;
+      }
+      else
+      {
+        s_Stats.rx1Overflows++;
+      }
+    }
+    Mcp2515HostUpdateInt();
+    return false;
+  }
+  s_Stats.framesReceived++;
+  Mcp2515HostUpdateInt();
+  return true;
+}
+
+/** Gets the statistics of the simulation
+ *  @param *stats Statistics to be filled in
+ */
+void Mcp2515HostGetStats(mcp2515_host_stats_t *stats)
+{
+  *stats = s_Stats;
+}
+
+/** Reads a register without going through the SPI bus
+ *  @param address Register address
+ *  @return Register contents
+ */
+uint8_t Mcp2515HostRegister(uint8_t address)
+{
+  return s_Registers[Mcp2515HostMap(address)];
+}
@@ -0,0 +1,366 @@
+/*
+  * @file Mcp2515Main.cpp
+  *
+  * Benchmarks the MCP2515 receive paths of the CAN-BUS Shield sketches against a simulated
+  * MCP2515 on the SPI bus, with the vehicle traffic model at 500 kbit/s. The polling path is
+  * the loop of the sketches on the mcp_can library (checkReceive, readMsgBuf, getCanId, one
+  * buffer per loop), the interrupt path the same loop taking frames from Mcp2515Reader. Both
+  * loops spend the same time on every frame, and more on the frames they print (the engine
+  * speed frames of Engine_RPM_2014_Nissan_Altima by default); the SPI bus takes 8 bit times
+  * of its clock per byte and the loop a few microseconds per pass. Digital writes to the chip
+  * select are free here, they cost the polling path more than the reader on the device.
+  *
+  * Every frame is checked in order against the frames put on the bus, so frames lost in the
+  * MCP2515, dropped from the ring, taken out of order or read wrong show. The interrupt path
+  * must lose nothing and take fewer SPI bytes per frame than the polling path, which has to
+  * lose frames with the bus at full load (-F). With -m the loop holds the SPI bus (an SD card write)
+  * for a while every so often, holding off the reader until the MCP2515 overflows: the RX0OVR
+  * and RX1OVR flags counted by the reader then have to match the ones the MCP2515 set.
+  *
+  * mcp2515_host_bench [-s seed] [-n frames] [-w us] [-p id:us] [-m hold_us:every_us] [-F] [-v]
+*/
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <HostTest.h>
+#include <SPI.h>
+#include <Mcp2515HostSim.h>
+#include <Mcp2515Reader.h>
+#include <mcp_can.h>
+#include <TrafficModel.h>
+
+/* DEFINES */
+#define MCP2515_TEST_CS_PIN           9         // SPI chip select of the CAN-BUS Shield
+#define MCP2515_TEST_INT_PIN          2         // INT of the CAN-BUS Shield
+#define MCP2515_TEST_FRAMES           20000     // Default number of frames put on the bus
+#define MCP2515_TEST_WORK_US          60        // Default time (us) the loop spends on every frame
+#define MCP2515_TEST_PRINT_ID         0x180     // Default ID of the frames the loop prints (engine speed)
+#define MCP2515_TEST_PRINT_US         1500      // Default time (us) printing a frame takes
+#define MCP2515_TEST_LOOP_US          4         // Time (us) of a pass through the loop besides the frames
+#define MCP2515_TEST_LOG_SIZE         1024      // Frames remembered for the in order check, a power of two
+#define MCP2515_TEST_LOG_MASK         (MCP2515_TEST_LOG_SIZE - 1)
+#define MCP2515_TEST_SETTLE_MS        50        // Time (ms) the loop runs after the last frame
+
+/* ENUMS */
+enum Mcp2515TestPath_e
+{
+  eMCP_TEST_POLLING = 0,                // checkReceive / readMsgBuf in the loop
+  eMCP_TEST_INTERRUPT                   // Mcp2515Reader
+};
+
+/* STRUCTS */
+typedef struct {
+  FLEXCAN_frame_t frame;                // Frame put on the bus
+  uint64_t endUs;                       // Time it ended on the bus
+} mcp2515_test_sent_t;
+
+typedef struct {
+  uint32_t consumed;                    // Frames the loop got
+  uint32_t reordered;                   // Frames the loop got after a later one
+  uint32_t corrupt;                     // Frames the loop got that were never sent
+  uint32_t readerRx0Overflows;          // RX0OVR flags the reader counted
+  uint32_t readerRx1Overflows;          // RX1OVR flags the reader counted
+  uint32_t dropped;                     // Frames the reader read with the ring full
+  uint8_t maxQueued;                    // Most frames in the ring
+  uint64_t latencyTotal;                // Sum of the times (us) from the end of a frame to the loop getting it
+  uint32_t latencyMax;                  // Longest of them (us)
+  mcp2515_host_stats_t mcp;             // What the MCP2515 saw
+} mcp2515_test_result_t;
+
+/* GLOBAL VARIABLES */
+static MCP_CAN CAN(MCP2515_TEST_CS_PIN);
+static mcp2515_reader_t s_Reader;
+
+static uint32_t s_WorkUs = MCP2515_TEST_WORK_US;
+static uint32_t s_PrintId = MCP2515_TEST_PRINT_ID;
+static uint32_t s_PrintUs = MCP2515_TEST_PRINT_US;
+static uint32_t s_HoldUs = 0;           // Time (us) the loop holds the SPI bus, 0 for never
+static uint32_t s_HoldEveryUs = 0;      // Time (us) between two holds
+
+static IntervalTimer s_BusTimer;
+static traffic_model_t s_Traffic;
+static FLEXCAN_frame_t s_TrafficFrame;  // Frame on the bus, received when it ends
+static uint64_t s_TrafficStartUs = 0;   // Host time of the start of the traffic model
+static uint32_t s_FramesToSend = 0;
+static uint32_t s_FramesSent = 0;
+static mcp2515_test_sent_t s_Sent[MCP2515_TEST_LOG_SIZE];
+static uint32_t s_NextExpected = 0;     // Sequence number after the last frame the loop got
+
+/** Callback function for the bus timer: the frame on the bus has ended and is received by the
+ *  MCP2515, the timer is armed for the end of the next one
+ *  Frames of two bytes or more carry their sequence number, so equal frames are told apart
+ */
+static void traffic_timer_callback(void)
+{
+  mcp2515_test_sent_t *sent = &s_Sent[s_FramesSent & MCP2515_TEST_LOG_MASK];
+  uint64_t endNs = 0;
+
+  if ((s_TrafficFrame.dlc >= 2) && !s_TrafficFrame.rtr)
+  {
+    s_TrafficFrame.data[0] = (uint8_t)(s_FramesSent >> 8);
+    s_TrafficFrame.data[1] = (uint8_t) s_FramesSent;
+  }
+  sent->frame = s_TrafficFrame;
+  sent->endUs = HostClockMicros();
+  Mcp2515HostReceive(&s_TrafficFrame);
+  s_FramesSent++;
+  if ((s_FramesSent < s_FramesToSend) && TrafficNextFrame(&s_Traffic, &s_TrafficFrame, &endNs))
+  {
+    s_BusTimer.HostBeginAt(traffic_timer_callback, s_TrafficStartUs + (endNs / 1000));
+  }
+}
+
+/** Checks whether or not a frame the loop got is a frame that was sent
+ *  @param *sent Frame sent
+ *  @param id ID got
+ *  @param ext Whether or not the ID got is extended
+ *  @param len Data length got
+ *  @param *data Payload got
+ *  @return Whether or not they are the same
+ */
+static bool Mcp2515TestSame(const mcp2515_test_sent_t *sent, uint32_t id, uint8_t ext, uint8_t len, const uint8_t *data)
+{
+  return (sent->frame.id == id) && (sent->frame.ide == ext) && (sent->frame.dlc == len) &&
+         (sent->frame.rtr || (memcmp(sent->frame.data, data, len) == 0));
+}
+
+/** Checks a frame the loop got against the frames sent, in order
+ *  Frames skipped over were lost on the way; a frame only found before the last one got came
+ *  out of order, one not found at all was read wrong
+ *  @param *result Results of the run
+ *  @param id ID got
+ *  @param ext Whether or not the ID got is extended
+ *  @param len Data length got
+ *  @param *data Payload got
+ */
+static void Mcp2515TestConsume(mcp2515_test_result_t *result, uint32_t id, uint8_t ext, uint8_t len, const uint8_t *data)
+{
+  uint32_t seq = 0;
+  uint32_t oldest = (s_FramesSent > MCP2515_TEST_LOG_SIZE) ? (s_FramesSent - MCP2515_TEST_LOG_SIZE) : 0;
+  uint32_t latency = 0;
+
+  result->consumed++;
+  for (seq = (s_NextExpected > oldest) ? s_NextExpected : oldest; seq < s_FramesSent; seq++)
+  {
+    if (Mcp2515TestSame(&s_Sent[seq & MCP2515_TEST_LOG_MASK], id, ext, len, data))
+    {
+      latency = (uint32_t)(HostClockMicros() - s_Sent[seq & MCP2515_TEST_LOG_MASK].endUs);
+      result->latencyTotal += latency;
+      if (latency > result->latencyMax)
+      {
+        result->latencyMax = latency;
+      }
+      s_NextExpected = seq + 1;
+      return;
+    }
+  }
+  for (seq = oldest; seq < s_NextExpected; seq++)
+  {
+    if (Mcp2515TestSame(&s_Sent[seq & MCP2515_TEST_LOG_MASK], id, ext, len, data))
+    {
+      result->reordered++;
+      return;
+    }
+  }
+  result->corrupt++;
+  if (g_HostTestVerbose)
+  {
+    printf("frame %lX [%u] not sent\n", (unsigned long) id, len);
+  }
+}
+
+/** Time the loop spends on a frame, printing it or not
+ *  @param id ID of the frame
+ */
+static void Mcp2515TestWork(uint32_t id)
+{
+  delayMicroseconds(s_WorkUs + ((id == s_PrintId) ? s_PrintUs : 0));
+}
+
+/** Holds the SPI bus with the reader held off when it is time, as an SD card write would
+ *  @param *nextHold Time (us) of the next hold
+ */
+static void Mcp2515TestHold(uint64_t *nextHold)
+{
+  if ((s_HoldUs == 0) || (HostClockMicros() < *nextHold))
+  {
+    return;
+  }
+  SPI.beginTransaction(SPISettings());
+  delayMicroseconds(s_HoldUs);
+  SPI.endTransaction();
+  *nextHold = HostClockMicros() + s_HoldEveryUs;
+}
+
+/** Runs the traffic through one of the receive paths
+ *  @param path Mcp2515TestPath_e
+ *  @param seed Seed of the traffic model, the same for both paths
+ *  @param frames Number of frames put on the bus
+ *  @param fullLoad Whether or not idle bus time is filled with frames
+ *  @param *result Results to be filled in
+ */
+static void Mcp2515TestRun(uint8_t path, uint32_t seed, uint32_t frames, bool fullLoad, mcp2515_test_result_t *result)
+{
+  mcp2515_frame_t frame;
+  unsigned char len = 0;
+  unsigned char buf[8];
+  uint64_t endNs = 0;
+  uint64_t nextHold = 0;
+  uint64_t settleUntil = 0;
+
+  memset(result, 0, sizeof(mcp2515_test_result_t));
+  HostPinReset();
+  HostSpiReset();
+  Mcp2515HostReset(MCP2515_TEST_CS_PIN, MCP2515_TEST_INT_PIN);
+  if (CAN.begin(CAN_500KBPS) != CAN_OK)
+  {
+    HostTestFail("CAN.begin failed");
+    return;
+  }
+  if (path == eMCP_TEST_INTERRUPT)
+  {
+    Mcp2515ReaderBegin(&s_Reader, MCP2515_TEST_CS_PIN, MCP2515_TEST_INT_PIN);
+  }
+
+  s_FramesToSend = frames;
+  s_FramesSent = 0;
+  s_NextExpected = 0;
+  TrafficInit(&s_Traffic, &TrafficVehicleProfile, TRAFFIC_BITRATE_500K, fullLoad, seed);
+  s_TrafficStartUs = HostClockMicros();
+  TrafficNextFrame(&s_Traffic, &s_TrafficFrame, &endNs);
+  s_BusTimer.HostBeginAt(traffic_timer_callback, s_TrafficStartUs + (endNs / 1000));
+  nextHold = HostClockMicros() + s_HoldEveryUs;
+
+  // the loop of the sketches, until the bus has been quiet for a while
+  while ((s_FramesSent < s_FramesToSend) || (HostClockMicros() < settleUntil) || (settleUntil == 0))
+  {
+    if ((s_FramesSent >= s_FramesToSend) && (settleUntil == 0))
+    {
+      settleUntil = HostClockMicros() + (MCP2515_TEST_SETTLE_MS * 1000UL);
+    }
+    if (path == eMCP_TEST_POLLING)
+    {
+      if (CAN_MSGAVAIL == CAN.checkReceive())
+      {
+        CAN.readMsgBuf(&len, buf);
+        Mcp2515TestConsume(result, CAN.getCanId(), CAN.isExtendedFrame(), len, buf);
+        Mcp2515TestWork(CAN.getCanId());
+      }
+    }
+    else
+    {
+      while (Mcp2515ReaderRead(&s_Reader, &frame))
+      {
+        Mcp2515TestConsume(result, frame.id, frame.ext, frame.len, frame.data);
+        Mcp2515TestWork(frame.id);
+      }
+    }
+    Mcp2515TestHold(&nextHold);
+    delayMicroseconds(MCP2515_TEST_LOOP_US);
+  }
+  s_BusTimer.end();
+
+  Mcp2515HostGetStats(&result->mcp);
+  if (path == eMCP_TEST_INTERRUPT)
+  {
+    result->readerRx0Overflows = s_Reader.rx0Overflows;
+    result->readerRx1Overflows = s_Reader.rx1Overflows;
+    result->dropped = s_Reader.dropped;
+    result->maxQueued = s_Reader.maxQueued;
+    if (g_HostTestVerbose)
+    {
+      Mcp2515ReaderPrint(&s_Reader, &Serial);
+    }
+  }
+}
+
+/** Prints the results of a run
+ *  @param *name Name of the receive path
+ *  @param *result Results of the run
+ */
+static void Mcp2515TestPrint(const char *name, const mcp2515_test_result_t *result)
+{
+  printf("%-9s %6lu of %6lu frames, %5lu lost in the MCP2515 (RX0OVR %lu, RX1OVR %lu), %4lu dropped, %3lu out of order, "
+         "%5.1f SPI bytes %4.1f transactions per frame, latency %5lu us mean %6lu us max\n", name,
+         (unsigned long) result->consumed, (unsigned long) result->mcp.framesOffered, (unsigned long) result->mcp.framesLost,
+         (unsigned long) result->mcp.rx0Overflows, (unsigned long) result->mcp.rx1Overflows, (unsigned long) result->dropped,
+         (unsigned long) result->reordered, (double) result->mcp.spiBytes / (result->consumed ? result->consumed : 1),
+         (double) result->mcp.transactions / (result->consumed ? result->consumed : 1),
+         (unsigned long)(result->latencyTotal / (result->consumed ? result->consumed : 1)), (unsigned long) result->latencyMax);
+}
+
+/** Reads an option value of the form first:second, second is 0 when it is left out
+ */
+static void Mcp2515TestPair(const char *text, uint32_t *first, uint32_t *second)
+{
+  char *next = NULL;
+
+  if (text != NULL)
+  {
+    *first = strtoul(text, &next, 0);
+    *second = (*next == ':') ? strtoul(next + 1, NULL, 0) : 0;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  mcp2515_test_result_t polling;
+  mcp2515_test_result_t interrupt;
+  uint32_t frames = MCP2515_TEST_FRAMES;
+  uint32_t seed = 1;
+  const char *print = NULL;
+  const char *hold = NULL;
+  bool fullLoad = false;
+  const host_test_option_t options[] =
+  {
+    {'s', eHOST_TEST_UINT, &seed},
+    {'n', eHOST_TEST_UINT, &frames},
+    {'w', eHOST_TEST_UINT, &s_WorkUs},
+    {'p', eHOST_TEST_STRING, &print},
+    {'m', eHOST_TEST_STRING, &hold},
+    {'F', eHOST_TEST_FLAG, &fullLoad}
+  };
+
+  if (!HostTestOptions(argc, argv, "[-s seed] [-n frames] [-w us] [-p id:us] [-m hold_us:every_us] [-F] [-v]", options,
+                       sizeof(options) / sizeof(options[0])))
+  {
+    return 1;
+  }
+  Mcp2515TestPair(print, &s_PrintId, &s_PrintUs);
+  Mcp2515TestPair(hold, &s_HoldUs, &s_HoldEveryUs);
+  if ((frames == 0) || ((s_HoldUs != 0) && (s_HoldEveryUs <= s_HoldUs)))
+  {
+    HostTestUsage();
+    return 1;
+  }
+
+  HostClockUseVirtualTime(true);
+  Mcp2515TestRun(eMCP_TEST_POLLING, seed, frames, fullLoad, &polling);
+  Mcp2515TestRun(eMCP_TEST_INTERRUPT, seed, frames, fullLoad, &interrupt);
+  printf("Bus load:  %.2f %% at %lu bit/s, %lu us per frame, %lu us more printing ID %lX\n", TrafficBusLoad(&s_Traffic) / 100.0,
+         (unsigned long) TRAFFIC_BITRATE_500K, (unsigned long) s_WorkUs, (unsigned long) s_PrintUs, (unsigned long) s_PrintId);
+  if (s_HoldUs != 0)
+  {
+    printf("SPI bus:   held %lu us every %lu us\n", (unsigned long) s_HoldUs, (unsigned long) s_HoldEveryUs);
+  }
+  Mcp2515TestPrint("polling", &polling);
+  Mcp2515TestPrint("interrupt", &interrupt);
+
+  HOST_TEST_CHECK((polling.corrupt == 0) && (interrupt.corrupt == 0), "frames read wrong: %lu polling, %lu interrupt",
+                  (unsigned long) polling.corrupt, (unsigned long) interrupt.corrupt);
+  HOST_TEST_CHECK((interrupt.consumed + interrupt.mcp.framesLost + interrupt.dropped == interrupt.mcp.framesOffered) && (interrupt.reordered == 0),
+                  "interrupt: frames unaccounted for or out of order");
+  HOST_TEST_CHECK((interrupt.readerRx0Overflows == interrupt.mcp.rx0Overflows) && (interrupt.readerRx1Overflows == interrupt.mcp.rx1Overflows),
+                  "interrupt: reader counted RX0OVR %lu, RX1OVR %lu, the MCP2515 set them %lu, %lu times",
+                  (unsigned long) interrupt.readerRx0Overflows, (unsigned long) interrupt.readerRx1Overflows,
+                  (unsigned long) interrupt.mcp.rx0Overflows, (unsigned long) interrupt.mcp.rx1Overflows);
+  HOST_TEST_CHECK((s_HoldUs != 0) || ((interrupt.mcp.framesLost == 0) && (interrupt.dropped == 0)), "interrupt: %lu frames lost, %lu dropped",
+                  (unsigned long) interrupt.mcp.framesLost, (unsigned long) interrupt.dropped);
+  HOST_TEST_CHECK((s_HoldUs != 0) || !fullLoad || (polling.mcp.framesLost != 0), "polling: no frames lost with the bus at full load");
+  HOST_TEST_CHECK((s_HoldUs == 0) || (interrupt.mcp.rx0Overflows + interrupt.mcp.rx1Overflows != 0),
+                  "interrupt: the MCP2515 never overflowed while the SPI bus was held");
+  HOST_TEST_CHECK(interrupt.mcp.spiBytes / (double) interrupt.consumed < polling.mcp.spiBytes / (double)(polling.consumed ? polling.consumed : 1),
+                  "interrupt: no fewer SPI bytes per frame than polling");
+
+  return HostTestSummary();
+}
@@ -0,0 +1,467 @@
+/*
+  * @file ReplayMain.cpp
+  *
+  * Replays captures written by FileWriteMessage through the logger sketch: every frame is put
+  * on the simulated bus and goes through the FIFO interrupt and can_fifo_callback, attack files
+  * are written below the SD root directory. Reports throughput, per-frame latency and drops.
+  *
+  * uds_logger_replay [-m afap|original|scaled] [-x speed] [-d sd_root] [-q] capture...
+  *
+  *   afap      Frames keep their capture timing on a virtual clock, the host runs them as fast
+  *             as it can (the reproducible throughput benchmark)
+  *   original  Frames are put on the bus in real time, at their capture timing
+  *   scaled    Real time, with the capture timing divided by the speed (-x)
+  *
+  * A capture is a file or a directory of .txt files. Frames from every capture are merged in
+  * timestamp order, frames repeated by overlapping attack files are replayed once.
+*/
+
+/* INCLUDES */
+#include <UDSLoggerHost.h>
+#include <CaptureFile.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <time.h>
+
+/* DEFINES */
+#define REPLAY_MAX_FILES              4096      // Number of capture files replayed at once
+#define REPLAY_DEFAULT_SPEED          10.0      // Speed of the scaled mode when -x is not given
+#define REPLAY_DRAIN_LIMIT            60000     // Time (ms) after the last frame before giving up on open sessions
+
+/* ENUMS */
+enum ReplayMode_e {
+  eREPLAY_AFAP = 0,                     // Virtual time, as fast as the host runs
+  eREPLAY_ORIGINAL,                     // Real time, capture timing
+  eREPLAY_SCALED                        // Real time, capture timing divided by the speed
+};
+
+/* STRUCTS */
+typedef struct {
+  can_message_t message;                // Frame as captured
+  uint32_t fileIndex;                   // Capture file the frame came from, in first timestamp order
+  uint32_t lineIndex;                   // Position of the frame in its file
+} replay_frame_t;
+
+/* FUNCTION PROTOTYPES */
+void can0_message_isr(void);
+
+/* GLOBAL VARIABLES */
+static IntervalTimer s_ReplayTimer;
+static char *s_Files[REPLAY_MAX_FILES];
+static uint32_t s_NumFiles = 0;
+static replay_frame_t *s_Frames = NULL;
+static uint64_t *s_ScheduleUs = NULL;   // Time each frame goes on the bus, from the first frame
+static uint32_t *s_LatencyNs = NULL;    // Time from putting each frame on the bus to the end of its interrupt
+static uint32_t s_NumFrames = 0;
+static uint32_t s_FramesSent = 0;
+static uint32_t s_LatencyCount = 0;
+static uint64_t s_StartUs = 0;
+static uint64_t s_InjectNs = 0;
+static bool s_InjectPending = false;
+
+static uint64_t ReplayWallNanos(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t) now.tv_sec * 1000000000ULL) + (uint64_t) now.tv_nsec;
+}
+
+/** Message interrupt of the replay: runs the driver ISR and records the latency of the frame
+ */
+static void replay_message_isr(void)
+{
+  can0_message_isr();
+  if (s_InjectPending && (FlexcanHostFifoCount() == 0))
+  {
+    s_LatencyNs[s_LatencyCount++] = (uint32_t)(ReplayWallNanos() - s_InjectNs);
+    s_InjectPending = false;
+  }
+}
+
+/** Callback function for the replay timer, puts the next frame on the bus and re-arms the
+ *  timer for the one after it
+ */
+static void replay_timer_callback(void)
+{
+  FLEXCAN_frame_t frame;
+  can_message_t *message = &s_Frames[s_FramesSent].message;
+
+  memset(&frame, 0, sizeof(frame));
+  frame.id = message->id;
+  frame.ide = message->ide;
+  frame.srr = frame.ide;
+  frame.dlc = message->len;
+  memcpy(frame.data, message->data, message->len);
+
+  s_InjectNs = ReplayWallNanos();
+  s_InjectPending = FlexcanHostReceive(&frame);
+  s_FramesSent++;
+  if (s_FramesSent < s_NumFrames)
+  {
+    s_ReplayTimer.HostBeginAt(replay_timer_callback, s_StartUs + s_ScheduleUs[s_FramesSent]);
+  }
+}
+
+static int ReplayCompareFrames(const void *a, const void *b)
+{
+  const replay_frame_t *first = (const replay_frame_t *) a;
+  const replay_frame_t *second = (const replay_frame_t *) b;
+
+  if (first->message.timestamp != second->message.timestamp)
+  {
+    return (first->message.timestamp < second->message.timestamp) ? -1 : 1;
+  }
+  if (first->fileIndex != second->fileIndex)
+  {
+    return (first->fileIndex < second->fileIndex) ? -1 : 1;
+  }
+  return (first->lineIndex < second->lineIndex) ? -1 : (first->lineIndex > second->lineIndex);
+}
+
+static int ReplayComparePaths(const void *a, const void *b)
+{
+  return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static bool ReplayAddFile(const char *path)
+{
+  char *copy = NULL;
+
+  if (s_NumFiles == REPLAY_MAX_FILES)
+  {
+    fprintf(stderr, "too many capture files, %s is not replayed\n", path);
+    return false;
+  }
+  copy = strdup(path);
+  if (copy == NULL)
+  {
+    fprintf(stderr, "out of memory, %s is not replayed\n", path);
+    return false;
+  }
+  s_Files[s_NumFiles++] = copy;
+  return true;
+}
+
+/** Frees the capture paths, the merged frames, the schedule and the latencies
+ */
+static void ReplayFree(void)
+{
+  uint32_t fileIndex = 0;
+
+  for (fileIndex = 0; fileIndex < s_NumFiles; fileIndex++)
+  {
+    free(s_Files[fileIndex]);
+  }
+  s_NumFiles = 0;
+  free(s_Frames);
+  free(s_ScheduleUs);
+  free(s_LatencyNs);
+  s_Frames = NULL;
+  s_ScheduleUs = NULL;
+  s_LatencyNs = NULL;
+  s_NumFrames = 0;
+}
+
+static int ReplayAddEntry(const char *path, const struct stat *info, int flag, struct FTW *ftw)
+{
+  size_t length = strlen(path);
+  (void) info;
+  (void) ftw;
+  if ((flag == FTW_F) && (length > 4) && (strcmp(&path[length - 4], ".txt") == 0))
+  {
+    ReplayAddFile(path);
+  }
+  return 0;
+}
+
+/** Adds a capture file, or every .txt file below a directory in name order
+ *  @param *path Capture file or directory
+ *  @return Whether or not the path could be read
+ */
+static bool ReplayAddCapture(const char *path)
+{
+  struct stat info;
+  uint32_t first = s_NumFiles;
+
+  if (stat(path, &info) != 0)
+  {
+    return false;
+  }
+  if (!S_ISDIR(info.st_mode))
+  {
+    return ReplayAddFile(path);
+  }
+  if (nftw(path, ReplayAddEntry, 16, FTW_PHYS) != 0)
+  {
+    return false;
+  }
+  qsort(&s_Files[first], s_NumFiles - first, sizeof(char *), ReplayComparePaths);
+  return true;
+}
+
+/** Loads every capture file and merges the frames in timestamp order
+ *  Frames of one millisecond keep the order of the files, taken by their first timestamp, so a
+ *  Before file goes ahead of its After file. Attack sessions that overlap write the same frames
+ *  to more than one file, a frame that matches one from another file at the same timestamp is
+ *  kept once.
+ *  @param *malformedLines Number of frame lines that could not be parsed
+ *  @return Whether or not every file was loaded
+ */
+static bool ReplayLoad(uint32_t *malformedLines)
+{
+  static capture_t captures[REPLAY_MAX_FILES];
+  static uint32_t order[REPLAY_MAX_FILES];
+  replay_frame_t *frames = NULL;
+  uint32_t fileIndex = 0;
+  uint32_t rank = 0;
+  uint32_t index = 0;
+  uint32_t kept = 0;
+  uint32_t groupStart = 0;
+  uint32_t other = 0;
+  bool duplicate = false;
+
+  *malformedLines = 0;
+  for (fileIndex = 0; fileIndex < s_NumFiles; fileIndex++)
+  {
+    CaptureInit(&captures[fileIndex]);
+    if (!CaptureLoadFile(&captures[fileIndex], s_Files[fileIndex]))
+    {
+      fprintf(stderr, "cannot read capture %s\n", s_Files[fileIndex]);
+      for (index = 0; index <= fileIndex; index++)
+      {
+        CaptureFree(&captures[index]);
+      }
+      return false;
+    }
+    *malformedLines += captures[fileIndex].malformedLines;
+    for (rank = fileIndex; (rank > 0) && (captures[order[rank - 1]].count > 0) &&
+         ((captures[fileIndex].count == 0) || (captures[order[rank - 1]].messages[0].timestamp > captures[fileIndex].messages[0].timestamp)); rank--)
+    {
+      order[rank] = order[rank - 1];
+    }
+    order[rank] = fileIndex;
+  }
+
+  for (rank = 0; rank < s_NumFiles; rank++)
+  {
+    capture_t *capture = &captures[order[rank]];
+    frames = (replay_frame_t *) realloc(s_Frames, (s_NumFrames + capture->count + 1) * sizeof(replay_frame_t));
+    if (frames == NULL)
+    {
+      fprintf(stderr, "out of memory for %lu frames\n", (unsigned long)(s_NumFrames + capture->count));
+      for (; rank < s_NumFiles; rank++)
+      {
+        CaptureFree(&captures[order[rank]]);
+      }
+      return false;
+    }
+    s_Frames = frames;
+    for (index = 0; index < capture->count; index++)
+    {
+      s_Frames[s_NumFrames].message = capture->messages[index];
+      s_Frames[s_NumFrames].fileIndex = rank;
+      s_Frames[s_NumFrames].lineIndex = index;
+      s_NumFrames++;
+    }
+    CaptureFree(capture);
+  }
+  qsort(s_Frames, s_NumFrames, sizeof(replay_frame_t), ReplayCompareFrames);
+
+  for (index = 0; index < s_NumFrames; index++)
+  {
+    if ((kept == 0) || (s_Frames[index].message.timestamp != s_Frames[kept - 1].message.timestamp))
+    {
+      groupStart = kept;
+    }
+    duplicate = false;
+    for (other = groupStart; (other < kept) && !duplicate; other++)
+    {
+      duplicate = (s_Frames[other].fileIndex != s_Frames[index].fileIndex) &&
+                  (memcmp(&s_Frames[other].message, &s_Frames[index].message, sizeof(can_message_t)) == 0);
+    }
+    if (!duplicate)
+    {
+      s_Frames[kept++] = s_Frames[index];
+    }
+  }
+  s_NumFrames = kept;
+  return true;
+}
+
+/** Sets the time each frame goes on the bus
+ *  Captures have millisecond timestamps, the frames of one millisecond are spread evenly over it
+ *  @param speed Capture timing is divided by this
+ *  @return Whether or not the schedule could be allocated
+ */
+static bool ReplaySchedule(double speed)
+{
+  uint32_t index = 0;
+  uint32_t groupStart = 0;
+  uint32_t groupEnd = 0;
+  uint32_t first = s_Frames[0].message.timestamp;
+  uint64_t offsetUs = 0;
+
+  s_ScheduleUs = (uint64_t *) malloc(s_NumFrames * sizeof(uint64_t));
+  if (s_ScheduleUs == NULL)
+  {
+    return false;
+  }
+  while (groupStart < s_NumFrames)
+  {
+    groupEnd = groupStart;
+    while ((groupEnd < s_NumFrames) && (s_Frames[groupEnd].message.timestamp == s_Frames[groupStart].message.timestamp))
+    {
+      groupEnd++;
+    }
+    for (index = groupStart; index < groupEnd; index++)
+    {
+      offsetUs = ((uint64_t)(s_Frames[index].message.timestamp - first) * 1000) + (((index - groupStart) * 1000) / (groupEnd - groupStart));
+      s_ScheduleUs[index] = (uint64_t)(offsetUs / speed);
+    }
+    groupStart = groupEnd;
+  }
+  return true;
+}
+
+static int ReplayCompareLatency(const void *a, const void *b)
+{
+  uint32_t first = *(const uint32_t *) a;
+  uint32_t second = *(const uint32_t *) b;
+  return (first < second) ? -1 : (first > second);
+}
+
+static uint32_t ReplayPercentile(double percentile)
+{
+  uint32_t index = 0;
+  if (s_LatencyCount == 0)
+  {
+    return 0;
+  }
+  index = (uint32_t)((percentile / 100.0) * (s_LatencyCount - 1) + 0.5);
+  return s_LatencyNs[index];
+}
+
+static void ReplayUsage(const char *program)
+{
+  fprintf(stderr, "usage: %s [-m afap|original|scaled] [-x speed] [-d sd_root] [-q] capture...\n", program);
+}
+
+int main(int argc, char **argv)
+{
+  ReplayMode_e mode = eREPLAY_AFAP;
+  double speed = 0;
+  uint32_t malformedLines = 0;
+  uint32_t drops = 0;
+  uint32_t drainStart = 0;
+  uint64_t wallStart = 0;
+  uint64_t wallEnd = 0;
+  double wallSeconds = 0;
+  bool passed = false;
+  flexcan_host_stats_t stats;
+  int option = 0;
+
+  while ((option = getopt(argc, argv, "m:x:d:q")) != -1)
+  {
+    switch (option)
+    {
+      case 'm':
+      {
+        if (strcmp(optarg, "afap") == 0) { mode = eREPLAY_AFAP; }
+        else if (strcmp(optarg, "original") == 0) { mode = eREPLAY_ORIGINAL; }
+        else if (strcmp(optarg, "scaled") == 0) { mode = eREPLAY_SCALED; }
+        else { ReplayUsage(argv[0]); return 1; }
+        break;
+      }
+      case 'x': { speed = strtod(optarg, NULL); break; }
+      case 'd': { SdFatHostSetRoot(optarg); break; }
+      case 'q': { HostSerialSetOutput(NULL); break; }
+      default:
+      {
+        ReplayUsage(argv[0]);
+        return 1;
+      }
+    }
+  }
+  if (speed == 0)
+  {
+    speed = (mode == eREPLAY_SCALED) ? REPLAY_DEFAULT_SPEED : 1.0;
+  }
+  if ((optind == argc) || (speed < 0))
+  {
+    ReplayUsage(argv[0]);
+    return 1;
+  }
+  for (; optind < argc; optind++)
+  {
+    if (!ReplayAddCapture(argv[optind]))
+    {
+      fprintf(stderr, "cannot read capture %s\n", argv[optind]);
+      ReplayFree();
+      return 1;
+    }
+  }
+  if (!ReplayLoad(&malformedLines) || (s_NumFrames == 0))
+  {
+    fprintf(stderr, "no frames to replay\n");
+    ReplayFree();
+    return 1;
+  }
+  s_LatencyNs = (uint32_t *) malloc(s_NumFrames * sizeof(uint32_t));
+  if (!ReplaySchedule((mode == eREPLAY_AFAP) ? 1.0 : speed) || (s_LatencyNs == NULL))
+  {
+    fprintf(stderr, "out of memory for %lu frames\n", (unsigned long) s_NumFrames);
+    ReplayFree();
+    return 1;
+  }
+
+  HostClockUseVirtualTime(mode == eREPLAY_AFAP);
+  FlexcanHostReset();
+  HostIrqAttach(IRQ_CAN_MESSAGE, replay_message_isr);
+  setup();
+
+  // in virtual time the logger stamps frames with their capture timestamps
+  s_StartUs = HostClockMicros();
+  if ((mode == eREPLAY_AFAP) && (s_StartUs < ((uint64_t) s_Frames[0].message.timestamp * 1000)))
+  {
+    s_StartUs = (uint64_t) s_Frames[0].message.timestamp * 1000;
+  }
+  wallStart = ReplayWallNanos();
+  s_ReplayTimer.HostBeginAt(replay_timer_callback, s_StartUs);
+  while (s_FramesSent < s_NumFrames)
+  {
+    loop();
+  }
+  wallEnd = ReplayWallNanos();
+
+  // let every open session reach the end of its window on an idle bus
+  drainStart = millis();
+  while ((SessionActiveCount(&g_Sessions) > 0) && ((millis() - drainStart) < REPLAY_DRAIN_LIMIT))
+  {
+    loop();
+  }
+
+  wallSeconds = (wallEnd - wallStart) / 1e9;
+  qsort(s_LatencyNs, s_LatencyCount, sizeof(uint32_t), ReplayCompareLatency);
+  FlexcanHostGetStats(&stats);
+  drops = stats.fifoOverflows + stats.framesIgnored + g_Sessions.droppedFrames;
+
+  printf("Capture files:          %lu\n", (unsigned long) s_NumFiles);
+  printf("Malformed lines:        %lu\n", (unsigned long) malformedLines);
+  printf("Frames replayed:        %lu\n", (unsigned long) s_NumFrames);
+  printf("Frames received:        %lu\n", (unsigned long) stats.framesReceived);
+  printf("FIFO overflows:         %lu\n", (unsigned long) stats.fifoOverflows);
+  printf("Frames ignored:         %lu\n", (unsigned long) stats.framesIgnored);
+  printf("Frames stored:          %lu\n", (unsigned long) g_Model.totalMsgCount);
+  printf("Frames dropped (ring):  %lu\n", (unsigned long) g_Sessions.droppedFrames);
+  printf("Attack sessions:        %lu\n", (unsigned long) g_Sessions.sessionCount);
+  printf("Sessions still open:    %u\n", SessionActiveCount(&g_Sessions));
+  printf("Replay time:            %.3f s (%.0f frames/s)\n", wallSeconds, (wallSeconds > 0) ? (s_NumFrames / wallSeconds) : 0.0);
+  printf("Latency (ns):           p50 %lu  p90 %lu  p99 %lu  p99.9 %lu  max %lu\n",
+         (unsigned long) ReplayPercentile(50), (unsigned long) ReplayPercentile(90), (unsigned long) ReplayPercentile(99),
+         (unsigned long) ReplayPercentile(99.9), (unsigned long) ReplayPercentile(100));
+  printf("Files written to:       %s/%s\n", SdFatHostRoot(), g_Timestamp);
+
+  passed = (drops == 0) && (SessionActiveCount(&g_Sessions) == 0);
+  ReplayFree();
+  return passed ? 0 : 1;
+}
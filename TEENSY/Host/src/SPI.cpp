@@ -0,0 +1,135 @@
+/*
+  * @file SPI.cpp
+  *
+  * Host stand-in for the SPI library
+*/
+
+/* INCLUDES */
+#include <SPI.h>
+
+/* STRUCTS */
+typedef struct {
+  uint8_t csPin;                        // Chip select, the device listens while it is low
+  HostSpiDevice device;                 // Answers each byte sent
+} spi_host_device_t;
+
+/* GLOBAL VARIABLES */
+SPIClass SPI;
+
+static spi_host_device_t s_Devices[SPI_HOST_MAX_DEVICES];
+static uint8_t s_NumDevices = 0;
+static uint32_t s_ClockHz = SPI_HOST_CLOCK;     // SPI clock of the transaction, or the one SPI.begin() sets
+static uint32_t s_ClockNs = 0;                  // Bus time (ns) not yet taken off the host clock
+static uint32_t s_Bytes = 0;                    // Bytes transferred
+static bool s_UsingInterrupt = false;           // Whether or not transactions hold off the pin interrupts
+static bool s_MaskedInterrupt = false;          // Whether or not the current transaction masked them
+
+void SPIClass::begin(void)
+{
+  s_ClockHz = SPI_HOST_CLOCK;
+}
+
+/** Takes the SPI bus for a device, holding off the pin interrupts registered with usingInterrupt
+ *  @param settings SPI clock of the device
+ */
+void SPIClass::beginTransaction(SPISettings settings)
+{
+  if (s_UsingInterrupt && !HostInInterrupt() && HostNvicIsEnabled(IRQ_PORT_PINS))
+  {
+    HostNvicEnable(IRQ_PORT_PINS, false);
+    s_MaskedInterrupt = true;
+  }
+  s_ClockHz = (settings.clock != 0) ? settings.clock : SPI_HOST_CLOCK;
+}
+
+/** Gives the SPI bus back, an edge seen meanwhile runs its interrupt now
+ */
+void SPIClass::endTransaction(void)
+{
+  if (s_MaskedInterrupt)
+  {
+    s_MaskedInterrupt = false;
+    HostNvicEnable(IRQ_PORT_PINS, true);
+  }
+}
+
+/** Registers an interrupt that uses the SPI bus, transactions started outside it hold it off
+ *  @param interruptNumber digitalPinToInterrupt of the pin, every pin interrupt on the host
+ */
+void SPIClass::usingInterrupt(uint8_t interruptNumber)
+{
+  (void) interruptNumber;
+  s_UsingInterrupt = true;
+}
+
+/** Sends a byte and reads the one the selected device sends back at the same time
+ *  @param data Byte to be sent
+ *  @return Byte received, 0xFF with no device selected (MISO pulled up)
+ */
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  uint8_t index = 0;
+  uint8_t received = 0xFF;
+
+  for (index = 0; index < s_NumDevices; index++)
+  {
+    if (digitalRead(s_Devices[index].csPin) == LOW)
+    {
+      received = s_Devices[index].device(data);
+      break;
+    }
+  }
+  s_Bytes++;
+  s_ClockNs += (uint32_t)(8000000000ULL / s_ClockHz);
+  if (s_ClockNs >= 1000)
+  {
+    HostClockAdvanceMicros(s_ClockNs / 1000);
+    s_ClockNs %= 1000;
+  }
+  return received;
+}
+
+void SPIClass::transfer(void *buf, size_t count)
+{
+  uint8_t *bytes = (uint8_t *) buf;
+  size_t index = 0;
+
+  for (index = 0; index < count; index++)
+  {
+    bytes[index] = transfer(bytes[index]);
+  }
+}
+
+/** Attaches a simulated device to the SPI bus
+ *  @param csPin Chip select of the device, driven by the sketch
+ *  @param device Called with each byte sent while the chip select is low
+ */
+void HostSpiAttach(uint8_t csPin, HostSpiDevice device)
+{
+  if (s_NumDevices < SPI_HOST_MAX_DEVICES)
+  {
+    s_Devices[s_NumDevices].csPin = csPin;
+    s_Devices[s_NumDevices].device = device;
+    s_NumDevices++;
+  }
+}
+
+/** Detaches every device and forgets the bytes counted
+ */
+void HostSpiReset(void)
+{
+  s_NumDevices = 0;
+  s_ClockHz = SPI_HOST_CLOCK;
+  s_ClockNs = 0;
+  s_Bytes = 0;
+  s_UsingInterrupt = false;
+  s_MaskedInterrupt = false;
+}
+
+/** Gets the number of bytes transferred since the last HostSpiReset
+ *  @return Bytes transferred
+ */
+uint32_t HostSpiBytes(void)
+{
+  return s_Bytes;
+}
@@ -0,0 +1,362 @@
+/*
+  * @file SdFat.cpp
+  *
+  * Host stand-in for the SdFat library, backed by a local directory
+*/
+
+/* INCLUDES */
+#include <SdFat.h>
+#include <errno.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+
+/* GLOBAL VARIABLES */
+static char s_Root[SD_HOST_ROOT_SIZE] = "";
+static bool s_CardPresent = true;
+static uint32_t s_CloseTime = 0;      // Time (us) a close holds the caller
+static bool s_DiscardWrites = false;  // Files opened for writing drop their bytes
+
+/** Sets the local directory that stands in for the card
+ *  @param *directory Directory, created when the card is initialized
+ */
+void SdFatHostSetRoot(const char *directory)
+{
+  snprintf(s_Root, sizeof(s_Root), "%s", directory);
+}
+
+/** Gets the local directory that stands in for the card
+ *  @return Directory path
+ */
+const char *SdFatHostRoot(void)
+{
+  const char *environment = NULL;
+  if (s_Root[0] == '\0')
+  {
+    environment = getenv("JEDI_SD_ROOT");
+    SdFatHostSetRoot((environment != NULL) ? environment : "sdcard");
+  }
+  return s_Root;
+}
+
+/** Maps a path on the card to a path on the host
+ *  @param *hostPath Host path to be set
+ *  @param size Size of the host path
+ *  @param *path Path on the card
+ */
+void SdFatHostPath(char *hostPath, size_t size, const char *path)
+{
+  while (*path == '/')
+  {
+    path++;
+  }
+  snprintf(hostPath, size, "%s/%s", SdFatHostRoot(), path);
+}
+
+/** Inserts or removes the simulated card
+ *  @param present Whether or not the card responds
+ */
+void SdFatHostSetCardPresent(bool present)
+{
+  s_CardPresent = present;
+}
+
+/** Sets the time a close takes, the card writing out its buffers
+ *  @param us Time (us) every close holds the caller, 0 for none
+ */
+void SdFatHostSetCloseTime(uint32_t us)
+{
+  s_CloseTime = us;
+}
+
+/** Makes the files opened for writing from now on drop their bytes: writes still go through the
+ *  stdio buffer and syncs still flush it, but nothing reaches the host disk
+ *  @param discard Whether or not written bytes are dropped
+ */
+void SdFatHostSetDiscardWrites(bool discard)
+{
+  s_DiscardWrites = discard;
+}
+
+/** Write function of a discarding file, takes every byte */
+static ssize_t SdFatHostDiscard(void *cookie, const char *buffer, size_t size)
+{
+  (void) cookie;
+  (void) buffer;
+  return (ssize_t) size;
+}
+
+/** Creates a directory and all of its parents
+ *  @param *path Host path of the directory
+ *  @return Whether or not the directory exists afterwards
+ */
+static bool SdFatHostMakePath(const char *path)
+{
+  char partial[SD_HOST_PATH_SIZE];
+  size_t index = 0;
+
+  snprintf(partial, sizeof(partial), "%s", path);
+  for (index = 1; partial[index] != '\0'; index++)
+  {
+    if (partial[index] == '/')
+    {
+      partial[index] = '\0';
+      ::mkdir(partial, 0777);
+      partial[index] = '/';
+    }
+  }
+  return (::mkdir(partial, 0777) == 0) || (errno == EEXIST);
+}
+
+static int SdFatHostRemoveEntry(const char *path, const struct stat *info, int flag, struct FTW *ftw)
+{
+  (void) info;
+  (void) flag;
+  if (ftw->level == 0) // keep the directory itself
+  {
+    return 0;
+  }
+  return ::remove(path);
+}
+
+/* ========================================================================= */
+/* SdFile                                                                    */
+/* ========================================================================= */
+
+bool SdFile::open(const char *path, int oflag)
+{
+  char hostPath[SD_HOST_PATH_SIZE];
+  const char *mode = "rb";
+  int access = oflag & O_ACCMODE;
+
+  close();
+  if (!s_CardPresent)
+  {
+    return false;
+  }
+  SdFatHostPath(hostPath, sizeof(hostPath), path);
+  if ((access != O_RDONLY) && s_DiscardWrites)
+  {
+    cookie_io_functions_t discard = {NULL, SdFatHostDiscard, NULL, NULL};
+    m_file = fopencookie(NULL, "w", discard);
+    snprintf(m_path, sizeof(m_path), "%s", path);
+    m_writeError = false;
+    return m_file != NULL;
+  }
+  if (access != O_RDONLY)
+  {
+    if (oflag & O_TRUNC)
+    {
+      mode = "wb+";
+    }
+    else if (oflag & (O_AT_END | O_APPEND))
+    {
+      mode = (oflag & O_CREAT) ? "ab+" : "rb+";
+    }
+    else
+    {
+      mode = "rb+";
+    }
+  }
+  m_file = fopen(hostPath, mode);
+  if ((m_file == NULL) && (access != O_RDONLY) && (oflag & O_CREAT))
+  {
+    m_file = fopen(hostPath, "wb+");
+  }
+  if (m_file == NULL)
+  {
+    return false;
+  }
+  if (oflag & O_AT_END)
+  {
+    fseek(m_file, 0, SEEK_END);
+  }
+  snprintf(m_path, sizeof(m_path), "%s", path);
+  m_writeError = false;
+  return true;
+}
+
+bool SdFile::close(void)
+{
+  bool status = true;
+  if (m_file != NULL)
+  {
+    status = (fclose(m_file) == 0) && s_CardPresent; // a removed card loses what was not synced
+    m_file = NULL;
+    if (s_CloseTime > 0)
+    {
+      HostClockAdvanceMicros(s_CloseTime);
+    }
+  }
+  return status;
+}
+
+bool SdFile::sync(void)
+{
+  return (m_file != NULL) && (fflush(m_file) == 0);
+}
+
+int SdFile::read(void)
+{
+  int c = EOF;
+  if (m_file != NULL)
+  {
+    c = fgetc(m_file);
+  }
+  return (c == EOF) ? -1 : c;
+}
+
+int SdFile::available(void)
+{
+  long position = 0;
+  if (m_file == NULL)
+  {
+    return 0;
+  }
+  position = ftell(m_file);
+  return (int)(fileSize() - (uint32_t) position);
+}
+
+uint32_t SdFile::fileSize(void)
+{
+  struct stat info;
+  if ((m_file == NULL) || (fflush(m_file) != 0) || (fstat(fileno(m_file), &info) != 0))
+  {
+    return 0;
+  }
+  return (uint32_t) info.st_size;
+}
+
+/** Cuts the file to a length, writes go on at the new end
+ *  @param length Length (bytes)
+ *  @return Whether or not the file was cut
+ */
+bool SdFile::truncate(uint32_t length)
+{
+  if ((m_file == NULL) || !s_CardPresent || (fflush(m_file) != 0) || (ftruncate(fileno(m_file), length) != 0))
+  {
+    return false;
+  }
+  return fseek(m_file, length, SEEK_SET) == 0;
+}
+
+/** Removes everything below this directory (the card root for SdFat::vwd())
+ *  @return Whether or not everything was removed
+ */
+bool SdFile::rmRfStar(void)
+{
+  char hostPath[SD_HOST_PATH_SIZE];
+  if (!s_CardPresent)
+  {
+    return false;
+  }
+  SdFatHostPath(hostPath, sizeof(hostPath), m_path);
+  return nftw(hostPath, SdFatHostRemoveEntry, 16, FTW_DEPTH | FTW_PHYS) == 0;
+}
+
+bool SdFile::timestamp(uint8_t flags, uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second)
+{
+  char hostPath[SD_HOST_PATH_SIZE];
+  struct tm fields;
+  struct utimbuf times;
+  time_t t = 0;
+
+  if (!s_CardPresent || (m_path[0] == '\0'))
+  {
+    return false;
+  }
+  memset(&fields, 0, sizeof(fields));
+  fields.tm_year = year - 1900;
+  fields.tm_mon = month - 1;
+  fields.tm_mday = day;
+  fields.tm_hour = hour;
+  fields.tm_min = minute;
+  fields.tm_sec = second;
+  fields.tm_isdst = -1;
+  t = mktime(&fields);
+  SdFatHostPath(hostPath, sizeof(hostPath), m_path);
+  times.actime = t;
+  times.modtime = t;
+  if (!(flags & (T_ACCESS | T_WRITE)))
+  {
+    return true; // creation time is not kept by the host file system
+  }
+  return utime(hostPath, &times) == 0;
+}
+
+size_t SdFile::write(uint8_t c)
+{
+  if ((m_file == NULL) || !s_CardPresent || (fputc(c, m_file) == EOF))
+  {
+    m_writeError = true;
+    return 0;
+  }
+  return 1;
+}
+
+size_t SdFile::write(const uint8_t *buffer, size_t size)
+{
+  size_t written = 0;
+  if ((m_file == NULL) || !s_CardPresent)
+  {
+    m_writeError = true;
+    return 0;
+  }
+  written = fwrite(buffer, 1, size, m_file);
+  if (written != size)
+  {
+    m_writeError = true;
+  }
+  return written;
+}
+
+void SdFile::dateTimeCallback(void (*callback)(uint16_t *date, uint16_t *time))
+{
+  (void) callback; // the host file system stamps files itself
+}
+
+/* ========================================================================= */
+/* Sd2Card and SdFat                                                         */
+/* ========================================================================= */
+
+bool Sd2Card::readOCR(uint32_t *ocr)
+{
+  if (!s_CardPresent)
+  {
+    return false;
+  }
+  *ocr = 0xC0FF8000; // powered up, high capacity, 2.7 - 3.6 V
+  return true;
+}
+
+bool SdFat::begin(uint8_t chipSelect, uint8_t spiSpeed)
+{
+  (void) chipSelect;
+  (void) spiSpeed;
+  return s_CardPresent && SdFatHostMakePath(SdFatHostRoot());
+}
+
+bool SdFat::exists(const char *path)
+{
+  char hostPath[SD_HOST_PATH_SIZE];
+  struct stat info;
+  SdFatHostPath(hostPath, sizeof(hostPath), path);
+  return s_CardPresent && (stat(hostPath, &info) == 0);
+}
+
+bool SdFat::mkdir(const char *path)
+{
+  char hostPath[SD_HOST_PATH_SIZE];
+  SdFatHostPath(hostPath, sizeof(hostPath), path);
+  return s_CardPresent && SdFatHostMakePath(hostPath);
+}
+
+bool SdFat::remove(const char *path)
+{
+  char hostPath[SD_HOST_PATH_SIZE];
+  SdFatHostPath(hostPath, sizeof(hostPath), path);
+  return s_CardPresent && (::remove(hostPath) == 0);
+}
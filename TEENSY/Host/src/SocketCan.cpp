@@ -0,0 +1,346 @@
+/*
+  * @file SocketCan.cpp
+  *
+  * Linux SocketCAN input: raw CAN sockets read in batches (recvmmsg) with kernel receive
+  * timestamps, and a load sender that puts the vehicle traffic model on an interface.
+  * Kept apart from the logger headers, glibc declares its own error_t next to the socket API.
+*/
+
+/* INCLUDES */
+#include <SocketCan.h>
+#include "TrafficModel.h"
+#include <errno.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* DEFINES */
+#define SOCKETCAN_CONTROL_SIZE        (CMSG_SPACE(sizeof(struct scm_timestamping)) + CMSG_SPACE(sizeof(uint32_t)))
+
+/* GLOBAL VARIABLES */
+static bool s_HaveStampBase = false;
+static uint64_t s_StampBaseNs = 0;      // Kernel time of the first frame
+static uint32_t s_StampBaseMs = 0;      // Logger time (millis) of the first frame
+
+/** Host monotonic time
+ *  @return Time (ns)
+ */
+uint64_t SocketCanNanos(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t) now.tv_sec * 1000000000ULL) + (uint64_t) now.tv_nsec;
+}
+
+/** Describes why the last socket call failed
+ *  @return Error text
+ */
+const char *SocketCanLastError(void)
+{
+  return strerror(errno);
+}
+
+/** Opens a raw CAN socket bound to an interface
+ *  @param *interface Interface name
+ *  @param receive Whether or not the socket receives (timestamps, drop counter, large buffer)
+ *  @return Socket, -1 when it cannot be opened
+ */
+int SocketCanOpen(const char *interface, bool receive)
+{
+  struct sockaddr_can address;
+  struct ifreq request;
+  int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+              SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+  int enable = 1;
+  int size = SOCKETCAN_RCVBUF_SIZE;
+  int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+
+  if (fd < 0)
+  {
+    return -1;
+  }
+  memset(&request, 0, sizeof(request));
+  snprintf(request.ifr_name, sizeof(request.ifr_name), "%s", interface);
+  if (ioctl(fd, SIOCGIFINDEX, &request) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  if (receive)
+  {
+    // raise the buffer past rmem_max when allowed, the plain request is capped by it
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+    {
+      setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0)
+    {
+      setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+    }
+  }
+  else
+  {
+    setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0); // send only
+  }
+  memset(&address, 0, sizeof(address));
+  address.can_family = AF_CAN;
+  address.can_ifindex = request.ifr_ifindex;
+  if (bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/** Closes a socket opened by SocketCanOpen
+ *  @param fd Socket
+ */
+void SocketCanClose(int fd)
+{
+  close(fd);
+}
+
+/** Waits for frames on a socket
+ *  @param fd Socket
+ *  @param timeoutMs Longest wait (ms)
+ *  @return Whether or not frames are waiting
+ */
+bool SocketCanWaitReadable(int fd, int timeoutMs)
+{
+  struct pollfd readable;
+  readable.fd = fd;
+  readable.events = POLLIN;
+  readable.revents = 0;
+  return poll(&readable, 1, timeoutMs) > 0;
+}
+
+/** Converts a kernel receive time to logger time (ms), counted from the first frame so the
+ *  hardware clock and the kernel clock both line up with millis()
+ */
+static uint32_t SocketCanStampToMillis(uint64_t stampNs)
+{
+  if (!s_HaveStampBase)
+  {
+    s_StampBaseNs = stampNs;
+    s_StampBaseMs = millis();
+    s_HaveStampBase = true;
+  }
+  return s_StampBaseMs + (uint32_t)((stampNs - s_StampBaseNs) / 1000000ULL);
+}
+
+/** Reads the receive time and the drop counter from the control messages of a frame
+ *  @param *header Message header of the frame
+ *  @param *stats Receive statistics to be updated
+ *  @return Logger time (ms) the frame was received
+ */
+static uint32_t SocketCanReadControl(struct msghdr *header, socketcan_stats_t *stats)
+{
+  struct cmsghdr *control = NULL;
+  struct scm_timestamping *stamps = NULL;
+  struct timespec *stamp = NULL;
+  uint32_t drops = 0;
+
+  for (control = CMSG_FIRSTHDR(header); control != NULL; control = CMSG_NXTHDR(header, control))
+  {
+    if (control->cmsg_level != SOL_SOCKET)
+    {
+      continue;
+    }
+    if (control->cmsg_type == SO_TIMESTAMPING)
+    {
+      stamps = (struct scm_timestamping *) CMSG_DATA(control);
+      if ((stamps->ts[2].tv_sec != 0) || (stamps->ts[2].tv_nsec != 0))
+      {
+        stamp = &stamps->ts[2];
+        stats->hardwareStamps++;
+      }
+      else
+      {
+        stamp = &stamps->ts[0];
+        stats->softwareStamps++;
+      }
+    }
+    else if (control->cmsg_type == SO_TIMESTAMPNS)
+    {
+      stamp = (struct timespec *) CMSG_DATA(control);
+      stats->softwareStamps++;
+    }
+    else if (control->cmsg_type == SO_RXQ_OVFL)
+    {
+      memcpy(&drops, CMSG_DATA(control), sizeof(drops));
+      stats->kernelDrops = drops;
+    }
+  }
+  if (stamp == NULL)
+  {
+    return millis();
+  }
+  return SocketCanStampToMillis(((uint64_t) stamp->tv_sec * 1000000000ULL) + (uint64_t) stamp->tv_nsec);
+}
+
+/** Reads every frame waiting on the socket, a batch per system call, and hands each data
+ *  frame to the handler with its kernel receive time
+ *  @param fd Socket
+ *  @param batch Number of frames per recvmmsg call
+ *  @param handler Function given every data frame
+ *  @param *stats Receive statistics to be updated
+ *  @return Number of frames read
+ */
+uint32_t SocketCanReceive(int fd, uint16_t batch, SocketCanHandler handler, socketcan_stats_t *stats)
+{
+  static struct mmsghdr messages[SOCKETCAN_MAX_BATCH];
+  static struct iovec vectors[SOCKETCAN_MAX_BATCH];
+  static struct can_frame frames[SOCKETCAN_MAX_BATCH];
+  static uint8_t controls[SOCKETCAN_MAX_BATCH][SOCKETCAN_CONTROL_SIZE];
+  can_message_t message;
+  uint32_t total = 0;
+  uint16_t index = 0;
+  int count = 0;
+
+  do
+  {
+    for (index = 0; index < batch; index++)
+    {
+      vectors[index].iov_base = &frames[index];
+      vectors[index].iov_len = sizeof(struct can_frame);
+      memset(&messages[index].msg_hdr, 0, sizeof(struct msghdr));
+      messages[index].msg_hdr.msg_iov = &vectors[index];
+      messages[index].msg_hdr.msg_iovlen = 1;
+      messages[index].msg_hdr.msg_control = controls[index];
+      messages[index].msg_hdr.msg_controllen = SOCKETCAN_CONTROL_SIZE;
+    }
+    count = recvmmsg(fd, messages, batch, MSG_DONTWAIT, NULL);
+    if (count <= 0)
+    {
+      break;
+    }
+    stats->batches++;
+    for (index = 0; index < count; index++)
+    {
+      struct can_frame *frame = &frames[index];
+      if ((messages[index].msg_len != sizeof(struct can_frame)) || (frame->can_id & (CAN_ERR_FLAG | CAN_RTR_FLAG)))
+      {
+        stats->framesSkipped++;
+        continue;
+      }
+      message.timestamp = SocketCanReadControl(&messages[index].msg_hdr, stats);
+      message.ide = (frame->can_id & CAN_EFF_FLAG) ? 1 : 0;
+      message.id = frame->can_id & (message.ide ? CAN_EFF_MASK : CAN_SFF_MASK);
+      message.len = (frame->can_dlc > 8) ? 8 : frame->can_dlc;
+      memset(message.data, 0, sizeof(message.data));
+      memcpy(message.data, frame->data, message.len);
+      handler(&message);
+      stats->framesReceived++;
+    }
+    total += count;
+  } while (count == batch);
+
+  if (total > 0)
+  {
+    stats->lastFrameNs = SocketCanNanos();
+    if (stats->firstFrameNs == 0)
+    {
+      stats->firstFrameNs = stats->lastFrameNs;
+    }
+  }
+  return total;
+}
+
+/** Sends the vehicle traffic model at 100% load on the interface, as fast as it takes frames
+ *  @param *argument Load description
+ */
+static void *SocketCanLoadThread(void *argument)
+{
+  socketcan_load_t *load = (socketcan_load_t *) argument;
+  static struct mmsghdr messages[SOCKETCAN_MAX_BATCH];
+  static struct iovec vectors[SOCKETCAN_MAX_BATCH];
+  static struct can_frame frames[SOCKETCAN_MAX_BATCH];
+  traffic_model_t model;
+  FLEXCAN_frame_t frame;
+  struct pollfd writable;
+  uint64_t endNs = 0;
+  uint16_t count = 0;
+  uint16_t index = 0;
+  int sent = 0;
+  int fd = SocketCanOpen(load->interface, false);
+
+  if (fd < 0)
+  {
+    load->done = true;
+    return NULL;
+  }
+  TrafficInit(&model, &TrafficVehicleProfile, SOCKETCAN_LOAD_BITRATE, true, 1);
+  writable.fd = fd;
+  writable.events = POLLOUT;
+  while (!load->stop && (load->framesSent < load->numFrames) && (sent >= 0))
+  {
+    count = ((load->numFrames - load->framesSent) < SOCKETCAN_DEFAULT_BATCH) ? (load->numFrames - load->framesSent) : SOCKETCAN_DEFAULT_BATCH;
+    for (index = 0; index < count; index++)
+    {
+      TrafficNextFrame(&model, &frame, &endNs);
+      memset(&frames[index], 0, sizeof(struct can_frame));
+      frames[index].can_id = frame.ide ? (frame.id | CAN_EFF_FLAG) : frame.id;
+      frames[index].can_dlc = frame.dlc;
+      memcpy(frames[index].data, frame.data, frame.dlc);
+      vectors[index].iov_base = &frames[index];
+      vectors[index].iov_len = sizeof(struct can_frame);
+      memset(&messages[index].msg_hdr, 0, sizeof(struct msghdr));
+      messages[index].msg_hdr.msg_iov = &vectors[index];
+      messages[index].msg_hdr.msg_iovlen = 1;
+    }
+    index = 0;
+    sent = 0;
+    while (!load->stop && (index < count) && (sent >= 0))
+    {
+      sent = sendmmsg(fd, &messages[index], count - index, 0);
+      if (sent > 0)
+      {
+        index += sent;
+        load->framesSent += sent;
+      }
+      else if ((errno == ENOBUFS) || (errno == EAGAIN))
+      {
+        poll(&writable, 1, 1); // the interface queue is full, this is the saturation point
+        sent = 0;
+      }
+      else
+      {
+        sent = -1; // interface gone or not a CAN interface
+      }
+    }
+  }
+  close(fd);
+  load->done = true;
+  return NULL;
+}
+
+/** Starts sending the traffic model on the interface from a thread of its own
+ *  @param *load Load description, interface and number of frames set
+ *  @return Whether or not the sender was started
+ */
+bool SocketCanStartLoad(socketcan_load_t *load)
+{
+  load->framesSent = 0;
+  load->done = false;
+  load->stop = false;
+  return pthread_create(&load->thread, NULL, SocketCanLoadThread, load) == 0;
+}
+
+/** Stops the sender and waits for it to finish
+ *  @param *load Load started by SocketCanStartLoad
+ */
+void SocketCanStopLoad(socketcan_load_t *load)
+{
+  load->stop = true;
+  pthread_join(load->thread, NULL);
+}
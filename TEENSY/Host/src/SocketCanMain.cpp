@@ -0,0 +1,163 @@
+/*
+  * @file SocketCanMain.cpp
+  *
+  * Runs the logger capture logic on Linux: frames are read from a SocketCAN interface in
+  * batches (recvmmsg), stamped with the kernel receive time (hardware when the interface has
+  * it, software otherwise) and go through LoggerProcessMessage, the logic behind the FIFO
+  * interrupt on the Teensy. Attack files are written below the output directory by the same
+  * session manager and file writers.
+  *
+  * uds_logger_socketcan [-i interface] [-d output_dir] [-b batch] [-s stats_seconds]
+  *                      [-L frames] [-q]
+  *
+  * -L sends that many frames of the vehicle traffic model at 100% load on the interface from
+  * a second socket, as fast as the interface takes them, and reports the sustained receive
+  * rate once they are all in: the saturation benchmark on a vcan interface.
+  * Exits with 77 when the interface cannot be opened (no SocketCAN, no such interface).
+*/
+
+/* INCLUDES */
+#include <UDSLoggerHost.h>
+#include <SocketCan.h>
+#include <getopt.h>
+#include <signal.h>
+
+/* DEFINES */
+#define SOCKETCAN_DEFAULT_INTERFACE   "vcan0"
+#define SOCKETCAN_POLL_TIMEOUT        10        // Time (ms) waited for frames before servicing the sessions
+#define SOCKETCAN_LOAD_IDLE           200       // Time (ms) without frames after the load is sent that ends the run
+#define SOCKETCAN_DRAIN_LIMIT         (SESSION_POST_TRIGGER_WINDOW + 1000) // Time (ms) open sessions get to close on exit
+#define SOCKETCAN_EXIT_UNAVAILABLE    77        // Exit code when the interface cannot be opened
+
+/* GLOBAL VARIABLES */
+static volatile sig_atomic_t s_Running = 1;
+static socketcan_stats_t s_Stats;
+
+static void SocketCanSignal(int signal)
+{
+  (void) signal;
+  s_Running = 0;
+}
+
+static void SocketCanPrintStats(void)
+{
+  double seconds = (s_Stats.lastFrameNs - s_Stats.firstFrameNs) / 1e9;
+
+  printf("Frames received:        %lu\n", (unsigned long) s_Stats.framesReceived);
+  printf("Frames skipped:         %lu\n", (unsigned long) s_Stats.framesSkipped);
+  printf("Kernel drops:           %lu\n", (unsigned long) s_Stats.kernelDrops);
+  printf("Frames per batch:       %.1f\n", (s_Stats.batches > 0) ? ((double) s_Stats.framesReceived / s_Stats.batches) : 0.0);
+  printf("Timestamps:             %lu hardware, %lu software\n", (unsigned long) s_Stats.hardwareStamps, (unsigned long) s_Stats.softwareStamps);
+  printf("Frames stored:          %lu\n", (unsigned long) g_Model.totalMsgCount);
+  printf("Frames dropped (ring):  %lu\n", (unsigned long) g_Sessions.droppedFrames);
+  printf("Attack sessions:        %lu\n", (unsigned long) g_Sessions.sessionCount);
+  printf("Sessions still open:    %u\n", SessionActiveCount(&g_Sessions));
+  printf("Sustained rate:         %.0f frames/s over %.3f s\n", (seconds > 0) ? (s_Stats.framesReceived / seconds) : 0.0, seconds);
+  printf("Files written to:       %s/%s\n", SdFatHostRoot(), g_Timestamp);
+}
+
+static void SocketCanUsage(const char *program)
+{
+  fprintf(stderr, "usage: %s [-i interface] [-d output_dir] [-b batch] [-s stats_seconds] [-L frames] [-q]\n", program);
+}
+
+int main(int argc, char **argv)
+{
+  const char *interface = SOCKETCAN_DEFAULT_INTERFACE;
+  uint16_t batch = SOCKETCAN_DEFAULT_BATCH;
+  uint32_t statsSeconds = 0;
+  uint64_t nextStatsNs = 0;
+  uint64_t idleSinceNs = 0;
+  uint32_t drainStart = 0;
+  socketcan_load_t load;
+  int option = 0;
+  int fd = -1;
+
+  memset(&load, 0, sizeof(load));
+  while ((option = getopt(argc, argv, "i:d:b:s:L:q")) != -1)
+  {
+    switch (option)
+    {
+      case 'i': { interface = optarg; break; }
+      case 'd': { SdFatHostSetRoot(optarg); break; }
+      case 'b': { batch = strtoul(optarg, NULL, 0); break; }
+      case 's': { statsSeconds = strtoul(optarg, NULL, 0); break; }
+      case 'L': { load.numFrames = strtoul(optarg, NULL, 0); break; }
+      case 'q': { HostSerialSetOutput(NULL); break; }
+      default:
+      {
+        SocketCanUsage(argv[0]);
+        return 1;
+      }
+    }
+  }
+  if ((batch == 0) || (batch > SOCKETCAN_MAX_BATCH))
+  {
+    SocketCanUsage(argv[0]);
+    return 1;
+  }
+
+  fd = SocketCanOpen(interface, true);
+  if (fd < 0)
+  {
+    fprintf(stderr, "cannot open CAN interface %s: %s\n", interface, SocketCanLastError());
+    return SOCKETCAN_EXIT_UNAVAILABLE;
+  }
+  signal(SIGINT, SocketCanSignal);
+  signal(SIGTERM, SocketCanSignal);
+
+  HostClockUseVirtualTime(false);
+  FlexcanHostReset();
+  setup();
+
+  load.interface = interface;
+  if ((load.numFrames > 0) && !SocketCanStartLoad(&load))
+  {
+    fprintf(stderr, "cannot start the load thread\n");
+    return 1;
+  }
+
+  nextStatsNs = SocketCanNanos() + (statsSeconds * 1000000000ULL);
+  while (s_Running)
+  {
+    if (SocketCanWaitReadable(fd, SOCKETCAN_POLL_TIMEOUT) && (SocketCanReceive(fd, batch, LoggerProcessMessage, &s_Stats) > 0))
+    {
+      idleSinceNs = 0;
+    }
+    else if (idleSinceNs == 0)
+    {
+      idleSinceNs = SocketCanNanos();
+    }
+    IntervalTimer::HostRunExpired();
+    LoggerService();
+
+    if ((statsSeconds > 0) && (SocketCanNanos() >= nextStatsNs))
+    {
+      SocketCanPrintStats();
+      nextStatsNs += statsSeconds * 1000000000ULL;
+    }
+    if ((load.numFrames > 0) && load.done && (idleSinceNs != 0) &&
+        ((SocketCanNanos() - idleSinceNs) > (SOCKETCAN_LOAD_IDLE * 1000000ULL)))
+    {
+      break;
+    }
+  }
+  s_Running = 0;
+  if (load.numFrames > 0)
+  {
+    SocketCanStopLoad(&load);
+    printf("Frames sent:            %lu\n", (unsigned long) load.framesSent);
+  }
+  SocketCanClose(fd);
+
+  // open sessions still get their After file and footer once their window ends
+  drainStart = millis();
+  while ((SessionActiveCount(&g_Sessions) > 0) && ((millis() - drainStart) < SOCKETCAN_DRAIN_LIMIT))
+  {
+    IntervalTimer::HostRunExpired();
+    LoggerService();
+    delay(SOCKETCAN_POLL_TIMEOUT);
+  }
+  SocketCanPrintStats();
+  return 0;
+}
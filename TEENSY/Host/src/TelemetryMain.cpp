@@ -0,0 +1,491 @@
+/*
+  * @file TelemetryMain.cpp
+  *
+  * Receiver of the binary telemetry stream (Telemetry.h): decodes the COBS packets from the
+  * logger's USB serial port, or from a recorded stream, into a live view of the busiest IDs,
+  * the attack session events and the capture health counters.
+  *
+  * uds_logger_telemetry [-o] [-n ids] [-r refresh_ms] source
+  *
+  *   source  serial device of the logger (e.g. /dev/ttyACM0), a recorded stream or - for stdin
+  *   -o      read the stream to its end, print the view once and check it: exits with 1 if a
+  *           packet was damaged or the frames received do not match the frames the logger sent
+  *   -n      number of IDs shown (default 16)
+  *   -r      time between view updates (ms, default 500)
+  *
+  * On a serial device the stream is started with a 't' and stopped with a 'q' on Ctrl-C.
+*/
+
+/* INCLUDES */
+#include <CaptureScan.h>
+#include <Telemetry.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* DEFINES */
+#define RX_DEFAULT_IDS                16        // IDs shown when -n is not given
+#define RX_DEFAULT_REFRESH            500       // View update period (ms) when -r is not given
+#define RX_PACKET_SIZE                (TELEMETRY_MAX_PACKET * 2)  // Largest packet kept, longer ones are damaged
+#define RX_NUM_EVENTS                 8         // Session events shown
+#define RX_READ_SIZE                  4096      // Bytes read at a time
+
+/* STRUCTS */
+typedef struct {
+  uint32_t id;                          // Arbitration ID, TELEMETRY_ID_EXTENDED set for an extended ID
+  uint32_t count;                       // Number of frames
+  uint32_t lastCount;                   // Number of frames at the last view update
+  uint32_t rate;                        // Frames per second over the last view update
+  uint32_t lastTimestamp;               // Timestamp of the last frame
+  uint8_t len;                          // Length of the last frame
+  uint8_t data[8];                      // Payload of the last frame
+} rx_id_t;
+
+typedef struct {
+  uint32_t timestamp;                   // Timestamp of the last trigger message
+  uint32_t id;                          // Trigger ID of the rule
+  uint8_t rule;                         // Trigger rule
+  uint8_t event;                        // SessionEvent_e
+  uint32_t fileNumber;                  // Number of the session files
+  uint32_t triggerMessages;             // Trigger messages in the session
+} rx_event_t;
+
+typedef struct {
+  uint8_t packet[RX_PACKET_SIZE];       // Bytes of the packet being received
+  size_t packetLength;                  // Number of bytes of the packet
+  bool packetOverrun;                   // Whether or not the packet has been too long
+  uint64_t bytes;                       // Number of bytes received
+  uint32_t packets;                     // Number of good packets
+  uint32_t damaged;                     // Number of packets with bad COBS, check, type or length
+  uint32_t frames;                      // Number of frame records
+  uint32_t lastFrames;                  // Number of frame records at the last view update
+  uint32_t frameRate;                   // Frames per second over the last view update
+  capture_id_index_t index;             // ID -> entry
+  rx_id_t *ids;                         // Entries in the order IDs were first seen
+  uint32_t idsCapacity;                 // Number of entries allocated
+  rx_event_t events[RX_NUM_EVENTS];     // Latest session events
+  uint32_t numEvents;                   // Number of session events
+  telemetry_health_t health;            // Latest health record
+  uint32_t healthCount;                 // Number of health records
+  int64_t sentOffset;                   // Frames the logger sent minus frames received, set by the first health record
+  uint32_t mismatches;                  // Number of health records whose frame count did not match
+} rx_state_t;
+
+/* GLOBAL VARIABLES */
+static volatile sig_atomic_t s_Stop = 0;
+static uint32_t s_NumIds = RX_DEFAULT_IDS;
+
+static void RxSignal(int signal)
+{
+  (void) signal;
+  s_Stop = 1;
+}
+
+static uint64_t RxMillis(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t) now.tv_sec * 1000) + (now.tv_nsec / 1000000);
+}
+
+static uint32_t RxGet32(const uint8_t *data)
+{
+  return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+/** Adds a frame record to its ID
+ *  @return Whether or not the record is a complete frame
+ */
+static bool RxFrame(rx_state_t *state, const uint8_t *payload, size_t length)
+{
+  rx_id_t *entry = NULL;
+  rx_id_t *ids = NULL;
+  uint32_t capacity = 0;
+  uint32_t id = 0;
+  uint32_t index = 0;
+  bool added = false;
+  uint8_t len = 0;
+
+  if ((length < 9) || (payload[8] > 8) || (length != (size_t)(9 + payload[8])))
+  {
+    return false;
+  }
+  id = RxGet32(payload + 4);
+  len = payload[8];
+  if (state->index.count == state->idsCapacity)
+  {
+    // grown before the index takes a new ID, so every ID in the index has an entry
+    capacity = (state->idsCapacity == 0) ? 64 : (state->idsCapacity * 2);
+    ids = (rx_id_t *) realloc(state->ids, capacity * sizeof(rx_id_t));
+    if (ids == NULL)
+    {
+      return false;
+    }
+    state->ids = ids;
+    state->idsCapacity = capacity;
+  }
+  index = CaptureIdIndexFind(&state->index, id & ~TELEMETRY_ID_EXTENDED, (id & TELEMETRY_ID_EXTENDED) ? 1 : 0, &added);
+  if (index == UINT32_MAX)
+  {
+    return false;
+  }
+  entry = &state->ids[index];
+  if (added)
+  {
+    memset(entry, 0, sizeof(rx_id_t));
+    entry->id = id;
+  }
+  entry->count++;
+  entry->lastTimestamp = RxGet32(payload);
+  entry->len = len;
+  memcpy(entry->data, payload + 9, len);
+  state->frames++;
+  return true;
+}
+
+/** Decodes a packet received up to its delimiter and applies its record
+ */
+static void RxPacket(rx_state_t *state)
+{
+  uint8_t raw[RX_PACKET_SIZE];
+  rx_event_t *event = NULL;
+  size_t length = CobsDecode(state->packet, state->packetLength, raw, sizeof(raw));
+  uint16_t check = 0;
+  bool good = false;
+
+  if (length < 3)
+  {
+    state->damaged++;
+    return;
+  }
+  check = raw[length - 2] | (raw[length - 1] << 8);
+  if (check != TelemetryChecksum(raw, length - 2))
+  {
+    state->damaged++;
+    return;
+  }
+  length -= 3; // payload only
+  switch (raw[0])
+  {
+    case eTELEMETRY_FRAME:
+    {
+      good = RxFrame(state, raw + 1, length);
+      break;
+    }
+    case eTELEMETRY_TRIGGER:
+    {
+      if (length == 18)
+      {
+        event = &state->events[state->numEvents % RX_NUM_EVENTS];
+        event->timestamp = RxGet32(raw + 1);
+        event->id = RxGet32(raw + 5);
+        event->rule = raw[9];
+        event->event = raw[10];
+        event->fileNumber = RxGet32(raw + 11);
+        event->triggerMessages = RxGet32(raw + 15);
+        state->numEvents++;
+        good = true;
+      }
+      break;
+    }
+    case eTELEMETRY_HEALTH:
+    {
+      good = TelemetryParseHealth(raw + 1, length, &state->health);
+      if (good)
+      {
+        // the logger counts the frames it sent ahead of each health record, a difference means lost packets
+        if (state->healthCount == 0)
+        {
+          state->sentOffset = (int64_t) state->health.framesSent - state->frames;
+        }
+        else if (((int64_t) state->health.framesSent - state->frames) != state->sentOffset)
+        {
+          state->mismatches++;
+          state->sentOffset = (int64_t) state->health.framesSent - state->frames;
+        }
+        state->healthCount++;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  if (good)
+  {
+    state->packets++;
+  }
+  else
+  {
+    state->damaged++;
+  }
+}
+
+/** Splits received bytes into packets on the 0x00 delimiter
+ */
+static void RxBytes(rx_state_t *state, const uint8_t *data, size_t length)
+{
+  size_t index = 0;
+  state->bytes += length;
+  for (index = 0; index < length; index++)
+  {
+    if (data[index] == 0)
+    {
+      if (state->packetOverrun)
+      {
+        state->damaged++;
+      }
+      else if (state->packetLength > 0)
+      {
+        RxPacket(state);
+      }
+      state->packetLength = 0;
+      state->packetOverrun = false;
+    }
+    else if (state->packetLength < RX_PACKET_SIZE)
+    {
+      state->packet[state->packetLength++] = data[index];
+    }
+    else
+    {
+      state->packetOverrun = true;
+    }
+  }
+}
+
+static int RxCompareCount(const void *a, const void *b)
+{
+  const rx_id_t *left = *(const rx_id_t * const *) a;
+  const rx_id_t *right = *(const rx_id_t * const *) b;
+  if (left->count != right->count)
+  {
+    return (left->count > right->count) ? -1 : 1;
+  }
+  return (left->id < right->id) ? -1 : ((left->id > right->id) ? 1 : 0);
+}
+
+/** Prints the view: stream counters, the busiest IDs, the latest session events and the health counters
+ *  @param elapsedMs Time since the last update, 0 for no rates
+ *  @param clear Whether or not the terminal is cleared first
+ */
+static void RxPrintView(rx_state_t *state, uint64_t elapsedMs, bool clear)
+{
+  rx_id_t **order = NULL;
+  const rx_event_t *event = NULL;
+  char id[CAPTURE_ID_TEXT_SIZE];
+  const telemetry_health_t *health = &state->health;
+  uint32_t index = 0;
+  uint32_t first = 0;
+  uint8_t byte = 0;
+
+  if (elapsedMs > 0)
+  {
+    state->frameRate = (uint32_t)(((uint64_t)(state->frames - state->lastFrames) * 1000) / elapsedMs);
+    state->lastFrames = state->frames;
+    for (index = 0; index < state->index.count; index++)
+    {
+      state->ids[index].rate = (uint32_t)(((uint64_t)(state->ids[index].count - state->ids[index].lastCount) * 1000) / elapsedMs);
+      state->ids[index].lastCount = state->ids[index].count;
+    }
+  }
+
+  if (clear)
+  {
+    printf("\033[H\033[2J");
+  }
+  printf("Telemetry: %llu bytes, %lu packets, %lu damaged, %lu frames (%lu/s), %lu IDs\n",
+         (unsigned long long) state->bytes, (unsigned long) state->packets, (unsigned long) state->damaged,
+         (unsigned long) state->frames, (unsigned long) state->frameRate, (unsigned long) state->index.count);
+
+  printf("\n        ID      Count    Rate/s  Last ms     Data\n");
+  order = (rx_id_t **) malloc((state->index.count + 1) * sizeof(rx_id_t *));
+  for (index = 0; index < state->index.count; index++)
+  {
+    order[index] = &state->ids[index];
+  }
+  qsort(order, state->index.count, sizeof(rx_id_t *), RxCompareCount);
+  for (index = 0; (index < state->index.count) && (index < s_NumIds); index++)
+  {
+    printf("  %8s %10lu %9lu %8lu    ",
+           CaptureFormatId(id, order[index]->id & ~TELEMETRY_ID_EXTENDED, (order[index]->id & TELEMETRY_ID_EXTENDED) ? 1 : 0),
+           (unsigned long) order[index]->count, (unsigned long) order[index]->rate, (unsigned long) order[index]->lastTimestamp);
+    for (byte = 0; byte < order[index]->len; byte++)
+    {
+      printf("%02X ", order[index]->data[byte]);
+    }
+    printf("\n");
+  }
+  free(order);
+
+  printf("\nSession events (%lu):\n", (unsigned long) state->numEvents);
+  first = (state->numEvents > RX_NUM_EVENTS) ? (state->numEvents - RX_NUM_EVENTS) : 0;
+  for (index = first; index < state->numEvents; index++)
+  {
+    event = &state->events[index % RX_NUM_EVENTS];
+    printf("  %8lu ms  %-5s session %lu  trigger %s (rule %u)  %lu trigger messages\n", (unsigned long) event->timestamp,
+           (event->event == eSESSION_EVENT_OPEN) ? "open" : "close", (unsigned long) event->fileNumber,
+           CaptureFormatId(id, event->id & ~TELEMETRY_ID_EXTENDED, (event->id & TELEMETRY_ID_EXTENDED) ? 1 : 0), event->rule,
+           (unsigned long) event->triggerMessages);
+  }
+
+  if (state->healthCount == 0)
+  {
+    printf("\nNo health record yet\n");
+    return;
+  }
+  printf("\nHealth at %lu ms (%lu records, %lu frame count mismatches):\n", (unsigned long) health->timestamp,
+         (unsigned long) state->healthCount, (unsigned long) state->mismatches);
+  printf("  Frames stored %lu, ring drops %lu, dropped while flushing %lu, FIFO overflows %lu\n",
+         (unsigned long) health->framesStored, (unsigned long) health->ringDrops, (unsigned long) health->droppedWhileFlushing,
+         (unsigned long) health->fifoOverflows);
+  printf("  Telemetry frames queued %lu, dropped %lu, sent %lu, events dropped %lu\n",
+         (unsigned long) health->framesQueued, (unsigned long) health->framesDropped, (unsigned long) health->framesSent,
+         (unsigned long) health->eventsDropped);
+  printf("  Ring high-water %lu frames, write backlog high-water %lu frames\n",
+         (unsigned long) health->ringHighWater, (unsigned long) health->backlogHighWater);
+  printf("  SD writes %lu, longest %lu us, longest FIFO callback %lu ns\n",
+         (unsigned long) health->sdWrites, (unsigned long) health->sdWriteMax, (unsigned long) health->isrMaxNs);
+  printf("  Sessions %lu, open %u, missed triggers %lu, error events dropped %lu\n",
+         (unsigned long) health->sessionCount, health->activeSessions, (unsigned long) health->missedTriggers,
+         (unsigned long) health->errorsDropped);
+  fflush(stdout);
+}
+
+/** Opens the source, a serial device is put in raw mode and told to start the stream
+ *  @return File descriptor, -1 on failure
+ */
+static int RxOpen(const char *path, bool *isSerial)
+{
+  struct termios tty;
+  int fd = (strcmp(path, "-") == 0) ? STDIN_FILENO : open(path, O_RDWR | O_NOCTTY);
+
+  *isSerial = false;
+  if (fd < 0) // a recorded stream may be read only
+  {
+    fd = open(path, O_RDONLY);
+  }
+  if (fd < 0)
+  {
+    perror(path);
+    return -1;
+  }
+  if ((fd != STDIN_FILENO) && isatty(fd) && (tcgetattr(fd, &tty) == 0))
+  {
+    cfmakeraw(&tty);
+    tcsetattr(fd, TCSANOW, &tty);
+    tcflush(fd, TCIFLUSH);
+    if (write(fd, "t", 1) != 1)
+    {
+      perror(path);
+    }
+    *isSerial = true;
+  }
+  return fd;
+}
+
+static void RxUsage(const char *program)
+{
+  fprintf(stderr, "usage: %s [-o] [-n ids] [-r refresh_ms] source\n", program);
+}
+
+int main(int argc, char **argv)
+{
+  rx_state_t state;
+  uint8_t buffer[RX_READ_SIZE];
+  struct pollfd poller;
+  uint32_t refresh = RX_DEFAULT_REFRESH;
+  uint64_t lastView = 0;
+  uint64_t now = 0;
+  ssize_t count = 0;
+  bool once = false;
+  bool isSerial = false;
+  int option = 0;
+  int fd = -1;
+
+  while ((option = getopt(argc, argv, "on:r:")) != -1)
+  {
+    switch (option)
+    {
+      case 'o': { once = true; break; }
+      case 'n': { s_NumIds = strtoul(optarg, NULL, 0); break; }
+      case 'r': { refresh = strtoul(optarg, NULL, 0); break; }
+      default:
+      {
+        RxUsage(argv[0]);
+        return 1;
+      }
+    }
+  }
+  if ((optind != (argc - 1)) || (refresh == 0))
+  {
+    RxUsage(argv[0]);
+    return 1;
+  }
+
+  memset(&state, 0, sizeof(state));
+  CaptureIdIndexInit(&state.index);
+  fd = RxOpen(argv[optind], &isSerial);
+  if (fd < 0)
+  {
+    return 1;
+  }
+  signal(SIGINT, RxSignal);
+  signal(SIGTERM, RxSignal);
+
+  lastView = RxMillis();
+  poller.fd = fd;
+  poller.events = POLLIN;
+  while (!s_Stop)
+  {
+    poller.revents = 0;
+    if (!once && (poll(&poller, 1, (int) refresh) < 0))
+    {
+      continue; // interrupted, s_Stop says whether to go on
+    }
+    if (once || (poller.revents & (POLLIN | POLLHUP)))
+    {
+      count = read(fd, buffer, sizeof(buffer));
+      if (count < 0)
+      {
+        if (!s_Stop)
+        {
+          perror(argv[optind]);
+        }
+        break;
+      }
+      if (count == 0) // end of a recorded stream
+      {
+        break;
+      }
+      RxBytes(&state, buffer, (size_t) count);
+    }
+    now = RxMillis();
+    if (!once && ((now - lastView) >= refresh))
+    {
+      RxPrintView(&state, now - lastView, true);
+      lastView = now;
+    }
+  }
+  if (isSerial && (write(fd, "q", 1) != 1))
+  {
+    perror(argv[optind]);
+  }
+  if (fd != STDIN_FILENO)
+  {
+    close(fd);
+  }
+
+  RxPrintView(&state, 0, !once);
+  CaptureIdIndexFree(&state.index);
+  free(state.ids);
+  if (once)
+  {
+    return ((state.damaged == 0) && (state.mismatches == 0) && (state.healthCount > 0)) ? 0 : 1;
+  }
+  return 0;
+}
@@ -0,0 +1,103 @@
+/*
+  * @file Time.cpp
+  *
+  * Host stand-ins for the Arduino Time library and the DS1307 real time clock
+*/
+
+/* INCLUDES */
+#include <Time.h>
+#include <DS1307RTC.h>
+
+/* GLOBAL VARIABLES */
+DS1307RTC RTC;
+
+static getExternalTime s_SyncProvider = NULL;
+static time_t s_Offset = 0;
+static timeStatus_t s_Status = timeNotSet;
+
+/** Breaks a time down into calendar fields (local time, like the RTC)
+ *  @param t Time to be broken down
+ *  @param *fields Fields to be set
+ */
+static void TimeBreak(time_t t, struct tm *fields)
+{
+  localtime_r(&t, fields);
+}
+
+time_t now(void)
+{
+  return time(NULL) + s_Offset;
+}
+
+int year(time_t t)
+{
+  struct tm fields;
+  TimeBreak(t, &fields);
+  return fields.tm_year + 1900;
+}
+
+int month(time_t t)
+{
+  struct tm fields;
+  TimeBreak(t, &fields);
+  return fields.tm_mon + 1;
+}
+
+int day(time_t t)
+{
+  struct tm fields;
+  TimeBreak(t, &fields);
+  return fields.tm_mday;
+}
+
+int hour(time_t t)
+{
+  struct tm fields;
+  TimeBreak(t, &fields);
+  return fields.tm_hour;
+}
+
+int minute(time_t t)
+{
+  struct tm fields;
+  TimeBreak(t, &fields);
+  return fields.tm_min;
+}
+
+int second(time_t t)
+{
+  struct tm fields;
+  TimeBreak(t, &fields);
+  return fields.tm_sec;
+}
+
+void setSyncProvider(getExternalTime provider)
+{
+  s_SyncProvider = provider;
+  if (s_SyncProvider != NULL)
+  {
+    setTime(s_SyncProvider());
+  }
+}
+
+timeStatus_t timeStatus(void)
+{
+  return s_Status;
+}
+
+void setTime(time_t t)
+{
+  s_Offset = t - time(NULL);
+  s_Status = timeSet;
+}
+
+time_t DS1307RTC::get(void)
+{
+  return time(NULL);
+}
+
+bool DS1307RTC::set(time_t t)
+{
+  setTime(t);
+  return true;
+}
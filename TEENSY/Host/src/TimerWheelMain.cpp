@@ -0,0 +1,194 @@
+/*
+  * @file TimerWheelMain.cpp
+  *
+  * Checks the timer wheel against a plain list of expiry ticks. Timers with delays from one
+  * tick to past the range of the wheel, periodic and one-shot, are started, cancelled and
+  * started again at random, from the main loop and from callbacks; every callback has to run
+  * on exactly the tick the list says and no expiry may be missed. The wheel is moved on a tick
+  * at a time and in jumps as a main loop would, across the wrap of the tick counter.
+  *
+  * timer_wheel_host [-s seed] [-n timers] [-t ticks] [-v]
+*/
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <HostTest.h>
+#include <TimerWheel.h>
+
+/* DEFINES */
+#define WHEEL_TEST_DEFAULT_TIMERS     500       // Number of timers
+#define WHEEL_TEST_DEFAULT_TICKS      (3 * TIMER_WHEEL_RANGE)  // Number of ticks run
+#define WHEEL_TEST_DEFAULT_SEED       1         // Seed of the timer operations when -s is not given
+#define WHEEL_TEST_MAX_TIMERS         4096      // Most timers
+#define WHEEL_TEST_START_TICK         (0xFFFFFFFFUL - 5000)  // First tick, the counter wraps early in the run
+#define WHEEL_TEST_MAX_JUMP           50        // Most ticks moved on by one advance
+#define WHEEL_TEST_OPERATION_ODDS     200       // One in this many advances starts or cancels a timer
+
+/* STRUCTS */
+typedef struct {
+  wheel_timer_t timer;                  // Timer under test
+  bool running;                         // Whether or not the timer should be running
+  uint32_t expires;                     // Tick the timer should expire on next
+  uint32_t period;                      // Ticks between expiries, 0 for one-shot
+  uint32_t fired;                       // Number of times the callback ran
+} wheel_test_timer_t;
+
+/* GLOBAL VARIABLES */
+static timer_wheel_t s_Wheel;
+static wheel_test_timer_t s_Timers[WHEEL_TEST_MAX_TIMERS];
+static uint32_t s_NumTimers = WHEEL_TEST_DEFAULT_TIMERS;
+static uint32_t s_Fired = 0;
+static uint32_t s_Cancels = 0;
+static uint32_t s_Restarts = 0;
+
+/** Picks a delay, mostly short ones as for periodic frames, some past the range of the wheel
+ *  @return Delay (ticks)
+ */
+static uint32_t WheelTestDelay(void)
+{
+  switch (random(4))
+  {
+    case 0: { return 1 + random(TIMER_WHEEL_SLOTS); }
+    case 1: { return 1 + random(TIMER_WHEEL_SLOTS * TIMER_WHEEL_SLOTS); }
+    case 2: { return 1 + random(1UL << (TIMER_WHEEL_SLOT_BITS * 3)); }
+    default: { return 1 + random(2 * TIMER_WHEEL_RANGE); }
+  }
+}
+
+/** Starts a timer and notes when it should expire
+ *  @param *test Timer
+ */
+static void WheelTestStart(wheel_test_timer_t *test)
+{
+  uint32_t delay = WheelTestDelay();
+  uint32_t period = (random(2) == 0) ? 0 : WheelTestDelay();
+
+  TimerWheelStart(&s_Wheel, &test->timer, delay, period);
+  test->running = true;
+  test->expires = s_Wheel.now + delay;
+  test->period = period;
+}
+
+/** Cancels a timer, the wheel has to agree whether or not it was running
+ *  @param *test Timer
+ */
+static void WheelTestCancel(wheel_test_timer_t *test)
+{
+  HOST_TEST_CHECK(TimerWheelCancel(&s_Wheel, &test->timer) == test->running, "tick %lu: timer %ld cancelled, running %d expected %d",
+                  (unsigned long) s_Wheel.now, (long)(test - s_Timers), !test->running, test->running);
+  test->running = false;
+  s_Cancels++;
+}
+
+/** Starts or cancels a random timer of the first half, the second half is left to run so long
+ *  delays get to go all the way down the wheel
+ */
+static void WheelTestOperation(void)
+{
+  wheel_test_timer_t *test = &s_Timers[random((s_NumTimers + 1) / 2)];
+
+  if (random(3) == 0)
+  {
+    WheelTestCancel(test);
+  }
+  else
+  {
+    WheelTestStart(test);
+    s_Restarts++;
+  }
+}
+
+/** Checks the expiry against the one noted and sometimes starts or cancels a timer
+ *  @param *arg Timer
+ */
+static void wheel_test_callback(void *arg)
+{
+  wheel_test_timer_t *test = (wheel_test_timer_t *) arg;
+
+  HOST_TEST_CHECK(test->running && (test->expires == s_Wheel.now) && (TimerWheelActive(&test->timer) == (test->period > 0)),
+                  "tick %lu: timer %ld expired, expected %s tick %lu", (unsigned long) s_Wheel.now, (long)(test - s_Timers),
+                  test->running ? "running" : "stopped", (unsigned long) test->expires);
+  if (g_HostTestVerbose)
+  {
+    printf("tick %lu: timer %ld\n", (unsigned long) s_Wheel.now, (long)(test - s_Timers));
+  }
+  test->fired++;
+  s_Fired++;
+  test->expires += test->period;
+  test->running = (test->period > 0);
+
+  if (random(WHEEL_TEST_OPERATION_ODDS / 10) == 0) // timers starting and cancelling timers, possibly expiring on this tick
+  {
+    WheelTestOperation();
+  }
+}
+
+/** Checks that no running timer was missed
+ */
+static void WheelTestMissed(void)
+{
+  uint32_t i = 0;
+
+  for (i = 0; i < s_NumTimers; i++)
+  {
+    HOST_TEST_CHECK(!s_Timers[i].running || ((int32_t)(s_Timers[i].expires - s_Wheel.now) > 0), "tick %lu: timer %lu missed tick %lu",
+                    (unsigned long) s_Wheel.now, (unsigned long) i, (unsigned long) s_Timers[i].expires);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t ticks = WHEEL_TEST_DEFAULT_TICKS;
+  uint32_t seed = WHEEL_TEST_DEFAULT_SEED;
+  uint32_t end = 0;
+  uint32_t i = 0;
+  const host_test_option_t options[] =
+  {
+    {'s', eHOST_TEST_UINT, &seed},
+    {'n', eHOST_TEST_UINT, &s_NumTimers},
+    {'t', eHOST_TEST_UINT, &ticks}
+  };
+
+  if (!HostTestOptions(argc, argv, "[-s seed] [-n timers] [-t ticks] [-v]", options, sizeof(options) / sizeof(options[0])))
+  {
+    return 1;
+  }
+  if ((s_NumTimers == 0) || (s_NumTimers > WHEEL_TEST_MAX_TIMERS))
+  {
+    HostTestUsage();
+    return 1;
+  }
+  randomSeed(seed);
+
+  TimerWheelInit(&s_Wheel, WHEEL_TEST_START_TICK);
+  for (i = 0; i < s_NumTimers; i++)
+  {
+    TimerWheelSetup(&s_Timers[i].timer, wheel_test_callback, &s_Timers[i]);
+    WheelTestStart(&s_Timers[i]);
+  }
+
+  end = s_Wheel.now + ticks;
+  while ((int32_t)(end - s_Wheel.now) > 0)
+  {
+    if (random(2) == 0)
+    {
+      TimerWheelTick(&s_Wheel);
+    }
+    else
+    {
+      TimerWheelAdvance(&s_Wheel, s_Wheel.now + 1 + random(WHEEL_TEST_MAX_JUMP));
+    }
+    if (random(WHEEL_TEST_OPERATION_ODDS) == 0)
+    {
+      WheelTestOperation();
+    }
+  }
+  WheelTestMissed();
+  HOST_TEST_CHECK(s_Fired == s_Wheel.expired, "%lu callbacks ran, the wheel expired %lu timers", (unsigned long) s_Fired,
+                  (unsigned long) s_Wheel.expired);
+
+  printf("%lu timers, %lu ticks: %lu expiries (wheel %lu), %lu cascades, %lu restarts, %lu cancels\n",
+         (unsigned long) s_NumTimers, (unsigned long) ticks, (unsigned long) s_Fired, (unsigned long) s_Wheel.expired,
+         (unsigned long) s_Wheel.cascaded, (unsigned long) s_Restarts, (unsigned long) s_Cancels);
+  return HostTestSummary();
+}
@@ -0,0 +1,266 @@
+/*
+  * @file TxQueueMain.cpp
+  *
+  * Checks the FlexCAN TX queue against the simulated controller. A burst is queued while the
+  * bus is held busy, so the queue fills and frames wait in every TX mailbox; once the bus is
+  * released the frames have to go out in arbitration order (lowest ID first, standard before
+  * extended, frames with the same ID in the order they were queued) and each has to be
+  * reported sent with its tag. A flushed burst has to be reported aborted without a frame
+  * reaching the bus.
+  *
+  * flexcan_host_txq [-s seed] [-v]
+*/
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <FlexcanHostBus.h>
+#include <HostTest.h>
+#include <can.h>
+#include <algorithm>
+
+/* DEFINES */
+#define TXQ_TEST_MAX_FRAMES           (FLEXCAN_TXQ_SIZE + FLEXCAN_TX_MB_WIDTH + 1)  // Most frames a burst can queue, plus the one turned away
+#define TXQ_TEST_FLUSH_FRAMES         12        // Number of frames queued and then flushed
+#define TXQ_TEST_DEFAULT_SEED         1         // Seed of the burst IDs when -s is not given
+#define TXQ_TEST_ROUNDS               4         // Number of bursts and flushes, the queue has to keep working after each
+
+/* STRUCTS */
+typedef struct {
+  FLEXCAN_frame_t frame;                // Frame queued
+  uint32_t key;                         // Arbitration key, lower wins
+  uint32_t tag;                         // Order the frame was queued in
+} txq_test_frame_t;
+
+/* CONSTANTS */
+// Standard and extended IDs, some sharing a base ID, picked at random for the burst
+const uint32_t TxqTestIds[][2] = {
+  {0x7DF, 0}, {0x7E0, 0}, {0x100, 0}, {0x050, 0}, {0x6FF, 0},
+  {0x18DAF110, 1}, {0x18DB33F1, 1}, {0x04000055, 1}, {0x00000001, 1}, {0x1FFFFFFF, 1}
+};
+const uint8_t TXQ_TEST_NUM_IDS = sizeof(TxqTestIds) / sizeof(TxqTestIds[0]);
+
+/* GLOBAL VARIABLES */
+static txq_test_frame_t s_Queued[TXQ_TEST_MAX_FRAMES];
+static uint32_t s_NumQueued = 0;
+static uint32_t s_Transmitted[TXQ_TEST_MAX_FRAMES];  // Tags in the order the frames reached the bus
+static uint32_t s_NumTransmitted = 0;
+static int s_Result[TXQ_TEST_MAX_FRAMES];            // Completion reported for each tag, -1 for none yet
+static uint32_t s_NumCompleted = 0;
+static uint32_t s_BadCompletions = 0;                 // Completions with an unknown tag, a changed frame or reported twice
+
+/** Gets the arbitration key of a frame: base ID, then IDE, then the extended ID bits
+ *  @param *frame Frame
+ *  @return Key, lower wins
+ */
+static uint32_t TxqTestKey(const FLEXCAN_frame_t *frame)
+{
+  if (frame->ide)
+  {
+    return (((frame->id >> 18) & 0x7FF) << 19) | (1UL << 18) | (frame->id & 0x3FFFF);
+  }
+  return (frame->id & 0x7FF) << 19;
+}
+
+/** Gets the tag a frame carries in its first two data bytes
+ *  @param *frame Frame
+ *  @return Tag
+ */
+static uint32_t TxqTestTag(const FLEXCAN_frame_t *frame)
+{
+  return ((uint32_t) frame->data[0] << 8) | frame->data[1];
+}
+
+/** Records a frame reaching the bus
+ *  @param *frame Frame transmitted
+ */
+static void txq_test_tx_handler(const FLEXCAN_frame_t *frame)
+{
+  if (s_NumTransmitted < TXQ_TEST_MAX_FRAMES)
+  {
+    s_Transmitted[s_NumTransmitted] = TxqTestTag(frame);
+  }
+  s_NumTransmitted++;
+  if (g_HostTestVerbose)
+  {
+    printf("tx %s 0x%08lX tag %lu\n", frame->ide ? "ext" : "std", (unsigned long) frame->id, (unsigned long) TxqTestTag(frame));
+  }
+}
+
+/** Records a frame completion reported by the TX queue
+ *  @param *frame Frame completed
+ *  @param tag Tag it was queued with
+ *  @param result FLEXCAN_TX_SUCCESS or FLEXCAN_TX_ABORTED
+ */
+static void txq_test_callback(const FLEXCAN_frame_t *frame, uint32_t tag, int result)
+{
+  s_NumCompleted++;
+  if ((tag >= s_NumQueued) || (s_Result[tag] != -1) || (frame->id != s_Queued[tag].frame.id) ||
+      (frame->ide != s_Queued[tag].frame.ide) || (TxqTestTag(frame) != tag))
+  {
+    s_BadCompletions++;
+    return;
+  }
+  s_Result[tag] = result;
+}
+
+/** Forgets the frames of the previous test
+ */
+static void TxqTestClear(void)
+{
+  uint32_t i = 0;
+
+  s_NumQueued = 0;
+  s_NumTransmitted = 0;
+  s_NumCompleted = 0;
+  s_BadCompletions = 0;
+  for (i = 0; i < TXQ_TEST_MAX_FRAMES; i++)
+  {
+    s_Result[i] = -1;
+  }
+}
+
+/** Queues a frame with a random ID from the table, tagged with the order it was queued in
+ *  @return Whether or not the TX queue took it
+ */
+static bool TxqTestSend(void)
+{
+  txq_test_frame_t *queued = &s_Queued[s_NumQueued];
+  uint8_t pick = random(TXQ_TEST_NUM_IDS);
+  uint8_t i = 0;
+
+  memset(queued, 0, sizeof(txq_test_frame_t));
+  queued->frame.id = TxqTestIds[pick][0];
+  queued->frame.ide = TxqTestIds[pick][1];
+  queued->frame.dlc = 8;
+  queued->frame.data[0] = s_NumQueued >> 8;
+  queued->frame.data[1] = s_NumQueued;
+  for (i = 2; i < 8; i++)
+  {
+    queued->frame.data[i] = pick + i;
+  }
+  queued->key = TxqTestKey(&queued->frame);
+  queued->tag = s_NumQueued;
+  if (FLEXCAN_txq_send(&queued->frame, queued->tag) != FLEXCAN_SUCCESS)
+  {
+    return false;
+  }
+  s_NumQueued++;
+  return true;
+}
+
+/** Queues a burst while the bus is busy until the queue is full, then releases the bus
+ *  Every frame has to go out once, in arbitration order, and be reported sent
+ */
+static void TxqTestBurst(void)
+{
+  txq_test_frame_t expected[TXQ_TEST_MAX_FRAMES];
+  uint32_t i = 0;
+
+  TxqTestClear();
+  FlexcanHostSetTxPaused(true);
+  while ((s_NumQueued < (TXQ_TEST_MAX_FRAMES - 1)) && TxqTestSend())
+  {
+  }
+  HOST_TEST_CHECK(s_NumQueued >= FLEXCAN_TXQ_SIZE, "burst: queue full after %lu frames, expected at least %d", (unsigned long) s_NumQueued,
+                  FLEXCAN_TXQ_SIZE);
+  HOST_TEST_CHECK(!TxqTestSend(), "burst: frame %lu taken by a full queue", (unsigned long) s_NumQueued);
+  HOST_TEST_CHECK((s_NumTransmitted == 0) && (s_NumCompleted == 0) && ((uint32_t) FLEXCAN_txq_pending() == s_NumQueued),
+                  "burst: %lu sent, %lu completed, %d pending while the bus is busy", (unsigned long) s_NumTransmitted,
+                  (unsigned long) s_NumCompleted, FLEXCAN_txq_pending());
+
+  FlexcanHostSetTxPaused(false);
+
+  memcpy(expected, s_Queued, s_NumQueued * sizeof(txq_test_frame_t));
+  std::stable_sort(expected, expected + s_NumQueued,
+                   [](const txq_test_frame_t &a, const txq_test_frame_t &b) { return a.key < b.key; });
+  HOST_TEST_CHECK(s_NumTransmitted == s_NumQueued, "burst: %lu of %lu frames sent", (unsigned long) s_NumTransmitted,
+                  (unsigned long) s_NumQueued);
+  for (i = 0; (i < s_NumQueued) && (i < s_NumTransmitted); i++)
+  {
+    if (s_Transmitted[i] != expected[i].tag)
+    {
+      HostTestFail("burst: frame %lu on the bus is tag %lu, expected tag %lu (ID 0x%08lX)", (unsigned long) i,
+                   (unsigned long) s_Transmitted[i], (unsigned long) expected[i].tag, (unsigned long) expected[i].frame.id);
+      break;
+    }
+  }
+  for (i = 0; i < s_NumQueued; i++)
+  {
+    if (s_Result[i] != FLEXCAN_TX_SUCCESS)
+    {
+      HostTestFail("burst: tag %lu completed with %d", (unsigned long) i, s_Result[i]);
+      break;
+    }
+  }
+  HOST_TEST_CHECK((s_NumCompleted == s_NumQueued) && (s_BadCompletions == 0) && (FLEXCAN_txq_pending() == 0),
+                  "burst: %lu completions (%lu bad) for %lu frames, %d pending", (unsigned long) s_NumCompleted,
+                  (unsigned long) s_BadCompletions, (unsigned long) s_NumQueued, FLEXCAN_txq_pending());
+  printf("burst: %lu frames queued, %lu sent in arbitration order\n", (unsigned long) s_NumQueued, (unsigned long) s_NumTransmitted);
+}
+
+/** Queues frames while the bus is busy and flushes them
+ *  Every frame has to be reported aborted and none may reach the bus
+ */
+static void TxqTestFlush(void)
+{
+  uint32_t i = 0;
+
+  TxqTestClear();
+  FlexcanHostSetTxPaused(true);
+  for (i = 0; i < TXQ_TEST_FLUSH_FRAMES; i++)
+  {
+    HOST_TEST_CHECK(TxqTestSend(), "flush: frame %lu turned away", (unsigned long) i);
+  }
+  FLEXCAN_txq_flush();
+  FlexcanHostSetTxPaused(false);
+
+  for (i = 0; i < s_NumQueued; i++)
+  {
+    if (s_Result[i] != FLEXCAN_TX_ABORTED)
+    {
+      HostTestFail("flush: tag %lu completed with %d", (unsigned long) i, s_Result[i]);
+      break;
+    }
+  }
+  HOST_TEST_CHECK((s_NumQueued == TXQ_TEST_FLUSH_FRAMES) && (s_NumTransmitted == 0) && (s_NumCompleted == s_NumQueued) &&
+                  (s_BadCompletions == 0) && (FLEXCAN_txq_pending() == 0),
+                  "flush: %lu queued, %lu sent, %lu completions (%lu bad), %d pending", (unsigned long) s_NumQueued,
+                  (unsigned long) s_NumTransmitted, (unsigned long) s_NumCompleted, (unsigned long) s_BadCompletions,
+                  FLEXCAN_txq_pending());
+  printf("flush: %lu frames aborted\n", (unsigned long) s_NumQueued);
+}
+
+int main(int argc, char **argv)
+{
+  FLEXCAN_config_t canConfig;
+  uint32_t seed = TXQ_TEST_DEFAULT_SEED;
+  uint32_t round = 0;
+  const host_test_option_t options[] =
+  {
+    {'s', eHOST_TEST_UINT, &seed}
+  };
+
+  if (!HostTestOptions(argc, argv, "[-s seed] [-v]", options, sizeof(options) / sizeof(options[0])))
+  {
+    return 1;
+  }
+  randomSeed(seed);
+
+  HostClockUseVirtualTime(true);
+  FlexcanHostReset();
+  canConfig.presdiv = 1;                // 500 kbit/s from the 16 MHz oscillator
+  canConfig.propseg = 2;
+  canConfig.rjw = 1;
+  canConfig.pseg_1 = 7;
+  canConfig.pseg_2 = 3;
+  FLEXCAN_init(canConfig);
+  FLEXCAN_txq_init(txq_test_callback);
+  FlexcanHostSetTxHandler(txq_test_tx_handler);
+
+  for (round = 0; round < TXQ_TEST_ROUNDS; round++)
+  {
+    TxqTestBurst();
+    TxqTestFlush();
+  }
+  return HostTestSummary();
+}
@@ -0,0 +1,8 @@
+/*
+  * @file UDSLoggerSketch.cpp
+  *
+  * Builds the logger sketch as a host translation unit, the same way the Arduino IDE turns
+  * the .ino file into C++
+*/
+
+#include "UDS_Data_Logger_Final_Interrupts.ino"
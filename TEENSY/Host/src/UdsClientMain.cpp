@@ -0,0 +1,527 @@
+/*
+  * @file UdsClientMain.cpp
+  *
+  * Measures the UDS client against simulated ECUs on the simulated bus. The client runs on the
+  * simulated FlexCAN controller; every ECU is an ISO-TP link answering after a short processing
+  * time: reads and session changes positively, security access negatively, routines with two
+  * response pending first, resets never, and some reads with a stray response ahead of the real
+  * one. A random mix of requests is run twice, pipelined (a few requests queued to every ECU at
+  * once) and in lockstep as the MCP2515 sketches do it (one request, then a 50 ms wait before
+  * checking for the response). Every request has to end with the result its service asks for,
+  * and the pipelined run has to be at least UDS_TEST_MIN_SPEEDUP times the request rate.
+  *
+  * uds_client_host [-s seed] [-n requests per ECU] [-e ECUs] [-v]
+*/
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <FlexcanHostBus.h>
+#include <HostTest.h>
+#include <UdsClient.h>
+
+/* DEFINES */
+#define UDS_TEST_FRAME_US             250       // Time (us) an 8 byte frame takes on the bus at 500 kbit/s
+#define UDS_TEST_STEP_US              10        // Time (us) the simulation moves on by per step
+#define UDS_TEST_BUS_QUEUE_SIZE       64        // Frames waiting for the bus per direction, a power of two
+#define UDS_TEST_MAX_ECUS             ISOTP_NUM_PAIRS  // One ECU per diagnostic ID pair
+#define UDS_TEST_MAX_REQUESTS         2000      // Most requests per ECU
+#define UDS_TEST_DEFAULT_REQUESTS     200       // Requests per ECU when -n is not given
+#define UDS_TEST_DEFAULT_SEED         1         // Seed of the request mix when -s is not given
+#define UDS_TEST_PIPELINE_DEPTH       4         // Requests queued to each ECU at once in the pipelined run
+#define UDS_TEST_POLL_US              50000     // Wait (us) between sending and checking in the lockstep run, delay(50)
+#define UDS_TEST_ECU_DELAY_US         1000      // Time (us) an ECU takes to answer
+#define UDS_TEST_PENDING_US           40000     // Time (us) between the responses of a routine, each one in P2
+#define UDS_TEST_ROUTINE_PENDINGS     2         // Response pending responses before the routine result
+#define UDS_TEST_MAX_REPLIES          4         // Responses an ECU has scheduled at once
+#define UDS_TEST_MAX_REQUEST          8         // Longest request (bytes)
+#define UDS_TEST_MAX_RESPONSE         80        // Longest response (bytes)
+#define UDS_TEST_STRAY_BIT            0x40      // Reads of data identifiers with this bit get a stray response first
+#define UDS_TEST_MIN_SPEEDUP          5         // Pipelined request rate over the lockstep one
+
+/* STRUCTS */
+typedef struct {
+  uint64_t at;                          // Time (us) the response is sent, 0 for a free slot
+  uint16_t length;
+  uint8_t data[UDS_TEST_MAX_RESPONSE];
+} uds_test_reply_t;
+
+typedef struct {
+  isotp_link_t link;                    // ECU side of the ID pair
+  uint8_t rxBuffer[64];
+  uds_test_reply_t replies[UDS_TEST_MAX_REPLIES];
+  uint8_t replyData[UDS_TEST_MAX_RESPONSE];  // Response being sent, kept until the link is done with it
+  uint32_t strays;                      // Stray responses sent
+} uds_test_ecu_t;
+
+typedef struct {
+  uds_request_t request;
+  uint8_t data[UDS_TEST_MAX_REQUEST];
+  uint8_t response[UDS_TEST_MAX_RESPONSE];
+  uint8_t ecu;                          // ECU the request goes to
+  bool done;
+} uds_test_request_t;
+
+typedef struct {
+  uint32_t done;                        // Requests done
+  uint32_t errors;                      // Requests ending with another result than the one expected
+  uint32_t results[eUDS_RESULT_TRANSPORT + 1];
+  uint64_t latencySum;                  // Sum of the submit to done times (us) of the reads
+  uint32_t latencyMax;
+  uint32_t reads;
+} uds_test_stats_t;
+
+/* GLOBAL VARIABLES */
+static uds_client_t s_Client;
+static uds_ecu_t s_ClientEcus[UDS_TEST_MAX_ECUS];
+static isotp_stack_t s_EcuStack;
+static uds_test_ecu_t s_Ecus[UDS_TEST_MAX_ECUS];
+static uds_test_request_t s_Requests[UDS_TEST_MAX_ECUS][UDS_TEST_MAX_REQUESTS];
+static uds_test_stats_t s_Stats;
+static FLEXCAN_frame_t s_ToEcu[UDS_TEST_BUS_QUEUE_SIZE];
+static uint32_t s_ToEcuHead = 0;
+static uint32_t s_ToEcuTail = 0;
+static FLEXCAN_frame_t s_ToTester[UDS_TEST_BUS_QUEUE_SIZE];
+static uint32_t s_ToTesterHead = 0;
+static uint32_t s_ToTesterTail = 0;
+static uint64_t s_BusFreeAt = 0;
+static uint32_t s_NumRequests = UDS_TEST_DEFAULT_REQUESTS;
+static uint32_t s_NumEcus = UDS_TEST_MAX_ECUS;
+
+/** Frames transmitted by the simulated controller, i.e. sent by the client
+ *  @param *frame Frame transmitted
+ */
+static void uds_test_tx_handler(const FLEXCAN_frame_t *frame)
+{
+  if ((s_ToEcuHead - s_ToEcuTail) >= UDS_TEST_BUS_QUEUE_SIZE)
+  {
+    printf("bus queue to the ECUs full\n");
+    return;
+  }
+  memcpy(&s_ToEcu[s_ToEcuHead++ & (UDS_TEST_BUS_QUEUE_SIZE - 1)], frame, sizeof(FLEXCAN_frame_t));
+}
+
+/** Sender of the ECU links, straight onto the bus
+ *  @param *frame Frame
+ *  @return FLEXCAN_SUCCESS, FLEXCAN_ERROR if too many frames wait for the bus
+ */
+static int uds_test_ecu_send(const FLEXCAN_frame_t *frame)
+{
+  if ((s_ToTesterHead - s_ToTesterTail) >= UDS_TEST_BUS_QUEUE_SIZE)
+  {
+    return FLEXCAN_ERROR;
+  }
+  memcpy(&s_ToTester[s_ToTesterHead++ & (UDS_TEST_BUS_QUEUE_SIZE - 1)], frame, sizeof(FLEXCAN_frame_t));
+  return FLEXCAN_SUCCESS;
+}
+
+/** RX FIFO interrupt of the client
+ *  @param mb Unused
+ */
+static void uds_test_fifo_callback(uint8_t mb)
+{
+  FLEXCAN_frame_t frame;
+  while (FLEXCAN_fifo_avalible())
+  {
+    FLEXCAN_fifo_read(&frame);
+    UdsClientReceive(&s_Client, &frame);
+  }
+}
+
+/** Schedules a response of a simulated ECU
+ *  @param *ecu ECU
+ *  @param delay Time (us) from now
+ *  @param *data Response
+ *  @param length Length of the response
+ */
+static void UdsTestSchedule(uds_test_ecu_t *ecu, uint32_t delay, const uint8_t *data, uint16_t length)
+{
+  uint8_t i = 0;
+  for (i = 0; i < UDS_TEST_MAX_REPLIES; i++)
+  {
+    if (ecu->replies[i].at == 0)
+    {
+      ecu->replies[i].at = HostClockMicros() + delay;
+      ecu->replies[i].length = length;
+      memcpy(ecu->replies[i].data, data, length);
+      return;
+    }
+  }
+  printf("ECU 0x%03lX: no room for a response\n", (unsigned long) ecu->link.txId);
+}
+
+/** Simulated ECU: answers a request according to its service
+ */
+static void uds_test_ecu_received(isotp_link_t *link, IsoTpLinkResult_e result, const uint8_t *data, uint16_t length)
+{
+  uds_test_ecu_t *ecu = (uds_test_ecu_t *) link->arg;
+  uint8_t reply[UDS_TEST_MAX_RESPONSE];
+  uint16_t did = 0;
+  uint16_t i = 0;
+  uint8_t p = 0;
+
+  if (result != eISOTP_N_OK)
+  {
+    return;
+  }
+  switch (data[0])
+  {
+    case 0x22:                          // ReadDataByIdentifier: 3 + (DID & 0x3F) bytes
+    {
+      did = ((uint16_t) data[1] << 8) | data[2];
+      reply[0] = 0x62;
+      reply[1] = data[1];
+      reply[2] = data[2];
+      for (i = 3; i < 3 + (did & 0x3F); i++)
+      {
+        reply[i] = (uint8_t)(did + i);
+      }
+      if (did & UDS_TEST_STRAY_BIT)
+      {
+        uint8_t stray[2] = {0x7E, 0x00}; // tester present response nobody asked for
+        UdsTestSchedule(ecu, UDS_TEST_ECU_DELAY_US / 2, stray, sizeof(stray));
+        ecu->strays++;
+      }
+      UdsTestSchedule(ecu, UDS_TEST_ECU_DELAY_US, reply, i);
+      break;
+    }
+    case 0x10:                          // DiagnosticSessionControl
+    {
+      uint8_t positive[6] = {0x50, data[1], 0x00, 0x32, 0x01, 0xF4};
+      UdsTestSchedule(ecu, UDS_TEST_ECU_DELAY_US, positive, sizeof(positive));
+      break;
+    }
+    case 0x27:                          // SecurityAccess: invalid key
+    {
+      uint8_t negative[3] = {UDS_NEGATIVE_RESPONSE_SID, 0x27, UDS_NRC_INVALID_KEY};
+      UdsTestSchedule(ecu, UDS_TEST_ECU_DELAY_US, negative, sizeof(negative));
+      break;
+    }
+    case 0x31:                          // RoutineControl: response pending first
+    {
+      uint8_t pending[3] = {UDS_NEGATIVE_RESPONSE_SID, 0x31, UDS_NRC_RESPONSE_PENDING};
+      uint8_t positive[4] = {0x71, data[1], data[2], data[3]};
+      for (p = 0; p < UDS_TEST_ROUTINE_PENDINGS; p++)
+      {
+        UdsTestSchedule(ecu, UDS_TEST_ECU_DELAY_US + (p * UDS_TEST_PENDING_US), pending, sizeof(pending));
+      }
+      UdsTestSchedule(ecu, UDS_TEST_ECU_DELAY_US + (p * UDS_TEST_PENDING_US), positive, sizeof(positive));
+      break;
+    }
+    default: { break; }                 // ECUReset never answered, TesterPresent suppressed
+  }
+}
+
+/** Sends the responses of a simulated ECU that are due, oldest first, one at a time
+ *  @param *ecu ECU
+ */
+static void UdsTestEcuPoll(uds_test_ecu_t *ecu)
+{
+  uds_test_reply_t *due = NULL;
+  uint8_t i = 0;
+
+  if (IsoTpLinkBusy(&ecu->link))
+  {
+    return;
+  }
+  for (i = 0; i < UDS_TEST_MAX_REPLIES; i++)
+  {
+    if ((ecu->replies[i].at != 0) && (ecu->replies[i].at <= HostClockMicros()) && ((due == NULL) || (ecu->replies[i].at < due->at)))
+    {
+      due = &ecu->replies[i];
+    }
+  }
+  if (due != NULL)
+  {
+    memcpy(ecu->replyData, due->data, due->length);
+    if (IsoTpLinkSend(&ecu->link, ecu->replyData, due->length))
+    {
+      due->at = 0;
+    }
+  }
+}
+
+/** Puts the next frame on the bus once it is free, the lower ID wins when both sides have one waiting
+ */
+static void UdsTestBusStep(void)
+{
+  FLEXCAN_frame_t *toEcu = (s_ToEcuHead != s_ToEcuTail) ? &s_ToEcu[s_ToEcuTail & (UDS_TEST_BUS_QUEUE_SIZE - 1)] : NULL;
+  FLEXCAN_frame_t *toTester = (s_ToTesterHead != s_ToTesterTail) ? &s_ToTester[s_ToTesterTail & (UDS_TEST_BUS_QUEUE_SIZE - 1)] : NULL;
+
+  if ((HostClockMicros() < s_BusFreeAt) || ((toEcu == NULL) && (toTester == NULL)))
+  {
+    return;
+  }
+  s_BusFreeAt = HostClockMicros() + UDS_TEST_FRAME_US;
+  if ((toEcu != NULL) && ((toTester == NULL) || (toEcu->id < toTester->id)))
+  {
+    s_ToEcuTail++;
+    IsoTpStackReceive(&s_EcuStack, toEcu);
+  }
+  else
+  {
+    s_ToTesterTail++;
+    FlexcanHostReceive(toTester);
+  }
+}
+
+/** Moves the simulation on by one step
+ */
+static void UdsTestStep(void)
+{
+  uint8_t e = 0;
+
+  HostClockAdvanceMicros(UDS_TEST_STEP_US);
+  UdsTestBusStep();
+  UdsClientService(&s_Client);
+  IsoTpStackService(&s_EcuStack);
+  for (e = 0; e < s_NumEcus; e++)
+  {
+    UdsTestEcuPoll(&s_Ecus[e]);
+  }
+}
+
+/** Gets the result a request has to end with
+ *  @param *data Request
+ *  @return Result the simulated ECU leads to
+ */
+static UdsResult_e UdsTestExpected(const uint8_t *data)
+{
+  switch (data[0])
+  {
+    case 0x27: { return eUDS_RESULT_NEGATIVE; }
+    case 0x3E: { return eUDS_RESULT_SENT; }
+    case 0x11: { return eUDS_RESULT_TIMEOUT; }
+    default: { return eUDS_RESULT_POSITIVE; }
+  }
+}
+
+/** Checks a request when it is done
+ */
+static void uds_test_request_callback(uds_request_t *request, UdsResult_e result)
+{
+  uds_test_request_t *test = (uds_test_request_t *) request->arg;
+  uds_ecu_t *ecu = &s_ClientEcus[test->ecu];
+  uint32_t latency = request->doneAt - request->submittedAt;
+  uint32_t waited = request->doneAt - request->sentAt;
+  bool good = (result == UdsTestExpected(test->data));
+
+  test->done = true;
+  s_Stats.done++;
+  s_Stats.results[result]++;
+  switch (test->data[0])
+  {
+    case 0x22:
+    {
+      good = good && (request->responseLength == 3U + (test->data[2] & 0x3F)) && (test->response[1] == test->data[1]) &&
+             (test->response[2] == test->data[2]);
+      s_Stats.latencySum += latency;
+      s_Stats.latencyMax = (latency > s_Stats.latencyMax) ? latency : s_Stats.latencyMax;
+      s_Stats.reads++;
+      break;
+    }
+    case 0x27: { good = good && (request->nrc == UDS_NRC_INVALID_KEY); break; }
+    case 0x31: { good = good && (request->pendings == UDS_TEST_ROUTINE_PENDINGS) && (test->response[1] == test->data[1]); break; }
+    case 0x11: { good = good && (waited >= ecu->p2 * 1000UL) && (waited <= (ecu->p2 * 1000UL) + 1000); break; }
+    default: { break; }
+  }
+  if (!good)
+  {
+    HostTestFail("ECU 0x%03lX request %02X %02X %02X: result %d, %u bytes, NRC 0x%02X, %u pending, %lu us",
+                 (unsigned long) ecu->link.txId, test->data[0], test->data[1], test->data[2], result, request->responseLength,
+                 request->nrc, request->pendings, (unsigned long) waited);
+    s_Stats.errors++;
+  }
+  if (g_HostTestVerbose)
+  {
+    printf("%10llu ECU 0x%03lX %02X %02X: result %d in %lu us\n", (unsigned long long) HostClockMicros(),
+           (unsigned long) ecu->link.txId, test->data[0], test->data[1], result, (unsigned long) latency);
+  }
+}
+
+/** Builds the random request mix, the same for both runs
+ */
+static void UdsTestBuildRequests(void)
+{
+  uds_test_request_t *test = NULL;
+  uint32_t i = 0;
+  uint8_t e = 0;
+  uint8_t *d = NULL;
+
+  for (e = 0; e < s_NumEcus; e++)
+  {
+    for (i = 0; i < s_NumRequests; i++)
+    {
+      test = &s_Requests[e][i];
+      memset(test, 0, sizeof(uds_test_request_t));
+      test->ecu = e;
+      d = test->data;
+      switch (random(20))
+      {
+        case 0: case 1: { d[0] = 0x10; d[1] = 0x03; UdsRequestInit(&test->request, d, 2, test->response, UDS_TEST_MAX_RESPONSE, uds_test_request_callback, test); break; }
+        case 2: case 3: { d[0] = 0x27; d[1] = 0x02; d[2] = random(256); d[3] = random(256); UdsRequestInit(&test->request, d, 4, test->response, UDS_TEST_MAX_RESPONSE, uds_test_request_callback, test); break; }
+        case 4: case 5: { d[0] = 0x3E; d[1] = 0x80; UdsRequestInit(&test->request, d, 2, test->response, UDS_TEST_MAX_RESPONSE, uds_test_request_callback, test); break; }
+        case 6: { d[0] = 0x31; d[1] = 0x01; d[2] = 0xFF; d[3] = random(256); UdsRequestInit(&test->request, d, 4, test->response, UDS_TEST_MAX_RESPONSE, uds_test_request_callback, test); break; }
+        case 7: { d[0] = 0x11; d[1] = 0x01; UdsRequestInit(&test->request, d, 2, test->response, UDS_TEST_MAX_RESPONSE, uds_test_request_callback, test); break; }
+        default: { d[0] = 0x22; d[1] = 0xF1; d[2] = random(256); UdsRequestInit(&test->request, d, 3, test->response, UDS_TEST_MAX_RESPONSE, uds_test_request_callback, test); break; }
+      }
+    }
+  }
+}
+
+/** Sets up the client and the ECUs for a run
+ */
+static void UdsTestSetup(void)
+{
+  const isotp_id_pair_t *pair = NULL;
+  uint8_t e = 0;
+
+  s_ToEcuHead = s_ToEcuTail = 0;
+  s_ToTesterHead = s_ToTesterTail = 0;
+  s_BusFreeAt = HostClockMicros();
+  memset(&s_Stats, 0, sizeof(s_Stats));
+  UdsClientInit(&s_Client, NULL);
+  IsoTpStackInit(&s_EcuStack, uds_test_ecu_send);
+  for (e = 0; e < s_NumEcus; e++)
+  {
+    pair = IsoTpGetPair(e);
+    UdsClientAddEcu(&s_Client, &s_ClientEcus[e], pair->requestId, pair->responseId);
+    memset(&s_Ecus[e], 0, sizeof(uds_test_ecu_t));
+    IsoTpLinkInit(&s_Ecus[e].link, pair->responseId, pair->requestId, s_Ecus[e].rxBuffer, sizeof(s_Ecus[e].rxBuffer),
+                  uds_test_ecu_received, NULL, &s_Ecus[e]);
+    IsoTpStackAdd(&s_EcuStack, &s_Ecus[e].link);
+  }
+}
+
+/** Runs every request, a few queued to each ECU at a time
+ *  @return Time (us) taken
+ */
+static uint64_t UdsTestRunPipelined(void)
+{
+  uint32_t next[UDS_TEST_MAX_ECUS] = {0};
+  uint64_t start = HostClockMicros();
+  uint32_t total = s_NumRequests * s_NumEcus;
+  uint8_t e = 0;
+
+  while (s_Stats.done < total)
+  {
+    for (e = 0; e < s_NumEcus; e++)
+    {
+      while ((next[e] < s_NumRequests) &&
+             ((next[e] < UDS_TEST_PIPELINE_DEPTH) || s_Requests[e][next[e] - UDS_TEST_PIPELINE_DEPTH].done))
+      {
+        UdsClientSubmit(&s_ClientEcus[e], &s_Requests[e][next[e]].request);
+        next[e]++;
+      }
+    }
+    UdsTestStep();
+  }
+  return HostClockMicros() - start;
+}
+
+/** Runs every request one at a time over all ECUs, sending and then waiting UDS_TEST_POLL_US
+ *  before checking for the response, as often as needed
+ *  @return Time (us) taken
+ */
+static uint64_t UdsTestRunLockstep(void)
+{
+  uint64_t start = HostClockMicros();
+  uint64_t poll = 0;
+  uint32_t i = 0;
+  uint8_t e = 0;
+
+  for (i = 0; i < s_NumRequests; i++)
+  {
+    for (e = 0; e < s_NumEcus; e++)
+    {
+      uds_test_request_t *test = &s_Requests[e][i];
+      UdsClientSubmit(&s_ClientEcus[e], &test->request);
+      do
+      {
+        poll = HostClockMicros() + UDS_TEST_POLL_US;
+        while (HostClockMicros() < poll)
+        {
+          UdsTestStep();
+        }
+      } while (!test->done);
+    }
+  }
+  return HostClockMicros() - start;
+}
+
+/** Prints the outcome of a run and checks the counters of the client against the requests
+ *  @param *name Name of the run
+ *  @param elapsed Time (us) taken
+ */
+static void UdsTestReport(const char *name, uint64_t elapsed)
+{
+  uint32_t unmatched = 0;
+  uint32_t strays = 0;
+  uint8_t e = 0;
+
+  for (e = 0; e < s_NumEcus; e++)
+  {
+    unmatched += s_ClientEcus[e].unmatched;
+    strays += s_Ecus[e].strays;
+  }
+  HOST_TEST_CHECK(unmatched == strays, "%s: %lu responses unmatched, %lu stray responses sent", name, (unsigned long) unmatched,
+                  (unsigned long) strays);
+  printf("%-9s %5lu requests in %9.1f ms: %8.1f requests/s, read latency mean %5lu us max %6lu us, "
+         "%lu positive %lu negative %lu sent %lu timeout %lu transport, %lu unmatched, %lu errors\n",
+         name, (unsigned long) s_Stats.done, elapsed / 1000.0, s_Stats.done * 1e6 / elapsed,
+         (unsigned long)(s_Stats.reads ? (s_Stats.latencySum / s_Stats.reads) : 0), (unsigned long) s_Stats.latencyMax,
+         (unsigned long) s_Stats.results[eUDS_RESULT_POSITIVE], (unsigned long) s_Stats.results[eUDS_RESULT_NEGATIVE],
+         (unsigned long) s_Stats.results[eUDS_RESULT_SENT], (unsigned long) s_Stats.results[eUDS_RESULT_TIMEOUT],
+         (unsigned long) s_Stats.results[eUDS_RESULT_TRANSPORT], (unsigned long) unmatched, (unsigned long) s_Stats.errors);
+}
+
+int main(int argc, char **argv)
+{
+  FLEXCAN_config_t canConfig;
+  uint32_t seed = UDS_TEST_DEFAULT_SEED;
+  uint64_t pipelined = 0;
+  uint64_t lockstep = 0;
+  double speedup = 0;
+  const host_test_option_t options[] =
+  {
+    {'s', eHOST_TEST_UINT, &seed},
+    {'n', eHOST_TEST_UINT, &s_NumRequests},
+    {'e', eHOST_TEST_UINT, &s_NumEcus}
+  };
+
+  if (!HostTestOptions(argc, argv, "[-s seed] [-n requests per ECU] [-e ECUs] [-v]", options, sizeof(options) / sizeof(options[0])))
+  {
+    return 1;
+  }
+  if ((s_NumRequests == 0) || (s_NumRequests > UDS_TEST_MAX_REQUESTS) || (s_NumEcus == 0) || (s_NumEcus > UDS_TEST_MAX_ECUS))
+  {
+    HostTestUsage();
+    return 1;
+  }
+  randomSeed(seed);
+
+  HostClockUseVirtualTime(true);
+  FlexcanHostReset();
+  canConfig.presdiv = 1;                // 500 kbit/s from the 16 MHz oscillator
+  canConfig.propseg = 2;
+  canConfig.rjw = 1;
+  canConfig.pseg_1 = 7;
+  canConfig.pseg_2 = 3;
+  FLEXCAN_init(canConfig);
+  FLEXCAN_fifo_reg_callback(uds_test_fifo_callback);
+  FLEXCAN_txq_init(NULL);
+  FlexcanHostSetTxHandler(uds_test_tx_handler);
+
+  UdsTestBuildRequests();
+  UdsTestSetup();
+  pipelined = UdsTestRunPipelined();
+  UdsTestReport("pipelined", pipelined);
+
+  UdsTestSetup();
+  lockstep = UdsTestRunLockstep();
+  UdsTestReport("lockstep", lockstep);
+
+  speedup = (double) lockstep / pipelined;
+  printf("pipelined %.1f x the request rate of lockstep\n", speedup);
+  HOST_TEST_CHECK(speedup >= UDS_TEST_MIN_SPEEDUP, "pipelined below %.1f x the request rate of lockstep", (double) UDS_TEST_MIN_SPEEDUP);
+  return HostTestSummary();
+}
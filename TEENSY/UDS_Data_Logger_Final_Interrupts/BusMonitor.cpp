@@ -0,0 +1,228 @@
+/*
+  * @file BusMonitor.cpp
+  *
+  * Follows the fault confinement state of the CAN controller and brings it back from bus off
+*/
+
+/* INCLUDES */
+#include "BusMonitor.h"
+
+/* CONSTANTS */
+const char *BusFaultNames[] = {"Error Active", "Error Passive", "Bus Off"};
+const char *BusRecoveryNames[] = {"automatic", "hold-off", "manual"};
+
+/** Gets the fault confinement state from a controller status
+ *  @param *status Controller status
+ *  @return State, FLT_CONF 2 and 3 both mean bus off
+ */
+static BusFault_e BusMonitorFault(const FLEXCAN_status_t *status)
+{
+  if (status->flt_conf >= FLEXCAN_FLT_BUS_OFF)
+  {
+    return eBUS_OFF;
+  }
+  if (status->flt_conf == FLEXCAN_FLT_ERROR_PASSIVE)
+  {
+    return eBUS_ERROR_PASSIVE;
+  }
+  return eBUS_ERROR_ACTIVE;
+}
+
+/** Queues an event if the controller changed state and updates the counters
+ *  Called from the interrupts, or from the main loop with interrupts disabled
+ *  @param *mon Bus monitor struct
+ *  @param *status Controller status
+ */
+static void BusMonitorChange(bus_monitor_t *mon, const FLEXCAN_status_t *status)
+{
+  BusFault_e fault = BusMonitorFault(status);
+  uint32_t current = micros();
+  bus_event_t *event = NULL;
+
+  if (fault == mon->fault)
+  {
+    return;
+  }
+  if ((mon->head - mon->tail) < BUS_EVENT_QUEUE_SIZE)
+  {
+    event = &mon->events[mon->head & (BUS_EVENT_QUEUE_SIZE - 1)];
+    event->timestamp = current;
+    event->duration = current - mon->faultSince;
+    event->errors = status->errors;
+    event->fault = fault;
+    event->previous = mon->fault;
+    event->txErrors = status->tx_err_cnt;
+    event->rxErrors = status->rx_err_cnt;
+    mon->head = mon->head + 1;
+  }
+  else
+  {
+    mon->eventsDropped++;
+  }
+
+  if (fault == eBUS_OFF)
+  {
+    mon->busOffs++;
+    mon->held = (mon->policy != eBUS_RECOVERY_AUTOMATIC);
+  }
+  else if (mon->fault == eBUS_OFF)
+  {
+    mon->recoveries++;
+    mon->recoveryLast = current - mon->faultSince;
+    if (mon->recoveryLast > mon->recoveryMax)
+    {
+      mon->recoveryMax = mon->recoveryLast;
+    }
+    mon->held = false;
+    if (mon->policy != eBUS_RECOVERY_AUTOMATIC) // hold the next bus off again
+    {
+      FLEXCAN_set_bus_off_recovery(0);
+    }
+  }
+  if (fault == eBUS_ERROR_PASSIVE)
+  {
+    mon->errorPassives++;
+  }
+  mon->fault = fault;
+  mon->faultSince = current;
+}
+
+/** Initializes the bus monitor, called after FLEXCAN_init
+ *  @param *mon Bus monitor struct to be initialized
+ *  @param policy How the controller leaves bus off
+ *  @param holdoff Time (ms) to stay off the bus with eBUS_RECOVERY_HOLDOFF
+ */
+void BusMonitorInit(bus_monitor_t *mon, BusRecovery_e policy, uint32_t holdoff)
+{
+  memset(mon, 0, sizeof(bus_monitor_t));
+  mon->fault = eBUS_ERROR_ACTIVE;
+  mon->faultSince = micros();
+  BusMonitorSetPolicy(mon, policy, holdoff);
+}
+
+/** Sets how the controller leaves bus off
+ *  A controller held in bus off is released right away when the policy becomes automatic
+ *  @param *mon Bus monitor struct
+ *  @param policy How the controller leaves bus off
+ *  @param holdoff Time (ms) to stay off the bus with eBUS_RECOVERY_HOLDOFF
+ */
+void BusMonitorSetPolicy(bus_monitor_t *mon, BusRecovery_e policy, uint32_t holdoff)
+{
+  __disable_irq();
+  mon->policy = policy;
+  mon->holdoff = holdoff;
+  if ((mon->fault != eBUS_OFF) || (policy == eBUS_RECOVERY_AUTOMATIC))
+  {
+    mon->held = false;
+    FLEXCAN_set_bus_off_recovery(policy == eBUS_RECOVERY_AUTOMATIC);
+  }
+  __enable_irq();
+}
+
+/** Handles the status read by the error, warning and bus off interrupts
+ *  @param *mon Bus monitor struct
+ *  @param *status Controller status, its interrupt flags tell which interrupts ran
+ */
+void BusMonitorIsr(bus_monitor_t *mon, FLEXCAN_status_t *status)
+{
+  if (status->errors & FLEXCAN_ESR_ERR_INT)
+  {
+    mon->errorInterrupts++;
+  }
+  if (status->errors & (FLEXCAN_ESR_TWRN_INT | FLEXCAN_ESR_RWRN_INT))
+  {
+    mon->warnings++;
+  }
+  BusMonitorChange(mon, status);
+}
+
+/** Reads the controller status for the changes no interrupt reports: back to error active
+ *  from error passive or bus off
+ *  Called from the CAN interrupt, or from the main loop with interrupts disabled
+ *  @param *mon Bus monitor struct
+ */
+void BusMonitorPoll(bus_monitor_t *mon)
+{
+  FLEXCAN_status_t status;
+
+  FLEXCAN_status(&status);
+  BusMonitorChange(mon, &status);
+}
+
+/** Polls the controller while the bus is faulted and ends the hold-off, called from the main loop
+ *  @param *mon Bus monitor struct
+ */
+void BusMonitorService(bus_monitor_t *mon)
+{
+  if (mon->fault == eBUS_ERROR_ACTIVE)
+  {
+    return;
+  }
+  __disable_irq();
+  BusMonitorPoll(mon);
+  if (mon->held && (mon->policy == eBUS_RECOVERY_HOLDOFF) && ((micros() - mon->faultSince) >= (mon->holdoff * 1000)))
+  {
+    mon->held = false;
+    FLEXCAN_set_bus_off_recovery(1);
+  }
+  __enable_irq();
+}
+
+/** Lets a controller held in bus off recover
+ *  The 128 x 11 recessive bits count from going bus off, so after a long hold-off the
+ *  controller joins the bus again 11 recessive bits later
+ *  @param *mon Bus monitor struct
+ */
+void BusMonitorRecover(bus_monitor_t *mon)
+{
+  __disable_irq();
+  if (mon->held)
+  {
+    mon->held = false;
+    FLEXCAN_set_bus_off_recovery(1);
+  }
+  __enable_irq();
+}
+
+/** Takes the oldest queued event, called from the main loop
+ *  @param *mon Bus monitor struct
+ *  @param *event Event to be set
+ *  @return Whether or not an event was queued
+ */
+bool BusMonitorPop(bus_monitor_t *mon, bus_event_t *event)
+{
+  if (mon->tail == mon->head)
+  {
+    return false;
+  }
+  memcpy(event, &mon->events[mon->tail & (BUS_EVENT_QUEUE_SIZE - 1)], sizeof(bus_event_t));
+  mon->tail = mon->tail + 1;
+  return true;
+}
+
+/** Formats an event as one line
+ *  e.g. "5012345 us: Bus Off after 8012 us Error Passive, TEC 255 REC 0, ESR1 0x00004236"
+ *  @param *event Event
+ *  @param *line Line to be set
+ *  @param size Size of the line
+ */
+void BusMonitorFormatEvent(const bus_event_t *event, char *line, size_t size)
+{
+  snprintf(line, size, "%lu us: %s after %lu us %s, TEC %u REC %u, ESR1 0x%08lX", (unsigned long) event->timestamp,
+           BusFaultNames[event->fault], (unsigned long) event->duration, BusFaultNames[event->previous],
+           event->txErrors, event->rxErrors, (unsigned long) event->errors);
+}
+
+/** Prints the state of the bus and the fault counters
+ *  @param *mon Bus monitor struct
+ *  @param *out Output
+ */
+void BusMonitorPrint(bus_monitor_t *mon, Print *out)
+{
+  char line[240];
+  snprintf(line, sizeof(line), "CAN bus: %s%s, %lu error interrupts, %lu warnings, %lu error passive, %lu bus off (%lu recovered, last %lu us, max %lu us), %s recovery, %lu events dropped",
+           BusFaultNames[mon->fault], mon->held ? " (held)" : "", (unsigned long) mon->errorInterrupts, (unsigned long) mon->warnings,
+           (unsigned long) mon->errorPassives, (unsigned long) mon->busOffs, (unsigned long) mon->recoveries, (unsigned long) mon->recoveryLast,
+           (unsigned long) mon->recoveryMax, BusRecoveryNames[mon->policy], (unsigned long) mon->eventsDropped);
+  out->println(line);
+}
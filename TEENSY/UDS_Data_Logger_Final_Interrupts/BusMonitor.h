@@ -0,0 +1,93 @@
+/*
+  * @file BusMonitor.h
+  *
+  * Follows the fault confinement state of the CAN controller and brings it back from bus off.
+  * The error, warning and bus off interrupts queue every change of state as a bus event; the
+  * controller has no interrupt for the way back to error active, so that is found by the first
+  * frame received afterwards, or by the main loop polling the status while the bus is faulted.
+  * A bus off controller needs 128 x 11 recessive bits before it may take part again
+  * (FLEXCAN_BUS_OFF_RECOVERY_BITS, 2.8 ms at 500 kbit/s); the recovery policy decides whether
+  * the controller starts on that right away, after a hold-off time, or when the user asks for it.
+*/
+
+#ifndef BUSMONITOR_H
+#define BUSMONITOR_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <stdint.h>
+#include <can.h>
+
+/* DEFINES */
+#define BUS_EVENT_QUEUE_SIZE          16        // Number of bus events waiting for the main loop, a power of two
+
+/* ENUMS */
+enum BusFault_e
+{
+  eBUS_ERROR_ACTIVE = 0,                // Taking part in bus traffic
+  eBUS_ERROR_PASSIVE,                   // An error counter is above 127, the controller only sends passive error flags
+  eBUS_OFF                              // TX error counter above 255, the controller is off the bus
+};
+
+enum BusRecovery_e
+{
+  eBUS_RECOVERY_AUTOMATIC = 0,          // Recover as soon as the spec allows, the controller starts on its own
+  eBUS_RECOVERY_HOLDOFF,                // Stay off the bus for the hold-off time first, then recover
+  eBUS_RECOVERY_MANUAL                  // Stay off the bus until BusMonitorRecover is called
+};
+
+/* STRUCTS */
+typedef struct {
+  uint32_t timestamp;                   // Time (micros) the state was entered
+  uint32_t duration;                    // Time (us) spent in the previous state
+  uint32_t errors;                      // ESR1 as read with the change
+  uint8_t fault;                        // BusFault_e entered
+  uint8_t previous;                     // BusFault_e left
+  uint8_t txErrors;                     // TX error counter
+  uint8_t rxErrors;                     // RX error counter
+} bus_event_t;
+
+typedef struct {
+  bus_event_t events[BUS_EVENT_QUEUE_SIZE];  // Event queue
+  volatile uint32_t head;               // Number of events queued, written by the interrupts
+  volatile uint32_t tail;               // Number of events taken, written by the main loop
+  volatile uint8_t fault;               // Current BusFault_e
+  uint32_t faultSince;                  // Time (micros) the current state was entered
+  BusRecovery_e policy;                 // How the controller leaves bus off
+  uint32_t holdoff;                     // Time (ms) to stay off the bus with eBUS_RECOVERY_HOLDOFF
+  volatile bool held;                   // Whether or not the controller is bus off and not allowed to recover yet
+  uint32_t errorInterrupts;             // Number of error interrupts
+  uint32_t warnings;                    // Number of TX and RX warning interrupts
+  uint32_t errorPassives;               // Number of times the controller went error passive
+  uint32_t busOffs;                     // Number of times the controller went bus off
+  uint32_t recoveries;                  // Number of times the controller came back from bus off
+  uint32_t recoveryLast;                // Time (us) from going bus off to receiving again, the last time
+  uint32_t recoveryMax;                 // Longest recovery (us)
+  uint32_t eventsDropped;               // Events lost because the queue was full
+} bus_monitor_t;
+
+/* FUNCTION PROTOTYPES */
+void BusMonitorInit(bus_monitor_t *mon, BusRecovery_e policy, uint32_t holdoff);
+void BusMonitorSetPolicy(bus_monitor_t *mon, BusRecovery_e policy, uint32_t holdoff);
+void BusMonitorIsr(bus_monitor_t *mon, FLEXCAN_status_t *status);
+void BusMonitorPoll(bus_monitor_t *mon);
+void BusMonitorService(bus_monitor_t *mon);
+void BusMonitorRecover(bus_monitor_t *mon);
+bool BusMonitorPop(bus_monitor_t *mon, bus_event_t *event);
+void BusMonitorFormatEvent(const bus_event_t *event, char *line, size_t size);
+void BusMonitorPrint(bus_monitor_t *mon, Print *out);
+
+/** Notes a received frame, called from the CAN interrupt
+ *  Only costs a compare while the bus is error active; otherwise the frame may be the first one
+ *  after a recovery, and the status is read to find out
+ *  @param *mon Bus monitor struct
+ */
+static inline void BusMonitorFrame(bus_monitor_t *mon)
+{
+  if (mon->fault != eBUS_ERROR_ACTIVE)
+  {
+    BusMonitorPoll(mon);
+  }
+}
+
+#endif // BUSMONITOR_H
@@ -9,15 +9,13 @@
 #include "CANMessage.h"
 
 /** Initializes CAN configuration parameters
+ *  The timing is worked out by the compiler from CAN_BITRATE and CAN_SAMPLE_POINT, at 500 kbit/s
+ *  and 75% it is 16 time quanta: PRESDIV 1, PROPSEG 2, RJW 1, PSEG1 7, PSEG2 3
  *  @param *canConfig CAN configuration struct to be set
  */
 void CanConfigInit(FLEXCAN_config_t *canConfig)
 {
-  canConfig->presdiv   = 1;  // Prescale division factor.
-  canConfig->propseg   = 2;  // Prop Seg length.
-  canConfig->rjw       = 1;  // Sychronization Jump Width
-  canConfig->pseg_1    = 7;  // Phase 1 length
-  canConfig->pseg_2    = 3;  // Phase 2 length
+  *canConfig = FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, CAN_BITRATE, CAN_SAMPLE_POINT);
 }
 
 
@@ -35,6 +33,25 @@ bool CanFifoRead(FLEXCAN_frame_t *frame)
   return false;
 }
 
+/** Prints an arbitration ID in hex the way the logs hold it
+ *  Extended IDs are padded to CAN_EXT_ID_DIGITS digits so they can be told from standard IDs
+ *  @param *out Serial port or file to print to
+ *  @param id Arbitration ID
+ *  @param ide Whether or not the ID is extended
+ */
+void PrintCanId(Print *out, uint32_t id, uint8_t ide)
+{
+  uint8_t shift = 0;
+  if (ide)
+  {
+    for (shift = (CAN_EXT_ID_DIGITS - 1) * 4; (shift > 0) && ((id >> shift) == 0); shift -= 4)
+    {
+      out->print('0');
+    }
+  }
+  out->print(id, HEX);
+}
+
 /** Prints a message to the serial port
  *  @param *message Message struct containing message data
  */
@@ -43,7 +60,7 @@ void SerialPrintCanMessage(can_message_t *message)
   uint8_t currentData = 0;
   Serial.print(message->timestamp, DEC);
   Serial.print(" ");
-  Serial.print(message->id, HEX);
+  PrintCanId(&Serial, message->id, message->ide);
   Serial.print(" ");
   for (currentData = 0; currentData < message->len; currentData++)
   {
@@ -62,7 +79,7 @@ void SerialPrintFrame(FLEXCAN_frame_t *frame)
   int dataIndex = 0;
   Serial.print(millis(), DEC);
   Serial.print(" ");
-  Serial.print(frame->id, HEX);
+  PrintCanId(&Serial, frame->id, frame->ide);
   Serial.print(" ");
   for (dataIndex = 0; dataIndex < frameLength; dataIndex++)
   {
@@ -86,7 +103,7 @@ int GenerateFrame(FLEXCAN_frame_t *frame, uint16_t minID, uint16_t maxID)
   {
     int dataCounter = 0;
     frame->dlc = random(0, 8 + 1);
-    for (dataCounter = 0; dataCounter < frame->dlc; dataCounter++)
+    for (dataCounter = 0; (dataCounter < frame->dlc) && (dataCounter < (int) sizeof(frame->data)); dataCounter++)
     {
       frame->data[dataCounter] = random(0, 255 + 1);
     }
@@ -105,6 +122,7 @@ void TransposeCanMessage(can_message_t *message, FLEXCAN_frame_t *frame)
 {
   message->timestamp = millis();
   memcpy(&(message->len), &(frame->dlc), sizeof(frame->dlc));
+  message->ide = frame->ide;
   memcpy(&(message->id), &(frame->id), sizeof(frame->id));
   memcpy(&(message->data), &(frame->data), sizeof(frame->data));
 }
@@ -11,12 +11,20 @@
 
 /* INCLUDES */
 #include <can.h>
+#include <can_timing.h>
 #include <string.h>
 
+/* DEFINES */
+#define CAN_MAX_STD_ID      0x7FF       // Largest standard (11 bit) arbitration ID
+#define CAN_EXT_ID_DIGITS   8           // Hex digits of an extended ID in the text formats, standard IDs have at most 3
+#define CAN_BITRATE         500000      // Bit rate (bit/s) of the vehicle bus
+#define CAN_SAMPLE_POINT    750         // Sample point (per mille of the bit)
+
 /* STRUCTS */
 typedef struct {
   uint32_t timestamp; // Timestamp - milliseconds since runtime
   uint8_t len;        // Data length code [0 - 8]
+  uint8_t ide;        // ID Extended bit: 1 - extended (29 bit) ID, 0 - standard (11 bit) ID
   uint32_t id;        // Arbitration ID
   uint8_t data[8];    // Data payload - maximum 8 bytes
 } can_message_t;
@@ -24,6 +32,7 @@ typedef struct {
 /* FUNCTION PROTOTYPES */
 void CanConfigInit(FLEXCAN_config_t *canConfig);
 bool CanFifoRead(FLEXCAN_frame_t *frame);
+void PrintCanId(Print *out, uint32_t id, uint8_t ide);
 void SerialPrintCanMessage(can_message_t *message);
 void SerialPrintFrame(FLEXCAN_frame_t *frame);
 int GenerateFrame(FLEXCAN_frame_t *frame, uint16_t minID, uint16_t maxID);
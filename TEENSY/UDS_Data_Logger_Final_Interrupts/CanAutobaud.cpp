@@ -0,0 +1,185 @@
+/*
+  * @file CanAutobaud.cpp
+  *
+  * Finds the bit rate of the bus in listen only mode
+*/
+
+/* INCLUDES */
+#include "CanAutobaud.h"
+#include "CANMessage.h"
+
+/* DEFINES */
+#define CAN_BIT_RATE(bitRate, name)   {(bitRate), FLEXCAN_TIMING(FLEXCAN_CLOCK_HZ, (bitRate), CAN_SAMPLE_POINT), (name)}
+
+/* CONSTANTS */
+const can_bit_rate_t CanBitRateTable[CAN_NUM_BIT_RATES] =
+{
+  // most common on vehicles first, the timing of each is worked out by the compiler
+  CAN_BIT_RATE(500000, "500 kbit/s"),
+  CAN_BIT_RATE(250000, "250 kbit/s"),
+  CAN_BIT_RATE(125000, "125 kbit/s"),
+  CAN_BIT_RATE(1000000, "1000 kbit/s"),
+  CAN_BIT_RATE(100000, "100 kbit/s"),
+  CAN_BIT_RATE(83333, "83.3 kbit/s"),
+  CAN_BIT_RATE(50000, "50 kbit/s"),
+  CAN_BIT_RATE(200000, "200 kbit/s"),
+  CAN_BIT_RATE(95238, "95.2 kbit/s"),
+  CAN_BIT_RATE(80000, "80 kbit/s"),
+  CAN_BIT_RATE(40000, "40 kbit/s"),
+  CAN_BIT_RATE(33333, "33.3 kbit/s"),
+  CAN_BIT_RATE(31250, "31.25 kbit/s"),
+  CAN_BIT_RATE(20000, "20 kbit/s"),
+  CAN_BIT_RATE(10000, "10 kbit/s"),
+  CAN_BIT_RATE(5000, "5 kbit/s")
+};
+
+const char *CanAutobaudStateNames[] = {"idle", "listening", "detected", "not found"};
+
+/* GLOBAL VARIABLES */
+static can_autobaud_t *s_Autobaud = NULL;   // Detection holding the status callback of the driver
+
+/** Status callback of the driver while a detection runs: the error interrupt reads (and clears)
+ *  the error flags before the main loop could
+ *  @param *status Controller status read by the interrupt
+ */
+static void can_autobaud_status_callback(FLEXCAN_status_t *status)
+{
+  if (s_Autobaud != NULL)
+  {
+    s_Autobaud->errorFlags |= status->errors & CAN_AUTOBAUD_ERRORS;
+  }
+}
+
+/** Sets the controller to a bit rate and forgets what was seen at the last one
+ *  @param *ab Autobaud struct
+ *  @param index Bit rate to be tried
+ */
+static void CanAutobaudSetRate(can_autobaud_t *ab, uint8_t index)
+{
+  FLEXCAN_status_t status;
+  FLEXCAN_frame_t frame;
+
+  ab->index = index;
+  FLEXCAN_set_timing(ab->rates[index].config);
+  FLEXCAN_status(&status); // reading ESR1 clears the errors of the last bit rate
+  while (CanFifoRead(&frame))
+  {
+  }
+  ab->errorFlags = 0;
+  ab->confirmed = 0;
+  ab->rateSince = micros();
+  ab->ratesTried++;
+}
+
+/** Ends a detection and gives the status callback back
+ *  @param *ab Autobaud struct
+ *  @param state eAUTOBAUD_DETECTED or eAUTOBAUD_FAILED
+ *  @param now Time (micros) the detection ended
+ */
+static void CanAutobaudStop(can_autobaud_t *ab, CanAutobaudState_e state, uint32_t now)
+{
+  ab->state = state;
+  ab->detectTime = now - ab->startedAt;
+  FLEXCAN_status_reg_callback(NULL);
+  s_Autobaud = NULL;
+}
+
+/** Starts finding the bit rate, called after FLEXCAN_init and before FLEXCAN_fifo_reg_callback
+ *  Puts the controller in listen only mode at the first bit rate
+ *  @param *ab Autobaud struct to be initialized
+ *  @param *rates Bit rates tried, in order (CanBitRateTable)
+ *  @param numRates Number of bit rates
+ *  @param timeout Time (ms) to give up after, 0 to keep trying
+ */
+void CanAutobaudStart(can_autobaud_t *ab, const can_bit_rate_t *rates, uint8_t numRates, uint32_t timeout)
+{
+  memset(ab, 0, sizeof(can_autobaud_t));
+  ab->rates = rates;
+  ab->numRates = numRates;
+  ab->timeout = timeout;
+  ab->startedAt = micros();
+  if (numRates == 0)
+  {
+    ab->state = eAUTOBAUD_FAILED;
+    return;
+  }
+  ab->state = eAUTOBAUD_LISTENING;
+  s_Autobaud = ab;
+  FLEXCAN_status_reg_callback(can_autobaud_status_callback);
+  FLEXCAN_set_listen_only(1);
+  CanAutobaudSetRate(ab, 0);
+}
+
+/** Runs the detection, called from the main loop as often as it can
+ *  An error at the current bit rate moves on to the next one, CAN_AUTOBAUD_CONFIRM_FRAMES frames
+ *  without one end the detection
+ *  @param *ab Autobaud struct
+ *  @return State of the detection
+ */
+CanAutobaudState_e CanAutobaudService(can_autobaud_t *ab)
+{
+  FLEXCAN_status_t status;
+  FLEXCAN_frame_t frame;
+  uint32_t errors = 0;
+  uint32_t now = 0;
+
+  if (ab->state != eAUTOBAUD_LISTENING)
+  {
+    return (CanAutobaudState_e) ab->state;
+  }
+
+  FLEXCAN_status(&status); // errors flagged with the error interrupt masked
+  errors = (status.errors & CAN_AUTOBAUD_ERRORS) | ab->errorFlags;
+  while (CanFifoRead(&frame))
+  {
+    ab->frames++;
+    ab->confirmed++;
+  }
+
+  now = micros();
+  if (errors != 0)
+  {
+    // a frame that came through at a wrong bit rate does not make up for the ones that did not
+    ab->rejected++;
+    CanAutobaudSetRate(ab, (ab->index + 1) % ab->numRates);
+  }
+  else if (ab->confirmed >= CAN_AUTOBAUD_CONFIRM_FRAMES)
+  {
+    CanAutobaudStop(ab, eAUTOBAUD_DETECTED, now);
+    return eAUTOBAUD_DETECTED;
+  }
+  else if ((ab->confirmed == 0) && ((now - ab->rateSince) >= (CAN_AUTOBAUD_DWELL * 1000UL)))
+  {
+    ab->silent++;
+    CanAutobaudSetRate(ab, (ab->index + 1) % ab->numRates);
+  }
+
+  if ((ab->timeout != 0) && ((now - ab->startedAt) >= (ab->timeout * 1000UL)))
+  {
+    CanAutobaudStop(ab, eAUTOBAUD_FAILED, now);
+  }
+  return (CanAutobaudState_e) ab->state;
+}
+
+/** Gets the bit rate found
+ *  @param *ab Autobaud struct
+ *  @return Bit rate the controller is set to, NULL unless one was detected
+ */
+const can_bit_rate_t *CanAutobaudResult(const can_autobaud_t *ab)
+{
+  return (ab->state == eAUTOBAUD_DETECTED) ? &ab->rates[ab->index] : NULL;
+}
+
+/** Prints the outcome of a detection
+ *  @param *ab Autobaud struct
+ *  @param *out Serial port to print to
+ */
+void CanAutobaudPrint(const can_autobaud_t *ab, Print *out)
+{
+  char line[160];
+  snprintf(line, sizeof(line), "CAN bit rate: %s %s in %lu us, %lu bit rates tried (%lu rejected, %lu silent), %lu frames",
+           (ab->state == eAUTOBAUD_DETECTED) ? ab->rates[ab->index].name : "-", CanAutobaudStateNames[ab->state],
+           (unsigned long)((ab->state == eAUTOBAUD_LISTENING) ? (micros() - ab->startedAt) : ab->detectTime),
+           (unsigned long) ab->ratesTried, (unsigned long) ab->rejected, (unsigned long) ab->silent, (unsigned long) ab->frames);
+  out->println(line);
+}
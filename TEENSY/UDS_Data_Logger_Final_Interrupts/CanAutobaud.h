@@ -0,0 +1,77 @@
+/*
+  * @file CanAutobaud.h
+  *
+  * Finds the bit rate of the bus without taking part in it. The controller is put in listen
+  * only mode, so it neither acknowledges frames nor sends error flags, and is set to one bit
+  * rate after the other. At a wrong bit rate the first frame on the bus already breaks the
+  * bit stuffing, the form or the CRC, which the controller flags in ESR1, so the next bit rate
+  * is tried right away; a bit rate is taken once CAN_AUTOBAUD_CONFIRM_FRAMES frames came in
+  * without an error. On a busy bus that is about one frame per wrong bit rate, rather than a
+  * fixed time listening at each. Only on a silent bus does a bit rate get CAN_AUTOBAUD_DWELL.
+  *
+  * The detection is started after FLEXCAN_init and before FLEXCAN_fifo_reg_callback: it reads
+  * the RX FIFO itself and holds the status callback of the driver (the error interrupt reads
+  * the error flags) until it is done. The timing registers are left at the bit rate found and
+  * the controller in listen only mode, FLEXCAN_set_listen_only(0) joins the bus.
+*/
+
+#ifndef CANAUTOBAUD_H
+#define CANAUTOBAUD_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <stdint.h>
+#include <can.h>
+#include <kinetis_flexcan.h>
+
+/* DEFINES */
+#define CAN_AUTOBAUD_CONFIRM_FRAMES   2         // Frames received without an error at a bit rate before it is taken
+#define CAN_AUTOBAUD_DWELL            100       // Time (ms) listening at a bit rate on a silent bus before the next one is tried
+#define CAN_AUTOBAUD_ERRORS           (FLEXCAN_ESR_STF_ERR | FLEXCAN_ESR_FRM_ERR | FLEXCAN_ESR_CRC_ERR | \
+                                       FLEXCAN_ESR_BIT0_ERR | FLEXCAN_ESR_BIT1_ERR)  // ESR1 errors that reject a bit rate
+#define CAN_NUM_BIT_RATES             16        // Number of bit rates in CanBitRateTable
+
+/* ENUMS */
+enum CanAutobaudState_e
+{
+  eAUTOBAUD_IDLE = 0,                   // Not started
+  eAUTOBAUD_LISTENING,                  // Trying the bit rates
+  eAUTOBAUD_DETECTED,                   // Bit rate found, the controller is set to it
+  eAUTOBAUD_FAILED                      // No bit rate found before the timeout
+};
+
+/* STRUCTS */
+typedef struct {
+  uint32_t bitRate;                     // Bit rate (bit/s)
+  FLEXCAN_config_t config;              // Timing that gives it from FLEXCAN_CLOCK_HZ
+  const char *name;                     // Printed with the result
+} can_bit_rate_t;
+
+typedef struct {
+  const can_bit_rate_t *rates;          // Bit rates tried, in order
+  uint8_t numRates;                     // Number of bit rates
+  uint32_t timeout;                     // Time (ms) to give up after, 0 to keep trying
+  uint8_t state;                        // CanAutobaudState_e
+  uint8_t index;                        // Bit rate being tried
+  uint32_t startedAt;                   // Time (micros) the detection started
+  uint32_t rateSince;                   // Time (micros) the current bit rate was set
+  volatile uint32_t errorFlags;         // CAN_AUTOBAUD_ERRORS seen by the error interrupt at the current bit rate
+  uint8_t confirmed;                    // Frames received at the current bit rate
+
+  uint32_t detectTime;                  // Time (us) from the start to the bit rate being taken
+  uint32_t ratesTried;                  // Number of bit rates set, counting the first
+  uint32_t rejected;                    // Number of bit rates rejected by an error
+  uint32_t silent;                      // Number of bit rates left with no traffic in CAN_AUTOBAUD_DWELL
+  uint32_t frames;                      // Number of frames received
+} can_autobaud_t;
+
+/* FUNCTION PROTOTYPES */
+void CanAutobaudStart(can_autobaud_t *ab, const can_bit_rate_t *rates, uint8_t numRates, uint32_t timeout);
+CanAutobaudState_e CanAutobaudService(can_autobaud_t *ab);
+const can_bit_rate_t *CanAutobaudResult(const can_autobaud_t *ab);
+void CanAutobaudPrint(const can_autobaud_t *ab, Print *out);
+
+/* CONSTANTS */
+extern const can_bit_rate_t CanBitRateTable[CAN_NUM_BIT_RATES];
+
+#endif // CANAUTOBAUD_H
@@ -7,6 +7,7 @@
 */
 
 #include "CircularBuffer.h"
+#include "Probe.h"
 
 /** Initializes circular buffer
  *  @param *cb Circular buffer struct to be initialized
@@ -22,6 +23,7 @@ void CircularBufferInit(circular_buffer_t *cb, size_t capacity, size_t itemSize)
   cb->tail = cb->bufferStart;
   cb->bufferEnd = cb->bufferStart;
   cb->hasWrapped = false;
+  cb->pushCount = 0;
   cb->bufferEnd += capacity;
 }
 
@@ -33,6 +35,7 @@ void CircularBufferReinit(circular_buffer_t *cb)
   cb->head = cb->bufferStart;
   cb->tail = cb->bufferStart;
   cb->hasWrapped = false;
+  cb->pushCount = 0;
 }
 
 /** Frees circular buffer
@@ -49,8 +52,10 @@ void CircularBufferFree(circular_buffer_t *cb)
  */
 void CircularBufferPush(circular_buffer_t *cb, can_message_t *item)
 {
+  PROBE_SCOPE(ePROBE_RING_PUSH);
   memcpy(cb->head, item, cb->itemSize);
   cb->head++;
+  cb->pushCount++;
   if (cb->head == cb->bufferEnd)
   {
     cb->head = cb->bufferStart;
@@ -118,3 +123,33 @@ uint16_t CircularBufferDumpToFile(circular_buffer_t *cb, SdFile *cbFile)
   return messageCount;
 }
 
+
+/** Gets an item by its sequence number
+ *  The item is only valid while it has not been overwritten, i.e. for the last capacity items pushed
+ *  @param *cb Circular buffer struct
+ *  @param sequence Sequence number of the item (value of pushCount when it was pushed)
+ *  @return Pointer to the item in the circular buffer
+ */
+can_message_t *CircularBufferAt(circular_buffer_t *cb, uint32_t sequence)
+{
+  return cb->bufferStart + (sequence % cb->capacity);
+}
+
+/** Dumps a range of items to a file on the SD Card without removing them from the circular buffer
+ *  @param *cb Circular buffer struct to be read from
+ *  @param startSequence Sequence number of the first item to be written
+ *  @param endSequence Sequence number one past the last item to be written
+ *  @param *cbFile File to be written to
+ *  @return messageCount Number of messages written
+ */
+uint16_t CircularBufferDumpRangeToFile(circular_buffer_t *cb, uint32_t startSequence, uint32_t endSequence, SdFile *cbFile)
+{
+  uint16_t messageCount = 0;
+  while (startSequence != endSequence)
+  {
+    FileWriteMessage(CircularBufferAt(cb, startSequence), cbFile);
+    startSequence++;
+    messageCount++;
+  }
+  return messageCount;
+}
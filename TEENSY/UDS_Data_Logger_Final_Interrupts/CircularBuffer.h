@@ -27,6 +27,7 @@ typedef struct {
   size_t capacity;              // maximum number of items in buffer
   size_t itemSize;              // size of each item in buffer
   bool hasWrapped;              // whether or not circular buffer has bufferEndped around
+  uint32_t pushCount;           // number of items pushed since the last reinit, sequence number of the next item
 } circular_buffer_t;
 
 /* FUNCTION PROTOTYPES */
@@ -36,6 +37,8 @@ void CircularBufferFree(circular_buffer_t *cb);
 void CircularBufferPush(circular_buffer_t *cb, can_message_t *item);
 void CicularBufferPop(circular_buffer_t *cb, can_message_t *item);
 uint16_t CircularBufferDumpToFile(circular_buffer_t *cb, SdFile *cbFile);
+can_message_t *CircularBufferAt(circular_buffer_t *cb, uint32_t sequence);
+uint16_t CircularBufferDumpRangeToFile(circular_buffer_t *cb, uint32_t startSequence, uint32_t endSequence, SdFile *cbFile);
 
 #endif // CIRCULARBUFFER_H
 
@@ -11,16 +11,22 @@
 error_t ErrorTable[]
 {
   {eERR_NONE,                             eERRTYPE_NONE,              ""},
-  {eERR_SD_FAILED_INIT,                   eERRTYPE_NON_RECOVERABLE,   "SD card failed initialization."},
+  {eERR_SD_FAILED_INIT,                   eERRTYPE_SD_RECOVERY,       "SD card failed initialization."},
   {eERR_SD_FAILED_FILE_OPEN_FOR_READ,     eERRTYPE_AUTO_RESUME,       "SD card failed to open a file for read."},
-  {eERR_SD_FAILED_FILE_OPEN_FOR_WRITE,    eERRTYPE_NON_RECOVERABLE,   "SD card failed to open a file for write."},
+  {eERR_SD_FAILED_FILE_OPEN_FOR_WRITE,    eERRTYPE_SD_RECOVERY,       "SD card failed to open a file for write."},
   {eERR_SD_FAILED_FILE_DELETE,            eERRTYPE_NON_RECOVERABLE,   "SD card failed to delete a file."},
-  {eERR_SD_FAILED_TO_CREATE_DIRECTORY,    eERRTYPE_NON_RECOVERABLE,   "SD card failed to create a directory."},
-  {eERR_SD_LOST_COMMUNICATIONS,           eERRTYPE_NON_RECOVERABLE,   "Lost communications with SD card."},
+  {eERR_SD_FAILED_TO_CREATE_DIRECTORY,    eERRTYPE_SD_RECOVERY,       "SD card failed to create a directory."},
+  {eERR_SD_LOST_COMMUNICATIONS,           eERRTYPE_SD_RECOVERY,       "Lost communications with SD card."},
   {eERR_SD_FAILED_TO_EDIT_FILE_TIMESTAMP, eERRTYPE_AUTO_RESUME,       "SD card failed to edit file timestamp."},
-  {eERR_UNABLE_TO_SYNC_RTC,               eERRTYPE_NON_RECOVERABLE,   "Unable to sync with RTC."}
+  {eERR_UNABLE_TO_SYNC_RTC,               eERRTYPE_NON_RECOVERABLE,   "Unable to sync with RTC."},
+  {eERR_SD_FAILED_WRITE,                  eERRTYPE_SD_RECOVERY,       "SD card failed to write a file."}
 };
 
+static error_event_t s_ErrorQueue[ERROR_QUEUE_SIZE];
+static uint32_t s_ErrorHead = 0;        // Number of events queued
+static uint32_t s_ErrorTail = 0;        // Number of events taken by the main loop
+static uint32_t s_ErrorsDropped = 0;    // Number of errors not queued because the queue was full
+
 /** Gets the error type for an error
  *  @param error Error to be searched
  */
@@ -37,43 +43,55 @@ char *GetErrorMessage(Error_e error)
   return ErrorTable[error].errorMessage;
 }
 
-/** Handles a recorded error
+/** Queues a recorded error for the main loop, safe to call from an interrupt
+ *  The same error flagged again before the main loop took it only counts up the queued event
  *  @param error Error flagged
  */
 void HandleError(Error_e error)
 {
-  delay(1000);
-  Serial.println(GetErrorMessage(error));
-  delay(1000);
-  
-  switch (GetErrorType(error))
+  error_event_t *last = NULL;
+
+  __disable_irq();
+  last = &s_ErrorQueue[(s_ErrorHead - 1) & (ERROR_QUEUE_SIZE - 1)];
+  if ((s_ErrorHead != s_ErrorTail) && (last->error == error) && (last->count < UINT16_MAX))
+  {
+    last->count++;
+  }
+  else if ((s_ErrorHead - s_ErrorTail) < ERROR_QUEUE_SIZE)
+  {
+    s_ErrorQueue[s_ErrorHead & (ERROR_QUEUE_SIZE - 1)] = {error, 1, millis()};
+    s_ErrorHead++;
+  }
+  else
   {
-    case eERRTYPE_NON_RECOVERABLE:
-    {
-      Shutdown();
-      break;
-    }
-    case eERRTYPE_AUTO_RESUME:
-    {
-      // do nothing
-      break;
-    }
-    default:
-    {
-      // do nothing
-      break;
-    }
+    s_ErrorsDropped++;
   }
+  __enable_irq();
 }
 
-/** Executes a shutdown
+/** Takes the oldest queued error, called from the main loop
+ *  @param *event Event to be set
+ *  @return Whether or not an error was queued
  */
-void Shutdown()
+bool ErrorPop(error_event_t *event)
 {
-  Serial.println("Shutting Down...");
-  while(true)
+  bool popped = false;
+
+  __disable_irq();
+  if (s_ErrorHead != s_ErrorTail)
   {
-    delay(1000);
+    *event = s_ErrorQueue[s_ErrorTail & (ERROR_QUEUE_SIZE - 1)];
+    s_ErrorTail++;
+    popped = true;
   }
+  __enable_irq();
+  return popped;
 }
 
+/** Gets the number of errors lost because the queue was full
+ *  @return Number of errors dropped
+ */
+uint32_t ErrorDroppedCount(void)
+{
+  return s_ErrorsDropped;
+}
@@ -3,7 +3,8 @@
   * @author Nicholas Kalamvokis
   * @date 1/25/2016
   *
-  *
+  * Errors are queued where they happen, which can be the CAN interrupt, and handled by the
+  * main loop. Nothing waits or halts: a failed SD card is re-initialized while capture goes on.
 */
 
 #ifndef ERRORS_H
@@ -14,6 +15,7 @@
 
 /* DEFINES */
 #define ERROR_CONTEXT_SIZE 100
+#define ERROR_QUEUE_SIZE              8         // Number of queued error events, a power of two
 
 /* ENUMS */
 enum Error_e
@@ -26,14 +28,16 @@ enum Error_e
   eERR_SD_FAILED_TO_CREATE_DIRECTORY,
   eERR_SD_LOST_COMMUNICATIONS,
   eERR_SD_FAILED_TO_EDIT_FILE_TIMESTAMP,
-  eERR_UNABLE_TO_SYNC_RTC
+  eERR_UNABLE_TO_SYNC_RTC,
+  eERR_SD_FAILED_WRITE
 };
 
 enum ErrorType_e
 {
   eERRTYPE_NONE = 0,
-  eERRTYPE_AUTO_RESUME,
-  eERRTYPE_NON_RECOVERABLE
+  eERRTYPE_AUTO_RESUME,                 // Reported, nothing else to do
+  eERRTYPE_SD_RECOVERY,                 // Reported, the SD card is re-initialized while frames wait in RAM
+  eERRTYPE_NON_RECOVERABLE              // Reported, the logger goes on without the failed function
 };
 
 /* STRUCTS */
@@ -43,11 +47,17 @@ typedef struct {
   char errorMessage[ERROR_CONTEXT_SIZE];
 } error_t;
 
+typedef struct {
+  Error_e error;                        // Error flagged
+  uint16_t count;                       // Number of times in a row it was flagged
+  uint32_t timestamp;                   // Time (millis) it was first flagged
+} error_event_t;
+
 /* FUNCTION PROTOTYPES */
 ErrorType_e GetErrorType(Error_e error);
 char *GetErrorMessage(Error_e error);
 void HandleError(Error_e error);
-void Shutdown();
+bool ErrorPop(error_event_t *event);
+uint32_t ErrorDroppedCount(void);
 
 #endif // ERRORS_H
-
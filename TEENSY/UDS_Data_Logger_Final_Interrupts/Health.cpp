@@ -0,0 +1,134 @@
+/*
+  * @file Health.cpp
+  *
+  * Capture health counters and high-water marks
+*/
+
+/* INCLUDES */
+#include "Health.h"
+#include "Probe.h"
+#include <string.h>
+
+/** Initializes the health counters and starts the clock the interrupt is timed with
+ *  @param *health Health counters to be initialized
+ *  @param ringCapacity Number of frames in the capture ring
+ */
+void HealthInit(logger_health_t *health, uint32_t ringCapacity)
+{
+  memset(health, 0, sizeof(logger_health_t));
+  health->ringCapacity = ringCapacity;
+  health->sdWriteMin = UINT32_MAX;
+  ProbeStartClock();
+}
+
+/** Marks the start of an SD write, frames dropped until HealthSdWriteEnd count as dropped while flushing
+ *  @param *health Health counters
+ */
+void HealthSdWriteBegin(logger_health_t *health)
+{
+  health->sdWriteStart = micros();
+  health->flushing = true;
+}
+
+/** Marks the end of an SD write and adds its time to the latency histogram
+ *  @param *health Health counters
+ */
+void HealthSdWriteEnd(logger_health_t *health)
+{
+  uint32_t elapsed = micros() - health->sdWriteStart;
+  uint8_t bucket = (elapsed == 0) ? 0 : (uint8_t)(32 - __builtin_clz(elapsed));
+
+  health->flushing = false;
+  if (bucket >= HEALTH_SD_BUCKETS)
+  {
+    bucket = HEALTH_SD_BUCKETS - 1;
+  }
+  health->sdWriteBuckets[bucket]++;
+  health->sdWrites++;
+  if (elapsed < health->sdWriteMin)
+  {
+    health->sdWriteMin = elapsed;
+  }
+  if (elapsed > health->sdWriteMax)
+  {
+    health->sdWriteMax = elapsed;
+  }
+}
+
+/** Copies the health counters without holding off the CAN interrupt
+ *  The copy is taken again if the interrupt updated its counters in the meantime. The interrupt
+ *  cannot be interrupted by the main loop, so it always finishes and the copy never waits long.
+ *  @param *health Health counters
+ *  @param *snapshot Copy to be set
+ */
+void HealthSnapshot(const logger_health_t *health, logger_health_t *snapshot)
+{
+  uint32_t sequence = 0;
+  do
+  {
+    sequence = health->isrSequence;
+    HEALTH_BARRIER();
+    memcpy(snapshot, (const void *) health, sizeof(logger_health_t));
+    HEALTH_BARRIER();
+  } while ((sequence & 1) || (sequence != health->isrSequence));
+}
+
+/** Prints the health counters, to Serial or to the footer of an attack file
+ *  @param *health Health counters
+ *  @param *out Output
+ */
+void HealthPrint(const logger_health_t *health, Print *out)
+{
+  logger_health_t snapshot;
+  char line[100];
+  char *cursor = NULL;
+  uint8_t bucket = 0;
+
+  HealthSnapshot(health, &snapshot);
+  out->println("Capture Health:");
+  snprintf(line, sizeof(line), "FIFO Callbacks: %lu, %lu us total, longest %lu ns", (unsigned long) snapshot.isrCalls,
+           (unsigned long)(snapshot.isrTicks / PROBE_TICKS_PER_US), (unsigned long)(((uint64_t) snapshot.isrMaxTicks * 1000) / PROBE_TICKS_PER_US));
+  out->println(line);
+  snprintf(line, sizeof(line), "FIFO Overflows: %lu", (unsigned long) snapshot.fifoOverflows);
+  out->println(line);
+  snprintf(line, sizeof(line), "Ring High-Water Mark: %lu of %lu frames", (unsigned long) snapshot.ringHighWater, (unsigned long) snapshot.ringCapacity);
+  out->println(line);
+  snprintf(line, sizeof(line), "Write Backlog High-Water Mark: %lu frames", (unsigned long) snapshot.backlogHighWater);
+  out->println(line);
+  snprintf(line, sizeof(line), "Frames Dropped While Flushing: %lu", (unsigned long) snapshot.droppedWhileFlushing);
+  out->println(line);
+  snprintf(line, sizeof(line), "ISO-TP PDUs Dropped: %lu, Reassemblies Aborted: %lu", (unsigned long) snapshot.isotpDroppedPdus,
+           (unsigned long) snapshot.isotpAbortedReassemblies);
+  out->println(line);
+  snprintf(line, sizeof(line), "Files Opened: %lu, Failed: %lu, Closed: %lu", (unsigned long) snapshot.fileOpens,
+           (unsigned long) snapshot.fileOpenFailures, (unsigned long) snapshot.fileCloses);
+  out->println(line);
+  snprintf(line, sizeof(line), "SD Failures: %lu, Recovered: %lu, last %lu ms, longest %lu ms", (unsigned long) snapshot.sdFailures,
+           (unsigned long) snapshot.sdRecoveries, (unsigned long) snapshot.sdRecoveryLast, (unsigned long) snapshot.sdRecoveryMax);
+  out->println(line);
+  snprintf(line, sizeof(line), "Error Events Dropped: %lu", (unsigned long) snapshot.errorsDropped);
+  out->println(line);
+  snprintf(line, sizeof(line), "Frames Kept In RAM During SD Outages: %lu, Dropped: %lu", (unsigned long) snapshot.sdOutageFramesKept,
+           (unsigned long) snapshot.sdOutageFramesDropped);
+  out->println(line);
+  snprintf(line, sizeof(line), "SD Writes: %lu, shortest %lu us, longest %lu us", (unsigned long) snapshot.sdWrites,
+           (unsigned long)((snapshot.sdWrites > 0) ? snapshot.sdWriteMin : 0), (unsigned long) snapshot.sdWriteMax);
+  out->println(line);
+
+  // e.g. "SD Write Latency: <1024us 3  <2048us 10"
+  cursor = line + snprintf(line, sizeof(line), "SD Write Latency:");
+  for (bucket = 0; bucket < HEALTH_SD_BUCKETS; bucket++)
+  {
+    if (snapshot.sdWriteBuckets[bucket] == 0)
+    {
+      continue;
+    }
+    if ((size_t)(cursor - line) > (sizeof(line) - 24)) // start a new line before running out of room
+    {
+      out->println(line);
+      cursor = line + snprintf(line, sizeof(line), "SD Write Latency:");
+    }
+    cursor += snprintf(cursor, sizeof(line) - (cursor - line), " <%luus %lu", (unsigned long)(1UL << bucket), (unsigned long) snapshot.sdWriteBuckets[bucket]);
+  }
+  out->println(line);
+}
@@ -0,0 +1,85 @@
+/*
+  * @file Health.h
+  *
+  * Capture health counters and high-water marks. The CAN interrupt is the only writer of its
+  * counters and never waits: it bumps a sequence number around its updates, and the main loop
+  * copies the counters again if an interrupt ran in the middle of the copy.
+*/
+
+#ifndef HEALTH_H
+#define HEALTH_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <stdint.h>
+
+/* DEFINES */
+#define HEALTH_SD_BUCKETS             24        // Bucket n counts SD writes of [2^(n-1), 2^n) us, the last one everything longer
+#define HEALTH_BARRIER()              __asm__ __volatile__("" ::: "memory")  // Keeps the compiler from moving counter updates across the sequence number
+
+/* STRUCTS */
+typedef struct {
+  /* Written by the CAN interrupt */
+  volatile uint32_t isrSequence;        // Odd while the interrupt is updating its counters
+  uint32_t isrCalls;                    // Number of FIFO callbacks
+  uint64_t isrTicks;                    // Time spent in the FIFO callback (ProbeNow ticks)
+  uint32_t isrMaxTicks;                 // Longest FIFO callback (ProbeNow ticks)
+  uint32_t fifoOverflows;               // Number of times the FIFO overflow flag was found set, at least one frame lost each
+  uint32_t ringHighWater;               // Most frames of the capture ring a session still had to write, sampled once per block
+  uint32_t droppedWhileFlushing;        // Frames not stored because the ring was full while the SD card was being written
+  uint32_t isotpDroppedPdus;            // ISO-TP PDUs overwritten in the queue before a session wrote them
+  uint32_t isotpAbortedReassemblies;    // ISO-TP reassemblies abandoned (timeout, bad sequence, no free context)
+  /* Written by the main loop */
+  volatile bool flushing;               // Whether or not the main loop is writing to the SD card
+  uint32_t ringCapacity;                // Number of frames in the capture ring
+  uint32_t backlogHighWater;            // Most frames of a session waiting to be written to the SD card
+  uint32_t sdWriteStart;                // Time (micros) the current SD write started
+  uint32_t sdWrites;                    // Number of SD writes
+  uint32_t sdWriteMin;                  // Shortest SD write (us)
+  uint32_t sdWriteMax;                  // Longest SD write (us)
+  uint32_t sdWriteBuckets[HEALTH_SD_BUCKETS];  // SD writes by power of two of their time
+  uint32_t fileOpens;                   // Number of files opened
+  uint32_t fileOpenFailures;            // Number of files that could not be opened
+  uint32_t fileCloses;                  // Number of files closed
+  uint32_t sdFailures;                  // Number of times the SD card failed and had to be recovered
+  uint32_t sdRecoveries;                // Number of times the SD card was recovered
+  uint32_t sdRecoveryLast;              // Time (ms) from the failure to the end of the last recovery
+  uint32_t sdRecoveryMax;               // Longest recovery (ms)
+  uint32_t sdOutageFramesKept;          // Frames recorded by sessions while the SD card was out, kept in the capture ring
+  uint32_t sdOutageFramesDropped;       // Frames not stored because the capture ring filled up while the SD card was out
+  uint32_t errorsDropped;               // Error events not reported because the error queue was full
+} logger_health_t;
+
+/* FUNCTION PROTOTYPES */
+void HealthInit(logger_health_t *health, uint32_t ringCapacity);
+void HealthSdWriteBegin(logger_health_t *health);
+void HealthSdWriteEnd(logger_health_t *health);
+void HealthSnapshot(const logger_health_t *health, logger_health_t *snapshot);
+void HealthPrint(const logger_health_t *health, Print *out);
+
+/** Marks the start of the counter updates of the CAN interrupt
+ *  @param *health Health counters
+ */
+static inline void HealthIsrBegin(logger_health_t *health)
+{
+  health->isrSequence = health->isrSequence + 1;
+  HEALTH_BARRIER();
+}
+
+/** Adds the time of a FIFO callback and marks the end of the counter updates of the CAN interrupt
+ *  @param *health Health counters
+ *  @param ticks Time spent in the callback (ProbeNow ticks)
+ */
+static inline void HealthIsrEnd(logger_health_t *health, uint32_t ticks)
+{
+  health->isrCalls++;
+  health->isrTicks += ticks;
+  if (ticks > health->isrMaxTicks)
+  {
+    health->isrMaxTicks = ticks;
+  }
+  HEALTH_BARRIER();
+  health->isrSequence = health->isrSequence + 1;
+}
+
+#endif // HEALTH_H
@@ -0,0 +1,399 @@
+/*
+  * @file IsoTp.cpp
+  *
+  * Passive ISO-TP (ISO 15765-2) reassembly of diagnostic traffic monitored on the bus
+*/
+
+#include "IsoTp.h"
+
+/* CONSTANTS */
+const isotp_id_pair_t IsoTpPairTable[ISOTP_NUM_PAIRS] =
+{
+  {0x7E0, 0x7E8},   // Engine ECU (tester present, UDS attack responses)
+  {0x7E1, 0x7E9},   // Transmission ECU
+  {0x745, 0x765}    // Body control module (diagnostic mode, blinker control)
+};
+
+/** Initializes the ISO-TP reassembler
+ *  @param *rs Reassembler struct to be initialized
+ */
+void IsoTpInit(isotp_reassembler_t *rs)
+{
+  memset(rs, 0, sizeof(isotp_reassembler_t));
+}
+
+/** Finds the diagnostic ID pair an arbitration ID belongs to
+ *  @param id Arbitration ID to be searched
+ *  @param *direction Direction of the ID within the pair (to be set)
+ *  @return Index of the pair in the pair table, ISOTP_NO_PAIR if the ID is not diagnostic
+ */
+uint8_t IsoTpFindPair(uint32_t id, IsoTpDirection_e *direction)
+{
+  uint8_t pairIndex = 0;
+  for (pairIndex = 0; pairIndex < ISOTP_NUM_PAIRS; pairIndex++)
+  {
+    if (IsoTpPairTable[pairIndex].requestId == id)
+    {
+      *direction = eISOTP_DIR_REQUEST;
+      return pairIndex;
+    }
+    if (IsoTpPairTable[pairIndex].responseId == id)
+    {
+      *direction = eISOTP_DIR_RESPONSE;
+      return pairIndex;
+    }
+  }
+  *direction = eISOTP_DIR_NONE;
+  return ISOTP_NO_PAIR;
+}
+
+/** Gets a diagnostic ID pair from the pair table
+ *  @param pairIndex Index of the pair
+ *  @return Pointer to the pair, NULL if the index is out of range
+ */
+const isotp_id_pair_t *IsoTpGetPair(uint8_t pairIndex)
+{
+  if (pairIndex >= ISOTP_NUM_PAIRS)
+  {
+    return NULL;
+  }
+  return &IsoTpPairTable[pairIndex];
+}
+
+/** Pushes a completed PDU onto the output queue, overwriting the oldest PDU if the queue is full
+ *  @param *rs Reassembler struct
+ *  @param *pdu Completed PDU
+ */
+static void IsoTpQueuePdu(isotp_reassembler_t *rs, isotp_pdu_t *pdu)
+{
+  memcpy(&rs->queue[rs->queueHead], pdu, sizeof(isotp_pdu_t));
+  rs->queueHead = (rs->queueHead + 1) % ISOTP_PDU_QUEUE_CAPACITY;
+  if (rs->queueCount == ISOTP_PDU_QUEUE_CAPACITY)
+  {
+    rs->droppedPdus++;
+  }
+  else
+  {
+    rs->queueCount++;
+  }
+  rs->pduCount++;
+}
+
+/** Copies payload bytes into a PDU, truncating anything beyond ISOTP_MAX_PDU_SIZE
+ *  @param *context Context of the PDU
+ *  @param *data Payload bytes
+ *  @param len Number of payload bytes
+ */
+static void IsoTpAppend(isotp_context_t *context, uint8_t *data, uint8_t len)
+{
+  uint16_t remaining = context->pdu.length - context->received;
+  if (len > remaining)
+  {
+    len = remaining;
+  }
+  if (context->received < ISOTP_MAX_PDU_SIZE)
+  {
+    uint16_t stored = len;
+    if (context->received + stored > ISOTP_MAX_PDU_SIZE)
+    {
+      stored = ISOTP_MAX_PDU_SIZE - context->received;
+      context->pdu.truncated = true;
+    }
+    memcpy(&context->pdu.data[context->received], data, stored);
+  }
+  else
+  {
+    context->pdu.truncated = true;
+  }
+  context->received += len;
+}
+
+/** Finds the context reassembling a PDU on an arbitration ID
+ *  Contexts that have not seen a frame within ISOTP_CONTEXT_TIMEOUT are released
+ *  @param *rs Reassembler struct
+ *  @param id Arbitration ID
+ *  @param timestamp Timestamp of the current frame
+ *  @return Context for the ID, NULL if there is none
+ */
+static isotp_context_t *IsoTpFindContext(isotp_reassembler_t *rs, uint32_t id, uint32_t timestamp)
+{
+  uint8_t contextIndex = 0;
+  for (contextIndex = 0; contextIndex < ISOTP_MAX_CONTEXTS; contextIndex++)
+  {
+    isotp_context_t *context = &rs->contexts[contextIndex];
+    if (context->inUse && ((timestamp - context->lastTimestamp) > ISOTP_CONTEXT_TIMEOUT))
+    {
+      context->inUse = false;
+      rs->abortedReassemblies++;
+    }
+    if (context->inUse && (context->pdu.id == id))
+    {
+      return context;
+    }
+  }
+  return NULL;
+}
+
+/** Allocates a context from the pool, evicting the least recently used context if the pool is exhausted
+ *  @param *rs Reassembler struct
+ *  @return Allocated context
+ */
+static isotp_context_t *IsoTpAllocContext(isotp_reassembler_t *rs)
+{
+  isotp_context_t *oldest = &rs->contexts[0];
+  uint8_t contextIndex = 0;
+  for (contextIndex = 0; contextIndex < ISOTP_MAX_CONTEXTS; contextIndex++)
+  {
+    isotp_context_t *context = &rs->contexts[contextIndex];
+    if (!context->inUse)
+    {
+      return context;
+    }
+    if (context->lastTimestamp < oldest->lastTimestamp)
+    {
+      oldest = context;
+    }
+  }
+  rs->abortedReassemblies++;
+  return oldest;
+}
+
+/** Runs a monitored CAN message through the ISO-TP reassembler
+ *  Single frames complete immediately, first frames claim a context from the pool and
+ *  consecutive frames are appended until the announced length is reached
+ *  @param *rs Reassembler struct
+ *  @param *message CAN message monitored on the bus
+ *  @return Whether or not the message completed a PDU
+ */
+bool IsoTpProcessMessage(isotp_reassembler_t *rs, can_message_t *message)
+{
+  IsoTpDirection_e direction;
+  uint8_t pairIndex = IsoTpFindPair(message->id, &direction);
+  if ((pairIndex == ISOTP_NO_PAIR) || message->ide || (message->len == 0)) // the pairs are standard IDs
+  {
+    return false;
+  }
+
+  isotp_context_t *context = IsoTpFindContext(rs, message->id, message->timestamp);
+  uint8_t pci = message->data[0];
+
+  switch (pci & ISOTP_PCI_TYPE_MASK)
+  {
+    case eISOTP_SINGLE_FRAME:
+    {
+      isotp_pdu_t pdu;
+      uint8_t length = pci & ISOTP_PCI_LOW_MASK;
+      if ((length == 0) || (length > (message->len - 1)))
+      {
+        return false;
+      }
+      if (context != NULL) // a single frame interrupts any reassembly in progress on this ID
+      {
+        context->inUse = false;
+        rs->abortedReassemblies++;
+      }
+      pdu.timestamp = message->timestamp;
+      pdu.id = message->id;
+      pdu.pairIndex = pairIndex;
+      pdu.direction = direction;
+      pdu.length = length;
+      pdu.numFrames = 1;
+      pdu.truncated = false;
+      memcpy(pdu.data, &message->data[1], length);
+      IsoTpQueuePdu(rs, &pdu);
+      return true;
+    }
+
+    case eISOTP_FIRST_FRAME:
+    {
+      uint16_t length = ((uint16_t)(pci & ISOTP_PCI_LOW_MASK) << 8) | message->data[1];
+      if ((message->len < 8) || (length < 8))
+      {
+        return false;
+      }
+      if (context != NULL) // a new first frame restarts the reassembly on this ID
+      {
+        rs->abortedReassemblies++;
+      }
+      else
+      {
+        context = IsoTpAllocContext(rs);
+      }
+      context->inUse = true;
+      context->nextSequence = 1;
+      context->received = 0;
+      context->lastTimestamp = message->timestamp;
+      context->pdu.id = message->id;
+      context->pdu.pairIndex = pairIndex;
+      context->pdu.direction = direction;
+      context->pdu.length = length;
+      context->pdu.numFrames = 1;
+      context->pdu.truncated = false;
+      IsoTpAppend(context, &message->data[2], message->len - 2);
+      return false;
+    }
+
+    case eISOTP_CONSECUTIVE_FRAME:
+    {
+      if (context == NULL)
+      {
+        return false;
+      }
+      if ((pci & ISOTP_PCI_LOW_MASK) != context->nextSequence)
+      {
+        context->inUse = false;
+        rs->abortedReassemblies++;
+        return false;
+      }
+      context->nextSequence = (context->nextSequence + 1) & ISOTP_PCI_LOW_MASK;
+      context->lastTimestamp = message->timestamp;
+      context->pdu.numFrames++;
+      IsoTpAppend(context, &message->data[1], message->len - 1);
+
+      if (context->received >= context->pdu.length)
+      {
+        context->pdu.timestamp = message->timestamp;
+        context->inUse = false;
+        IsoTpQueuePdu(rs, &context->pdu);
+        return true;
+      }
+      return false;
+    }
+
+    default: // flow control frames carry no payload
+    {
+      return false;
+    }
+  }
+}
+
+/** Pops the oldest completed PDU from the output queue
+ *  @param *rs Reassembler struct
+ *  @param *pdu PDU to be populated
+ *  @return Whether or not a PDU was popped
+ */
+bool IsoTpPopPdu(isotp_reassembler_t *rs, isotp_pdu_t *pdu)
+{
+  if (rs->queueCount == 0)
+  {
+    return false;
+  }
+  uint8_t tail = (rs->queueHead + ISOTP_PDU_QUEUE_CAPACITY - rs->queueCount) % ISOTP_PDU_QUEUE_CAPACITY;
+  memcpy(pdu, &rs->queue[tail], sizeof(isotp_pdu_t));
+  rs->queueCount--;
+  return true;
+}
+
+/** Gets the most recently completed PDU
+ *  @param *rs Reassembler struct
+ *  @return Pointer to the PDU in the queue, NULL if the queue is empty
+ */
+isotp_pdu_t *IsoTpLastPdu(isotp_reassembler_t *rs)
+{
+  if (rs->queueCount == 0)
+  {
+    return NULL;
+  }
+  return &rs->queue[(rs->queueHead + ISOTP_PDU_QUEUE_CAPACITY - 1) % ISOTP_PDU_QUEUE_CAPACITY];
+}
+
+/** Prints a reassembled PDU to a file as an annotated record
+ *  Records start with "PDU" so they can be told apart from raw frames, which start with a timestamp,
+ *  and carry the decoded service ahead of the payload
+ *  @param *pdu PDU to be printed to the file
+ *  @param *file File to be printed to
+ */
+void FileWritePdu(isotp_pdu_t *pdu, SdFile *file)
+{
+  const isotp_id_pair_t *pair = IsoTpGetPair(pdu->pairIndex);
+  uint16_t stored = pdu->length;
+  uint16_t currentData = 0;
+  char dataOut[24];
+  uds_decoded_t decoded;
+
+  if (stored > ISOTP_MAX_PDU_SIZE)
+  {
+    stored = ISOTP_MAX_PDU_SIZE;
+  }
+
+  file->print("PDU\t");
+  file->print(pdu->timestamp, DEC);
+  file->print("\t");
+  if (pdu->direction == eISOTP_DIR_REQUEST)
+  {
+    snprintf(dataOut, sizeof(dataOut), "%03lX->%03lX\t", (unsigned long) pair->requestId, (unsigned long) pair->responseId);
+  }
+  else
+  {
+    snprintf(dataOut, sizeof(dataOut), "%03lX->%03lX\t", (unsigned long) pair->responseId, (unsigned long) pair->requestId);
+  }
+  file->print(dataOut);
+  file->print(pdu->length, DEC);
+  file->print(pdu->truncated ? "+\t" : "\t");
+  UDSDecode(pdu->data, stored, (pdu->direction == eISOTP_DIR_RESPONSE), &decoded);
+  FileWriteUDSDecode(&decoded, file);
+  file->print("\t");
+  for (currentData = 0; currentData < stored; currentData++)
+  {
+    file->print(pdu->data[currentData], HEX);
+    file->print(" ");
+  }
+  file->println();
+}
+
+/** Writes all queued PDUs to an open file on the SD Card
+ *  @param *rs Reassembler struct
+ *  @param *file File to be written to
+ *  @return pduCount Number of PDUs written
+ */
+uint16_t IsoTpDumpToFile(isotp_reassembler_t *rs, SdFile *file)
+{
+  isotp_pdu_t pdu;
+  uint16_t pduCount = 0;
+  while (IsoTpPopPdu(rs, &pdu))
+  {
+    FileWritePdu(&pdu, file);
+    pduCount++;
+  }
+  return pduCount;
+}
+
+/** Pops the oldest queued PDU of one diagnostic ID pair
+ *  PDUs of other pairs stay queued in order, PDUs of the pair older than sinceTimestamp are discarded.
+ *  The queue is compacted in place, the PDUs that stay move up over the ones taken out.
+ *  @param *rs Reassembler struct
+ *  @param pairIndex Index of the diagnostic ID pair
+ *  @param sinceTimestamp Timestamp of the oldest PDU to be popped
+ *  @param *pdu PDU to be populated
+ *  @return Whether or not a PDU was popped
+ */
+bool IsoTpPopPairPdu(isotp_reassembler_t *rs, uint8_t pairIndex, uint32_t sinceTimestamp, isotp_pdu_t *pdu)
+{
+  isotp_pdu_t *current = NULL;
+  uint8_t tail = (rs->queueHead + ISOTP_PDU_QUEUE_CAPACITY - rs->queueCount) % ISOTP_PDU_QUEUE_CAPACITY;
+  uint8_t kept = 0;
+  uint8_t index = 0;
+  bool found = false;
+
+  for (index = 0; index < rs->queueCount; index++)
+  {
+    current = &rs->queue[(tail + index) % ISOTP_PDU_QUEUE_CAPACITY];
+    if (!found && (current->pairIndex == pairIndex))
+    {
+      if ((int32_t)(current->timestamp - sinceTimestamp) >= 0)
+      {
+        memcpy(pdu, current, sizeof(isotp_pdu_t));
+        found = true;
+      }
+      continue;
+    }
+    if (kept != index)
+    {
+      memcpy(&rs->queue[(tail + kept) % ISOTP_PDU_QUEUE_CAPACITY], current, sizeof(isotp_pdu_t));
+    }
+    kept++;
+  }
+  rs->queueCount = kept;
+  rs->queueHead = (tail + kept) % ISOTP_PDU_QUEUE_CAPACITY;
+  return found;
+}
@@ -0,0 +1,90 @@
+/*
+  * @file IsoTp.h
+  *
+  * Passive ISO-TP (ISO 15765-2) reassembly of diagnostic traffic monitored on the bus
+*/
+
+#ifndef ISOTP_H
+#define ISOTP_H
+
+/* INCLUDES */
+#include <stdint.h>
+#include <string.h>
+#include "CANMessage.h"
+#include "SDCard.h"
+#include "UDSDecoder.h"
+
+/* DEFINES */
+#define ISOTP_MAX_CONTEXTS            4         // Maximum number of multi-frame PDUs reassembled at the same time
+#define ISOTP_MAX_PDU_SIZE            64        // Maximum number of payload bytes stored per PDU, longer PDUs are truncated
+#define ISOTP_PDU_QUEUE_CAPACITY      16        // Maximum number of completed PDUs waiting to be written to a file
+#define ISOTP_CONTEXT_TIMEOUT         1000      // Time (ms) without a consecutive frame before a reassembly is abandoned (N_Cr)
+#define ISOTP_NUM_PAIRS               3         // Number of diagnostic ID pairs in the pair table
+#define ISOTP_NO_PAIR                 0xFF      // Pair index of an ID that is not part of a diagnostic ID pair
+
+#define ISOTP_PCI_TYPE_MASK           0xF0      // Protocol control information frame type nibble
+#define ISOTP_PCI_LOW_MASK            0x0F      // Protocol control information length / sequence nibble
+
+/* ENUMS */
+enum IsoTpFrameType_e
+{
+  eISOTP_SINGLE_FRAME = 0x00,
+  eISOTP_FIRST_FRAME = 0x10,
+  eISOTP_CONSECUTIVE_FRAME = 0x20,
+  eISOTP_FLOW_CONTROL = 0x30
+};
+
+enum IsoTpDirection_e
+{
+  eISOTP_DIR_NONE = 0,
+  eISOTP_DIR_REQUEST,
+  eISOTP_DIR_RESPONSE
+};
+
+/* STRUCTS */
+typedef struct {
+  uint32_t requestId;                   // Arbitration ID used by the tester
+  uint32_t responseId;                  // Arbitration ID used by the ECU
+} isotp_id_pair_t;
+
+typedef struct {
+  uint32_t timestamp;                   // Timestamp of the frame that completed the PDU
+  uint32_t id;                          // Arbitration ID the PDU was sent on
+  uint8_t pairIndex;                    // Index of the diagnostic ID pair in the pair table
+  IsoTpDirection_e direction;           // Request (tester -> ECU) or response (ECU -> tester)
+  uint16_t length;                      // PDU length announced by the sender
+  uint8_t numFrames;                    // Number of CAN frames the PDU was carried in
+  bool truncated;                       // Whether or not the PDU was longer than ISOTP_MAX_PDU_SIZE
+  uint8_t data[ISOTP_MAX_PDU_SIZE];     // PDU payload
+} isotp_pdu_t;
+
+typedef struct {
+  bool inUse;                           // Whether or not the context is reassembling a PDU
+  uint8_t nextSequence;                 // Sequence number expected in the next consecutive frame
+  uint16_t received;                    // Number of payload bytes received so far
+  uint32_t lastTimestamp;               // Timestamp of the last frame of this PDU
+  isotp_pdu_t pdu;                      // PDU being reassembled
+} isotp_context_t;
+
+typedef struct {
+  isotp_context_t contexts[ISOTP_MAX_CONTEXTS];   // Pool of reassembly contexts
+  isotp_pdu_t queue[ISOTP_PDU_QUEUE_CAPACITY];    // Completed PDUs waiting to be written
+  uint8_t queueHead;                              // Index of the next free queue slot
+  uint8_t queueCount;                             // Number of PDUs in the queue
+  uint32_t pduCount;                              // Number of PDUs reassembled
+  uint32_t droppedPdus;                           // Number of PDUs overwritten before they were written
+  uint32_t abortedReassemblies;                   // Number of reassemblies abandoned (timeout, bad sequence, no free context)
+} isotp_reassembler_t;
+
+/* FUNCTION PROTOTYPES */
+void IsoTpInit(isotp_reassembler_t *rs);
+uint8_t IsoTpFindPair(uint32_t id, IsoTpDirection_e *direction);
+const isotp_id_pair_t *IsoTpGetPair(uint8_t pairIndex);
+bool IsoTpProcessMessage(isotp_reassembler_t *rs, can_message_t *message);
+bool IsoTpPopPdu(isotp_reassembler_t *rs, isotp_pdu_t *pdu);
+bool IsoTpPopPairPdu(isotp_reassembler_t *rs, uint8_t pairIndex, uint32_t sinceTimestamp, isotp_pdu_t *pdu);
+isotp_pdu_t *IsoTpLastPdu(isotp_reassembler_t *rs);
+void FileWritePdu(isotp_pdu_t *pdu, SdFile *file);
+uint16_t IsoTpDumpToFile(isotp_reassembler_t *rs, SdFile *file);
+
+#endif // ISOTP_H
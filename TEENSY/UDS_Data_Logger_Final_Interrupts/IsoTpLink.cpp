@@ -0,0 +1,524 @@
+/*
+  * @file IsoTpLink.cpp
+  *
+  * ISO-TP (ISO 15765-2) send and receive over the FlexCAN driver
+*/
+
+#include "IsoTpLink.h"
+
+/** Puts a frame on the bus through the FlexCAN TX queue, the default sender of a stack
+ *  @param *frame Frame to be sent
+ *  @return FLEXCAN_SUCCESS if the frame was queued, FLEXCAN_ERROR if the queue is full
+ */
+static int IsoTpStackSendDefault(const FLEXCAN_frame_t *frame)
+{
+  return FLEXCAN_txq_send(frame, 0);
+}
+
+/** Initializes an ISO-TP stack with no links
+ *  @param *stack Stack struct to be initialized
+ *  @param send Puts a frame on the bus, NULL for the FlexCAN TX queue (FLEXCAN_txq_init has to be called)
+ */
+void IsoTpStackInit(isotp_stack_t *stack, isotp_send_frame_t send)
+{
+  memset(stack, 0, sizeof(isotp_stack_t));
+  stack->send = (send != NULL) ? send : IsoTpStackSendDefault;
+}
+
+/** Adds a link to a stack, before frames are passed to IsoTpStackReceive
+ *  @param *stack Stack struct
+ *  @param *link Link initialized by IsoTpLinkInit
+ *  @return Whether or not the stack had room for the link
+ */
+bool IsoTpStackAdd(isotp_stack_t *stack, isotp_link_t *link)
+{
+  if (stack->numLinks >= ISOTP_STACK_MAX_LINKS)
+  {
+    return false;
+  }
+  link->stack = stack;
+  stack->links[stack->numLinks++] = link;
+  return true;
+}
+
+/** Finds the link receiving on an arbitration ID
+ *  @param *stack Stack struct
+ *  @param id Arbitration ID of a standard frame
+ *  @return Link, NULL if no link receives on the ID
+ */
+static isotp_link_t *IsoTpStackFind(isotp_stack_t *stack, uint32_t id)
+{
+  uint8_t i = 0;
+  for (i = 0; i < stack->numLinks; i++)
+  {
+    if (stack->links[i]->rxId == id)
+    {
+      return stack->links[i];
+    }
+  }
+  return NULL;
+}
+
+/** Queues a received frame for the main loop if a link receives on its ID, called from the CAN interrupt
+ *  @param *stack Stack struct
+ *  @param *frame Frame received
+ *  @return Whether or not the frame belongs to a link of the stack
+ */
+bool IsoTpStackReceive(isotp_stack_t *stack, const FLEXCAN_frame_t *frame)
+{
+  if (frame->ide || frame->rtr || (IsoTpStackFind(stack, frame->id) == NULL))
+  {
+    return false;
+  }
+  if ((stack->head - stack->tail) >= ISOTP_STACK_QUEUE_SIZE)
+  {
+    stack->framesDropped++;
+    return true;
+  }
+  memcpy(&stack->queue[stack->head & (ISOTP_STACK_QUEUE_SIZE - 1)], frame, sizeof(FLEXCAN_frame_t));
+  stack->head++;
+  return true;
+}
+
+/** Initializes a link, it has to be added to a stack before it is used
+ *  The block size and STmin asked of the peer start at 0 (everything, as fast as it can) and
+ *  may be set in the struct afterwards, as may the padding byte
+ *  @param *link Link struct to be initialized
+ *  @param txId Arbitration ID to send on (standard)
+ *  @param rxId Arbitration ID to receive on (standard)
+ *  @param *rxBuffer Buffer received PDUs are put together in
+ *  @param rxSize Size of the buffer, longer PDUs are refused with a flow control overflow
+ *  @param received Called with each PDU received, NULL if none
+ *  @param sent Called when a PDU is sent, NULL if none
+ *  @param *arg Left to the owner of the link
+ */
+void IsoTpLinkInit(isotp_link_t *link, uint32_t txId, uint32_t rxId, uint8_t *rxBuffer, uint16_t rxSize,
+                   isotp_link_callback_t received, isotp_link_callback_t sent, void *arg)
+{
+  memset(link, 0, sizeof(isotp_link_t));
+  link->txId = txId;
+  link->rxId = rxId;
+  link->padding = ISOTP_LINK_PADDING;
+  link->rxBuffer = rxBuffer;
+  link->rxSize = rxSize;
+  link->received = received;
+  link->sent = sent;
+  link->arg = arg;
+}
+
+/** Converts a STmin byte to a separation time
+ *  @param stMin STmin of a flow control: 0 - 127 ms, or 100 - 900 us for 0xF1 - 0xF9
+ *  @return Separation time (us), the longest one for the reserved values
+ */
+uint32_t IsoTpStMinMicros(uint8_t stMin)
+{
+  if (stMin <= 0x7F)
+  {
+    return (uint32_t) stMin * 1000;
+  }
+  if ((stMin >= 0xF1) && (stMin <= 0xF9))
+  {
+    return (uint32_t)(stMin - 0xF0) * 100;
+  }
+  return 127000;
+}
+
+/** Sends a frame on the TX ID of a link, padded to 8 bytes
+ *  @param *link Link
+ *  @param *data Protocol control information and payload
+ *  @param length Number of bytes in data, at most 8
+ *  @return Whether or not the frame was taken for sending
+ */
+static bool IsoTpLinkSendFrame(isotp_link_t *link, const uint8_t *data, uint8_t length)
+{
+  FLEXCAN_frame_t frame;
+
+  memset(&frame, 0, sizeof(FLEXCAN_frame_t));
+  frame.id = link->txId;
+  frame.dlc = 8;
+  memset(frame.data, link->padding, sizeof(frame.data));
+  memcpy(frame.data, data, length);
+  return link->stack->send(&frame) == FLEXCAN_SUCCESS;
+}
+
+/** Sends a flow control frame with the block size and STmin of the link
+ *  @param *link Link
+ *  @param flowStatus ISOTP_FC_CLEAR_TO_SEND, ISOTP_FC_WAIT or ISOTP_FC_OVERFLOW
+ *  @return Whether or not the frame was taken for sending
+ */
+static bool IsoTpLinkSendFlowControl(isotp_link_t *link, uint8_t flowStatus)
+{
+  uint8_t data[3] = {(uint8_t)(eISOTP_FLOW_CONTROL | flowStatus), link->blockSize, link->stMin};
+  return IsoTpLinkSendFrame(link, data, sizeof(data));
+}
+
+/** Ends the PDU being sent and reports why
+ *  @param *link Link
+ *  @param result Outcome reported to the sent callback
+ */
+static void IsoTpLinkTxEnd(isotp_link_t *link, IsoTpLinkResult_e result)
+{
+  link->txState = eISOTP_LINK_IDLE;
+  if (result == eISOTP_N_OK)
+  {
+    link->pdusSent++;
+  }
+  else
+  {
+    link->txErrors++;
+  }
+  if (link->sent != NULL)
+  {
+    link->sent(link, result, link->txData, link->txLength);
+  }
+}
+
+/** Ends the PDU being received and reports it, or why it failed
+ *  @param *link Link
+ *  @param result Outcome reported to the received callback
+ */
+static void IsoTpLinkRxEnd(isotp_link_t *link, IsoTpLinkResult_e result)
+{
+  link->rxState = eISOTP_LINK_IDLE;
+  if (result == eISOTP_N_OK)
+  {
+    link->pdusReceived++;
+  }
+  else
+  {
+    link->rxErrors++;
+  }
+  if (link->received != NULL)
+  {
+    link->received(link, result, (result == eISOTP_N_OK) ? link->rxBuffer : NULL, (result == eISOTP_N_OK) ? link->rxLength : 0);
+  }
+}
+
+/** Sends the flow control a reception is waiting on, it is tried again by the next service if the TX queue is full
+ *  @param *link Link
+ *  @param now Current time (micros)
+ */
+static void IsoTpLinkRxFlowControl(isotp_link_t *link, uint32_t now)
+{
+  if (IsoTpLinkSendFlowControl(link, link->rxFlowStatus))
+  {
+    link->rxState = eISOTP_LINK_RX_WAIT_CF;
+    link->rxDeadline = now + (ISOTP_LINK_TIMEOUT_CR * 1000UL);
+  }
+  else
+  {
+    link->rxState = eISOTP_LINK_RX_SEND_FC;
+  }
+}
+
+/** Sends the consecutive frames that are due, until the block or the PDU ends or STmin has to pass
+ *  @param *link Link sending consecutive frames
+ *  @param now Current time (micros)
+ */
+static void IsoTpLinkTxConsecutive(isotp_link_t *link, uint32_t now)
+{
+  uint8_t data[1 + ISOTP_LINK_CF_DATA_LENGTH];
+  uint16_t length = 0;
+
+  while ((link->txState == eISOTP_LINK_TX_SEND_CF) && ((int32_t)(now - link->txNext) >= 0))
+  {
+    length = link->txLength - link->txOffset;
+    if (length > ISOTP_LINK_CF_DATA_LENGTH)
+    {
+      length = ISOTP_LINK_CF_DATA_LENGTH;
+    }
+    data[0] = eISOTP_CONSECUTIVE_FRAME | link->txSequence;
+    memcpy(&data[1], &link->txData[link->txOffset], length);
+    if (!IsoTpLinkSendFrame(link, data, 1 + length))
+    {
+      return; // TX queue full, the next service tries again
+    }
+    link->txOffset += length;
+    link->txSequence = (link->txSequence + 1) & ISOTP_PCI_LOW_MASK;
+    link->txNext = now + link->txStMin;
+
+    if (link->txOffset >= link->txLength)
+    {
+      IsoTpLinkTxEnd(link, eISOTP_N_OK);
+    }
+    else if ((link->txBlockSize > 0) && (--link->txBlockLeft == 0))
+    {
+      link->txState = eISOTP_LINK_TX_WAIT_FC;
+      link->txDeadline = now + (ISOTP_LINK_TIMEOUT_BS * 1000UL);
+    }
+  }
+}
+
+/** Handles a flow control for the PDU being sent
+ *  @param *link Link
+ *  @param *frame Flow control frame
+ *  @param now Current time (micros)
+ */
+static void IsoTpLinkFlowControl(isotp_link_t *link, const FLEXCAN_frame_t *frame, uint32_t now)
+{
+  if ((link->txState != eISOTP_LINK_TX_WAIT_FC) || (frame->dlc < 3))
+  {
+    return;
+  }
+  switch (frame->data[0] & ISOTP_PCI_LOW_MASK)
+  {
+    case ISOTP_FC_CLEAR_TO_SEND:
+    {
+      link->txBlockSize = frame->data[1];
+      link->txBlockLeft = frame->data[1];
+      link->txStMin = IsoTpStMinMicros(frame->data[2]);
+      link->txWaits = 0;
+      link->txNext = now;
+      link->txState = eISOTP_LINK_TX_SEND_CF;
+      IsoTpLinkTxConsecutive(link, now);
+      break;
+    }
+    case ISOTP_FC_WAIT:
+    {
+      if (++link->txWaits > ISOTP_LINK_MAX_WFT)
+      {
+        IsoTpLinkTxEnd(link, eISOTP_N_WFT_OVRN);
+      }
+      else
+      {
+        link->txDeadline = now + (ISOTP_LINK_TIMEOUT_BS * 1000UL);
+      }
+      break;
+    }
+    case ISOTP_FC_OVERFLOW: { IsoTpLinkTxEnd(link, eISOTP_N_BUFFER_OVFLW); break; }
+    default: { IsoTpLinkTxEnd(link, eISOTP_N_INVALID_FS); break; }
+  }
+}
+
+/** Handles a single frame or first frame, either ends a reception in progress
+ *  @param *link Link
+ *  @param *frame Single frame or first frame
+ *  @param now Current time (micros)
+ */
+static void IsoTpLinkRxStart(isotp_link_t *link, const FLEXCAN_frame_t *frame, uint32_t now)
+{
+  uint16_t length = 0;
+  bool first = ((frame->data[0] & ISOTP_PCI_TYPE_MASK) == eISOTP_FIRST_FRAME);
+
+  if (first)
+  {
+    length = ((uint16_t)(frame->data[0] & ISOTP_PCI_LOW_MASK) << 8) | frame->data[1];
+    if ((frame->dlc < 8) || ((length > 0) && (length <= ISOTP_LINK_SF_MAX_LENGTH)))
+    {
+      return; // not a valid first frame, ignored
+    }
+  }
+  else
+  {
+    length = frame->data[0] & ISOTP_PCI_LOW_MASK;
+    if ((length == 0) || (length >= frame->dlc))
+    {
+      return; // not a valid single frame, ignored
+    }
+  }
+
+  if (link->rxState != eISOTP_LINK_IDLE)
+  {
+    IsoTpLinkRxEnd(link, eISOTP_N_UNEXP_PDU);
+  }
+  if ((length == 0) || (length > link->rxSize)) // escape first frame (> 4095 bytes) or too long for the buffer
+  {
+    if (first)
+    {
+      IsoTpLinkSendFlowControl(link, ISOTP_FC_OVERFLOW);
+    }
+    IsoTpLinkRxEnd(link, eISOTP_N_BUFFER_OVFLW);
+    return;
+  }
+
+  link->rxLength = length;
+  if (!first)
+  {
+    memcpy(link->rxBuffer, &frame->data[1], length);
+    IsoTpLinkRxEnd(link, eISOTP_N_OK);
+    return;
+  }
+  memcpy(link->rxBuffer, &frame->data[2], ISOTP_LINK_FF_DATA_LENGTH);
+  link->rxOffset = ISOTP_LINK_FF_DATA_LENGTH;
+  link->rxSequence = 1;
+  link->rxBlockCount = 0;
+  link->rxFlowStatus = ISOTP_FC_CLEAR_TO_SEND;
+  IsoTpLinkRxFlowControl(link, now);
+}
+
+/** Handles a consecutive frame of the PDU being received
+ *  @param *link Link
+ *  @param *frame Consecutive frame
+ *  @param now Current time (micros)
+ */
+static void IsoTpLinkRxConsecutive(isotp_link_t *link, const FLEXCAN_frame_t *frame, uint32_t now)
+{
+  uint16_t length = link->rxLength - link->rxOffset;
+
+  if (link->rxState != eISOTP_LINK_RX_WAIT_CF)
+  {
+    return;
+  }
+  if ((frame->data[0] & ISOTP_PCI_LOW_MASK) != link->rxSequence)
+  {
+    IsoTpLinkRxEnd(link, eISOTP_N_WRONG_SN);
+    return;
+  }
+  if (length > ISOTP_LINK_CF_DATA_LENGTH)
+  {
+    length = ISOTP_LINK_CF_DATA_LENGTH;
+  }
+  if (length >= frame->dlc)
+  {
+    length = frame->dlc - 1;
+  }
+  memcpy(&link->rxBuffer[link->rxOffset], &frame->data[1], length);
+  link->rxOffset += length;
+  link->rxSequence = (link->rxSequence + 1) & ISOTP_PCI_LOW_MASK;
+
+  if (link->rxOffset >= link->rxLength)
+  {
+    IsoTpLinkRxEnd(link, eISOTP_N_OK);
+  }
+  else if ((link->blockSize > 0) && (++link->rxBlockCount >= link->blockSize))
+  {
+    link->rxBlockCount = 0;
+    link->rxFlowStatus = ISOTP_FC_CLEAR_TO_SEND;
+    IsoTpLinkRxFlowControl(link, now);
+  }
+  else
+  {
+    link->rxDeadline = now + (ISOTP_LINK_TIMEOUT_CR * 1000UL);
+  }
+}
+
+/** Runs a received frame through the state machines of its link
+ *  @param *link Link receiving on the frame ID
+ *  @param *frame Frame received
+ *  @param now Current time (micros)
+ */
+static void IsoTpLinkProcess(isotp_link_t *link, const FLEXCAN_frame_t *frame, uint32_t now)
+{
+  if (frame->dlc < 1)
+  {
+    return;
+  }
+  switch (frame->data[0] & ISOTP_PCI_TYPE_MASK)
+  {
+    case eISOTP_SINGLE_FRAME:
+    case eISOTP_FIRST_FRAME: { IsoTpLinkRxStart(link, frame, now); break; }
+    case eISOTP_CONSECUTIVE_FRAME: { IsoTpLinkRxConsecutive(link, frame, now); break; }
+    case eISOTP_FLOW_CONTROL: { IsoTpLinkFlowControl(link, frame, now); break; }
+    default: { break; }
+  }
+}
+
+/** Runs the time driven parts of a link: reports, paced consecutive frames, retried flow controls and timeouts
+ *  @param *link Link
+ *  @param now Current time (micros)
+ */
+static void IsoTpLinkPoll(isotp_link_t *link, uint32_t now)
+{
+  switch (link->txState)
+  {
+    case eISOTP_LINK_TX_DONE: { IsoTpLinkTxEnd(link, eISOTP_N_OK); break; }
+    case eISOTP_LINK_TX_SEND_CF: { IsoTpLinkTxConsecutive(link, now); break; }
+    case eISOTP_LINK_TX_WAIT_FC:
+    {
+      if ((int32_t)(now - link->txDeadline) >= 0)
+      {
+        IsoTpLinkTxEnd(link, eISOTP_N_TIMEOUT_BS);
+      }
+      break;
+    }
+    default: { break; }
+  }
+
+  switch (link->rxState)
+  {
+    case eISOTP_LINK_RX_SEND_FC: { IsoTpLinkRxFlowControl(link, now); break; }
+    case eISOTP_LINK_RX_WAIT_CF:
+    {
+      if ((int32_t)(now - link->rxDeadline) >= 0)
+      {
+        IsoTpLinkRxEnd(link, eISOTP_N_TIMEOUT_CR);
+      }
+      break;
+    }
+    default: { break; }
+  }
+}
+
+/** Runs the links of a stack, called from the main loop as often as it can
+ *  Handles the frames queued by IsoTpStackReceive, then sends what is due and checks the timeouts;
+ *  the link callbacks are called from here
+ *  @param *stack Stack struct
+ */
+void IsoTpStackService(isotp_stack_t *stack)
+{
+  uint32_t now = micros();
+  isotp_link_t *link = NULL;
+  uint8_t i = 0;
+
+  while (stack->tail != stack->head)
+  {
+    const FLEXCAN_frame_t *frame = &stack->queue[stack->tail & (ISOTP_STACK_QUEUE_SIZE - 1)];
+    link = IsoTpStackFind(stack, frame->id);
+    if (link != NULL)
+    {
+      IsoTpLinkProcess(link, frame, now);
+    }
+    stack->tail++;
+  }
+
+  for (i = 0; i < stack->numLinks; i++)
+  {
+    IsoTpLinkPoll(stack->links[i], now);
+  }
+}
+
+/** Starts sending a PDU on a link
+ *  The data is read while the PDU is sent and has to stay unchanged until the sent callback
+ *  @param *link Link added to a stack
+ *  @param *data PDU
+ *  @param length Length of the PDU, 1 - ISOTP_LINK_MAX_LENGTH bytes
+ *  @return Whether or not the PDU was started, false if the link is busy or the TX queue is full
+ */
+bool IsoTpLinkSend(isotp_link_t *link, const uint8_t *data, uint16_t length)
+{
+  uint8_t frame[8];
+
+  if ((link->stack == NULL) || (link->txState != eISOTP_LINK_IDLE) || (length == 0) || (length > ISOTP_LINK_MAX_LENGTH))
+  {
+    return false;
+  }
+
+  if (length <= ISOTP_LINK_SF_MAX_LENGTH)
+  {
+    frame[0] = eISOTP_SINGLE_FRAME | length;
+    memcpy(&frame[1], data, length);
+    if (!IsoTpLinkSendFrame(link, frame, 1 + length))
+    {
+      return false;
+    }
+    link->txState = eISOTP_LINK_TX_DONE;
+  }
+  else
+  {
+    frame[0] = eISOTP_FIRST_FRAME | (length >> 8);
+    frame[1] = length & 0xFF;
+    memcpy(&frame[2], data, ISOTP_LINK_FF_DATA_LENGTH);
+    if (!IsoTpLinkSendFrame(link, frame, sizeof(frame)))
+    {
+      return false;
+    }
+    link->txOffset = ISOTP_LINK_FF_DATA_LENGTH;
+    link->txSequence = 1;
+    link->txWaits = 0;
+    link->txDeadline = micros() + (ISOTP_LINK_TIMEOUT_BS * 1000UL);
+    link->txState = eISOTP_LINK_TX_WAIT_FC;
+  }
+  link->txData = data;
+  link->txLength = length;
+  return true;
+}
@@ -0,0 +1,142 @@
+/*
+  * @file IsoTpLink.h
+  *
+  * ISO-TP (ISO 15765-2) send and receive over the FlexCAN driver, for talking to ECUs rather
+  * than only listening in (IsoTp.h). Every link is one pair of arbitration IDs with its own
+  * transmit and receive state machine: PDUs of up to 7 bytes go out as a single frame, longer
+  * ones as a first frame and consecutive frames paced by the block size and STmin the receiver
+  * asks for in its flow control; received PDUs are put together in a buffer given by the caller
+  * and flow controlled with the block size and STmin of the link. Nothing is allocated, the
+  * caller owns the links, the receive buffers and the data being sent.
+  *
+  * The CAN interrupt only puts the frames of the links into the receive queue of the stack
+  * (IsoTpStackReceive); IsoTpStackService, called from the main loop, runs the state machines,
+  * sends the paced consecutive frames, checks the N_Bs / N_Cr timeouts and calls the link
+  * callbacks. Sending and the callbacks therefore all run in the main loop; a received PDU is
+  * only valid in its callback, the next first frame reuses the buffer.
+*/
+
+#ifndef ISOTPLINK_H
+#define ISOTPLINK_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <stdint.h>
+#include <string.h>
+#include <can.h>
+#include "IsoTp.h"
+
+/* DEFINES */
+#define ISOTP_STACK_MAX_LINKS         8         // Maximum number of links served by one stack
+#define ISOTP_STACK_QUEUE_SIZE        32        // Number of received frames waiting for the main loop, a power of two
+#define ISOTP_LINK_MAX_LENGTH         4095      // Longest PDU (bytes), the 12 bit first frame length
+#define ISOTP_LINK_SF_MAX_LENGTH      7         // Longest PDU sent in a single frame
+#define ISOTP_LINK_FF_DATA_LENGTH     6         // Payload bytes in a first frame
+#define ISOTP_LINK_CF_DATA_LENGTH     7         // Payload bytes in a consecutive frame
+#define ISOTP_LINK_TIMEOUT_BS         1000      // Time (ms) to wait for a flow control (N_Bs)
+#define ISOTP_LINK_TIMEOUT_CR         1000      // Time (ms) to wait for a consecutive frame (N_Cr)
+#define ISOTP_LINK_MAX_WFT            8         // Flow control WAIT frames accepted in a row (N_WFTmax)
+#define ISOTP_LINK_PADDING            0xAA      // Default value of the unused data bytes, frames are always 8 bytes
+
+#define ISOTP_FC_CLEAR_TO_SEND        0x00      // Flow status: send the next block
+#define ISOTP_FC_WAIT                 0x01      // Flow status: wait for another flow control
+#define ISOTP_FC_OVERFLOW             0x02      // Flow status: the PDU does not fit, abort
+
+/* ENUMS */
+enum IsoTpLinkState_e
+{
+  eISOTP_LINK_IDLE = 0,                 // Nothing being sent / received
+  eISOTP_LINK_TX_DONE,                  // Single frame sent, reported by the next service
+  eISOTP_LINK_TX_WAIT_FC,               // First frame or block sent, waiting for a flow control
+  eISOTP_LINK_TX_SEND_CF,               // Sending the consecutive frames of a block
+  eISOTP_LINK_RX_SEND_FC,               // Flow control to be sent (again if the TX queue was full)
+  eISOTP_LINK_RX_WAIT_CF                // Waiting for the next consecutive frame
+};
+
+enum IsoTpLinkResult_e
+{
+  eISOTP_N_OK = 0,                      // PDU sent / received
+  eISOTP_N_TIMEOUT_BS,                  // No flow control within N_Bs
+  eISOTP_N_TIMEOUT_CR,                  // No consecutive frame within N_Cr
+  eISOTP_N_WRONG_SN,                    // Consecutive frame out of sequence
+  eISOTP_N_INVALID_FS,                  // Flow control with an unknown flow status
+  eISOTP_N_UNEXP_PDU,                   // New PDU started while one was being received
+  eISOTP_N_WFT_OVRN,                    // More than ISOTP_LINK_MAX_WFT flow control WAIT frames
+  eISOTP_N_BUFFER_OVFLW                 // PDU longer than the receive buffer (ours or the peer's)
+};
+
+/* STRUCTS */
+struct isotp_link_s;
+
+typedef void (*isotp_link_callback_t)(struct isotp_link_s *link, IsoTpLinkResult_e result, const uint8_t *data, uint16_t length);
+typedef int (*isotp_send_frame_t)(const FLEXCAN_frame_t *frame);
+
+typedef struct isotp_link_s {
+  uint32_t txId;                        // Arbitration ID the link sends on
+  uint32_t rxId;                        // Arbitration ID the link receives on
+  uint8_t blockSize;                    // Consecutive frames asked for per flow control, 0 for all
+  uint8_t stMin;                        // Separation time asked for in the flow control (STmin byte)
+  uint8_t padding;                      // Value of the unused data bytes
+  uint8_t *rxBuffer;                    // Received PDUs are put together here
+  uint16_t rxSize;                      // Size of the receive buffer (bytes)
+  isotp_link_callback_t received;       // Called with each PDU received, or the reason a reception failed
+  isotp_link_callback_t sent;           // Called when a PDU is sent, or with the reason it failed
+  void *arg;                            // Left to the owner of the link
+  struct isotp_stack_s *stack;          // Stack serving the link
+
+  uint8_t txState;                      // IsoTpLinkState_e of the transmit side
+  const uint8_t *txData;                // PDU being sent, owned by the caller until the sent callback
+  uint16_t txLength;                    // Length of the PDU being sent
+  uint16_t txOffset;                    // Payload bytes sent so far
+  uint8_t txSequence;                   // Sequence number of the next consecutive frame
+  uint8_t txBlockSize;                  // Block size asked for by the receiver
+  uint8_t txBlockLeft;                  // Consecutive frames left in the block
+  uint8_t txWaits;                      // Flow control WAIT frames received in a row
+  uint32_t txStMin;                     // Separation time (us) asked for by the receiver
+  uint32_t txNext;                      // Time (micros) the next consecutive frame may be sent
+  uint32_t txDeadline;                  // Time (micros) the flow control has to arrive by
+
+  uint8_t rxState;                      // IsoTpLinkState_e of the receive side
+  uint8_t rxFlowStatus;                 // Flow status of the flow control to be sent
+  uint8_t rxSequence;                   // Sequence number expected in the next consecutive frame
+  uint8_t rxBlockCount;                 // Consecutive frames received in the current block
+  uint16_t rxLength;                    // Length of the PDU being received
+  uint16_t rxOffset;                    // Payload bytes received so far
+  uint32_t rxDeadline;                  // Time (micros) the next consecutive frame has to arrive by
+
+  uint32_t pdusSent;                    // Number of PDUs sent
+  uint32_t pdusReceived;                // Number of PDUs received
+  uint32_t txErrors;                    // Number of PDUs that could not be sent
+  uint32_t rxErrors;                    // Number of receptions that failed
+} isotp_link_t;
+
+typedef struct isotp_stack_s {
+  isotp_link_t *links[ISOTP_STACK_MAX_LINKS];     // Links served
+  uint8_t numLinks;                               // Number of links
+  isotp_send_frame_t send;                        // Puts a frame on the bus, FLEXCAN_txq_send by default
+  FLEXCAN_frame_t queue[ISOTP_STACK_QUEUE_SIZE];  // Frames received for the links
+  volatile uint32_t head;                         // Number of frames queued, written by the CAN interrupt
+  volatile uint32_t tail;                         // Number of frames taken, written by the main loop
+  uint32_t framesDropped;                         // Frames lost because the queue was full
+} isotp_stack_t;
+
+/* FUNCTION PROTOTYPES */
+void IsoTpStackInit(isotp_stack_t *stack, isotp_send_frame_t send);
+bool IsoTpStackAdd(isotp_stack_t *stack, isotp_link_t *link);
+bool IsoTpStackReceive(isotp_stack_t *stack, const FLEXCAN_frame_t *frame);
+void IsoTpStackService(isotp_stack_t *stack);
+void IsoTpLinkInit(isotp_link_t *link, uint32_t txId, uint32_t rxId, uint8_t *rxBuffer, uint16_t rxSize,
+                   isotp_link_callback_t received, isotp_link_callback_t sent, void *arg);
+bool IsoTpLinkSend(isotp_link_t *link, const uint8_t *data, uint16_t length);
+uint32_t IsoTpStMinMicros(uint8_t stMin);
+
+/** Checks whether or not a link is still sending a PDU
+ *  @param *link Link
+ *  @return Whether or not the sent callback is still to come
+ */
+static inline bool IsoTpLinkBusy(const isotp_link_t *link)
+{
+  return link->txState != eISOTP_LINK_IDLE;
+}
+
+#endif // ISOTPLINK_H
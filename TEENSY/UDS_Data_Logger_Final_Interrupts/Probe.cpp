@@ -0,0 +1,136 @@
+/*
+  * @file Probe.cpp
+  *
+  * Timing probes for the capture hot path, fixed bucket histograms dumped over Serial
+*/
+
+/* INCLUDES */
+#include "Probe.h"
+
+/** Starts the cycle counter ProbeNow reads, nothing to do on the host
+ */
+void ProbeStartClock(void)
+{
+  #if defined(__arm__)
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+  #endif
+}
+
+#ifdef PROBES
+
+#include <Arduino.h>
+#include <string.h>
+
+/* CONSTANTS */
+const char *ProbeNames[ePROBE_NUM] =
+{
+  "can_fifo_callback",
+  "FLEXCAN_fifo_read",
+  "TransposeCanMessage",
+  "CircularBufferPush",
+  "SD flush"
+};
+
+/* GLOBAL VARIABLES */
+probe_histogram_t g_Probes[ePROBE_NUM];   // Written by the probe scopes, from the CAN interrupt and the main loop
+
+/** Starts the cycle counter and clears the histograms
+ */
+void ProbeInit(void)
+{
+  ProbeStartClock();
+  ProbeReset();
+}
+
+/** Clears the histograms
+ */
+void ProbeReset(void)
+{
+  uint8_t probe = 0;
+  __disable_irq();
+  memset(g_Probes, 0, sizeof(g_Probes));
+  for (probe = 0; probe < ePROBE_NUM; probe++)
+  {
+    g_Probes[probe].min = UINT32_MAX;
+  }
+  __enable_irq();
+}
+
+/** Adds a time to the histogram of a probe
+ *  Each probe is only measured in one context (interrupt or main loop), so the update needs no lock
+ *  @param probe Probe
+ *  @param ticks Time measured
+ */
+void ProbeRecord(Probe_e probe, uint32_t ticks)
+{
+  probe_histogram_t *histogram = &g_Probes[probe];
+  uint8_t bucket = (ticks == 0) ? 0 : (uint8_t)(32 - __builtin_clz(ticks));
+
+  if (bucket >= PROBE_NUM_BUCKETS)
+  {
+    bucket = PROBE_NUM_BUCKETS - 1;
+  }
+  histogram->buckets[bucket]++;
+  histogram->count++;
+  histogram->total += ticks;
+  if (ticks < histogram->min)
+  {
+    histogram->min = ticks;
+  }
+  if (ticks > histogram->max)
+  {
+    histogram->max = ticks;
+  }
+}
+
+/** Copies the histogram of a probe, consistent with the interrupt
+ *  @param probe Probe
+ *  @param *histogram Copy to be set
+ *  @return Whether or not the probe measured anything
+ */
+bool ProbeGet(Probe_e probe, probe_histogram_t *histogram)
+{
+  __disable_irq();
+  memcpy(histogram, &g_Probes[probe], sizeof(probe_histogram_t));
+  __enable_irq();
+  return histogram->count > 0;
+}
+
+/** Prints the histogram of every probe that measured something, times in ns
+ *  e.g. "TransposeCanMessage  n 1200  min 42  mean 55  max 310" then one line per bucket
+ */
+void ProbeDump(void)
+{
+  probe_histogram_t histogram;
+  char line[96];
+  uint8_t probe = 0;
+  uint8_t bucket = 0;
+
+  Serial.println("Probes (ns):");
+  for (probe = 0; probe < ePROBE_NUM; probe++)
+  {
+    if (!ProbeGet((Probe_e) probe, &histogram))
+    {
+      continue;
+    }
+    snprintf(line, sizeof(line), "%-20s n %lu  min %lu  mean %lu  max %lu", ProbeNames[probe], (unsigned long) histogram.count,
+             (unsigned long)(((uint64_t) histogram.min * 1000) / PROBE_TICKS_PER_US),
+             (unsigned long)((histogram.total * 1000) / ((uint64_t) histogram.count * PROBE_TICKS_PER_US)),
+             (unsigned long)(((uint64_t) histogram.max * 1000) / PROBE_TICKS_PER_US));
+    Serial.println(line);
+    for (bucket = 0; bucket < PROBE_NUM_BUCKETS; bucket++)
+    {
+      if (histogram.buckets[bucket] == 0)
+      {
+        continue;
+      }
+      // upper bound of the bucket, 2^bucket ticks
+      snprintf(line, sizeof(line), "  < %10lu  %lu", (unsigned long)((((uint64_t) 1 << bucket) * 1000) / PROBE_TICKS_PER_US),
+               (unsigned long) histogram.buckets[bucket]);
+      Serial.println(line);
+    }
+  }
+}
+
+#endif // PROBES
@@ -0,0 +1,97 @@
+/*
+  * @file Probe.h
+  *
+  * Timing probes for the capture hot path: a probe scope measures the code it encloses in
+  * DWT cycles on the Teensy (steady_clock nanoseconds on the host) and adds the time to a fixed
+  * bucket histogram in RAM, dumped over Serial on demand. Without PROBES every probe compiles
+  * to nothing.
+*/
+
+#ifndef PROBE_H
+#define PROBE_H
+
+/* INCLUDES */
+#include <stdint.h>
+
+//#define PROBES 1
+
+/* DEFINES */
+#define PROBE_NUM_BUCKETS             32        // Bucket n counts times of [2^(n-1), 2^n) ticks, bucket 0 zero ticks
+
+/* ENUMS */
+enum Probe_e
+{
+  ePROBE_FIFO_CALLBACK = 0,             // can_fifo_callback, the whole per-frame interrupt work
+  ePROBE_FIFO_READ,                     // FLEXCAN_fifo_read (FLEXCAN_read_frame and the flag clear)
+  ePROBE_TRANSPOSE,                     // TransposeCanMessage
+  ePROBE_RING_PUSH,                     // CircularBufferPush
+  ePROBE_SD_FLUSH,                      // Writing a range of the capture ring to an attack file, close included
+  ePROBE_NUM
+};
+
+/* STRUCTS */
+typedef struct {
+  uint32_t count;                       // Number of times measured
+  uint32_t min;                         // Shortest time (ticks)
+  uint32_t max;                         // Longest time (ticks)
+  uint64_t total;                       // Sum of the times (ticks)
+  uint32_t buckets[PROBE_NUM_BUCKETS];  // Times by power of two
+} probe_histogram_t;
+
+/* The tick source is always built, the health counters time the CAN interrupt with it */
+#if defined(__arm__)
+  #include <Arduino.h>
+  #define PROBE_TICKS_PER_US          (F_CPU / 1000000) // DWT cycle counter runs at the core clock
+  static inline uint32_t ProbeNow(void)
+  {
+    return ARM_DWT_CYCCNT;
+  }
+#else
+  #include <chrono>
+  #define PROBE_TICKS_PER_US          1000      // steady_clock nanoseconds
+  static inline uint32_t ProbeNow(void)
+  {
+    return (uint32_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+#endif
+
+void ProbeStartClock(void);
+
+#ifdef PROBES
+
+/* FUNCTION PROTOTYPES */
+void ProbeInit(void);
+void ProbeReset(void);
+void ProbeRecord(Probe_e probe, uint32_t ticks);
+bool ProbeGet(Probe_e probe, probe_histogram_t *histogram);
+void ProbeDump(void);
+
+/* CLASSES */
+class ProbeScope
+{
+public:
+  explicit ProbeScope(Probe_e probe) : m_Probe(probe), m_Start(ProbeNow()) {}
+  ~ProbeScope() { ProbeRecord(m_Probe, ProbeNow() - m_Start); }
+
+private:
+  Probe_e m_Probe;
+  uint32_t m_Start;
+};
+
+#define PROBE_CONCAT_(a, b)           a##b
+#define PROBE_CONCAT(a, b)            PROBE_CONCAT_(a, b)
+#define PROBE_SCOPE(probe)            ProbeScope PROBE_CONCAT(probeScope, __LINE__)(probe)
+#define PROBE_INIT()                  ProbeInit()
+#define PROBE_RESET()                 ProbeReset()
+#define PROBE_DUMP()                  ProbeDump()
+
+#else
+
+#define PROBE_SCOPE(probe)            do {} while (0)
+#define PROBE_INIT()                  do {} while (0)
+#define PROBE_RESET()                 do {} while (0)
+#define PROBE_DUMP()                  do {} while (0)
+
+#endif // PROBES
+
+#endif // PROBE_H
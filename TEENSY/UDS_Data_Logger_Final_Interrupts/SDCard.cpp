@@ -51,6 +51,22 @@ bool MakeDirectory(char *dirName, SdFat *sd)
   return status;
 }
 
+/** Sets the file name and path for a new data file
+ *  This function is used to set these parameters before opening a new file
+ *  @param *filePath Full path of the file (to be set)
+ *  @param *fileName Name of the file (to be set)
+ *  @param *directory Directory of the new file
+ *  @param *fileTitle Name of new file
+ *  @param fileNumber File number to be appended to the end of the file name
+ *  @param nameSize Size of the file name
+ *  @param pathSize Size of the file path
+ */
+void SetFileNameAndPath(char *filePath, char *fileName, const char *directory, const char *fileTitle, uint32_t fileNumber, size_t nameSize, size_t pathSize)
+{
+  snprintf(fileName, nameSize, "%s%lu.txt", fileTitle, (unsigned long) fileNumber);
+  snprintf(filePath, pathSize, "%s/%s", directory, fileName);
+}
+
 /** Prints the file name and data column headers to a file
  *  @param *file File to be configured
  *  @param *fileName Name of the file
@@ -68,6 +84,7 @@ void ConfigureDataFile(SdFile *file, char* fileName)
 }
 
 /** Opens and configures a new data file for write
+ *  A file left over from a failed attempt is started over
  *  @param *file SD file object
  *  @param *filePath Full path of the new file
  *  @param *fileName Name of the new file
@@ -77,13 +94,15 @@ bool OpenNewDataFile(SdFile *file, char *filePath, char *fileName)
 {
   bool status = true;
   
-  if (!file->open(filePath, O_RDWR | O_CREAT | O_AT_END)) 
+  if (!file->open(filePath, O_RDWR | O_CREAT | O_TRUNC)) 
   {
     HandleError(eERR_SD_FAILED_FILE_OPEN_FOR_WRITE);
     status = false;
   }
-  
-  ConfigureDataFile(file, fileName);
+  else
+  {
+    ConfigureDataFile(file, fileName);
+  }
   return status;
 }
 
@@ -155,7 +174,7 @@ void FileWriteMessage(can_message_t *message, SdFile *file)
   uint8_t currentData = 0;
   file->print(message->timestamp, DEC);
   file->print("\t\t");
-  file->print(message->id, HEX);
+  PrintCanId(file, message->id, message->ide);
   file->print("\t");
   for (currentData = 0; currentData < message->len; currentData++)
   {
@@ -165,6 +184,81 @@ void FileWriteMessage(can_message_t *message, SdFile *file)
   file->println();
 }
 
+/** Prints a decoded diagnostic PDU to a file
+ *  e.g. "REQ 10 DiagnosticSessionControl C0" or "NEG 27 SecurityAccess NRC 35 invalidKey"
+ *  @param *decoded Decoded PDU to be printed to the file
+ *  @param *file File to be printed to
+ */
+void FileWriteUDSDecode(uds_decoded_t *decoded, SdFile *file)
+{
+  const uds_service_t *service = UDSGetService(decoded->serviceIndex);
+  char dataOut[12];
+
+  switch (decoded->type)
+  {
+    case eUDS_MSG_REQUEST:
+    {
+      file->print("REQ ");
+      break;
+    }
+    case eUDS_MSG_POSITIVE_RESPONSE:
+    {
+      file->print("POS ");
+      break;
+    }
+    case eUDS_MSG_NEGATIVE_RESPONSE:
+    {
+      file->print("NEG ");
+      break;
+    }
+    default:
+    {
+      file->print("UNKNOWN");
+      return;
+    }
+  }
+
+  snprintf(dataOut, sizeof(dataOut), "%02X ", decoded->sid);
+  file->print(dataOut);
+  file->print((service != NULL) ? service->name : "UnknownService");
+  if (decoded->hasParam)
+  {
+    snprintf(dataOut, sizeof(dataOut), " %02X", decoded->param);
+    file->print(dataOut);
+  }
+  if (decoded->type == eUDS_MSG_NEGATIVE_RESPONSE)
+  {
+    snprintf(dataOut, sizeof(dataOut), " NRC %02X ", decoded->nrc);
+    file->print(dataOut);
+    file->print(UDSGetNrcName(decoded->nrc));
+  }
+}
+
+/** Prints the decoded service summary and classification of an attack to a file
+ *  @param *summary Summary of the attack
+ *  @param *file File to be printed to
+ */
+void FileWriteAttackSummary(uds_summary_t *summary, SdFile *file)
+{
+  uint8_t serviceClass = 0;
+  char summaryString[100];
+
+  snprintf(summaryString, sizeof(summaryString), "UDS Requests: %lu  Positive Responses: %lu  Negative Responses: %lu",
+           (unsigned long) summary->requests, (unsigned long) summary->positiveResponses, (unsigned long) summary->negativeResponses);
+  file->println(summaryString);
+  for (serviceClass = eUDS_CLASS_SESSION; serviceClass < eUDS_NUM_CLASSES; serviceClass++)
+  {
+    if (summary->classCount[serviceClass] > 0)
+    {
+      snprintf(summaryString, sizeof(summaryString), "  %s Requests: %lu",
+               UDSGetClassName((UDSServiceClass_e) serviceClass), (unsigned long) summary->classCount[serviceClass]);
+      file->println(summaryString);
+    }
+  }
+  file->print("Attack Classification: ");
+  file->println(UDSGetAttackName(UDSClassifyAttack(summary)));
+}
+
 /** Checks the status of the SD card
  *  @param *sd SD card object
  *  @return Status of SD card communications 
@@ -181,3 +275,47 @@ bool CheckStatus(SdFat *sd)
   return status;
 }
 
+
+/** Stamps a file with the current time
+ *  @param *file File to be stamped
+ *  @param flags Timestamps to be set (T_ACCESS, T_CREATE, T_WRITE)
+ *  @return Whether or not the timestamp could be set
+ */
+static bool SetFileTime(SdFile *file, uint8_t flags)
+{
+  bool status = true;
+  time_t t = now();
+  if (!file->timestamp(flags, year(t), month(t), day(t), hour(t), minute(t), second(t)))
+  {
+    HandleError(eERR_SD_FAILED_TO_EDIT_FILE_TIMESTAMP);
+    status = false;
+  }
+  return status;
+}
+
+/** Sets the creation time of a file to the current time
+ *  @param *file File to be stamped
+ *  @return Whether or not the timestamp could be set
+ */
+bool SetFileCreateTime(SdFile *file)
+{
+  return SetFileTime(file, T_CREATE);
+}
+
+/** Sets the last write time of a file to the current time
+ *  @param *file File to be stamped
+ *  @return Whether or not the timestamp could be set
+ */
+bool SetFileEditTime(SdFile *file)
+{
+  return SetFileTime(file, T_WRITE);
+}
+
+/** Sets the last access time of a file to the current time
+ *  @param *file File to be stamped
+ *  @return Whether or not the timestamp could be set
+ */
+bool SetFileAccessTime(SdFile *file)
+{
+  return SetFileTime(file, T_ACCESS);
+}
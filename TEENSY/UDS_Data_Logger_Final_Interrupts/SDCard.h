@@ -15,9 +15,15 @@
 #include <DS1307RTC.h>
 #include "CANMessage.h"
 #include "Errors.h"
+#include "UDSDecoder.h"
+
+/* DEFINES */
+#define FILE_NAME_SIZE                30        // Size of file name string
+#define FILE_PATH_SIZE                60        // Maximum size of file names
 
 /* FUNCTION PROTOTYPES */
 bool SdInit(SdFat *sd, uint8_t chipSelect);
+void SetFileNameAndPath(char *filePath, char *fileName, const char *directory, const char *fileTitle, uint32_t fileNumber, size_t nameSize, size_t pathSize);
 void dateTime(uint16_t *date, uint16_t *time);
 bool MakeDirectory(char *dirName, SdFat *sd);
 void ConfigureDataFile(SdFile *file, char* fileName);
@@ -26,6 +32,8 @@ bool OpenDataFile(SdFile *file, char *filePath);
 bool ReadFile(char *fileName, SdFile *file);
 bool DeleteAllFiles(SdFat *sd);
 void FileWriteMessage(can_message_t *message, SdFile *file);
+void FileWriteUDSDecode(uds_decoded_t *decoded, SdFile *file);
+void FileWriteAttackSummary(uds_summary_t *summary, SdFile *file);
 bool CheckStatus(SdFat *sd);
 bool SetFileCreateTime(SdFile *file);
 bool SetFileEditTime(SdFile *file);
@@ -0,0 +1,103 @@
+/*
+  * @file SdMonitor.cpp
+  *
+  * Keeps track of the SD card without polling it
+*/
+
+/* INCLUDES */
+#include "SdMonitor.h"
+#include "SDCard.h"
+
+/* CONSTANTS */
+const char *SdCardStateNames[] = {"Unknown", "OK", "Failed"};
+
+/** Initializes the SD monitor, nothing is known about the card until the first access
+ *  @param *mon SD monitor struct to be initialized
+ *  @param *sd SD Card object
+ */
+void SdMonitorInit(sd_monitor_t *mon, SdFat *sd)
+{
+  memset(mon, 0, sizeof(sd_monitor_t));
+  mon->sd = sd;
+  mon->state = eSD_CARD_UNKNOWN;
+  mon->lastAccess = millis();
+  mon->probePeriod = SD_MONITOR_MIN_PERIOD;
+}
+
+/** Reports the result of an SD access made anyway (file open, write and close, initialization)
+ *  Each one counts as a free probe and puts the next real probe off
+ *  @param *mon SD monitor struct
+ *  @param ok Whether or not the access worked
+ */
+void SdMonitorReport(sd_monitor_t *mon, bool ok)
+{
+  uint32_t current = millis();
+
+  mon->results++;
+  mon->lastAccess = current;
+  if (ok)
+  {
+    mon->state = eSD_CARD_OK;
+    mon->lastGood = current;
+  }
+  else
+  {
+    mon->failedResults++;
+    mon->state = eSD_CARD_FAILED;
+    mon->probePeriod = SD_MONITOR_MIN_PERIOD;
+  }
+}
+
+/** Probes the card if it has been idle for the probe period, called from the main loop
+ *  A probe that works doubles the period up to SD_MONITOR_MAX_PERIOD. A failed probe flags
+ *  eERR_SD_LOST_COMMUNICATIONS, a failed card is left to the SD recovery and not probed.
+ *  @param *mon SD monitor struct
+ *  @return Whether or not the card was probed
+ */
+bool SdMonitorService(sd_monitor_t *mon)
+{
+  uint32_t current = millis();
+
+  if ((mon->state == eSD_CARD_FAILED) || ((current - mon->lastAccess) < mon->probePeriod))
+  {
+    return false;
+  }
+  mon->probes++;
+  mon->lastAccess = current;
+  if (CheckStatus(mon->sd))
+  {
+    mon->state = eSD_CARD_OK;
+    mon->lastGood = current;
+    mon->probePeriod = (mon->probePeriod >= (SD_MONITOR_MAX_PERIOD / 2)) ? SD_MONITOR_MAX_PERIOD : (mon->probePeriod * 2);
+  }
+  else
+  {
+    mon->failedProbes++;
+    mon->state = eSD_CARD_FAILED;
+    mon->probePeriod = SD_MONITOR_MIN_PERIOD;
+  }
+  return true;
+}
+
+/** Gets the last known state of the card, without any SD access
+ *  @param *mon SD monitor struct
+ *  @return State of the card
+ */
+SdCardState_e SdMonitorState(sd_monitor_t *mon)
+{
+  return mon->state;
+}
+
+/** Prints the state of the card and the probe counters
+ *  e.g. "SD Card: OK, last good 120 ms ago, 96 results (0 failed), 5 probes (0 failed), probe period 8000 ms"
+ *  @param *mon SD monitor struct
+ *  @param *out Output
+ */
+void SdMonitorPrint(sd_monitor_t *mon, Print *out)
+{
+  char line[160];
+  snprintf(line, sizeof(line), "SD Card: %s, last good %lu ms ago, %lu results (%lu failed), %lu probes (%lu failed), probe period %lu ms",
+           SdCardStateNames[mon->state], (unsigned long)(millis() - mon->lastGood), (unsigned long) mon->results, (unsigned long) mon->failedResults,
+           (unsigned long) mon->probes, (unsigned long) mon->failedProbes, (unsigned long) mon->probePeriod);
+  out->println(line);
+}
@@ -0,0 +1,50 @@
+/*
+  * @file SdMonitor.h
+  *
+  * Keeps track of the SD card without polling it. Every file open and close already tells
+  * whether the card works, so the card is only probed (readOCR) after it has been left alone
+  * for a while, and the time between probes doubles for as long as it stays idle and healthy.
+  * The last known state is read without touching the SPI bus.
+*/
+
+#ifndef SDMONITOR_H
+#define SDMONITOR_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <stdint.h>
+#include <SdFat.h>
+
+/* DEFINES */
+#define SD_MONITOR_MIN_PERIOD         250       // Time (ms) without SD access before the first probe
+#define SD_MONITOR_MAX_PERIOD         8000      // Longest time (ms) between probes of an idle card
+
+/* ENUMS */
+enum SdCardState_e
+{
+  eSD_CARD_UNKNOWN = 0,                 // Nothing heard from the card yet
+  eSD_CARD_OK,                          // Last access worked
+  eSD_CARD_FAILED                       // Last access failed, no probes until an access works again
+};
+
+/* STRUCTS */
+typedef struct {
+  SdFat *sd;                            // SD Card object
+  SdCardState_e state;                  // Last known state of the card
+  uint32_t lastAccess;                  // Time (millis) of the last access, probe or not
+  uint32_t lastGood;                    // Time (millis) of the last access that worked
+  uint32_t probePeriod;                 // Time (ms) without access before the next probe
+  uint32_t results;                     // Number of access results reported
+  uint32_t failedResults;               // Number of reported accesses that failed
+  uint32_t probes;                      // Number of probes
+  uint32_t failedProbes;                // Number of probes that failed
+} sd_monitor_t;
+
+/* FUNCTION PROTOTYPES */
+void SdMonitorInit(sd_monitor_t *mon, SdFat *sd);
+void SdMonitorReport(sd_monitor_t *mon, bool ok);
+bool SdMonitorService(sd_monitor_t *mon);
+SdCardState_e SdMonitorState(sd_monitor_t *mon);
+void SdMonitorPrint(sd_monitor_t *mon, Print *out);
+
+#endif // SDMONITOR_H
@@ -0,0 +1,118 @@
+/*
+  * @file SdRecovery.cpp
+  *
+  * Brings the SD card back after it failed
+*/
+
+/* INCLUDES */
+#include "SdRecovery.h"
+
+/** Initializes the SD recovery with the card in use
+ *  @param *rec SD recovery struct to be initialized
+ *  @param *sd SD Card object
+ *  @param chipSelect Chip select pin for SD card
+ *  @param *sessions Sessions paused while the card is out
+ *  @param *health Health counters the recoveries are counted in
+ */
+void SdRecoveryInit(sd_recovery_t *rec, SdFat *sd, uint8_t chipSelect, session_manager_t *sessions, logger_health_t *health)
+{
+  memset(rec, 0, sizeof(sd_recovery_t));
+  rec->state = eSD_READY;
+  rec->sd = sd;
+  rec->chipSelect = chipSelect;
+  rec->sessions = sessions;
+  rec->health = health;
+  rec->cause = eERR_NONE;
+}
+
+/** Starts a recovery for an SD card error, an error during a recovery is part of it
+ *  Session writes stop here, the frames they still have to write stay pinned in the capture ring
+ *  @param *rec SD recovery struct
+ *  @param *event Error that was flagged
+ */
+void SdRecoveryStart(sd_recovery_t *rec, error_event_t *event)
+{
+  if (rec->state != eSD_READY)
+  {
+    return;
+  }
+  rec->state = eSD_REINIT;
+  rec->cause = event->error;
+  rec->failedAt = event->timestamp;
+  rec->nextAttempt = millis();
+  rec->attempts = 0;
+  rec->sessions->sdAvailable = false;
+  SESSION_LOCK();
+  rec->storedAtFailure = rec->sessions->ring->pushCount;
+  rec->droppedAtFailure = rec->sessions->droppedFrames;
+  SESSION_UNLOCK();
+  rec->health->sdFailures++;
+}
+
+/** Takes the next recovery step once its time has come, called from the main loop
+ *  @param *rec SD recovery struct
+ *  @return Whether or not the card came back during this call
+ */
+bool SdRecoveryService(sd_recovery_t *rec)
+{
+  uint32_t current = millis();
+  uint32_t elapsed = 0;
+
+  if ((rec->state == eSD_READY) || ((int32_t)(current - rec->nextAttempt) < 0))
+  {
+    return false;
+  }
+  rec->nextAttempt = current + SD_RECOVERY_RETRY_PERIOD;
+
+  if (rec->state == eSD_REINIT)
+  {
+    rec->attempts++;
+    if (!rec->sd->begin(rec->chipSelect, SPI_FULL_SPEED))
+    {
+      return false;
+    }
+    rec->state = eSD_REOPEN;
+  }
+  if (!SessionReopenFiles(rec->sessions))
+  {
+    rec->state = eSD_REINIT;
+    return false;
+  }
+
+  rec->framesKept = SessionPendingSince(rec->sessions, rec->storedAtFailure);
+  rec->framesDropped = rec->sessions->droppedFrames - rec->droppedAtFailure;
+  elapsed = current - rec->failedAt;
+  rec->health->sdRecoveries++;
+  rec->health->sdRecoveryLast = elapsed;
+  if (elapsed > rec->health->sdRecoveryMax)
+  {
+    rec->health->sdRecoveryMax = elapsed;
+  }
+  rec->health->sdOutageFramesKept += rec->framesKept;
+  rec->health->sdOutageFramesDropped += rec->framesDropped;
+  rec->state = eSD_READY;
+  rec->sessions->sdAvailable = true;
+  return true;
+}
+
+/** Gets whether or not a recovery is under way
+ *  @param *rec SD recovery struct
+ *  @return Whether or not the card is out
+ */
+bool SdRecoveryActive(sd_recovery_t *rec)
+{
+  return rec->state != eSD_READY;
+}
+
+/** Prints the result of the last recovery
+ *  e.g. "SD card recovered after 730 ms (3 attempts), 1460 frames kept in RAM, 0 dropped"
+ *  @param *rec SD recovery struct
+ *  @param *out Output
+ */
+void SdRecoveryPrint(sd_recovery_t *rec, Print *out)
+{
+  char line[120];
+  snprintf(line, sizeof(line), "SD card recovered after %lu ms (%lu attempts), %lu frames kept in RAM, %lu dropped",
+           (unsigned long) rec->health->sdRecoveryLast, (unsigned long) rec->attempts, (unsigned long) rec->framesKept, (unsigned long) rec->framesDropped);
+  out->println(line);
+}
@@ -0,0 +1,56 @@
+/*
+  * @file SdRecovery.h
+  *
+  * Brings the SD card back after it failed, one step per main loop pass so nothing waits:
+  * the card is re-initialized, the attack files are opened again and the sessions resume.
+  * The CAN interrupt keeps storing frames in the capture ring the whole time, the sessions
+  * write them once the card is back.
+*/
+
+#ifndef SDRECOVERY_H
+#define SDRECOVERY_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <stdint.h>
+#include <SdFat.h>
+#include "Errors.h"
+#include "Health.h"
+#include "SessionManager.h"
+
+/* DEFINES */
+#define SD_RECOVERY_RETRY_PERIOD      250       // Time (ms) between attempts to re-initialize the SD card
+
+/* ENUMS */
+enum SdRecoveryState_e
+{
+  eSD_READY = 0,                        // Card in use
+  eSD_REINIT,                           // Card failed, re-initialized every SD_RECOVERY_RETRY_PERIOD
+  eSD_REOPEN                            // Card initialized, attack files still to be opened again
+};
+
+/* STRUCTS */
+typedef struct {
+  SdRecoveryState_e state;              // State of the recovery
+  SdFat *sd;                            // SD Card object
+  uint8_t chipSelect;                   // Chip select pin for SD card
+  session_manager_t *sessions;          // Sessions paused while the card is out
+  logger_health_t *health;              // Health counters the recoveries are counted in
+  Error_e cause;                        // Error that started the recovery
+  uint32_t failedAt;                    // Time (millis) the error was flagged
+  uint32_t nextAttempt;                 // Time (millis) of the next attempt
+  uint32_t attempts;                    // Number of times the card was re-initialized during this recovery
+  uint32_t storedAtFailure;             // Value of the capture ring push count when the card failed
+  uint32_t droppedAtFailure;            // Value of droppedFrames when the card failed
+  uint32_t framesKept;                  // Frames of the last outage kept in the capture ring for the sessions
+  uint32_t framesDropped;               // Frames dropped during the last outage
+} sd_recovery_t;
+
+/* FUNCTION PROTOTYPES */
+void SdRecoveryInit(sd_recovery_t *rec, SdFat *sd, uint8_t chipSelect, session_manager_t *sessions, logger_health_t *health);
+void SdRecoveryStart(sd_recovery_t *rec, error_event_t *event);
+bool SdRecoveryService(sd_recovery_t *rec);
+bool SdRecoveryActive(sd_recovery_t *rec);
+void SdRecoveryPrint(sd_recovery_t *rec, Print *out);
+
+#endif // SDRECOVERY_H
@@ -0,0 +1,743 @@
+/*
+  * @file SessionManager.cpp
+  *
+  * Tracks overlapping attack sessions over one shared capture ring
+*/
+
+#include "SessionManager.h"
+#include "Probe.h"
+
+/* CONSTANTS */
+const trigger_rule_t SessionRuleTable[] =
+{
+  {0x7E8, 0x7FF, 0, "Engine ECU UDS Response"},
+  {0x7E9, 0x7FF, 0, "Transmission ECU UDS Response"},
+  {0x765, 0x7FF, 0, "Body Control Module Diagnostic Response"}
+};
+
+const uint8_t SESSION_NUM_RULES = sizeof(SessionRuleTable) / sizeof(SessionRuleTable[0]);
+
+/** Initializes the session manager
+ *  The capacity of the capture ring has to pass SESSION_RING_FITS: a multiple of SESSION_BLOCK_SIZE, at
+ *  most SESSION_MAX_BLOCKS blocks with room for a pre-trigger window and a free block and, so sequence
+ *  numbers stay valid when they wrap, a power of two
+ *  @param *mgr Session manager struct to be initialized
+ *  @param *ring Shared capture ring
+ *  @param *isotp Reassembler the session PDUs are taken from
+ *  @param *sd SD Card object
+ *  @param *directory Directory the session files are written to
+ *  @param *beforeTitle Name of the pre-trigger files
+ *  @param *afterTitle Name of the attack files
+ *  @param *health Health counters of the logger, written to every attack file footer
+ */
+void SessionInit(session_manager_t *mgr, circular_buffer_t *ring, isotp_reassembler_t *isotp, SdFat *sd, char *directory, const char *beforeTitle, const char *afterTitle, logger_health_t *health)
+{
+  uint8_t index = 0;
+
+  mgr->ring = ring;
+  mgr->isotp = isotp;
+  mgr->sd = sd;
+  mgr->directory = directory;
+  mgr->beforeTitle = beforeTitle;
+  mgr->afterTitle = afterTitle;
+  mgr->health = health;
+  assert(SESSION_RING_FITS(ring->capacity));
+  mgr->numBlocks = ring->capacity / SESSION_BLOCK_SIZE;
+  for (index = 0; index < SESSION_MAX_SESSIONS; index++)
+  {
+    mgr->sessions[index].state = eSESSION_FREE;
+  }
+  for (index = 0; index < ISOTP_NUM_PAIRS; index++)
+  {
+    UDSSummaryReset(&mgr->pendingSummary[index]);
+  }
+  memset(mgr->blockRefs, 0, sizeof(mgr->blockRefs));
+  mgr->activeSessions = 0;
+  mgr->nextFileNumber = 1;
+  mgr->sessionCount = 0;
+  mgr->missedTriggers = 0;
+  mgr->droppedFrames = 0;
+  mgr->windowExpired = false;
+  mgr->sdAvailable = true;
+  mgr->eventCallback = NULL;
+  mgr->monitor = NULL;
+}
+
+/** Finds the trigger rule a message matches, an 11 bit rule never matches an extended ID that
+ *  has the same low bits (and the other way round)
+ *  @param *message Message
+ *  @return Index of the rule, SESSION_NO_RULE if the message does not trigger a session
+ */
+uint8_t SessionMatchRule(const can_message_t *message)
+{
+  uint8_t ruleIndex = 0;
+  for (ruleIndex = 0; ruleIndex < SESSION_NUM_RULES; ruleIndex++)
+  {
+    if ((message->ide == SessionRuleTable[ruleIndex].ide) &&
+        ((message->id & SessionRuleTable[ruleIndex].mask) == SessionRuleTable[ruleIndex].id))
+    {
+      return ruleIndex;
+    }
+  }
+  return SESSION_NO_RULE;
+}
+
+/** Gets a trigger rule from the rule table
+ *  @param ruleIndex Index of the rule
+ *  @return Pointer to the rule, NULL if the index is invalid
+ */
+const trigger_rule_t *SessionGetRule(uint8_t ruleIndex)
+{
+  if (ruleIndex >= SESSION_NUM_RULES)
+  {
+    return NULL;
+  }
+  return &SessionRuleTable[ruleIndex];
+}
+
+/** Finds the active session of a trigger rule
+ *  @param *mgr Session manager struct
+ *  @param ruleIndex Index of the rule
+ *  @return Pointer to the session, NULL if the rule has no active session
+ */
+static attack_session_t *SessionFindActive(session_manager_t *mgr, uint8_t ruleIndex)
+{
+  uint8_t index = 0;
+  for (index = 0; index < SESSION_MAX_SESSIONS; index++)
+  {
+    if ((mgr->sessions[index].state == eSESSION_ACTIVE) && (mgr->sessions[index].ruleIndex == ruleIndex))
+    {
+      return &mgr->sessions[index];
+    }
+  }
+  return NULL;
+}
+
+/** Opens a session for a trigger message that has just been pushed onto the capture ring
+ *  The session pins the current block and the SESSION_PRE_TRIGGER_BLOCKS complete blocks before it,
+ *  the block after the current one stays free so frames keep being stored while the session writes
+ *  @param *mgr Session manager struct
+ *  @param ruleIndex Index of the rule the message matched
+ *  @param *message Trigger message
+ *  @param sequence Sequence number of the trigger message
+ */
+static void SessionOpen(session_manager_t *mgr, uint8_t ruleIndex, can_message_t *message, uint32_t sequence)
+{
+  attack_session_t *session = NULL;
+  uds_summary_t *pending = NULL;
+  IsoTpDirection_e direction;
+  uint32_t headBlock = sequence / SESSION_BLOCK_SIZE;
+  uint32_t startBlock = 0;
+  uint32_t block = 0;
+  uint8_t index = 0;
+
+  for (index = 0; index < SESSION_MAX_SESSIONS; index++)
+  {
+    if (mgr->sessions[index].state == eSESSION_FREE)
+    {
+      session = &mgr->sessions[index];
+      break;
+    }
+  }
+  if (session == NULL)
+  {
+    mgr->missedTriggers++;
+    return;
+  }
+
+  if (headBlock >= SESSION_PRE_TRIGGER_BLOCKS(mgr->numBlocks))
+  {
+    startBlock = headBlock - SESSION_PRE_TRIGGER_BLOCKS(mgr->numBlocks);
+  }
+  for (block = startBlock; block <= headBlock; block++)
+  {
+    mgr->blockRefs[block % mgr->numBlocks]++;
+  }
+
+  session->ruleIndex = ruleIndex;
+  session->pairIndex = IsoTpFindPair(SessionRuleTable[ruleIndex].id, &direction);
+  session->beforeWritten = false;
+  session->fileNumber = mgr->nextFileNumber++;
+  session->startSeq = startBlock * SESSION_BLOCK_SIZE;
+  session->triggerSeq = sequence;
+  session->writtenSeq = session->startSeq;
+  session->endSeq = 0;
+  session->startTimestamp = CircularBufferAt(mgr->ring, session->startSeq)->timestamp;
+  session->lastTriggerTimestamp = message->timestamp;
+  session->numTriggerMessages = 1;
+  session->droppedFramesAtStart = mgr->droppedFrames;
+  session->droppedPdusAtStart = mgr->isotp->droppedPdus;
+  session->abortedReassembliesAtStart = mgr->isotp->abortedReassemblies;
+  session->fileSize = 0;
+  UDSSummaryReset(&session->summary);
+
+  // diagnostic traffic leading up to the trigger (e.g. the request it answers) belongs to the session
+  if (session->pairIndex != ISOTP_NO_PAIR)
+  {
+    pending = &mgr->pendingSummary[session->pairIndex];
+    if ((message->timestamp - pending->lastTimestamp) <= UDS_SUMMARY_IDLE_TIMEOUT)
+    {
+      memcpy(&session->summary, pending, sizeof(uds_summary_t));
+    }
+    UDSSummaryReset(pending);
+  }
+
+  session->state = eSESSION_ACTIVE;
+  mgr->activeSessions++;
+  mgr->sessionCount++;
+  if (mgr->eventCallback != NULL)
+  {
+    mgr->eventCallback(session, eSESSION_EVENT_OPEN);
+  }
+}
+
+/** Updates the high-water mark of the capture ring, the most frames a session still has to write
+ *  Called from the CAN callback once per block
+ *  @param *mgr Session manager struct
+ *  @param sequence Sequence number of the frame being stored
+ */
+static void SessionUpdateHighWater(session_manager_t *mgr, uint32_t sequence)
+{
+  attack_session_t *session = NULL;
+  uint32_t pending = 0;
+  uint8_t index = 0;
+  for (index = 0; index < SESSION_MAX_SESSIONS; index++)
+  {
+    session = &mgr->sessions[index];
+    if (session->state == eSESSION_FREE)
+    {
+      continue;
+    }
+    pending = sequence - (session->beforeWritten ? session->writtenSeq : session->startSeq);
+    if (pending > mgr->health->ringHighWater)
+    {
+      mgr->health->ringHighWater = pending;
+    }
+  }
+}
+
+/** Stores a message in the capture ring and opens or extends the session of the rule it matches
+ *  Called from the CAN callback. A message that would start reusing a block still pinned by a session
+ *  is dropped rather than overwriting frames that have not been written yet.
+ *  @param *mgr Session manager struct
+ *  @param *message Received message
+ *  @return Whether or not the message was stored
+ */
+bool SessionProcessMessage(session_manager_t *mgr, can_message_t *message)
+{
+  uint32_t sequence = mgr->ring->pushCount;
+  uint8_t block = 0;
+  uint8_t ruleIndex = 0;
+  attack_session_t *session = NULL;
+
+  if ((sequence % SESSION_BLOCK_SIZE) == 0)
+  {
+    block = (sequence / SESSION_BLOCK_SIZE) % mgr->numBlocks;
+    if (mgr->blockRefs[block] > 0)
+    {
+      mgr->droppedFrames++;
+      mgr->health->ringHighWater = mgr->ring->capacity;
+      if (mgr->health->flushing)
+      {
+        mgr->health->droppedWhileFlushing++;
+      }
+      return false;
+    }
+    mgr->blockRefs[block] = mgr->activeSessions; // every active session records the new block
+    SessionUpdateHighWater(mgr, sequence);
+  }
+  CircularBufferPush(mgr->ring, message);
+
+  ruleIndex = SessionMatchRule(message);
+  if (ruleIndex != SESSION_NO_RULE)
+  {
+    session = SessionFindActive(mgr, ruleIndex);
+    if (session != NULL)
+    {
+      session->numTriggerMessages++;
+      session->lastTriggerTimestamp = message->timestamp;
+    }
+    else
+    {
+      SessionOpen(mgr, ruleIndex, message, sequence);
+    }
+  }
+  return true;
+}
+
+/** Decodes a reassembled diagnostic PDU and adds it to the summary of the session of its pair
+ *  PDUs of a pair without an active session are kept in a pending summary that the next session
+ *  of the pair adopts, unless the pair has been idle for longer than UDS_SUMMARY_IDLE_TIMEOUT
+ *  @param *mgr Session manager struct
+ *  @param *pdu Reassembled PDU
+ */
+void SessionTrackPdu(session_manager_t *mgr, isotp_pdu_t *pdu)
+{
+  uds_decoded_t decoded;
+  uds_summary_t *summary = NULL;
+  uint16_t stored = (pdu->length > ISOTP_MAX_PDU_SIZE) ? ISOTP_MAX_PDU_SIZE : pdu->length;
+  uint8_t index = 0;
+
+  if (pdu->pairIndex >= ISOTP_NUM_PAIRS)
+  {
+    return;
+  }
+  if (!UDSDecode(pdu->data, stored, (pdu->direction == eISOTP_DIR_RESPONSE), &decoded))
+  {
+    return;
+  }
+
+  for (index = 0; index < SESSION_MAX_SESSIONS; index++)
+  {
+    if ((mgr->sessions[index].state == eSESSION_ACTIVE) && (mgr->sessions[index].pairIndex == pdu->pairIndex))
+    {
+      summary = &mgr->sessions[index].summary;
+      break;
+    }
+  }
+  if (summary == NULL)
+  {
+    summary = &mgr->pendingSummary[pdu->pairIndex];
+    if ((pdu->timestamp - summary->lastTimestamp) > UDS_SUMMARY_IDLE_TIMEOUT)
+    {
+      UDSSummaryReset(summary);
+    }
+  }
+  UDSSummaryUpdate(summary, &decoded, pdu->timestamp);
+}
+
+/** Flags the end of a session window so the main loop can close the session, even if no more frames arrive
+ *  Called from the window timer
+ *  @param *mgr Session manager struct
+ */
+void SessionCheckWindows(session_manager_t *mgr)
+{
+  uint8_t index = 0;
+  for (index = 0; index < SESSION_MAX_SESSIONS; index++)
+  {
+    if ((mgr->sessions[index].state == eSESSION_ACTIVE) &&
+        ((millis() - mgr->sessions[index].lastTriggerTimestamp) >= SESSION_POST_TRIGGER_WINDOW))
+    {
+      mgr->windowExpired = true;
+    }
+  }
+}
+
+/** Marks frames of a session as written and releases every block the session has finished
+ *  @param *mgr Session manager struct
+ *  @param *session Session
+ *  @param sequence Sequence number of the next frame to be written
+ */
+static void SessionAdvance(session_manager_t *mgr, attack_session_t *session, uint32_t sequence)
+{
+  SESSION_LOCK();
+  while ((session->writtenSeq / SESSION_BLOCK_SIZE) != (sequence / SESSION_BLOCK_SIZE))
+  {
+    mgr->blockRefs[(session->writtenSeq / SESSION_BLOCK_SIZE) % mgr->numBlocks]--;
+    session->writtenSeq = ((session->writtenSeq / SESSION_BLOCK_SIZE) + 1) * SESSION_BLOCK_SIZE;
+  }
+  session->writtenSeq = sequence;
+  SESSION_UNLOCK();
+}
+
+/** Opens a session file and counts the open in the health counters
+ *  A file that cannot be opened stops every session write until the SD card has been recovered
+ *  @param *mgr Session manager struct
+ *  @param *filePath Path of the file
+ *  @param *fileName Name of a new file, NULL to append to an existing file
+ *  @return Whether or not the file was opened
+ */
+static bool SessionOpenFile(session_manager_t *mgr, char *filePath, char *fileName)
+{
+  bool opened = false;
+
+  mgr->file.clearWriteError();
+  opened = (fileName != NULL) ? OpenNewDataFile(&mgr->file, filePath, fileName) : OpenDataFile(&mgr->file, filePath);
+  if (opened)
+  {
+    mgr->health->fileOpens++;
+  }
+  else
+  {
+    mgr->health->fileOpenFailures++;
+    mgr->sdAvailable = false;
+  }
+  if (mgr->monitor != NULL)
+  {
+    SdMonitorReport(mgr->monitor, opened);
+  }
+  return opened;
+}
+
+/** Closes the session file and counts the close in the health counters
+ *  A failed write stops every session write until the SD card has been recovered
+ *  @param *mgr Session manager struct
+ *  @return Whether or not everything written since the file was opened reached the card
+ */
+static bool SessionCloseFile(session_manager_t *mgr)
+{
+  bool written = !mgr->file.getWriteError();
+  written = mgr->file.close() && written;
+  mgr->health->fileCloses++;
+  if (!written)
+  {
+    HandleError(eERR_SD_FAILED_WRITE);
+    mgr->sdAvailable = false;
+  }
+  if (mgr->monitor != NULL)
+  {
+    SdMonitorReport(mgr->monitor, written);
+  }
+  return written;
+}
+
+/** Writes the queued PDUs of the session pair to the open session file
+ *  @param *mgr Session manager struct
+ *  @param *session Session
+ */
+static void SessionWritePdus(session_manager_t *mgr, attack_session_t *session)
+{
+  isotp_pdu_t pdu;
+  bool popped = false;
+
+  if (session->pairIndex == ISOTP_NO_PAIR)
+  {
+    return;
+  }
+  do
+  {
+    SESSION_LOCK();
+    popped = IsoTpPopPairPdu(mgr->isotp, session->pairIndex, session->startTimestamp, &pdu);
+    SESSION_UNLOCK();
+    if (popped)
+    {
+      FileWritePdu(&pdu, &mgr->file);
+    }
+  } while (popped);
+}
+
+/** Writes the pre-trigger file of a session and creates its attack file
+ *  Nothing is marked as written unless both files made it to the card, a retry starts them over
+ *  @param *mgr Session manager struct
+ *  @param *session Session
+ *  @return Whether or not the files were written
+ */
+static bool SessionWriteBefore(session_manager_t *mgr, attack_session_t *session)
+{
+  char filePath[FILE_PATH_SIZE];
+  char fileName[FILE_NAME_SIZE];
+  uint32_t fileSize = 0;
+  bool written = false;
+
+  if (!mgr->sd->exists(mgr->directory) && !MakeDirectory(mgr->directory, mgr->sd)) // create a new directory after the first attack starts
+  {
+    mgr->sdAvailable = false;
+    return false;
+  }
+
+  SetFileNameAndPath(filePath, fileName, mgr->directory, mgr->beforeTitle, session->fileNumber, FILE_NAME_SIZE, FILE_PATH_SIZE);
+  if (!SessionOpenFile(mgr, filePath, fileName))
+  {
+    return false;
+  }
+  HealthSdWriteBegin(mgr->health);
+  {
+    PROBE_SCOPE(ePROBE_SD_FLUSH);
+    CircularBufferDumpRangeToFile(mgr->ring, session->startSeq, session->triggerSeq, &mgr->file);
+    SessionWritePdus(mgr, session);
+    written = SessionCloseFile(mgr);
+  }
+  HealthSdWriteEnd(mgr->health);
+  if (!written)
+  {
+    return false;
+  }
+
+  SetFileNameAndPath(filePath, fileName, mgr->directory, mgr->afterTitle, session->fileNumber, FILE_NAME_SIZE, FILE_PATH_SIZE);
+  if (!SessionOpenFile(mgr, filePath, fileName))
+  {
+    return false;
+  }
+  fileSize = mgr->file.fileSize();
+  if (!SessionCloseFile(mgr))
+  {
+    return false;
+  }
+  session->fileSize = fileSize;
+  SessionAdvance(mgr, session, session->triggerSeq);
+  session->beforeWritten = true;
+  return true;
+}
+
+/** Appends the frames of a session up to a sequence number to its attack file
+ *  Frames of a failed write stay pinned in the ring and are written again once the card is back
+ *  @param *mgr Session manager struct
+ *  @param *session Session
+ *  @param endSeq Sequence number one past the last frame to be written
+ *  @return Whether or not the frames were written
+ */
+static bool SessionWriteFrames(session_manager_t *mgr, attack_session_t *session, uint32_t endSeq)
+{
+  char filePath[FILE_PATH_SIZE];
+  char fileName[FILE_NAME_SIZE];
+  uint32_t fileSize = 0;
+  bool written = false;
+
+  if ((int32_t)(endSeq - session->writtenSeq) <= 0)
+  {
+    return true;
+  }
+  SetFileNameAndPath(filePath, fileName, mgr->directory, mgr->afterTitle, session->fileNumber, FILE_NAME_SIZE, FILE_PATH_SIZE);
+  if ((endSeq - session->writtenSeq) > mgr->health->backlogHighWater)
+  {
+    mgr->health->backlogHighWater = endSeq - session->writtenSeq;
+  }
+  if (!SessionOpenFile(mgr, filePath, NULL))
+  {
+    return false;
+  }
+  HealthSdWriteBegin(mgr->health);
+  {
+    PROBE_SCOPE(ePROBE_SD_FLUSH);
+    CircularBufferDumpRangeToFile(mgr->ring, session->writtenSeq, endSeq, &mgr->file);
+    SessionWritePdus(mgr, session);
+    fileSize = mgr->file.fileSize();
+    written = SessionCloseFile(mgr);
+  }
+  HealthSdWriteEnd(mgr->health);
+  if (!written)
+  {
+    return false;
+  }
+  session->fileSize = fileSize;
+  SessionAdvance(mgr, session, endSeq);
+  return true;
+}
+
+/** Writes the footer and attack summary of a closing session and frees its slot
+ *  A session whose footer could not be written stays closing and is tried again
+ *  @param *mgr Session manager struct
+ *  @param *session Session
+ */
+static void SessionClose(session_manager_t *mgr, attack_session_t *session)
+{
+  char filePath[FILE_PATH_SIZE];
+  char fileName[FILE_NAME_SIZE];
+  char footerString[80];
+  bool written = false;
+
+  SetFileNameAndPath(filePath, fileName, mgr->directory, mgr->afterTitle, session->fileNumber, FILE_NAME_SIZE, FILE_PATH_SIZE);
+  if (!SessionOpenFile(mgr, filePath, NULL))
+  {
+    return;
+  }
+  HealthSdWriteBegin(mgr->health);
+  snprintf(footerString, sizeof(footerString), "\nUDS Messages Recorded: %lu", (unsigned long) session->numTriggerMessages);
+  mgr->file.println(footerString);
+  snprintf(footerString, sizeof(footerString), "Recorded After Last UDS Message: %lu ms", (unsigned long)(millis() - session->lastTriggerTimestamp));
+  mgr->file.println(footerString);
+  snprintf(footerString, sizeof(footerString), "Trigger: %s", SessionRuleTable[session->ruleIndex].name);
+  mgr->file.println(footerString);
+  snprintf(footerString, sizeof(footerString), "Frames Dropped While Recording: %lu", (unsigned long)(mgr->droppedFrames - session->droppedFramesAtStart));
+  mgr->file.println(footerString);
+  snprintf(footerString, sizeof(footerString), "ISO-TP PDUs Dropped While Recording: %lu", (unsigned long)(mgr->isotp->droppedPdus - session->droppedPdusAtStart));
+  mgr->file.println(footerString);
+  snprintf(footerString, sizeof(footerString), "ISO-TP Reassemblies Aborted While Recording: %lu",
+           (unsigned long)(mgr->isotp->abortedReassemblies - session->abortedReassembliesAtStart));
+  mgr->file.println(footerString);
+  FileWriteAttackSummary(&session->summary, &mgr->file);
+  HealthPrint(mgr->health, &mgr->file);
+  written = SessionCloseFile(mgr);
+  HealthSdWriteEnd(mgr->health);
+  if (!written)
+  {
+    return;
+  }
+  if (mgr->eventCallback != NULL)
+  {
+    mgr->eventCallback(session, eSESSION_EVENT_CLOSE);
+  }
+
+  SESSION_LOCK();
+  if ((session->endSeq % SESSION_BLOCK_SIZE) != 0) // the block the session ended in is still pinned
+  {
+    mgr->blockRefs[(session->endSeq / SESSION_BLOCK_SIZE) % mgr->numBlocks]--;
+  }
+  session->state = eSESSION_FREE;
+  SESSION_UNLOCK();
+}
+
+/** Writes pending session data to the SD Card and closes the sessions whose window has elapsed
+ *  Called from the main loop. Open sessions are written a whole block at a time, the CAN callback is
+ *  only held off while the session bookkeeping is updated. Windows end only after the window timer
+ *  has flagged them (SessionCheckWindows), a flag cleared here before the timer sees a session that
+ *  is still running over its window is set again on the next timer tick.
+ *  @param *mgr Session manager struct
+ */
+void SessionService(session_manager_t *mgr)
+{
+  attack_session_t *session = NULL;
+  uint32_t endSeq = 0;
+  uint8_t index = 0;
+  bool windowExpired = mgr->windowExpired;
+
+  mgr->windowExpired = false;
+  for (index = 0; index < SESSION_MAX_SESSIONS; index++)
+  {
+    session = &mgr->sessions[index];
+    if (session->state == eSESSION_FREE)
+    {
+      continue;
+    }
+
+    SESSION_LOCK();
+    if (windowExpired && (session->state == eSESSION_ACTIVE) &&
+        ((millis() - session->lastTriggerTimestamp) >= SESSION_POST_TRIGGER_WINDOW))
+    {
+      session->state = eSESSION_CLOSING;
+      session->endSeq = mgr->ring->pushCount;
+      mgr->activeSessions--;
+    }
+    if (session->state == eSESSION_CLOSING)
+    {
+      endSeq = session->endSeq;
+    }
+    else
+    {
+      endSeq = mgr->ring->pushCount - (mgr->ring->pushCount % SESSION_BLOCK_SIZE);
+    }
+    SESSION_UNLOCK();
+
+    if (!mgr->sdAvailable) // frames stay pinned in the ring until the SD card is back
+    {
+      continue;
+    }
+    if (!session->beforeWritten && !SessionWriteBefore(mgr, session))
+    {
+      continue;
+    }
+    if (!SessionWriteFrames(mgr, session, endSeq))
+    {
+      continue;
+    }
+    if (session->state == eSESSION_CLOSING)
+    {
+      SessionClose(mgr, session);
+    }
+  }
+}
+
+/** Gets the number of sessions that have not been closed yet
+ *  @param *mgr Session manager struct
+ *  @return Number of active and closing sessions
+ */
+uint8_t SessionActiveCount(session_manager_t *mgr)
+{
+  uint8_t count = 0;
+  uint8_t index = 0;
+  for (index = 0; index < SESSION_MAX_SESSIONS; index++)
+  {
+    if (mgr->sessions[index].state != eSESSION_FREE)
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+/** Counts the frames stored since a sequence number that sessions still have to write
+ *  @param *mgr Session manager struct
+ *  @param sequence Sequence number
+ *  @return Number of frames from the sequence number on pinned by a session
+ */
+uint32_t SessionPendingSince(session_manager_t *mgr, uint32_t sequence)
+{
+  attack_session_t *session = NULL;
+  uint32_t first = 0;
+  uint32_t end = 0;
+  uint32_t pending = 0;
+  uint8_t index = 0;
+
+  SESSION_LOCK();
+  for (index = 0; index < SESSION_MAX_SESSIONS; index++)
+  {
+    session = &mgr->sessions[index];
+    if (session->state == eSESSION_FREE)
+    {
+      continue;
+    }
+    first = session->beforeWritten ? session->writtenSeq : session->startSeq;
+    if ((int32_t)(sequence - first) > 0)
+    {
+      first = sequence;
+    }
+    end = (session->state == eSESSION_CLOSING) ? session->endSeq : mgr->ring->pushCount;
+    if (((int32_t)(end - first) > 0) && ((end - first) > pending))
+    {
+      pending = end - first;
+    }
+  }
+  SESSION_UNLOCK();
+  return pending;
+}
+
+/** Opens the attack file of every session again after the SD card was re-initialized
+ *  Anything a failed write left at the end of a file is cut off, so every session goes on right
+ *  after its last good write. Called by the SD recovery, errors are left to it.
+ *  @param *mgr Session manager struct
+ *  @return Whether or not every attack file could be opened
+ */
+bool SessionReopenFiles(session_manager_t *mgr)
+{
+  char filePath[FILE_PATH_SIZE];
+  char fileName[FILE_NAME_SIZE];
+  attack_session_t *session = NULL;
+  bool reopened = true;
+  uint8_t index = 0;
+
+  if ((SessionActiveCount(mgr) > 0) && !mgr->sd->exists(mgr->directory) && !mgr->sd->mkdir(mgr->directory))
+  {
+    return false;
+  }
+  for (index = 0; index < SESSION_MAX_SESSIONS; index++)
+  {
+    session = &mgr->sessions[index];
+    if ((session->state == eSESSION_FREE) || !session->beforeWritten)
+    {
+      continue;
+    }
+    SetFileNameAndPath(filePath, fileName, mgr->directory, mgr->afterTitle, session->fileNumber, FILE_NAME_SIZE, FILE_PATH_SIZE);
+    if (!mgr->file.open(filePath, O_RDWR | O_CREAT | O_AT_END))
+    {
+      return false;
+    }
+    if (mgr->file.fileSize() > session->fileSize)
+    {
+      reopened = mgr->file.truncate(session->fileSize);
+    }
+    reopened = mgr->file.close() && reopened;
+    if (!reopened)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/** Registers the function called when a session opens (from the CAN callback) or closes (from the main loop)
+ *  @param *mgr Session manager struct
+ *  @param callback Function to be called, NULL for none
+ */
+void SessionRegisterCallback(session_manager_t *mgr, SessionEventCallback callback)
+{
+  mgr->eventCallback = callback;
+}
+
+/** Sets the SD monitor told the result of every file open and close, so the card does not have to be probed while sessions write
+ *  @param *mgr Session manager struct
+ *  @param *monitor SD monitor, NULL for none
+ */
+void SessionSetMonitor(session_manager_t *mgr, sd_monitor_t *monitor)
+{
+  mgr->monitor = monitor;
+}
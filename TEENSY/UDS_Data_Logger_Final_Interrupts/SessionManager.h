@@ -0,0 +1,121 @@
+/*
+  * @file SessionManager.h
+  *
+  * Tracks overlapping attack sessions over one shared capture ring. Every session pins the ring
+  * blocks it still has to write with a reference count, so frames are stored once no matter how
+  * many sessions record them.
+*/
+
+#ifndef SESSIONMANAGER_H
+#define SESSIONMANAGER_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include "CircularBuffer.h"
+#include "CANMessage.h"
+#include "SDCard.h"
+#include "IsoTp.h"
+#include "UDSDecoder.h"
+#include "Health.h"
+#include "SdMonitor.h"
+
+/* DEFINES */
+#define SESSION_MAX_SESSIONS          4         // Maximum number of attack sessions recorded at the same time
+#define SESSION_BLOCK_SIZE            256       // Number of frames per capture ring block, the unit sessions pin
+#define SESSION_MAX_BLOCKS            16        // Maximum number of blocks in the capture ring
+#define SESSION_MIN_BLOCKS            3         // Fewest blocks in the capture ring: a complete pre-trigger block, the trigger block and a free block
+#define SESSION_PRE_TRIGGER_BLOCKS(numBlocks)  ((uint32_t)(numBlocks) - 2)  // Complete blocks before the trigger block a session records, one block stays free for the CAN callback
+#define SESSION_RING_FITS(capacity)   ((((capacity) % SESSION_BLOCK_SIZE) == 0) && (((capacity) & ((capacity) - 1)) == 0) && \
+                                       (((capacity) / SESSION_BLOCK_SIZE) >= SESSION_MIN_BLOCKS) && (((capacity) / SESSION_BLOCK_SIZE) <= SESSION_MAX_BLOCKS))
+#define SESSION_POST_TRIGGER_WINDOW   5000      // Time (ms) recorded after the last trigger message of a session
+#define SESSION_NO_RULE               0xFF      // Rule index of a message that does not match a trigger rule
+
+#define SESSION_LOCK()                NVIC_DISABLE_IRQ(IRQ_CAN_MESSAGE)  // Keeps the CAN callback out of session bookkeeping
+#define SESSION_UNLOCK()              NVIC_ENABLE_IRQ(IRQ_CAN_MESSAGE)
+
+/* ENUMS */
+enum SessionState_e
+{
+  eSESSION_FREE = 0,
+  eSESSION_ACTIVE,                      // Recording, extended by every trigger message
+  eSESSION_CLOSING                      // Window elapsed, remaining frames and footer still to be written
+};
+
+enum SessionEvent_e
+{
+  eSESSION_EVENT_OPEN = 1,              // Session opened by a trigger message, reported from the CAN callback
+  eSESSION_EVENT_CLOSE                  // Session files closed, reported from the main loop
+};
+
+/* STRUCTS */
+typedef struct {
+  uint32_t id;                          // Arbitration ID that triggers a session
+  uint32_t mask;                        // Bits of the arbitration ID that have to match
+  uint8_t ide;                          // ID Extended bit the trigger message has: 1 - extended (29 bit) ID, 0 - standard (11 bit) ID
+  const char *name;                     // Name written to the attack file
+} trigger_rule_t;
+
+typedef struct {
+  SessionState_e state;                 // State of the session
+  uint8_t ruleIndex;                    // Trigger rule that opened the session
+  uint8_t pairIndex;                    // Diagnostic ID pair of the trigger rule, ISOTP_NO_PAIR if none
+  bool beforeWritten;                   // Whether or not the pre-trigger file has been written
+  uint32_t fileNumber;                  // Number of the session files
+  uint32_t startSeq;                    // Sequence number of the oldest frame in the pre-trigger file
+  uint32_t triggerSeq;                  // Sequence number of the frame that opened the session
+  uint32_t writtenSeq;                  // Sequence number of the next frame to be written
+  uint32_t endSeq;                      // Sequence number one past the last frame of the session (closing only)
+  uint32_t startTimestamp;              // Timestamp of the oldest frame in the pre-trigger file
+  uint32_t lastTriggerTimestamp;        // Timestamp of the last trigger message, the post-trigger window starts here
+  uint32_t numTriggerMessages;          // Number of trigger messages in the session
+  uint32_t droppedFramesAtStart;        // Value of droppedFrames when the session was opened
+  uint32_t droppedPdusAtStart;          // Value of the ISO-TP droppedPdus when the session was opened
+  uint32_t abortedReassembliesAtStart;  // Value of the ISO-TP abortedReassemblies when the session was opened
+  uint32_t fileSize;                    // Bytes of the attack file known to be on the card, a failed write is cut back to this
+  uds_summary_t summary;                // Decoded diagnostic services of the session
+} attack_session_t;
+
+typedef void (*SessionEventCallback)(const attack_session_t *session, SessionEvent_e event);
+
+typedef struct {
+  circular_buffer_t *ring;                          // Shared capture ring
+  isotp_reassembler_t *isotp;                       // Reassembler the session PDUs are taken from
+  SdFat *sd;                                        // SD Card object
+  SdFile file;                                      // File object used for session writes
+  logger_health_t *health;                          // Health counters of the logger
+  char *directory;                                  // Directory the session files are written to
+  const char *beforeTitle;                          // Name of the pre-trigger files
+  const char *afterTitle;                           // Name of the attack files
+  attack_session_t sessions[SESSION_MAX_SESSIONS];  // Session slots
+  uds_summary_t pendingSummary[ISOTP_NUM_PAIRS];    // Diagnostic traffic of each pair seen while no session was open
+  uint8_t blockRefs[SESSION_MAX_BLOCKS];            // Number of sessions that still have to write each ring block
+  uint8_t numBlocks;                                // Number of blocks in the capture ring
+  uint8_t activeSessions;                           // Number of sessions in the active state
+  uint32_t nextFileNumber;                          // Number of the next session files
+  uint32_t sessionCount;                            // Number of sessions opened
+  uint32_t missedTriggers;                          // Number of sessions not opened because every slot was in use
+  uint32_t droppedFrames;                           // Number of frames not stored because the next block was still pinned
+  volatile bool windowExpired;                      // Set by the window timer when a session window has elapsed
+  bool sdAvailable;                                 // Whether or not the SD card can be written, sessions keep their frames in the ring while it cannot
+  SessionEventCallback eventCallback;               // Called when a session opens or closes, NULL if none
+  sd_monitor_t *monitor;                            // Told the result of every file open and close, NULL if none
+} session_manager_t;
+
+/* FUNCTION PROTOTYPES */
+void SessionInit(session_manager_t *mgr, circular_buffer_t *ring, isotp_reassembler_t *isotp, SdFat *sd, char *directory, const char *beforeTitle, const char *afterTitle, logger_health_t *health);
+uint8_t SessionMatchRule(const can_message_t *message);
+const trigger_rule_t *SessionGetRule(uint8_t ruleIndex);
+bool SessionProcessMessage(session_manager_t *mgr, can_message_t *message);
+void SessionTrackPdu(session_manager_t *mgr, isotp_pdu_t *pdu);
+void SessionCheckWindows(session_manager_t *mgr);
+void SessionService(session_manager_t *mgr);
+uint8_t SessionActiveCount(session_manager_t *mgr);
+uint32_t SessionPendingSince(session_manager_t *mgr, uint32_t sequence);
+bool SessionReopenFiles(session_manager_t *mgr);
+void SessionRegisterCallback(session_manager_t *mgr, SessionEventCallback callback);
+void SessionSetMonitor(session_manager_t *mgr, sd_monitor_t *monitor);
+
+#endif // SESSIONMANAGER_H
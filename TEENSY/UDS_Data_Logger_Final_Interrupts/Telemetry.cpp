@@ -0,0 +1,422 @@
+/*
+  * @file Telemetry.cpp
+  *
+  * Binary live telemetry over USB serial, COBS framed
+*/
+
+/* INCLUDES */
+#include "Telemetry.h"
+#include "Probe.h"
+#include <string.h>
+
+/** Writes a 32 bit number little endian
+ *  @param *cursor Position to be written, moved past the number
+ *  @param value Number
+ */
+static void TelemetryPut32(uint8_t **cursor, uint32_t value)
+{
+  (*cursor)[0] = (uint8_t) value;
+  (*cursor)[1] = (uint8_t)(value >> 8);
+  (*cursor)[2] = (uint8_t)(value >> 16);
+  (*cursor)[3] = (uint8_t)(value >> 24);
+  *cursor += 4;
+}
+
+/** Reads a 32 bit number little endian
+ *  @param **cursor Position to be read, moved past the number
+ *  @return Number
+ */
+static uint32_t TelemetryGet32(const uint8_t **cursor)
+{
+  uint32_t value = (uint32_t)(*cursor)[0] | ((uint32_t)(*cursor)[1] << 8) | ((uint32_t)(*cursor)[2] << 16) | ((uint32_t)(*cursor)[3] << 24);
+  *cursor += 4;
+  return value;
+}
+
+/** Gets the next free slot of the record ring
+ *  @param *tm Telemetry struct
+ *  @return Slot, NULL if the ring is full
+ */
+static telemetry_record_t *TelemetryClaim(telemetry_t *tm)
+{
+  if ((tm->head - tm->tail) >= TELEMETRY_RING_SIZE)
+  {
+    return NULL;
+  }
+  return &tm->records[tm->head & (TELEMETRY_RING_SIZE - 1)];
+}
+
+/** Hands the slot returned by TelemetryClaim to the main loop
+ *  @param *tm Telemetry struct
+ */
+static void TelemetryPublish(telemetry_t *tm)
+{
+  HEALTH_BARRIER(); // the record has to be complete before the main loop can see it
+  tm->head = tm->head + 1;
+}
+
+/** Makes room at the end of the TX buffer by moving the bytes not sent yet to the front
+ *  @param *tm Telemetry struct
+ *  @return Number of free bytes
+ */
+static uint16_t TelemetryCompact(telemetry_t *tm)
+{
+  if (tm->txOffset > 0)
+  {
+    memmove(tm->tx, tm->tx + tm->txOffset, tm->txLength - tm->txOffset);
+    tm->txLength -= tm->txOffset;
+    tm->txOffset = 0;
+  }
+  return TELEMETRY_TX_SIZE - tm->txLength;
+}
+
+/** Appends a packet to the TX buffer, the caller makes sure TELEMETRY_MAX_PACKET bytes are free
+ *  @param *tm Telemetry struct
+ *  @param type TelemetryType_e
+ *  @param *payload Payload
+ *  @param length Number of payload bytes
+ */
+static void TelemetryAppendPacket(telemetry_t *tm, uint8_t type, const uint8_t *payload, uint8_t length)
+{
+  uint8_t raw[TELEMETRY_HEALTH_SIZE + 3];
+  uint16_t check = 0;
+
+  raw[0] = type;
+  memcpy(raw + 1, payload, length);
+  check = TelemetryChecksum(raw, length + 1);
+  raw[length + 1] = (uint8_t) check;
+  raw[length + 2] = (uint8_t)(check >> 8);
+  tm->txLength += CobsEncode(raw, length + 3, tm->tx + tm->txLength);
+  tm->tx[tm->txLength++] = 0;
+  tm->packetsSent++;
+}
+
+/** Initializes the telemetry stream, disabled until TelemetryEnable
+ *  @param *tm Telemetry struct to be initialized
+ */
+void TelemetryInit(telemetry_t *tm)
+{
+  memset(tm, 0, sizeof(telemetry_t));
+}
+
+/** Starts or stops queuing records
+ *  A stream that starts with a delimiter lets the receiver drop whatever it got before (e.g. text)
+ *  @param *tm Telemetry struct
+ *  @param enabled Whether or not records are queued
+ */
+void TelemetryEnable(telemetry_t *tm, bool enabled)
+{
+  if (enabled && !tm->enabled)
+  {
+    tm->tail = tm->head;
+    if (TelemetryCompact(tm) > 0)
+    {
+      tm->tx[tm->txLength++] = 0;
+    }
+    tm->lastHealth = millis() - TELEMETRY_HEALTH_PERIOD; // health right away
+  }
+  tm->enabled = enabled;
+}
+
+/** Queues a frame record, called from the CAN callback
+ *  The frame is dropped and counted if the ring is full, capture never waits for the USB port
+ *  @param *tm Telemetry struct
+ *  @param *message Received message
+ */
+void TelemetryPushFrame(telemetry_t *tm, const can_message_t *message)
+{
+  telemetry_record_t *record = NULL;
+  uint8_t *cursor = NULL;
+  uint8_t len = (message->len > 8) ? 8 : message->len;
+
+  if (!tm->enabled)
+  {
+    return;
+  }
+  record = TelemetryClaim(tm);
+  if (record == NULL)
+  {
+    tm->framesDropped++;
+    return;
+  }
+  cursor = record->payload;
+  TelemetryPut32(&cursor, message->timestamp);
+  TelemetryPut32(&cursor, message->ide ? (message->id | TELEMETRY_ID_EXTENDED) : message->id);
+  *cursor++ = len;
+  memcpy(cursor, message->data, len);
+  record->type = eTELEMETRY_FRAME;
+  record->length = 9 + len;
+  tm->framesQueued++;
+  TelemetryPublish(tm);
+}
+
+/** Queues a trigger record for a session that opened or closed
+ *  @param *tm Telemetry struct
+ *  @param *session Session
+ *  @param event Whether the session opened or closed
+ *  @param lock Whether or not the CAN interrupt has to be held off (records queued by the main loop)
+ */
+void TelemetryPushTrigger(telemetry_t *tm, const attack_session_t *session, SessionEvent_e event, bool lock)
+{
+  telemetry_record_t *record = NULL;
+  uint8_t *cursor = NULL;
+  const trigger_rule_t *rule = NULL;
+
+  if (!tm->enabled)
+  {
+    return;
+  }
+  if (lock)
+  {
+    TELEMETRY_LOCK();
+  }
+  record = TelemetryClaim(tm);
+  if (record == NULL)
+  {
+    tm->eventsDropped++;
+  }
+  else
+  {
+    cursor = record->payload;
+    TelemetryPut32(&cursor, session->lastTriggerTimestamp);
+    rule = SessionGetRule(session->ruleIndex);
+    TelemetryPut32(&cursor, rule->ide ? (rule->id | TELEMETRY_ID_EXTENDED) : rule->id);
+    *cursor++ = session->ruleIndex;
+    *cursor++ = (uint8_t) event;
+    TelemetryPut32(&cursor, session->fileNumber);
+    TelemetryPut32(&cursor, session->numTriggerMessages);
+    record->type = eTELEMETRY_TRIGGER;
+    record->length = 18;
+    TelemetryPublish(tm);
+  }
+  if (lock)
+  {
+    TELEMETRY_UNLOCK();
+  }
+}
+
+/** Adds a health record to the TX buffer, behind every frame already taken from the ring
+ *  Payload: the fields of telemetry_health_t in order, 32 bits each except activeSessions (8 bits)
+ *  @param *tm Telemetry struct
+ *  @param *health Health counters
+ *  @param *sessions Session manager
+ *  @param framesStored Number of frames stored in the capture ring
+ *  @return Whether or not the record fit in the TX buffer (if not, try again later)
+ */
+bool TelemetrySendHealth(telemetry_t *tm, const logger_health_t *health, session_manager_t *sessions, uint32_t framesStored)
+{
+  logger_health_t snapshot;
+  uint8_t payload[TELEMETRY_HEALTH_SIZE];
+  uint8_t *cursor = payload;
+
+  if (!tm->enabled || (TelemetryCompact(tm) < TELEMETRY_MAX_PACKET))
+  {
+    return false;
+  }
+  HealthSnapshot(health, &snapshot);
+  TelemetryPut32(&cursor, millis());
+  TelemetryPut32(&cursor, framesStored);
+  TelemetryPut32(&cursor, sessions->droppedFrames);
+  TelemetryPut32(&cursor, tm->framesQueued);
+  TelemetryPut32(&cursor, tm->framesDropped);
+  TelemetryPut32(&cursor, tm->framesSent);
+  TelemetryPut32(&cursor, tm->eventsDropped);
+  TelemetryPut32(&cursor, snapshot.fifoOverflows);
+  TelemetryPut32(&cursor, snapshot.ringHighWater);
+  TelemetryPut32(&cursor, snapshot.backlogHighWater);
+  TelemetryPut32(&cursor, snapshot.droppedWhileFlushing);
+  TelemetryPut32(&cursor, snapshot.sdWrites);
+  TelemetryPut32(&cursor, snapshot.sdWriteMax);
+  TelemetryPut32(&cursor, (uint32_t)(((uint64_t) snapshot.isrMaxTicks * 1000) / PROBE_TICKS_PER_US));
+  TelemetryPut32(&cursor, sessions->sessionCount);
+  TelemetryPut32(&cursor, sessions->missedTriggers);
+  *cursor++ = SessionActiveCount(sessions);
+  TelemetryPut32(&cursor, snapshot.errorsDropped);
+  TelemetryAppendPacket(tm, eTELEMETRY_HEALTH, payload, (uint8_t)(cursor - payload));
+  tm->lastHealth = millis();
+  return true;
+}
+
+/** Encodes queued records into the TX buffer and sends what the USB serial port takes without blocking
+ *  Called from the main loop, sends at most TELEMETRY_SERVICE_BUDGET bytes
+ *  @param *tm Telemetry struct
+ */
+void TelemetryService(telemetry_t *tm)
+{
+  telemetry_record_t *record = NULL;
+  uint32_t budget = TELEMETRY_SERVICE_BUDGET;
+  uint32_t count = 0;
+  int room = 0;
+
+  while (budget > 0)
+  {
+    while ((tm->tail != tm->head) && (TelemetryCompact(tm) >= TELEMETRY_MAX_PACKET))
+    {
+      HEALTH_BARRIER();
+      record = &tm->records[tm->tail & (TELEMETRY_RING_SIZE - 1)];
+      TelemetryAppendPacket(tm, record->type, record->payload, record->length);
+      if (record->type == eTELEMETRY_FRAME)
+      {
+        tm->framesSent++;
+      }
+      HEALTH_BARRIER(); // done with the slot before the interrupt can reuse it
+      tm->tail = tm->tail + 1;
+    }
+    if (tm->txOffset == tm->txLength)
+    {
+      break;
+    }
+    room = Serial.availableForWrite();
+    if (room <= 0)
+    {
+      break;
+    }
+    count = tm->txLength - tm->txOffset;
+    count = (count > (uint32_t) room) ? (uint32_t) room : count;
+    count = (count > budget) ? budget : count;
+    Serial.write(tm->tx + tm->txOffset, count);
+    tm->txOffset += count;
+    budget -= count;
+  }
+}
+
+/** Checks for records or bytes not sent yet
+ *  @param *tm Telemetry struct
+ *  @return Whether or not anything is waiting to be sent
+ */
+bool TelemetryPending(telemetry_t *tm)
+{
+  return (tm->tail != tm->head) || (tm->txOffset != tm->txLength);
+}
+
+/** COBS encodes a block, the output has no zero bytes and is at most length + length / 254 + 1 bytes
+ *  @param *src Bytes to be encoded
+ *  @param length Number of bytes
+ *  @param *dst Encoded bytes, without the delimiter
+ *  @return Number of encoded bytes
+ */
+size_t CobsEncode(const uint8_t *src, size_t length, uint8_t *dst)
+{
+  size_t read = 0;
+  size_t write = 1;
+  size_t codeIndex = 0;
+  uint8_t code = 1;
+
+  while (read < length)
+  {
+    if (src[read] == 0)
+    {
+      dst[codeIndex] = code;
+      code = 1;
+      codeIndex = write++;
+      read++;
+    }
+    else
+    {
+      dst[write++] = src[read++];
+      code++;
+      if (code == 0xFF)
+      {
+        dst[codeIndex] = code;
+        code = 1;
+        codeIndex = write++;
+      }
+    }
+  }
+  dst[codeIndex] = code;
+  return write;
+}
+
+/** Decodes a COBS block, without its delimiter
+ *  @param *src Encoded bytes
+ *  @param length Number of encoded bytes
+ *  @param *dst Decoded bytes
+ *  @param dstSize Size of dst
+ *  @return Number of decoded bytes, 0 if the block is not valid COBS or does not fit
+ */
+size_t CobsDecode(const uint8_t *src, size_t length, uint8_t *dst, size_t dstSize)
+{
+  size_t read = 0;
+  size_t write = 0;
+  uint8_t code = 0;
+  uint8_t index = 0;
+
+  while (read < length)
+  {
+    code = src[read];
+    if ((code == 0) || ((read + code) > length))
+    {
+      return 0;
+    }
+    read++;
+    for (index = 1; index < code; index++)
+    {
+      if ((write >= dstSize) || (src[read] == 0))
+      {
+        return 0;
+      }
+      dst[write++] = src[read++];
+    }
+    if ((code != 0xFF) && (read != length))
+    {
+      if (write >= dstSize)
+      {
+        return 0;
+      }
+      dst[write++] = 0;
+    }
+  }
+  return write;
+}
+
+/** Computes the Fletcher-16 check of a packet
+ *  @param *data Bytes
+ *  @param length Number of bytes
+ *  @return Check, second sum in the high byte
+ */
+uint16_t TelemetryChecksum(const uint8_t *data, size_t length)
+{
+  uint16_t sum1 = 0;
+  uint16_t sum2 = 0;
+  size_t index = 0;
+  for (index = 0; index < length; index++)
+  {
+    sum1 = (sum1 + data[index]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return (sum2 << 8) | sum1;
+}
+
+/** Reads the payload of a health record
+ *  @param *payload Payload
+ *  @param length Number of payload bytes
+ *  @param *health Health record to be set
+ *  @return Whether or not the payload is a complete health record
+ */
+bool TelemetryParseHealth(const uint8_t *payload, size_t length, telemetry_health_t *health)
+{
+  const uint8_t *cursor = payload;
+  if (length < 69)
+  {
+    return false;
+  }
+  health->timestamp = TelemetryGet32(&cursor);
+  health->framesStored = TelemetryGet32(&cursor);
+  health->ringDrops = TelemetryGet32(&cursor);
+  health->framesQueued = TelemetryGet32(&cursor);
+  health->framesDropped = TelemetryGet32(&cursor);
+  health->framesSent = TelemetryGet32(&cursor);
+  health->eventsDropped = TelemetryGet32(&cursor);
+  health->fifoOverflows = TelemetryGet32(&cursor);
+  health->ringHighWater = TelemetryGet32(&cursor);
+  health->backlogHighWater = TelemetryGet32(&cursor);
+  health->droppedWhileFlushing = TelemetryGet32(&cursor);
+  health->sdWrites = TelemetryGet32(&cursor);
+  health->sdWriteMax = TelemetryGet32(&cursor);
+  health->isrMaxNs = TelemetryGet32(&cursor);
+  health->sessionCount = TelemetryGet32(&cursor);
+  health->missedTriggers = TelemetryGet32(&cursor);
+  health->activeSessions = *cursor++;
+  health->errorsDropped = TelemetryGet32(&cursor);
+  return true;
+}
@@ -0,0 +1,104 @@
+/*
+  * @file Telemetry.h
+  *
+  * Binary live telemetry over USB serial. The CAN interrupt queues frame and trigger records in a
+  * record ring without waiting; the main loop turns them into COBS packets in a TX buffer and sends
+  * what the USB serial port takes. Records that do not fit in the ring are dropped and counted.
+  *
+  * Packet: COBS(type, payload, Fletcher-16 of type and payload) followed by a 0x00 delimiter,
+  * every number little endian.
+  *   eTELEMETRY_FRAME    timestamp (4) id (4, TELEMETRY_ID_EXTENDED set for a 29 bit ID) len (1) data (len)
+  *   eTELEMETRY_TRIGGER  timestamp (4) id (4, as in a frame record) rule (1) event (1, SessionEvent_e) file number (4) trigger messages (4)
+  *   eTELEMETRY_HEALTH   see TelemetrySendHealth
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "CANMessage.h"
+#include "Health.h"
+#include "SessionManager.h"
+
+/* DEFINES */
+#define TELEMETRY_RING_SIZE           128       // Number of queued records, a power of two
+#define TELEMETRY_MAX_PAYLOAD         18        // Largest record payload queued by the interrupt
+#define TELEMETRY_HEALTH_SIZE         72        // Largest health payload
+#define TELEMETRY_MAX_PACKET          (TELEMETRY_HEALTH_SIZE + 6)  // Type, payload and check, COBS overhead and delimiter
+#define TELEMETRY_TX_SIZE             256       // Size of the TX buffer
+#define TELEMETRY_SERVICE_BUDGET      4096      // Most bytes sent by one TelemetryService call
+#define TELEMETRY_HEALTH_PERIOD       1000      // Time (ms) between health records
+#define TELEMETRY_ID_EXTENDED         0x80000000UL  // Flag in the ID of a frame record with an extended ID
+
+#define TELEMETRY_LOCK()              NVIC_DISABLE_IRQ(IRQ_CAN_MESSAGE)  // For records queued by the main loop, the interrupt is the other producer
+#define TELEMETRY_UNLOCK()            NVIC_ENABLE_IRQ(IRQ_CAN_MESSAGE)
+
+/* ENUMS */
+enum TelemetryType_e
+{
+  eTELEMETRY_FRAME = 1,                 // Received frame
+  eTELEMETRY_TRIGGER,                   // Attack session opened or closed
+  eTELEMETRY_HEALTH                     // Capture health counters
+};
+
+/* STRUCTS */
+typedef struct {
+  uint8_t type;                         // TelemetryType_e
+  uint8_t length;                       // Number of payload bytes
+  uint8_t payload[TELEMETRY_MAX_PAYLOAD]; // Record payload
+} telemetry_record_t;
+
+typedef struct {
+  telemetry_record_t records[TELEMETRY_RING_SIZE];  // Record ring
+  volatile uint32_t head;               // Number of records queued, written by the producer
+  volatile uint32_t tail;               // Number of records taken, written by the main loop
+  volatile bool enabled;                // Whether or not records are queued
+  uint32_t framesQueued;                // Number of frame records queued
+  uint32_t framesDropped;               // Number of frame records dropped because the ring was full
+  uint32_t eventsDropped;               // Number of trigger records dropped because the ring was full
+  uint32_t framesSent;                  // Number of frame records moved to the TX buffer
+  uint32_t packetsSent;                 // Number of packets moved to the TX buffer
+  uint32_t lastHealth;                  // Time (millis) of the last health record
+  uint8_t tx[TELEMETRY_TX_SIZE];        // TX buffer of encoded packets
+  uint16_t txLength;                    // Number of bytes in the TX buffer
+  uint16_t txOffset;                    // Number of bytes of the TX buffer already sent
+} telemetry_t;
+
+typedef struct {
+  uint32_t timestamp;                   // Time (millis) the record was made
+  uint32_t framesStored;                // Frames stored in the capture ring
+  uint32_t ringDrops;                   // Frames dropped because the capture ring was full
+  uint32_t framesQueued;                // Frame records queued for telemetry
+  uint32_t framesDropped;               // Frame records dropped because the telemetry ring was full
+  uint32_t framesSent;                  // Frame records sent before this record
+  uint32_t eventsDropped;               // Trigger records dropped
+  uint32_t fifoOverflows;               // FIFO overflow flags seen
+  uint32_t ringHighWater;               // Capture ring high-water mark (frames)
+  uint32_t backlogHighWater;            // Write backlog high-water mark (frames)
+  uint32_t droppedWhileFlushing;        // Frames dropped while the SD card was being written
+  uint32_t sdWrites;                    // Number of SD writes
+  uint32_t sdWriteMax;                  // Longest SD write (us)
+  uint32_t isrMaxNs;                    // Longest FIFO callback (ns)
+  uint32_t sessionCount;                // Attack sessions opened
+  uint32_t missedTriggers;              // Sessions not opened because every slot was in use
+  uint8_t activeSessions;               // Sessions not closed yet
+  uint32_t errorsDropped;               // Error events dropped because the error queue was full
+} telemetry_health_t;
+
+/* FUNCTION PROTOTYPES */
+void TelemetryInit(telemetry_t *tm);
+void TelemetryEnable(telemetry_t *tm, bool enabled);
+void TelemetryPushFrame(telemetry_t *tm, const can_message_t *message);
+void TelemetryPushTrigger(telemetry_t *tm, const attack_session_t *session, SessionEvent_e event, bool lock);
+bool TelemetrySendHealth(telemetry_t *tm, const logger_health_t *health, session_manager_t *sessions, uint32_t framesStored);
+void TelemetryService(telemetry_t *tm);
+bool TelemetryPending(telemetry_t *tm);
+size_t CobsEncode(const uint8_t *src, size_t length, uint8_t *dst);
+size_t CobsDecode(const uint8_t *src, size_t length, uint8_t *dst, size_t dstSize);
+uint16_t TelemetryChecksum(const uint8_t *data, size_t length);
+bool TelemetryParseHealth(const uint8_t *payload, size_t length, telemetry_health_t *health);
+
+#endif // TELEMETRY_H
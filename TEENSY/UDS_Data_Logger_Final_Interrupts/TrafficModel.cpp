@@ -0,0 +1,492 @@
+/*
+  * @file TrafficModel.cpp
+  *
+  * Synthetic vehicle bus traffic: periodic IDs with jitter, sporadic frames drawn from a DLC
+  * distribution, bursty diagnostic sessions and a 100% bus load mode, timed with the real
+  * bit-time of every frame (stuff bits included) and arbitrated by ID
+*/
+
+/* INCLUDES */
+#include "TrafficModel.h"
+
+/* STRUCTS */
+typedef struct {
+  uint8_t request[3];                   // Single frame request: length, service, parameter
+  uint8_t response[3];                  // Single frame positive response
+} traffic_diag_exchange_t;
+
+typedef struct {
+  uint16_t crc;                         // CRC-15 of the bits so far
+  uint16_t bits;                        // Number of bits, stuff bits included
+  uint8_t run;                          // Number of equal bits in a row
+  uint8_t last;                         // Value of the last bit on the bus
+} traffic_bit_stream_t;
+
+/* CONSTANTS */
+/* Powertrain / chassis bus of a passenger car: 10 ms control loops, slower status and body frames */
+const traffic_periodic_t TrafficVehiclePeriodic[] =
+{
+  {0x002, 10, 150, 5},        // Steering angle
+  {0x160, 10, 150, 7},        // Accelerator pedal
+  {0x180, 10, 150, 8},        // Engine speed / torque
+  {0x182, 10, 150, 8},
+  {0x1F9, 10, 150, 8},
+  {0x215, 20, 300, 6},
+  {0x245, 20, 300, 8},        // Yaw rate
+  {0x280, 20, 300, 8},        // Wheel speeds
+  {0x284, 20, 300, 8},
+  {0x285, 20, 300, 8},
+  {0x292, 40, 500, 8},        // Brakes
+  {0x2B0, 40, 500, 6},
+  {0x351, 100, 1000, 8},      // Transmission
+  {0x354, 100, 1000, 8},
+  {0x358, 100, 1000, 8},
+  {0x35D, 100, 1000, 8},      // Lights / wipers
+  {0x421, 100, 1000, 3},      // Gear position
+  {0x512, 500, 2000, TRAFFIC_DLC_RANDOM},
+  {0x551, 500, 2000, 8},      // Coolant temperature
+  {0x5C5, 500, 2000, 8},      // Odometer
+  {0x60D, 1000, 5000, 8},     // Doors
+  {0x625, 1000, 5000, 6}
+};
+
+const traffic_profile_t TrafficVehicleProfile =
+{
+  TrafficVehiclePeriodic,
+  sizeof(TrafficVehiclePeriodic) / sizeof(TrafficVehiclePeriodic[0]),
+  {1, 1, 2, 4, 6, 6, 6, 8, 66},       // DLC 8 dominates, as on a real bus
+  50,
+  0x100,
+  0x6FF,
+  20000,
+  0x7E0,
+  0x7E8,
+  8,
+  50,
+  2000
+};
+
+/* Services a tester runs through in a diagnostic session, all in single frames */
+const traffic_diag_exchange_t TrafficDiagScript[] =
+{
+  {{0x02, 0x10, 0x03}, {0x02, 0x50, 0x03}},   // DiagnosticSessionControl (extended)
+  {{0x02, 0x3E, 0x00}, {0x02, 0x7E, 0x00}},   // TesterPresent
+  {{0x03, 0x22, 0xF1}, {0x03, 0x62, 0xF1}},   // ReadDataByIdentifier
+  {{0x02, 0x27, 0x01}, {0x02, 0x67, 0x01}},   // SecurityAccess (request seed)
+  {{0x02, 0x11, 0x01}, {0x02, 0x51, 0x01}}    // ECUReset
+};
+
+const uint8_t TRAFFIC_DIAG_SCRIPT_LENGTH = sizeof(TrafficDiagScript) / sizeof(TrafficDiagScript[0]);
+
+/** Pseudo-random number (xorshift32), repeatable for a given seed
+ *  @param *model Traffic model holding the generator state
+ *  @return Random value
+ */
+static uint32_t TrafficRandom(traffic_model_t *model)
+{
+  uint32_t x = model->seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  model->seed = x;
+  return x;
+}
+
+/** Random value in [minimum, maximum]
+ */
+static uint32_t TrafficRandomRange(traffic_model_t *model, uint32_t minimum, uint32_t maximum)
+{
+  return minimum + (TrafficRandom(model) % (maximum - minimum + 1));
+}
+
+/** Draws a DLC from the profile distribution
+ *  @param *model Traffic model
+ *  @return Data length code
+ */
+static uint8_t TrafficRandomDlc(traffic_model_t *model)
+{
+  const uint8_t *weights = model->profile->dlcWeights;
+  uint16_t total = 0;
+  uint16_t pick = 0;
+  uint8_t dlc = 0;
+
+  for (dlc = 0; dlc < TRAFFIC_NUM_DLC; dlc++)
+  {
+    total += weights[dlc];
+  }
+  if (total == 0)
+  {
+    return 8;
+  }
+  pick = TrafficRandom(model) % total;
+  for (dlc = 0; pick >= weights[dlc]; dlc++)
+  {
+    pick -= weights[dlc];
+  }
+  return dlc;
+}
+
+/** Time between two sporadic frames, uniform around the mean rate
+ */
+static uint64_t TrafficSporadicGapNs(traffic_model_t *model)
+{
+  uint64_t meanNs = 1000000000ULL / model->profile->sporadicPerSecond;
+  return TrafficRandomRange(model, 0, (uint32_t)((2 * meanNs) / 1000)) * 1000ULL;
+}
+
+/** Time between two diagnostic sessions, between half and one and a half times the mean
+ */
+static uint64_t TrafficDiagGapNs(traffic_model_t *model)
+{
+  uint32_t intervalMs = model->profile->diagIntervalMs;
+  return TrafficRandomRange(model, intervalMs / 2, intervalMs + (intervalMs / 2)) * 1000000ULL;
+}
+
+/** Sets the send time of a periodic ID from its nominal time and a random jitter
+ */
+static void TrafficJitter(traffic_model_t *model, uint8_t index)
+{
+  uint32_t jitterNs = model->profile->periodic[index].jitterUs * 1000UL;
+  uint64_t nominal = model->periodicNominalNs[index];
+  uint32_t offset = TrafficRandomRange(model, 0, 2 * jitterNs);
+
+  model->periodicDueNs[index] = ((nominal + offset) > jitterNs) ? (nominal + offset - jitterNs) : 0;
+}
+
+/** Initializes a traffic model at time 0
+ *  @param *model Traffic model to be initialized
+ *  @param *profile Traffic profile
+ *  @param bitrate Bus speed (bit/s), one of TRAFFIC_BITRATE_*
+ *  @param fullLoad Whether or not idle bus time is filled with frames (100% bus load)
+ *  @param seed Seed of the pseudo-random generator, nonzero
+ */
+void TrafficInit(traffic_model_t *model, const traffic_profile_t *profile, uint32_t bitrate, bool fullLoad, uint32_t seed)
+{
+  uint8_t index = 0;
+  uint8_t dataIndex = 0;
+
+  memset(model, 0, sizeof(traffic_model_t));
+  model->profile = profile;
+  model->bitrate = bitrate;
+  model->fullLoad = fullLoad;
+  model->seed = (seed != 0) ? seed : 1;
+
+  for (index = 0; (index < profile->numPeriodic) && (index < TRAFFIC_MAX_PERIODIC); index++)
+  {
+    // spread the IDs over their first period, ECUs do not start in lockstep
+    model->periodicNominalNs[index] = TrafficRandomRange(model, 0, profile->periodic[index].periodMs * 1000UL) * 1000ULL;
+    TrafficJitter(model, index);
+    for (dataIndex = 0; dataIndex < 8; dataIndex++)
+    {
+      model->periodicData[index][dataIndex] = (uint8_t) TrafficRandom(model);
+    }
+  }
+  if (profile->sporadicPerSecond > 0)
+  {
+    model->sporadicDueNs = TrafficSporadicGapNs(model);
+  }
+  if (profile->diagIntervalMs > 0)
+  {
+    model->diagDueNs = TrafficDiagGapNs(model);
+  }
+}
+
+/** Puts bits on the stream, most significant first, adding stuff bits and the CRC
+ *  @param *stream Bit stream
+ *  @param value Bits to be sent
+ *  @param count Number of bits
+ *  @param crc Whether or not the bits are covered by the CRC
+ */
+static void TrafficPutBits(traffic_bit_stream_t *stream, uint32_t value, uint8_t count, bool crc)
+{
+  uint8_t bit = 0;
+
+  while (count > 0)
+  {
+    count--;
+    bit = (value >> count) & 0x01;
+    if (crc)
+    {
+      stream->crc = ((stream->crc << 1) & 0x7FFF) ^ ((bit ^ (stream->crc >> 14)) ? TRAFFIC_CRC15_POLY : 0);
+    }
+    stream->bits++;
+    stream->run = (bit == stream->last) ? (stream->run + 1) : 1;
+    stream->last = bit;
+    if (stream->run == TRAFFIC_STUFF_RUN)
+    {
+      stream->bits++;
+      stream->last = !bit;
+      stream->run = 1;
+    }
+  }
+}
+
+/** Counts the bits a frame takes on the bus
+ *  Stuff bits are counted exactly from the ID, payload and CRC-15, from the start of frame
+ *  bit to the end of the CRC, the fixed-form tail and intermission are added
+ *  @param *frame Frame to be sent
+ *  @return Number of bit-times
+ */
+uint16_t TrafficFrameBits(const FLEXCAN_frame_t *frame)
+{
+  traffic_bit_stream_t stream;
+  uint8_t dlc = (frame->dlc > 8) ? 8 : frame->dlc;
+  uint8_t index = 0;
+
+  memset(&stream, 0, sizeof(stream));
+  stream.last = 0xFF; // the idle bus is not part of a run
+  TrafficPutBits(&stream, 0, 1, true);                                  // SOF
+  if (frame->ide)
+  {
+    TrafficPutBits(&stream, (frame->id >> 18) & 0x7FF, 11, true);       // base ID
+    TrafficPutBits(&stream, 0x3, 2, true);                              // SRR, IDE
+    TrafficPutBits(&stream, frame->id & 0x3FFFF, 18, true);             // ID extension
+    TrafficPutBits(&stream, frame->rtr ? 1 : 0, 1, true);               // RTR
+    TrafficPutBits(&stream, 0, 2, true);                                // r1, r0
+  }
+  else
+  {
+    TrafficPutBits(&stream, frame->id & 0x7FF, 11, true);
+    TrafficPutBits(&stream, frame->rtr ? 1 : 0, 1, true);               // RTR
+    TrafficPutBits(&stream, 0, 2, true);                                // IDE, r0
+  }
+  TrafficPutBits(&stream, dlc, 4, true);
+  for (index = 0; (index < dlc) && !frame->rtr; index++)
+  {
+    TrafficPutBits(&stream, frame->data[index], 8, true);
+  }
+  TrafficPutBits(&stream, stream.crc, 15, false);
+  return stream.bits + TRAFFIC_FRAME_TAIL_BITS;
+}
+
+/** Time a frame takes on the bus
+ *  @param *frame Frame to be sent
+ *  @param bitrate Bus speed (bit/s)
+ *  @return Time (ns)
+ */
+uint32_t TrafficFrameTimeNs(const FLEXCAN_frame_t *frame, uint32_t bitrate)
+{
+  return (uint32_t)(((uint64_t) TrafficFrameBits(frame) * 1000000000ULL) / bitrate);
+}
+
+/** Queues a frame to be sent once it is due and wins arbitration
+ *  @param *model Traffic model
+ *  @param *frame Frame to be sent
+ *  @param dueNs Time the frame is ready to be sent
+ *  @return Whether or not there was room in the queue
+ */
+bool TrafficQueueFrame(traffic_model_t *model, const FLEXCAN_frame_t *frame, uint64_t dueNs)
+{
+  if (model->numPending == TRAFFIC_PENDING_CAPACITY)
+  {
+    return false;
+  }
+  memcpy(&model->pending[model->numPending].frame, frame, sizeof(FLEXCAN_frame_t));
+  model->pending[model->numPending].dueNs = dueNs;
+  model->numPending++;
+  return true;
+}
+
+/** Queues the request / response exchanges of a diagnostic session starting at a time
+ */
+static void TrafficQueueDiagSession(traffic_model_t *model, uint64_t startNs)
+{
+  const traffic_profile_t *profile = model->profile;
+  const traffic_diag_exchange_t *exchange = NULL;
+  FLEXCAN_frame_t frame;
+  uint64_t requestNs = startNs;
+  uint8_t index = 0;
+
+  memset(&frame, 0, sizeof(frame));
+  frame.dlc = 8;
+  for (index = 0; index < profile->diagExchanges; index++)
+  {
+    exchange = &TrafficDiagScript[model->diagService];
+    model->diagService = (model->diagService + 1) % TRAFFIC_DIAG_SCRIPT_LENGTH;
+
+    frame.id = profile->diagRequestId;
+    memset(frame.data, 0, sizeof(frame.data));
+    memcpy(frame.data, exchange->request, sizeof(exchange->request));
+    TrafficQueueFrame(model, &frame, requestNs);
+
+    frame.id = profile->diagResponseId;
+    memset(frame.data, 0, sizeof(frame.data));
+    memcpy(frame.data, exchange->response, sizeof(exchange->response));
+    TrafficQueueFrame(model, &frame, requestNs + (profile->diagResponseUs * 1000ULL));
+
+    requestNs += profile->diagGapMs * 1000000ULL;
+  }
+}
+
+/** Builds a sporadic or filler frame with a random ID and a DLC from the distribution
+ */
+static void TrafficRandomFrame(traffic_model_t *model, FLEXCAN_frame_t *frame)
+{
+  uint8_t index = 0;
+
+  memset(frame, 0, sizeof(FLEXCAN_frame_t));
+  frame->id = TrafficRandomRange(model, model->profile->sporadicMinId, model->profile->sporadicMaxId);
+  frame->dlc = TrafficRandomDlc(model);
+  for (index = 0; index < frame->dlc; index++)
+  {
+    frame->data[index] = (uint8_t) TrafficRandom(model);
+  }
+}
+
+/** Builds the next frame of a periodic ID: a rolling counter in the low nibble of the last
+ *  byte and now and then a changed signal byte, the rest of the payload is kept
+ */
+static void TrafficPeriodicFrame(traffic_model_t *model, uint8_t index, FLEXCAN_frame_t *frame)
+{
+  const traffic_periodic_t *periodic = &model->profile->periodic[index];
+  uint8_t *data = model->periodicData[index];
+
+  memset(frame, 0, sizeof(FLEXCAN_frame_t));
+  frame->id = periodic->id;
+  frame->ide = (periodic->id > TRAFFIC_MAX_STD_ID) ? 1 : 0;
+  frame->dlc = (periodic->dlc == TRAFFIC_DLC_RANDOM) ? TrafficRandomDlc(model) : periodic->dlc;
+  if (frame->dlc > 0)
+  {
+    data[frame->dlc - 1] = (data[frame->dlc - 1] & 0xF0) | ((data[frame->dlc - 1] + 1) & 0x0F);
+    if ((TrafficRandom(model) & 0x03) == 0)
+    {
+      data[TrafficRandom(model) % frame->dlc] ^= (uint8_t)(TrafficRandom(model) & 0x0F);
+    }
+  }
+  memcpy(frame->data, data, frame->dlc);
+}
+
+/** Arbitration priority of a frame, lower wins
+ *  Bits are compared in the order they are sent: the base ID, then the RTR bit of a standard
+ *  frame against the recessive SRR bit of an extended one, then the ID extension
+ */
+static uint32_t TrafficPriority(const FLEXCAN_frame_t *frame)
+{
+  if (frame->ide)
+  {
+    return (((frame->id >> 18) & 0x7FF) << 19) | (1UL << 18) | (frame->id & 0x3FFFF);
+  }
+  return (frame->id & 0x7FF) << 19;
+}
+
+/** Sends the next frame on the bus
+ *  The bus starts the next frame once it is free and a frame is due, every due frame
+ *  arbitrates and the lowest ID wins. At 100% load an idle bus carries a filler frame.
+ *  @param *model Traffic model
+ *  @param *frame Frame to be set
+ *  @param *endNs Time the frame ends on the bus, when the controller has received it
+ *  @return Whether or not a frame was sent
+ */
+bool TrafficNextFrame(traffic_model_t *model, FLEXCAN_frame_t *frame, uint64_t *endNs)
+{
+  const traffic_profile_t *profile = model->profile;
+  uint64_t startNs = UINT64_MAX;
+  uint32_t bestPriority = UINT32_MAX;
+  int16_t bestPeriodic = -1;
+  int16_t bestPending = -1;
+  bool bestSporadic = false;
+  FLEXCAN_frame_t candidate;
+  uint8_t index = 0;
+
+  memset(&candidate, 0, sizeof(candidate));
+  // diagnostic sessions start on schedule and queue their exchanges
+  while ((profile->diagIntervalMs > 0) && (model->diagDueNs <= model->busFreeNs))
+  {
+    TrafficQueueDiagSession(model, model->diagDueNs);
+    model->diagDueNs += TrafficDiagGapNs(model);
+  }
+
+  // the next frame starts when the bus is free and something is due
+  for (index = 0; index < profile->numPeriodic; index++)
+  {
+    startNs = (model->periodicDueNs[index] < startNs) ? model->periodicDueNs[index] : startNs;
+  }
+  for (index = 0; index < model->numPending; index++)
+  {
+    startNs = (model->pending[index].dueNs < startNs) ? model->pending[index].dueNs : startNs;
+  }
+  if (profile->sporadicPerSecond > 0)
+  {
+    startNs = (model->sporadicDueNs < startNs) ? model->sporadicDueNs : startNs;
+  }
+  if ((profile->diagIntervalMs > 0) && (model->diagDueNs < startNs))
+  {
+    startNs = model->diagDueNs;
+    TrafficQueueDiagSession(model, model->diagDueNs);
+    model->diagDueNs += TrafficDiagGapNs(model);
+  }
+  if (model->fullLoad || (startNs < model->busFreeNs))
+  {
+    startNs = model->busFreeNs;
+  }
+  if (startNs == UINT64_MAX)
+  {
+    return false;
+  }
+
+  // arbitration between every frame that is due
+  for (index = 0; index < profile->numPeriodic; index++)
+  {
+    if (model->periodicDueNs[index] <= startNs)
+    {
+      candidate.id = profile->periodic[index].id;
+      candidate.ide = (candidate.id > TRAFFIC_MAX_STD_ID) ? 1 : 0;
+      if (TrafficPriority(&candidate) < bestPriority)
+      {
+        bestPriority = TrafficPriority(&candidate);
+        bestPeriodic = index;
+      }
+    }
+  }
+  for (index = 0; index < model->numPending; index++)
+  {
+    if ((model->pending[index].dueNs <= startNs) && (TrafficPriority(&model->pending[index].frame) < bestPriority))
+    {
+      bestPriority = TrafficPriority(&model->pending[index].frame);
+      bestPending = index;
+      bestPeriodic = -1;
+    }
+  }
+
+  if (bestPending >= 0)
+  {
+    memcpy(frame, &model->pending[bestPending].frame, sizeof(FLEXCAN_frame_t));
+    model->numPending--;
+    memmove(&model->pending[bestPending], &model->pending[bestPending + 1], (model->numPending - bestPending) * sizeof(traffic_pending_t));
+  }
+  else if (bestPeriodic >= 0)
+  {
+    TrafficPeriodicFrame(model, bestPeriodic, frame);
+    model->periodicNominalNs[bestPeriodic] += profile->periodic[bestPeriodic].periodMs * 1000000ULL;
+    TrafficJitter(model, bestPeriodic);
+  }
+  else
+  {
+    // a sporadic frame that is due, or filler on a fully loaded bus
+    bestSporadic = (profile->sporadicPerSecond > 0) && (model->sporadicDueNs <= startNs);
+    TrafficRandomFrame(model, frame);
+    if (bestSporadic)
+    {
+      model->sporadicDueNs += TrafficSporadicGapNs(model);
+    }
+  }
+
+  *endNs = startNs + TrafficFrameTimeNs(frame, model->bitrate);
+  model->busyNs += *endNs - startNs;
+  model->busFreeNs = *endNs;
+  model->numFrames++;
+  return true;
+}
+
+/** Share of the time the bus carried frames
+ *  @param *model Traffic model
+ *  @return Bus load in hundredths of a percent
+ */
+uint16_t TrafficBusLoad(traffic_model_t *model)
+{
+  if (model->busFreeNs == 0)
+  {
+    return 0;
+  }
+  return (uint16_t)((model->busyNs * 10000) / model->busFreeNs);
+}
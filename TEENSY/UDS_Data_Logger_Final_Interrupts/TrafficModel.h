@@ -0,0 +1,89 @@
+/*
+  * @file TrafficModel.h
+  *
+  * Synthetic vehicle bus traffic: periodic IDs with jitter, sporadic frames drawn from a DLC
+  * distribution, bursty diagnostic sessions and a 100% bus load mode, timed with the real
+  * bit-time of every frame (stuff bits included) and arbitrated by ID
+*/
+
+#ifndef TRAFFICMODEL_H
+#define TRAFFICMODEL_H
+
+/* INCLUDES */
+#include <stdint.h>
+#include <string.h>
+#include "CANMessage.h"
+
+/* DEFINES */
+#define TRAFFIC_MAX_PERIODIC          32        // Maximum number of periodic IDs in a profile
+#define TRAFFIC_PENDING_CAPACITY      32        // Maximum number of queued frames (diagnostic exchanges, injected frames)
+#define TRAFFIC_MAX_STD_ID            0x7FF     // Largest standard arbitration ID
+#define TRAFFIC_DLC_RANDOM            0xFF      // DLC of a periodic ID drawn from the profile DLC distribution
+#define TRAFFIC_NUM_DLC               9         // Number of data length codes [0 - 8]
+#define TRAFFIC_FRAME_TAIL_BITS       13        // CRC delimiter, ACK slot and delimiter, end of frame, intermission
+#define TRAFFIC_CRC15_POLY            0x4599    // CAN CRC-15 generator polynomial
+#define TRAFFIC_STUFF_RUN             5         // Number of equal bits followed by a stuff bit
+
+#define TRAFFIC_BITRATE_125K          125000
+#define TRAFFIC_BITRATE_250K          250000
+#define TRAFFIC_BITRATE_500K          500000
+#define TRAFFIC_BITRATE_1M            1000000
+
+/* STRUCTS */
+typedef struct {
+  uint32_t id;                          // Arbitration ID
+  uint16_t periodMs;                    // Nominal period
+  uint16_t jitterUs;                    // Maximum deviation from the nominal send time
+  uint8_t dlc;                          // Data length code, TRAFFIC_DLC_RANDOM to draw it per frame
+} traffic_periodic_t;
+
+typedef struct {
+  const traffic_periodic_t *periodic;   // Periodic IDs
+  uint8_t numPeriodic;                  // Number of periodic IDs
+  uint8_t dlcWeights[TRAFFIC_NUM_DLC];  // Relative frequency of each DLC for sporadic and filler frames
+  uint16_t sporadicPerSecond;           // Mean rate of sporadic (event) frames, 0 for none
+  uint16_t sporadicMinId;               // Lowest ID of sporadic and filler frames
+  uint16_t sporadicMaxId;               // Highest ID of sporadic and filler frames
+  uint32_t diagIntervalMs;              // Mean time between diagnostic sessions, 0 for none
+  uint32_t diagRequestId;               // Arbitration ID of the tester
+  uint32_t diagResponseId;              // Arbitration ID of the ECU
+  uint8_t diagExchanges;                // Number of request / response exchanges per session
+  uint16_t diagGapMs;                   // Time between the exchanges of a session
+  uint16_t diagResponseUs;              // Time the ECU takes to respond
+} traffic_profile_t;
+
+typedef struct {
+  FLEXCAN_frame_t frame;                // Frame waiting for the bus
+  uint64_t dueNs;                       // Time the frame is ready to be sent
+} traffic_pending_t;
+
+typedef struct {
+  const traffic_profile_t *profile;     // Traffic profile
+  uint32_t bitrate;                     // Bus speed (bit/s)
+  bool fullLoad;                        // Whether or not idle bus time is filled with frames
+  uint32_t seed;                        // State of the pseudo-random generator, runs are repeatable
+  uint64_t busFreeNs;                   // Time the frame on the bus ends
+  uint64_t periodicNominalNs[TRAFFIC_MAX_PERIODIC]; // Nominal send time of each periodic ID
+  uint64_t periodicDueNs[TRAFFIC_MAX_PERIODIC];     // Send time of each periodic ID, jitter included
+  uint8_t periodicData[TRAFFIC_MAX_PERIODIC][8];    // Last payload of each periodic ID
+  uint64_t sporadicDueNs;               // Send time of the next sporadic frame
+  uint64_t diagDueNs;                   // Start time of the next diagnostic session
+  uint8_t diagService;                  // Index of the next service in the diagnostic script
+  traffic_pending_t pending[TRAFFIC_PENDING_CAPACITY]; // Queued frames
+  uint8_t numPending;                   // Number of queued frames
+  uint32_t numFrames;                   // Number of frames sent
+  uint64_t busyNs;                      // Time the bus carried frames
+} traffic_model_t;
+
+/* FUNCTION PROTOTYPES */
+void TrafficInit(traffic_model_t *model, const traffic_profile_t *profile, uint32_t bitrate, bool fullLoad, uint32_t seed);
+uint16_t TrafficFrameBits(const FLEXCAN_frame_t *frame);
+uint32_t TrafficFrameTimeNs(const FLEXCAN_frame_t *frame, uint32_t bitrate);
+bool TrafficQueueFrame(traffic_model_t *model, const FLEXCAN_frame_t *frame, uint64_t dueNs);
+bool TrafficNextFrame(traffic_model_t *model, FLEXCAN_frame_t *frame, uint64_t *endNs);
+uint16_t TrafficBusLoad(traffic_model_t *model);
+
+/* CONSTANTS */
+extern const traffic_profile_t TrafficVehicleProfile;
+
+#endif // TRAFFICMODEL_H
@@ -11,18 +11,26 @@
 
 /* INCLUDES */
 #include "CircularBuffer.h"
-#include "LinearBuffer.h"
 #include "CANMessage.h"
 #include "SDCard.h"
 #include "Errors.h"
 #include "TimeModule.h"
+#include "IsoTp.h"
+#include "UDSDecoder.h"
+#include "SessionManager.h"
+#include "TrafficModel.h"
+#include "Probe.h"
+#include "Health.h"
+#include "Telemetry.h"
+#include "SdMonitor.h"
+#include "SdRecovery.h"
+#include "BusMonitor.h"
+#include "CanAutobaud.h"
 
 /* DEFINES */
 #define TEST_PACKET_TRANSFER_DELAY    1         // Packet simulation send delay time
 #define SD_CHIP_SELECT                10        // Chip select pin for SD card
 #define TIMESTAMP_SIZE                30        // Size of timestamp string
-#define FILE_NAME_SIZE                30        // Size of file name string
-#define FILE_PATH_SIZE                60        // Maximum size of file names
 
 /* ENUMS */
 enum NetworkState_e
@@ -32,27 +40,24 @@ enum NetworkState_e
   eSTATE_CORRUPT_TRAFFIC
 };
 
-enum ReadType_e
-{
-  eREAD_NONE = 0,
-  eREAD_CIRCULAR_BUFFER,
-  eREAD_LINEAR_BUFFER
-};
-
 /* STRUCTS */
 typedef struct {
-  ReadType_e readType;                  // Type of storage used to store messages
-  NetworkState_e networkState;          // Current status of CAN traffic (Normal or Corrupt) that decides how the data should be stored
-  uint32_t corruptMsgCount;             // Number of messages since UDS message was monitored
-  uint32_t fileNumber;                  // Number cooresponding to each UDS attack instance
-  uint32_t numUDSMessages;              // Number of UDS messages in a single attack
+  NetworkState_e networkState;          // Current status of CAN traffic (Normal or Corrupt), corrupt while any attack session is open
   uint32_t totalMsgCount;               // Total number of messages recorded
+  logger_health_t health;               // Capture health counters and high-water marks
 } model_t;
 
 /* FUNCTION PROTOTYPES */
-void SetFileNameAndPath(char *filePath, char *fileName, char *directory, const char *fileTitle, uint32_t fileNumber, size_t nameSize, size_t pathSize);
-void ChangeState(ReadType_e newReadType, NetworkState_e newNetworkState);
+void window_timer_callback();
+void load_timer_callback();
 void can_fifo_callback(uint8_t x);
+void can_status_callback(FLEXCAN_status_t *status);
+void session_event_callback(const attack_session_t *session, SessionEvent_e event);
+void LoggerProcessMessage(can_message_t *message);
+void LoggerService(void);
+void LoggerHandleErrors(void);
+void LoggerHandleBusEvents(void);
+void LoggerSerialCommand(void);
 
 #endif // UDSDATALOGGER_H
 
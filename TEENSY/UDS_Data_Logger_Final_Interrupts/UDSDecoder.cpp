@@ -0,0 +1,338 @@
+/*
+  * @file UDSDecoder.cpp
+  *
+  * Table driven decoding of UDS (ISO 14229) / KWP2000 diagnostic PDUs and attack classification
+*/
+
+#include "UDSDecoder.h"
+
+/* CONSTANTS */
+const uds_service_t UDSServiceTable[] =
+{
+  {0x10, "DiagnosticSessionControl",        eUDS_PARAM_SUB_FUNCTION,  eUDS_CLASS_SESSION},
+  {0x11, "ECUReset",                        eUDS_PARAM_SUB_FUNCTION,  eUDS_CLASS_RESET},
+  {0x14, "ClearDiagnosticInformation",      eUDS_PARAM_NONE,          eUDS_CLASS_DTC},
+  {0x19, "ReadDTCInformation",              eUDS_PARAM_SUB_FUNCTION,  eUDS_CLASS_DTC},
+  {0x1A, "ReadECUIdentification",           eUDS_PARAM_LOCAL_ID,      eUDS_CLASS_READ},
+  {0x21, "ReadDataByLocalIdentifier",       eUDS_PARAM_LOCAL_ID,      eUDS_CLASS_READ},
+  {0x22, "ReadDataByIdentifier",            eUDS_PARAM_DATA_ID,       eUDS_CLASS_READ},
+  {0x23, "ReadMemoryByAddress",             eUDS_PARAM_NONE,          eUDS_CLASS_READ},
+  {0x27, "SecurityAccess",                  eUDS_PARAM_SUB_FUNCTION,  eUDS_CLASS_SECURITY},
+  {0x28, "CommunicationControl",            eUDS_PARAM_SUB_FUNCTION,  eUDS_CLASS_COMMUNICATION},
+  {0x2E, "WriteDataByIdentifier",           eUDS_PARAM_DATA_ID,       eUDS_CLASS_WRITE},
+  {0x2F, "InputOutputControlByIdentifier",  eUDS_PARAM_DATA_ID,       eUDS_CLASS_IO_CONTROL},
+  {0x30, "InputOutputControlByLocalId",     eUDS_PARAM_LOCAL_ID,      eUDS_CLASS_IO_CONTROL},
+  {0x31, "RoutineControl",                  eUDS_PARAM_SUB_FUNCTION,  eUDS_CLASS_ROUTINE},
+  {0x34, "RequestDownload",                 eUDS_PARAM_NONE,          eUDS_CLASS_TRANSFER},
+  {0x35, "RequestUpload",                   eUDS_PARAM_NONE,          eUDS_CLASS_TRANSFER},
+  {0x36, "TransferData",                    eUDS_PARAM_NONE,          eUDS_CLASS_TRANSFER},
+  {0x37, "RequestTransferExit",             eUDS_PARAM_NONE,          eUDS_CLASS_TRANSFER},
+  {0x3B, "WriteDataByLocalIdentifier",      eUDS_PARAM_LOCAL_ID,      eUDS_CLASS_WRITE},
+  {0x3D, "WriteMemoryByAddress",            eUDS_PARAM_NONE,          eUDS_CLASS_WRITE},
+  {0x3E, "TesterPresent",                   eUDS_PARAM_SUB_FUNCTION,  eUDS_CLASS_KEEPALIVE},
+  {0x85, "ControlDTCSetting",               eUDS_PARAM_SUB_FUNCTION,  eUDS_CLASS_DTC}
+};
+
+const uint8_t UDS_NUM_SERVICES = sizeof(UDSServiceTable) / sizeof(UDSServiceTable[0]);
+
+typedef struct {
+  uint8_t nrc;
+  const char *name;
+} uds_nrc_t;
+
+const uds_nrc_t UDSNrcTable[] =
+{
+  {0x10, "generalReject"},
+  {0x11, "serviceNotSupported"},
+  {0x12, "subFunctionNotSupported"},
+  {0x13, "incorrectMessageLength"},
+  {0x14, "responseTooLong"},
+  {0x21, "busyRepeatRequest"},
+  {0x22, "conditionsNotCorrect"},
+  {0x24, "requestSequenceError"},
+  {0x31, "requestOutOfRange"},
+  {0x33, "securityAccessDenied"},
+  {0x35, "invalidKey"},
+  {0x36, "exceededNumberOfAttempts"},
+  {0x37, "requiredTimeDelayNotExpired"},
+  {0x72, "generalProgrammingFailure"},
+  {0x78, "responsePending"},
+  {0x7E, "subFunctionNotSupportedInActiveSession"},
+  {0x7F, "serviceNotSupportedInActiveSession"}
+};
+
+const char *AttackClassNames[] =
+{
+  "None",
+  "Tester Present Only",
+  "Diagnostic Scan",
+  "Session Control",
+  "Communication Control",
+  "IO Control",
+  "ECU Reset",
+  "Security Access",
+  "Security Access Brute Force",
+  "Reprogramming"
+};
+
+const char *ServiceClassNames[eUDS_NUM_CLASSES] =
+{
+  "None",
+  "Session",
+  "Keepalive",
+  "IO Control",
+  "Security",
+  "Reset",
+  "Read",
+  "Write",
+  "Routine",
+  "Transfer",
+  "Communication",
+  "DTC"
+};
+
+/* GLOBAL VARIABLES */
+uint8_t g_UDSServiceIndex[256];         // Service ID -> service table index, built once so decoding is a single lookup
+bool g_UDSDecoderReady = false;
+
+/** Builds the service ID lookup table
+ */
+void UDSDecoderInit()
+{
+  uint8_t serviceIndex = 0;
+  memset(g_UDSServiceIndex, UDS_NO_SERVICE, sizeof(g_UDSServiceIndex));
+  for (serviceIndex = 0; serviceIndex < UDS_NUM_SERVICES; serviceIndex++)
+  {
+    g_UDSServiceIndex[UDSServiceTable[serviceIndex].sid] = serviceIndex;
+  }
+  g_UDSDecoderReady = true;
+}
+
+/** Decodes a diagnostic PDU into service, parameter and negative response code
+ *  @param *data PDU payload, starting with the service ID
+ *  @param len Length of the PDU payload
+ *  @param isResponse Whether or not the PDU was sent by the ECU
+ *  @param *decoded Decoded PDU (to be set)
+ *  @return Whether or not the service ID is known
+ */
+bool UDSDecode(const uint8_t *data, uint16_t len, bool isResponse, uds_decoded_t *decoded)
+{
+  const uint8_t *param = data + 1;
+  uint16_t paramLen = 0;
+
+  if (!g_UDSDecoderReady)
+  {
+    UDSDecoderInit();
+  }
+
+  memset(decoded, 0, sizeof(uds_decoded_t));
+  decoded->serviceIndex = UDS_NO_SERVICE;
+  if (len == 0)
+  {
+    return false;
+  }
+
+  if (isResponse && (data[0] == UDS_NEGATIVE_RESPONSE_SID))
+  {
+    decoded->type = eUDS_MSG_NEGATIVE_RESPONSE;
+    decoded->sid = (len > 1) ? data[1] : 0;
+    decoded->nrc = (len > 2) ? data[2] : 0;
+    decoded->serviceIndex = g_UDSServiceIndex[decoded->sid];
+    return (decoded->serviceIndex != UDS_NO_SERVICE);
+  }
+  else if (isResponse)
+  {
+    decoded->type = eUDS_MSG_POSITIVE_RESPONSE;
+    decoded->sid = data[0] - UDS_POSITIVE_RESPONSE_OFFSET;
+  }
+  else
+  {
+    decoded->type = eUDS_MSG_REQUEST;
+    decoded->sid = data[0];
+  }
+
+  decoded->serviceIndex = g_UDSServiceIndex[decoded->sid];
+  if (decoded->serviceIndex == UDS_NO_SERVICE)
+  {
+    decoded->type = eUDS_MSG_UNKNOWN;
+    return false;
+  }
+
+  paramLen = len - 1;
+  switch (UDSServiceTable[decoded->serviceIndex].param)
+  {
+    case eUDS_PARAM_SUB_FUNCTION:
+    {
+      if (paramLen >= 1)
+      {
+        decoded->hasParam = true;
+        decoded->param = param[0];
+        decoded->suppressResponse = (decoded->type == eUDS_MSG_REQUEST) && (param[0] & UDS_SUPPRESS_RESPONSE_BIT);
+      }
+      break;
+    }
+    case eUDS_PARAM_LOCAL_ID:
+    {
+      if (paramLen >= 1)
+      {
+        decoded->hasParam = true;
+        decoded->param = param[0];
+      }
+      break;
+    }
+    case eUDS_PARAM_DATA_ID:
+    {
+      if (paramLen >= 2)
+      {
+        decoded->hasParam = true;
+        decoded->param = ((uint16_t) param[0] << 8) | param[1];
+      }
+      break;
+    }
+    default:
+    {
+      break;
+    }
+  }
+  return true;
+}
+
+/** Gets a service from the service table
+ *  @param serviceIndex Index of the service
+ *  @return Pointer to the service, NULL if the index is out of range
+ */
+const uds_service_t *UDSGetService(uint8_t serviceIndex)
+{
+  if (serviceIndex >= UDS_NUM_SERVICES)
+  {
+    return NULL;
+  }
+  return &UDSServiceTable[serviceIndex];
+}
+
+/** Gets the name of a negative response code
+ *  @param nrc Negative response code
+ *  @return Name of the code, "unknown" if it is not in the table
+ */
+const char *UDSGetNrcName(uint8_t nrc)
+{
+  uint8_t nrcIndex = 0;
+  for (nrcIndex = 0; nrcIndex < sizeof(UDSNrcTable) / sizeof(UDSNrcTable[0]); nrcIndex++)
+  {
+    if (UDSNrcTable[nrcIndex].nrc == nrc)
+    {
+      return UDSNrcTable[nrcIndex].name;
+    }
+  }
+  return "unknown";
+}
+
+/** Resets an attack summary
+ *  @param *summary Summary to be reset
+ */
+void UDSSummaryReset(uds_summary_t *summary)
+{
+  memset(summary, 0, sizeof(uds_summary_t));
+}
+
+/** Adds a decoded PDU to an attack summary
+ *  @param *summary Summary to be updated
+ *  @param *decoded Decoded PDU
+ *  @param timestamp Timestamp of the PDU
+ */
+void UDSSummaryUpdate(uds_summary_t *summary, uds_decoded_t *decoded, uint32_t timestamp)
+{
+  summary->lastTimestamp = timestamp;
+  switch (decoded->type)
+  {
+    case eUDS_MSG_REQUEST:
+    {
+      summary->requests++;
+      summary->classCount[UDSServiceTable[decoded->serviceIndex].serviceClass]++;
+      break;
+    }
+    case eUDS_MSG_POSITIVE_RESPONSE:
+    {
+      summary->positiveResponses++;
+      break;
+    }
+    case eUDS_MSG_NEGATIVE_RESPONSE:
+    {
+      summary->negativeResponses++;
+      if ((decoded->nrc == UDS_NRC_INVALID_KEY) || (decoded->nrc == UDS_NRC_EXCEEDED_ATTEMPTS))
+      {
+        summary->rejectedKeys++;
+      }
+      break;
+    }
+    default:
+    {
+      break;
+    }
+  }
+}
+
+/** Classifies an attack by the most severe class of service requested
+ *  @param *summary Summary of the attack
+ *  @return Classification of the attack
+ */
+AttackClass_e UDSClassifyAttack(uds_summary_t *summary)
+{
+  const uint32_t *count = summary->classCount;
+
+  if (count[eUDS_CLASS_WRITE] || count[eUDS_CLASS_TRANSFER] || count[eUDS_CLASS_ROUTINE])
+  {
+    return eATTACK_REPROGRAMMING;
+  }
+  if (summary->rejectedKeys >= UDS_BRUTE_FORCE_THRESHOLD)
+  {
+    return eATTACK_SECURITY_BRUTE_FORCE;
+  }
+  if (count[eUDS_CLASS_SECURITY])
+  {
+    return eATTACK_SECURITY_ACCESS;
+  }
+  if (count[eUDS_CLASS_RESET])
+  {
+    return eATTACK_ECU_RESET;
+  }
+  if (count[eUDS_CLASS_IO_CONTROL])
+  {
+    return eATTACK_IO_CONTROL;
+  }
+  if (count[eUDS_CLASS_COMMUNICATION])
+  {
+    return eATTACK_COMMUNICATION_CONTROL;
+  }
+  if (count[eUDS_CLASS_SESSION])
+  {
+    return eATTACK_SESSION_CONTROL;
+  }
+  if (count[eUDS_CLASS_READ] || count[eUDS_CLASS_DTC])
+  {
+    return eATTACK_DIAGNOSTIC_SCAN;
+  }
+  if (count[eUDS_CLASS_KEEPALIVE])
+  {
+    return eATTACK_KEEPALIVE_ONLY;
+  }
+  return eATTACK_NONE;
+}
+
+/** Gets the name of an attack classification
+ *  @param attackClass Attack classification
+ *  @return Name of the classification
+ */
+const char *UDSGetAttackName(AttackClass_e attackClass)
+{
+  return AttackClassNames[attackClass];
+}
+
+/** Gets the name of a service class
+ *  @param serviceClass Service class
+ *  @return Name of the class
+ */
+const char *UDSGetClassName(UDSServiceClass_e serviceClass)
+{
+  return ServiceClassNames[serviceClass];
+}
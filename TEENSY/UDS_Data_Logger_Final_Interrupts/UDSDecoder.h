@@ -0,0 +1,113 @@
+/*
+  * @file UDSDecoder.h
+  *
+  * Table driven decoding of UDS (ISO 14229) / KWP2000 diagnostic PDUs and attack classification
+*/
+
+#ifndef UDSDECODER_H
+#define UDSDECODER_H
+
+/* INCLUDES */
+#include <stdint.h>
+#include <string.h>
+
+/* DEFINES */
+#define UDS_NEGATIVE_RESPONSE_SID     0x7F      // Service ID of every negative response
+#define UDS_POSITIVE_RESPONSE_OFFSET  0x40      // Added to the request service ID in a positive response
+#define UDS_SUPPRESS_RESPONSE_BIT     0x80      // Sub-function bit requesting no positive response
+#define UDS_NO_SERVICE                0xFF      // Service index of an unknown service ID
+#define UDS_BRUTE_FORCE_THRESHOLD     3         // Number of rejected security keys classified as a brute force attempt
+#define UDS_SUMMARY_IDLE_TIMEOUT      2000      // Time (ms) without diagnostic traffic before an unused summary is discarded
+
+#define UDS_NRC_SECURITY_DENIED       0x33
+#define UDS_NRC_INVALID_KEY           0x35
+#define UDS_NRC_EXCEEDED_ATTEMPTS     0x36
+#define UDS_NRC_RESPONSE_PENDING      0x78
+
+/* ENUMS */
+enum UDSServiceClass_e
+{
+  eUDS_CLASS_NONE = 0,
+  eUDS_CLASS_SESSION,
+  eUDS_CLASS_KEEPALIVE,
+  eUDS_CLASS_IO_CONTROL,
+  eUDS_CLASS_SECURITY,
+  eUDS_CLASS_RESET,
+  eUDS_CLASS_READ,
+  eUDS_CLASS_WRITE,
+  eUDS_CLASS_ROUTINE,
+  eUDS_CLASS_TRANSFER,
+  eUDS_CLASS_COMMUNICATION,
+  eUDS_CLASS_DTC,
+  eUDS_NUM_CLASSES
+};
+
+enum UDSParam_e
+{
+  eUDS_PARAM_NONE = 0,
+  eUDS_PARAM_SUB_FUNCTION,              // 1 byte sub-function, bit 7 suppresses the positive response
+  eUDS_PARAM_LOCAL_ID,                  // 1 byte KWP2000 local identifier
+  eUDS_PARAM_DATA_ID                    // 2 byte data identifier
+};
+
+enum UDSMessageType_e
+{
+  eUDS_MSG_UNKNOWN = 0,
+  eUDS_MSG_REQUEST,
+  eUDS_MSG_POSITIVE_RESPONSE,
+  eUDS_MSG_NEGATIVE_RESPONSE
+};
+
+enum AttackClass_e
+{
+  eATTACK_NONE = 0,
+  eATTACK_KEEPALIVE_ONLY,
+  eATTACK_DIAGNOSTIC_SCAN,
+  eATTACK_SESSION_CONTROL,
+  eATTACK_COMMUNICATION_CONTROL,
+  eATTACK_IO_CONTROL,
+  eATTACK_ECU_RESET,
+  eATTACK_SECURITY_ACCESS,
+  eATTACK_SECURITY_BRUTE_FORCE,
+  eATTACK_REPROGRAMMING
+};
+
+/* STRUCTS */
+typedef struct {
+  uint8_t sid;                          // Request service ID
+  const char *name;                     // Service name
+  UDSParam_e param;                     // Parameter following the service ID
+  UDSServiceClass_e serviceClass;       // Class used for attack classification
+} uds_service_t;
+
+typedef struct {
+  UDSMessageType_e type;                // Request, positive or negative response
+  uint8_t serviceIndex;                 // Index of the service in the service table, UDS_NO_SERVICE if unknown
+  uint8_t sid;                          // Request service ID (also for responses)
+  uint16_t param;                       // Sub-function, local identifier or data identifier
+  bool hasParam;                        // Whether or not the PDU carried the service parameter
+  bool suppressResponse;                // Whether or not the request suppresses its positive response
+  uint8_t nrc;                          // Negative response code (negative responses only)
+} uds_decoded_t;
+
+typedef struct {
+  uint32_t classCount[eUDS_NUM_CLASSES];  // Number of requests per service class
+  uint32_t requests;                      // Number of requests decoded
+  uint32_t positiveResponses;             // Number of positive responses decoded
+  uint32_t negativeResponses;             // Number of negative responses decoded
+  uint32_t rejectedKeys;                  // Number of security access keys rejected by the ECU
+  uint32_t lastTimestamp;                 // Timestamp of the last PDU added to the summary
+} uds_summary_t;
+
+/* FUNCTION PROTOTYPES */
+void UDSDecoderInit();
+bool UDSDecode(const uint8_t *data, uint16_t len, bool isResponse, uds_decoded_t *decoded);
+const uds_service_t *UDSGetService(uint8_t serviceIndex);
+const char *UDSGetNrcName(uint8_t nrc);
+void UDSSummaryReset(uds_summary_t *summary);
+void UDSSummaryUpdate(uds_summary_t *summary, uds_decoded_t *decoded, uint32_t timestamp);
+AttackClass_e UDSClassifyAttack(uds_summary_t *summary);
+const char *UDSGetAttackName(AttackClass_e attackClass);
+const char *UDSGetClassName(UDSServiceClass_e serviceClass);
+
+#endif // UDSDECODER_H
@@ -21,218 +21,361 @@
 
 
 /* DEFINES */
-#define UDS_ID                        0x7E8    // Arbitration ID of all UDS messages sent to the vehicle
-#define CIRCULAR_BUFFER_CAPACITY      1800      // Maximum capacity of the circular buffer, equates to ~1.2 seconds of CAN data
-#define LINEAR_BUFFER_CAPACITY        512       // Maximum capacity of the linear buffer
-#define MIN_CORRUPT_TRAFFIC_READINGS  90000     // Amount of corrupt CAN messages that will be recorded after each UDS message
+#define CAPTURE_RING_CAPACITY         (SESSION_BLOCK_SIZE * 8)  // Capacity of the shared capture ring (2048 frames), 6 to 7 blocks (~1 second of CAN data) are kept before a trigger
+#define WINDOW_TIMER_PERIOD           10000     // Period (us) of the timer that checks for the end of the post-trigger windows
+#define LOAD_TIMER_PERIOD             100       // Period (us) of the timer that sends traffic model frames (load source)
+#define LOAD_BITRATE                  TRAFFIC_BITRATE_500K // Bus speed the traffic model is timed for
+#define LOAD_FULL                     false     // Whether or not the load source fills the bus to 100% load
+#define BUS_RECOVERY_POLICY           eBUS_RECOVERY_AUTOMATIC  // How the controller leaves bus off, 'b' over Serial releases a held one
+#define BUS_RECOVERY_HOLDOFF          0         // Time (ms) to stay off the bus with eBUS_RECOVERY_HOLDOFF
+#define AUTOBAUD_TIMEOUT              10000     // Time (ms) to look for the bit rate of the bus with AUTOBAUD, then stay at the configured one
 
 //#define DIAG 1
 //#define PRINT 1
+//#define LOAD_SOURCE 1
+//#define AUTOBAUD 1
+
+static_assert(SESSION_RING_FITS(CAPTURE_RING_CAPACITY), "The capture ring has to hold a pre-trigger window and a free block");
 
 /* CONSTANTS */
 const char g_CbFileName[FILE_NAME_SIZE] = "Before_UDS_Attack_";
 const char g_LbFileName[FILE_NAME_SIZE] = "After_UDS_Attack_";
+const char g_BusFileName[FILE_NAME_SIZE] = "Bus_Events_";
 
 /* GLOBAL VARIABLES */
-circular_buffer_t g_CB;                   // Circular buffer
-linear_buffer_t g_LB;                     // Linear buffer
+circular_buffer_t g_CB;                   // Capture ring shared by every attack session
+isotp_reassembler_t g_IsoTp;              // ISO-TP reassembler for diagnostic PDUs
+session_manager_t g_Sessions;             // Attack sessions recorded from the capture ring
 SdFat g_SD;                               // SD Card object
+sd_recovery_t g_SdRecovery;               // Brings the SD card back after it failed
+sd_monitor_t g_SdMonitor;                 // Last known state of the SD card, probed only while it is idle
+bus_monitor_t g_BusMonitor;               // Fault confinement state of the CAN controller, bus off recovery
 model_t g_Model;                          // System model
 char g_Timestamp[TIMESTAMP_SIZE];         // Timestamp for each file saved to SD card, this marks the start time of the program
-SdFile g_CurrentFile;                     // File object of file traffic is currently being written to
-char g_currentFilePath[FILE_PATH_SIZE];   // Path of file traffic is currently being written to
-char g_currentFileName[FILE_NAME_SIZE];   // Name of file traffic is currently being written to
-
-
-/** Sets the file name and path for a new data file
- *  This function is used to set these parameters before opening a new file
- *  @param *filePath Full path of the file (to be set)
- *  @param *fileName Name of the file (to be set)
- *  @param *directory Directory of the new file
- *  @param *fileTitle Name of new file
- *  @param fileNumber File number to be appended to the end of the file name
- *  @param nameSize Size of the file name
- *  @param pathSize Size of the file path
+IntervalTimer g_WindowTimer;              // Timer that ends the post-trigger windows, also on an idle bus
+telemetry_t g_Telemetry;                  // Binary live telemetry over USB serial, started with a 't' over Serial
+#ifdef LOAD_SOURCE
+  traffic_model_t g_Traffic;              // Vehicle traffic model sent on the bus
+  FLEXCAN_frame_t g_LoadFrame;            // Next frame of the traffic model
+  uint64_t g_LoadEndNs;                   // Time the next frame is due to end on the bus
+  uint64_t g_LoadNowNs;                   // Time since the load source started
+  uint32_t g_LoadLastUs;                  // Time (micros) of the last load timer tick
+  IntervalTimer g_LoadTimer;              // Timer that sends the traffic model frames
+#endif
+
+
+/** Callback function for the post-trigger window timer
+ *  Flags the end of a session window so the main loop can close the session, even if no more frames arrive
  */
-void SetFileNameAndPath(char *filePath, char *fileName, char *directory, const char *fileTitle, uint32_t fileNumber, size_t nameSize, size_t pathSize)
+void window_timer_callback()
 {
-  snprintf(fileName, nameSize, "%s%lu.txt", fileTitle, fileNumber);
-  snprintf(filePath, pathSize, "%s/%s", directory, fileName);
+  SessionCheckWindows(&g_Sessions);
 }
 
-/** Sets parameters during a state change
- *  @param newReadType New 
+#ifdef LOAD_SOURCE
+/** Callback function for the load source timer
+ *  Queues every traffic model frame whose time has come; the TX queue spreads them over the
+ *  TX mailboxes and the controller does the real arbitration and bit timing. A frame the full
+ *  queue turns away is tried again on the next tick
  */
-void ChangeState(ReadType_e newReadType, NetworkState_e newNetworkState)
+void load_timer_callback()
 {
-  g_Model.readType = newReadType;
-  g_Model.networkState = newNetworkState;
-  
-  switch (newReadType)
+  uint32_t current = micros();
+  g_LoadNowNs += (uint64_t)(current - g_LoadLastUs) * 1000;
+  g_LoadLastUs = current;
+  while ((g_LoadEndNs <= g_LoadNowNs) && (FLEXCAN_txq_send(&g_LoadFrame, 0) == FLEXCAN_SUCCESS))
   {
-    case eREAD_LINEAR_BUFFER:
-    {
-      #ifdef DIAG
-        Serial.println("Changing State: Circular -> Linear");
-      #endif
-      
-      g_Model.numUDSMessages = 1;
-      g_Model.corruptMsgCount = 1;
-      SetFileNameAndPath(g_currentFilePath, g_currentFileName, g_Timestamp, g_LbFileName, g_Model.fileNumber, FILE_NAME_SIZE, FILE_PATH_SIZE);
-      OpenNewDataFile(&g_CurrentFile, g_currentFilePath, g_currentFileName);
-      g_CurrentFile.close();
-      break;
-    }
-    case eREAD_CIRCULAR_BUFFER:
-    {
-      #ifdef DIAG
-        Serial.println("Changing State: Linear -> Circular");
-      #endif
-      
-      g_Model.fileNumber++;
-      break;
-    }
-    default:
-    {
-      break;
-    }
+    TrafficNextFrame(&g_Traffic, &g_LoadFrame, &g_LoadEndNs);
   }
 }
+#endif
 
 /** Callback function for the CAN hardware fifo queue
- *  This callback is used to avoid the use of polling and therefore, increase CAN read speeds
+ *  This callback is used to avoid the use of polling and therefore, increase CAN read speeds.
+ *  Frames only go into the capture ring here, the attack files are written from the main loop.
  */
 void can_fifo_callback(uint8_t x)
 {
+  PROBE_SCOPE(ePROBE_FIFO_CALLBACK);
+  uint32_t start = ProbeNow();
+  HealthIsrBegin(&g_Model.health);
+  if (FLEXCAN0_IFLAG1 & FLEXCAN_IFLAG1_BUF7I) // FIFO overflow, sticky until cleared (write 1 to clear)
+  {
+    g_Model.health.fifoOverflows++;
+    FLEXCAN0_IFLAG1 = FLEXCAN_IFLAG1_BUF7I;
+  }
   if(FLEXCAN_fifo_avalible())
   {
     FLEXCAN_frame_t newFrame;
     can_message_t newMessage;
-    FLEXCAN_fifo_read(&newFrame);
-    TransposeCanMessage(&newMessage, &newFrame);
+    {
+      PROBE_SCOPE(ePROBE_FIFO_READ);
+      FLEXCAN_fifo_read(&newFrame);
+    }
+    {
+      PROBE_SCOPE(ePROBE_TRANSPOSE);
+      TransposeCanMessage(&newMessage, &newFrame);
+    }
+    LoggerProcessMessage(&newMessage);
+    BusMonitorFrame(&g_BusMonitor);
+  }
+  HealthIsrEnd(&g_Model.health, ProbeNow() - start);
+   return;
+}
 
-    #ifdef PRINT
-      SerialPrintCanMessage(&newMessage);
-    #endif
-    
-    switch (g_Model.readType)
-    { 
-      case eREAD_CIRCULAR_BUFFER:
+/** Callback function for the CAN error, warning and bus off interrupts
+ *  Queues a bus event when the controller changed state
+ */
+void can_status_callback(FLEXCAN_status_t *status)
+{
+  BusMonitorIsr(&g_BusMonitor, status);
+}
+
+/** Callback function for attack sessions opening (CAN callback) and closing (main loop)
+ *  Sends a trigger event over the telemetry stream
+ */
+void session_event_callback(const attack_session_t *session, SessionEvent_e event)
+{
+  TelemetryPushTrigger(&g_Telemetry, session, event, (event == eSESSION_EVENT_CLOSE));
+}
+
+/** Runs a received message through the capture logic: ISO-TP reassembly, attack triggers and
+ *  the capture ring. Called from the FIFO interrupt, or by any other input (SocketCAN on Linux).
+ *  @param *message Message with its receive timestamp
+ */
+void LoggerProcessMessage(can_message_t *message)
+{
+  if (IsoTpProcessMessage(&g_IsoTp, message))
+  {
+    SessionTrackPdu(&g_Sessions, IsoTpLastPdu(&g_IsoTp));
+  }
+  g_Model.health.isotpDroppedPdus = g_IsoTp.droppedPdus;  // between HealthIsrBegin and HealthIsrEnd of the FIFO callback
+  g_Model.health.isotpAbortedReassemblies = g_IsoTp.abortedReassemblies;
+
+  #ifdef PRINT
+    SerialPrintCanMessage(message);
+  #endif
+  TelemetryPushFrame(&g_Telemetry, message);
+
+  #ifdef DIAG
+    if ((SessionMatchRule(message) != SESSION_NO_RULE) && (g_Sessions.activeSessions == 0))
+    {
+      Serial.println("Found attack - opening attack session");
+      SerialPrintCanMessage(message);
+    }
+  #endif
+
+  if (SessionProcessMessage(&g_Sessions, message))
+  {
+    g_Model.totalMsgCount++;
+  }
+  g_Model.networkState = (g_Sessions.activeSessions > 0) ? eSTATE_CORRUPT_TRAFFIC : eSTATE_NORMAL_TRAFFIC;
+}
+
+/** Handles queued errors, recovers the SD card, writes the open attack sessions to it, probes the card
+ *  if it has been idle, follows the CAN bus faults and sends the telemetry stream, the main loop work
+ */
+void LoggerService(void)
+{
+  LoggerHandleErrors();
+  BusMonitorService(&g_BusMonitor);
+  if (SdRecoveryService(&g_SdRecovery))
+  {
+    SdMonitorReport(&g_SdMonitor, true);
+    if (!g_Telemetry.enabled)
+    {
+      SdRecoveryPrint(&g_SdRecovery, &Serial);
+    }
+  }
+  if (SessionActiveCount(&g_Sessions) > 0)
+  {
+    #ifdef DIAG
+      if (g_Sessions.windowExpired)
       {
-        if (newMessage.id == UDS_ID) // UDS message detected, an attack was launched
-        {
-          #ifdef DIAG
-            Serial.println("Found attack - dumping circular buffer to SD card");
-            SerialPrintCanMessage(&newMessage);
-          #endif
-          
-          if (!g_SD.exists(g_Timestamp)) // create a new directory after the first attack starts
-          {
-            MakeDirectory(g_Timestamp, &g_SD);
-          }
-
-          SetFileNameAndPath(g_currentFilePath, g_currentFileName, g_Timestamp, g_CbFileName, g_Model.fileNumber, FILE_NAME_SIZE, FILE_PATH_SIZE);
-          OpenNewDataFile(&g_CurrentFile, g_currentFilePath, g_currentFileName);
-          CircularBufferDumpToFile(&g_CB, &g_CurrentFile);
-          g_CurrentFile.close();
-          
-          LinearBufferPush(&g_LB, &newMessage);
-          ChangeState(eREAD_LINEAR_BUFFER, eSTATE_CORRUPT_TRAFFIC);
-        }
-        else
-        {
-          CircularBufferPush(&g_CB, &newMessage);
-        }
-        g_Model.totalMsgCount++;
-        break;
+        Serial.println("Session window elapsed - closing attack session");
       }
+    #endif
+    SessionService(&g_Sessions); // closes sessions only once the window timer has flagged them
+  }
+  if (!SdRecoveryActive(&g_SdRecovery))
+  {
+    SdMonitorService(&g_SdMonitor);
+  }
+  LoggerHandleBusEvents();
+  LoggerSerialCommand();
+  if (g_Telemetry.enabled && ((millis() - g_Telemetry.lastHealth) >= TELEMETRY_HEALTH_PERIOD))
+  {
+    TelemetrySendHealth(&g_Telemetry, &g_Model.health, &g_Sessions, g_Model.totalMsgCount);
+  }
+  TelemetryService(&g_Telemetry);
+}
 
-      case eREAD_LINEAR_BUFFER:
-      {
-        LinearBufferPush(&g_LB, &newMessage);
-        g_Model.corruptMsgCount++;
-        g_Model.totalMsgCount++;
-
-        if (g_LB.isFull)
-        {
-          #ifdef DIAG
-            Serial.println("Linear buffer full - dumping linear buffer to SD card");
-          #endif
-    
-          OpenDataFile(&g_CurrentFile, g_currentFilePath);
-          LinearBufferDumpToFile(&g_LB, &g_CurrentFile);
-          g_CurrentFile.close();
-        }
-        
-        if (newMessage.id == UDS_ID) // UDS message detected, an attack occured
-        {
-          g_Model.corruptMsgCount = 0;
-          g_Model.numUDSMessages++;
-          
-          #ifdef DIAG
-            Serial.print("  Another UDS Message found: ");
-            Serial.print(newMessage.id, HEX);
-            Serial.println(" (Extending read time)");
-          #endif
-        }
-        else if (g_Model.corruptMsgCount >= MIN_CORRUPT_TRAFFIC_READINGS)
-        {
-          #ifdef DIAG
-            Serial.println("UDS Message end - dumping linear buffer to SD card");
-          #endif
-    
-          OpenDataFile(&g_CurrentFile, g_currentFilePath);
-          LinearBufferDumpToFile(&g_LB, &g_CurrentFile);
-          char UDSMsgCountString[50];
-          sprintf(UDSMsgCountString, "\nUDS Messages Recorded: %lu", g_Model.numUDSMessages);
-          g_CurrentFile.println(UDSMsgCountString);
-          g_CurrentFile.close();
-          ChangeState(eREAD_CIRCULAR_BUFFER, eSTATE_CORRUPT_TRAFFIC);
-        }
+/** Reports the errors queued since the last pass and starts an SD recovery for SD card errors
+ *  Messages go to Serial unless it carries the telemetry stream
+ */
+void LoggerHandleErrors(void)
+{
+  error_event_t event;
+  char line[ERROR_CONTEXT_SIZE + 40];
+
+  while (ErrorPop(&event))
+  {
+    if (!g_Telemetry.enabled)
+    {
+      snprintf(line, sizeof(line), "%lu ms: %s (x%u)", (unsigned long) event.timestamp, GetErrorMessage(event.error), event.count);
+      Serial.println(line);
+    }
+    if (GetErrorType(event.error) == eERRTYPE_SD_RECOVERY)
+    {
+      SdRecoveryStart(&g_SdRecovery, &event);
+    }
+  }
+  g_Model.health.errorsDropped = ErrorDroppedCount();
+}
+
+/** Reports the bus events queued since the last pass
+ *  Each one goes to Serial unless it carries the telemetry stream, and to the bus event file
+ *  while the SD card can be written
+ */
+void LoggerHandleBusEvents(void)
+{
+  bus_event_t event;
+  SdFile file;
+  char filePath[FILE_PATH_SIZE];
+  char fileName[FILE_NAME_SIZE];
+  char line[120];
+  bool opened = false;
+  bool written = true;
+
+  while (BusMonitorPop(&g_BusMonitor, &event))
+  {
+    BusMonitorFormatEvent(&event, line, sizeof(line));
+    if (!g_Telemetry.enabled)
+    {
+      Serial.println(line);
+    }
+    if (!opened && g_Sessions.sdAvailable && !SdRecoveryActive(&g_SdRecovery) && (g_SD.exists(g_Timestamp) || MakeDirectory(g_Timestamp, &g_SD)))
+    {
+      SetFileNameAndPath(filePath, fileName, g_Timestamp, g_BusFileName, 0, FILE_NAME_SIZE, FILE_PATH_SIZE);
+      opened = OpenDataFile(&file, filePath);
+      SdMonitorReport(&g_SdMonitor, opened);
+    }
+    if (opened)
+    {
+      file.println(line);
+    }
+  }
+  if (opened)
+  {
+    written = !file.getWriteError();
+    written = file.close() && written;
+    SdMonitorReport(&g_SdMonitor, written);
+    if (!written)
+    {
+      HandleError(eERR_SD_FAILED_WRITE);
+    }
+  }
+}
+
+/** Handles single character commands sent over Serial, without waiting for them
+ *  'h' prints the health counters and the SD card state, 'p' prints the probe histograms, 'r' clears them,
+ *  't' starts the binary telemetry stream, 'q' stops it, 'b' lets a CAN controller held in bus off recover
+ */
+void LoggerSerialCommand(void)
+{
+  while (Serial.available() > 0)
+  {
+    switch (Serial.read())
+    {
+      case 'h':
+        HealthPrint(&g_Model.health, &Serial);
+        SdMonitorPrint(&g_SdMonitor, &Serial);
+        BusMonitorPrint(&g_BusMonitor, &Serial);
+        break;
+      case 'b':
+        BusMonitorRecover(&g_BusMonitor);
+        break;
+      case 'p':
+        PROBE_DUMP();
+        break;
+      case 't':
+        TelemetryEnable(&g_Telemetry, true);
+        break;
+      case 'q':
+        TelemetryEnable(&g_Telemetry, false);
+        break;
+      case 'r':
+        PROBE_RESET();
         break;
-      }
       default:
-      {
         break;
-      }
     }
   }
-   return;
 }
 
 void setup(void)
 {
   Serial.begin(115200);
+  PROBE_INIT();
   
   /* Model Configuration */
-  g_Model.readType = eREAD_CIRCULAR_BUFFER;  
   g_Model.networkState = eSTATE_NORMAL_TRAFFIC;
-  g_Model.corruptMsgCount = 0;
-  g_Model.fileNumber = 1;
-  g_Model.numUDSMessages = 0;
   g_Model.totalMsgCount = 0;
+  HealthInit(&g_Model.health, CAPTURE_RING_CAPACITY);
+  TelemetryInit(&g_Telemetry);
 
   /* Buffer Configuration */
-  CircularBufferInit(&g_CB, CIRCULAR_BUFFER_CAPACITY, sizeof(can_message_t));
-  LinearBufferInit(&g_LB, LINEAR_BUFFER_CAPACITY, sizeof(can_message_t));
+  CircularBufferInit(&g_CB, CAPTURE_RING_CAPACITY, sizeof(can_message_t));
+  IsoTpInit(&g_IsoTp);
+  UDSDecoderInit();
 
   /* Timing Configuration */
   RTCInit();
 
   /* File Writing Configuration */
   SetTimestamp(g_Timestamp, TIMESTAMP_SIZE);
-  SdInit(&g_SD, SD_CHIP_SELECT);
+  SdMonitorInit(&g_SdMonitor, &g_SD);
+  SdMonitorReport(&g_SdMonitor, SdInit(&g_SD, SD_CHIP_SELECT));
+  SessionInit(&g_Sessions, &g_CB, &g_IsoTp, &g_SD, g_Timestamp, g_CbFileName, g_LbFileName, &g_Model.health);
+  SessionRegisterCallback(&g_Sessions, session_event_callback);
+  SessionSetMonitor(&g_Sessions, &g_SdMonitor);
+  SdRecoveryInit(&g_SdRecovery, &g_SD, SD_CHIP_SELECT, &g_Sessions, &g_Model.health);
+  g_WindowTimer.begin(window_timer_callback, WINDOW_TIMER_PERIOD);
 
   /* CAN Network Configuration */
   FLEXCAN_config_t canConfig;
   CanConfigInit(&canConfig);
   FLEXCAN_init(canConfig);
+  #ifdef AUTOBAUD
+    can_autobaud_t autobaud;
+    CanAutobaudStart(&autobaud, CanBitRateTable, CAN_NUM_BIT_RATES, AUTOBAUD_TIMEOUT);
+    while (CanAutobaudService(&autobaud) == eAUTOBAUD_LISTENING)
+    {
+      yield();
+    }
+    CanAutobaudPrint(&autobaud, &Serial);
+    if (CanAutobaudResult(&autobaud) == NULL)
+    {
+      FLEXCAN_set_timing(canConfig);
+    }
+    FLEXCAN_set_listen_only(0);
+  #endif
   FLEXCAN_fifo_reg_callback(can_fifo_callback);
+  BusMonitorInit(&g_BusMonitor, BUS_RECOVERY_POLICY, BUS_RECOVERY_HOLDOFF);
+  FLEXCAN_status_reg_callback(can_status_callback);
+
+  #ifdef LOAD_SOURCE
+    FLEXCAN_txq_init(NULL);
+    TrafficInit(&g_Traffic, &TrafficVehicleProfile, LOAD_BITRATE, LOAD_FULL, micros());
+    TrafficNextFrame(&g_Traffic, &g_LoadFrame, &g_LoadEndNs);
+    g_LoadNowNs = 0;
+    g_LoadLastUs = micros();
+    g_LoadTimer.begin(load_timer_callback, LOAD_TIMER_PERIOD);
+  #endif
 }
 
 void loop(void)
 {
-  CheckStatus(&g_SD);
+  LoggerService();
   delay(10);
 }
-
@@ -0,0 +1,265 @@
+/*
+  * @file UdsClient.cpp
+  *
+  * Asynchronous UDS (ISO 14229) client over the ISO-TP links
+*/
+
+#include "UdsClient.h"
+
+/** Ends the active request of an ECU and reports it
+ *  @param *ecu ECU struct
+ *  @param result Outcome reported to the request callback
+ */
+static void UdsEcuComplete(uds_ecu_t *ecu, UdsResult_e result)
+{
+  uds_request_t *request = ecu->active;
+
+  ecu->active = NULL;
+  request->state = eUDS_REQUEST_IDLE;
+  request->doneAt = micros();
+  ecu->requests++;
+  switch (result)
+  {
+    case eUDS_RESULT_POSITIVE: { ecu->positives++; break; }
+    case eUDS_RESULT_NEGATIVE: { ecu->negatives++; break; }
+    case eUDS_RESULT_TIMEOUT: { ecu->timeouts++; break; }
+    case eUDS_RESULT_TRANSPORT: { ecu->transportErrors++; break; }
+    default: { break; }
+  }
+  if (request->callback != NULL)
+  {
+    request->callback(request, result);
+  }
+}
+
+/** Sends the next queued request of an ECU if nothing is outstanding and the link is free
+ *  @param *ecu ECU struct
+ */
+static void UdsEcuStartNext(uds_ecu_t *ecu)
+{
+  uds_request_t *request = ecu->head;
+
+  if ((ecu->active != NULL) || (request == NULL) || IsoTpLinkBusy(&ecu->link))
+  {
+    return;
+  }
+  if (!IsoTpLinkSend(&ecu->link, request->data, request->length))
+  {
+    return; // TX queue full, the next service tries again
+  }
+  ecu->head = request->next;
+  if (ecu->head == NULL)
+  {
+    ecu->tail = NULL;
+  }
+  request->next = NULL;
+  request->state = eUDS_REQUEST_SENDING;
+  request->sentAt = micros();
+  ecu->active = request;
+}
+
+/** Keeps the response of the active request
+ *  @param *request Active request
+ *  @param *data Response PDU
+ *  @param length Length of the response
+ */
+static void UdsRequestCopyResponse(uds_request_t *request, const uint8_t *data, uint16_t length)
+{
+  request->responseLength = length;
+  if (request->response != NULL)
+  {
+    memcpy(request->response, data, (length < request->responseSize) ? length : request->responseSize);
+  }
+}
+
+/** ISO-TP link callback: the active request was sent, or could not be
+ */
+static void uds_isotp_sent(isotp_link_t *link, IsoTpLinkResult_e result, const uint8_t *data, uint16_t length)
+{
+  uds_ecu_t *ecu = (uds_ecu_t *) link->arg;
+  uds_request_t *request = ecu->active;
+
+  if ((request != NULL) && (request->state == eUDS_REQUEST_SENDING))
+  {
+    if (result != eISOTP_N_OK)
+    {
+      request->isotpResult = result;
+      UdsEcuComplete(ecu, eUDS_RESULT_TRANSPORT);
+    }
+    else if (request->suppressed)
+    {
+      UdsEcuComplete(ecu, eUDS_RESULT_SENT);
+    }
+    else
+    {
+      request->state = eUDS_REQUEST_WAITING;
+      request->deadline = micros() + (ecu->p2 * 1000UL);
+    }
+  }
+  UdsEcuStartNext(ecu);
+}
+
+/** ISO-TP link callback: a response was received, or a reception failed
+ *  The response may come before the sent callback of a single frame request
+ */
+static void uds_isotp_received(isotp_link_t *link, IsoTpLinkResult_e result, const uint8_t *data, uint16_t length)
+{
+  uds_ecu_t *ecu = (uds_ecu_t *) link->arg;
+  uds_request_t *request = ecu->active;
+  uint8_t sid = 0;
+
+  if ((request == NULL) || request->suppressed)
+  {
+    ecu->unmatched += (result == eISOTP_N_OK) ? 1 : 0;
+    return;
+  }
+  if (result != eISOTP_N_OK)
+  {
+    request->isotpResult = result;
+    UdsEcuComplete(ecu, eUDS_RESULT_TRANSPORT);
+    UdsEcuStartNext(ecu);
+    return;
+  }
+
+  sid = request->data[0];
+  if ((length >= 3) && (data[0] == UDS_NEGATIVE_RESPONSE_SID) && (data[1] == sid))
+  {
+    if (data[2] == UDS_NRC_RESPONSE_PENDING)
+    {
+      ecu->pendings++;
+      request->pendings++;
+      request->state = eUDS_REQUEST_WAITING; // may come before the sent callback, which must not set P2 again
+      request->deadline = micros() + (ecu->p2Star * 1000UL);
+      return;
+    }
+    request->nrc = data[2];
+    UdsRequestCopyResponse(request, data, length);
+    UdsEcuComplete(ecu, eUDS_RESULT_NEGATIVE);
+  }
+  else if (data[0] == (uint8_t)(sid + UDS_POSITIVE_RESPONSE_OFFSET))
+  {
+    UdsRequestCopyResponse(request, data, length);
+    UdsEcuComplete(ecu, eUDS_RESULT_POSITIVE);
+  }
+  else
+  {
+    ecu->unmatched++; // late response to an earlier request, or not a response at all
+    return;
+  }
+  UdsEcuStartNext(ecu);
+}
+
+/** Initializes a UDS client with no ECUs
+ *  @param *client Client struct to be initialized
+ *  @param send Puts a frame on the bus, NULL for the FlexCAN TX queue (FLEXCAN_txq_init has to be called)
+ */
+void UdsClientInit(uds_client_t *client, isotp_send_frame_t send)
+{
+  memset(client, 0, sizeof(uds_client_t));
+  IsoTpStackInit(&client->stack, send);
+}
+
+/** Adds an ECU to a client, with the default P2 / P2* times (they may be set in the struct afterwards)
+ *  @param *client Client struct
+ *  @param *ecu ECU struct to be initialized
+ *  @param txId Arbitration ID the requests are sent on
+ *  @param rxId Arbitration ID the ECU responds on
+ *  @return Whether or not the client had room for the ECU
+ */
+bool UdsClientAddEcu(uds_client_t *client, uds_ecu_t *ecu, uint32_t txId, uint32_t rxId)
+{
+  if (client->numEcus >= UDS_CLIENT_MAX_ECUS)
+  {
+    return false;
+  }
+  memset(ecu, 0, sizeof(uds_ecu_t));
+  ecu->p2 = UDS_CLIENT_P2;
+  ecu->p2Star = UDS_CLIENT_P2_STAR;
+  IsoTpLinkInit(&ecu->link, txId, rxId, ecu->rxBuffer, UDS_CLIENT_RX_SIZE, uds_isotp_received, uds_isotp_sent, ecu);
+  if (!IsoTpStackAdd(&client->stack, &ecu->link))
+  {
+    return false;
+  }
+  client->ecus[client->numEcus++] = ecu;
+  return true;
+}
+
+/** Initializes a request
+ *  @param *request Request struct to be initialized
+ *  @param *data Request PDU, service ID first
+ *  @param length Length of the request
+ *  @param *response Buffer for the response, NULL if not needed
+ *  @param responseSize Size of the response buffer
+ *  @param callback Called when the request is done, NULL if none
+ *  @param *arg Left to the owner of the request
+ */
+void UdsRequestInit(uds_request_t *request, const uint8_t *data, uint16_t length, uint8_t *response, uint16_t responseSize,
+                    uds_request_callback_t callback, void *arg)
+{
+  memset(request, 0, sizeof(uds_request_t));
+  request->data = data;
+  request->length = length;
+  request->response = response;
+  request->responseSize = responseSize;
+  request->callback = callback;
+  request->arg = arg;
+}
+
+/** Queues a request to an ECU, it is sent right away if nothing else is outstanding to the ECU
+ *  @param *ecu ECU added to a client
+ *  @param *request Request initialized by UdsRequestInit and not already submitted
+ *  @return Whether or not the request was queued
+ */
+bool UdsClientSubmit(uds_ecu_t *ecu, uds_request_t *request)
+{
+  uds_decoded_t decoded;
+
+  if ((request->state != eUDS_REQUEST_IDLE) || (request->length == 0) || (request->length > ISOTP_LINK_MAX_LENGTH))
+  {
+    return false;
+  }
+  UDSDecode(request->data, request->length, false, &decoded);
+  request->suppressed = decoded.suppressResponse;
+  request->responseLength = 0;
+  request->nrc = 0;
+  request->isotpResult = eISOTP_N_OK;
+  request->pendings = 0;
+  request->submittedAt = micros();
+  request->state = eUDS_REQUEST_QUEUED;
+  request->next = NULL;
+  if (ecu->tail != NULL)
+  {
+    ecu->tail->next = request;
+  }
+  else
+  {
+    ecu->head = request;
+  }
+  ecu->tail = request;
+  UdsEcuStartNext(ecu);
+  return true;
+}
+
+/** Runs the client, called from the main loop as often as it can
+ *  Services the ISO-TP links (the request callbacks are called from here), times out the
+ *  requests past their deadline and sends the next queued requests
+ *  @param *client Client struct
+ */
+void UdsClientService(uds_client_t *client)
+{
+  uds_ecu_t *ecu = NULL;
+  uint32_t now = 0;
+  uint8_t i = 0;
+
+  IsoTpStackService(&client->stack);
+  now = micros();
+  for (i = 0; i < client->numEcus; i++)
+  {
+    ecu = client->ecus[i];
+    if ((ecu->active != NULL) && (ecu->active->state == eUDS_REQUEST_WAITING) && ((int32_t)(now - ecu->active->deadline) >= 0))
+    {
+      UdsEcuComplete(ecu, eUDS_RESULT_TIMEOUT);
+    }
+    UdsEcuStartNext(ecu);
+  }
+}
@@ -0,0 +1,120 @@
+/*
+  * @file UdsClient.h
+  *
+  * Asynchronous UDS (ISO 14229) client over the ISO-TP links. Every ECU has its own ID pair
+  * and its own queue of requests, so requests to different ECUs are outstanding at the same
+  * time and the next request to an ECU goes out as soon as the previous one is answered,
+  * instead of sending one request and waiting a fixed time for the answer. A response is
+  * matched to the request waiting on its ID pair by its service ID (positive or negative);
+  * a response pending (NRC 0x78) moves the deadline from P2 out to P2*, anything else that
+  * does not match is counted and dropped. Requests with the suppress positive response bit
+  * are done once sent. Timeouts are deadlines checked by UdsClientService, nothing waits.
+  *
+  * Requests are allocated by the caller and belong to the client from UdsClientSubmit until
+  * their callback, which runs in the main loop (UdsClientService) and may submit again.
+*/
+
+#ifndef UDSCLIENT_H
+#define UDSCLIENT_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <stdint.h>
+#include <string.h>
+#include "IsoTpLink.h"
+#include "UDSDecoder.h"
+
+/* DEFINES */
+#define UDS_CLIENT_MAX_ECUS           ISOTP_STACK_MAX_LINKS  // Maximum number of ECUs, one ISO-TP link each
+#define UDS_CLIENT_RX_SIZE            512       // Longest response (bytes) received from an ECU
+#define UDS_CLIENT_P2                 50        // Default time (ms) for the ECU to start its response (P2 client)
+#define UDS_CLIENT_P2_STAR            5000      // Default time (ms) for the ECU to respond after a response pending (P2* client)
+
+/* ENUMS */
+enum UdsRequestState_e
+{
+  eUDS_REQUEST_IDLE = 0,                // Not submitted, or done
+  eUDS_REQUEST_QUEUED,                  // Waiting for the requests before it to the same ECU
+  eUDS_REQUEST_SENDING,                 // Being sent over ISO-TP
+  eUDS_REQUEST_WAITING                  // Sent, waiting for the response until the deadline
+};
+
+enum UdsResult_e
+{
+  eUDS_RESULT_POSITIVE = 0,             // Positive response received
+  eUDS_RESULT_NEGATIVE,                 // Negative response received, see nrc
+  eUDS_RESULT_SENT,                     // Sent with the suppress positive response bit, no response awaited
+  eUDS_RESULT_TIMEOUT,                  // No response by the P2 / P2* deadline
+  eUDS_RESULT_TRANSPORT                 // ISO-TP failed sending the request or receiving the response, see isotpResult
+};
+
+/* STRUCTS */
+struct uds_request_s;
+
+typedef void (*uds_request_callback_t)(struct uds_request_s *request, UdsResult_e result);
+
+typedef struct uds_request_s {
+  const uint8_t *data;                  // Request PDU, service ID first, owned by the caller until the callback
+  uint16_t length;                      // Length of the request
+  uint8_t *response;                    // Response PDU is copied here, NULL if not needed
+  uint16_t responseSize;                // Size of the response buffer, longer responses are cut
+  uds_request_callback_t callback;      // Called when the request is done
+  void *arg;                            // Left to the owner of the request
+
+  uint16_t responseLength;              // Length of the response received (before cutting)
+  uint8_t nrc;                          // Negative response code of a negative response
+  uint8_t isotpResult;                  // IsoTpLinkResult_e of a transport failure
+  uint8_t pendings;                     // Number of response pending (0x78) responses received
+  uint32_t submittedAt;                 // Time (micros) the request was submitted
+  uint32_t sentAt;                      // Time (micros) the request was sent
+  uint32_t doneAt;                      // Time (micros) the request was done
+
+  uint8_t state;                        // UdsRequestState_e
+  bool suppressed;                      // Whether or not the request suppresses its positive response
+  uint32_t deadline;                    // Time (micros) the response has to start by
+  struct uds_request_s *next;           // Next request queued to the same ECU
+} uds_request_t;
+
+typedef struct {
+  isotp_link_t link;                    // ISO-TP link to the ECU
+  uint8_t rxBuffer[UDS_CLIENT_RX_SIZE]; // Responses are received here
+  uint16_t p2;                          // Time (ms) for the ECU to start its response
+  uint16_t p2Star;                      // Time (ms) for the ECU to respond after a response pending
+  uds_request_t *active;                // Request being sent or waiting for its response
+  uds_request_t *head;                  // Requests queued behind it
+  uds_request_t *tail;
+
+  uint32_t requests;                    // Number of requests done
+  uint32_t positives;                   // Number of positive responses
+  uint32_t negatives;                   // Number of negative responses (not counting response pending)
+  uint32_t pendings;                    // Number of response pending responses
+  uint32_t timeouts;                    // Number of requests timed out
+  uint32_t transportErrors;             // Number of requests failed by ISO-TP
+  uint32_t unmatched;                   // Number of responses with no request waiting for them
+} uds_ecu_t;
+
+typedef struct {
+  isotp_stack_t stack;                  // ISO-TP stack of the ECU links
+  uds_ecu_t *ecus[UDS_CLIENT_MAX_ECUS]; // ECUs talked to
+  uint8_t numEcus;                      // Number of ECUs
+} uds_client_t;
+
+/* FUNCTION PROTOTYPES */
+void UdsClientInit(uds_client_t *client, isotp_send_frame_t send);
+bool UdsClientAddEcu(uds_client_t *client, uds_ecu_t *ecu, uint32_t txId, uint32_t rxId);
+void UdsRequestInit(uds_request_t *request, const uint8_t *data, uint16_t length, uint8_t *response, uint16_t responseSize,
+                    uds_request_callback_t callback, void *arg);
+bool UdsClientSubmit(uds_ecu_t *ecu, uds_request_t *request);
+void UdsClientService(uds_client_t *client);
+
+/** Passes a received frame to the client, called from the CAN interrupt
+ *  @param *client Client struct
+ *  @param *frame Frame received
+ *  @return Whether or not the frame came from one of the ECUs
+ */
+static inline bool UdsClientReceive(uds_client_t *client, const FLEXCAN_frame_t *frame)
+{
+  return IsoTpStackReceive(&client->stack, frame);
+}
+
+#endif // UDSCLIENT_H
@@ -10,8 +10,10 @@
  *        file. This code can be expanded to send test commands to the vehicle.
  *        
  * Notes: 
- *        - The "CAN_BUS_Shield-master" library must be added to your Arduino IDE for this
- *          program to compile successfully.
+ *        - The "CAN_BUS_Shield-master" and "TimerWheel" libraries must be added to your Arduino IDE
+ *          for this program to compile successfully.
+ *        - The periodic packets are sent from a timer wheel moved on by millis() in the loop, so
+ *          reading is never held up by a delay().
  *        - This program is written for the SEEED CAN Bus Shield.
  *        - This code has only been tested on a 2014 Nissan Altima. It may work on other
  *          vehicles, but this is not certain.
@@ -20,6 +22,7 @@
 /* INCLUDES */
 #include <mcp_can.h>
 #include <SPI.h>
+#include <TimerWheel.h>
 
 /* CONSTANTS */
 const int SPI_CS_PIN = 9; // SPI chip select pin set to 9
@@ -27,12 +30,12 @@ const int SPI_CS_PIN = 9; // SPI chip select pin set to 9
 const unsigned int TESTER_PRESENT_SEND_FREQ = 2000; // send tester present command every 2000 ms
 unsigned char TESTER_PRESENT_PAYLOAD[3]  = {0x02, 0x3E, 0x01}; // payload of tester present packet
 const unsigned int TESTER_PRESENT_PAYLOAD_SIZE = 3; // tester present packet payload size
-const unsigned char TESTER_PRESENT_PID = 0x7E0; // tester present packet ID
+const unsigned long TESTER_PRESENT_PID = 0x7E0; // tester present packet ID
 // Message - 0x7E0: PID, 0x02: data size, 0x3E: tester present command, 0x01: parameter
 // Expected Response - 0x7E8: Response PID, 0x01: data size, 0x7E: response to 0x3E command (0x7E = 0x3E + 0x40)
 
 unsigned char DIAG_MODE_PAYLOAD[3]  = {0x02, 0x10, 0xC0}; // payload of tester present packet
-const unsigned char DIAG_MODE_PID = 0x745;
+const unsigned long DIAG_MODE_PID = 0x745;
 const unsigned int DIAG_MODE_PAYLOAD_SIZE = 3; // tester present packet payload size
 
 unsigned char DIAG_RIGHT_BLINKER_PAYLOAD[5] = {0x04, 0x30, 0x2F, 0x20, 0x01};
@@ -41,10 +44,29 @@ const unsigned int STANDARD_FRAME = 0; // Standard frame parameter
 
 unsigned char DIAG_POLL_PAYLOAD[3] = {0x02, 0x30, 0x00};
 unsigned int DIAG_POLL_SIZE = 3;
+const unsigned int DIAG_POLL_DELAY = 100; // send the poll 100 ms after the diagnostic mode request
 
 /* SHIELD SETUP */
 MCP_CAN CAN(SPI_CS_PIN);  // Set ship select pin
 
+/* TIMERS */
+timer_wheel_t wheel;                // 1 ms ticks, moved on by millis()
+wheel_timer_t testerPresentTimer;   // periodic tester present
+wheel_timer_t diagPollTimer;        // one-shot poll after the diagnostic mode request
+
+void tester_present_callback(void *arg)
+{
+    Serial.print(millis());
+    Serial.print(": Sent tester present");
+    Serial.println();
+    CAN.sendMsgBuf(TESTER_PRESENT_PID, STANDARD_FRAME, TESTER_PRESENT_PAYLOAD_SIZE, TESTER_PRESENT_PAYLOAD);
+}
+
+void diag_poll_callback(void *arg)
+{
+    CAN.sendMsgBuf(DIAG_MODE_PID, STANDARD_FRAME, DIAG_POLL_SIZE, DIAG_POLL_PAYLOAD);
+}
+
 void setup()
 {
     Serial.begin(115200);
@@ -60,6 +82,15 @@ void setup()
         Serial.println("Init CAN BUS Shield again");
         delay(100);
     }
+
+    TimerWheelInit(&wheel, millis());
+    TimerWheelSetup(&testerPresentTimer, tester_present_callback, NULL);
+    TimerWheelSetup(&diagPollTimer, diag_poll_callback, NULL);
+
+    Serial.println("Sent diagnostic mode request");
+    CAN.sendMsgBuf(DIAG_MODE_PID, STANDARD_FRAME, DIAG_MODE_PAYLOAD_SIZE, DIAG_MODE_PAYLOAD);
+    TimerWheelStart(&wheel, &diagPollTimer, DIAG_POLL_DELAY, 0);
+    TimerWheelStart(&wheel, &testerPresentTimer, TESTER_PRESENT_SEND_FREQ, TESTER_PRESENT_SEND_FREQ); // periodically send the tester present message
 }
 
 
@@ -68,26 +99,11 @@ void loop()
     unsigned char len = 0;  // length of data
     unsigned char buf[8];   // 8 byte data buffer
     unsigned long timestamp = millis();   // get time since program started in milliseconds
-/*
-    if (timestamp % TESTER_PRESENT_SEND_FREQ) // periodically send the tester present message
-    {
-      Serial.print(timestamp);
-      Serial.print(": Sent tester present");
-      Serial.println();
-        CAN.sendMsgBuf(TESTER_PRESENT_PID, STANDARD_FRAME, TESTER_PRESENT_PAYLOAD_SIZE, TESTER_PRESENT_PAYLOAD);
-    }*/
 
-    Serial.println("Sent diagnostic mode request");
-    CAN.sendMsgBuf(DIAG_MODE_PID, STANDARD_FRAME, DIAG_MODE_PAYLOAD_SIZE, DIAG_MODE_PAYLOAD);
-    delay(100);
-    CAN.sendMsgBuf(DIAG_MODE_PID, STANDARD_FRAME, DIAG_POLL_SIZE, DIAG_POLL_PAYLOAD);
-   // Serial.println("Sent diagnostic mode blinker request");
-  //  CAN.sendMsgBuf(DIAG_MODE_PID, STANDARD_FRAME, DIAG_RIGHT_BLINKER_SIZE, DIAG_RIGHT_BLINKER_PAYLOAD);
-  while(true)
-  {
+    TimerWheelAdvance(&wheel, timestamp); // send the periodic packets that are due
+
     if(CAN_MSGAVAIL == CAN.checkReceive())    // check if data is coming in
     {
-      timestamp = millis();
         CAN.readMsgBuf(&len, buf);            // read data,  len: data length, buf: data buffer
         
         unsigned long canId = CAN.getCanId(); // get the ID of the CAN message
@@ -112,7 +128,6 @@ void loop()
         Serial.println();
     }
 }
-}
 
 /*********************************************************************************************************
   END FILE
@@ -0,0 +1,231 @@
+/*
+  * @file TimerWheel.cpp
+  *
+  * Hierarchical timer wheel: runs any number of periodic and one-shot timers off one time source
+*/
+
+/* INCLUDES */
+#include "TimerWheel.h"
+
+/** Keeps the tick from running while the timer lists change
+ *  @return State to be given back to TimerWheelUnlock
+ */
+static inline uint8_t TimerWheelLock(void)
+{
+#if defined(__AVR__)
+  uint8_t state = SREG;
+  cli();
+  return state;
+#else
+  __disable_irq();
+  return 0;
+#endif
+}
+
+/** Lets the tick run again
+ *  @param state State returned by TimerWheelLock
+ */
+static inline void TimerWheelUnlock(uint8_t state)
+{
+#if defined(__AVR__)
+  SREG = state;
+#else
+  (void) state;
+  __enable_irq();
+#endif
+}
+
+/** Takes a timer out of its slot, called with the wheel locked
+ *  @param *timer Running timer
+ */
+static void TimerWheelUnlink(wheel_timer_t *timer)
+{
+  *timer->pprev = timer->next;
+  if (timer->next != NULL)
+  {
+    timer->next->pprev = timer->pprev;
+  }
+  timer->next = NULL;
+  timer->pprev = NULL;
+}
+
+/** Puts a timer into the slot of its expiry, called with the wheel locked
+ *  The level is the lowest one whose slots together cover the time left, so the timer is
+ *  reached by the time the level below wraps around to it
+ *  @param *wheel Timer wheel struct
+ *  @param *timer Timer not running
+ */
+static void TimerWheelAdd(timer_wheel_t *wheel, wheel_timer_t *timer)
+{
+  uint32_t expires = timer->expires;
+  uint32_t delta = expires - wheel->now;
+  uint8_t level = 0;
+  wheel_timer_t **slot = NULL;
+
+  if ((int32_t) delta < 0) // moved down on its own tick
+  {
+    delta = 0;
+    expires = wheel->now;
+  }
+  else if (delta > TIMER_WHEEL_RANGE) // goes round the top level and is placed again when it comes down
+  {
+    delta = TIMER_WHEEL_RANGE;
+    expires = wheel->now + TIMER_WHEEL_RANGE;
+  }
+  while ((level < (TIMER_WHEEL_LEVELS - 1)) && ((delta >> ((level + 1) * TIMER_WHEEL_SLOT_BITS)) != 0))
+  {
+    level++;
+  }
+
+  slot = &wheel->slots[level][(expires >> (level * TIMER_WHEEL_SLOT_BITS)) & TIMER_WHEEL_SLOT_MASK];
+  timer->next = *slot;
+  if (*slot != NULL)
+  {
+    (*slot)->pprev = &timer->next;
+  }
+  *slot = timer;
+  timer->pprev = slot;
+}
+
+/** Moves the timers of a slot down to the levels their time left falls in, called with the wheel locked
+ *  @param *wheel Timer wheel struct
+ *  @param level Level of the slot, not 0
+ *  @param index Slot number
+ */
+static void TimerWheelCascade(timer_wheel_t *wheel, uint8_t level, uint32_t index)
+{
+  wheel_timer_t *timer = wheel->slots[level][index];
+  wheel_timer_t *next = NULL;
+
+  wheel->slots[level][index] = NULL;
+  while (timer != NULL)
+  {
+    next = timer->next;
+    TimerWheelAdd(wheel, timer);
+    wheel->cascaded++;
+    timer = next;
+  }
+}
+
+/** Initializes a timer wheel with no timers
+ *  @param *wheel Timer wheel struct to be initialized
+ *  @param now Current tick, e.g. millis() for a wheel driven with TimerWheelAdvance
+ */
+void TimerWheelInit(timer_wheel_t *wheel, uint32_t now)
+{
+  memset(wheel, 0, sizeof(timer_wheel_t));
+  wheel->now = now;
+}
+
+/** Initializes a timer, it does not run until started
+ *  @param *timer Timer struct to be initialized
+ *  @param callback Called when the timer expires
+ *  @param *arg Passed to the callback
+ */
+void TimerWheelSetup(wheel_timer_t *timer, timer_wheel_callback_t callback, void *arg)
+{
+  memset(timer, 0, sizeof(wheel_timer_t));
+  timer->callback = callback;
+  timer->arg = arg;
+}
+
+/** Starts a timer, or starts it again if it is running
+ *  @param *wheel Timer wheel struct
+ *  @param *timer Timer
+ *  @param delay Ticks until the first expiry, at least 1
+ *  @param period Ticks between the following expiries, 0 for a one-shot timer
+ */
+void TimerWheelStart(timer_wheel_t *wheel, wheel_timer_t *timer, uint32_t delay, uint32_t period)
+{
+  uint8_t state = TimerWheelLock();
+  if (timer->pprev != NULL)
+  {
+    TimerWheelUnlink(timer);
+  }
+  timer->expires = wheel->now + ((delay > 0) ? delay : 1);
+  timer->period = period;
+  TimerWheelAdd(wheel, timer);
+  TimerWheelUnlock(state);
+}
+
+/** Stops a timer, its callback is not called again
+ *  @param *wheel Timer wheel struct
+ *  @param *timer Timer
+ *  @return Whether or not the timer was running
+ */
+bool TimerWheelCancel(timer_wheel_t *wheel, wheel_timer_t *timer)
+{
+  bool running = false;
+  uint8_t state = TimerWheelLock();
+  if (timer->pprev != NULL)
+  {
+    TimerWheelUnlink(timer);
+    running = true;
+  }
+  TimerWheelUnlock(state);
+  return running;
+}
+
+/** Moves the wheel on by one tick and runs the callbacks of the timers expiring on it
+ *  Called from the hardware timer interrupt, or through TimerWheelAdvance. A periodic timer is
+ *  started again before its callback runs, so the callback may cancel or restart it
+ *  @param *wheel Timer wheel struct
+ */
+void TimerWheelTick(timer_wheel_t *wheel)
+{
+  wheel_timer_t *expired = NULL;
+  wheel_timer_t *timer = NULL;
+  uint32_t now = 0;
+  uint8_t level = 0;
+  uint8_t state = TimerWheelLock();
+
+  now = wheel->now + 1;
+  wheel->now = now;
+  for (level = 1; (level < TIMER_WHEEL_LEVELS) && (((now >> ((level - 1) * TIMER_WHEEL_SLOT_BITS)) & TIMER_WHEEL_SLOT_MASK) == 0); level++)
+  {
+    TimerWheelCascade(wheel, level, (now >> (level * TIMER_WHEEL_SLOT_BITS)) & TIMER_WHEEL_SLOT_MASK);
+  }
+
+  // every timer in the level 0 slot expires now; taken off the wheel so callbacks starting a timer cannot add to it
+  expired = wheel->slots[0][now & TIMER_WHEEL_SLOT_MASK];
+  wheel->slots[0][now & TIMER_WHEEL_SLOT_MASK] = NULL;
+  if (expired != NULL)
+  {
+    expired->pprev = &expired;
+  }
+  TimerWheelUnlock(state);
+
+  while (true)
+  {
+    state = TimerWheelLock();
+    timer = expired; // a callback may have cancelled the next one
+    if (timer == NULL)
+    {
+      TimerWheelUnlock(state);
+      return;
+    }
+    TimerWheelUnlink(timer);
+    if (timer->period > 0)
+    {
+      timer->expires += timer->period;
+      TimerWheelAdd(wheel, timer);
+    }
+    wheel->expired++;
+    TimerWheelUnlock(state);
+
+    timer->callback(timer->arg);
+  }
+}
+
+/** Moves the wheel on to a time, running every tick missed since the last call
+ *  Called from the main loop, e.g. with millis() for a 1 ms tick
+ *  @param *wheel Timer wheel struct
+ *  @param now Current tick
+ */
+void TimerWheelAdvance(timer_wheel_t *wheel, uint32_t now)
+{
+  while ((int32_t)(now - wheel->now) > 0)
+  {
+    TimerWheelTick(wheel);
+  }
+}
@@ -0,0 +1,73 @@
+/*
+  * @file TimerWheel.h
+  *
+  * Hierarchical timer wheel: runs any number of periodic and one-shot timers off one time
+  * source. Level 0 has a slot per tick, every level above covers TIMER_WHEEL_SLOTS slots of
+  * the one below; a timer goes into the level its delay falls in and moves down a level each
+  * time the level below wraps around, so starting and cancelling a timer are O(1) and a tick
+  * only touches the timers that expire on it (plus one cascade every TIMER_WHEEL_SLOTS ticks).
+  * Delays past the top level go round the top level again until they are in range.
+  *
+  * The wheel is driven by a hardware timer calling TimerWheelTick once per tick, or by the main
+  * loop calling TimerWheelAdvance with the time, which catches up on every tick missed. Timer
+  * callbacks run in that context and must not wait; starting and cancelling timers is safe from
+  * both the main loop and the callbacks. Timers are allocated by the caller.
+  *
+  * Install this folder as an Arduino library to use it in a sketch.
+*/
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+/* INCLUDES */
+#include <Arduino.h>
+#include <stdint.h>
+
+/* DEFINES */
+#ifndef TIMER_WHEEL_SLOT_BITS
+#define TIMER_WHEEL_SLOT_BITS         5         // Slots per level as a power of two
+#endif
+#ifndef TIMER_WHEEL_LEVELS
+#define TIMER_WHEEL_LEVELS            4         // Number of levels, the wheel covers 2^(SLOT_BITS x LEVELS) ticks
+#endif
+#define TIMER_WHEEL_SLOTS             (1UL << TIMER_WHEEL_SLOT_BITS)  // Slots per level
+#define TIMER_WHEEL_SLOT_MASK         (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_RANGE             ((1UL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS)) - 1)  // Longest delay (ticks) placed without going round the top level
+
+/* STRUCTS */
+typedef void (*timer_wheel_callback_t)(void *arg);
+
+typedef struct wheel_timer_s {
+  struct wheel_timer_s *next;           // Next timer in the slot
+  struct wheel_timer_s **pprev;         // Link pointing at this timer, NULL while not running
+  uint32_t expires;                     // Tick the timer expires on
+  uint32_t period;                      // Ticks between expiries, 0 for a one-shot timer
+  timer_wheel_callback_t callback;      // Called when the timer expires
+  void *arg;                            // Passed to the callback
+} wheel_timer_t;
+
+typedef struct {
+  wheel_timer_t *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];  // Timers by level and slot
+  volatile uint32_t now;                // Current tick
+  uint32_t expired;                     // Number of callbacks run
+  uint32_t cascaded;                    // Number of timers moved down a level
+} timer_wheel_t;
+
+/* FUNCTION PROTOTYPES */
+void TimerWheelInit(timer_wheel_t *wheel, uint32_t now);
+void TimerWheelSetup(wheel_timer_t *timer, timer_wheel_callback_t callback, void *arg);
+void TimerWheelStart(timer_wheel_t *wheel, wheel_timer_t *timer, uint32_t delay, uint32_t period);
+bool TimerWheelCancel(timer_wheel_t *wheel, wheel_timer_t *timer);
+void TimerWheelTick(timer_wheel_t *wheel);
+void TimerWheelAdvance(timer_wheel_t *wheel, uint32_t now);
+
+/** Checks whether or not a timer is running
+ *  @param *timer Timer
+ *  @return Whether or not the timer is waiting to expire
+ */
+static inline bool TimerWheelActive(const wheel_timer_t *timer)
+{
+  return timer->pprev != NULL;
+}
+
+#endif // TIMERWHEEL_H